@@ -0,0 +1,1340 @@
+/** @file rpchat_bench.c
+ *
+ * @brief Load generator for the BCP server: argument handling, the client
+ * state machine run over each thread's connections, and the report. Threads
+ * own their epoll instance and connections outright, so nothing is shared
+ * between them until their results are merged at the end
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#include "rpchat_bench.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rpchat_basic_chat_util.h"
+
+#define RPCHAT_BENCH_NS_PER_MS  1000000ULL
+#define RPCHAT_BENCH_NS_PER_SEC 1000000000ULL
+#define RPCHAT_BENCH_HIST_SUB_MASK \
+    ((UINT64_C(1) << RPCHAT_BENCH_HIST_SUB_SHIFT) - 1)
+
+static const char *const gp_scenario_names[RPCHAT_BENCH_NUM_SCENARIOS]
+    = { "steady", "storm", "slowack" };
+
+/**
+ * Take a timestamp. Senders and receivers share the clock, so latencies are
+ * only meaningful with the bench running on a single host
+ * @return Monotonic time in nanoseconds
+ */
+static uint64_t
+rpchat_bench_now(void)
+{
+    struct timespec now; // current time
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * RPCHAT_BENCH_NS_PER_SEC)
+           + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Find the bucket a latency falls in
+ * @param latency_ns Latency in nanoseconds
+ * @return Bucket index
+ */
+static size_t
+rpchat_bench_bucket(uint64_t latency_ns)
+{
+    unsigned int shift = 0; // position of highest bit set
+
+    if ((UINT64_C(1) << RPCHAT_BENCH_HIST_MIN_SHIFT) > latency_ns)
+    {
+        return 0;
+    }
+    if ((UINT64_C(1) << RPCHAT_BENCH_HIST_MAX_SHIFT) <= latency_ns)
+    {
+        return RPCHAT_BENCH_HIST_BUCKETS - 1;
+    }
+    shift = 63 - (unsigned int)__builtin_clzll(latency_ns);
+    return 1
+           + ((size_t)(shift - RPCHAT_BENCH_HIST_MIN_SHIFT)
+              << RPCHAT_BENCH_HIST_SUB_SHIFT)
+           + ((latency_ns >> (shift - RPCHAT_BENCH_HIST_SUB_SHIFT))
+              & RPCHAT_BENCH_HIST_SUB_MASK);
+}
+
+/**
+ * Get the upper bound of a bucket, exclusive
+ * @param bucket Bucket index, below RPCHAT_BENCH_HIST_BUCKETS - 1
+ * @return Bound in nanoseconds
+ */
+static uint64_t
+rpchat_bench_bucket_bound(size_t bucket)
+{
+    unsigned int shift = 0; // power of two the bucket lies in
+
+    if (0 == bucket)
+    {
+        return UINT64_C(1) << RPCHAT_BENCH_HIST_MIN_SHIFT;
+    }
+    shift = RPCHAT_BENCH_HIST_MIN_SHIFT
+            + (unsigned int)((bucket - 1) >> RPCHAT_BENCH_HIST_SUB_SHIFT);
+    return (UINT64_C(1) << shift)
+           + ((((bucket - 1) & RPCHAT_BENCH_HIST_SUB_MASK) + 1)
+              << (shift - RPCHAT_BENCH_HIST_SUB_SHIFT));
+}
+
+/**
+ * Record a latency
+ * @param p_hist Pointer to histogram
+ * @param latency_ns Latency in nanoseconds
+ */
+static void
+rpchat_bench_hist_record(rpchat_bench_hist_t *p_hist, uint64_t latency_ns)
+{
+    p_hist->buckets[rpchat_bench_bucket(latency_ns)]++;
+    p_hist->count++;
+    if (p_hist->max_ns < latency_ns)
+    {
+        p_hist->max_ns = latency_ns;
+    }
+}
+
+/**
+ * Add the latencies of one histogram to another
+ * @param p_dst Pointer to histogram added to
+ * @param p_src Pointer to histogram added
+ */
+static void
+rpchat_bench_hist_merge(rpchat_bench_hist_t       *p_dst,
+                        const rpchat_bench_hist_t *p_src)
+{
+    size_t bucket = 0; // bucket being added
+
+    for (bucket = 0; bucket < RPCHAT_BENCH_HIST_BUCKETS; bucket++)
+    {
+        p_dst->buckets[bucket] += p_src->buckets[bucket];
+    }
+    p_dst->count += p_src->count;
+    if (p_dst->max_ns < p_src->max_ns)
+    {
+        p_dst->max_ns = p_src->max_ns;
+    }
+}
+
+/**
+ * Estimate a percentile as the upper bound of the bucket it falls in, so it
+ * overstates by at most one bucket width (1/16 of its power of two)
+ * @param p_hist Pointer to histogram
+ * @param permille Percentile in tenths of a percent, 1-1000
+ * @return Latency in nanoseconds, never above the longest recorded; 0 if
+ * nothing was recorded
+ */
+static uint64_t
+rpchat_bench_hist_percentile(const rpchat_bench_hist_t *p_hist,
+                             unsigned int               permille)
+{
+    uint64_t rank = 0; // latencies at or under the percentile
+    uint64_t seen = 0; // latencies in buckets so far
+    size_t   bucket = 0; // bucket being summed
+    uint64_t bound  = 0; // upper bound of bucket
+
+    if (0 == p_hist->count)
+    {
+        return 0;
+    }
+    rank = ((p_hist->count * permille) + 999) / 1000;
+    for (bucket = 0; bucket < RPCHAT_BENCH_HIST_BUCKETS - 1; bucket++)
+    {
+        seen += p_hist->buckets[bucket];
+        if (seen >= rank)
+        {
+            bound = rpchat_bench_bucket_bound(bucket);
+            return (bound < p_hist->max_ns) ? bound : p_hist->max_ns;
+        }
+    }
+    return p_hist->max_ns;
+}
+
+/**
+ * Append bytes to the outbound buffer of a connection
+ * @param p_conn Pointer to connection
+ * @param p_data Pointer to bytes
+ * @param len Number of bytes
+ * @return true if they fit, false if nothing was appended
+ */
+static bool
+rpchat_bench_queue(rpchat_bench_conn_t *p_conn, const void *p_data, size_t len)
+{
+    if (p_conn->sz_out_buf - p_conn->out_len < len)
+    {
+        return false;
+    }
+    memcpy(p_conn->p_out_buf + p_conn->out_len, p_data, len);
+    p_conn->out_len += len;
+    return true;
+}
+
+/**
+ * Write what the outbound buffer of a connection holds, until the socket
+ * would block
+ * @param p_conn Pointer to connection
+ * @return RPLIB_SUCCESS on no issues, RPLIB_ERROR if the socket failed
+ */
+static int
+rpchat_bench_flush(rpchat_bench_conn_t *p_conn)
+{
+    ssize_t sent    = 0; // bytes written by one call
+    size_t  written = 0; // bytes written so far
+
+    while (written < p_conn->out_len)
+    {
+        sent = send(p_conn->h_fd,
+                    p_conn->p_out_buf + written,
+                    p_conn->out_len - written,
+                    MSG_NOSIGNAL);
+        if (0 > sent)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            if (EAGAIN == errno || EWOULDBLOCK == errno)
+            {
+                break;
+            }
+            return RPLIB_ERROR;
+        }
+        written += (size_t)sent;
+    }
+    memmove(p_conn->p_out_buf,
+            p_conn->p_out_buf + written,
+            p_conn->out_len - written);
+    p_conn->out_len -= written;
+    return RPLIB_SUCCESS;
+}
+
+/**
+ * Close the socket of a connection and forget what it had buffered
+ * @param p_worker Pointer to thread owning connection
+ * @param p_conn Pointer to connection
+ */
+static void
+rpchat_bench_close(rpchat_bench_worker_t *p_worker,
+                   rpchat_bench_conn_t   *p_conn)
+{
+    if (0 > p_conn->h_fd)
+    {
+        return;
+    }
+    if (RPCHAT_BENCH_CONN_REGISTERING == p_conn->state)
+    {
+        p_worker->num_registering--;
+    }
+    if (RPCHAT_BENCH_CONN_READY == p_conn->state)
+    {
+        p_worker->num_ready--;
+    }
+    // closing the last reference removes it from the epoll instance
+    close(p_conn->h_fd);
+    p_conn->h_fd        = -1;
+    p_conn->state       = RPCHAT_BENCH_CONN_CLOSED;
+    p_conn->unacked     = 0;
+    p_conn->outstanding = 0;
+    p_conn->ack_due_ns  = 0;
+    p_conn->in_len      = 0;
+    p_conn->out_len     = 0;
+}
+
+/**
+ * Close a connection the server cut or that broke, counting it against the
+ * stage it was in
+ * @param p_worker Pointer to thread owning connection
+ * @param p_conn Pointer to connection
+ */
+static void
+rpchat_bench_drop(rpchat_bench_worker_t *p_worker, rpchat_bench_conn_t *p_conn)
+{
+    if (RPCHAT_BENCH_CONN_REGISTERING == p_conn->state)
+    {
+        p_worker->stats.num_reg_failed++;
+    }
+    else
+    {
+        p_worker->stats.num_dropped++;
+    }
+    rpchat_bench_close(p_worker, p_conn);
+}
+
+/**
+ * Open a socket for a connection, start connecting and queue its REGISTER,
+ * or REGWIN when it takes deliveries windowed. Usernames carry the number of
+ * reconnections, so a reconnecting client never collides with the name its
+ * previous socket may still hold on the server
+ * @param p_worker Pointer to thread owning connection
+ * @param p_conn Pointer to closed connection
+ * @param p_addr Pointer to server address
+ * @return RPLIB_SUCCESS on no issues, RPLIB_ERROR on failure
+ */
+static int
+rpchat_bench_connect(rpchat_bench_worker_t    *p_worker,
+                     rpchat_bench_conn_t      *p_conn,
+                     const struct sockaddr_in *p_addr)
+{
+    int                res = RPLIB_ERROR; // assume failure
+    struct epoll_event event;             // registration with epoll
+    char               frame[4 + RPCHAT_BENCH_NAME_MAX]; // REGISTER frame
+    int                name_len = 0;      // bytes of username
+    size_t             frame_len = 0;     // bytes of frame
+
+    p_conn->h_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (0 > p_conn->h_fd)
+    {
+        perror("socket");
+        goto leave;
+    }
+    p_conn->connect_ns = rpchat_bench_now();
+    if (0 > connect(p_conn->h_fd, (const struct sockaddr *)p_addr,
+                    sizeof(*p_addr))
+        && EINPROGRESS != errno)
+    {
+        perror("connect");
+        goto cleanup;
+    }
+    memset(&event, 0, sizeof(event));
+    event.events   = EPOLLIN | EPOLLOUT | EPOLLET;
+    event.data.ptr = p_conn;
+    if (0 > epoll_ctl(p_worker->h_fd_epoll, EPOLL_CTL_ADD, p_conn->h_fd,
+                      &event))
+    {
+        perror("epoll_ctl");
+        goto cleanup;
+    }
+
+    name_len = snprintf(frame + 3,
+                        RPCHAT_BENCH_NAME_MAX,
+                        "%s%u_%u",
+                        p_worker->p_config->p_prefix,
+                        p_conn->index,
+                        p_conn->gen);
+    frame[0]  = (char)((1 < p_conn->window) ? RPCHAT_BCP_REGWIN
+                                            : RPCHAT_BCP_REGISTER);
+    frame[1]  = (char)((unsigned int)name_len >> 8);
+    frame[2]  = (char)((unsigned int)name_len & 0xFF);
+    frame_len = 3 + (size_t)name_len;
+    if (1 < p_conn->window)
+    {
+        frame[frame_len++] = (char)p_conn->window;
+    }
+    p_conn->state = RPCHAT_BENCH_CONN_REGISTERING;
+    p_worker->num_registering++;
+    rpchat_bench_queue(p_conn, frame, frame_len);
+    res = RPLIB_SUCCESS;
+    goto leave;
+cleanup:
+    close(p_conn->h_fd);
+    p_conn->h_fd = -1;
+leave:
+    return res;
+}
+
+/**
+ * Queue acknowledgements for every delivery taken but not yet acknowledged:
+ * cumulative ACKs on windowed connections, a STATUS each otherwise
+ * @param p_conn Pointer to connection
+ */
+static void
+rpchat_bench_queue_acks(rpchat_bench_conn_t *p_conn)
+{
+    char         frame[2]; // ACK or STATUS frame
+    unsigned int count = 0; // deliveries acknowledged by frame
+
+    while (0 < p_conn->unacked)
+    {
+        if (1 < p_conn->window)
+        {
+            count    = (RPCHAT_BENCH_MAX_WINDOW < p_conn->unacked)
+                           ? RPCHAT_BENCH_MAX_WINDOW
+                           : p_conn->unacked;
+            frame[0] = (char)RPCHAT_BCP_ACK;
+            frame[1] = (char)count;
+        }
+        else
+        {
+            count    = 1;
+            frame[0] = (char)RPCHAT_BCP_STATUS;
+            frame[1] = (char)RPCHAT_BCP_STATUS_GOOD;
+        }
+        if (!rpchat_bench_queue(p_conn, frame, sizeof(frame)))
+        {
+            break;
+        }
+        p_conn->unacked -= count;
+    }
+    p_conn->ack_due_ns = 0;
+}
+
+/**
+ * Get the length of the frame at the start of a buffer
+ * @param p_buf Pointer to buffered bytes
+ * @param len Number of bytes buffered
+ * @return Frame length, 0 if the frame is not complete yet, RPLIB_ERROR if
+ * the server sent something a client never expects
+ */
+static ssize_t
+rpchat_bench_frame_len(const uint8_t *p_buf, size_t len)
+{
+    size_t first_len = 0; // length of first string
+
+    if (1 > len)
+    {
+        return 0;
+    }
+    switch (p_buf[0])
+    {
+        case RPCHAT_BCP_STATUS:
+            // opcode, code, message
+            if (4 > len)
+            {
+                return 0;
+            }
+            first_len = ((size_t)p_buf[2] << 8) | p_buf[3];
+            return (4 + first_len <= len) ? (ssize_t)(4 + first_len) : 0;
+        case RPCHAT_BCP_DELIVER:
+        case RPCHAT_BCP_FNOTIFY:
+            // opcode, sender, message
+            if (3 > len)
+            {
+                return 0;
+            }
+            first_len = ((size_t)p_buf[1] << 8) | p_buf[2];
+            if (5 + first_len > len)
+            {
+                return 0;
+            }
+            first_len += 5 + (((size_t)p_buf[3 + first_len] << 8)
+                              | p_buf[4 + first_len]);
+            return (first_len <= len) ? (ssize_t)first_len : 0;
+        default:
+            return RPLIB_ERROR;
+    }
+}
+
+/**
+ * Handle a STATUS: the answer to a REGISTER while registering, then to the
+ * oldest SEND outstanding
+ * @param p_worker Pointer to thread owning connection
+ * @param p_conn Pointer to connection
+ * @param code Status code
+ * @param now_ns Time the frame was read
+ * @return RPLIB_SUCCESS on no issues, RPLIB_UNSUCCESS if the connection was
+ * closed
+ */
+static int
+rpchat_bench_on_status(rpchat_bench_worker_t *p_worker,
+                       rpchat_bench_conn_t   *p_conn,
+                       uint8_t                code,
+                       uint64_t               now_ns)
+{
+    if (RPCHAT_BENCH_CONN_REGISTERING == p_conn->state)
+    {
+        if (RPCHAT_BCP_STATUS_GOOD != code)
+        {
+            p_worker->stats.num_reg_failed++;
+            rpchat_bench_close(p_worker, p_conn);
+            return RPLIB_UNSUCCESS;
+        }
+        p_worker->num_registering--;
+        p_worker->num_ready++;
+        p_conn->state = RPCHAT_BENCH_CONN_READY;
+        if (0 == p_conn->gen)
+        {
+            p_worker->stats.num_registered++;
+        }
+        else if (p_worker->b_measuring)
+        {
+            p_worker->stats.num_reconnects++;
+            rpchat_bench_hist_record(&p_worker->stats.reg_latency,
+                                     now_ns - p_conn->connect_ns);
+        }
+        return RPLIB_SUCCESS;
+    }
+    if (0 < p_conn->outstanding)
+    {
+        p_conn->outstanding--;
+        if (RPCHAT_BCP_STATUS_GOOD != code && p_worker->b_measuring)
+        {
+            p_worker->stats.num_refused++;
+        }
+    }
+    return RPLIB_SUCCESS;
+}
+
+/**
+ * Handle a DELIVER or FNOTIFY: count it, measure its latency if a bench
+ * sender stamped it, and note it needs acknowledging
+ * @param p_worker Pointer to thread owning connection
+ * @param p_conn Pointer to connection
+ * @param p_frame Pointer to complete frame
+ * @param now_ns Time the frame was read
+ */
+static void
+rpchat_bench_on_deliver(rpchat_bench_worker_t *p_worker,
+                        rpchat_bench_conn_t   *p_conn,
+                        const uint8_t         *p_frame,
+                        uint64_t               now_ns)
+{
+    size_t         from_len   = ((size_t)p_frame[1] << 8) | p_frame[2];
+    const uint8_t *p_from     = p_frame + 3;
+    size_t         msg_len    = ((size_t)p_frame[3 + from_len] << 8)
+                                | p_frame[4 + from_len];
+    const uint8_t *p_msg      = p_frame + 5 + from_len;
+    size_t         prefix_len = strlen(p_worker->p_config->p_prefix);
+    uint64_t       stamp_ns   = 0; // time the SEND was made
+    size_t         pos        = 0; // stamp digit being read
+    int            digit      = 0; // value of digit
+
+    p_conn->unacked++;
+    if (!p_worker->b_measuring)
+    {
+        return;
+    }
+    p_worker->stats.num_delivered++;
+
+    // only SENDs of bench clients start with a stamp
+    if (RPCHAT_BCP_DELIVER != p_frame[0] || prefix_len > from_len
+        || 0 != memcmp(p_from, p_worker->p_config->p_prefix, prefix_len)
+        || RPCHAT_BENCH_STAMP_LEN > msg_len)
+    {
+        return;
+    }
+    for (pos = 0; pos < RPCHAT_BENCH_STAMP_LEN; pos++)
+    {
+        if ('0' <= p_msg[pos] && '9' >= p_msg[pos])
+        {
+            digit = p_msg[pos] - '0';
+        }
+        else if ('a' <= p_msg[pos] && 'f' >= p_msg[pos])
+        {
+            digit = p_msg[pos] - 'a' + 10;
+        }
+        else
+        {
+            return;
+        }
+        stamp_ns = (stamp_ns << 4) | (uint64_t)digit;
+    }
+    if (stamp_ns <= now_ns)
+    {
+        rpchat_bench_hist_record(&p_worker->stats.deliver_latency,
+                                 now_ns - stamp_ns);
+    }
+}
+
+/**
+ * Read everything a connection has received and handle each complete frame,
+ * then acknowledge what arrived unless the client holds its acks
+ * @param p_worker Pointer to thread owning connection
+ * @param p_conn Pointer to connection
+ * @return RPLIB_SUCCESS on no issues, RPLIB_UNSUCCESS if the connection was
+ * closed
+ */
+static int
+rpchat_bench_on_readable(rpchat_bench_worker_t *p_worker,
+                         rpchat_bench_conn_t   *p_conn)
+{
+    ssize_t  received  = 0; // bytes read by one call
+    ssize_t  frame_len = 0; // length of frame at offset
+    size_t   offset    = 0; // start of unhandled bytes
+    uint64_t now_ns    = 0; // time bytes were read
+    uint8_t *p_buf     = (uint8_t *)p_conn->in_buf;
+
+    for (;;)
+    {
+        received = recv(p_conn->h_fd,
+                        p_conn->in_buf + p_conn->in_len,
+                        sizeof(p_conn->in_buf) - p_conn->in_len,
+                        0);
+        if (0 == received)
+        {
+            goto drop;
+        }
+        if (0 > received)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            if (EAGAIN == errno || EWOULDBLOCK == errno)
+            {
+                break;
+            }
+            goto drop;
+        }
+        p_conn->in_len += (size_t)received;
+        now_ns               = rpchat_bench_now();
+        p_worker->last_rx_ns = now_ns;
+
+        offset = 0;
+        while (0 < (frame_len = rpchat_bench_frame_len(
+                        p_buf + offset, p_conn->in_len - offset)))
+        {
+            if (RPCHAT_BCP_STATUS == p_buf[offset])
+            {
+                if (RPLIB_SUCCESS
+                    != rpchat_bench_on_status(
+                        p_worker, p_conn, p_buf[offset + 1], now_ns))
+                {
+                    return RPLIB_UNSUCCESS;
+                }
+            }
+            else
+            {
+                rpchat_bench_on_deliver(
+                    p_worker, p_conn, p_buf + offset, now_ns);
+            }
+            offset += (size_t)frame_len;
+        }
+        if (0 > frame_len)
+        {
+            fprintf(stderr, "unexpected opcode %u\n", p_buf[offset]);
+            goto drop;
+        }
+        memmove(p_buf, p_buf + offset, p_conn->in_len - offset);
+        p_conn->in_len -= offset;
+    }
+
+    if (0 < p_conn->unacked)
+    {
+        if (!p_conn->b_slow)
+        {
+            rpchat_bench_queue_acks(p_conn);
+        }
+        else if (0 == p_conn->ack_due_ns)
+        {
+            p_conn->ack_due_ns
+                = now_ns
+                  + (p_worker->p_config->delay_ms * RPCHAT_BENCH_NS_PER_MS);
+        }
+    }
+    if (RPLIB_SUCCESS != rpchat_bench_flush(p_conn))
+    {
+        goto drop;
+    }
+    return RPLIB_SUCCESS;
+drop:
+    rpchat_bench_drop(p_worker, p_conn);
+    return RPLIB_UNSUCCESS;
+}
+
+/**
+ * Wait once for events on the connections of a thread and handle them
+ * @param p_worker Pointer to thread
+ * @param timeout_ms Most milliseconds to wait
+ */
+static void
+rpchat_bench_poll(rpchat_bench_worker_t *p_worker, int timeout_ms)
+{
+    struct epoll_event   events[RPCHAT_BENCH_EVENT_BATCH]; // events taken
+    int                  num_events = 0;    // # entries in events
+    int                  idx        = 0;    // event being handled
+    rpchat_bench_conn_t *p_conn     = NULL; // connection of event
+
+    num_events = epoll_wait(
+        p_worker->h_fd_epoll, events, RPCHAT_BENCH_EVENT_BATCH, timeout_ms);
+    for (idx = 0; idx < num_events; idx++)
+    {
+        p_conn = events[idx].data.ptr;
+        if (0 > p_conn->h_fd)
+        {
+            continue;
+        }
+        if (events[idx].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+        {
+            if (RPLIB_SUCCESS != rpchat_bench_on_readable(p_worker, p_conn))
+            {
+                continue;
+            }
+        }
+        if ((events[idx].events & EPOLLOUT)
+            && RPLIB_SUCCESS != rpchat_bench_flush(p_conn))
+        {
+            rpchat_bench_drop(p_worker, p_conn);
+        }
+    }
+}
+
+/**
+ * Queue the SENDs of every slot that came due on sender connections. A slot
+ * finding the sender with too many SENDs outstanding, or its buffer full, is
+ * skipped rather than made up later, so a stalled server is charged with
+ * skipped SENDs instead of hiding behind a burst
+ * @param p_worker Pointer to thread
+ * @param now_ns Current time
+ * @param period_ns Nanoseconds between slots of one sender
+ */
+static void
+rpchat_bench_send_due(rpchat_bench_worker_t *p_worker,
+                      uint64_t               now_ns,
+                      uint64_t               period_ns)
+{
+    const rpchat_bench_config_t *p_config = p_worker->p_config;
+    rpchat_bench_conn_t         *p_conn   = NULL; // connection sending
+    unsigned int                 idx      = 0;    // connection checked
+    char   frame[3 + RPCHAT_BENCH_MAX_PAYLOAD + 1]; // SEND frame
+    size_t frame_len = 3 + p_config->payload;       // bytes of frame
+
+    frame[0] = (char)RPCHAT_BCP_SEND;
+    frame[1] = (char)(p_config->payload >> 8);
+    frame[2] = (char)(p_config->payload & 0xFF);
+    memset(frame + 3 + RPCHAT_BENCH_MIN_PAYLOAD,
+           'x',
+           p_config->payload - RPCHAT_BENCH_MIN_PAYLOAD);
+
+    for (idx = 0; idx < p_worker->num_conns; idx++)
+    {
+        p_conn = p_worker->pp_conns[idx];
+        if (!p_conn->b_sender || RPCHAT_BENCH_CONN_READY != p_conn->state)
+        {
+            continue;
+        }
+        while (p_conn->next_send_ns <= now_ns)
+        {
+            p_conn->next_send_ns += period_ns;
+            if (RPCHAT_BENCH_MAX_OUTSTANDING <= p_conn->outstanding
+                || p_conn->sz_out_buf - p_conn->out_len < frame_len)
+            {
+                p_worker->stats.num_skipped++;
+                continue;
+            }
+            // stamp and sequence, the rest stays padding
+            snprintf(frame + 3,
+                     RPCHAT_BENCH_MIN_PAYLOAD + 1,
+                     "%016llx %08x ",
+                     (unsigned long long)rpchat_bench_now(),
+                     (unsigned int)p_conn->seq++);
+            frame[3 + RPCHAT_BENCH_MIN_PAYLOAD] = 'x';
+            rpchat_bench_queue(p_conn, frame, frame_len);
+            p_conn->outstanding++;
+            p_worker->stats.num_sent++;
+        }
+        if (RPLIB_SUCCESS != rpchat_bench_flush(p_conn))
+        {
+            rpchat_bench_drop(p_worker, p_conn);
+        }
+    }
+}
+
+/**
+ * Send the acknowledgements slow clients held once their delay ran out
+ * @param p_worker Pointer to thread
+ * @param now_ns Current time
+ */
+static void
+rpchat_bench_ack_due(rpchat_bench_worker_t *p_worker, uint64_t now_ns)
+{
+    rpchat_bench_conn_t *p_conn = NULL; // connection checked
+    unsigned int         idx    = 0;    // position of connection
+
+    for (idx = 0; idx < p_worker->num_conns; idx++)
+    {
+        p_conn = p_worker->pp_conns[idx];
+        if (!p_conn->b_slow || 0 == p_conn->ack_due_ns
+            || p_conn->ack_due_ns > now_ns)
+        {
+            continue;
+        }
+        rpchat_bench_queue_acks(p_conn);
+        if (RPLIB_SUCCESS != rpchat_bench_flush(p_conn))
+        {
+            rpchat_bench_drop(p_worker, p_conn);
+        }
+    }
+}
+
+/**
+ * Close every storming client of a thread that is registered and connect it
+ * again under a fresh name
+ * @param p_worker Pointer to thread
+ * @param p_addr Pointer to server address
+ */
+static void
+rpchat_bench_storm(rpchat_bench_worker_t    *p_worker,
+                   const struct sockaddr_in *p_addr)
+{
+    rpchat_bench_conn_t *p_conn = NULL; // connection checked
+    unsigned int         idx    = 0;    // position of connection
+
+    for (idx = 0; idx < p_worker->num_conns; idx++)
+    {
+        p_conn = p_worker->pp_conns[idx];
+        if (!p_conn->b_storm || RPCHAT_BENCH_CONN_READY != p_conn->state)
+        {
+            continue;
+        }
+        rpchat_bench_close(p_worker, p_conn);
+        p_conn->gen++;
+        if (RPLIB_SUCCESS != rpchat_bench_connect(p_worker, p_conn, p_addr))
+        {
+            p_worker->stats.num_reg_failed++;
+        }
+    }
+}
+
+/**
+ * Thread body: connect and register every connection of the thread, let the
+ * join notices it set off die down, wait for the other threads at the
+ * barrier, drive the load for the configured time, then keep acknowledging
+ * while deliveries drain
+ * @param p_arg Pointer to thread (rpchat_bench_worker_t)
+ * @return NULL
+ */
+static void *
+rpchat_bench_thread(void *p_arg)
+{
+    rpchat_bench_worker_t       *p_worker = p_arg;
+    const rpchat_bench_config_t *p_config = p_worker->p_config;
+    struct sockaddr_in           addr;            // server address
+    unsigned int                 idx       = 0;   // connection handled
+    uint64_t                     now_ns    = 0;   // current time
+    uint64_t                     end_ns    = 0;   // end of stage
+    uint64_t                     storm_ns  = 0;   // next reconnect storm
+    uint64_t                     period_ns = 0;   // between SENDs of sender
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons((uint16_t)p_config->port_num);
+    inet_pton(AF_INET, p_config->p_host, &addr.sin_addr);
+
+    // registration: every connection registered or given up on
+    for (idx = 0; idx < p_worker->num_conns; idx++)
+    {
+        if (RPLIB_SUCCESS
+            != rpchat_bench_connect(p_worker, p_worker->pp_conns[idx], &addr))
+        {
+            p_worker->stats.num_reg_failed++;
+        }
+    }
+    end_ns = rpchat_bench_now() + (RPCHAT_BENCH_SETTLE_MS
+                                   * RPCHAT_BENCH_NS_PER_MS);
+    while (0 < p_worker->num_registering && rpchat_bench_now() < end_ns)
+    {
+        rpchat_bench_poll(p_worker, RPCHAT_BENCH_TICK_MS);
+    }
+    // every join is announced to every client; let that fan-out finish
+    now_ns = rpchat_bench_now();
+    while ((now_ns - p_worker->last_rx_ns)
+               < (RPCHAT_BENCH_QUIET_MS * RPCHAT_BENCH_NS_PER_MS)
+           && now_ns < end_ns)
+    {
+        rpchat_bench_poll(p_worker, RPCHAT_BENCH_TICK_MS);
+        now_ns = rpchat_bench_now();
+    }
+    pthread_barrier_wait(p_worker->p_barrier);
+
+    // run: spread the first SEND of each sender over one period
+    p_worker->b_measuring = true;
+    now_ns                = rpchat_bench_now();
+    period_ns             = RPCHAT_BENCH_NS_PER_SEC / p_config->rate;
+    end_ns   = now_ns + (p_config->seconds * RPCHAT_BENCH_NS_PER_SEC);
+    storm_ns = now_ns + (p_config->interval_ms * RPCHAT_BENCH_NS_PER_MS);
+    for (idx = 0; idx < p_worker->num_conns; idx++)
+    {
+        p_worker->pp_conns[idx]->next_send_ns
+            = now_ns
+              + ((period_ns * p_worker->pp_conns[idx]->index)
+                 / p_config->num_senders);
+    }
+    while (now_ns < end_ns)
+    {
+        rpchat_bench_poll(p_worker, RPCHAT_BENCH_TICK_MS);
+        now_ns = rpchat_bench_now();
+        rpchat_bench_send_due(p_worker, now_ns, period_ns);
+        rpchat_bench_ack_due(p_worker, now_ns);
+        if (RPCHAT_BENCH_STORM == p_config->scenario && storm_ns <= now_ns)
+        {
+            rpchat_bench_storm(p_worker, &addr);
+            storm_ns += p_config->interval_ms * RPCHAT_BENCH_NS_PER_MS;
+        }
+    }
+
+    // drain: no more SENDs, deliveries still in flight are counted
+    end_ns = now_ns + (RPCHAT_BENCH_DRAIN_MS * RPCHAT_BENCH_NS_PER_MS);
+    while (now_ns < end_ns)
+    {
+        rpchat_bench_poll(p_worker, RPCHAT_BENCH_TICK_MS);
+        now_ns = rpchat_bench_now();
+        rpchat_bench_ack_due(p_worker, now_ns);
+    }
+    p_worker->b_measuring = false;
+
+    for (idx = 0; idx < p_worker->num_conns; idx++)
+    {
+        rpchat_bench_close(p_worker, p_worker->pp_conns[idx]);
+    }
+    p_worker->res = RPLIB_SUCCESS;
+    return NULL;
+}
+
+/**
+ * Print the merged results of a run
+ * @param p_config Pointer to options
+ * @param p_stats Pointer to merged results
+ * @param reg_ns Nanoseconds registration and its join notices took
+ */
+static void
+rpchat_bench_report(const rpchat_bench_config_t *p_config,
+                    const rpchat_bench_stats_t  *p_stats,
+                    uint64_t                     reg_ns)
+{
+    const rpchat_bench_hist_t *p_deliver = &p_stats->deliver_latency;
+    const rpchat_bench_hist_t *p_reg     = &p_stats->reg_latency;
+    const double               ms        = (double)RPCHAT_BENCH_NS_PER_MS;
+
+    printf("Registered: %llu of %u (%llu failed), settled in %.3f s\n",
+           (unsigned long long)p_stats->num_registered,
+           p_config->num_conns,
+           (unsigned long long)p_stats->num_reg_failed,
+           (double)reg_ns / (double)RPCHAT_BENCH_NS_PER_SEC);
+    printf("Sent: %llu (%llu refused, %llu slots skipped)\n",
+           (unsigned long long)p_stats->num_sent,
+           (unsigned long long)p_stats->num_refused,
+           (unsigned long long)p_stats->num_skipped);
+    printf("Delivered: %llu (%.0f msg/s fan-out)\n",
+           (unsigned long long)p_stats->num_delivered,
+           (double)p_stats->num_delivered / (double)p_config->seconds);
+    printf("Delivery latency: p50 %.3f ms, p99 %.3f ms, p999 %.3f ms, "
+           "max %.3f ms (%llu samples)\n",
+           (double)rpchat_bench_hist_percentile(p_deliver, 500) / ms,
+           (double)rpchat_bench_hist_percentile(p_deliver, 990) / ms,
+           (double)rpchat_bench_hist_percentile(p_deliver, 999) / ms,
+           (double)p_deliver->max_ns / ms,
+           (unsigned long long)p_deliver->count);
+    if (RPCHAT_BENCH_STORM == p_config->scenario)
+    {
+        printf("Reconnects: %llu, registration p50 %.3f ms, p99 %.3f ms, "
+               "max %.3f ms\n",
+               (unsigned long long)p_stats->num_reconnects,
+               (double)rpchat_bench_hist_percentile(p_reg, 500) / ms,
+               (double)rpchat_bench_hist_percentile(p_reg, 990) / ms,
+               (double)p_reg->max_ns / ms);
+    }
+    printf("Disconnected by server: %llu\n",
+           (unsigned long long)p_stats->num_dropped);
+}
+
+int
+rpchat_bench_run(const rpchat_bench_config_t *p_config)
+{
+    int                    res        = RPLIB_ERROR; // assume failure
+    rpchat_bench_worker_t *p_workers  = NULL; // one per thread
+    rpchat_bench_conn_t   *p_conn     = NULL; // connection being set up
+    rpchat_bench_stats_t  *p_stats    = NULL; // merged results
+    pthread_barrier_t      barrier;           // registration done
+    unsigned int           idx        = 0;    // thread or connection index
+    unsigned int           receiver   = 0;    // position among receivers
+    unsigned int           num_started = 0;   // threads running
+    uint64_t               start_ns   = 0;    // registration started
+    uint64_t               reg_ns     = 0;    // registration settled after
+
+    p_workers = calloc(p_config->num_threads, sizeof(*p_workers));
+    p_stats   = calloc(1, sizeof(*p_stats));
+    if (NULL == p_workers || NULL == p_stats)
+    {
+        perror("calloc");
+        goto leave;
+    }
+    for (idx = 0; idx < p_config->num_threads; idx++)
+    {
+        p_workers[idx].p_config   = p_config;
+        p_workers[idx].p_barrier  = &barrier;
+        p_workers[idx].res        = RPLIB_ERROR;
+        p_workers[idx].h_fd_epoll = epoll_create1(0);
+        p_workers[idx].pp_conns   = calloc(
+            (p_config->num_conns / p_config->num_threads) + 1,
+            sizeof(*p_workers[idx].pp_conns));
+        if (0 > p_workers[idx].h_fd_epoll || NULL == p_workers[idx].pp_conns)
+        {
+            perror("thread setup");
+            goto cleanup;
+        }
+    }
+
+    // connections dealt out in turn, so senders spread over the threads
+    for (idx = 0; idx < p_config->num_conns; idx++)
+    {
+        p_conn = calloc(1, sizeof(*p_conn));
+        if (NULL == p_conn)
+        {
+            perror("calloc");
+            goto cleanup;
+        }
+        p_conn->h_fd     = -1;
+        p_conn->index    = idx;
+        p_conn->b_sender = idx < p_config->num_senders;
+        p_conn->window   = (uint8_t)(p_conn->b_sender
+                                         ? RPCHAT_BENCH_SENDER_WINDOW
+                                         : p_config->window);
+        p_conn->sz_out_buf = p_conn->b_sender ? RPCHAT_BENCH_SENDER_OUT_SZ
+                                              : RPCHAT_BENCH_OUT_BUF_SZ;
+        p_conn->p_out_buf  = malloc(p_conn->sz_out_buf);
+        if (!p_conn->b_sender)
+        {
+            // the given share of receivers, evenly spread
+            receiver = idx - p_config->num_senders;
+            if (((receiver + 1) * p_config->fraction) / 100
+                > (receiver * p_config->fraction) / 100)
+            {
+                p_conn->b_slow  = RPCHAT_BENCH_SLOW_ACK == p_config->scenario;
+                p_conn->b_storm = RPCHAT_BENCH_STORM == p_config->scenario;
+            }
+        }
+        p_workers[idx % p_config->num_threads]
+            .pp_conns[p_workers[idx % p_config->num_threads].num_conns++]
+            = p_conn;
+        if (NULL == p_conn->p_out_buf)
+        {
+            perror("malloc");
+            goto cleanup;
+        }
+    }
+
+    if (0 != pthread_barrier_init(&barrier, NULL, p_config->num_threads + 1))
+    {
+        perror("pthread_barrier_init");
+        goto cleanup;
+    }
+    start_ns = rpchat_bench_now();
+    for (num_started = 0; num_started < p_config->num_threads; num_started++)
+    {
+        if (0 != pthread_create(&p_workers[num_started].thread,
+                                NULL,
+                                rpchat_bench_thread,
+                                &p_workers[num_started]))
+        {
+            // threads already started would wait at the barrier forever
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_barrier_wait(&barrier);
+    reg_ns = rpchat_bench_now() - start_ns;
+    printf("Running %s for %u s\n",
+           gp_scenario_names[p_config->scenario],
+           p_config->seconds);
+    fflush(stdout);
+
+    res = RPLIB_SUCCESS;
+    for (idx = 0; idx < num_started; idx++)
+    {
+        pthread_join(p_workers[idx].thread, NULL);
+        if (RPLIB_SUCCESS != p_workers[idx].res)
+        {
+            res = RPLIB_ERROR;
+        }
+        p_stats->num_registered += p_workers[idx].stats.num_registered;
+        p_stats->num_reg_failed += p_workers[idx].stats.num_reg_failed;
+        p_stats->num_sent += p_workers[idx].stats.num_sent;
+        p_stats->num_refused += p_workers[idx].stats.num_refused;
+        p_stats->num_skipped += p_workers[idx].stats.num_skipped;
+        p_stats->num_delivered += p_workers[idx].stats.num_delivered;
+        p_stats->num_reconnects += p_workers[idx].stats.num_reconnects;
+        p_stats->num_dropped += p_workers[idx].stats.num_dropped;
+        rpchat_bench_hist_merge(&p_stats->deliver_latency,
+                                &p_workers[idx].stats.deliver_latency);
+        rpchat_bench_hist_merge(&p_stats->reg_latency,
+                                &p_workers[idx].stats.reg_latency);
+    }
+    pthread_barrier_destroy(&barrier);
+    rpchat_bench_report(p_config, p_stats, reg_ns);
+    if (RPLIB_SUCCESS == res && p_config->num_conns != p_stats->num_registered)
+    {
+        res = RPLIB_UNSUCCESS;
+    }
+cleanup:
+    for (idx = 0; idx < p_config->num_threads; idx++)
+    {
+        while (NULL != p_workers[idx].pp_conns && 0 < p_workers[idx].num_conns)
+        {
+            p_conn = p_workers[idx].pp_conns[--p_workers[idx].num_conns];
+            free(p_conn->p_out_buf);
+            free(p_conn);
+        }
+        free(p_workers[idx].pp_conns);
+        if (0 <= p_workers[idx].h_fd_epoll)
+        {
+            close(p_workers[idx].h_fd_epoll);
+        }
+    }
+leave:
+    free(p_workers);
+    free(p_stats);
+    return res;
+}
+
+/**
+ * Parse an unsigned argument within bounds
+ * @param p_arg Pointer to argument
+ * @param min Least value accepted
+ * @param max Greatest value accepted
+ * @param p_value Pointer to value in caller, set on success
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS if invalid
+ */
+static int
+rpchat_bench_parse_uint(const char   *p_arg,
+                        unsigned long min,
+                        unsigned long max,
+                        unsigned int *p_value)
+{
+    char *next_char = NULL; // used for strtoul
+    unsigned long value = 0; // parsed argument
+
+    errno = 0;
+    value = strtoul(p_arg, &next_char, 10);
+    if (0 != errno || p_arg == next_char || '\0' != *next_char || '-' == *p_arg
+        || min > value || max < value)
+    {
+        return RPLIB_UNSUCCESS;
+    }
+    *p_value = (unsigned int)value;
+    return RPLIB_SUCCESS;
+}
+
+/**
+ * Parse command-line arguments into options, defaults for any not given
+ * @param argc Arg count passed to program
+ * @param pp_argv Arguments array
+ * @param p_config Pointer to options in caller
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS if arguments are invalid
+ * or help was asked for
+ */
+static int
+rpchat_bench_get_arguments(int                    argc,
+                           char                 **pp_argv,
+                           rpchat_bench_config_t *p_config)
+{
+    int            opt      = 0;    // option being parsed
+    int            scenario = 0;    // for matching -m names
+    int            res      = RPLIB_SUCCESS; // result of one option
+    struct in_addr addr;            // -H parsed
+
+    p_config->p_host      = RPCHAT_BENCH_DEFAULT_HOST;
+    p_config->port_num    = RPCHAT_BENCH_DEFAULT_PORT;
+    p_config->p_prefix    = RPCHAT_BENCH_DEFAULT_PREFIX;
+    p_config->num_conns   = RPCHAT_BENCH_DEFAULT_CONNS;
+    p_config->num_threads = RPCHAT_BENCH_DEFAULT_THREADS;
+    p_config->num_senders = RPCHAT_BENCH_DEFAULT_SENDERS;
+    p_config->rate        = RPCHAT_BENCH_DEFAULT_RATE;
+    p_config->seconds     = RPCHAT_BENCH_DEFAULT_SECONDS;
+    p_config->window      = RPCHAT_BENCH_DEFAULT_WINDOW;
+    p_config->payload     = RPCHAT_BENCH_DEFAULT_PAYLOAD;
+    p_config->scenario    = RPCHAT_BENCH_STEADY;
+    p_config->interval_ms = RPCHAT_BENCH_DEFAULT_INTERVAL;
+    p_config->fraction    = RPCHAT_BENCH_DEFAULT_FRACTION;
+    p_config->delay_ms    = RPCHAT_BENCH_DEFAULT_DELAY;
+
+    opterr = 0;
+    while (-1 != (opt = getopt(argc, pp_argv, "H:p:n:c:t:s:r:d:w:l:m:i:f:a:h")))
+    {
+        switch (opt)
+        {
+            case 'H':
+                p_config->p_host = optarg;
+                res = (1 == inet_pton(AF_INET, optarg, &addr))
+                          ? RPLIB_SUCCESS
+                          : RPLIB_UNSUCCESS;
+                break;
+            case 'p':
+                res = rpchat_bench_parse_uint(
+                    optarg, 1, UINT16_MAX, &p_config->port_num);
+                break;
+            case 'n':
+                p_config->p_prefix = optarg;
+                res = (0 < strlen(optarg)
+                       && RPCHAT_BENCH_PREFIX_MAX >= strlen(optarg))
+                          ? RPLIB_SUCCESS
+                          : RPLIB_UNSUCCESS;
+                break;
+            case 'c':
+                res = rpchat_bench_parse_uint(
+                    optarg, 1, RPCHAT_BENCH_MAX_CONNS, &p_config->num_conns);
+                break;
+            case 't':
+                res = rpchat_bench_parse_uint(optarg,
+                                              1,
+                                              RPCHAT_BENCH_MAX_THREADS,
+                                              &p_config->num_threads);
+                break;
+            case 's':
+                res = rpchat_bench_parse_uint(
+                    optarg, 1, RPCHAT_BENCH_MAX_CONNS, &p_config->num_senders);
+                break;
+            case 'r':
+                res = rpchat_bench_parse_uint(
+                    optarg, 1, RPCHAT_BENCH_MAX_RATE, &p_config->rate);
+                break;
+            case 'd':
+                res = rpchat_bench_parse_uint(
+                    optarg, 1, RPCHAT_BENCH_MAX_SECONDS, &p_config->seconds);
+                break;
+            case 'w':
+                res = rpchat_bench_parse_uint(
+                    optarg, 1, RPCHAT_BENCH_MAX_WINDOW, &p_config->window);
+                break;
+            case 'l':
+                res = rpchat_bench_parse_uint(optarg,
+                                              RPCHAT_BENCH_MIN_PAYLOAD,
+                                              RPCHAT_BENCH_MAX_PAYLOAD,
+                                              &p_config->payload);
+                break;
+            case 'm':
+                for (scenario = 0; scenario < RPCHAT_BENCH_NUM_SCENARIOS;
+                     scenario++)
+                {
+                    if (0 == strcmp(optarg, gp_scenario_names[scenario]))
+                    {
+                        break;
+                    }
+                }
+                p_config->scenario = (rpchat_bench_scenario_t)scenario;
+                res = (RPCHAT_BENCH_NUM_SCENARIOS > scenario)
+                          ? RPLIB_SUCCESS
+                          : RPLIB_UNSUCCESS;
+                break;
+            case 'i':
+                res = rpchat_bench_parse_uint(optarg,
+                                              1,
+                                              RPCHAT_BENCH_MAX_DELAY,
+                                              &p_config->interval_ms);
+                break;
+            case 'f':
+                res = rpchat_bench_parse_uint(
+                    optarg, 0, 100, &p_config->fraction);
+                break;
+            case 'a':
+                res = rpchat_bench_parse_uint(
+                    optarg, 0, RPCHAT_BENCH_MAX_DELAY, &p_config->delay_ms);
+                break;
+            default:
+                goto print_usage;
+        }
+        if (RPLIB_SUCCESS != res)
+        {
+            printf("Invalid Argument for -%c\n", opt);
+            goto print_usage;
+        }
+    }
+    if (p_config->num_senders > p_config->num_conns)
+    {
+        printf("Invalid Argument for -s\n");
+        goto print_usage;
+    }
+    if (p_config->num_threads > p_config->num_conns)
+    {
+        p_config->num_threads = p_config->num_conns;
+    }
+    return RPLIB_SUCCESS;
+print_usage:
+    fprintf(stdout,
+            "Usage: \n rpchat_bench -H[server address (default %s)] "
+            "-p[server port (default %d)] "
+            "-n[username prefix (default %s)] "
+            "-c[connections, 1-%d (default %d)] "
+            "-t[threads, 1-%d (default %d)] "
+            "-s[connections sending (default %d)] "
+            "-r[SENDs per second per sender (default %d)] "
+            "-d[seconds to run (default %d)] "
+            "-w[delivery window of receivers, 1-%d (default %d)] "
+            "-l[bytes per SEND, %d-%d (default %d)] "
+            "-m[scenario: steady, storm or slowack (default steady)] "
+            "-i[ms between reconnect storms (default %d)] "
+            "-f[percent of receivers storming or slow (default %d)] "
+            "-a[ms slow receivers hold acks for (default %d)]\n",
+            RPCHAT_BENCH_DEFAULT_HOST,
+            RPCHAT_BENCH_DEFAULT_PORT,
+            RPCHAT_BENCH_DEFAULT_PREFIX,
+            RPCHAT_BENCH_MAX_CONNS,
+            RPCHAT_BENCH_DEFAULT_CONNS,
+            RPCHAT_BENCH_MAX_THREADS,
+            RPCHAT_BENCH_DEFAULT_THREADS,
+            RPCHAT_BENCH_DEFAULT_SENDERS,
+            RPCHAT_BENCH_DEFAULT_RATE,
+            RPCHAT_BENCH_DEFAULT_SECONDS,
+            RPCHAT_BENCH_MAX_WINDOW,
+            RPCHAT_BENCH_DEFAULT_WINDOW,
+            RPCHAT_BENCH_MIN_PAYLOAD,
+            RPCHAT_BENCH_MAX_PAYLOAD,
+            RPCHAT_BENCH_DEFAULT_PAYLOAD,
+            RPCHAT_BENCH_DEFAULT_INTERVAL,
+            RPCHAT_BENCH_DEFAULT_FRACTION,
+            RPCHAT_BENCH_DEFAULT_DELAY);
+    return RPLIB_UNSUCCESS;
+}
+
+/**
+ * Entry point for the load generator
+ * @param argc arg count
+ * @param argv arg array
+ * @return 0 if every connection registered and the run completed, 1 otherwise
+ */
+int
+main(int argc, char **argv)
+{
+    rpchat_bench_config_t config; // options of run
+    struct rlimit         rlim;   // descriptor limit
+
+    if (RPLIB_SUCCESS != rpchat_bench_get_arguments(argc, argv, &config))
+    {
+        return EXIT_FAILURE;
+    }
+
+    // one descriptor per connection, plus an epoll instance per thread
+    if (0 == getrlimit(RLIMIT_NOFILE, &rlim)
+        && rlim.rlim_cur < rlim.rlim_max)
+    {
+        rlim.rlim_cur = rlim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rlim);
+    }
+
+    printf("Server: %s:%u\n", config.p_host, config.port_num);
+    printf("Connections: %u over %u threads, %u sending %u msg/s each\n",
+           config.num_conns,
+           config.num_threads,
+           config.num_senders,
+           config.rate);
+    printf("Receiver Window: %u\n", config.window);
+    printf("Payload: %u bytes\n", config.payload);
+    if (RPCHAT_BENCH_STORM == config.scenario)
+    {
+        printf("Scenario: storm, %u%% of receivers reconnect every %u ms\n",
+               config.fraction,
+               config.interval_ms);
+    }
+    else if (RPCHAT_BENCH_SLOW_ACK == config.scenario)
+    {
+        printf("Scenario: slowack, %u%% of receivers hold acks for %u ms\n",
+               config.fraction,
+               config.delay_ms);
+    }
+    else
+    {
+        printf("Scenario: steady\n");
+    }
+
+    return (RPLIB_SUCCESS == rpchat_bench_run(&config)) ? EXIT_SUCCESS
+                                                        : EXIT_FAILURE;
+}
+
+/*** end of file ***/
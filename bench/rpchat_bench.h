@@ -0,0 +1,189 @@
+/** @file rpchat_bench.h
+ *
+ * @brief Load generator for the BCP server. Many registered connections are
+ * spread over a few threads, each driving its share through its own epoll
+ * instance. Senders stamp every payload with the time it was sent, so
+ * receivers on the same host measure delivery latency from the payload alone.
+ * Scenarios add reconnect storms and clients slow to acknowledge
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#ifndef RPCHAT_RPCHAT_BENCH_H
+#define RPCHAT_RPCHAT_BENCH_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rplib_common.h"
+
+#define RPCHAT_BENCH_DEFAULT_HOST     "127.0.0.1"
+#define RPCHAT_BENCH_DEFAULT_PORT     9001
+#define RPCHAT_BENCH_DEFAULT_PREFIX   "bench"
+#define RPCHAT_BENCH_DEFAULT_CONNS    100
+#define RPCHAT_BENCH_DEFAULT_THREADS  4
+#define RPCHAT_BENCH_DEFAULT_SENDERS  1
+#define RPCHAT_BENCH_DEFAULT_RATE     100  // SENDs per second per sender
+#define RPCHAT_BENCH_DEFAULT_SECONDS  10
+#define RPCHAT_BENCH_DEFAULT_WINDOW   1    // stop-and-wait receivers
+#define RPCHAT_BENCH_DEFAULT_PAYLOAD  64   // bytes per SEND
+#define RPCHAT_BENCH_DEFAULT_INTERVAL 1000 // ms between reconnect storms
+#define RPCHAT_BENCH_DEFAULT_FRACTION 10   // % of clients storming, or slow
+#define RPCHAT_BENCH_DEFAULT_DELAY    50   // ms slow clients hold acks for
+
+#define RPCHAT_BENCH_MAX_CONNS       1000000
+#define RPCHAT_BENCH_MAX_THREADS     256
+#define RPCHAT_BENCH_MAX_RATE        1000000
+#define RPCHAT_BENCH_MAX_SECONDS     86400
+#define RPCHAT_BENCH_MAX_WINDOW      255  // window is one byte on the wire
+#define RPCHAT_BENCH_MAX_PAYLOAD     4095 // longest BCP string
+#define RPCHAT_BENCH_MIN_PAYLOAD     26   // stamp, sequence and separators
+#define RPCHAT_BENCH_MAX_DELAY       60000
+#define RPCHAT_BENCH_PREFIX_MAX      32
+#define RPCHAT_BENCH_SENDER_WINDOW   64   // senders take deliveries windowed
+#define RPCHAT_BENCH_MAX_OUTSTANDING 64   // SENDs awaiting STATUS per sender
+#define RPCHAT_BENCH_NAME_MAX        64   // room for prefix and numbering
+#define RPCHAT_BENCH_IN_BUF_SZ       8448 // holds the largest DELIVER
+#define RPCHAT_BENCH_OUT_BUF_SZ      512  // acks and REGISTER
+#define RPCHAT_BENCH_SENDER_OUT_SZ   65536 // SENDs queued by a sender
+#define RPCHAT_BENCH_EVENT_BATCH     256  // events taken per wait
+#define RPCHAT_BENCH_TICK_MS         1    // wait timeout between due checks
+#define RPCHAT_BENCH_SETTLE_MS       30000 // registration deadline
+#define RPCHAT_BENCH_QUIET_MS        200  // no input before run, joins done
+#define RPCHAT_BENCH_DRAIN_MS        1000 // delivery wait once sending stops
+#define RPCHAT_BENCH_STAMP_LEN       16   // hex digits of send time
+
+#define RPCHAT_BENCH_HIST_MIN_SHIFT 10 // first bucket holds below 2^10 ns
+#define RPCHAT_BENCH_HIST_MAX_SHIFT 36 // last holds 2^36 ns (~69 s) and up
+#define RPCHAT_BENCH_HIST_SUB_SHIFT 4  // 2^4 buckets per power of two
+#define RPCHAT_BENCH_HIST_BUCKETS                                   \
+    (2                                                              \
+     + ((RPCHAT_BENCH_HIST_MAX_SHIFT - RPCHAT_BENCH_HIST_MIN_SHIFT) \
+        << RPCHAT_BENCH_HIST_SUB_SHIFT))
+
+/**
+ * Load shape layered over the steady SEND rate
+ */
+typedef enum
+{
+    RPCHAT_BENCH_STEADY = 0, // every client stays connected, acks at once
+    RPCHAT_BENCH_STORM,      // a share of clients reconnects every interval
+    RPCHAT_BENCH_SLOW_ACK,   // a share of clients holds acks for a delay
+    RPCHAT_BENCH_NUM_SCENARIOS
+} rpchat_bench_scenario_t;
+
+typedef enum
+{
+    RPCHAT_BENCH_CONN_CLOSED = 0,  // no socket
+    RPCHAT_BENCH_CONN_REGISTERING, // REGISTER queued, STATUS not yet back
+    RPCHAT_BENCH_CONN_READY,       // registered
+} rpchat_bench_conn_state_t;
+
+/**
+ * Options for a benchmark run
+ */
+typedef struct
+{
+    const char             *p_host;      // server address (IPv4)
+    unsigned int            port_num;    // server port
+    const char             *p_prefix;    // start of every username
+    unsigned int            num_conns;   // connections in total
+    unsigned int            num_threads; // threads driving them
+    unsigned int            num_senders; // connections sending
+    unsigned int            rate;        // SENDs per second per sender
+    unsigned int            seconds;     // length of measured run
+    unsigned int            window;      // deliveries receivers take unacked
+    unsigned int            payload;     // bytes per SEND
+    rpchat_bench_scenario_t scenario;    // load shape
+    unsigned int            interval_ms; // between reconnect storms
+    unsigned int            fraction;    // % of receivers storming, or slow
+    unsigned int            delay_ms;    // ms slow receivers hold acks for
+} rpchat_bench_config_t;
+
+/**
+ * Latencies counted per bucket: one below 2^MIN_SHIFT ns, 2^SUB_SHIFT linear
+ * steps within each power of two, one for the rest
+ */
+typedef struct
+{
+    uint64_t buckets[RPCHAT_BENCH_HIST_BUCKETS];
+    uint64_t count;  // latencies recorded
+    uint64_t max_ns; // longest recorded
+} rpchat_bench_hist_t;
+
+/**
+ * What a thread saw; merged once every thread finished
+ */
+typedef struct
+{
+    uint64_t            num_registered;  // first registrations completed
+    uint64_t            num_reg_failed;  // registrations refused or cut off
+    uint64_t            num_sent;        // SENDs written while measuring
+    uint64_t            num_refused;     // SENDs answered with an error
+    uint64_t            num_skipped;     // send slots missed, sender busy
+    uint64_t            num_delivered;   // DELIVERs received while measuring
+    uint64_t            num_reconnects;  // storm reconnections completed
+    uint64_t            num_dropped;     // connections cut by the server
+    rpchat_bench_hist_t deliver_latency; // SEND stamp to DELIVER received
+    rpchat_bench_hist_t reg_latency;     // storm connect to STATUS received
+} rpchat_bench_stats_t;
+
+/**
+ * One client connection, owned by a single thread
+ */
+typedef struct
+{
+    int                       h_fd;         // socket, -1 if closed
+    rpchat_bench_conn_state_t state;        // registration progress
+    unsigned int              index;        // position over all connections
+    unsigned int              gen;          // reconnections, names them
+    bool                      b_sender;     // sends at the configured rate
+    bool                      b_slow;       // holds acks for delay_ms
+    bool                      b_storm;      // reconnects in storms
+    uint8_t                   window;       // deliveries taken unacked
+    unsigned int              unacked;      // deliveries not yet acked
+    unsigned int              outstanding;  // SENDs awaiting STATUS
+    uint64_t                  connect_ns;   // connect started
+    uint64_t                  ack_due_ns;   // slow acks go out, or 0
+    uint64_t                  next_send_ns; // next send slot
+    uint32_t                  seq;          // SENDs made
+    size_t                    in_len;       // bytes in in_buf
+    size_t                    out_len;      // bytes in p_out_buf
+    size_t                    sz_out_buf;   // capacity of p_out_buf
+    char                     *p_out_buf;    // bytes not yet written
+    char in_buf[RPCHAT_BENCH_IN_BUF_SZ];    // bytes not yet parsed
+} rpchat_bench_conn_t;
+
+/**
+ * A thread and the connections it drives
+ */
+typedef struct
+{
+    const rpchat_bench_config_t *p_config;    // options of run
+    pthread_barrier_t           *p_barrier;   // all registered, start at once
+    pthread_t                    thread;      // thread running pp_conns
+    int                          h_fd_epoll;  // epoll instance of thread
+    rpchat_bench_conn_t        **pp_conns;    // connections of thread
+    unsigned int                 num_conns;   // # entries in pp_conns
+    unsigned int                 num_registering; // awaiting STATUS
+    unsigned int                 num_ready;   // connections registered
+    uint64_t                     last_rx_ns;  // bytes last read
+    bool                         b_measuring; // run phase, count events
+    rpchat_bench_stats_t         stats;       // what the thread saw
+    int                          res;         // result of thread
+} rpchat_bench_worker_t;
+
+/**
+ * Run a benchmark against a server, printing a report once done
+ * @param p_config Pointer to options
+ * @return RPLIB_SUCCESS if every connection registered and the run
+ * completed, RPLIB_UNSUCCESS on problems, RPLIB_ERROR on setup failure
+ */
+int rpchat_bench_run(const rpchat_bench_config_t *p_config);
+
+#endif // RPCHAT_RPCHAT_BENCH_H
+
+/*** end of file ***/
@@ -0,0 +1,977 @@
+/** @file rplib_bench.c
+ *
+ * @brief Microbenchmarks for rplib: queue operations against thread count,
+ * threadpool dispatch of empty tasks, node removal against list length and
+ * allocation churn through malloc and rplib_pool. Every case runs a fixed
+ * number of operations from a fixed seed; the median of its runs is printed
+ * alongside the fastest
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#include "rplib_bench.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rplib_ll_queue.h"
+#include "rplib_pool.h"
+#include "rplib_tpool.h"
+
+#define RPLIB_BENCH_NS_PER_SEC 1000000000ULL
+
+static const char *const gp_family_names[RPLIB_BENCH_NUM_FAMILIES]
+    = { "queue", "dispatch", "remove", "alloc" };
+
+// size classes of the alloc case, spanning those the server configures
+static const size_t g_pool_class_sizes[] = { 64, 256, 1024, 4096 };
+
+// sizes the alloc case asks for, drawn uniformly
+static const size_t g_alloc_sizes[] = { 32, 64, 128, 256, 1024, 4096 };
+
+// results; stdout itself carries whatever rplib prints in debug builds
+static FILE *gp_results = NULL;
+
+/**
+ * Completion record of one dispatched task
+ */
+typedef struct
+{
+    _Atomic uint64_t start_ns; // time task began, 0 until then
+} rplib_bench_stamp_t;
+
+/**
+ * Take a timestamp
+ * @return Monotonic time in nanoseconds
+ */
+static uint64_t
+rplib_bench_now(void)
+{
+    struct timespec now; // current time
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * RPLIB_BENCH_NS_PER_SEC)
+           + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Step a xorshift generator
+ * @param p_seed Pointer to generator state, never 0
+ * @return Next value
+ */
+static uint64_t
+rplib_bench_rand(uint64_t *p_seed)
+{
+    *p_seed ^= *p_seed << 13;
+    *p_seed ^= *p_seed >> 7;
+    *p_seed ^= *p_seed << 17;
+    return *p_seed;
+}
+
+/**
+ * Order two unsigned 64-bit values, for qsort
+ * @param p_lhs Pointer to first value
+ * @param p_rhs Pointer to second value
+ * @return Negative, zero or positive as the first sorts before, with or
+ * after the second
+ */
+static int
+rplib_bench_cmp_u64(const void *p_lhs, const void *p_rhs)
+{
+    uint64_t lhs = *(const uint64_t *)p_lhs;
+    uint64_t rhs = *(const uint64_t *)p_rhs;
+
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+/**
+ * Print the CSV header
+ */
+static void
+rplib_bench_print_header(void)
+{
+    fprintf(gp_results,
+            "benchmark,variant,threads,param,ops,reps,ns_per_op,"
+           "min_ns_per_op,ops_per_sec,p50_ns,p99_ns\n");
+}
+
+/**
+ * Print one case: the median run by time per operation, the fastest run,
+ * and for latency cases the median of each run's percentiles
+ * @param p_family Name of benchmark family
+ * @param p_variant Name of case within family
+ * @param num_threads Threads the case ran with
+ * @param param Size the case is parameterized by (payload, list length), or
+ * 0
+ * @param p_samples Pointer to runs of case
+ * @param num_reps Number of entries in p_samples
+ */
+static void
+rplib_bench_print_case(const char                 *p_family,
+                       const char                 *p_variant,
+                       unsigned int                num_threads,
+                       size_t                      param,
+                       const rplib_bench_sample_t *p_samples,
+                       unsigned int                num_reps)
+{
+    uint64_t     per_op[RPLIB_BENCH_MAX_REPS]; // ps per op of each run
+    uint64_t     p50[RPLIB_BENCH_MAX_REPS];    // p50 of each run
+    uint64_t     p99[RPLIB_BENCH_MAX_REPS];    // p99 of each run
+    unsigned int rep = 0;                      // run being summarized
+    double       median_ns = 0;                // median time per op
+
+    for (rep = 0; rep < num_reps; rep++)
+    {
+        // picoseconds keep sub-nanosecond operations apart
+        per_op[rep] = (p_samples[rep].elapsed_ns * 1000)
+                      / (p_samples[rep].num_ops ? p_samples[rep].num_ops : 1);
+        p50[rep]    = p_samples[rep].p50_ns;
+        p99[rep]    = p_samples[rep].p99_ns;
+    }
+    qsort(per_op, num_reps, sizeof(per_op[0]), rplib_bench_cmp_u64);
+    qsort(p50, num_reps, sizeof(p50[0]), rplib_bench_cmp_u64);
+    qsort(p99, num_reps, sizeof(p99[0]), rplib_bench_cmp_u64);
+    median_ns = (double)per_op[num_reps / 2] / 1000.0;
+
+    fprintf(gp_results,
+            "%s,%s,%u,%zu,%llu,%u,%.3f,%.3f,%.0f,",
+            p_family,
+            p_variant,
+            num_threads,
+            param,
+            (unsigned long long)p_samples[0].num_ops,
+            num_reps,
+            median_ns,
+            (double)per_op[0] / 1000.0,
+            (0 < median_ns) ? 1e9 / median_ns : 0.0);
+    if (0 < p99[num_reps / 2])
+    {
+        fprintf(gp_results,
+                "%llu,%llu\n",
+                (unsigned long long)p50[num_reps / 2],
+                (unsigned long long)p99[num_reps / 2]);
+    }
+    else
+    {
+        fprintf(gp_results, ",\n");
+    }
+    fflush(gp_results);
+}
+
+/**
+ * Run a thread body on a number of threads, timing from the first of them
+ * starting work to the last finishing. Threads stamp themselves, as on a
+ * busy machine they can be done before the caller is scheduled again
+ * @param p_shared Pointer to work of run, barrier uninitialized
+ * @param num_threads Number of threads to run
+ * @param p_body Thread body, passed its rplib_bench_thread_t
+ * @param p_sample Pointer to sample to store elapsed time in
+ * @return RPLIB_SUCCESS on no issues, RPLIB_ERROR if threads could not be
+ * started or one of them failed
+ */
+static int
+rplib_bench_run_threads(rplib_bench_shared_t *p_shared,
+                        unsigned int          num_threads,
+                        void *(*p_body)(void *),
+                        rplib_bench_sample_t *p_sample)
+{
+    int                   res       = RPLIB_SUCCESS; // assume success
+    rplib_bench_thread_t *p_threads = NULL; // one per thread
+    unsigned int          idx       = 0;    // thread being handled
+    uint64_t              start_ns  = UINT64_MAX; // first thread started
+    uint64_t              end_ns    = 0;          // last thread finished
+
+    p_threads = calloc(num_threads, sizeof(*p_threads));
+    if (NULL == p_threads
+        || 0 != pthread_barrier_init(&p_shared->barrier, NULL, num_threads + 1))
+    {
+        free(p_threads);
+        return RPLIB_ERROR;
+    }
+    for (idx = 0; idx < num_threads; idx++)
+    {
+        p_threads[idx].p_shared = p_shared;
+        p_threads[idx].seed     = RPLIB_BENCH_SEED + idx;
+        if (0 != pthread_create(&p_threads[idx].thread,
+                                NULL,
+                                p_body,
+                                &p_threads[idx]))
+        {
+            // threads already started would wait at the barrier forever
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_barrier_wait(&p_shared->barrier);
+    for (idx = 0; idx < num_threads; idx++)
+    {
+        pthread_join(p_threads[idx].thread, NULL);
+        if (RPLIB_SUCCESS != p_threads[idx].res)
+        {
+            res = RPLIB_ERROR;
+        }
+        start_ns = (p_threads[idx].start_ns < start_ns)
+                       ? p_threads[idx].start_ns
+                       : start_ns;
+        end_ns   = (p_threads[idx].end_ns > end_ns) ? p_threads[idx].end_ns
+                                                    : end_ns;
+    }
+    p_sample->elapsed_ns = end_ns - start_ns;
+    p_sample->num_ops    = p_shared->num_ops * num_threads;
+    pthread_barrier_destroy(&p_shared->barrier);
+    free(p_threads);
+    return res;
+}
+
+/**
+ * Thread body: enqueue and dequeue pairs on a queue shared under a mutex,
+ * the way connection mailboxes are used
+ * @param p_arg Pointer to thread (rplib_bench_thread_t)
+ * @return NULL
+ */
+static void *
+rplib_bench_queue_shared_body(void *p_arg)
+{
+    rplib_bench_thread_t *p_thread = p_arg;
+    rplib_bench_shared_t *p_shared = p_thread->p_shared;
+    char                 *p_data   = calloc(1, p_shared->payload);
+    uint64_t              op       = 0; // pair being made
+
+    pthread_barrier_wait(&p_shared->barrier);
+    p_thread->start_ns = rplib_bench_now();
+    p_thread->res      = (NULL == p_data) ? RPLIB_ERROR : RPLIB_SUCCESS;
+    for (op = 0; RPLIB_SUCCESS == p_thread->res && op < p_shared->num_ops;
+         op++)
+    {
+        pthread_mutex_lock(&p_shared->mutex);
+        if (NULL
+            == rplib_ll_queue_enqueue(
+                p_shared->p_queue, p_data, p_shared->payload))
+        {
+            p_thread->res = RPLIB_ERROR;
+            pthread_mutex_unlock(&p_shared->mutex);
+            break;
+        }
+        pthread_mutex_unlock(&p_shared->mutex);
+        pthread_mutex_lock(&p_shared->mutex);
+        rplib_ll_queue_dequeue(p_shared->p_queue);
+        pthread_mutex_unlock(&p_shared->mutex);
+    }
+    p_thread->end_ns = rplib_bench_now();
+    free(p_data);
+    return NULL;
+}
+
+/**
+ * Thread body: enqueue and dequeue pairs on a queue of the thread's own, so
+ * only the allocations inside the queue are contended
+ * @param p_arg Pointer to thread (rplib_bench_thread_t)
+ * @return NULL
+ */
+static void *
+rplib_bench_queue_local_body(void *p_arg)
+{
+    rplib_bench_thread_t *p_thread = p_arg;
+    rplib_bench_shared_t *p_shared = p_thread->p_shared;
+    char                 *p_data   = calloc(1, p_shared->payload);
+    rplib_ll_queue_t     *p_queue  = rplib_ll_queue_create();
+    uint64_t              op       = 0; // pair being made
+
+    pthread_barrier_wait(&p_shared->barrier);
+    p_thread->start_ns = rplib_bench_now();
+    p_thread->res      = (NULL == p_data || NULL == p_queue) ? RPLIB_ERROR
+                                                             : RPLIB_SUCCESS;
+    for (op = 0; RPLIB_SUCCESS == p_thread->res && op < p_shared->num_ops;
+         op++)
+    {
+        if (NULL == rplib_ll_queue_enqueue(p_queue, p_data, p_shared->payload))
+        {
+            p_thread->res = RPLIB_ERROR;
+            break;
+        }
+        rplib_ll_queue_dequeue(p_queue);
+    }
+    p_thread->end_ns = rplib_bench_now();
+    if (NULL != p_queue)
+    {
+        rplib_ll_queue_destroy(p_queue);
+    }
+    free(p_data);
+    return NULL;
+}
+
+/**
+ * Time enqueue/dequeue pairs at doubling thread counts, on a queue shared
+ * under a mutex and on a queue per thread
+ * @param p_config Pointer to options
+ * @param p_samples Pointer to buffer of num_reps samples
+ * @param num_threads Thread count to run with
+ * @return RPLIB_SUCCESS on no issues, RPLIB_ERROR on failure
+ */
+static int
+rplib_bench_queue(const rplib_bench_config_t *p_config,
+                  rplib_bench_sample_t       *p_samples,
+                  unsigned int                num_threads)
+{
+    rplib_bench_shared_t shared;   // work of run
+    unsigned int         rep = 0;  // run being made
+    bool                 b_local = false; // variant being run
+
+    for (b_local = false; ; b_local = true)
+    {
+        for (rep = 0; rep < p_config->num_reps; rep++)
+        {
+            memset(&shared, 0, sizeof(shared));
+            shared.payload = p_config->payload;
+            shared.num_ops = p_config->num_ops / num_threads;
+            pthread_mutex_init(&shared.mutex, NULL);
+            shared.p_queue = b_local ? NULL : rplib_ll_queue_create();
+            if ((!b_local && NULL == shared.p_queue)
+                || RPLIB_SUCCESS
+                       != rplib_bench_run_threads(
+                           &shared,
+                           num_threads,
+                           b_local ? rplib_bench_queue_local_body
+                                   : rplib_bench_queue_shared_body,
+                           &p_samples[rep]))
+            {
+                return RPLIB_ERROR;
+            }
+            if (NULL != shared.p_queue)
+            {
+                rplib_ll_queue_destroy(shared.p_queue);
+            }
+            pthread_mutex_destroy(&shared.mutex);
+        }
+        rplib_bench_print_case(gp_family_names[RPLIB_BENCH_QUEUE],
+                               b_local ? "local" : "shared",
+                               num_threads,
+                               p_config->payload,
+                               p_samples,
+                               p_config->num_reps);
+        if (b_local)
+        {
+            break;
+        }
+    }
+    return RPLIB_SUCCESS;
+}
+
+/**
+ * Task doing nothing, so dispatch alone is measured
+ * @param p_arg Unused
+ */
+static void
+rplib_bench_empty_task(void *p_arg)
+{
+    (void)p_arg;
+}
+
+/**
+ * Task recording when it started
+ * @param p_arg Pointer to completion record (rplib_bench_stamp_t)
+ */
+static void
+rplib_bench_stamp_task(void *p_arg)
+{
+    rplib_bench_stamp_t *p_stamp = p_arg;
+
+    atomic_store_explicit(
+        &p_stamp->start_ns, rplib_bench_now(), memory_order_release);
+}
+
+/**
+ * Time empty tasks through a running threadpool: the latency of handing one
+ * task to an idle pool and waiting for it to start, then the throughput of
+ * tasks enqueued one at a time and in batches
+ * @param p_config Pointer to options
+ * @param p_samples Pointer to buffer of num_reps samples
+ * @param num_threads Thread count of pool
+ * @return RPLIB_SUCCESS on no issues, RPLIB_ERROR on failure
+ */
+static int
+rplib_bench_dispatch(const rplib_bench_config_t *p_config,
+                     rplib_bench_sample_t       *p_samples,
+                     unsigned int                num_threads)
+{
+    int                 res       = RPLIB_ERROR; // assume failure
+    rplib_tpool_t      *p_tpool   = NULL; // pool under test
+    uint64_t           *p_latency = NULL; // latencies of one run
+    rplib_tpool_task_t  tasks[RPLIB_BENCH_DISPATCH_BATCH]; // batch enqueued
+    rplib_bench_stamp_t stamp;            // record of latest task
+    size_t              num_samples = 0;  // latencies per run
+    size_t              idx         = 0;  // latency or task being made
+    unsigned int        rep         = 0;  // run being made
+    uint64_t            start_ns    = 0;  // run or task started
+    uint64_t            done        = 0;  // tasks enqueued
+
+    num_samples = (RPLIB_BENCH_MAX_SAMPLES < p_config->num_ops)
+                      ? RPLIB_BENCH_MAX_SAMPLES
+                      : p_config->num_ops;
+    p_latency = calloc(num_samples, sizeof(*p_latency));
+    p_tpool   = rplib_tpool_create(num_threads);
+    if (NULL == p_latency || NULL == p_tpool
+        || RPLIB_SUCCESS != rplib_tpool_start(p_tpool))
+    {
+        goto leave;
+    }
+    for (idx = 0; idx < RPLIB_BENCH_DISPATCH_BATCH; idx++)
+    {
+        tasks[idx].p_function = rplib_bench_empty_task;
+        tasks[idx].p_arg      = NULL;
+    }
+
+    // one task at a time: a full wakeup every time
+    for (rep = 0; rep < p_config->num_reps; rep++)
+    {
+        start_ns = rplib_bench_now();
+        for (idx = 0; idx < num_samples; idx++)
+        {
+            atomic_store(&stamp.start_ns, 0);
+            p_latency[idx] = rplib_bench_now();
+            if (RPLIB_SUCCESS
+                != rplib_tpool_enqueue_task(
+                    p_tpool, rplib_bench_stamp_task, &stamp))
+            {
+                goto leave;
+            }
+            while (0
+                   == atomic_load_explicit(&stamp.start_ns,
+                                           memory_order_acquire))
+            {
+                sched_yield();
+            }
+            p_latency[idx] = atomic_load(&stamp.start_ns) - p_latency[idx];
+        }
+        p_samples[rep].elapsed_ns = rplib_bench_now() - start_ns;
+        p_samples[rep].num_ops    = num_samples;
+        qsort(p_latency, num_samples, sizeof(*p_latency), rplib_bench_cmp_u64);
+        p_samples[rep].p50_ns = p_latency[num_samples / 2];
+        p_samples[rep].p99_ns = p_latency[(num_samples * 99) / 100];
+        rplib_tpool_wait(p_tpool);
+    }
+    rplib_bench_print_case(gp_family_names[RPLIB_BENCH_DISPATCH],
+                           "latency",
+                           num_threads,
+                           0,
+                           p_samples,
+                           p_config->num_reps);
+
+    // enqueued back to back, then waited out
+    for (rep = 0; rep < p_config->num_reps; rep++)
+    {
+        memset(&p_samples[rep], 0, sizeof(p_samples[rep]));
+        start_ns = rplib_bench_now();
+        for (done = 0; done < p_config->num_ops; done++)
+        {
+            if (RPLIB_SUCCESS
+                != rplib_tpool_enqueue_task(
+                    p_tpool, rplib_bench_empty_task, NULL))
+            {
+                goto leave;
+            }
+        }
+        rplib_tpool_wait(p_tpool);
+        p_samples[rep].elapsed_ns = rplib_bench_now() - start_ns;
+        p_samples[rep].num_ops    = p_config->num_ops;
+    }
+    rplib_bench_print_case(gp_family_names[RPLIB_BENCH_DISPATCH],
+                           "single",
+                           num_threads,
+                           0,
+                           p_samples,
+                           p_config->num_reps);
+
+    // enqueued a batch at a time, as reactors do
+    for (rep = 0; rep < p_config->num_reps; rep++)
+    {
+        start_ns = rplib_bench_now();
+        for (done = 0; done < p_config->num_ops;
+             done += RPLIB_BENCH_DISPATCH_BATCH)
+        {
+            if (RPLIB_BENCH_DISPATCH_BATCH
+                != rplib_tpool_enqueue_batch(
+                    p_tpool, tasks, RPLIB_BENCH_DISPATCH_BATCH))
+            {
+                goto leave;
+            }
+        }
+        rplib_tpool_wait(p_tpool);
+        p_samples[rep].elapsed_ns = rplib_bench_now() - start_ns;
+        p_samples[rep].num_ops    = done;
+    }
+    rplib_bench_print_case(gp_family_names[RPLIB_BENCH_DISPATCH],
+                           "batch",
+                           num_threads,
+                           RPLIB_BENCH_DISPATCH_BATCH,
+                           p_samples,
+                           p_config->num_reps);
+    res = RPLIB_SUCCESS;
+leave:
+    if (NULL != p_tpool)
+    {
+        rplib_tpool_destroy(p_tpool, false);
+    }
+    free(p_latency);
+    return res;
+}
+
+/**
+ * Time rplib_ll_remove_node on lists of growing length, removing the front
+ * node (constant work) and the rear node (a walk of the whole list). Each
+ * removal is followed by an enqueue keeping the length steady, so both
+ * variants include one allocation pair and the difference is the walk
+ * @param p_config Pointer to options
+ * @param p_samples Pointer to buffer of num_reps samples
+ * @return RPLIB_SUCCESS on no issues, RPLIB_ERROR on failure
+ */
+static int
+rplib_bench_remove(const rplib_bench_config_t *p_config,
+                   rplib_bench_sample_t       *p_samples)
+{
+    int               res         = RPLIB_ERROR; // assume failure
+    rplib_ll_queue_t *p_queue     = NULL;  // list removed from
+    size_t            length      = 0;     // entries in list
+    uint64_t          num_removes = 0;     // removals per run
+    uint64_t          op          = 0;     // removal being made
+    unsigned int      rep         = 0;     // run being made
+    uint64_t          start_ns    = 0;     // run started
+    bool              b_rear      = false; // variant being run
+    size_t            value       = 0;     // data of every entry
+
+    for (length = RPLIB_BENCH_MIN_LIST; length <= RPLIB_BENCH_MAX_LIST;
+         length *= 4)
+    {
+        num_removes = p_config->num_ops / length;
+        num_removes = (RPLIB_BENCH_MIN_REMOVES > num_removes)
+                          ? RPLIB_BENCH_MIN_REMOVES
+                          : num_removes;
+        for (b_rear = false; ; b_rear = true)
+        {
+            for (rep = 0; rep < p_config->num_reps; rep++)
+            {
+                p_queue = rplib_ll_queue_create();
+                if (NULL == p_queue)
+                {
+                    goto leave;
+                }
+                for (op = 0; op < length; op++)
+                {
+                    if (NULL
+                        == rplib_ll_queue_enqueue(
+                            p_queue, &value, sizeof(value)))
+                    {
+                        goto leave;
+                    }
+                }
+                start_ns = rplib_bench_now();
+                for (op = 0; op < num_removes; op++)
+                {
+                    rplib_ll_remove_node(p_queue,
+                                         b_rear ? p_queue->p_rear
+                                                : p_queue->p_front);
+                    if (NULL
+                        == rplib_ll_queue_enqueue(
+                            p_queue, &value, sizeof(value)))
+                    {
+                        goto leave;
+                    }
+                }
+                p_samples[rep].elapsed_ns = rplib_bench_now() - start_ns;
+                p_samples[rep].num_ops    = num_removes;
+                p_samples[rep].p50_ns     = 0;
+                p_samples[rep].p99_ns     = 0;
+                // destroy only frees what dequeue reaches; drain first
+                while (0 < p_queue->size)
+                {
+                    rplib_ll_queue_dequeue(p_queue);
+                }
+                rplib_ll_queue_destroy(p_queue);
+                p_queue = NULL;
+            }
+            rplib_bench_print_case(gp_family_names[RPLIB_BENCH_REMOVE],
+                                   b_rear ? "rear" : "front",
+                                   1,
+                                   length,
+                                   p_samples,
+                                   p_config->num_reps);
+            if (b_rear)
+            {
+                break;
+            }
+        }
+    }
+    res = RPLIB_SUCCESS;
+leave:
+    if (NULL != p_queue)
+    {
+        while (0 < p_queue->size)
+        {
+            rplib_ll_queue_dequeue(p_queue);
+        }
+        rplib_ll_queue_destroy(p_queue);
+    }
+    return res;
+}
+
+/**
+ * Thread body: keep a set of live blocks, replacing a random one with a
+ * block of random size each operation, through malloc or the shared pool
+ * @param p_arg Pointer to thread (rplib_bench_thread_t)
+ * @return NULL
+ */
+static void *
+rplib_bench_alloc_body(void *p_arg)
+{
+    rplib_bench_thread_t *p_thread = p_arg;
+    rplib_bench_shared_t *p_shared = p_thread->p_shared;
+    rplib_pool_t         *p_pool   = p_shared->p_pool;
+    void     *p_live[RPLIB_BENCH_LIVE_BLOCKS] = { NULL }; // held blocks
+    uint64_t  op   = 0; // replacement being made
+    uint64_t  draw = 0; // random value of operation
+    size_t    slot = 0; // block replaced
+    size_t    size = 0; // bytes asked for
+
+    pthread_barrier_wait(&p_shared->barrier);
+    p_thread->start_ns = rplib_bench_now();
+    p_thread->res = RPLIB_SUCCESS;
+    for (op = 0; op < p_shared->num_ops; op++)
+    {
+        draw = rplib_bench_rand(&p_thread->seed);
+        slot = (size_t)(draw % RPLIB_BENCH_LIVE_BLOCKS);
+        size = g_alloc_sizes[(draw >> 32)
+                             % (sizeof(g_alloc_sizes)
+                                / sizeof(g_alloc_sizes[0]))];
+        if (NULL != p_pool)
+        {
+            rplib_pool_free(p_pool, p_live[slot]);
+            p_live[slot] = rplib_pool_alloc(p_pool, size);
+        }
+        else
+        {
+            free(p_live[slot]);
+            p_live[slot] = malloc(size);
+        }
+        if (NULL == p_live[slot])
+        {
+            p_thread->res = RPLIB_ERROR;
+            break;
+        }
+        // touch the block, as a message copy would
+        *(volatile char *)p_live[slot] = (char)op;
+    }
+    p_thread->end_ns = rplib_bench_now();
+    for (slot = 0; slot < RPLIB_BENCH_LIVE_BLOCKS; slot++)
+    {
+        if (NULL != p_pool)
+        {
+            rplib_pool_free(p_pool, p_live[slot]);
+        }
+        else
+        {
+            free(p_live[slot]);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Time allocation churn at a thread count, through malloc and through a pool
+ * shared by every thread
+ * @param p_config Pointer to options
+ * @param p_samples Pointer to buffer of num_reps samples
+ * @param num_threads Thread count to run with
+ * @return RPLIB_SUCCESS on no issues, RPLIB_ERROR on failure
+ */
+static int
+rplib_bench_alloc(const rplib_bench_config_t *p_config,
+                  rplib_bench_sample_t       *p_samples,
+                  unsigned int                num_threads)
+{
+    rplib_bench_shared_t shared;         // work of run
+    unsigned int         rep    = 0;     // run being made
+    bool                 b_pool = false; // variant being run
+    int                  res    = RPLIB_SUCCESS; // result of run
+
+    for (b_pool = false; ; b_pool = true)
+    {
+        for (rep = 0; rep < p_config->num_reps; rep++)
+        {
+            memset(&shared, 0, sizeof(shared));
+            shared.num_ops = p_config->num_ops / num_threads;
+            if (b_pool)
+            {
+                shared.p_pool = rplib_pool_create(
+                    g_pool_class_sizes,
+                    sizeof(g_pool_class_sizes)
+                        / sizeof(g_pool_class_sizes[0]));
+                if (NULL == shared.p_pool)
+                {
+                    return RPLIB_ERROR;
+                }
+            }
+            res = rplib_bench_run_threads(
+                &shared, num_threads, rplib_bench_alloc_body,
+                &p_samples[rep]);
+            if (NULL != shared.p_pool)
+            {
+                rplib_pool_destroy(shared.p_pool);
+            }
+            if (RPLIB_SUCCESS != res)
+            {
+                return RPLIB_ERROR;
+            }
+        }
+        rplib_bench_print_case(gp_family_names[RPLIB_BENCH_ALLOC],
+                               b_pool ? "pool" : "malloc",
+                               num_threads,
+                               RPLIB_BENCH_LIVE_BLOCKS,
+                               p_samples,
+                               p_config->num_reps);
+        if (b_pool)
+        {
+            break;
+        }
+    }
+    return RPLIB_SUCCESS;
+}
+
+/**
+ * Parse an unsigned argument within bounds
+ * @param p_arg Pointer to argument
+ * @param min Least value accepted
+ * @param max Greatest value accepted
+ * @param p_value Pointer to value in caller, set on success
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS if invalid
+ */
+static int
+rplib_bench_parse_uint(const char   *p_arg,
+                       unsigned long min,
+                       unsigned long max,
+                       unsigned int *p_value)
+{
+    char         *next_char = NULL; // used for strtoul
+    unsigned long value     = 0;    // parsed argument
+
+    errno = 0;
+    value = strtoul(p_arg, &next_char, 10);
+    if (0 != errno || p_arg == next_char || '\0' != *next_char || '-' == *p_arg
+        || min > value || max < value)
+    {
+        return RPLIB_UNSUCCESS;
+    }
+    *p_value = (unsigned int)value;
+    return RPLIB_SUCCESS;
+}
+
+/**
+ * Select benchmark families from a comma separated list of names
+ * @param p_list Pointer to list, modified while parsed
+ * @param p_config Pointer to options in caller
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS on unknown names
+ */
+static int
+rplib_bench_parse_families(char *p_list, rplib_bench_config_t *p_config)
+{
+    char *p_name  = NULL; // family named
+    char *p_state = NULL; // used for strtok_r
+    int   family  = 0;    // for matching names
+
+    memset(p_config->b_run, 0, sizeof(p_config->b_run));
+    for (p_name = strtok_r(p_list, ",", &p_state); NULL != p_name;
+         p_name = strtok_r(NULL, ",", &p_state))
+    {
+        for (family = 0; family < RPLIB_BENCH_NUM_FAMILIES; family++)
+        {
+            if (0 == strcmp(p_name, gp_family_names[family]))
+            {
+                p_config->b_run[family] = true;
+                break;
+            }
+        }
+        if (RPLIB_BENCH_NUM_FAMILIES == family)
+        {
+            return RPLIB_UNSUCCESS;
+        }
+    }
+    return RPLIB_SUCCESS;
+}
+
+/**
+ * Parse command-line arguments into options, defaults for any not given
+ * @param argc Arg count passed to program
+ * @param pp_argv Arguments array
+ * @param p_config Pointer to options in caller
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS if arguments are invalid
+ * or help was asked for
+ */
+static int
+rplib_bench_get_arguments(int                   argc,
+                          char                **pp_argv,
+                          rplib_bench_config_t *p_config)
+{
+    int  opt    = 0;             // option being parsed
+    int  res    = RPLIB_SUCCESS; // result of one option
+    long online = sysconf(_SC_NPROCESSORS_ONLN); // processors available
+
+    memset(p_config, 0, sizeof(*p_config));
+    memset(p_config->b_run, 1, sizeof(p_config->b_run));
+    p_config->max_threads = (2 > online) ? 2 : (unsigned int)online;
+    p_config->max_threads = (RPLIB_BENCH_MAX_THREADS < p_config->max_threads)
+                                ? RPLIB_BENCH_MAX_THREADS
+                                : p_config->max_threads;
+    p_config->num_ops     = RPLIB_BENCH_DEFAULT_OPS;
+    p_config->num_reps    = RPLIB_BENCH_DEFAULT_REPS;
+    p_config->payload     = RPLIB_BENCH_DEFAULT_PAYLOAD;
+
+    opterr = 0;
+    while (-1 != (opt = getopt(argc, pp_argv, "b:t:n:r:l:h")))
+    {
+        switch (opt)
+        {
+            case 'b':
+                res = rplib_bench_parse_families(optarg, p_config);
+                break;
+            case 't':
+                res = rplib_bench_parse_uint(optarg,
+                                             1,
+                                             RPLIB_BENCH_MAX_THREADS,
+                                             &p_config->max_threads);
+                break;
+            case 'n':
+                res = rplib_bench_parse_uint(optarg,
+                                             RPLIB_BENCH_MAX_THREADS,
+                                             RPLIB_BENCH_MAX_OPS,
+                                             &p_config->num_ops);
+                break;
+            case 'r':
+                res = rplib_bench_parse_uint(
+                    optarg, 1, RPLIB_BENCH_MAX_REPS, &p_config->num_reps);
+                break;
+            case 'l':
+                res = rplib_bench_parse_uint(
+                    optarg, 1, RPLIB_BENCH_MAX_PAYLOAD, &p_config->payload);
+                break;
+            default:
+                goto print_usage;
+        }
+        if (RPLIB_SUCCESS != res)
+        {
+            printf("Invalid Argument for -%c\n", opt);
+            goto print_usage;
+        }
+    }
+    return RPLIB_SUCCESS;
+print_usage:
+    fprintf(stdout,
+            "Usage: \n rplib_bench -b[families to run, comma separated: "
+            "queue, dispatch, remove, alloc (default all)] "
+            "-t[most threads, counts double up to it, 1-%d (default online "
+            "processors, at least 2)] "
+            "-n[operations per run, at least %d (default %d)] "
+            "-r[runs per case, median reported, 1-%d (default %d)] "
+            "-l[bytes per queued entry, 1-%d (default %d)]\n",
+            RPLIB_BENCH_MAX_THREADS,
+            RPLIB_BENCH_MAX_THREADS,
+            RPLIB_BENCH_DEFAULT_OPS,
+            RPLIB_BENCH_MAX_REPS,
+            RPLIB_BENCH_DEFAULT_REPS,
+            RPLIB_BENCH_MAX_PAYLOAD,
+            RPLIB_BENCH_DEFAULT_PAYLOAD);
+    return RPLIB_UNSUCCESS;
+}
+
+/**
+ * Step to the next thread count: 1, 2, 4 ... and the most asked for, even if
+ * not a power of two
+ * @param num_threads Thread count just run
+ * @param p_config Pointer to options
+ * @return Next thread count, 0 once the most asked for has run
+ */
+static unsigned int
+rplib_bench_next_threads(unsigned int                num_threads,
+                         const rplib_bench_config_t *p_config)
+{
+    if (num_threads >= p_config->max_threads)
+    {
+        return 0;
+    }
+    return (num_threads * 2 > p_config->max_threads) ? p_config->max_threads
+                                                     : num_threads * 2;
+}
+
+/**
+ * Entry point for the microbenchmarks. Results go to stdout as CSV
+ * @param argc arg count
+ * @param argv arg array
+ * @return 0 if every case ran, 1 otherwise
+ */
+int
+main(int argc, char **argv)
+{
+    int                   res         = RPLIB_SUCCESS; // assume success
+    rplib_bench_config_t  config;                      // options of session
+    rplib_bench_sample_t *p_samples   = NULL;          // runs of a case
+    unsigned int          num_threads = 0;             // threads of case
+
+    if (RPLIB_SUCCESS != rplib_bench_get_arguments(argc, argv, &config))
+    {
+        return EXIT_FAILURE;
+    }
+    p_samples = calloc(config.num_reps, sizeof(*p_samples));
+    if (NULL == p_samples)
+    {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+
+    // keep the CSV on stdout alone: results get a copy of it, and anything
+    // else printed there is sent to stderr
+    fflush(stdout);
+    gp_results = fdopen(dup(STDOUT_FILENO), "w");
+    if (NULL == gp_results || 0 > dup2(STDERR_FILENO, STDOUT_FILENO))
+    {
+        perror("stdout");
+        free(p_samples);
+        return EXIT_FAILURE;
+    }
+
+    rplib_bench_print_header();
+    for (num_threads = 1; RPLIB_SUCCESS == res && 0 < num_threads;
+         num_threads = rplib_bench_next_threads(num_threads, &config))
+    {
+        if (config.b_run[RPLIB_BENCH_QUEUE])
+        {
+            res = rplib_bench_queue(&config, p_samples, num_threads);
+        }
+        if (RPLIB_SUCCESS == res && config.b_run[RPLIB_BENCH_DISPATCH])
+        {
+            res = rplib_bench_dispatch(&config, p_samples, num_threads);
+        }
+        if (RPLIB_SUCCESS == res && config.b_run[RPLIB_BENCH_ALLOC])
+        {
+            res = rplib_bench_alloc(&config, p_samples, num_threads);
+        }
+    }
+    if (RPLIB_SUCCESS == res && config.b_run[RPLIB_BENCH_REMOVE])
+    {
+        res = rplib_bench_remove(&config, p_samples);
+    }
+    if (RPLIB_SUCCESS != res)
+    {
+        fprintf(stderr, "rplib_bench: a case failed to run\n");
+    }
+    fclose(gp_results);
+    free(p_samples);
+    return (RPLIB_SUCCESS == res) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*** end of file ***/
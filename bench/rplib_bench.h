@@ -0,0 +1,102 @@
+/** @file rplib_bench.h
+ *
+ * @brief Microbenchmarks for the rplib structures under every message: the
+ * linked list queue, the threadpool handoff and the pool allocator. Each case
+ * runs several times and results are printed as CSV, one row per case, so
+ * runs can be compared over time
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#ifndef RPCHAT_RPLIB_BENCH_H
+#define RPCHAT_RPLIB_BENCH_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rplib_common.h"
+#include "rplib_ll_queue.h"
+#include "rplib_pool.h"
+
+#define RPLIB_BENCH_DEFAULT_OPS     1000000 // operations per run
+#define RPLIB_BENCH_DEFAULT_REPS    5       // runs per case, median reported
+#define RPLIB_BENCH_DEFAULT_PAYLOAD 64      // bytes copied per enqueue
+#define RPLIB_BENCH_MAX_OPS         1000000000
+#define RPLIB_BENCH_MAX_REPS        101
+#define RPLIB_BENCH_MAX_THREADS     256
+#define RPLIB_BENCH_MAX_PAYLOAD     65536
+#define RPLIB_BENCH_MIN_LIST        16      // shortest list removed from
+#define RPLIB_BENCH_MAX_LIST        16384   // longest list removed from
+#define RPLIB_BENCH_MIN_REMOVES     1000    // removals per run, any length
+#define RPLIB_BENCH_MAX_SAMPLES     20000   // dispatch latencies per run
+#define RPLIB_BENCH_DISPATCH_BATCH  64      // tasks per batched enqueue
+#define RPLIB_BENCH_LIVE_BLOCKS     256     // blocks each thread holds
+#define RPLIB_BENCH_SEED            0x9E3779B97F4A7C15ULL // fixed, repeatable
+
+/**
+ * Benchmark families, selectable with -b
+ */
+typedef enum
+{
+    RPLIB_BENCH_QUEUE = 0, // enqueue/dequeue pairs against thread count
+    RPLIB_BENCH_DISPATCH,  // empty tasks through the threadpool
+    RPLIB_BENCH_REMOVE,    // rplib_ll_remove_node against list length
+    RPLIB_BENCH_ALLOC,     // allocation churn, malloc against rplib_pool
+    RPLIB_BENCH_NUM_FAMILIES
+} rplib_bench_family_t;
+
+/**
+ * Options for a benchmark session
+ */
+typedef struct
+{
+    bool         b_run[RPLIB_BENCH_NUM_FAMILIES]; // families to run
+    unsigned int max_threads; // thread counts double up to this
+    unsigned int num_ops;     // operations per run
+    unsigned int num_reps;    // runs per case
+    unsigned int payload;     // bytes per queued entry
+} rplib_bench_config_t;
+
+/**
+ * What one run of a case measured
+ */
+typedef struct
+{
+    uint64_t elapsed_ns; // wall time of run
+    uint64_t num_ops;    // operations completed
+    uint64_t p50_ns;     // median latency, latency cases only
+    uint64_t p99_ns;     // 99th percentile latency, latency cases only
+} rplib_bench_sample_t;
+
+/**
+ * Work shared by the threads of one threaded run
+ */
+typedef struct
+{
+    pthread_barrier_t barrier;   // threads start together
+    pthread_mutex_t   mutex;     // guards p_queue when shared
+    rplib_ll_queue_t *p_queue;   // queue of shared case, or NULL
+    rplib_pool_t     *p_pool;    // pool of alloc case, or NULL
+    size_t            payload;   // bytes per queued entry
+    uint64_t          num_ops;   // operations per thread
+} rplib_bench_shared_t;
+
+/**
+ * State of one thread of a threaded run
+ */
+typedef struct
+{
+    rplib_bench_shared_t *p_shared; // work of run
+    pthread_t             thread;   // thread running the case
+    uint64_t              seed;     // xorshift state
+    uint64_t              start_ns; // work started
+    uint64_t              end_ns;   // work finished
+    int                   res;      // result of thread
+} rplib_bench_thread_t;
+
+#endif // RPCHAT_RPLIB_BENCH_H
+
+/*** end of file ***/
@@ -12,44 +12,279 @@
 
 #include <assert.h>
 #include <stdatomic.h>
+#include <stdint.h>
 
 #include "rpchat_basic_chat_util.h"
+#include "rpchat_file_xfer.h"
+#include "rpchat_frame_parser.h"
+#include "rpchat_room_index.h"
+#include "rpchat_shared_msg.h"
 #include "rpchat_string.h"
+#include "rplib_ll_queue.h"
+#include "rplib_pool.h"
+#include "rplib_ring_buf.h"
+#include "rplib_timer_wheel.h"
 #include "rplib_tpool.h"
 
+#define RPCHAT_CONN_INBOUND_BUF_SZ 16384 // must hold largest inbound frame
+#define RPCHAT_CONN_MAX_IOV        64    // frames written per vectored send
+#define RPCHAT_CONN_NAME_INLINE_SZ 24    // username bytes kept in the record
+#define RPCHAT_CONN_CACHE_LINE     64    // hot fields share one line
+#define RPCHAT_CONN_MAX_WINDOW     64    // most unacked DELIVERs granted
+
+// epoll reports one event per arming, so a connection is off the instance
+// while its event is processed and nothing needs to disarm it
+#define RPCHAT_CONN_EPOLL_EVENTS \
+    (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLET | EPOLLONESHOT)
+
 typedef enum rpchat_connection_status
 {
     RPCHAT_CONN_PRE_REGISTER,
+    RPCHAT_CONN_CLAIMING,       // username awaiting other nodes' agreement
     RPCHAT_CONN_AVAILABLE,      // connection is available to receive data
     RPCHAT_CONN_SEND_STAT,      // send a message outbound
     RPCHAT_CONN_SEND_MSG,       // send a message outbound
     RPCHAT_CONN_PENDING_STATUS, // data sent, awaiting status response
+    RPCHAT_CONN_RECV_FILE,      // SENDFILE contents arriving on socket
+    RPCHAT_CONN_SEND_FILE,      // RECVFILE contents being written to socket
     RPCHAT_CONN_ERR,            // error state
     RPCHAT_CONN_CLOSING,        // connection has closed
 } rpchat_conn_stat_t;
 
+/**
+ * Whether a flush task will take the deliveries posted to a connection's
+ * outbox
+ */
+typedef enum rpchat_flush_state
+{
+    RPCHAT_FLUSH_IDLE,   // none queued; the next post queues one or lingers
+    RPCHAT_FLUSH_QUEUED, // flush task queued, takes everything posted so far
+} rpchat_flush_state_t;
+
+/**
+ * Canned status messages, looked up in a static table when a STATUS is sent
+ * instead of being formatted into every connection
+ */
+typedef enum rpchat_stat_msg_id
+{
+    RPCHAT_STAT_MSG_NONE,     // empty status message
+    RPCHAT_STAT_MSG_INACTIVE, // disconnected by inactivity timeout
+    RPCHAT_STAT_MSG_NO_STORE, // SENDFILE contents could not be stored
+    RPCHAT_STAT_MSG_NO_FILE,  // GETFILE named nothing that can be served
+    RPCHAT_STAT_MSG_BACKLOG,  // disconnected for exceeding outbound budget
+    RPCHAT_STAT_MSG_BUSY,     // SEND refused, server holds too much outbound
+    RPCHAT_STAT_MSG_TAKEN,    // username held on another node of the cluster
+    RPCHAT_STAT_MSG_BAD_ROOM, // room name empty or not printable
+    RPCHAT_STAT_MSG_NO_ROOM,  // LEAVE or ROOMSEND names a room not joined
+    RPCHAT_STAT_MSG_ROOMS,    // JOIN refused, RPCHAT_ROOM_MAX_JOINED reached
+} rpchat_stat_msg_id_t;
+
+/**
+ * Compact name of a connection. Short names live in the record itself, longer
+ * ones in a block from the session allocator
+ */
+typedef struct rpchat_conn_name
+{
+    uint16_t len;        // length of name, excluding terminator
+    char    *p_contents; // NUL terminated; inline_buf or overflow block
+    char     inline_buf[RPCHAT_CONN_NAME_INLINE_SZ]; // storage of short names
+} rpchat_conn_name_t;
+
+/**
+ * A complete BCP message waiting to be written to a client
+ */
+typedef struct rpchat_outbound_frame
+{
+    rpchat_shared_msg_t *p_shared_msg; // encoded message, one reference held
+    size_t               sz_sent;      // bytes already written to socket
+} rpchat_outbound_frame_t;
+
+/**
+ * Intrusive links of a connection within its owning connection queue
+ */
+typedef struct rpchat_conn_link
+{
+    struct rpchat_connection_info *p_prev; // previous connection, NULL if front
+    struct rpchat_connection_info *p_next; // next connection, NULL if rear
+} rpchat_conn_link_t;
+
+/**
+ * Fields of a connection that only matter once it joins a room, is posted
+ * deliveries or is timed. Idle connections go without; created on first use
+ * by `rpchat_conn_info_get_extra` and kept until the connection is destroyed
+ */
+typedef struct rpchat_conn_extra
+{
+    pthread_mutex_t      mutex_outbox;     // lock for outbox fields
+    rplib_ll_queue_t    *p_outbox;         // deliveries posted, NULL if none
+    size_t               sz_outbox;        // bytes of those deliveries
+    uint8_t              flush_state;      // `rpchat_flush_state_t`
+    bool                 b_lingering;      // in queue's lingering list
+    struct rpchat_connection_info *p_next_linger; // under queue's linger lock
+    uint32_t             num_dropped;      // deliveries the notice reports
+    rpchat_shared_msg_t *p_drop_notice;    // parked notice of drops, or NULL
+    uint64_t             recv_ns;          // unparsed bytes buffered since
+    uint64_t             ack_sample_ns;    // timed DELIVER written at, or 0
+    uint8_t              ack_sample_ahead; // unacked DELIVERs older than it
+    uint8_t              num_rooms;        // # entries in rooms
+    rpchat_room_sub_t    rooms[RPCHAT_ROOM_MAX_JOINED]; // under room lock
+} rpchat_conn_extra_t;
+
+/**
+ * Everything tracked for one client. Fields touched by every event come first
+ * and fill a single cache line; records must be allocated with
+ * `aligned_alloc(RPCHAT_CONN_CACHE_LINE, ...)`
+ */
 typedef struct rpchat_connection_info
 {
-    int                h_fd;         // descriptor of active TCP socket
-    atomic_int         pending_jobs; // # of jobs queued for this client
-    rpchat_string_t    username;     // username picked by client
-    rpchat_string_t    stat_msg;     // error/status message as applicable
-    pthread_mutex_t    mutex_conn;   // lock for connection
-    rpchat_conn_stat_t conn_status;  // status of connection
-    time_t             last_active;  // time connection was last active
+    _Alignas(RPCHAT_CONN_CACHE_LINE) int h_fd; // descriptor of TCP socket
+    rpchat_conn_stat_t     conn_status;      // status of connection
+    atomic_int             pending_jobs;     // # of jobs queued for client
+    bool                   b_affinity;       // pinned, mutex_conn unused
+    uint8_t                stat_msg_id;      // `rpchat_stat_msg_id_t` to send
+    uint8_t                window;           // DELIVERs allowed unacked
+    uint8_t                in_flight;        // DELIVERs sent, not yet acked
+    _Atomic(time_t)        last_active;      // time connection last active
+    pthread_mutex_t        mutex_conn;       // lock for connection
+    rpchat_conn_name_t     username;         // username picked by client
+    rplib_ring_buf_t       inbound_buf;      // bytes received but not parsed
+    rpchat_frame_parser_t  inbound_parser;   // parse progress of inbound buf
+    rplib_ll_queue_t      *p_outbound_queue; // frames waiting to be written
+    rplib_ll_queue_t      *p_parked_in;      // inbound events parked, or NULL
+    rplib_ll_queue_t      *p_parked_out;     // outbound ones parked, or NULL
+    rplib_pool_t          *p_pool;           // session allocator
+    rplib_tpool_affinity_t affinity;         // worker tasks are pinned to
+    rpchat_conn_link_t     queue_link;       // membership in owning queue
+    rplib_timer_node_t     idle_timer;       // inactivity check, owned by queue
+    rpchat_file_xfer_t    *p_xfer;           // file transfer, NULL if none
+    atomic_size_t          backlog_frames;   // deliveries queued, not yet sent
+    atomic_size_t          sz_backlog;       // bytes of those deliveries
+    atomic_bool            b_overrun;        // budget exceeded, disconnecting
+    atomic_bool            b_poll_pending;   // io_uring poll not yet reported
+    bool                   b_unlinked;       // left queue list, under its lock
+    atomic_bool            b_reclaimable;    // no snapshot lists it anymore
+    uint64_t               retired_gen;      // first snapshot not listing it
+    _Atomic(rpchat_conn_extra_t *) p_extra;  // cold fields, NULL until used
 } rpchat_conn_info_t;
 
 /**
  * Initialize a connection info object with default values
  * @param p_new_conn_info Pointer to new connection info object
  * @param h_new_fd File descriptor to associate with this info object
+ * @param p_pool Pointer to session allocator used for outbound messages
+ * @param b_affinity Whether to run all of this connection's tasks on one
+ * worker, one at a time, instead of serializing them with `mutex_conn`
  * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS on problems
  */
 int rpchat_conn_info_initialize(rpchat_conn_info_t *p_new_conn_info,
-                                int                 h_new_fd);
+                                int                 h_new_fd,
+                                rplib_pool_t       *p_pool,
+                                bool                b_affinity);
+
+/**
+ * Release all resources owned by a connection info object
+ * @param p_conn_info Pointer to connection info object
+ * \nNote: `mutex_conn` must not be held; it is destroyed here
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS on problems
+ */
+int rpchat_conn_info_destroy(rpchat_conn_info_t *p_conn_info);
+
+/**
+ * Get the cold fields of a connection, creating them on first use
+ * \nNote: Safe from any thread; the first to publish its copy wins
+ * @param p_conn_info Pointer to connection info object
+ * @return Pointer to fields; NULL on allocation failure
+ */
+rpchat_conn_extra_t *rpchat_conn_info_get_extra(
+    rpchat_conn_info_t *p_conn_info);
+
+/**
+ * Set the username of a connection, copying only the bytes in use
+ * \nNote: callers serialize changes, see `rpchat_conn_queue_claim_username`
+ * @param p_conn_info Pointer to connection info object
+ * @param p_username Pointer to sanitized username
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on allocation failure
+ */
+int rpchat_conn_info_set_username(rpchat_conn_info_t *p_conn_info,
+                                  rpchat_string_t    *p_username);
+
+/**
+ * Clear the username of a connection, releasing any overflow block
+ * @param p_conn_info Pointer to connection info object
+ */
+void rpchat_conn_info_clear_username(rpchat_conn_info_t *p_conn_info);
+
+/**
+ * Drain pending bytes from a connection's socket into its inbound buffer.
+ * Reads as much as the buffer can hold with a single vectored `recv`. Storage
+ * for the buffer is taken from the session allocator when the first byte
+ * arrives
+ * @param p_conn_info Pointer to connection info object
+ * @return RPLIB_SUCCESS if socket drained (or buffer full), RPLIB_ERROR if the
+ * peer disconnected or the socket errored
+ */
+int rpchat_conn_info_fill_inbound(rpchat_conn_info_t *p_conn_info);
+
+/**
+ * Give inbound buffer storage back to the session allocator once everything
+ * received has been parsed, so idle connections hold none
+ * @param p_conn_info Pointer to connection info object
+ */
+void rpchat_conn_info_release_inbound(rpchat_conn_info_t *p_conn_info);
+
+/**
+ * Append a message to a connection's outbound queue. The message is copied, so
+ * the caller keeps ownership of p_msg_buf
+ * @param p_conn_info Pointer to connection info object
+ * @param p_msg_buf Pointer to buffer containing valid BCP message
+ * @param sz_msg_buf Size of passed message buffer
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on allocation failure
+ */
+int rpchat_conn_info_queue_outbound(rpchat_conn_info_t *p_conn_info,
+                                    char               *p_msg_buf,
+                                    size_t              sz_msg_buf);
+
+/**
+ * Append a shared message to a connection's outbound queue without copying
+ * it. The queue takes its own reference, released once the message is written
+ * @param p_conn_info Pointer to connection info object
+ * @param p_shared_msg Pointer to shared message containing valid BCP message
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on allocation failure
+ */
+int rpchat_conn_info_queue_shared(rpchat_conn_info_t  *p_conn_info,
+                                  rpchat_shared_msg_t *p_shared_msg);
+
+/**
+ * Write as much of a connection's outbound queue as the socket accepts, using
+ * vectored sends. Partially written frames stay at the front of the queue
+ * @param p_conn_info Pointer to connection info object
+ * @return RPLIB_SUCCESS if queue drained or socket full, RPLIB_ERROR if the
+ * socket errored
+ */
+int rpchat_conn_info_flush_outbound(rpchat_conn_info_t *p_conn_info);
 
 /**
- * Enqueue tasks into threadpool
+ * Check whether a connection has frames waiting to be written
+ * @param p_conn_info Pointer to connection info object
+ * @return true if outbound queue is non-empty
+ */
+bool rpchat_conn_info_has_outbound(rpchat_conn_info_t *p_conn_info);
+
+/**
+ * Listen for inbound data on a connection, and for writability while its
+ * outbound queue is non-empty. While a download is written only writability
+ * is listened for, so requests the client sends meanwhile wait in the socket.
+ * Arms a single report; the connection is armed again once that report has
+ * been handled
+ * @param p_conn_info Pointer to connection info object
+ * @param h_fd_epoll Epoll instance file descriptor
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS on problems
+ */
+int rpchat_conn_info_arm(rpchat_conn_info_t *p_conn_info, int h_fd_epoll);
+
+/**
+ * Enqueue tasks into threadpool. When the connection uses affinity, the task
+ * is queued on the worker the connection is pinned to
  * @param p_conn_info Pointer to `rpchat_conn_info_t` object involved in
  * transaction
  * @param p_tpool Pointer to threadpool object
@@ -62,6 +297,20 @@ int rpchat_conn_info_enqueue_task(rpchat_conn_info_t *p_conn_info,
                                   void (*p_function)(void *p_arg),
                                   void *p_arg);
 
+/**
+ * Prepare a task for a connection without enqueuing it, so several can be
+ * handed to `rplib_tpool_enqueue_batch` at once. The task is counted as
+ * pending right away; callers undo the count for tasks the batch did not take
+ * @param p_conn_info Pointer to `rpchat_conn_info_t` object without affinity
+ * @param p_task Pointer to task to fill
+ * @param p_function Function pointer to task to execute
+ * @param p_arg Pointer to args to use with function
+ */
+void rpchat_conn_info_batch_task(rpchat_conn_info_t *p_conn_info,
+                                 rplib_tpool_task_t *p_task,
+                                 void (*p_function)(void *p_arg),
+                                 void *p_arg);
+
 #endif // RPCHAT_RPCHAT_CONN_INFO_H
 
 /*** end of file ***/
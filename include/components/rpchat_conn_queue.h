@@ -11,50 +11,190 @@
 #define RPCHAT_RPCHAT_CONN_QUEUE_H
 
 #include <assert.h>
+#include <stdatomic.h>
 
 #include "rpchat_basic_chat_util.h"
 #include "rpchat_conn_info.h"
+#include "rpchat_name_index.h"
+#include "rpchat_room_index.h"
 #include "rplib_ll_queue.h"
+#include "rplib_pool.h"
+#include "rplib_timer_wheel.h"
 #include "rplib_tpool.h"
 
 #define RPCHAT_SERVER_IDENTIFIER "[Server]" // used for server message prefix
+#define RPCHAT_CONN_QUEUE_MAX_PEERS 64       // queues that may reach each other
 
 /**
- * Conn_Queue holds a linked list of all conn_info objects, a mutex for it, as
- * well as globals for the lifetime of the BCP server session
+ * Outbound budgets, shared by every reactor. DELIVER and FNOTIFY messages
+ * count against their recipient from the moment they are queued for it until
+ * they are written to its outbound queue (or dropped); the sum over all
+ * clients is kept in `sz_queued`
  */
-typedef struct
+typedef struct rpchat_backlog_policy
 {
-    rplib_ll_queue_t *p_conn_ll;     // linked list of conn_info objects
-    pthread_mutex_t   mutex_conn_ll; // mutex for linked list
-    int               h_fd_epoll;    // File descriptor of epoll server
-    rpchat_string_t   server_str;    // String that server will use in messages
+    size_t        max_frames;    // messages queued per client at most
+    size_t        max_bytes;     // bytes of those per client at most
+    bool          b_drop_oldest; // over budget: drop oldest, else disconnect
+    size_t        watermark;     // SENDs refused once sz_queued reaches this
+    atomic_size_t sz_queued;     // bytes queued for every client
+} rpchat_backlog_policy_t;
+
+/**
+ * Immutable listing of a queue's connections, published whenever one joins or
+ * leaves. Broadcasts walk a snapshot instead of the list, without its lock; a
+ * connection left out of newer snapshots is only destroyed once no reader
+ * holds a snapshot listing it
+ */
+typedef struct rpchat_conn_snapshot
+{
+    atomic_int                   refcount;   // readers, plus queue if current
+    uint64_t                     generation; // increases with every publish
+    struct rpchat_conn_snapshot *p_older;    // live snapshots, under list lock
+    struct rpchat_conn_snapshot *p_newer;    // NULL if current
+    size_t                       num_conns;  // # entries in p_conns
+    rpchat_conn_info_t          *p_conns[];  // connections, oldest first
+} rpchat_conn_snapshot_t;
+
+/**
+ * Conn_Queue holds an intrusive list of all conn_info objects, a mutex for it,
+ * as well as globals for the lifetime of the BCP server session. With several
+ * reactors, each has its own queue and reaches the others through `pp_peers`.
+ * Usernames and rooms of every reactor are indexed by the first queue. Every
+ * connection
+ * has an inactivity deadline in `idle_timers`; creators set `conn_timeout`,
+ * `idle_recheck`, `h_fd_file_dir`, `p_file_cache`, `p_backlog`,
+ * `p_cluster`, `p_tpool`, `flush_bytes` and `flush_us` before adding
+ * connections. Deliveries to a connection are written in batches of up to
+ * `flush_bytes`; with `flush_us` set, a batch may wait that long for more,
+ * until `h_fd_flush` fires
+ */
+typedef struct rpchat_conn_queue
+{
+    rpchat_conn_info_t        *p_conn_front;  // oldest connection
+    rpchat_conn_info_t        *p_conn_rear;   // newest connection
+    size_t                     num_conns;     // # connections in list
+    pthread_mutex_t            mutex_conn_ll; // mutex for connection list
+    rpchat_conn_snapshot_t    *p_snapshot;    // current, under both locks
+    pthread_mutex_t            mutex_snap;    // held to take p_snapshot
+    rpchat_conn_snapshot_t    *p_oldest;      // live snapshots, under list lock
+    uint64_t                   generation;    // of p_snapshot
+    rpchat_conn_info_t        *p_retired;     // unlinked, maybe still listed
+    rpchat_name_index_t        name_index;    // username to connection
+    pthread_mutex_t            mutex_names;   // mutex for name_index
+    rpchat_room_index_t        room_index;    // room name to members
+    pthread_mutex_t            mutex_rooms;   // mutex for room_index, rooms
+    int                        h_fd_epoll;    // File descriptor of epoll server
+    rpchat_conn_name_t         server_name;   // sender of server messages
+    rplib_pool_t              *p_pool;        // allocator for args and messages
+    bool                       b_affinity;    // pin each connection to a worker
+    bool                       b_owns_pool;   // p_pool created by this queue
+    struct rpchat_conn_queue **pp_peers;      // queue of every reactor, or NULL
+    size_t                     num_peers;     // # entries in pp_peers
+    int                        h_fd_mailbox;  // eventfd, readable on new mail
+    rplib_ll_queue_t          *p_mailbox;     // broadcasts from other reactors
+    pthread_mutex_t            mutex_mailbox; // mutex for mailbox
+    atomic_bool                b_terminate;   // reactor asked to stop
+    rplib_timer_wheel_t        idle_timers;   // under mutex_conn_ll, 1 s ticks
+    time_t                     conn_timeout;  // seconds idle before disconnect
+    time_t                     idle_recheck;  // seconds between idle checks
+    int                        h_fd_file_dir; // file directory, -1 if none
+    rpchat_file_cache_t       *p_file_cache;  // shared by reactors, or NULL
+    rpchat_backlog_policy_t   *p_backlog;     // shared by reactors, or NULL
+    struct rpchat_cluster     *p_cluster;     // federation, NULL if standalone
+    rplib_tpool_t             *p_tpool;       // wakes retired connections
+    size_t                     flush_bytes;   // deliveries written at once
+    long                       flush_us;      // linger of a batch, 0 for none
+    int                        h_fd_flush;    // timerfd, readable once due
+    rpchat_conn_info_t        *p_lingering;   // batches waiting for h_fd_flush
+    pthread_mutex_t            mutex_linger;  // mutex for p_lingering
 } rpchat_conn_queue_t;
 /**
  * Create a rpchat_conn_queue object
+ * @param h_fd_epoll Epoll instance file descriptor
+ * @param b_affinity Whether connections added to queue pin their tasks to a
+ * single worker
+ * @param p_shared_pool Allocator to share with other queues; NULL to create
+ * one owned by this queue
  * @return Pointer to object in heap on success, NULL on failure
  */
-rpchat_conn_queue_t *rpchat_conn_queue_create(int h_fd_epoll);
+rpchat_conn_queue_t *rpchat_conn_queue_create(int           h_fd_epoll,
+                                              bool          b_affinity,
+                                              rplib_pool_t *p_shared_pool);
 /**
- * Destroy an rpchat_conn_queue object
+ * Destroy an rpchat_conn_queue object. A queue owning a shared pool must be
+ * destroyed after every queue borrowing it
  * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS on failure
  */
 int rpchat_conn_queue_destroy(rpchat_conn_queue_t *p_conn_queue);
 /**
- * Clean up a disconnected client's underlying data structures and post a
- * message to all connected clients\n\n
- * WARNING: Assumes the caller has locked the passed conn_info object's mutex.
- * Unexpected behavior will occur if it has not.
+ * Add a newly accepted connection to the rear of a queue, and schedule its
+ * first inactivity check
+ * @param p_conn_queue Pointer to connection queue object
+ * @param p_conn_info Pointer to heap allocated, initialized connection info;
+ * the queue frees it once destroyed
+ */
+void rpchat_conn_queue_add_conn_info(rpchat_conn_queue_t *p_conn_queue,
+                                     rpchat_conn_info_t  *p_conn_info);
+/**
+ * Add several newly accepted connections to the rear of a queue in order,
+ * taking its lock once, and schedule their first inactivity checks
  * @param p_conn_queue Pointer to connection queue object
+ * @param pp_conn_infos Array of heap allocated, initialized connection infos;
+ * the queue frees each once destroyed
+ * @param num_conns Number of entries in pp_conn_infos
+ */
+void rpchat_conn_queue_add_conn_batch(rpchat_conn_queue_t *p_conn_queue,
+                                      rpchat_conn_info_t **pp_conn_infos,
+                                      size_t               num_conns);
+/**
+ * Unlink a closing connection from its queue and its rooms, cancel its
+ * inactivity check, release its username and publish a snapshot without it,
+ * so no new broadcast or audit can reach it. Only done on the first call.
+ * It cannot be destroyed while a reader still holds an older snapshot or tasks
+ * for it are queued; the last task retries, and once the last such snapshot
+ * is released the connection is handed a HEARTBEAT to retry with
+ * @param p_conn_queue Pointer to connection queue object
+ * @param p_conn_info Pointer to connection info object corresponding to target
+ * @return RPLIB_SUCCESS if removed and ready to be destroyed, RPLIB_UNSUCCESS
+ * if snapshots or tasks may still reach it
+ */
+int rpchat_conn_queue_remove_conn_info(rpchat_conn_queue_t *p_conn_queue,
+                                       rpchat_conn_info_t  *p_conn_info);
+/**
+ * Clean up a removed client's underlying data structures and free it\n\n
+ * WARNING: Assumes the caller has locked the passed conn_info object's mutex
+ * (or is running the pinned connection's task), and that it was removed with
+ * `rpchat_conn_queue_remove_conn_info`. Unexpected behavior will occur if
+ * not.
  * @param p_conn_info Pointer to connection info object corresponding to target
  * @return RPLIB_SUCCESS on success; RPLIB_UNSUCCESS on error
  */
-int rpchat_conn_queue_destroy_conn_info(rpchat_conn_queue_t *p_conn_queue,
-                                        rpchat_conn_info_t  *p_conn_info);
+int rpchat_conn_queue_destroy_conn_info(rpchat_conn_info_t *p_conn_info);
 
 /**
- * Search a Queue of `rpchat_conn_info_t` objects for an object associated with
- * a given p_tgt_username
+ * Take a reference to the current snapshot of a queue's connections. Entries
+ * stay allocated until it is released, though they may be closing
+ * \nNote: Only a short lock is held, never the list lock
+ * @param p_conn_queue Pointer to connection queue
+ * @return Pointer to snapshot, never NULL
+ */
+rpchat_conn_snapshot_t *rpchat_conn_queue_acquire_snapshot(
+    rpchat_conn_queue_t *p_conn_queue);
+
+/**
+ * Drop a reference taken with `rpchat_conn_queue_acquire_snapshot`. The last
+ * reader of an old snapshot frees it, waking connections waiting on it
+ * @param p_conn_queue Pointer to connection queue the snapshot is of
+ * @param p_snapshot Pointer to snapshot
+ */
+void rpchat_conn_queue_release_snapshot(rpchat_conn_queue_t    *p_conn_queue,
+                                        rpchat_conn_snapshot_t *p_snapshot);
+
+/**
+ * Look up the connection registered under p_tgt_username on any reactor.
+ * The result may be stale once the index lock is dropped; registration
+ * should use `rpchat_conn_queue_claim_username`
  * @param p_conn_queue Pointer to Queue of `rpchat_conn_info_t` objects
  * @param p_tgt_username Username for comparison
  * @return `rpchat_conn_info_t` associated with p_tgt_username if found;
@@ -64,7 +204,70 @@ rpchat_conn_info_t *rpchat_conn_queue_find_by_username(
     rpchat_conn_queue_t *p_conn_queue, rpchat_string_t *p_tgt_username);
 
 /**
- * Helper function to get all names of all clients currently connected
+ * Register a username for a connection, unless another connection of any
+ * reactor already holds it. Check and claim happen under one lock
+ * @param p_conn_queue Pointer to connection queue
+ * @param p_conn_info Pointer to registering connection
+ * @param p_username Pointer to sanitized username
+ * @return RPLIB_SUCCESS if claimed, RPLIB_UNSUCCESS if taken, RPLIB_ERROR on
+ * allocation failure
+ */
+int rpchat_conn_queue_claim_username(rpchat_conn_queue_t *p_conn_queue,
+                                     rpchat_conn_info_t  *p_conn_info,
+                                     rpchat_string_t     *p_username);
+
+/**
+ * Give up the username of a connection that stays queued, so another client
+ * can claim it; the connection counts as unregistered from then on
+ * @param p_conn_queue Pointer to connection queue
+ * @param p_conn_info Pointer to connection
+ */
+void rpchat_conn_queue_release_username(rpchat_conn_queue_t *p_conn_queue,
+                                        rpchat_conn_info_t  *p_conn_info);
+
+/**
+ * Add a registered connection to a room of any reactor, by name
+ * @param p_conn_queue Pointer to queue of the connection
+ * @param p_conn_info Pointer to connection joining
+ * @param p_name Pointer to valid room name contents
+ * @param len Length of room name
+ * @return RPLIB_SUCCESS if joined (or already a member), RPLIB_UNSUCCESS if
+ * the connection joined too many rooms, RPLIB_ERROR on allocation failure
+ */
+int rpchat_conn_queue_join_room(rpchat_conn_queue_t *p_conn_queue,
+                                rpchat_conn_info_t  *p_conn_info,
+                                const char          *p_name,
+                                size_t               len);
+
+/**
+ * Remove a connection from a room it joined
+ * @param p_conn_queue Pointer to queue of the connection
+ * @param p_conn_info Pointer to connection leaving
+ * @param p_name Pointer to room name contents
+ * @param len Length of room name
+ * @return RPLIB_SUCCESS if left, RPLIB_UNSUCCESS if not a member
+ */
+int rpchat_conn_queue_leave_room(rpchat_conn_queue_t *p_conn_queue,
+                                 rpchat_conn_info_t  *p_conn_info,
+                                 const char          *p_name,
+                                 size_t               len);
+
+/**
+ * Lock the rooms of every reactor, so members of a room can be walked
+ * @param p_conn_queue Pointer to connection queue
+ */
+void rpchat_conn_queue_lock_rooms(rpchat_conn_queue_t *p_conn_queue);
+
+/**
+ * Unlock the rooms locked with `rpchat_conn_queue_lock_rooms`
+ * @param p_conn_queue Pointer to connection queue
+ */
+void rpchat_conn_queue_unlock_rooms(rpchat_conn_queue_t *p_conn_queue);
+
+/**
+ * Helper function to get all names of all clients currently connected, to
+ * this queue or any of its peers
+ * \nNote: Takes the username lock; names are only freed under it
  * @param p_conn_queue Pointer to connection queue
  * @param p_output_buf Pointer to string to store usernames in
  * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS otherwise
@@ -72,6 +275,78 @@ rpchat_conn_info_t *rpchat_conn_queue_find_by_username(
 int rpchat_conn_queue_list_users(rpchat_conn_queue_t *p_conn_queue,
                                  rpchat_string_t     *p_output_buf);
 
+/**
+ * Count clients connected to this queue and all of its peers
+ * @param p_conn_queue Pointer to connection queue
+ * @return Number of connections
+ */
+size_t rpchat_conn_queue_count_users(rpchat_conn_queue_t *p_conn_queue);
+
+/**
+ * Get a queue from the set of reactors a queue belongs to
+ * @param p_conn_queue Pointer to connection queue
+ * @param peer_index Index of peer, below `num_peers`
+ * @return Pointer to peer queue (p_conn_queue itself if it has no peers)
+ */
+rpchat_conn_queue_t *rpchat_conn_queue_get_peer(
+    rpchat_conn_queue_t *p_conn_queue, size_t peer_index);
+
+/**
+ * Post a shared message to a queue's mailbox, to be fanned out to its
+ * connections by the reactor owning it. The mailbox takes its own reference
+ * @param p_conn_queue Pointer to recipient connection queue
+ * @param p_shared_msg Pointer to shared message containing valid BCP message
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS otherwise
+ */
+int rpchat_conn_queue_post_mail(rpchat_conn_queue_t *p_conn_queue,
+                                rpchat_shared_msg_t *p_shared_msg);
+
+/**
+ * Post several shared messages to a queue's mailbox in order, taking its lock
+ * and waking its reactor once. The mailbox takes its own references
+ * @param p_conn_queue Pointer to recipient connection queue
+ * @param pp_shared_msgs Array of shared messages containing valid BCP messages
+ * @param num_msgs Number of entries in pp_shared_msgs
+ * @return Number of messages posted, counted from the first
+ */
+size_t rpchat_conn_queue_post_mail_batch(rpchat_conn_queue_t  *p_conn_queue,
+                                         rpchat_shared_msg_t **pp_shared_msgs,
+                                         size_t                num_msgs);
+
+/**
+ * Take the oldest message from a queue's mailbox. Once the mailbox is empty
+ * its eventfd is reset
+ * @param p_conn_queue Pointer to connection queue
+ * @return Pointer to shared message (caller owns the reference); NULL if none
+ */
+rpchat_shared_msg_t *rpchat_conn_queue_take_mail(
+    rpchat_conn_queue_t *p_conn_queue);
+
+/**
+ * Let a connection's deliveries wait for the queue's flush timer, set to fire
+ * `flush_us` from now unless another batch already set it
+ * @param p_conn_queue Pointer to queue of the connection
+ * @param p_conn_info Pointer to connection, not yet lingering (its extra
+ * fields already created)
+ */
+void rpchat_conn_queue_linger(rpchat_conn_queue_t *p_conn_queue,
+                              rpchat_conn_info_t  *p_conn_info);
+
+/**
+ * Take every connection waiting for the queue's flush timer, and reset it
+ * @param p_conn_queue Pointer to connection queue
+ * @return Pointer to first connection, linked through `p_next_linger` of
+ * its extra fields; NULL if none
+ */
+rpchat_conn_info_t *rpchat_conn_queue_take_lingering(
+    rpchat_conn_queue_t *p_conn_queue);
+
+/**
+ * Ask the reactor owning a queue to stop, waking it through its mailbox
+ * @param p_conn_queue Pointer to connection queue
+ */
+void rpchat_conn_queue_stop(rpchat_conn_queue_t *p_conn_queue);
+
 #endif // RPCHAT_RPCHAT_CONN_QUEUE_H
 
 /*** end of file ***/
@@ -0,0 +1,142 @@
+/** @file rpchat_file_cache.h
+ *
+ * @brief Cache of recently downloaded files, shared by every reactor. Files
+ * are mapped read-only once and served to each downloader from the same
+ * pages, with the RECVFILE header built alongside; least recently used files
+ * are unmapped to stay within a memory budget. Re-uploading a file drops its
+ * entry
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#ifndef RPCHAT_RPCHAT_FILE_CACHE_H
+#define RPCHAT_RPCHAT_FILE_CACHE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rpchat_basic_chat_util.h"
+#include "rplib_common.h"
+
+#define RPCHAT_FILE_CACHE_BUDGET   67108864 // bytes mapped at most by default
+#define RPCHAT_FILE_CACHE_MAX_FILE 16777216 // larger files are not cached
+#define RPCHAT_FILE_CACHE_BUCKETS  256      // hash chains, power of two
+#define RPCHAT_FILE_CACHE_NAME_MAX 200      // matches RPCHAT_FILE_NAME_MAX
+
+/**
+ * A mapped file. Listed entries hold a reference for the cache; every
+ * download holds its own, so an entry evicted or invalidated mid-download
+ * stays mapped until that download ends
+ */
+typedef struct rpchat_file_entry
+{
+    atomic_int                refcount;    // cache while listed + downloads
+    struct rpchat_file_entry *p_next_hash; // next entry in hash chain
+    struct rpchat_file_entry *p_prev_lru;  // more recently used entry
+    struct rpchat_file_entry *p_next_lru;  // less recently used entry
+    uint32_t                  hash;        // hash of file_name
+    uint32_t                  file_len;    // bytes of contents
+    const char               *p_contents;  // read-only mapping, NULL if empty
+    rpchat_pkt_recvfile_t     header;      // RECVFILE header for contents
+    char file_name[RPCHAT_FILE_CACHE_NAME_MAX + 1]; // name contents are under
+} rpchat_file_entry_t;
+
+/**
+ * Counters kept by a file cache
+ */
+typedef struct rpchat_file_cache_stats
+{
+    size_t hits;        // downloads served from a mapping
+    size_t misses;      // downloads that had to open the file
+    size_t num_entries; // files currently listed
+    size_t sz_mapped;   // bytes of listed files
+} rpchat_file_cache_stats_t;
+
+typedef struct rpchat_file_cache
+{
+    pthread_mutex_t      mutex_cache; // guards table, LRU list and sizes
+    size_t               budget;      // most bytes listed entries may map
+    size_t               sz_mapped;   // bytes mapped by listed entries
+    size_t               num_entries; // # listed entries
+    uint64_t             generation;  // bumped by every invalidation
+    rpchat_file_entry_t *p_lru_front; // most recently used
+    rpchat_file_entry_t *p_lru_back;  // first to be evicted
+    atomic_size_t        hits;        // lookups that found an entry
+    atomic_size_t        misses;      // lookups that did not
+    rpchat_file_entry_t *p_buckets[RPCHAT_FILE_CACHE_BUCKETS]; // hash chains
+} rpchat_file_cache_t;
+
+/**
+ * Create an empty file cache
+ * @param budget Most bytes of file contents to keep mapped
+ * @return Pointer to cache; NULL on failure
+ */
+rpchat_file_cache_t *rpchat_file_cache_create(size_t budget);
+
+/**
+ * Unmap every listed entry and free the cache. Entries still held by
+ * downloads are freed when those release them
+ * @param p_cache Pointer to cache; NULL is ignored
+ */
+void rpchat_file_cache_destroy(rpchat_file_cache_t *p_cache);
+
+/**
+ * Look up a file, marking it most recently used
+ * @param p_cache Pointer to cache
+ * @param p_name Pointer to null-terminated, already checked filename
+ * @param p_generation Pointer to receive the generation to pass to
+ * `rpchat_file_cache_insert` on a miss
+ * @return Pointer to entry with a reference taken for the caller; NULL on a
+ * miss
+ */
+rpchat_file_entry_t *rpchat_file_cache_find(rpchat_file_cache_t *p_cache,
+                                            const char          *p_name,
+                                            uint64_t            *p_generation);
+
+/**
+ * Map a file that missed and list it, evicting least recently used entries
+ * to stay within budget. If the file was invalidated since the lookup (the
+ * generation moved on), the mapping is returned but not listed, so stale
+ * contents are never served to later downloads
+ * @param p_cache Pointer to cache
+ * @param p_name Pointer to null-terminated filename the file was opened by
+ * @param h_fd_file Open descriptor of the file, not consumed
+ * @param file_len Size of the file
+ * @param generation Generation returned by the missed lookup
+ * @return Pointer to entry with a reference taken for the caller; NULL if the
+ * file is too large to cache or could not be mapped
+ */
+rpchat_file_entry_t *rpchat_file_cache_insert(rpchat_file_cache_t *p_cache,
+                                              const char          *p_name,
+                                              int                  h_fd_file,
+                                              uint32_t             file_len,
+                                              uint64_t             generation);
+
+/**
+ * Drop the entry of a file whose contents changed, if listed
+ * @param p_cache Pointer to cache; NULL is ignored
+ * @param p_name Pointer to null-terminated filename
+ */
+void rpchat_file_cache_invalidate(rpchat_file_cache_t *p_cache,
+                                  const char          *p_name);
+
+/**
+ * Drop a reference to an entry, unmapping it once no holders remain
+ * @param p_entry Pointer to entry
+ */
+void rpchat_file_entry_release(rpchat_file_entry_t *p_entry);
+
+/**
+ * Get the counters of a file cache, read by every metrics scrape
+ * @param p_cache Pointer to cache
+ * @param p_stats Pointer to receive counters
+ */
+void rpchat_file_cache_get_stats(rpchat_file_cache_t       *p_cache,
+                                 rpchat_file_cache_stats_t *p_stats);
+
+#endif // RPCHAT_RPCHAT_FILE_CACHE_H
+
+/*** end of file ***/
@@ -0,0 +1,160 @@
+/** @file rpchat_file_xfer.h
+ *
+ * @brief Resumable file transfers between a client socket and the file
+ * directory. Uploads are spliced from the socket into the file through a
+ * pipe, downloads are served with `sendfile`, so file contents are never
+ * copied through user space. Each step moves a bounded amount and reports
+ * whether the transfer is done, blocked on the socket, or yielding the worker
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#ifndef RPCHAT_RPCHAT_FILE_XFER_H
+#define RPCHAT_RPCHAT_FILE_XFER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "rpchat_basic_chat_util.h"
+#include "rpchat_file_cache.h"
+#include "rpchat_string.h"
+#include "rplib_pool.h"
+#include "rplib_ring_buf.h"
+
+#define RPCHAT_FILE_NAME_MAX   RPCHAT_FILE_CACHE_NAME_MAX // longest filename
+#define RPCHAT_FILE_PART_FMT   ".part.%d.%s" // upload in progress, per socket
+#define RPCHAT_FILE_PATH_MAX   256           // room for a part name
+#define RPCHAT_FILE_PIPE_SZ    1048576       // splice pipe size asked for
+#define RPCHAT_FILE_XFER_SLICE 4194304       // bytes moved per step at most
+#define RPCHAT_FILE_MODE       0644          // permissions of uploaded files
+
+typedef enum rpchat_file_xfer_dir
+{
+    RPCHAT_FILE_XFER_UPLOAD,   // socket to file (SENDFILE)
+    RPCHAT_FILE_XFER_DOWNLOAD, // file to socket (RECVFILE)
+} rpchat_file_xfer_dir_t;
+
+typedef enum rpchat_file_xfer_res
+{
+    RPCHAT_FILE_XFER_DONE,    // every byte moved
+    RPCHAT_FILE_XFER_BLOCKED, // socket would block, wait for readiness
+    RPCHAT_FILE_XFER_YIELD,   // slice used up, continue from a new task
+    RPCHAT_FILE_XFER_FAILED,  // socket failed, stream cannot be resumed
+} rpchat_file_xfer_res_t;
+
+/**
+ * A transfer in progress, owned by the connection it runs on. A failed file
+ * write does not end an upload: the rest of the contents are discarded so
+ * the stream stays in sync, and `b_failed` tells the client afterwards
+ */
+typedef struct rpchat_file_xfer
+{
+    rpchat_file_xfer_dir_t direction;    // which way bytes move
+    int                    h_fd_dir;     // file directory, not owned
+    rpchat_file_cache_t   *p_cache;      // cache of directory, may be NULL
+    rpchat_file_entry_t   *p_entry;      // cached contents (downloads), or NULL
+    rpchat_pkt_recvfile_t  header;       // RECVFILE header (downloads)
+    int                    h_fd_file;    // file being written or read
+    int                    h_fd_pipe[2]; // splice pipe (uploads), read end 0
+    size_t                 sz_in_pipe;   // bytes read from socket, not written
+    off_t                  offset;       // bytes read from file (downloads)
+    uint32_t               file_len;     // bytes of contents in total
+    uint32_t               remaining;    // bytes still to cross the socket
+    bool                   b_failed;     // file write failed, discarding rest
+    bool                   b_committed;  // upload published under file_name
+    rplib_pool_t          *p_pool;       // allocator transfer came from
+    char part_name[RPCHAT_FILE_PATH_MAX];     // upload in progress
+    char file_name[RPCHAT_FILE_NAME_MAX + 1]; // name as published
+} rpchat_file_xfer_t;
+
+/**
+ * Check that a filename sent by a client names a plain file directly in the
+ * file directory: printable, no whitespace, no `/`, and not starting with `.`
+ * (which also keeps `.` and `..` and upload part names out of reach)
+ * @param p_name Pointer to filename as received
+ * @return true if the name can be used
+ */
+bool rpchat_file_xfer_check_name(const rpchat_string_t *p_name);
+
+/**
+ * Start an upload into a part file of the file directory, published under its
+ * final name once complete
+ * @param p_pool Allocator to take transfer from
+ * @param p_cache Cache whose copy of the file is dropped on publishing; NULL
+ * if there is none
+ * @param h_fd_dir File directory descriptor; negative if there is none
+ * @param h_fd_sock Socket contents arrive on; names the part file
+ * @param p_name Pointer to filename as received
+ * @param file_len Bytes of contents to come
+ * @return Pointer to transfer; NULL on allocation failure. A transfer whose
+ * name fails `rpchat_file_xfer_check_name`, or whose file could not be
+ * created, is returned already failed, discarding contents
+ */
+rpchat_file_xfer_t *rpchat_file_xfer_begin_upload(
+    rplib_pool_t          *p_pool,
+    rpchat_file_cache_t   *p_cache,
+    int                    h_fd_dir,
+    int                    h_fd_sock,
+    const rpchat_string_t *p_name,
+    uint32_t               file_len);
+
+/**
+ * Start a download of a regular file of the file directory, served from the
+ * cache when it holds the file (and added to it when it does not). `header`
+ * holds the RECVFILE header to send ahead of the contents
+ * @param p_pool Allocator to take transfer from
+ * @param p_cache Cache to serve from; NULL to always read the file
+ * @param h_fd_dir File directory descriptor; negative if there is none
+ * @param p_name Pointer to filename as received
+ * @return Pointer to transfer; NULL if the name fails
+ * `rpchat_file_xfer_check_name` or the file cannot be served
+ */
+rpchat_file_xfer_t *rpchat_file_xfer_begin_download(
+    rplib_pool_t          *p_pool,
+    rpchat_file_cache_t   *p_cache,
+    int                    h_fd_dir,
+    const rpchat_string_t *p_name);
+
+/**
+ * Move the next part of an upload. Contents already buffered with the header
+ * are written from the inbound buffer first; the rest is spliced from the
+ * socket
+ * @param p_xfer Pointer to upload
+ * @param h_fd_sock Socket contents arrive on
+ * @param p_inbound Pointer to connection's inbound buffer
+ * @return `rpchat_file_xfer_res_t` describing how the step ended
+ */
+rpchat_file_xfer_res_t rpchat_file_xfer_recv(rpchat_file_xfer_t *p_xfer,
+                                             int                 h_fd_sock,
+                                             rplib_ring_buf_t   *p_inbound);
+
+/**
+ * Move the next part of a download, from the cached mapping if there is one,
+ * otherwise with `sendfile`
+ * @param p_xfer Pointer to download
+ * @param h_fd_sock Socket to send contents to
+ * @return `rpchat_file_xfer_res_t` describing how the step ended
+ */
+rpchat_file_xfer_res_t rpchat_file_xfer_send(rpchat_file_xfer_t *p_xfer,
+                                             int                 h_fd_sock);
+
+/**
+ * Publish a completed upload under its final name, replacing any file of the
+ * same name along with its cached copy
+ * @param p_xfer Pointer to upload that returned RPCHAT_FILE_XFER_DONE
+ * @return RPLIB_SUCCESS if published, RPLIB_UNSUCCESS if the upload failed
+ */
+int rpchat_file_xfer_commit(rpchat_file_xfer_t *p_xfer);
+
+/**
+ * End a transfer, closing its descriptors and freeing it. An upload that was
+ * never committed has its part file removed
+ * @param p_xfer Pointer to transfer; NULL is ignored
+ */
+void rpchat_file_xfer_destroy(rpchat_file_xfer_t *p_xfer);
+
+#endif // RPCHAT_RPCHAT_FILE_XFER_H
+
+/*** end of file ***/
@@ -0,0 +1,78 @@
+/** @file rpchat_frame_parser.h
+ *
+ * @brief Incremental parser that extracts complete BCP frames from a
+ * connection's inbound ring buffer
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#ifndef RPCHAT_RPCHAT_FRAME_PARSER_H
+#define RPCHAT_RPCHAT_FRAME_PARSER_H
+
+#include <stdint.h>
+
+#include "rpchat_basic_chat_util.h"
+#include "rpchat_string.h"
+#include "rplib_ring_buf.h"
+
+#define RPCHAT_FRAME_OPCODE_SZ sizeof(uint8_t)  // opcode field
+#define RPCHAT_FRAME_STRLEN_SZ sizeof(uint16_t) // string length field
+#define RPCHAT_FRAME_CODE_SZ   sizeof(uint8_t)  // status code, count, window
+#define RPCHAT_FRAME_FLEN_SZ   sizeof(uint32_t) // file length field
+
+/**
+ * A complete inbound BCP message decoded from the wire. For SENDFILE only the
+ * header is a frame; the file contents that follow it are left in the buffer
+ */
+typedef struct rpchat_frame
+{
+    rpchat_msg_type_t msg_type; // BCP message type
+    uint8_t           code;     // status code, ACK count or REGWIN window
+    uint32_t          file_len; // bytes of contents following (SENDFILE only)
+    uint8_t           room_len; // length of room (JOIN, LEAVE, ROOMSEND only)
+    char              room[RPCHAT_BCP_MAX_ROOM_LENGTH]; // not terminated
+    rpchat_string_t   contents; // username, message or filename
+} rpchat_frame_t;
+
+/**
+ * Parse progress for the frame at the front of a ring buffer, retained between
+ * readiness events so headers are only decoded once per frame
+ */
+typedef struct rpchat_frame_parser
+{
+    size_t sz_frame; // total size of front frame, 0 if header incomplete
+} rpchat_frame_parser_t;
+
+/**
+ * Reset a parser to expect the start of a new frame
+ * @param p_parser Pointer to parser
+ */
+void rpchat_frame_parser_reset(rpchat_frame_parser_t *p_parser);
+
+/**
+ * Determine whether the frame at the front of the ring buffer is complete
+ * without consuming it
+ * @param p_parser Pointer to parser
+ * @param p_ring Pointer to ring buffer holding inbound bytes
+ * @return RPLIB_SUCCESS if a complete frame is buffered, RPLIB_UNSUCCESS if
+ * more bytes are needed, RPLIB_ERROR if the buffered bytes are not valid BCP
+ */
+int rpchat_frame_parser_check(rpchat_frame_parser_t *p_parser,
+                              rplib_ring_buf_t      *p_ring);
+
+/**
+ * Extract the next complete frame from the ring buffer, consuming its bytes
+ * @param p_parser Pointer to parser
+ * @param p_ring Pointer to ring buffer holding inbound bytes
+ * @param p_frame Pointer to frame object to store result in
+ * @return RPLIB_SUCCESS if a frame was extracted, RPLIB_UNSUCCESS if more bytes
+ * are needed, RPLIB_ERROR if the buffered bytes are not valid BCP
+ */
+int rpchat_frame_parser_next(rpchat_frame_parser_t *p_parser,
+                             rplib_ring_buf_t      *p_ring,
+                             rpchat_frame_t        *p_frame);
+
+#endif // RPCHAT_RPCHAT_FRAME_PARSER_H
+
+/*** end of file ***/
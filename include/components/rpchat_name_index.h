@@ -0,0 +1,90 @@
+/** @file rpchat_name_index.h
+ *
+ * @brief Open-addressing hash index from username to connection. Not
+ * synchronized; callers serialize access
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#ifndef RPCHAT_RPCHAT_NAME_INDEX_H
+#define RPCHAT_RPCHAT_NAME_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rpchat_string.h"
+#include "rplib_common.h"
+
+#define RPCHAT_NAME_INDEX_MIN_CAPACITY 64 // slots allocated up front
+
+struct rpchat_connection_info;
+
+/**
+ * A single slot of the index; empty while p_conn_info is NULL
+ */
+typedef struct rpchat_name_slot
+{
+    uint32_t                       hash;        // hash of username
+    struct rpchat_connection_info *p_conn_info; // connection owning username
+} rpchat_name_slot_t;
+
+typedef struct rpchat_name_index
+{
+    rpchat_name_slot_t *p_slots;   // linearly probed slots
+    size_t              capacity;  // # slots, power of two
+    size_t              num_names; // # occupied slots
+} rpchat_name_index_t;
+
+/**
+ * Hash a username
+ * @param p_name Pointer to username contents
+ * @param len Length of username
+ * @return 32-bit FNV-1a hash of username contents
+ */
+uint32_t rpchat_name_index_hash(const char *p_name, size_t len);
+
+/**
+ * Initialize an empty name index
+ * @param p_index Pointer to index
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on allocation failure
+ */
+int rpchat_name_index_initialize(rpchat_name_index_t *p_index);
+
+/**
+ * Release slots held by a name index. Indexed connections are not touched
+ * @param p_index Pointer to index
+ */
+void rpchat_name_index_destroy(rpchat_name_index_t *p_index);
+
+/**
+ * Find the connection registered under a username
+ * @param p_index Pointer to index
+ * @param p_username Pointer to username to look up
+ * @return Pointer to connection if found; otherwise NULL
+ */
+struct rpchat_connection_info *rpchat_name_index_find(
+    rpchat_name_index_t *p_index, rpchat_string_t *p_username);
+
+/**
+ * Index a connection under its current username
+ * @param p_index Pointer to index
+ * @param p_conn_info Pointer to connection, username already set
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS if username is taken,
+ * RPLIB_ERROR on allocation failure
+ */
+int rpchat_name_index_insert(rpchat_name_index_t           *p_index,
+                             struct rpchat_connection_info *p_conn_info);
+
+/**
+ * Remove a connection from the index, if it is indexed under its username
+ * @param p_index Pointer to index
+ * @param p_conn_info Pointer to connection
+ * @return RPLIB_SUCCESS if removed, RPLIB_UNSUCCESS if not indexed
+ */
+int rpchat_name_index_remove(rpchat_name_index_t           *p_index,
+                             struct rpchat_connection_info *p_conn_info);
+
+#endif // RPCHAT_RPCHAT_NAME_INDEX_H
+
+/*** end of file ***/
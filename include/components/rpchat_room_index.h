@@ -0,0 +1,141 @@
+/** @file rpchat_room_index.h
+ *
+ * @brief Rooms clients subscribe to, indexed by name. Each room keeps its
+ * members in one compact array, so a room broadcast only walks the clients
+ * that joined it. Not synchronized; callers serialize access
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#ifndef RPCHAT_RPCHAT_ROOM_INDEX_H
+#define RPCHAT_RPCHAT_ROOM_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rpchat_basic_chat_util.h"
+#include "rplib_common.h"
+
+#define RPCHAT_ROOM_INDEX_MIN_CAPACITY 16 // slots allocated up front
+#define RPCHAT_ROOM_MIN_MEMBERS        8  // member slots of a new room
+#define RPCHAT_ROOM_MAX_JOINED         8  // rooms a connection may be in
+#define RPCHAT_ROOM_STACK_MEMBERS      64 // members copied without allocating
+
+struct rpchat_connection_info;
+struct rpchat_conn_queue;
+struct rpchat_room;
+
+/**
+ * A room a connection joined, kept by the connection so it can leave without
+ * searching the member array
+ */
+typedef struct rpchat_room_sub
+{
+    struct rpchat_room *p_room;       // room joined
+    size_t              member_index; // position in its member array
+} rpchat_room_sub_t;
+
+/**
+ * A subscriber of a room
+ */
+typedef struct rpchat_room_member
+{
+    struct rpchat_connection_info *p_conn_info;  // subscribed connection
+    struct rpchat_conn_queue      *p_conn_queue; // queue of its reactor
+} rpchat_room_member_t;
+
+/**
+ * A room; exists while it has members
+ */
+typedef struct rpchat_room
+{
+    uint32_t              hash;        // hash of name
+    uint8_t               name_len;    // length of name, excluding terminator
+    char                  name[RPCHAT_BCP_MAX_ROOM_LENGTH + 1]; // terminated
+    rpchat_room_member_t *p_members;   // first num_members entries in use
+    size_t                num_members; // # subscribers
+    size_t                capacity;    // # entries allocated in p_members
+} rpchat_room_t;
+
+typedef struct rpchat_room_index
+{
+    rpchat_room_t **pp_slots;  // linearly probed slots, NULL if empty
+    size_t          capacity;  // # slots, power of two
+    size_t          num_rooms; // # occupied slots
+} rpchat_room_index_t;
+
+/**
+ * Check a room name: 1 to RPCHAT_BCP_MAX_ROOM_LENGTH printable characters,
+ * spaces excluded
+ * @param p_name Pointer to name contents
+ * @param len Length of name
+ * @return RPLIB_SUCCESS if valid, RPLIB_UNSUCCESS otherwise
+ */
+int rpchat_room_index_check_name(const char *p_name, size_t len);
+
+/**
+ * Initialize an empty room index
+ * @param p_index Pointer to index
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on allocation failure
+ */
+int rpchat_room_index_initialize(rpchat_room_index_t *p_index);
+
+/**
+ * Free every room of an index and the slots holding them. Member connections
+ * are not touched
+ * @param p_index Pointer to index
+ */
+void rpchat_room_index_destroy(rpchat_room_index_t *p_index);
+
+/**
+ * Find a room a connection is a member of
+ * @param p_conn_info Pointer to connection
+ * @param p_name Pointer to room name contents
+ * @param len Length of room name
+ * @return Pointer to room if joined; otherwise NULL
+ */
+rpchat_room_t *rpchat_room_index_joined(
+    struct rpchat_connection_info *p_conn_info, const char *p_name, size_t len);
+
+/**
+ * Add a connection to a room, creating the room if nobody is in it yet.
+ * Joining a room already joined changes nothing
+ * @param p_index Pointer to index
+ * @param p_conn_info Pointer to connection
+ * @param p_conn_queue Pointer to queue of the connection's reactor
+ * @param p_name Pointer to valid room name contents
+ * @param len Length of room name
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS if the connection is
+ * already in RPCHAT_ROOM_MAX_JOINED rooms, RPLIB_ERROR on allocation failure
+ */
+int rpchat_room_index_join(rpchat_room_index_t           *p_index,
+                           struct rpchat_connection_info *p_conn_info,
+                           struct rpchat_conn_queue      *p_conn_queue,
+                           const char                    *p_name,
+                           size_t                         len);
+
+/**
+ * Remove a connection from a room, freeing the room once it is empty
+ * @param p_index Pointer to index
+ * @param p_conn_info Pointer to connection
+ * @param p_name Pointer to room name contents
+ * @param len Length of room name
+ * @return RPLIB_SUCCESS if left, RPLIB_UNSUCCESS if not a member
+ */
+int rpchat_room_index_leave(rpchat_room_index_t           *p_index,
+                            struct rpchat_connection_info *p_conn_info,
+                            const char                    *p_name,
+                            size_t                         len);
+
+/**
+ * Remove a connection from every room it joined
+ * @param p_index Pointer to index
+ * @param p_conn_info Pointer to connection
+ */
+void rpchat_room_index_leave_all(rpchat_room_index_t           *p_index,
+                                 struct rpchat_connection_info *p_conn_info);
+
+#endif // RPCHAT_RPCHAT_ROOM_INDEX_H
+
+/*** end of file ***/
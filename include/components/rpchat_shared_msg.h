@@ -0,0 +1,56 @@
+/** @file rpchat_shared_msg.h
+ *
+ * @brief Immutable, reference-counted encoded BCP message that can sit in many
+ * connections' outbound queues at once
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#ifndef RPCHAT_RPCHAT_SHARED_MSG_H
+#define RPCHAT_RPCHAT_SHARED_MSG_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "rplib_common.h"
+#include "rplib_pool.h"
+
+typedef struct rpchat_shared_msg
+{
+    atomic_int    refcount;      // # of holders (queues, tasks, creator)
+    rplib_pool_t *p_pool;        // allocator to return to, NULL for heap
+    size_t        sz_msg;        // size of encoded message
+    uint64_t      origin_ns;     // metrics stamp of the SEND, or 0
+    atomic_int    fan_outs_left; // queues yet to enqueue it, while timed
+    char          contents[];    // encoded message
+} rpchat_shared_msg_t;
+
+/**
+ * Create a shared message with room for sz_msg bytes. The caller holds the only
+ * reference and fills contents before handing it to anyone else
+ * @param p_pool Pointer to pool to allocate from; NULL to use the heap
+ * @param sz_msg Size of encoded message
+ * @return Pointer to shared message; NULL on failure
+ */
+rpchat_shared_msg_t *rpchat_shared_msg_create(rplib_pool_t *p_pool,
+                                              size_t        sz_msg);
+
+/**
+ * Take an additional reference to a shared message
+ * @param p_shared_msg Pointer to shared message
+ * @return Pointer to shared message
+ */
+rpchat_shared_msg_t *rpchat_shared_msg_retain(
+    rpchat_shared_msg_t *p_shared_msg);
+
+/**
+ * Drop a reference to a shared message, freeing it once no holders remain
+ * @param p_shared_msg Pointer to shared message
+ */
+void rpchat_shared_msg_release(rpchat_shared_msg_t *p_shared_msg);
+
+#endif // RPCHAT_RPCHAT_SHARED_MSG_H
+
+/*** end of file ***/
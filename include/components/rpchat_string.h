@@ -26,13 +26,18 @@
 typedef struct rpchat_basic_chat_string
 {
     u_int16_t len;
+    bool      b_sanitized; // output of `rpchat_string_sanitize`, unchanged
     char      contents[RPCHAT_MAX_STR_LENGTH];
 } rpchat_string_t;
 
 /**
- * Sanitize a string to only printable characters
+ * Sanitize a string to only printable characters, terminated. Clean runs are
+ * copied whole; only strings containing disallowed characters are compacted.
+ * The output is marked sanitized, so later stages can use it as is (it passes
+ * the filter allowing control characters either way)
  * @param p_input_string Pointer to input string
- * @param p_output_string Pointer to string to store output
+ * @param p_output_string Pointer to string to store output, distinct from
+ * input
  * @param b_allow_ctrl If true, allow control characters like \n,\t,\w;
  * otherwise, only match printable ascii (excl. space)
  * @return RPLIB_SUCCESS if no issues; otherwise, RPLIB_UNSUCCESS
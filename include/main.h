@@ -17,6 +17,7 @@
  */
 
 #define RPCHAT_MAX_USABLE_DESCRIPTOR_OFFSET 3 // signalfd, epollfd, serverfd
+#define RPCHAT_MAX_PORT_NUM                 65535 // upper bound for -s
 
 #endif /* RPCHAT_MAIN_H */
 
@@ -10,6 +10,7 @@
 #define RPCHAT_BASIC_CHAT_H
 
 #include <malloc.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <string.h>
 #include <sys/epoll.h>
@@ -17,6 +18,8 @@
 #include "components/rpchat_conn_info.h"
 #include "components/rpchat_conn_queue.h"
 #include "components/rpchat_string.h"
+#include "rpchat_cluster.h"
+#include "rpchat_handoff.h"
 #include "rpchat_networking.h"
 #include "rpchat_process_event.h"
 #include "rplib_common.h"
@@ -24,38 +27,108 @@
 #include "rplib_tpool.h"
 
 #define RPCHAT_DEFAULT_LOG  'stdout'
-#define RPCHAT_NUM_THREADS  4
+#define RPCHAT_NUM_THREADS  4    // workers kept while idle, by default
+#define RPCHAT_MAX_WORKERS  1024 // upper bound for -g and -x
+#define RPCHAT_MAX_REACTORS RPCHAT_CONN_QUEUE_MAX_PEERS // upper bound for -r
+#define RPCHAT_DEFAULT_EVENT_BATCH 256   // events taken per wait by default
+#define RPCHAT_MAX_EVENT_BATCH     65536 // upper bound for -b
+#define RPCHAT_DEFAULT_BACKLOG_FRAMES 4096    // messages queued per client
+#define RPCHAT_DEFAULT_BACKLOG_KIB    4096    // KiB queued per client
+#define RPCHAT_DEFAULT_WATERMARK_MIB  256     // MiB queued before SENDs refused
+#define RPCHAT_MAX_BACKLOG            1048576 // upper bound for -q, -k and -m
+#define RPCHAT_DEFAULT_FLUSH_KIB 64      // KiB of deliveries written at once
+#define RPCHAT_MAX_FLUSH_KIB     4096    // upper bound for -w
+#define RPCHAT_MAX_FLUSH_US      1000000 // upper bound for -e
+
+/**
+ * Options for a BCP server session
+ */
+typedef struct
+{
+    unsigned int port_num;        // Port to listen on
+    unsigned int max_connections; // Maximum number of simultaneous connections
+    bool         b_affinity;      // Pin each connection to a single worker
+    unsigned int num_reactors;    // # event loops, each with its own listener
+    unsigned int conn_timeout;    // seconds idle before a client is dropped
+    unsigned int audit_interval;  // seconds between inactivity checks
+    unsigned int event_batch;     // events taken from epoll per wait
+    int          h_fd_file_dir;   // directory files are exchanged in, or -1
+    unsigned int backlog_frames;  // messages queued per client at most
+    unsigned int backlog_kib;     // KiB of those per client at most
+    unsigned int watermark_mib;   // MiB queued in total before SENDs refused
+    bool         b_drop_oldest;   // over budget: drop oldest, else disconnect
+    unsigned int flush_kib;       // KiB of deliveries per client write at most
+    unsigned int flush_us;        // us deliveries may wait to be written along
+    unsigned int min_workers;     // worker threads kept while idle
+    unsigned int max_workers;     // worker threads run at most
+    bool         b_pin_workers;   // pin each worker to a CPU
+    const rpchat_cluster_config_t *p_cluster_config; // NULL when standalone
+    const char       *p_handoff_path; // successors connect here, or NULL
+    rpchat_handoff_t *p_handoff;      // taken over from predecessor, or NULL
+} rpchat_server_config_t;
+
+/**
+ * An event loop owning a listening socket, an epoll instance and the
+ * connections accepted through them
+ */
+typedef struct
+{
+    int                  h_fd_server;     // listening socket
+    int                  h_fd_epoll;      // epoll instance
+    int                  h_fd_signal;     // signalfd, -1 unless first reactor
+    int                  h_fd_timer;   // timerfd driving inactivity checks
+    int                  h_fd_handoff; // successors connect, -1 unless first
+    int                  h_fd_successor; // successor accepted, or -1
+    unsigned int         event_batch;  // events returned per wait
+    struct epoll_event  *p_event_buf;  // event_batch events, kept across waits
+    rplib_tpool_task_t  *p_task_buf;   // event_batch tasks for one batch
+    rplib_tpool_t       *p_tpool;      // threadpool shared by all reactors
+    rpchat_conn_queue_t *p_conn_queue; // connections of this reactor
+    pthread_t            thread;       // thread running loop (not first)
+    int                  res;          // result of `rpchat_run_reactor`
+} rpchat_reactor_t;
 
 /**
  * Task-related definitions
  */
 
 /**
- * Begin BCP server on port number with up to max_connections
+ * Begin BCP server with the passed options. The first reactor runs on the
+ * calling thread and owns signal handling; any others get their own threads
+ * @param p_config Pointer to server options
  * @return RPLIB_ERROR on error, RPLIB_UNSUCCESS on problems, RPLIB_SUCCESS on
  * success
  */
-int rpchat_begin_chat_server(unsigned int port_num,
-                             unsigned int max_connections);
+int rpchat_begin_chat_server(rpchat_server_config_t *p_config);
+
+/**
+ * Wait for and handle events on a reactor until it is told to stop (SIGINT
+ * for the first reactor, `rpchat_conn_queue_stop` for the others)
+ * @param p_reactor Pointer to reactor
+ * @return RPLIB_SUCCESS on planned stop, RPLIB_UNSUCCESS otherwise
+ */
+int rpchat_run_reactor(rpchat_reactor_t *p_reactor);
 
 /**
- * Given activity reported by epoll on a buffer of events, take appropriate
- * action.
+ * Given activity reported by epoll in the event buffer of a reactor, take
+ * appropriate action. Events on client connections are handed to the
+ * threadpool together, as a single batch
+ * @param p_reactor Pointer to reactor
+ * @param num_events Number of events epoll placed in `p_event_buf`
  * @return RPLIB_SUCCESS on no problems, RPLIB_UNSUCCESS on scheduled stop,
  * RPLIB error otherwise
  */
-int rpchat_handle_events(struct epoll_event  *p_ret_event_buf,
-                         int                  h_fd_server,
-                         int                  h_fd_epoll,
-                         int                  h_fd_signal,
-                         rplib_tpool_t       *p_tpool,
-                         size_t               sz_ret_event_buf,
-                         rpchat_conn_queue_t *p_conn_queue);
+int rpchat_handle_events(rpchat_reactor_t *p_reactor, size_t num_events);
 
 /**
- * Handle a new incoming connection
- * @param h_fd_server
- * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS otherwise
+ * Handle incoming connections: accept up to RPCHAT_ACCEPT_BATCH of them,
+ * register the batch with the connection queue at once, then start watching
+ * each
+ * @param h_fd_server Non-blocking listening socket that became readable
+ * @param h_fd_epoll Epoll instance file descriptor
+ * @param p_conn_queue Pointer to connection queue of reactor
+ * @return RPLIB_SUCCESS once the backlog is drained or the batch is full,
+ * RPLIB_ERROR if accepting failed otherwise
  */
 int rpchat_handle_new_connection(unsigned int         h_fd_server,
                                  unsigned int         h_fd_epoll,
@@ -70,6 +143,18 @@ int rpchat_handle_existing_connection(unsigned int         h_fd_server,
                                       rpchat_conn_queue_t *p_conn_queue,
                                       struct epoll_event  *p_new_event);
 
+/**
+ * Helper function to handle the inactivity timer of a reactor firing. Sends a
+ * HEARTBEAT to every connection whose inactivity deadline has passed
+ * @param h_fd_timer Timer file descriptor that became readable
+ * @param p_tpool Pointer to threadpool handling tasks
+ * @param p_conn_queue Pointer to connection queue of reactor
+ * @return RPLIB_SUCCESS if handled, RPLIB_ERROR on erroneous behavior
+ */
+int rpchat_handle_timer(int                  h_fd_timer,
+                        rplib_tpool_t       *p_tpool,
+                        rpchat_conn_queue_t *p_conn_queue);
+
 /**
  * Helper function to handle signal raised and caught by epoll
  * @param h_fd_signal Signal FD signal was raised
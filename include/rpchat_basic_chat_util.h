@@ -11,14 +11,27 @@
 
 #include "components/rpchat_string.h"
 #include "stdint.h"
+#include <stdatomic.h>
 #include <sys/epoll.h>
 
+#define RPCHAT_BCP_MAX_ROOM_LENGTH 32 // longest room name, bytes
+
 typedef enum rpchat_message_type
 {
-    RPCHAT_BCP_REGISTER = 1,
-    RPCHAT_BCP_SEND     = 2,
-    RPCHAT_BCP_DELIVER  = 3,
-    RPCHAT_BCP_STATUS   = 4,
+    RPCHAT_BCP_REGISTER    = 1,
+    RPCHAT_BCP_SEND        = 2,
+    RPCHAT_BCP_DELIVER     = 3,
+    RPCHAT_BCP_STATUS      = 4,
+    RPCHAT_BCP_SENDFILE    = 5,
+    RPCHAT_BCP_FNOTIFY     = 6,
+    RPCHAT_BCP_GETFILE     = 7,
+    RPCHAT_BCP_RECVFILE    = 8,
+    RPCHAT_BCP_REGWIN      = 9,  // REGISTER asking for windowed delivery
+    RPCHAT_BCP_ACK         = 10, // acknowledges several DELIVERs at once
+    RPCHAT_BCP_JOIN        = 11, // subscribes to a room
+    RPCHAT_BCP_LEAVE       = 12, // unsubscribes from a room
+    RPCHAT_BCP_ROOMSEND    = 13, // SEND to the members of a room
+    RPCHAT_BCP_ROOMDELIVER = 14, // DELIVER of a ROOMSEND, names the room
 } rpchat_msg_type_t;
 
 typedef enum rpchat_bcp_status_code
@@ -50,6 +63,12 @@ typedef struct __attribute__((__packed__)) rpchat_packet_deliver
     rpchat_string_t message; // Message from client
 } rpchat_pkt_deliver_t;
 
+typedef struct __attribute__((__packed__)) rpchat_packet_recvfile
+{
+    uint8_t  opcode;   // BCP message type
+    uint32_t file_len; // length of contents that follow (big endian)
+} rpchat_pkt_recvfile_t;
+
 typedef struct __attribute__((__packed__)) rpchat_packet_status
 {
     uint8_t         opcode;  // BCP message type
@@ -65,19 +84,22 @@ typedef struct __attribute__((__packed__)) rpchat_packet_status
 rpchat_msg_type_t rpchat_get_msg_type(char *p_msg_buf);
 
 /**
- * Turn an epoll descriptor on or off, making the epoll instance either ignore
- * or pay attention to inbound data
- * @param h_fd_epoll Epoll instance file descriptor
- * @param h_toggle_fd File descriptor to toggle
+ * Set the events an epoll instance reports for a descriptor, adding the
+ * descriptor to the instance if it is not already being watched. On the
+ * io_uring backend a poll is submitted, or the outstanding one updated
+ * @param h_fd_epoll Epoll instance (or io_uring ring) file descriptor
+ * @param h_arm_fd File descriptor to arm
  * @param p_data_ptr Pointer to data connected to epoll event
- * @param enabled If true, listen to events on this connection. If false, stop
- * listening.
+ * @param events Epoll events to report for this descriptor
+ * @param p_b_pending Pointer to flag telling whether an io_uring poll is
+ * outstanding for the descriptor; unused by epoll
  * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS on problems
  */
-int rpchat_toggle_descriptor(int   h_fd_epoll,
-                             int   h_toggle_fd,
-                             void *p_data_ptr,
-                             bool  enabled);
+int rpchat_arm_descriptor(int          h_fd_epoll,
+                          int          h_arm_fd,
+                          void        *p_data_ptr,
+                          uint32_t     events,
+                          atomic_bool *p_b_pending);
 
 #endif // RPCHAT_RPCHAT_BASIC_CHAT_UTIL_H
 
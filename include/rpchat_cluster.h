@@ -0,0 +1,184 @@
+/** @file rpchat_cluster.h
+ *
+ * @brief Federation of several servers into one chat. Every node links to
+ * every other over TCP; a link carries the broadcasts of its node, each
+ * encoded once and fanned out by the receiving node to its own clients, and
+ * the changes to a username registry every node holds a full copy of. A name
+ * is only granted once every linked node agrees, so it stays unique across
+ * the cluster. When a node's link fails, its users are announced as having
+ * left; when it links again, it tells which names it holds
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#ifndef RPCHAT_RPCHAT_CLUSTER_H
+#define RPCHAT_RPCHAT_CLUSTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "components/rpchat_conn_info.h"
+#include "components/rpchat_conn_queue.h"
+#include "components/rpchat_shared_msg.h"
+#include "components/rpchat_string.h"
+#include "rplib_common.h"
+#include "rplib_tpool.h"
+
+#define RPCHAT_CLUSTER_MAX_NODES   64    // node ids 0 to 63
+#define RPCHAT_CLUSTER_VERSION     1     // link protocol spoken
+#define RPCHAT_CLUSTER_TICK_SEC    1     // between pings and dials
+#define RPCHAT_CLUSTER_DEAD_SEC    5     // silence before a link is dropped
+#define RPCHAT_CLUSTER_HEADER_SZ   5     // type, then payload length
+#define RPCHAT_CLUSTER_MAX_PAYLOAD 8195  // largest DELIVER, largest name fits
+#define RPCHAT_CLUSTER_IN_BUF_SZ   65536 // received per link, not yet handled
+#define RPCHAT_CLUSTER_MAX_QUEUED  (64 * 1024 * 1024) // unsent before dropped
+#define RPCHAT_CLUSTER_EVENT_BATCH 64    // events taken per wait
+#define RPCHAT_CLUSTER_MAIL_BATCH  64    // DELIVERs posted to mailboxes at once
+#define RPCHAT_CLUSTER_MIN_BUCKETS 64    // registry buckets allocated up front
+
+/**
+ * Frames exchanged over a link, each `type (u8) | length (u32) | payload`.
+ * Registry frames carry a username as their payload
+ */
+typedef enum rpchat_cluster_frame_type
+{
+    RPCHAT_CLUSTER_HELLO = 1, // version and node id; first frame both ways
+    RPCHAT_CLUSTER_PING,      // nothing, keeps a quiet link alive
+    RPCHAT_CLUSTER_CLAIM,     // sender asks for a name
+    RPCHAT_CLUSTER_GRANT,     // receiver agrees to sender's claim
+    RPCHAT_CLUSTER_DENY,      // receiver refuses sender's claim
+    RPCHAT_CLUSTER_JOIN,      // sender holds a name, sent once a link is up
+    RPCHAT_CLUSTER_LEAVE,     // sender gave up a name
+    RPCHAT_CLUSTER_DELIVER,   // encoded DELIVER for every client of receiver
+} rpchat_cluster_frame_type_t;
+
+/**
+ * Another node of the cluster
+ */
+typedef struct
+{
+    unsigned int            node_id; // id the node introduces itself with
+    struct sockaddr_storage addr;    // where its links are accepted
+    socklen_t               sz_addr; // bytes of addr in use
+} rpchat_cluster_peer_t;
+
+/**
+ * Options of a node. Of each pair of nodes, the one with the higher id dials
+ * the other, so every node lists every other
+ */
+typedef struct
+{
+    unsigned int          node_id;   // id of this node, unique in cluster
+    unsigned int          port_num;  // port links are accepted on
+    size_t                num_peers; // # entries in peers
+    rpchat_cluster_peer_t peers[RPCHAT_CLUSTER_MAX_NODES]; // other nodes
+} rpchat_cluster_config_t;
+
+typedef struct rpchat_cluster rpchat_cluster_t;
+
+/**
+ * Parse a peer given as `id@host:port`
+ * @param p_arg Pointer to null-terminated argument
+ * @param p_peer Pointer to peer to fill
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS if malformed or the host
+ * does not resolve
+ */
+int rpchat_cluster_parse_peer(const char *p_arg, rpchat_cluster_peer_t *p_peer);
+
+/**
+ * Create a node: open the socket links are accepted on, and everything the
+ * cluster thread waits on. Nothing is dialed until started
+ * @param p_config Pointer to options, copied
+ * @param pp_queues Pointer to array of connection queues, one per reactor;
+ * received broadcasts are posted to each
+ * @param num_queues Number of entries in pp_queues
+ * @param p_tpool Pointer to threadpool running connection tasks
+ * @return Pointer to node on success, NULL on failure
+ */
+rpchat_cluster_t *rpchat_cluster_create(const rpchat_cluster_config_t *p_config,
+                                        rpchat_conn_queue_t **pp_queues,
+                                        size_t                num_queues,
+                                        rplib_tpool_t        *p_tpool);
+
+/**
+ * Start the cluster thread, which accepts and dials links and handles what
+ * arrives on them
+ * @param p_cluster Pointer to node
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR if the thread could not start
+ */
+int rpchat_cluster_start(rpchat_cluster_t *p_cluster);
+
+/**
+ * Stop the cluster thread. Workers may keep calling into the node until it is
+ * destroyed; nothing they queue is sent anymore
+ * @param p_cluster Pointer to node
+ */
+void rpchat_cluster_stop(rpchat_cluster_t *p_cluster);
+
+/**
+ * Close every link and free a stopped node
+ * @param p_cluster Pointer to node
+ */
+void rpchat_cluster_destroy(rpchat_cluster_t *p_cluster);
+
+/**
+ * Claim a username for a connection across the cluster. The name is taken
+ * locally at once, as `rpchat_conn_queue_claim_username` would; while other
+ * nodes are linked it is only kept once each of them has agreed, which is
+ * reported later through `rpchat_resolve_claim`
+ * @param p_cluster Pointer to node
+ * @param p_conn_queue Pointer to queue of the connection
+ * @param p_conn_info Pointer to connection claiming the name
+ * @param p_username Pointer to sanitized username
+ * @param p_b_pending Pointer to flag set when other nodes have to agree first
+ * @return RPLIB_SUCCESS if claimed (or pending), RPLIB_UNSUCCESS if held or
+ * claimed anywhere in the cluster, RPLIB_ERROR on allocation failure
+ */
+int rpchat_cluster_claim_username(rpchat_cluster_t    *p_cluster,
+                                  rpchat_conn_queue_t *p_conn_queue,
+                                  rpchat_conn_info_t  *p_conn_info,
+                                  rpchat_string_t     *p_username,
+                                  bool                *p_b_pending);
+
+/**
+ * Give up the username of a connection about to be destroyed, telling every
+ * linked node. Once this returns, no claim result reaches the connection
+ * \nNote: Safe to call more than once, and for connections without a name
+ * @param p_cluster Pointer to node
+ * @param p_conn_info Pointer to connection
+ */
+void rpchat_cluster_release_username(rpchat_cluster_t   *p_cluster,
+                                     rpchat_conn_info_t *p_conn_info);
+
+/**
+ * Queue a broadcast of a local client to every linked node
+ * @param p_cluster Pointer to node
+ * @param p_shared_msg Pointer to encoded DELIVER; copied
+ */
+void rpchat_cluster_forward(rpchat_cluster_t    *p_cluster,
+                            rpchat_shared_msg_t *p_shared_msg);
+
+/**
+ * Count the users of every other node
+ * @param p_cluster Pointer to node
+ * @return Number of names held by other nodes
+ */
+size_t rpchat_cluster_count_users(rpchat_cluster_t *p_cluster);
+
+/**
+ * Append the users of every other node to a list of names, comma separated
+ * as `rpchat_conn_queue_list_users` writes them
+ * @param p_cluster Pointer to node
+ * @param p_output_buf Pointer to string to append to
+ * @param b_first Whether no name was written to p_output_buf yet
+ */
+void rpchat_cluster_list_users(rpchat_cluster_t *p_cluster,
+                               rpchat_string_t  *p_output_buf,
+                               bool              b_first);
+
+#endif // RPCHAT_RPCHAT_CLUSTER_H
+
+/*** end of file ***/
@@ -28,4 +28,21 @@ rpchat_open_log_location(char *p_log_location);
 int
 rpchat_close_log_location(int h_fd_log_loc);
 
+/**
+ * Open the directory uploaded files are stored in and served from. Files are
+ * only ever opened relative to the returned descriptor
+ * @param p_file_dir Pointer to null-terminated char buf containing directory
+ * @return File Descriptor for directory, RPLIB_ERROR on failure
+ */
+int
+rpchat_open_file_dir(char *p_file_dir);
+
+/**
+ * Close file directory descriptor
+ * @param h_fd_file_dir File directory descriptor; ignored if negative
+ * @return RPLIB_SUCCESS on no issues, otherwise RPLIB_ERROR
+ */
+int
+rpchat_close_file_dir(int h_fd_file_dir);
+
 #endif // RPCHAT_RPCHAT_FILE_IO_H
@@ -0,0 +1,157 @@
+/** @file rpchat_handoff.h
+ *
+ * @brief Restart without dropping clients. A server started with a handoff
+ * path listens there for its successor; once one connects, the server stops
+ * like on SIGINT, lets every task run out, and passes its listening sockets
+ * and the sockets of its clients over the Unix socket (SCM_RIGHTS), each
+ * client followed by what the successor needs to carry on with it: username,
+ * rooms, state, delivery window, unparsed and unsent bytes, and messages
+ * waiting for the window. The successor resumes every client where it was,
+ * without a REGISTER or a join broadcast.
+ *
+ * Only clients between messages move: registering (or waiting for other
+ * nodes to agree to a name), transferring a file, or closing are closed with
+ * the old process. Cluster links are not passed; other nodes see the node
+ * link again and learn its names from it
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#ifndef RPCHAT_RPCHAT_HANDOFF_H
+#define RPCHAT_RPCHAT_HANDOFF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "components/rpchat_conn_queue.h"
+#include "rpchat_cluster.h"
+#include "rplib_common.h"
+#include "rplib_tpool.h"
+
+#define RPCHAT_HANDOFF_VERSION       1     // layout of the records passed
+#define RPCHAT_HANDOFF_MAX_LISTENERS 64    // one per reactor, at most
+#define RPCHAT_HANDOFF_MAX_PACKET    65536 // largest record sent at once
+#define RPCHAT_HANDOFF_TIMEOUT_SEC   30    // wait on a predecessor at most
+
+/**
+ * Records exchanged over the handoff socket, one packet each, `type (u8)`
+ * first. A CONN record carries the client's socket and is followed by the
+ * records holding its bytes, in the order they are restored
+ */
+typedef enum rpchat_handoff_record_type
+{
+    RPCHAT_HANDOFF_HELLO = 1, // version; carries the listening sockets
+    RPCHAT_HANDOFF_CONN,      // state, username and rooms; carries socket
+    RPCHAT_HANDOFF_INBOUND,   // bytes received, not yet parsed
+    RPCHAT_HANDOFF_OUTBOUND,  // bytes queued, not yet written
+    RPCHAT_HANDOFF_DELIVERY,  // DELIVER waiting for the window
+    RPCHAT_HANDOFF_STATUS,    // STATUS waiting for the window
+    RPCHAT_HANDOFF_END,       // every client was passed
+} rpchat_handoff_record_type_t;
+
+typedef struct rpchat_handoff rpchat_handoff_t;
+
+/**
+ * Take over from the server listening for a successor at a path, if any: its
+ * listening sockets and clients are received, then its exit is waited for
+ * (up to RPCHAT_HANDOFF_TIMEOUT_SEC), so every port it held is free once this
+ * returns
+ * @param p_path Pointer to path of the handoff socket
+ * @param pp_handoff Pointer to store what was received in; left NULL when no
+ * server listens at the path
+ * @return RPLIB_SUCCESS on success (also when nobody listens), RPLIB_ERROR if
+ * a server answered but the handoff failed; nothing it passed is kept then
+ */
+int rpchat_handoff_receive(const char *p_path, rpchat_handoff_t **pp_handoff);
+
+/**
+ * Take a listening socket received from the predecessor, for one reactor
+ * @param p_handoff Pointer to what was received, or NULL
+ * @param port_num Port the listener must be bound to
+ * @return Listening socket, now owned by the caller; -1 if none is left
+ */
+int rpchat_handoff_take_listener(rpchat_handoff_t *p_handoff,
+                                 unsigned int      port_num);
+
+/**
+ * Resume every client received from the predecessor, spread over the queues
+ * of every reactor, and close the listening sockets no reactor took. A client
+ * that cannot be restored is disconnected like any other
+ * \nNote: Called once the threadpool runs, before any reactor or the cluster
+ * does
+ * @param p_handoff Pointer to what was received
+ * @param pp_queues Pointer to array of connection queues, one per reactor
+ * @param num_queues Number of entries in pp_queues
+ * @param p_cluster Pointer to node usernames are claimed on, NULL if
+ * standalone
+ * @param p_tpool Pointer to threadpool running connection tasks
+ * @return Number of clients resumed
+ */
+size_t rpchat_handoff_adopt(rpchat_handoff_t     *p_handoff,
+                            rpchat_conn_queue_t **pp_queues,
+                            size_t                num_queues,
+                            rpchat_cluster_t     *p_cluster,
+                            rplib_tpool_t        *p_tpool);
+
+/**
+ * Free what was received, closing every socket not taken or adopted
+ * @param p_handoff Pointer to what was received, or NULL
+ */
+void rpchat_handoff_destroy(rpchat_handoff_t *p_handoff);
+
+/**
+ * Listen for a successor at a path, replacing a socket left there
+ * @param p_path Pointer to path of the handoff socket
+ * @return Listening socket on success, RPLIB_ERROR on failure
+ */
+int rpchat_handoff_listen(const char *p_path);
+
+/**
+ * Accept the successor waiting on a handoff socket
+ * @param h_fd_listen Listening socket from `rpchat_handoff_listen`
+ * @return Blocking socket connected to successor, RPLIB_ERROR on failure
+ */
+int rpchat_handoff_accept(int h_fd_listen);
+
+/**
+ * Stop listening for a successor, removing the socket from its path
+ * @param h_fd_listen Listening socket from `rpchat_handoff_listen`
+ * @param p_path Pointer to path of the handoff socket
+ */
+void rpchat_handoff_close(int h_fd_listen, const char *p_path);
+
+/**
+ * Run every task a stopped server still owes: wait for the threadpool, then
+ * deliver what waits in mailboxes and for flush timers, until nothing is
+ * left. Clients are between tasks from then on
+ * \nNote: Reactors and cluster must be stopped, the threadpool running
+ * @param pp_queues Pointer to array of connection queues, one per reactor
+ * @param num_queues Number of entries in pp_queues
+ * @param p_tpool Pointer to threadpool running connection tasks
+ */
+void rpchat_handoff_quiesce(rpchat_conn_queue_t **pp_queues,
+                            size_t                num_queues,
+                            rplib_tpool_t        *p_tpool);
+
+/**
+ * Pass listening sockets and every client between messages to a successor.
+ * The successor's socket is left open: it takes this process exiting as the
+ * sign every port is free
+ * \nNote: Nothing may run tasks anymore; the threadpool is destroyed
+ * @param h_fd_successor Socket from `rpchat_handoff_accept`
+ * @param p_listeners Pointer to array of listening sockets, one per reactor
+ * @param num_listeners Number of entries in p_listeners
+ * @param pp_queues Pointer to array of connection queues, one per reactor
+ * @param num_queues Number of entries in pp_queues
+ * @return Number of clients passed, RPLIB_ERROR if the successor went away
+ */
+int rpchat_handoff_send(int                   h_fd_successor,
+                        const int            *p_listeners,
+                        size_t                num_listeners,
+                        rpchat_conn_queue_t **pp_queues,
+                        size_t                num_queues);
+
+#endif // RPCHAT_RPCHAT_HANDOFF_H
+
+/*** end of file ***/
@@ -0,0 +1,118 @@
+/** @file rpchat_io_uring.h
+ *
+ * @brief io_uring readiness backend for the reactors. A ring stands in for an
+ * epoll instance: descriptors are watched with poll requests and completions
+ * are handed back as `struct epoll_event`s, so reactors and connection tasks
+ * work the same on either backend. With kernel submission polling, arming a
+ * connection is a write to shared memory rather than a system call; without
+ * it, entries are batched into the system call the reactor waits in
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#ifndef RPCHAT_RPCHAT_IO_URING_H
+#define RPCHAT_RPCHAT_IO_URING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#include "rplib_common.h"
+
+#define RPCHAT_URING_MAX_RINGS   64    // rings open at once, one per reactor
+#define RPCHAT_URING_ENTRIES     4096  // submission queue entries per ring
+#define RPCHAT_URING_CQ_ENTRIES  16384 // completion queue entries per ring
+#define RPCHAT_URING_SQ_IDLE_MS  20    // idle before submission thread sleeps
+#define RPCHAT_URING_MAX_WATCHED 8     // non-connection descriptors per ring
+
+/**
+ * Check whether the running kernel can serve as backend: rings can be set up
+ * (with a submission polling thread, if asked) and poll requests can be
+ * updated in place (Linux 5.13 onwards)
+ * @param b_sqpoll Whether the kernel should poll the submission queue
+ * @return true if rings of this kind can be used
+ */
+bool rpchat_uring_probe(bool b_sqpoll);
+
+/**
+ * Create a ring. Rings created with submission polling share one kernel
+ * thread where the kernel allows it
+ * @param b_sqpoll Whether the kernel should poll the submission queue
+ * @return Ring file descriptor on success, RPLIB_ERROR on failure
+ */
+int rpchat_uring_create(bool b_sqpoll);
+
+/**
+ * Unmap and close a ring; requests still outstanding are cancelled
+ * @param h_fd_ring Ring file descriptor
+ */
+void rpchat_uring_destroy(int h_fd_ring);
+
+/**
+ * Watch a descriptor for input, level triggered: as long as it stays
+ * readable, each wait reports it again. Events report the descriptor itself
+ * in `data.fd`
+ * @param h_fd_ring Ring file descriptor
+ * @param h_fd File descriptor to watch
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on failure
+ */
+int rpchat_uring_watch(int h_fd_ring, int h_fd);
+
+/**
+ * Stop reporting a watched descriptor.
+ * \nNote: Called from the thread waiting on the ring
+ * @param h_fd_ring Ring file descriptor
+ * @param h_fd Watched file descriptor
+ */
+void rpchat_uring_unwatch(int h_fd_ring, int h_fd);
+
+/**
+ * Wait once for the events given on a descriptor, like an EPOLLONESHOT
+ * registration. If a poll is already outstanding its events are updated,
+ * else a new one is submitted.
+ * \nNote: Calls for one descriptor are serialized by the caller
+ * @param h_fd_ring Ring file descriptor
+ * @param h_fd File descriptor to poll
+ * @param p_data_ptr Pointer reported in `data.ptr`, at least 4-byte aligned
+ * @param events Epoll events to wait for (EPOLLET and EPOLLONESHOT ignored)
+ * @param p_b_pending Pointer to flag telling whether a poll is outstanding;
+ * set here, cleared by the caller once the completion has been received
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS on problems
+ */
+int rpchat_uring_arm(int          h_fd_ring,
+                     int          h_fd,
+                     void        *p_data_ptr,
+                     uint32_t     events,
+                     atomic_bool *p_b_pending);
+
+/**
+ * Withdraw the outstanding poll of a descriptor, if any. The withdrawn poll
+ * still completes (as EPOLLERR | EPOLLHUP), so `p_b_pending` is left set
+ * @param h_fd_ring Ring file descriptor
+ * @param p_data_ptr Pointer the poll was armed with
+ * @param p_b_pending Pointer to flag telling whether a poll is outstanding
+ */
+void rpchat_uring_disarm(int          h_fd_ring,
+                         void        *p_data_ptr,
+                         atomic_bool *p_b_pending);
+
+/**
+ * Wait for completions and translate them into epoll events. Polls of
+ * watched descriptors reported by the previous call are published again,
+ * and every published entry is submitted in the same system call that waits,
+ * or in one call after if events were already waiting.
+ * \nNote: Only one thread waits on a ring
+ * @param h_fd_ring Ring file descriptor
+ * @param p_ret_event_buf Pointer to buffer to receive events
+ * @param max_events Most events to return
+ * @return # events, RPLIB_ERROR on failure
+ */
+int rpchat_uring_wait(int                 h_fd_ring,
+                      struct epoll_event *p_ret_event_buf,
+                      unsigned int        max_events);
+
+#endif // RPCHAT_RPCHAT_IO_URING_H
+
+/*** end of file ***/
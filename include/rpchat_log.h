@@ -0,0 +1,82 @@
+/** @file rpchat_log.h
+ *
+ * @brief Asynchronous logging for the BCP server. Each thread formats records
+ * into its own lock-free ring buffer; a single writer thread drains every ring
+ * into the log descriptor with large batched writes. Records that do not fit
+ * are dropped and counted instead of blocking the caller
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#ifndef RPCHAT_RPCHAT_LOG_H
+#define RPCHAT_RPCHAT_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "rplib_common.h"
+
+#define RPCHAT_LOG_RING_SIZE     65536 // bytes buffered per thread, power of 2
+#define RPCHAT_LOG_RECORD_MAX    8192  // longest record, longer are truncated
+#define RPCHAT_LOG_FLUSH_MS      20    // writer drains at least this often
+#define RPCHAT_LOG_MAX_IOV       64    // ring regions gathered per write
+#define RPCHAT_LOG_DEFAULT_LEVEL RPCHAT_LOG_INFO
+
+/**
+ * Record severity; records above the configured level are discarded
+ */
+typedef enum
+{
+    RPCHAT_LOG_ERROR = 0, // failures affecting the server
+    RPCHAT_LOG_WARN,      // failures affecting a single client
+    RPCHAT_LOG_INFO,      // registrations, messages, disconnects
+    RPCHAT_LOG_DEBUG,     // everything else
+    RPCHAT_LOG_NUM_LEVELS
+} rpchat_log_level_t;
+
+/**
+ * Start the writer thread. Only one logger runs per process; it must be
+ * started before and stopped after every thread that logs
+ * @param h_fd_log Descriptor records are written to
+ * @param level Most verbose level kept
+ * @return RPLIB_SUCCESS on no issues, RPLIB_ERROR if the writer could not start
+ */
+int rpchat_log_start(int h_fd_log, rpchat_log_level_t level);
+
+/**
+ * Stop the writer thread after draining every ring, and free the rings. No
+ * thread may log while or after this runs
+ * @return Number of records dropped over the life of the logger
+ */
+size_t rpchat_log_stop(void);
+
+/**
+ * Check whether records of a level are currently kept, so callers can skip
+ * building arguments for discarded records
+ * @param level Level of record
+ * @return true if a record of this level would be written
+ */
+bool rpchat_log_enabled(rpchat_log_level_t level);
+
+/**
+ * Format a record into the calling thread's ring. Never blocks; the record is
+ * dropped if the ring is full or the logger is not running. A newline is
+ * appended
+ * @param level Level of record
+ * @param p_format printf-style format string
+ * @return RPLIB_SUCCESS if queued, RPLIB_UNSUCCESS if discarded or dropped
+ */
+int rpchat_log_write(rpchat_log_level_t level, const char *p_format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * Get the name of a level as written in records
+ * @param level Level
+ * @return Pointer to static null-terminated name
+ */
+const char *rpchat_log_level_name(rpchat_log_level_t level);
+
+#endif /* RPCHAT_RPCHAT_LOG_H */
+
+/*** end of file ***/
@@ -0,0 +1,133 @@
+/** @file rpchat_metrics.h
+ *
+ * @brief Counters and latency histograms for the message pipeline. Each
+ * thread records into its own shard without locks or shared cache lines; an
+ * admin thread sums the shards, reads gauges off the threadpool and
+ * connection queues, and serves the result in the Prometheus text format on a
+ * loopback socket. While disabled, recording costs a single check
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#ifndef RPCHAT_RPCHAT_METRICS_H
+#define RPCHAT_RPCHAT_METRICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "components/rpchat_conn_queue.h"
+#include "components/rpchat_file_cache.h"
+#include "rplib_common.h"
+#include "rplib_pool.h"
+#include "rplib_tpool.h"
+
+#define RPCHAT_METRICS_MIN_SHIFT    10 // first bucket holds below 2^10 ns
+#define RPCHAT_METRICS_MAX_SHIFT    36 // last holds 2^36 ns (~69 s) and up
+#define RPCHAT_METRICS_SUB_SHIFT    2  // 2^2 buckets per power of two
+#define RPCHAT_METRICS_IO_TIMEOUT   1  // seconds a scrape may stall for
+#define RPCHAT_METRICS_REQUEST_MAX  1024 // request bytes read, rest ignored
+
+// below the first power of two, 2^SUB_SHIFT per power of two, above the last
+#define RPCHAT_METRICS_NUM_BUCKETS                              \
+    (2                                                          \
+     + ((RPCHAT_METRICS_MAX_SHIFT - RPCHAT_METRICS_MIN_SHIFT)   \
+        << RPCHAT_METRICS_SUB_SHIFT))
+
+/**
+ * Events counted, summed over every thread
+ */
+typedef enum
+{
+    RPCHAT_METRIC_TASKS = 0,    // connection tasks run
+    RPCHAT_METRIC_REQUEUES,     // tasks that found the connection held
+    RPCHAT_METRIC_PARKED,       // events parked for a state change
+    RPCHAT_METRIC_FRAMES,       // complete frames parsed from clients
+    RPCHAT_METRIC_BROADCASTS,   // messages fanned out to every client
+    RPCHAT_METRIC_DELIVERIES,   // deliveries enqueued with recipients
+    RPCHAT_METRIC_COALESCED,    // deliveries joining an earlier one's write
+    RPCHAT_METRIC_NUM_COUNTERS
+} rpchat_metric_counter_t;
+
+/**
+ * Latencies tracked, in nanoseconds
+ */
+typedef enum
+{
+    RPCHAT_METRIC_RECV_PARSE = 0, // bytes buffered to their frame parsed
+    RPCHAT_METRIC_SEND_FAN_OUT,   // SEND broadcast to last DELIVER enqueued
+    RPCHAT_METRIC_DELIVER_ACK,    // DELIVER written to its STATUS or ACK
+    RPCHAT_METRIC_TASK_WAIT,      // task enqueued to task started
+    RPCHAT_METRIC_NUM_HISTOGRAMS
+} rpchat_metric_hist_t;
+
+/**
+ * Open the admin socket on the loopback interface and start the thread
+ * serving it, then enable recording. Only one instance runs per process; it
+ * must be started before and stopped after every thread that records
+ * @param port_num Port to serve metrics on
+ * @return RPLIB_SUCCESS on no issues, RPLIB_ERROR if the socket could not be
+ * opened or the thread could not start
+ */
+int rpchat_metrics_start(unsigned int port_num);
+
+/**
+ * Stop the admin thread, close its socket and free every thread's shard. No
+ * thread may record while or after this runs
+ */
+void rpchat_metrics_stop(void);
+
+/**
+ * Hand the admin thread the threadpool, connection queues, file cache and
+ * allocator it reads gauges from. Scrapes served without them report
+ * counters and histograms only
+ * @param p_tpool Pointer to threadpool
+ * @param pp_queues Pointer to array of connection queues, one per reactor
+ * @param num_queues Number of entries in pp_queues
+ * @param p_file_cache Pointer to file cache, or NULL
+ * @param p_pool Pointer to allocator shared by the queues, or NULL
+ */
+void rpchat_metrics_attach(rplib_tpool_t        *p_tpool,
+                           rpchat_conn_queue_t **pp_queues,
+                           size_t                num_queues,
+                           rpchat_file_cache_t  *p_file_cache,
+                           rplib_pool_t         *p_pool);
+
+/**
+ * Withdraw what `rpchat_metrics_attach` handed over, waiting out any scrape
+ * still reading it
+ */
+void rpchat_metrics_detach(void);
+
+/**
+ * Check whether recording is enabled
+ * @return true if metrics are being recorded
+ */
+bool rpchat_metrics_enabled(void);
+
+/**
+ * Take a timestamp to measure a latency from
+ * @return Monotonic time in nanoseconds; 0 when disabled, which
+ * `rpchat_metrics_record` ignores
+ */
+uint64_t rpchat_metrics_now(void);
+
+/**
+ * Add to a counter of the calling thread
+ * @param counter Counter to add to
+ * @param amount Amount to add
+ */
+void rpchat_metrics_count(rpchat_metric_counter_t counter, uint64_t amount);
+
+/**
+ * Record the time elapsed since a timestamp in a histogram of the calling
+ * thread
+ * @param hist Histogram to record in
+ * @param start_ns Timestamp from `rpchat_metrics_now`; 0 records nothing
+ */
+void rpchat_metrics_record(rpchat_metric_hist_t hist, uint64_t start_ns);
+
+#endif /* RPCHAT_RPCHAT_METRICS_H */
+
+/*** end of file ***/
@@ -15,12 +15,17 @@
 #include <fcntl.h>
 #include <malloc.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/epoll.h>
 #include <sys/signalfd.h>
+#include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include "components/rpchat_conn_queue.h"
@@ -28,25 +33,141 @@
 
 #define RPCHAT_DEFAULT_PORT 9001
 #define RPCHAT_MAX_INCOMING_MSG      8195 // maximum expected msg size
-#define RPCHAT_CLIENT_AUDIT_INTERVAL 10   // seconds to wait between checks
-#define RPCHAT_CONNECTION_TIMEOUT    60   // seconds to wait before terminating
+#define RPCHAT_CLIENT_AUDIT_INTERVAL 10   // default seconds between checks
+#define RPCHAT_CONNECTION_TIMEOUT    60   // default seconds before terminating
+#define RPCHAT_MAX_TIMEOUT           86400 // upper bound for -t and -i
+#define RPCHAT_DEFER_ACCEPT_SEC      5  // wait this long for a first message
+#define RPCHAT_ACCEPT_BATCH          64 // connections accepted per wakeup
+
+/**
+ * How reactors wait for readiness. Each reactor's `h_fd_epoll` is an epoll
+ * instance or an io_uring ring, depending on the backend in use
+ */
+typedef enum rpchat_io_backend
+{
+    RPCHAT_IO_EPOLL,        // epoll_wait, epoll_ctl per arm
+    RPCHAT_IO_URING,        // io_uring polls, io_uring_enter per arm
+    RPCHAT_IO_URING_SQPOLL, // io_uring polls, kernel takes arms from memory
+} rpchat_io_backend_t;
+
+/**
+ * Pick the backend every reactor uses, falling back to the next simpler one
+ * (down to epoll) while the kernel does not support the one asked for.
+ * \nNote: Called once, before any networking begins
+ * @param requested Backend asked for
+ * @return Backend in use
+ */
+rpchat_io_backend_t rpchat_select_io_backend(rpchat_io_backend_t requested);
+
+/**
+ * Get the backend in use
+ * @return Backend picked by `rpchat_select_io_backend`, RPCHAT_IO_EPOLL if
+ * none was
+ */
+rpchat_io_backend_t rpchat_get_io_backend(void);
+
+/**
+ * Get the name of a backend, as accepted by the -u option
+ * @param backend Backend
+ * @return Pointer to null-terminated name
+ */
+const char *rpchat_io_backend_name(rpchat_io_backend_t backend);
 
 /**
  * Begin networking for basic chat server with given arguments
  * @param port_num Port number to serve on
+ * @param h_fd_inherited Listening socket taken over from a predecessor, or -1
+ * to bind a new one
  * @param max_connections Maximum concurrent connections
  * @return Epoll file descriptor on success, RPLIB_ERROR on failure
  */
 int rpchat_begin_networking(unsigned int port_num,
+                            int          h_fd_inherited,
                             int         *p_h_fd_server,
                             int         *p_h_fd_epoll,
                             int         *p_h_fd_signal);
 
+/**
+ * Create a listening socket and an epoll instance watching it, without the
+ * process-wide signal setup done by `rpchat_begin_networking`
+ * @param port_num Port number to serve on
+ * @param h_fd_inherited Listening socket taken over from a predecessor, or -1
+ * to bind a new one; closed on failure either way
+ * @param p_h_fd_server Pointer to store server socket file descriptor in
+ * @param p_h_fd_epoll Pointer to store epoll file descriptor in
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on failure
+ */
+int rpchat_begin_listener(unsigned int port_num,
+                          int          h_fd_inherited,
+                          int         *p_h_fd_server,
+                          int         *p_h_fd_epoll);
+
+/**
+ * Watch a descriptor for input on an epoll instance. Events report the
+ * descriptor itself in `data.fd`
+ * @param h_fd_epoll Epoll instance file descriptor
+ * @param h_fd File descriptor to watch
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on failure
+ */
+int rpchat_watch_descriptor(int h_fd_epoll, int h_fd);
+
+/**
+ * Stop watching a descriptor added by `rpchat_watch_descriptor`
+ * @param h_fd_epoll Epoll instance file descriptor
+ * @param h_fd Watched file descriptor
+ */
+void rpchat_unwatch_descriptor(int h_fd_epoll, int h_fd);
+
+/**
+ * Start watching a new connection for the given events, reported once (the
+ * first arming of `rpchat_arm_descriptor`)
+ * @param h_fd_epoll Epoll instance file descriptor
+ * @param h_fd File descriptor of connection
+ * @param p_data_ptr Pointer reported in `data.ptr`
+ * @param events Epoll events to report
+ * @param p_b_pending Pointer to the connection's outstanding poll flag
+ * (io_uring only)
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS on problems
+ */
+int rpchat_register_descriptor(int          h_fd_epoll,
+                               int          h_fd,
+                               void        *p_data_ptr,
+                               uint32_t     events,
+                               atomic_bool *p_b_pending);
+
+/**
+ * Withdraw the outstanding io_uring poll of a connection about to be closed.
+ * The poll completes as a hang up, so the connection is not destroyed under
+ * it. Nothing to do for epoll, `rpchat_close_connection` removes the
+ * descriptor
+ * @param h_fd_epoll Epoll instance file descriptor
+ * @param p_data_ptr Pointer the connection was armed with
+ * @param p_b_pending Pointer to the connection's outstanding poll flag
+ */
+void rpchat_disarm_descriptor(int          h_fd_epoll,
+                              void        *p_data_ptr,
+                              atomic_bool *p_b_pending);
+
+/**
+ * Create a periodic timer watched by an epoll instance, readable every
+ * interval_sec seconds
+ * @param h_fd_epoll Epoll instance file descriptor
+ * @param interval_sec Seconds between expirations
+ * @return Timer file descriptor on success, RPLIB_ERROR on failure
+ */
+int rpchat_begin_timer(int h_fd_epoll, unsigned int interval_sec);
+
 /**
  * Stop networking for basic chat server
  * @param h_fd_epoll Epoll instance file descriptor
+ * @param h_fd_server Listening socket file descriptor
+ * @param h_fd_signal Signalfd file descriptor, or -1
+ * @param h_fd_timer Timer file descriptor, or -1
  */
-void rpchat_stop_networking(int h_fd_epoll, int h_fd_server, int h_fd_signal);
+void rpchat_stop_networking(int h_fd_epoll,
+                            int h_fd_server,
+                            int h_fd_signal,
+                            int h_fd_timer);
 
 /**
  * Setup a TCP server socket
@@ -67,15 +188,18 @@ int rpchat_monitor_connections(int                 h_fd_epoll,
                                unsigned int        max_connections);
 
 /**
- * Accept a new connection and return the socket descriptor
- * @param h_fd_server File descriptor for server
+ * Accept a new connection and return its socket descriptor, already
+ * non-blocking and close-on-exec
+ * @param h_fd_server File descriptor for non-blocking server socket
  * @return Socket descriptor of new connection on success, RPLIB_ERROR on
- * problems
+ * problems. errno is EAGAIN or EWOULDBLOCK once no connection is waiting
  */
 int rpchat_accept_new_connection(unsigned int h_fd_server);
 
 /**
- * Close a connection and dependencies
+ * Close a connection and dependencies. The descriptor is removed from the
+ * epoll instance first, as its number can be reused as soon as it is closed
+ * (io_uring polls are withdrawn by `rpchat_disarm_descriptor` instead)
  * @param h_fd_epoll File descriptor for related epoll instance
  * @param h_fd File descriptor for related connection
  * @return RPLIB_SUCCESS on no problems, RPLIB_UNSUCCESS otherwise
@@ -98,6 +222,17 @@ int rpchat_get_signal(int h_fd_signal);
  */
 int rpchat_recv(int h_fd_client, char *p_buf, size_t len);
 
+/**
+ * Receive as much pending data as fits into a set of buffers from a given
+ * client with a single call
+ * @param h_fd_client FD of client to receive message from
+ * @param p_iov Pointer to array of buffers in which to place data
+ * @param iov_count Number of buffers in p_iov
+ * @return Bytes read, 0 if no data is pending, RPLIB_ERROR on error or
+ * disconnect
+ */
+int rpchat_recvv(int h_fd_client, struct iovec *p_iov, int iov_count);
+
 /**
  * Send a message to a given client
  * @param h_fd_client FD of client to send message to
@@ -106,6 +241,16 @@ int rpchat_recv(int h_fd_client, char *p_buf, size_t len);
  */
 int rpchat_sendmsg(int h_fd_client, char *p_buf, size_t len);
 
+/**
+ * Send as much of a set of buffers to a given client as the socket accepts
+ * with a single call
+ * @param h_fd_client FD of client to send message to
+ * @param p_iov Pointer to array of buffers containing data to send
+ * @param iov_count Number of buffers in p_iov
+ * @return Bytes sent (0 if socket buffer is full), RPLIB_ERROR on error
+ */
+int rpchat_sendmsgv(int h_fd_client, struct iovec *p_iov, int iov_count);
+
 #endif // RPCHAT_NETWORKING_H
 
 /*** end of file ***/
@@ -21,9 +21,13 @@
 
 #include "components/rpchat_conn_info.h"
 #include "components/rpchat_conn_queue.h"
+#include "components/rpchat_frame_parser.h"
+#include "components/rpchat_shared_msg.h"
 #include "components/rpchat_string.h"
 #include "endian.h"
 #include "rpchat_basic_chat_util.h"
+#include "rpchat_log.h"
+#include "rpchat_metrics.h"
 #include "rpchat_networking.h"
 #include "rplib_common.h"
 #include "rplib_tpool.h"
@@ -32,7 +36,9 @@ typedef enum
 {
     RPCHAT_PROC_EVENT_INBOUND, // event is INBOUND to server (status, send, etc)
     RPCHAT_PROC_EVENT_OUTBOUND, // event is OUTBOUND to clients (e.g. deliver)
-    RPCHAT_PROC_EVENT_HEARTBEAT // event is explicitly to close client
+    RPCHAT_PROC_EVENT_HEARTBEAT, // event is explicitly to close client
+    RPCHAT_PROC_EVENT_CLAIM,     // cluster decided on the client's username
+    RPCHAT_PROC_EVENT_FLUSH      // deliveries posted to the outbox are due
 } rpchat_args_proc_event_src_t;
 
 typedef struct
@@ -44,78 +50,219 @@ typedef struct
     rpchat_conn_queue_t *p_conn_queue; // Queue of `rpchat_conn_info_t`
     char                *p_msg_buf;    // Pointer to msg buffer
     size_t               sz_msg_buf;   // size of msg buffer
+    rpchat_shared_msg_t *p_shared_msg; // message shared between recipients
+    bool                 b_charged;    // counted in recipient's backlog
+    uint64_t             enqueued_ns;  // metrics stamp once queued, or 0
+    bool                 b_granted;    // CLAIM events: username is kept
 } rpchat_args_proc_event_t;
 
+typedef enum
+{
+    RPCHAT_PROC_RES_DONE,      // event handled, args can be freed
+    RPCHAT_PROC_RES_AGAIN,     // state changed, process event again
+    RPCHAT_PROC_RES_PARK,      // wrong state for event, defer until it changes
+    RPCHAT_PROC_RES_DESTROYED, // connection was destroyed
+} rpchat_proc_event_res_t;
+
 /**
  * Task that controls how to handle events, including state changes. Manages
  * entire lifecycle of a connection
- * \nNote: Task is re-entrant and will requeue itself to manage state
+ * \nNote: Events the connection's state cannot process yet are parked on the
+ * connection and run, in order, once the state changes
  * \nNote: Task frees passed argument pointer on completion of processing
  * @param p_args Pointer to event args
  */
 void rpchat_task_conn_proc_event(void *p_args);
 
 /**
- * Given inbound data from a client, receive appropriate headers and do
- * appropriate action based on content
+ * Given a complete message parsed from a client, do appropriate action based
+ * on content
  * @param p_conn_info Pointer to sender connection info
- * @param p_msg_buf Pointer to buffer containing message sent
+ * @param p_frame Pointer to frame containing message sent
  * @return RPLIB_SUCCESS on no issues, RPLIB_UNSUCCESS if unexpected,
  * RPLIB_ERROR if invalid msg passed
  */
 int rpchat_handle_msg(rpchat_conn_queue_t           *p_conn_queue,
                       struct rpchat_connection_info *p_conn_info,
                       rplib_tpool_t                 *p_tpool,
-                      char                          *p_msg_buf);
+                      rpchat_frame_t                *p_frame);
 /**
- * Receive and handle a BCP RPCHAT_BCP_REGISTER message - register client and
- * send status message
+ * Handle a BCP RPCHAT_BCP_REGISTER message - register client and send status
+ * message. A RPCHAT_BCP_REGWIN message also sets the delivery window, capped
+ * at RPCHAT_CONN_MAX_WINDOW
  * @param p_conn_info Pointer to sender connection info
  * @param p_conn_queue Pointer to connection Queue
  * @param p_tpool Pointer to threadpool managing tasks
+ * @param p_frame Pointer to frame containing REGISTER message
  * @return RPLIB_SUCCESS on no issues, RPLIB_UNSUCCESS on registration failure
  */
 int rpchat_handle_register(rpchat_conn_queue_t           *p_conn_queue,
                            struct rpchat_connection_info *p_conn_info,
-                           rplib_tpool_t                 *p_tpool);
+                           rplib_tpool_t                 *p_tpool,
+                           rpchat_frame_t                *p_frame);
 /**
- * Receive and handle a BCP RPCHAT_BCP_SEND message - broadcast message to every
- * client connected (except sender)
+ * Handle a BCP RPCHAT_BCP_SEND message - broadcast message to every client
+ * connected (except sender)
  * @param p_conn_queue Pointer to connection Queue\
  * @param p_sender_info Pointer to sender connection info
  * @param p_tpool Pointer to threadpool managing tasks
+ * @param p_frame Pointer to frame containing SEND message
  * @return RP_SUCCESS on no issues, RPLIB_UNSUCCESS on processing failure
  */
 int rpchat_handle_send(rpchat_conn_queue_t           *p_conn_queue,
                        struct rpchat_connection_info *p_sender_info,
-                       rplib_tpool_t                 *p_tpool);
+                       rplib_tpool_t                 *p_tpool,
+                       rpchat_frame_t                *p_frame);
+
+/**
+ * Handle an BCP RPCHAT_BCP_SENDFILE message. The contents following the
+ * header are received as the connection becomes readable, and answered with
+ * a STATUS once stored (or discarded)
+ * @param p_conn_queue Pointer to queue holding the file directory
+ * @param p_sender_info Pointer to sender connection info
+ * @param p_frame Pointer to frame containing SENDFILE header
+ * @return RP_SUCCESS on no issues, RPLIB_ERROR if the client may not upload
+ * now
+ */
+int rpchat_handle_sendfile(rpchat_conn_queue_t           *p_conn_queue,
+                           struct rpchat_connection_info *p_sender_info,
+                           rpchat_frame_t                *p_frame);
+
+/**
+ * Handle an BCP RPCHAT_BCP_GETFILE message. A RECVFILE header is queued and
+ * the file contents follow it as the connection becomes writable; a file
+ * that cannot be served is answered with a negative STATUS instead
+ * @param p_conn_queue Pointer to queue holding the file directory
+ * @param p_sender_info Pointer to sender connection info
+ * @param p_frame Pointer to frame containing GETFILE message
+ * @return RP_SUCCESS on no issues, RPLIB_ERROR if the client may not download
+ * now
+ */
+int rpchat_handle_getfile(rpchat_conn_queue_t           *p_conn_queue,
+                          struct rpchat_connection_info *p_sender_info,
+                          rpchat_frame_t                *p_frame);
+
+/**
+ * Handle a BCP RPCHAT_BCP_JOIN message - subscribe the sender to a room,
+ * created on first join. An invalid name, or joining more than
+ * RPCHAT_ROOM_MAX_JOINED rooms, is answered with a negative STATUS
+ * @param p_conn_queue Pointer to queue of the sender
+ * @param p_conn_info Pointer to sender connection info
+ * @param p_frame Pointer to frame containing JOIN message
+ * @return RP_SUCCESS on no issues, RPLIB_UNSUCCESS if the sender is not
+ * registered, RPLIB_ERROR on allocation failure
+ */
+int rpchat_handle_join(rpchat_conn_queue_t           *p_conn_queue,
+                       struct rpchat_connection_info *p_conn_info,
+                       rpchat_frame_t                *p_frame);
+
+/**
+ * Handle a BCP RPCHAT_BCP_LEAVE message - unsubscribe the sender from a room.
+ * A room not joined is answered with a negative STATUS
+ * @param p_conn_queue Pointer to queue of the sender
+ * @param p_conn_info Pointer to sender connection info
+ * @param p_frame Pointer to frame containing LEAVE message
+ * @return RP_SUCCESS on no issues, RPLIB_UNSUCCESS if the sender is not
+ * registered
+ */
+int rpchat_handle_leave(rpchat_conn_queue_t           *p_conn_queue,
+                        struct rpchat_connection_info *p_conn_info,
+                        rpchat_frame_t                *p_frame);
 
 /**
- * Receive and handle an BCP RPCHAT_BCP_STATUS message
+ * Handle a BCP RPCHAT_BCP_ROOMSEND message - broadcast message to the other
+ * members of a room the sender joined
+ * @param p_conn_queue Pointer to queue of the sender
+ * @param p_sender_info Pointer to sender connection info
+ * @param p_tpool Pointer to threadpool managing tasks
+ * @param p_frame Pointer to frame containing ROOMSEND message
+ * @return RP_SUCCESS on no issues, RPLIB_UNSUCCESS on processing failure
+ */
+int rpchat_handle_roomsend(rpchat_conn_queue_t           *p_conn_queue,
+                           struct rpchat_connection_info *p_sender_info,
+                           rplib_tpool_t                 *p_tpool,
+                           rpchat_frame_t                *p_frame);
+
+/**
+ * Handle an BCP RPCHAT_BCP_STATUS message, acknowledging the oldest message
+ * still awaiting one
+ * @param p_conn_info Pointer to sender connection info
+ * @param p_frame Pointer to frame containing STATUS message
+ * @return RP_SUCCESS on no issues, RP_UNSUCCESS if no status was expected,
+ * RPLIB_ERROR on a negative status
+ */
+int rpchat_conn_info_handle_status(rpchat_conn_info_t *p_conn_info,
+                                   rpchat_frame_t     *p_frame);
+
+/**
+ * Handle an BCP RPCHAT_BCP_ACK message, acknowledging the `code` oldest
+ * messages still awaiting a status. Only valid for windowed connections
  * @param p_conn_info Pointer to sender connection info
- * @return RP_SUCCESS on no issues, RP_UNSUCCESS on processing failure
+ * @param p_frame Pointer to frame containing ACK message
+ * @return RP_SUCCESS on no issues, RP_UNSUCCESS if the connection is not
+ * windowed, RPLIB_ERROR if the count is zero or more than is unacknowledged
  */
-int rpchat_conn_info_handle_status(rpchat_conn_info_t *p_conn_info);
+int rpchat_conn_info_handle_ack(rpchat_conn_info_t *p_conn_info,
+                                rpchat_frame_t     *p_frame);
 
 /**
  * Sanitize and send a message to every client connected to the BCP session
  * except for the sender identified by passed `p_sender_info` by submitting jobs
- * to threadpool
+ * to threadpool. The DELIVER message is encoded once and shared by every
+ * recipient; clients of other reactors get it through their mailboxes
  * @param p_conn_queue Pointer to queue containing conn info objects
  * @param p_sender_info Pointer to sender connection info
- * @param p_sender_str Pointer to string containing the sender identity
+ * @param p_sender_name Pointer to name of the sender; NULL to use the username
+ * of p_sender_info
  * @param p_tpool Pointer to threadpool managing tasks
- * @param p_msg Pointer to string containing message to send
+ * @param p_msg Pointer to string containing message to send; sent as is when
+ * already marked sanitized
  * @return RP_SUCCESS on no issues, RP_UNSUCCESS on broadcast failure
  */
 int rpchat_broadcast_msg(rpchat_conn_queue_t           *p_conn_queue,
                          struct rpchat_connection_info *p_sender_info,
-                         rpchat_string_t               *p_sender_str,
+                         rpchat_conn_name_t            *p_sender_name,
                          rplib_tpool_t                 *p_tpool,
                          rpchat_string_t               *p_msg);
 
 /**
- * Send a message to a client specified by a `rpchat_conn_info_t` object
+ * Announce a newly stored file to every client connected to the BCP session
+ * except its uploader with an FNOTIFY message, encoded once and shared the
+ * same way as `rpchat_broadcast_msg`
+ * @param p_conn_queue Pointer to queue containing conn info objects
+ * @param p_sender_info Pointer to uploader connection info
+ * @param p_tpool Pointer to threadpool managing tasks
+ * @param p_file_name Pointer to name the file was stored under
+ * @return RP_SUCCESS on no issues, RP_UNSUCCESS on broadcast failure
+ */
+int rpchat_broadcast_file(rpchat_conn_queue_t           *p_conn_queue,
+                          struct rpchat_connection_info *p_sender_info,
+                          rplib_tpool_t                 *p_tpool,
+                          rpchat_string_t               *p_file_name);
+
+/**
+ * Send a message to every other member of a room with a ROOMDELIVER message,
+ * encoded once. Only the members are walked, on whichever reactor they are;
+ * clients outside the room are never touched
+ * @param p_conn_queue Pointer to queue of the sender
+ * @param p_sender_info Pointer to sender connection info, a member of the room
+ * @param p_tpool Pointer to threadpool managing tasks
+ * @param p_room_name Pointer to room name contents
+ * @param room_len Length of room name
+ * @param p_msg Pointer to sanitized message
+ * @return RP_SUCCESS on no issues, RP_UNSUCCESS on broadcast failure
+ */
+int rpchat_broadcast_room(rpchat_conn_queue_t           *p_conn_queue,
+                          struct rpchat_connection_info *p_sender_info,
+                          rplib_tpool_t                 *p_tpool,
+                          const char                    *p_room_name,
+                          uint16_t                       room_len,
+                          rpchat_string_t               *p_msg);
+
+/**
+ * Send a message to a client specified by a `rpchat_conn_info_t` object. The
+ * message is appended to the connection's outbound queue and written as far as
+ * the socket allows; any remainder is sent once the socket becomes writable
  * @param p_sender_info Pointer to `rpchat_conn_info_t` object
  * @param p_msg_buf Pointer to buffer containing valid BCP message
  * @param sz_msg_buf Size of passed message buffer
@@ -125,4 +272,103 @@ int rpchat_conn_info_submit_msg(rpchat_conn_info_t *p_sender_info,
                                 char               *p_msg_buf,
                                 size_t              sz_msg_buf);
 
+/**
+ * Send a shared message to a client specified by a `rpchat_conn_info_t`
+ * object. The connection's outbound queue references the message rather than
+ * copying it
+ * @param p_sender_info Pointer to `rpchat_conn_info_t` object
+ * @param p_shared_msg Pointer to shared message containing valid BCP message
+ * @return RPLIB_SUCCESS on success; otherwise, RPLIB_UNSUCCESS
+ */
+int rpchat_conn_info_submit_shared(rpchat_conn_info_t  *p_sender_info,
+                                   rpchat_shared_msg_t *p_shared_msg);
+
+/**
+ * Sanitize and send a server message to every client of this node, through
+ * the mailbox of every reactor. For threads other than workers and reactors,
+ * and for news other nodes announce for themselves
+ * @param p_conn_queue Pointer to any queue of the node
+ * @param p_msg Pointer to string containing message to send
+ * @return RP_SUCCESS on no issues, RP_UNSUCCESS on broadcast failure
+ */
+int rpchat_broadcast_notice(rpchat_conn_queue_t *p_conn_queue,
+                            rpchat_string_t     *p_msg);
+
+/**
+ * Tell a connection what the cluster decided about its username. A granted
+ * claim completes the registration; a refused claim, or a name lost to
+ * another node, disconnects the client
+ * @param p_conn_queue Pointer to queue of the connection
+ * @param p_conn_info Pointer to connection
+ * @param p_tpool Pointer to threadpool managing tasks
+ * @param b_granted Whether the connection keeps its username
+ * @return RPLIB_SUCCESS on no issues, otherwise RPLIB_UNSUCCESS
+ */
+int rpchat_resolve_claim(rpchat_conn_queue_t *p_conn_queue,
+                         rpchat_conn_info_t  *p_conn_info,
+                         rplib_tpool_t       *p_tpool,
+                         bool                 b_granted);
+
+/**
+ * Hand a connection a HEARTBEAT, so a closing one runs its closing task again
+ * @param p_conn_queue Pointer to queue of the connection
+ * @param p_conn_info Pointer to connection
+ * @param p_tpool Pointer to threadpool managing tasks
+ * @return RPLIB_SUCCESS on no issues, otherwise RPLIB_UNSUCCESS
+ */
+int rpchat_wake_connection(rpchat_conn_queue_t *p_conn_queue,
+                           rpchat_conn_info_t  *p_conn_info,
+                           rplib_tpool_t       *p_tpool);
+
+/**
+ * Hand a connection an inbound event without readiness, so messages already
+ * in its inbound buffer are processed, and it is armed once none is left
+ * @param p_conn_queue Pointer to queue of the connection
+ * @param p_conn_info Pointer to connection
+ * @param p_tpool Pointer to threadpool managing tasks
+ * @return RPLIB_SUCCESS on no issues, otherwise RPLIB_UNSUCCESS
+ */
+int rpchat_resume_connection(rpchat_conn_queue_t *p_conn_queue,
+                             rpchat_conn_info_t  *p_conn_info,
+                             rplib_tpool_t       *p_tpool);
+
+/**
+ * Park an outbound message on a connection behind those parked already, as
+ * if the connection's state had held it back. A delivery counts against the
+ * connection's backlog until written
+ * \nNote: No task may run for the connection meanwhile
+ * @param p_conn_queue Pointer to queue of the connection
+ * @param p_conn_info Pointer to connection
+ * @param p_tpool Pointer to threadpool managing tasks
+ * @param p_msg Pointer to encoded message; copied
+ * @param sz_msg Size of encoded message
+ * @param b_delivery Whether the message is a delivery, else a STATUS
+ * @return RPLIB_SUCCESS on no issues, RPLIB_ERROR on allocation failure or a
+ * STATUS too large
+ */
+int rpchat_park_outbound(rpchat_conn_queue_t *p_conn_queue,
+                         rpchat_conn_info_t  *p_conn_info,
+                         rplib_tpool_t       *p_tpool,
+                         const char          *p_msg,
+                         size_t               sz_msg,
+                         bool                 b_delivery);
+
+/**
+ * Flush the outboxes of every connection whose deliveries waited for the
+ * connection queue's flush timer, once it fired
+ * @param p_conn_queue Pointer to connection queue owning the timer
+ * @param p_tpool Pointer to threadpool managing tasks
+ */
+void rpchat_flush_lingering(rpchat_conn_queue_t *p_conn_queue,
+                            rplib_tpool_t       *p_tpool);
+
+/**
+ * Deliver every message waiting in a connection queue's mailbox to the
+ * clients connected to that queue
+ * @param p_conn_queue Pointer to connection queue owning the mailbox
+ * @param p_tpool Pointer to threadpool managing tasks
+ */
+void rpchat_deliver_mail(rpchat_conn_queue_t *p_conn_queue,
+                         rplib_tpool_t       *p_tpool);
+
 #endif // RPCHAT_RPCHAT_PROCESS_EVENT_H
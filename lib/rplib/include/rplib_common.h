@@ -10,6 +10,7 @@
 #define RPLIB_RP_COMMON_H
 
 #include "stdio.h"
+#include <stddef.h>
 
 
 #ifndef NDEBUG
@@ -26,6 +27,10 @@
 
 #define RPLIB_IS_BIG_ENDIAN (!*(unsigned char *)&(uint16_t){1})
 
+// get the object embedding `p_member` as its field `member`
+#define RPLIB_CONTAINER_OF(p_member, type, member) \
+    ((type *)((char *)(p_member) - offsetof(type, member)))
+
 
 typedef enum
 {
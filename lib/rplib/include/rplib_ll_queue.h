@@ -67,6 +67,14 @@ int rplib_ll_queue_dequeue(rplib_ll_queue_t *p_queue);
  */
 rplib_ll_queue_node_t *rplib_ll_queue_peek(rplib_ll_queue_t *p_queue);
 
+/**
+ * Move every node of a Queue to the rear of another, keeping their order
+ * @param p_queue Pointer to Queue to append to
+ * @param p_other Pointer to Queue to take nodes from; left empty
+ */
+void rplib_ll_queue_splice(rplib_ll_queue_t *p_queue,
+                           rplib_ll_queue_t *p_other);
+
 /**
  * Destroy a Queue in memory, freeing all children
  * @param p_queue Pointer to LL Queue to destroy
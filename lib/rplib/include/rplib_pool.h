@@ -0,0 +1,112 @@
+/** @file rplib_pool.h
+ *
+ * @brief Fixed size-class block allocator with per-thread free-list caches
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#ifndef RPLIB_POOL_H
+#define RPLIB_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "rplib_common.h"
+
+#define RPLIB_POOL_MAX_CLASSES 8  // size classes per pool
+#define RPLIB_POOL_CACHE_DEPTH 64 // free blocks a thread keeps per class
+#define RPLIB_POOL_BATCH       32 // blocks moved between thread and pool
+
+/**
+ * Header preceding every block handed out by a pool
+ */
+typedef union rplib_pool_block
+{
+    union rplib_pool_block *p_next;      // next free block (while free)
+    size_t                  class_index; // size class (while allocated)
+    max_align_t             align;       // keep user data aligned
+} rplib_pool_block_t;
+
+/**
+ * Allocation counters, summed over every thread that used a pool
+ */
+typedef struct rplib_pool_stats
+{
+    unsigned long cache_hits; // served from the calling thread's cache
+    unsigned long pool_hits;  // served by refilling from the shared lists
+    unsigned long misses;     // fell through to malloc
+} rplib_pool_stats_t;
+
+/**
+ * Free blocks and counters owned by a single thread
+ */
+typedef struct rplib_pool_cache
+{
+    struct rplib_pool       *p_pool;                             // owner
+    rplib_pool_block_t      *p_free[RPLIB_POOL_MAX_CLASSES];     // free lists
+    size_t                   free_count[RPLIB_POOL_MAX_CLASSES]; // list sizes
+    atomic_ulong             cache_hits;   // see `rplib_pool_stats_t`
+    atomic_ulong             pool_hits;    // see `rplib_pool_stats_t`
+    atomic_ulong             misses;       // see `rplib_pool_stats_t`
+    struct rplib_pool_cache *p_next_cache; // next live cache of pool
+} rplib_pool_cache_t;
+
+typedef struct rplib_pool
+{
+    size_t              num_classes;                        // # size classes
+    size_t              class_size[RPLIB_POOL_MAX_CLASSES]; // ascending sizes
+    pthread_key_t       key_cache;  // calling thread's `rplib_pool_cache_t`
+    pthread_mutex_t     mutex_pool; // lock for shared lists and cache list
+    rplib_pool_block_t *p_free[RPLIB_POOL_MAX_CLASSES];     // shared lists
+    size_t              free_count[RPLIB_POOL_MAX_CLASSES]; // list sizes
+    rplib_pool_cache_t *p_caches;      // live thread caches
+    rplib_pool_stats_t  retired_stats; // counters of exited threads
+} rplib_pool_t;
+
+/**
+ * Create a pool allocator
+ * @param p_class_sizes Pointer to array of block sizes, in ascending order
+ * @param num_classes Number of entries in p_class_sizes (at most
+ * RPLIB_POOL_MAX_CLASSES)
+ * @return Pointer to created pool; NULL on failure
+ */
+rplib_pool_t *rplib_pool_create(const size_t *p_class_sizes,
+                                size_t        num_classes);
+
+/**
+ * Destroy a pool allocator, freeing every block not currently allocated.
+ * \nNote: other threads that used the pool must have exited
+ * @param p_pool Pointer to pool to destroy
+ * @return RPLIB_SUCCESS on no issues; otherwise RPLIB_UNSUCCESS
+ */
+int rplib_pool_destroy(rplib_pool_t *p_pool);
+
+/**
+ * Allocate a block of at least `size` bytes from the smallest fitting size
+ * class. Requests larger than every class are passed to malloc
+ * @param p_pool Pointer to pool
+ * @param size Number of bytes required
+ * @return Pointer to block; NULL on failure
+ */
+void *rplib_pool_alloc(rplib_pool_t *p_pool, size_t size);
+
+/**
+ * Return a block obtained from `rplib_pool_alloc` to the pool
+ * @param p_pool Pointer to pool the block was allocated from
+ * @param p_data Pointer to block; NULL is ignored
+ */
+void rplib_pool_free(rplib_pool_t *p_pool, void *p_data);
+
+/**
+ * Get allocation counters for a pool
+ * @param p_pool Pointer to pool
+ * @param p_stats Pointer to stats object to store result in
+ */
+void rplib_pool_get_stats(rplib_pool_t *p_pool, rplib_pool_stats_t *p_stats);
+
+#endif /* RPLIB_POOL_H */
+
+/*** end of file ***/
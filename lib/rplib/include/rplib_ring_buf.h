@@ -0,0 +1,126 @@
+/** @file rplib_ring_buf.h
+ *
+ * @brief Implements a fixed-capacity byte ring buffer
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#ifndef RPLIB_RING_BUF_H
+#define RPLIB_RING_BUF_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+
+#include "rplib_common.h"
+
+typedef struct rplib_ring_buf
+{
+    char  *p_buf;    // backing storage
+    size_t capacity; // size of backing storage in bytes (power of two)
+    size_t head;     // running offset of first readable byte
+    size_t tail;     // running offset one past last readable byte
+} rplib_ring_buf_t;
+
+/**
+ * Create a ring buffer
+ * @param capacity Size of ring buffer in bytes; must be a power of two
+ * @return Pointer to created ring buffer; NULL on failure
+ */
+rplib_ring_buf_t *rplib_ring_buf_create(size_t capacity);
+
+/**
+ * Destroy a ring buffer in memory, freeing backing storage
+ * @param p_ring Pointer to ring buffer to destroy
+ * @return RPLIB_SUCCESS on no issues; otherwise RPLIB_UNSUCCESS
+ */
+int rplib_ring_buf_destroy(rplib_ring_buf_t *p_ring);
+
+/**
+ * Give an empty ring buffer object caller-owned backing storage, e.g. one
+ * embedded in another structure that only holds storage while busy
+ * @param p_ring Pointer to ring buffer object
+ * @param p_storage Pointer to backing storage of at least `capacity` bytes
+ * @param capacity Size of storage in bytes; must be a power of two
+ */
+void rplib_ring_buf_attach(rplib_ring_buf_t *p_ring,
+                           char             *p_storage,
+                           size_t            capacity);
+
+/**
+ * Take back storage given with `rplib_ring_buf_attach`. Any buffered bytes are
+ * discarded; the ring buffer holds nothing until storage is attached again
+ * @param p_ring Pointer to ring buffer object
+ * @return Pointer to backing storage; NULL if none was attached
+ */
+char *rplib_ring_buf_detach(rplib_ring_buf_t *p_ring);
+
+/**
+ * Get amount of readable bytes currently held by a ring buffer
+ * @param p_ring Pointer to ring buffer
+ * @return Number of readable bytes
+ */
+size_t rplib_ring_buf_size(const rplib_ring_buf_t *p_ring);
+
+/**
+ * Get amount of bytes that can still be written to a ring buffer
+ * @param p_ring Pointer to ring buffer
+ * @return Number of writable bytes
+ */
+size_t rplib_ring_buf_free_space(const rplib_ring_buf_t *p_ring);
+
+/**
+ * Describe the writable region of a ring buffer as up to two iovecs, suitable
+ * for a single `readv`/`recvmsg` call. Bytes written to the region must be
+ * committed with `rplib_ring_buf_commit`
+ * @param p_ring Pointer to ring buffer
+ * @param p_iov Pointer to array of at least two iovecs to fill
+ * @return Number of iovecs filled (0 when full)
+ */
+int rplib_ring_buf_get_free_iov(rplib_ring_buf_t *p_ring, struct iovec *p_iov);
+
+/**
+ * Describe the readable region of a ring buffer as up to two iovecs, so
+ * buffered bytes can be handed to a single `writev`-style call. Bytes written
+ * out of the region are not consumed until `rplib_ring_buf_consume` is called
+ * @param p_ring Pointer to ring buffer
+ * @param p_iov Pointer to array of at least two iovecs to fill
+ * @param max_len Most bytes to describe
+ * @return Number of iovecs filled (0 when empty)
+ */
+int rplib_ring_buf_get_data_iov(const rplib_ring_buf_t *p_ring,
+                                struct iovec           *p_iov,
+                                size_t                  max_len);
+
+/**
+ * Mark bytes placed in the region returned by `rplib_ring_buf_get_free_iov` as
+ * readable
+ * @param p_ring Pointer to ring buffer
+ * @param len Number of bytes written
+ */
+void rplib_ring_buf_commit(rplib_ring_buf_t *p_ring, size_t len);
+
+/**
+ * Copy bytes out of a ring buffer WITHOUT consuming them
+ * @param p_ring Pointer to ring buffer
+ * @param offset Offset from first readable byte to begin copying at
+ * @param p_dst Pointer to destination buffer
+ * @param len Number of bytes to copy
+ * @return RPLIB_SUCCESS if bytes were available; otherwise RPLIB_UNSUCCESS
+ */
+int rplib_ring_buf_peek(const rplib_ring_buf_t *p_ring,
+                        size_t                  offset,
+                        void                   *p_dst,
+                        size_t                  len);
+
+/**
+ * Discard bytes from the front of a ring buffer
+ * @param p_ring Pointer to ring buffer
+ * @param len Number of bytes to discard (clamped to readable size)
+ */
+void rplib_ring_buf_consume(rplib_ring_buf_t *p_ring, size_t len);
+
+#endif /* RPLIB_RING_BUF_H */
+
+/*** end of file ***/
@@ -0,0 +1,97 @@
+/** @file rplib_timer_wheel.h
+ *
+ * @brief Hierarchical timer wheel over intrusive timer nodes. Not
+ * synchronized; callers serialize access
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#ifndef RPLIB_TIMER_WHEEL_H
+#define RPLIB_TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rplib_common.h"
+
+#define RPLIB_TIMER_WHEEL_BITS   6 // log2 of slots per level
+#define RPLIB_TIMER_WHEEL_SLOTS  (1u << RPLIB_TIMER_WHEEL_BITS)
+#define RPLIB_TIMER_WHEEL_LEVELS 3 // spans SLOTS^LEVELS ticks
+
+/**
+ * Timer embedded in the object it times; unscheduled while pp_prev is NULL
+ */
+typedef struct rplib_timer_node
+{
+    struct rplib_timer_node  *p_next;  // next timer in slot
+    struct rplib_timer_node **pp_prev; // link pointing at this timer
+    uint64_t                  expiry;  // tick timer fires on
+} rplib_timer_node_t;
+
+typedef struct rplib_timer_wheel
+{
+    uint64_t            now;        // last tick processed
+    size_t              num_timers; // # scheduled timers
+    rplib_timer_node_t *p_slots[RPLIB_TIMER_WHEEL_LEVELS]
+                               [RPLIB_TIMER_WHEEL_SLOTS]; // timers per slot
+} rplib_timer_wheel_t;
+
+/**
+ * Called for every timer that expires. The timer is already unscheduled and
+ * may be scheduled again from the callback
+ * @param p_node Pointer to expired timer
+ * @param p_arg Argument passed to `rplib_timer_wheel_advance`
+ */
+typedef void (*rplib_timer_fn_t)(rplib_timer_node_t *p_node, void *p_arg);
+
+/**
+ * Initialize an empty timer wheel
+ * @param p_wheel Pointer to wheel
+ * @param now Current tick
+ */
+void rplib_timer_wheel_initialize(rplib_timer_wheel_t *p_wheel, uint64_t now);
+
+/**
+ * Initialize a timer node as unscheduled
+ * @param p_node Pointer to timer
+ */
+void rplib_timer_node_initialize(rplib_timer_node_t *p_node);
+
+/**
+ * Schedule a timer, moving it if it was already scheduled. Expiries at or
+ * before the current tick fire on the next one; expiries beyond the span of
+ * the wheel are parked in its last slot and placed again as they come closer
+ * @param p_wheel Pointer to wheel
+ * @param p_node Pointer to timer
+ * @param expiry Tick to fire on
+ */
+void rplib_timer_wheel_schedule(rplib_timer_wheel_t *p_wheel,
+                                rplib_timer_node_t  *p_node,
+                                uint64_t             expiry);
+
+/**
+ * Unschedule a timer; does nothing if it is not scheduled
+ * @param p_wheel Pointer to wheel
+ * @param p_node Pointer to timer
+ */
+void rplib_timer_wheel_cancel(rplib_timer_wheel_t *p_wheel,
+                              rplib_timer_node_t  *p_node);
+
+/**
+ * Advance a wheel to tick `now`, firing every timer that expired on the way.
+ * Cost is proportional to ticks passed and timers fired, not timers held
+ * @param p_wheel Pointer to wheel
+ * @param now Current tick; ticks before the last processed one are ignored
+ * @param p_fn Function called for each expired timer
+ * @param p_arg Argument passed to p_fn
+ * @return Number of timers fired
+ */
+size_t rplib_timer_wheel_advance(rplib_timer_wheel_t *p_wheel,
+                                 uint64_t             now,
+                                 rplib_timer_fn_t     p_fn,
+                                 void                *p_arg);
+
+#endif /* RPLIB_TIMER_WHEEL_H */
+
+/*** end of file ***/
@@ -17,20 +17,13 @@
 #include "rplib_common.h"
 #include "rplib_ll_queue.h"
 
-typedef struct
-{
-    rplib_ll_queue_t *p_queue_tasks;     // job queue
-    pthread_t        *p_thread_buf;      // storage for threads
-    size_t            num_threads;       // number of threads to use
-    volatile size_t   num_threads_busy;  // number of active threads
-    volatile size_t   num_threads_alive; // number of active threads
-    pthread_mutex_t   mutex_task_queue;  // lock for job queue
-    pthread_mutex_t   mutex_thrd_count;  // lock for thread metrics
-    pthread_cond_t    cond_task_queue;   // used to signal threads about jobs
-    pthread_cond_t    cond_threads_idle; // used to signal all threads idle
-    atomic_bool       b_terminate;       // trigger for shutdown
-
-} rplib_tpool_t;
+#define RPLIB_TPOOL_RING_CAPACITY   65536 // shared tasks held lock-free (2^n)
+#define RPLIB_TPOOL_LOCAL_CAPACITY  4096  // per-worker tasks held lock-free
+#define RPLIB_TPOOL_CACHE_LINE      64    // keeps ring cursors apart
+#define RPLIB_TPOOL_REBALANCE_SLACK 32    // backlog that moves an idle binding
+#define RPLIB_TPOOL_GROW_DEPTH      16    // queued tasks per worker to grow
+#define RPLIB_TPOOL_IDLE_MS         2000  // idling before an extra worker parks
+#define RPLIB_TPOOL_MAX_NODES       64    // NUMA nodes looked up for pinning
 
 typedef struct
 {
@@ -38,6 +31,88 @@ typedef struct
     void *p_arg;
 } rplib_tpool_task_t;
 
+/**
+ * Slot in the task ring. `sequence` tells producers and consumers which lap of
+ * the ring the slot is ready for
+ */
+typedef struct
+{
+    atomic_size_t      sequence; // ring position slot is ready for
+    rplib_tpool_task_t task;     // stored task
+} rplib_tpool_slot_t;
+
+/**
+ * Bounded MPMC ring of task slots
+ */
+typedef struct
+{
+    rplib_tpool_slot_t *p_slots;   // slot storage
+    size_t              ring_mask; // ring capacity - 1
+    _Alignas(RPLIB_TPOOL_CACHE_LINE) atomic_size_t enqueue_pos; // next to fill
+    _Alignas(RPLIB_TPOOL_CACHE_LINE) atomic_size_t dequeue_pos; // next to take
+} rplib_tpool_ring_t;
+
+/**
+ * FIFO of tasks: a lock-free ring, spilling to a locked list once full
+ */
+typedef struct
+{
+    rplib_tpool_ring_t ring;           // lock-free part of queue
+    size_t             sz_mapped;      // bytes of mapped ring slots, 0 if heap
+    rplib_ll_queue_t  *p_overflow;     // jobs that did not fit in ring
+    atomic_size_t      num_overflow;   // # jobs in p_overflow
+    atomic_size_t      num_pending;    // # jobs queued, not yet started
+    pthread_mutex_t    mutex_overflow; // lock for p_overflow
+} rplib_tpool_queue_t;
+
+/**
+ * Per-thread state. Tasks in `queue` run only on this worker, in order. A
+ * parked worker takes no shared tasks, but still runs those bound to it
+ */
+typedef struct
+{
+    rplib_tpool_queue_t queue;       // tasks bound to this worker
+    pthread_cond_t      cond_worker; // used to wake this worker
+    atomic_bool         b_sleeping;  // worker is waiting on cond_worker
+    atomic_bool         b_parked;    // worker waits to be given back tasks
+    bool                b_started;   // thread created, joined on destroy
+    int                 cpu;         // CPU pinned to, -1 if not pinned
+    int                 node;        // NUMA node of cpu, -1 if unknown
+    struct rplib_tpool *p_tpool;     // owning threadpool
+    size_t              index;       // position in p_workers
+} rplib_tpool_worker_t;
+
+/**
+ * Binds a stream of tasks to a single worker so they run one at a time, in
+ * order. The worker is only picked again once every task has finished
+ */
+typedef struct
+{
+    atomic_uint_fast64_t binding; // worker index << 32 | tasks outstanding
+    size_t               key;     // hashed to pick preferred worker
+} rplib_tpool_affinity_t;
+
+typedef struct rplib_tpool
+{
+    rplib_tpool_queue_t   queue_shared;         // tasks any worker can run
+    rplib_tpool_worker_t *p_workers;            // per-thread state
+    atomic_size_t         num_tasks_pending;    // # jobs queued, all queues
+    pthread_t            *p_thread_buf;         // storage for threads
+    size_t                num_threads;          // workers, most that may run
+    size_t                min_threads;          // workers kept while idle
+    atomic_size_t         num_threads_active;   // first workers, not parked
+    atomic_size_t         num_threads_busy;     // number of active threads
+    atomic_size_t         num_threads_alive;    // number of live threads
+    atomic_size_t         num_threads_sleeping; // # threads awaiting job
+    atomic_size_t         num_grown;         // workers added past minimum
+    atomic_size_t         num_shrunk;        // workers parked after idling
+    pthread_mutex_t       mutex_task_queue;  // lock for sleeping and wakeups
+    pthread_mutex_t       mutex_thrd_count;  // lock for idle condition
+    pthread_mutex_t       mutex_grow;        // lock for resizing
+    pthread_cond_t        cond_threads_idle; // used to signal all threads idle
+    atomic_bool           b_terminate;       // trigger for shutdown
+} rplib_tpool_t;
+
 /**
  * Create a threadpool object
  * @param num_threads Number of threads to use
@@ -45,6 +120,23 @@ typedef struct
  */
 rplib_tpool_t *rplib_tpool_create(size_t num_threads);
 
+/**
+ * Create a threadpool object that runs between `min_threads` and
+ * `max_threads` workers. Another worker is added whenever none is asleep and
+ * more than RPLIB_TPOOL_GROW_DEPTH tasks per running worker are queued; the
+ * last one added parks once idle for RPLIB_TPOOL_IDLE_MS. Threads are
+ * created the first time their worker is added and only exit on destroy, so
+ * what they hold per thread outlives a shrink
+ * @param min_threads Number of threads kept running
+ * @param max_threads Most threads to run, at least min_threads
+ * @param b_pin Whether to pin each worker to a CPU the process may run on,
+ * filling one NUMA node before the next, with its queue on that node
+ * @return Pointer to threadpool object; NULL on failure
+ */
+rplib_tpool_t *rplib_tpool_create_adaptive(size_t min_threads,
+                                           size_t max_threads,
+                                           bool   b_pin);
+
 /**
  * Initialize threadpool object
  * @param p_tpool Pointer to threadpool to initialize
@@ -53,6 +145,20 @@ rplib_tpool_t *rplib_tpool_create(size_t num_threads);
  */
 int rplib_tpool_initialize(rplib_tpool_t *p_tpool, size_t num_threads);
 
+/**
+ * Initialize threadpool object running between two numbers of threads, see
+ * `rplib_tpool_create_adaptive`
+ * @param p_tpool Pointer to threadpool to initialize
+ * @param min_threads Number of threads kept running
+ * @param max_threads Most threads to run, at least min_threads
+ * @param b_pin Whether to pin each worker to a CPU
+ * @return RPLIB_SUCCESS on success; RP_UNSUCCESS otherwise
+ */
+int rplib_tpool_initialize_adaptive(rplib_tpool_t *p_tpool,
+                                    size_t         min_threads,
+                                    size_t         max_threads,
+                                    bool           b_pin);
+
 /**
  * Destroy threadpool object
  * @param p_tpool Pointer to threadpool to destroy
@@ -71,16 +177,61 @@ int rplib_tpool_enqueue_task(rplib_tpool_t *p_tpool,
                              void (*p_function)(void *p_arg),
                              void *p_arg);
 
+/**
+ * Enqueue several tasks in the threadpool at once, waking as many sleeping
+ * workers as there are tasks with a single pass over the sleepers
+ * @param p_tpool Pointer to threadpool object
+ * @param p_tasks Pointer to array of tasks to enqueue, in order
+ * @param num_tasks Number of entries in p_tasks
+ * @return Number of tasks enqueued; tasks past it were not queued
+ */
+size_t rplib_tpool_enqueue_batch(rplib_tpool_t      *p_tpool,
+                                 rplib_tpool_task_t *p_tasks,
+                                 size_t              num_tasks);
+
+/**
+ * Initialize an affinity binding. Tasks enqueued through it prefer the worker
+ * `key` hashes to
+ * @param p_affinity Pointer to affinity object to initialize
+ * @param key Value used to pick preferred worker (e.g. a descriptor)
+ */
+void rplib_tpool_affinity_initialize(rplib_tpool_affinity_t *p_affinity,
+                                     size_t                  key);
+
+/**
+ * Enqueue a task on the worker an affinity object is bound to. If nothing
+ * enqueued through the binding is outstanding, it is first (re)bound, to the
+ * preferred worker unless that one is backed up compared to the least loaded.
+ * \nNote: every task enqueued this way must call
+ * `rplib_tpool_affinity_release` when it is done
+ * @param p_tpool Pointer to threadpool object
+ * @param p_affinity Pointer to affinity object
+ * @param p_function Pointer to function to enqueue
+ * @param p_arg Pointer to argument object to pass function
+ * @return RPLIB_SUCCESS on success; otherwise RPLIB_UNSUCCESS
+ */
+int rplib_tpool_enqueue_affine(rplib_tpool_t          *p_tpool,
+                               rplib_tpool_affinity_t *p_affinity,
+                               void (*p_function)(void *p_arg),
+                               void *p_arg);
+
+/**
+ * Mark a task enqueued with `rplib_tpool_enqueue_affine` as finished
+ * @param p_affinity Pointer to affinity object task was enqueued through
+ */
+void rplib_tpool_affinity_release(rplib_tpool_affinity_t *p_affinity);
+
 /**
  * Helper function that every thread executes persistently until threadpool
  * is destroyed
- * @param p_tpool Pointer to threadpool object
+ * @param p_worker Pointer to worker state of calling thread
  * @return RPLIB_SUCCESS on no issues, RPLIB_UNSUCCESS otherwise
  */
-void rplib_tpool_thread_do(rplib_tpool_t *p_tpool);
+void rplib_tpool_thread_do(rplib_tpool_worker_t *p_worker);
 
 /**
  * Start threadpool with amount of threads specified in `rplib_tpool_initialize`
+ * (the minimum, for adaptive pools)
  * @param p_tpool Pointer to threadpool object
  * @return RPLIB_SUCCESS on no issues; otherwise RPLIB_UNSUCCESS
  */
@@ -93,6 +244,20 @@ int rplib_tpool_start(rplib_tpool_t *p_tpool);
  */
 int rplib_tpool_wait(rplib_tpool_t *p_tpool);
 
+/**
+ * Get number of tasks queued but not yet picked up by a thread
+ * @param p_tpool Pointer to threadpool object
+ * @return Number of pending tasks
+ */
+size_t rplib_tpool_get_queue_depth(rplib_tpool_t *p_tpool);
+
+/**
+ * Get number of workers currently taking tasks, parked ones excluded
+ * @param p_tpool Pointer to threadpool object
+ * @return Number of running workers
+ */
+size_t rplib_tpool_get_num_threads(rplib_tpool_t *p_tpool);
+
 #endif /* RPLIB_TPOOL_H */
 
 /*** end of file ***/
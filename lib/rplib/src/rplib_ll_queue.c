@@ -172,6 +172,33 @@ rplib_ll_queue_peek(rplib_ll_queue_t *p_queue)
     return p_res;
 }
 
+void
+rplib_ll_queue_splice(rplib_ll_queue_t *p_queue, rplib_ll_queue_t *p_other)
+{
+    // asserts
+    assert(p_queue);
+    assert(p_other);
+    if (0 == p_other->size)
+    {
+        return;
+    }
+    // link other's nodes behind the rear
+    if (NULL == p_queue->p_rear)
+    {
+        p_queue->p_front = p_other->p_front;
+    }
+    else
+    {
+        p_queue->p_rear->p_next_node = p_other->p_front;
+    }
+    p_queue->p_rear = p_other->p_rear;
+    p_queue->size += p_other->size;
+    // other owns nothing anymore
+    p_other->p_front = NULL;
+    p_other->p_rear  = NULL;
+    p_other->size    = 0;
+}
+
 int
 rplib_ll_queue_destroy(rplib_ll_queue_t *p_queue)
 {
@@ -0,0 +1,324 @@
+/** @file rplib_pool.c
+ *
+ * @brief Implements a fixed size-class block allocator with per-thread caches
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#include "rplib_pool.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#define RPLIB_POOL_NO_CLASS SIZE_MAX // block came straight from malloc
+
+/**
+ * Move up to `count` blocks of a size class from one free list to another
+ * @param pp_src Pointer to head of source list
+ * @param p_src_count Pointer to size of source list
+ * @param pp_dst Pointer to head of destination list
+ * @param p_dst_count Pointer to size of destination list
+ * @param count Maximum number of blocks to move
+ */
+static void
+rplib_pool_move_blocks(rplib_pool_block_t **pp_src,
+                       size_t              *p_src_count,
+                       rplib_pool_block_t **pp_dst,
+                       size_t              *p_dst_count,
+                       size_t               count)
+{
+    rplib_pool_block_t *p_block = NULL;
+
+    while (0 < count && NULL != *pp_src)
+    {
+        p_block         = *pp_src;
+        *pp_src         = p_block->p_next;
+        p_block->p_next = *pp_dst;
+        *pp_dst         = p_block;
+        (*p_src_count)--;
+        (*p_dst_count)++;
+        count--;
+    }
+}
+
+/**
+ * Return everything a thread cache holds to its pool and stop tracking it.
+ * Registered as the destructor for `key_cache`, so runs on thread exit
+ * @param p_arg Pointer to `rplib_pool_cache_t`
+ */
+static void
+rplib_pool_cache_destroy(void *p_arg)
+{
+    rplib_pool_cache_t  *p_cache     = (rplib_pool_cache_t *)p_arg;
+    rplib_pool_t        *p_pool      = p_cache->p_pool;
+    rplib_pool_cache_t **pp_curr     = NULL;
+    size_t               class_index = 0;
+
+    pthread_mutex_lock(&p_pool->mutex_pool);
+    for (class_index = 0; class_index < p_pool->num_classes; class_index++)
+    {
+        rplib_pool_move_blocks(&p_cache->p_free[class_index],
+                               &p_cache->free_count[class_index],
+                               &p_pool->p_free[class_index],
+                               &p_pool->free_count[class_index],
+                               SIZE_MAX);
+    }
+    // keep counters after thread is gone
+    p_pool->retired_stats.cache_hits += atomic_load(&p_cache->cache_hits);
+    p_pool->retired_stats.pool_hits += atomic_load(&p_cache->pool_hits);
+    p_pool->retired_stats.misses += atomic_load(&p_cache->misses);
+    // unlink
+    for (pp_curr = &p_pool->p_caches; NULL != *pp_curr;
+         pp_curr = &(*pp_curr)->p_next_cache)
+    {
+        if (p_cache == *pp_curr)
+        {
+            *pp_curr = p_cache->p_next_cache;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&p_pool->mutex_pool);
+    free(p_cache);
+}
+
+/**
+ * Get the calling thread's cache for a pool, creating it on first use
+ * @param p_pool Pointer to pool
+ * @return Pointer to cache; NULL on failure
+ */
+static rplib_pool_cache_t *
+rplib_pool_get_cache(rplib_pool_t *p_pool)
+{
+    rplib_pool_cache_t *p_cache = NULL;
+
+    p_cache = pthread_getspecific(p_pool->key_cache);
+    if (NULL != p_cache)
+    {
+        goto leave;
+    }
+    p_cache = calloc(1, sizeof(rplib_pool_cache_t));
+    if (NULL == p_cache)
+    {
+        RPLIB_DEBUG_PRINTF("error: rplib_pool, %s", "CACHE MALLOC");
+        goto leave;
+    }
+    p_cache->p_pool = p_pool;
+    if (0 != pthread_setspecific(p_pool->key_cache, p_cache))
+    {
+        free(p_cache);
+        p_cache = NULL;
+        goto leave;
+    }
+    // track for stats and teardown
+    pthread_mutex_lock(&p_pool->mutex_pool);
+    p_cache->p_next_cache = p_pool->p_caches;
+    p_pool->p_caches      = p_cache;
+    pthread_mutex_unlock(&p_pool->mutex_pool);
+leave:
+    return p_cache;
+}
+
+rplib_pool_t *
+rplib_pool_create(const size_t *p_class_sizes, size_t num_classes)
+{
+    rplib_pool_t *p_pool      = NULL;
+    size_t        class_index = 0;
+    // asserts
+    assert(p_class_sizes);
+    assert(0 < num_classes && RPLIB_POOL_MAX_CLASSES >= num_classes);
+    // allocate
+    p_pool = calloc(1, sizeof(rplib_pool_t));
+    if (NULL == p_pool)
+    {
+        RPLIB_DEBUG_PRINTF("error: rplib_pool, %s", "POOL MALLOC");
+        goto leave;
+    }
+    // set fields
+    p_pool->num_classes = num_classes;
+    for (class_index = 0; class_index < num_classes; class_index++)
+    {
+        assert(0 == class_index
+               || p_class_sizes[class_index - 1] <= p_class_sizes[class_index]);
+        p_pool->class_size[class_index] = p_class_sizes[class_index];
+    }
+    if (0 != pthread_key_create(&p_pool->key_cache, rplib_pool_cache_destroy))
+    {
+        goto cleanup;
+    }
+    pthread_mutex_init(&p_pool->mutex_pool, NULL);
+    goto leave;
+cleanup:
+    free(p_pool);
+    p_pool = NULL;
+leave:
+    return p_pool;
+}
+
+int
+rplib_pool_destroy(rplib_pool_t *p_pool)
+{
+    rplib_pool_cache_t *p_cache     = NULL;
+    rplib_pool_block_t *p_block     = NULL;
+    size_t              class_index = 0;
+
+    assert(p_pool);
+    // calling thread's cache will not see its destructor run
+    p_cache = pthread_getspecific(p_pool->key_cache);
+    if (NULL != p_cache)
+    {
+        pthread_setspecific(p_pool->key_cache, NULL);
+        rplib_pool_cache_destroy(p_cache);
+    }
+    pthread_key_delete(p_pool->key_cache);
+
+    // release free blocks
+    for (class_index = 0; class_index < p_pool->num_classes; class_index++)
+    {
+        while (NULL != p_pool->p_free[class_index])
+        {
+            p_block                     = p_pool->p_free[class_index];
+            p_pool->p_free[class_index] = p_block->p_next;
+            free(p_block);
+        }
+    }
+    pthread_mutex_destroy(&p_pool->mutex_pool);
+    free(p_pool);
+    p_pool = NULL;
+    return RPLIB_SUCCESS;
+}
+
+void *
+rplib_pool_alloc(rplib_pool_t *p_pool, size_t size)
+{
+    rplib_pool_cache_t *p_cache     = NULL;
+    rplib_pool_block_t *p_block     = NULL;
+    size_t              class_index = 0;
+
+    // find smallest class that fits
+    while (class_index < p_pool->num_classes
+           && p_pool->class_size[class_index] < size)
+    {
+        class_index++;
+    }
+    p_cache = rplib_pool_get_cache(p_pool);
+    if (class_index == p_pool->num_classes || NULL == p_cache)
+    {
+        class_index = RPLIB_POOL_NO_CLASS;
+        goto heap_alloc;
+    }
+
+    // fast path, thread's own free list
+    if (NULL != p_cache->p_free[class_index])
+    {
+        atomic_fetch_add_explicit(
+            &p_cache->cache_hits, 1, memory_order_relaxed);
+        goto pop_block;
+    }
+    // refill a batch from the shared list
+    pthread_mutex_lock(&p_pool->mutex_pool);
+    rplib_pool_move_blocks(&p_pool->p_free[class_index],
+                           &p_pool->free_count[class_index],
+                           &p_cache->p_free[class_index],
+                           &p_cache->free_count[class_index],
+                           RPLIB_POOL_BATCH);
+    pthread_mutex_unlock(&p_pool->mutex_pool);
+    if (NULL != p_cache->p_free[class_index])
+    {
+        atomic_fetch_add_explicit(
+            &p_cache->pool_hits, 1, memory_order_relaxed);
+        goto pop_block;
+    }
+heap_alloc:
+    if (NULL != p_cache)
+    {
+        atomic_fetch_add_explicit(
+            &p_cache->misses, 1, memory_order_relaxed);
+    }
+    p_block = malloc(sizeof(rplib_pool_block_t)
+                     + (RPLIB_POOL_NO_CLASS == class_index
+                            ? size
+                            : p_pool->class_size[class_index]));
+    if (NULL == p_block)
+    {
+        goto leave;
+    }
+    goto set_class;
+pop_block:
+    p_block                      = p_cache->p_free[class_index];
+    p_cache->p_free[class_index] = p_block->p_next;
+    p_cache->free_count[class_index]--;
+set_class:
+    p_block->class_index = class_index;
+    // hand out memory following header
+    p_block++;
+leave:
+    return p_block;
+}
+
+void
+rplib_pool_free(rplib_pool_t *p_pool, void *p_data)
+{
+    rplib_pool_cache_t *p_cache     = NULL;
+    rplib_pool_block_t *p_block     = NULL;
+    size_t              class_index = 0;
+
+    if (NULL == p_data)
+    {
+        return;
+    }
+    p_block     = (rplib_pool_block_t *)p_data - 1;
+    class_index = p_block->class_index;
+    // oversized, not tracked by the pool
+    if (RPLIB_POOL_NO_CLASS == class_index)
+    {
+        free(p_block);
+        return;
+    }
+    // no cache to hold it, straight to the shared list
+    p_cache = rplib_pool_get_cache(p_pool);
+    if (NULL == p_cache)
+    {
+        pthread_mutex_lock(&p_pool->mutex_pool);
+        p_block->p_next             = p_pool->p_free[class_index];
+        p_pool->p_free[class_index] = p_block;
+        p_pool->free_count[class_index]++;
+        pthread_mutex_unlock(&p_pool->mutex_pool);
+        return;
+    }
+
+    // keep in thread's own list
+    p_block->p_next              = p_cache->p_free[class_index];
+    p_cache->p_free[class_index] = p_block;
+    p_cache->free_count[class_index]++;
+    // thread is only freeing (e.g. consumer of another thread's blocks), give
+    // a batch back so producers can reuse it
+    if (RPLIB_POOL_CACHE_DEPTH < p_cache->free_count[class_index])
+    {
+        pthread_mutex_lock(&p_pool->mutex_pool);
+        rplib_pool_move_blocks(&p_cache->p_free[class_index],
+                               &p_cache->free_count[class_index],
+                               &p_pool->p_free[class_index],
+                               &p_pool->free_count[class_index],
+                               RPLIB_POOL_BATCH);
+        pthread_mutex_unlock(&p_pool->mutex_pool);
+    }
+}
+
+void
+rplib_pool_get_stats(rplib_pool_t *p_pool, rplib_pool_stats_t *p_stats)
+{
+    rplib_pool_cache_t *p_cache = NULL;
+
+    pthread_mutex_lock(&p_pool->mutex_pool);
+    memcpy(p_stats, &p_pool->retired_stats, sizeof(rplib_pool_stats_t));
+    for (p_cache = p_pool->p_caches; NULL != p_cache;
+         p_cache = p_cache->p_next_cache)
+    {
+        p_stats->cache_hits += atomic_load(&p_cache->cache_hits);
+        p_stats->pool_hits += atomic_load(&p_cache->pool_hits);
+        p_stats->misses += atomic_load(&p_cache->misses);
+    }
+    pthread_mutex_unlock(&p_pool->mutex_pool);
+}
@@ -0,0 +1,206 @@
+/** @file rplib_ring_buf.c
+ *
+ * @brief Implements a fixed-capacity byte ring buffer
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#include "rplib_ring_buf.h"
+
+#include <assert.h>
+#include <string.h>
+
+rplib_ring_buf_t *
+rplib_ring_buf_create(size_t capacity)
+{
+    rplib_ring_buf_t *p_ring = NULL;
+    // asserts (capacity must be power of two so offsets can be masked)
+    assert(capacity > 0);
+    assert(0 == (capacity & (capacity - 1)));
+    // allocate
+    p_ring = malloc(sizeof(rplib_ring_buf_t));
+    if (NULL == p_ring)
+    {
+        RPLIB_DEBUG_PRINTF("error: rplib_ring_buf, %s", "RING MALLOC");
+        goto leave;
+    }
+    p_ring->p_buf = malloc(capacity);
+    if (NULL == p_ring->p_buf)
+    {
+        RPLIB_DEBUG_PRINTF("error: rplib_ring_buf, %s", "STORAGE MALLOC");
+        goto cleanup;
+    }
+    // set fields
+    p_ring->capacity = capacity;
+    p_ring->head     = 0;
+    p_ring->tail     = 0;
+    goto leave;
+cleanup:
+    free(p_ring);
+    p_ring = NULL;
+leave:
+    return p_ring;
+}
+
+int
+rplib_ring_buf_destroy(rplib_ring_buf_t *p_ring)
+{
+    assert(p_ring);
+    free(p_ring->p_buf);
+    p_ring->p_buf = NULL;
+    free(p_ring);
+    p_ring = NULL;
+    return RPLIB_SUCCESS;
+}
+
+void
+rplib_ring_buf_attach(rplib_ring_buf_t *p_ring,
+                      char             *p_storage,
+                      size_t            capacity)
+{
+    assert(p_ring);
+    assert(p_storage);
+    assert(capacity > 0);
+    assert(0 == (capacity & (capacity - 1)));
+    p_ring->p_buf    = p_storage;
+    p_ring->capacity = capacity;
+    p_ring->head     = 0;
+    p_ring->tail     = 0;
+}
+
+char *
+rplib_ring_buf_detach(rplib_ring_buf_t *p_ring)
+{
+    char *p_storage = p_ring->p_buf;
+
+    // zero capacity, nothing to read and no room to write
+    p_ring->p_buf    = NULL;
+    p_ring->capacity = 0;
+    p_ring->head     = 0;
+    p_ring->tail     = 0;
+    return p_storage;
+}
+
+size_t
+rplib_ring_buf_size(const rplib_ring_buf_t *p_ring)
+{
+    return p_ring->tail - p_ring->head;
+}
+
+size_t
+rplib_ring_buf_free_space(const rplib_ring_buf_t *p_ring)
+{
+    return p_ring->capacity - rplib_ring_buf_size(p_ring);
+}
+
+int
+rplib_ring_buf_get_free_iov(rplib_ring_buf_t *p_ring, struct iovec *p_iov)
+{
+    int    res        = 0;
+    size_t free_space = rplib_ring_buf_free_space(p_ring);
+    size_t tail_index = 0; // masked position of tail
+    size_t first_len  = 0; // contiguous bytes from tail to end of storage
+
+    if (0 == free_space)
+    {
+        goto leave;
+    }
+    // if empty, rewind so the whole region is contiguous
+    if (p_ring->head == p_ring->tail)
+    {
+        p_ring->head = 0;
+        p_ring->tail = 0;
+    }
+    tail_index = p_ring->tail & (p_ring->capacity - 1);
+    first_len  = p_ring->capacity - tail_index;
+    first_len  = first_len < free_space ? first_len : free_space;
+
+    // region from tail to end of storage (or to head)
+    p_iov[0].iov_base = p_ring->p_buf + tail_index;
+    p_iov[0].iov_len  = first_len;
+    res               = 1;
+    // wrapped region from start of storage up to head
+    if (first_len < free_space)
+    {
+        p_iov[1].iov_base = p_ring->p_buf;
+        p_iov[1].iov_len  = free_space - first_len;
+        res               = 2;
+    }
+leave:
+    return res;
+}
+
+int
+rplib_ring_buf_get_data_iov(const rplib_ring_buf_t *p_ring,
+                            struct iovec           *p_iov,
+                            size_t                  max_len)
+{
+    int    res        = 0;
+    size_t data_len   = rplib_ring_buf_size(p_ring);
+    size_t head_index = 0; // masked position of head
+    size_t first_len  = 0; // contiguous bytes from head to end of storage
+
+    data_len = data_len < max_len ? data_len : max_len;
+    if (0 == data_len)
+    {
+        goto leave;
+    }
+    head_index = p_ring->head & (p_ring->capacity - 1);
+    first_len  = p_ring->capacity - head_index;
+    first_len  = first_len < data_len ? first_len : data_len;
+
+    // region from head to end of storage (or to tail)
+    p_iov[0].iov_base = p_ring->p_buf + head_index;
+    p_iov[0].iov_len  = first_len;
+    res               = 1;
+    // wrapped region from start of storage
+    if (first_len < data_len)
+    {
+        p_iov[1].iov_base = p_ring->p_buf;
+        p_iov[1].iov_len  = data_len - first_len;
+        res               = 2;
+    }
+leave:
+    return res;
+}
+
+void
+rplib_ring_buf_commit(rplib_ring_buf_t *p_ring, size_t len)
+{
+    assert(len <= rplib_ring_buf_free_space(p_ring));
+    p_ring->tail += len;
+}
+
+int
+rplib_ring_buf_peek(const rplib_ring_buf_t *p_ring,
+                    size_t                  offset,
+                    void                   *p_dst,
+                    size_t                  len)
+{
+    int    res        = RPLIB_UNSUCCESS;
+    size_t read_index = 0; // masked position to begin copy
+    size_t first_len  = 0; // contiguous bytes before wrap
+
+    // must have enough readable bytes
+    if (offset + len > rplib_ring_buf_size(p_ring))
+    {
+        goto leave;
+    }
+    read_index = (p_ring->head + offset) & (p_ring->capacity - 1);
+    first_len  = p_ring->capacity - read_index;
+    first_len  = first_len < len ? first_len : len;
+    // copy up to end of storage, then any wrapped remainder
+    memcpy(p_dst, p_ring->p_buf + read_index, first_len);
+    memcpy((char *)p_dst + first_len, p_ring->p_buf, len - first_len);
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+void
+rplib_ring_buf_consume(rplib_ring_buf_t *p_ring, size_t len)
+{
+    size_t readable = rplib_ring_buf_size(p_ring);
+    p_ring->head += len < readable ? len : readable;
+}
@@ -0,0 +1,188 @@
+/** @file rplib_timer_wheel.c
+ *
+ * @brief Implements hierarchical timer wheel. Level 0 holds timers due within
+ * RPLIB_TIMER_WHEEL_SLOTS ticks, one tick per slot; each level above covers
+ * RPLIB_TIMER_WHEEL_SLOTS times the span of the one below and is cascaded
+ * down as its slots come due
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#include "rplib_timer_wheel.h"
+
+#include <assert.h>
+#include <string.h>
+
+#define RPLIB_TIMER_WHEEL_MASK (RPLIB_TIMER_WHEEL_SLOTS - 1)
+
+/**
+ * Get the number of ticks spanned by a single slot of a level
+ * @param level Level of wheel
+ * @return Ticks per slot
+ */
+static uint64_t
+rplib_timer_wheel_granularity(size_t level)
+{
+    return (uint64_t)1 << (RPLIB_TIMER_WHEEL_BITS * level);
+}
+
+/**
+ * Link a timer into the slot covering its expiry
+ * @param p_wheel Pointer to wheel
+ * @param p_node Pointer to unscheduled timer, expiry set
+ * @param earliest Earliest tick the timer may be placed on
+ */
+static void
+rplib_timer_wheel_place(rplib_timer_wheel_t *p_wheel,
+                        rplib_timer_node_t  *p_node,
+                        uint64_t             earliest)
+{
+    uint64_t             tick    = p_node->expiry;
+    size_t               level   = 0;
+    size_t               slot    = 0;
+    rplib_timer_node_t **pp_head = NULL; // slot timer is linked into
+
+    if (tick < earliest)
+    {
+        tick = earliest;
+    }
+    // lowest level whose span reaches the tick
+    while (RPLIB_TIMER_WHEEL_LEVELS > level + 1
+           && tick - p_wheel->now
+                  >= rplib_timer_wheel_granularity(level + 1))
+    {
+        level++;
+    }
+    // beyond the wheel, park in the farthest slot until it cascades
+    if (tick - p_wheel->now
+        >= rplib_timer_wheel_granularity(RPLIB_TIMER_WHEEL_LEVELS))
+    {
+        tick = p_wheel->now
+               + rplib_timer_wheel_granularity(RPLIB_TIMER_WHEEL_LEVELS) - 1;
+    }
+    slot = (tick >> (RPLIB_TIMER_WHEEL_BITS * level)) & RPLIB_TIMER_WHEEL_MASK;
+
+    // push front
+    pp_head         = &p_wheel->p_slots[level][slot];
+    p_node->p_next  = *pp_head;
+    p_node->pp_prev = pp_head;
+    if (NULL != *pp_head)
+    {
+        (*pp_head)->pp_prev = &p_node->p_next;
+    }
+    *pp_head = p_node;
+    p_wheel->num_timers++;
+}
+
+/**
+ * Move every timer of a slot down to the level (or slot) now covering it
+ * @param p_wheel Pointer to wheel
+ * @param level Level of slot
+ */
+static void
+rplib_timer_wheel_cascade(rplib_timer_wheel_t *p_wheel, size_t level)
+{
+    size_t              slot   = 0;
+    rplib_timer_node_t *p_node = NULL;
+
+    slot = (p_wheel->now >> (RPLIB_TIMER_WHEEL_BITS * level))
+           & RPLIB_TIMER_WHEEL_MASK;
+    while (NULL != (p_node = p_wheel->p_slots[level][slot]))
+    {
+        rplib_timer_wheel_cancel(p_wheel, p_node);
+        // may be due this very tick, slot is fired right after cascading
+        rplib_timer_wheel_place(p_wheel, p_node, p_wheel->now);
+    }
+}
+
+void
+rplib_timer_wheel_initialize(rplib_timer_wheel_t *p_wheel, uint64_t now)
+{
+    memset(p_wheel->p_slots, 0, sizeof(p_wheel->p_slots));
+    p_wheel->now        = now;
+    p_wheel->num_timers = 0;
+}
+
+void
+rplib_timer_node_initialize(rplib_timer_node_t *p_node)
+{
+    p_node->p_next  = NULL;
+    p_node->pp_prev = NULL;
+    p_node->expiry  = 0;
+}
+
+void
+rplib_timer_wheel_schedule(rplib_timer_wheel_t *p_wheel,
+                           rplib_timer_node_t  *p_node,
+                           uint64_t             expiry)
+{
+    rplib_timer_wheel_cancel(p_wheel, p_node);
+    p_node->expiry = expiry;
+    // current tick has already fired
+    rplib_timer_wheel_place(p_wheel, p_node, p_wheel->now + 1);
+}
+
+void
+rplib_timer_wheel_cancel(rplib_timer_wheel_t *p_wheel,
+                         rplib_timer_node_t  *p_node)
+{
+    if (NULL == p_node->pp_prev)
+    {
+        return;
+    }
+    *p_node->pp_prev = p_node->p_next;
+    if (NULL != p_node->p_next)
+    {
+        p_node->p_next->pp_prev = p_node->pp_prev;
+    }
+    p_node->p_next  = NULL;
+    p_node->pp_prev = NULL;
+    assert(0 < p_wheel->num_timers);
+    p_wheel->num_timers--;
+}
+
+size_t
+rplib_timer_wheel_advance(rplib_timer_wheel_t *p_wheel,
+                          uint64_t             now,
+                          rplib_timer_fn_t     p_fn,
+                          void                *p_arg)
+{
+    size_t              num_fired = 0;
+    size_t              level     = 0;
+    rplib_timer_node_t *p_node    = NULL;
+
+    assert(p_fn);
+    while (p_wheel->now < now)
+    {
+        // nothing can fire, skip straight to the target
+        if (0 == p_wheel->num_timers)
+        {
+            p_wheel->now = now;
+            break;
+        }
+        p_wheel->now++;
+        // bring due slots of upper levels down, highest first
+        for (level = RPLIB_TIMER_WHEEL_LEVELS - 1; 0 < level; level--)
+        {
+            if (0
+                == (p_wheel->now
+                    & (rplib_timer_wheel_granularity(level) - 1)))
+            {
+                rplib_timer_wheel_cascade(p_wheel, level);
+            }
+        }
+        // fire everything in the current slot
+        while (NULL
+               != (p_node = p_wheel->p_slots[0][p_wheel->now
+                                                & RPLIB_TIMER_WHEEL_MASK]))
+        {
+            rplib_timer_wheel_cancel(p_wheel, p_node);
+            p_fn(p_node, p_arg);
+            num_fired++;
+        }
+    }
+    return num_fired;
+}
+
+/*** end of file ***/
@@ -6,23 +6,286 @@
  * COPYRIGHT NOTICE: None
  */
 
+#define _GNU_SOURCE // CPU_SET, sched_getaffinity, pthread_attr_setaffinity_np
+
 #include "rplib_tpool.h"
 
 #include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RPLIB_TPOOL_COUNT_MASK  0xFFFFFFFFu // outstanding bits of a binding
+#define RPLIB_TPOOL_INDEX_SHIFT 32          // worker index bits of a binding
+#define RPLIB_TPOOL_NODE_PATH   "/sys/devices/system/node/node%d/cpulist"
+
+/**
+ * CPUs in the order workers of a pinned pool take them
+ */
+typedef struct
+{
+    int       cpus[CPU_SETSIZE];  // CPU of each position
+    int       nodes[CPU_SETSIZE]; // NUMA node of each, -1 if unknown
+    size_t    num_cpus;           // # positions filled
+    cpu_set_t allowed;            // CPUs the process may run on
+    cpu_set_t placed;             // CPUs given a position already
+} rplib_tpool_cpu_order_t;
+
+/**
+ * Helper function to allocate the slots of a ring, preferably from the memory
+ * of a NUMA node
+ * @param p_queue Pointer to queue owning the ring
+ * @param capacity Number of slots in ring
+ * @param node NUMA node to place slots on, -1 for anywhere
+ * @return Pointer to zeroed slots; NULL on failure
+ */
+static rplib_tpool_slot_t *
+rplib_tpool_queue_alloc_slots(rplib_tpool_queue_t *p_queue,
+                              size_t               capacity,
+                              int                  node)
+{
+    void         *p_slots   = NULL;
+    size_t        sz_slots  = capacity * sizeof(rplib_tpool_slot_t);
+    unsigned long node_mask = 0; // nodes slots may be placed on
+
+    p_queue->sz_mapped = 0;
+    if (0 > node || (int)(sizeof(node_mask) * 8) <= node + 1)
+    {
+        return calloc(capacity, sizeof(rplib_tpool_slot_t));
+    }
+    // mapped rather than taken from the heap, so no page is touched before
+    // the policy is set
+    p_slots = mmap(NULL,
+                   sz_slots,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS,
+                   -1,
+                   0);
+    if (MAP_FAILED == p_slots)
+    {
+        return NULL;
+    }
+    p_queue->sz_mapped = sz_slots;
+    // only a preference, the ring works wherever its pages land
+    node_mask = 1UL << node;
+    syscall(SYS_mbind,
+            p_slots,
+            sz_slots,
+            MPOL_PREFERRED,
+            &node_mask,
+            sizeof(node_mask) * 8,
+            0);
+    return p_slots;
+}
+
+/**
+ * Initialize a task queue
+ * @param p_queue Pointer to queue to initialize
+ * @param capacity Number of slots in ring (power of two)
+ * @param node NUMA node to place ring on, -1 for anywhere
+ * @return RPLIB_SUCCESS on success; RPLIB_UNSUCCESS otherwise
+ */
+static int
+rplib_tpool_queue_initialize(rplib_tpool_queue_t *p_queue,
+                             size_t               capacity,
+                             int                  node)
+{
+    int    res        = RPLIB_UNSUCCESS;
+    size_t slot_index = 0;
+
+    assert(0 == (capacity & (capacity - 1)));
+    atomic_init(&p_queue->num_overflow, 0);
+    atomic_init(&p_queue->num_pending, 0);
+    atomic_init(&p_queue->ring.enqueue_pos, 0);
+    atomic_init(&p_queue->ring.dequeue_pos, 0);
+    p_queue->ring.ring_mask = capacity - 1;
+    p_queue->ring.p_slots
+        = rplib_tpool_queue_alloc_slots(p_queue, capacity, node);
+    p_queue->p_overflow = rplib_ll_queue_create();
+    if (!p_queue->ring.p_slots || !p_queue->p_overflow)
+    {
+        goto leave;
+    }
+    // each slot starts out ready for the first lap
+    for (slot_index = 0; slot_index < capacity; slot_index++)
+    {
+        atomic_init(&p_queue->ring.p_slots[slot_index].sequence, slot_index);
+    }
+    if (0 != pthread_mutex_init(&p_queue->mutex_overflow, NULL))
+    {
+        goto leave;
+    }
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+/**
+ * Release resources held by a task queue. Tasks still queued are dropped
+ * @param p_queue Pointer to queue to destroy
+ * @return RPLIB_SUCCESS on no issues; otherwise RPLIB_UNSUCCESS
+ */
+static int
+rplib_tpool_queue_destroy(rplib_tpool_queue_t *p_queue)
+{
+    int res = RPLIB_SUCCESS;
+
+    pthread_mutex_destroy(&p_queue->mutex_overflow);
+    if (NULL != p_queue->p_overflow)
+    {
+        res                 = rplib_ll_queue_destroy(p_queue->p_overflow);
+        p_queue->p_overflow = NULL;
+    }
+    if (0 < p_queue->sz_mapped)
+    {
+        munmap(p_queue->ring.p_slots, p_queue->sz_mapped);
+    }
+    else
+    {
+        free(p_queue->ring.p_slots);
+    }
+    p_queue->ring.p_slots = NULL;
+    return res;
+}
+
+/**
+ * Helper function to append the allowed CPUs of a NUMA node to an order
+ * @param p_order Pointer to order to extend
+ * @param node NUMA node to look up; skipped if the system has none by that id
+ */
+static void
+rplib_tpool_order_node(rplib_tpool_cpu_order_t *p_order, int node)
+{
+    char  path[64];   // sysfs listing of node's CPUs
+    char  list[4096]; // CPU ranges such as "0-3,8-11"
+    char *p_next = list;
+    FILE *p_file = NULL;
+    long  first  = 0; // first CPU of a range
+    long  last   = 0; // last CPU of a range
+
+    snprintf(path, sizeof(path), RPLIB_TPOOL_NODE_PATH, node);
+    p_file = fopen(path, "r");
+    if (NULL == p_file)
+    {
+        return;
+    }
+    if (NULL == fgets(list, sizeof(list), p_file))
+    {
+        list[0] = '\0';
+    }
+    fclose(p_file);
+    while (isdigit((unsigned char)*p_next))
+    {
+        first = strtol(p_next, &p_next, 10);
+        last  = first;
+        if ('-' == *p_next)
+        {
+            last = strtol(p_next + 1, &p_next, 10);
+        }
+        for (; first <= last && CPU_SETSIZE > first; first++)
+        {
+            if (CPU_ISSET(first, &p_order->allowed)
+                && !CPU_ISSET(first, &p_order->placed))
+            {
+                CPU_SET(first, &p_order->placed);
+                p_order->cpus[p_order->num_cpus]  = (int)first;
+                p_order->nodes[p_order->num_cpus] = node;
+                p_order->num_cpus++;
+            }
+        }
+        if (',' == *p_next)
+        {
+            p_next++;
+        }
+    }
+}
+
+/**
+ * Helper function to pick the CPU of each worker of a pinned pool, among the
+ * CPUs the process may run on. CPUs are taken a NUMA node at a time, so a
+ * pool no larger than a node stays on it; workers past the number of CPUs
+ * share them in the same order
+ * @param p_tpool Pointer to threadpool object, workers allocated
+ */
+static void
+rplib_tpool_place_workers(rplib_tpool_t *p_tpool)
+{
+    rplib_tpool_cpu_order_t *p_order      = NULL;
+    size_t                   worker_index = 0;
+    size_t                   position     = 0;
+    int                      node         = 0;
+    int                      cpu          = 0;
+
+    p_order = calloc(1, sizeof(rplib_tpool_cpu_order_t));
+    // workers are left unpinned
+    if (NULL == p_order
+        || 0
+               != sched_getaffinity(
+                   0, sizeof(p_order->allowed), &p_order->allowed))
+    {
+        goto leave;
+    }
+    for (node = 0; node < RPLIB_TPOOL_MAX_NODES; node++)
+    {
+        rplib_tpool_order_node(p_order, node);
+    }
+    // CPUs of no node, e.g. without sysfs
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &p_order->allowed)
+            && !CPU_ISSET(cpu, &p_order->placed))
+        {
+            p_order->cpus[p_order->num_cpus]  = cpu;
+            p_order->nodes[p_order->num_cpus] = -1;
+            p_order->num_cpus++;
+        }
+    }
+    for (worker_index = 0;
+         0 < p_order->num_cpus && worker_index < p_tpool->num_threads;
+         worker_index++)
+    {
+        position = worker_index % p_order->num_cpus;
+        p_tpool->p_workers[worker_index].cpu  = p_order->cpus[position];
+        p_tpool->p_workers[worker_index].node = p_order->nodes[position];
+    }
+leave:
+    free(p_order);
+}
 
 rplib_tpool_t *
 rplib_tpool_create(size_t num_threads)
+{
+    return rplib_tpool_create_adaptive(num_threads, num_threads, false);
+}
+
+rplib_tpool_t *
+rplib_tpool_create_adaptive(size_t min_threads,
+                            size_t max_threads,
+                            bool   b_pin)
 {
     rplib_tpool_t *p_tpool = NULL;
-    // allocate
-    p_tpool = malloc(sizeof(rplib_tpool_t));
+    // allocate (aligned so ring cursors sit on their own cache lines)
+    p_tpool = aligned_alloc(RPLIB_TPOOL_CACHE_LINE, sizeof(rplib_tpool_t));
     if (!p_tpool)
     {
         goto leave;
     }
     // init
-    rplib_tpool_initialize(p_tpool, num_threads);
+    if (RPLIB_SUCCESS
+        != rplib_tpool_initialize_adaptive(
+            p_tpool, min_threads, max_threads, b_pin))
+    {
+        free(p_tpool);
+        p_tpool = NULL;
+    }
 leave:
     return p_tpool;
 }
@@ -30,16 +293,75 @@ leave:
 int
 rplib_tpool_initialize(rplib_tpool_t *p_tpool, size_t num_threads)
 {
-    int res = RPLIB_UNSUCCESS;
+    return rplib_tpool_initialize_adaptive(
+        p_tpool, num_threads, num_threads, false);
+}
+
+int
+rplib_tpool_initialize_adaptive(rplib_tpool_t *p_tpool,
+                                size_t         min_threads,
+                                size_t         max_threads,
+                                bool           b_pin)
+{
+    int                   res          = RPLIB_UNSUCCESS;
+    size_t                worker_index = 0;
+    size_t                num_threads  = max_threads;
+    rplib_tpool_worker_t *p_worker     = NULL;
     // asserts
     assert(p_tpool);
-    assert(num_threads > 0);
+    assert(min_threads > 0);
+    assert(max_threads >= min_threads);
     // set fields
-    p_tpool->num_threads       = num_threads;
-    p_tpool->num_threads_busy  = 0;
-    p_tpool->num_threads_alive = 0;
-    p_tpool->p_queue_tasks     = rplib_ll_queue_create();
-    p_tpool->p_thread_buf      = calloc(num_threads, sizeof(pthread_t));
+    p_tpool->num_threads = num_threads;
+    p_tpool->min_threads = min_threads;
+    atomic_init(&p_tpool->num_threads_active, 0);
+    atomic_init(&p_tpool->num_grown, 0);
+    atomic_init(&p_tpool->num_shrunk, 0);
+    atomic_init(&p_tpool->num_threads_busy, 0);
+    atomic_init(&p_tpool->num_threads_alive, 0);
+    atomic_init(&p_tpool->num_threads_sleeping, 0);
+    atomic_init(&p_tpool->num_tasks_pending, 0);
+    if (RPLIB_SUCCESS
+        != rplib_tpool_queue_initialize(
+            &p_tpool->queue_shared, RPLIB_TPOOL_RING_CAPACITY, -1))
+    {
+        goto leave;
+    }
+    p_tpool->p_thread_buf = calloc(num_threads, sizeof(pthread_t));
+    p_tpool->p_workers    = aligned_alloc(
+        RPLIB_TPOOL_CACHE_LINE, num_threads * sizeof(rplib_tpool_worker_t));
+    if (!p_tpool->p_thread_buf || !p_tpool->p_workers)
+    {
+        goto leave;
+    }
+    for (worker_index = 0; worker_index < num_threads; worker_index++)
+    {
+        p_worker             = &p_tpool->p_workers[worker_index];
+        p_worker->p_tpool    = p_tpool;
+        p_worker->index      = worker_index;
+        p_worker->b_started  = false;
+        p_worker->cpu        = -1;
+        p_worker->node       = -1;
+        atomic_init(&p_worker->b_sleeping, false);
+        atomic_init(&p_worker->b_parked, false);
+    }
+    if (b_pin)
+    {
+        rplib_tpool_place_workers(p_tpool);
+    }
+    // per-worker queues, on the node of their worker
+    for (worker_index = 0; worker_index < num_threads; worker_index++)
+    {
+        p_worker = &p_tpool->p_workers[worker_index];
+        if (RPLIB_SUCCESS
+                != rplib_tpool_queue_initialize(&p_worker->queue,
+                                                RPLIB_TPOOL_LOCAL_CAPACITY,
+                                                p_worker->node)
+            || 0 != pthread_cond_init(&p_worker->cond_worker, NULL))
+        {
+            goto leave;
+        }
+    }
 
     atomic_store(&p_tpool->b_terminate, false);
 
@@ -47,7 +369,7 @@ rplib_tpool_initialize(rplib_tpool_t *p_tpool, size_t num_threads)
     // initialize pthread specific objects
     if (0 != pthread_mutex_init(&(p_tpool->mutex_task_queue), NULL)
         || 0 != pthread_mutex_init(&(p_tpool->mutex_thrd_count), NULL)
-        || 0 != pthread_cond_init(&(p_tpool->cond_task_queue), NULL)
+        || 0 != pthread_mutex_init(&(p_tpool->mutex_grow), NULL)
         || 0 != pthread_cond_init(&(p_tpool->cond_threads_idle), NULL))
     {
         goto leave;
@@ -69,25 +391,44 @@ rplib_tpool_destroy(rplib_tpool_t *p_tpool, bool b_shutdown_immediate)
         rplib_tpool_wait(p_tpool);
     }
 
-    // set termination flag and tell all threads to wake up
+    // set termination flag and tell all threads to wake up. Nothing starts
+    // a worker once set
+    pthread_mutex_lock(&p_tpool->mutex_grow);
+    pthread_mutex_lock(&p_tpool->mutex_task_queue);
     atomic_store(&(p_tpool->b_terminate), 1);
-    pthread_cond_broadcast(&p_tpool->cond_task_queue);
+    for (thread_index = 0; thread_index < p_tpool->num_threads;
+         thread_index++)
+    {
+        pthread_cond_signal(&p_tpool->p_workers[thread_index].cond_worker);
+    }
+    pthread_mutex_unlock(&p_tpool->mutex_task_queue);
+    pthread_mutex_unlock(&p_tpool->mutex_grow);
 
-    // join threads
+    // join threads, parked ones included; workers never added have none
     for (thread_index = 0; thread_index < p_tpool->num_threads;
          thread_index++)
     {
-        pthread_join(p_tpool->p_thread_buf[thread_index], NULL);
+        if (p_tpool->p_workers[thread_index].b_started)
+        {
+            pthread_join(p_tpool->p_thread_buf[thread_index], NULL);
+        }
     }
 
     // destroy mutexes
     pthread_mutex_destroy(&(p_tpool->mutex_task_queue));
     pthread_mutex_destroy(&(p_tpool->mutex_thrd_count));
-    pthread_cond_destroy(&(p_tpool->cond_task_queue));
+    pthread_mutex_destroy(&(p_tpool->mutex_grow));
     pthread_cond_destroy(&(p_tpool->cond_threads_idle));
     // destroy tasks
-    res = rplib_ll_queue_destroy(p_tpool->p_queue_tasks);
+    for (thread_index = 0; thread_index < p_tpool->num_threads;
+         thread_index++)
+    {
+        pthread_cond_destroy(&p_tpool->p_workers[thread_index].cond_worker);
+        rplib_tpool_queue_destroy(&p_tpool->p_workers[thread_index].queue);
+    }
+    res = rplib_tpool_queue_destroy(&p_tpool->queue_shared);
     // destroy threadbuf
+    free(p_tpool->p_workers);
     free(p_tpool->p_thread_buf);
     // destroy tpool
     free(p_tpool);
@@ -95,6 +436,436 @@ rplib_tpool_destroy(rplib_tpool_t *p_tpool, bool b_shutdown_immediate)
     return res;
 }
 
+/**
+ * Attempt to place a task in a ring without blocking
+ * @param p_ring Pointer to ring
+ * @param p_task Pointer to task to copy into ring
+ * @return true if stored, false if ring is full
+ */
+static bool
+rplib_tpool_ring_push(rplib_tpool_ring_t *p_ring, rplib_tpool_task_t *p_task)
+{
+    rplib_tpool_slot_t *p_slot   = NULL;
+    size_t              pos      = 0;
+    size_t              sequence = 0;
+    intptr_t            diff     = 0; // how far slot is from being ready
+
+    pos = atomic_load_explicit(&p_ring->enqueue_pos, memory_order_relaxed);
+    for (;;)
+    {
+        p_slot = &p_ring->p_slots[pos & p_ring->ring_mask];
+        sequence
+            = atomic_load_explicit(&p_slot->sequence, memory_order_acquire);
+        diff = (intptr_t)sequence - (intptr_t)pos;
+        // slot free on this lap, try to claim it
+        if (0 == diff)
+        {
+            if (atomic_compare_exchange_weak_explicit(&p_ring->enqueue_pos,
+                                                      &pos,
+                                                      pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        // slot still holds a task from the previous lap, ring is full
+        else if (0 > diff)
+        {
+            return false;
+        }
+        // another producer got here first
+        else
+        {
+            pos = atomic_load_explicit(&p_ring->enqueue_pos,
+                                       memory_order_relaxed);
+        }
+    }
+    p_slot->task = *p_task;
+    // publish to consumers
+    atomic_store_explicit(&p_slot->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * Attempt to take a task from a ring without blocking
+ * @param p_ring Pointer to ring
+ * @param p_task Pointer to task object to store result in
+ * @return true if a task was taken, false if ring is empty
+ */
+static bool
+rplib_tpool_ring_pop(rplib_tpool_ring_t *p_ring, rplib_tpool_task_t *p_task)
+{
+    rplib_tpool_slot_t *p_slot   = NULL;
+    size_t              pos      = 0;
+    size_t              sequence = 0;
+    intptr_t            diff     = 0; // how far slot is from being filled
+
+    pos = atomic_load_explicit(&p_ring->dequeue_pos, memory_order_relaxed);
+    for (;;)
+    {
+        p_slot = &p_ring->p_slots[pos & p_ring->ring_mask];
+        sequence
+            = atomic_load_explicit(&p_slot->sequence, memory_order_acquire);
+        diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+        // slot filled on this lap, try to claim it
+        if (0 == diff)
+        {
+            if (atomic_compare_exchange_weak_explicit(&p_ring->dequeue_pos,
+                                                      &pos,
+                                                      pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        // nothing published here yet, ring is empty
+        else if (0 > diff)
+        {
+            return false;
+        }
+        // another consumer got here first
+        else
+        {
+            pos = atomic_load_explicit(&p_ring->dequeue_pos,
+                                       memory_order_relaxed);
+        }
+    }
+    *p_task = p_slot->task;
+    // hand slot back to producers for the next lap
+    atomic_store_explicit(
+        &p_slot->sequence, pos + p_ring->ring_mask + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * Add a task to a queue. Goes in the ring if it fits and nothing has spilled
+ * over, so spilled tasks still run first
+ * @param p_queue Pointer to queue
+ * @param p_task Pointer to task to copy into queue
+ * @return RPLIB_SUCCESS on success; otherwise RPLIB_UNSUCCESS
+ */
+static int
+rplib_tpool_queue_push(rplib_tpool_queue_t *p_queue,
+                       rplib_tpool_task_t  *p_task)
+{
+    int res = RPLIB_SUCCESS;
+
+    // count first so pending never undercounts what a consumer can see
+    atomic_fetch_add(&p_queue->num_pending, 1);
+    if (0 == atomic_load(&p_queue->num_overflow)
+        && rplib_tpool_ring_push(&p_queue->ring, p_task))
+    {
+        goto leave;
+    }
+    // ring full, spill to locked overflow list
+    pthread_mutex_lock(&p_queue->mutex_overflow);
+    if (NULL
+        == rplib_ll_queue_enqueue(
+            p_queue->p_overflow, p_task, sizeof(rplib_tpool_task_t)))
+    {
+        atomic_fetch_sub(&p_queue->num_pending, 1);
+        res = RPLIB_UNSUCCESS;
+    }
+    else
+    {
+        atomic_fetch_add(&p_queue->num_overflow, 1);
+    }
+    pthread_mutex_unlock(&p_queue->mutex_overflow);
+leave:
+    return res;
+}
+
+/**
+ * Take the next task from a queue, from the ring or else the overflow list
+ * @param p_queue Pointer to queue
+ * @param p_task Pointer to task object to store result in
+ * @return true if a task was taken, false if none are queued
+ */
+static bool
+rplib_tpool_queue_pop(rplib_tpool_queue_t *p_queue,
+                      rplib_tpool_task_t  *p_task)
+{
+    bool res = false;
+
+    if (rplib_tpool_ring_pop(&p_queue->ring, p_task))
+    {
+        res = true;
+        goto leave;
+    }
+    // only touch the lock if something spilled over
+    if (0 == atomic_load(&p_queue->num_overflow))
+    {
+        goto leave;
+    }
+    pthread_mutex_lock(&p_queue->mutex_overflow);
+    if (0 < p_queue->p_overflow->size)
+    {
+        *p_task = *(rplib_tpool_task_t *)p_queue->p_overflow->p_front->p_data;
+        rplib_ll_queue_dequeue(p_queue->p_overflow);
+        atomic_fetch_sub(&p_queue->num_overflow, 1);
+        res = true;
+    }
+    pthread_mutex_unlock(&p_queue->mutex_overflow);
+leave:
+    if (res)
+    {
+        atomic_fetch_sub(&p_queue->num_pending, 1);
+    }
+    return res;
+}
+
+/**
+ * Helper function to wake `rplib_tpool_wait` once no thread is busy and no
+ * task is queued
+ * @param p_tpool Pointer to threadpool object
+ */
+static void
+rplib_tpool_signal_idle(rplib_tpool_t *p_tpool)
+{
+    if (0 == atomic_load(&p_tpool->num_threads_busy)
+        && 0 == atomic_load(&p_tpool->num_tasks_pending))
+    {
+        pthread_mutex_lock(&p_tpool->mutex_thrd_count);
+        pthread_cond_broadcast(&p_tpool->cond_threads_idle);
+        pthread_mutex_unlock(&p_tpool->mutex_thrd_count);
+    }
+}
+
+/**
+ * Helper function to wake a sleeping worker after a task was queued. Waking
+ * claims the worker, so back to back wakeups go to different sleepers
+ * @param p_tpool Pointer to threadpool object
+ * @param p_worker Pointer to worker task was bound to; NULL to wake any
+ */
+static void
+rplib_tpool_wake(rplib_tpool_t *p_tpool, rplib_tpool_worker_t *p_worker)
+{
+    size_t worker_index = 0;
+
+    // only touch the lock if someone is asleep
+    if (0 == atomic_load(&p_tpool->num_threads_sleeping)
+        || (NULL != p_worker && !atomic_load(&p_worker->b_sleeping)))
+    {
+        return;
+    }
+    pthread_mutex_lock(&p_tpool->mutex_task_queue);
+    // any worker can run shared tasks, find one asleep
+    for (worker_index = 0; NULL == p_worker; worker_index++)
+    {
+        if (worker_index == p_tpool->num_threads)
+        {
+            goto leave;
+        }
+        if (atomic_load(&p_tpool->p_workers[worker_index].b_sleeping))
+        {
+            p_worker = &p_tpool->p_workers[worker_index];
+        }
+    }
+    if (atomic_exchange(&p_worker->b_sleeping, false))
+    {
+        pthread_cond_signal(&p_worker->cond_worker);
+    }
+leave:
+    pthread_mutex_unlock(&p_tpool->mutex_task_queue);
+}
+
+/**
+ * Helper function to wake up to `count` sleeping workers after shared tasks
+ * were queued, taking the lock once
+ * @param p_tpool Pointer to threadpool object
+ * @param count Maximum number of workers to wake
+ */
+static void
+rplib_tpool_wake_shared(rplib_tpool_t *p_tpool, size_t count)
+{
+    size_t                worker_index = 0;
+    rplib_tpool_worker_t *p_worker     = NULL;
+
+    // only touch the lock if someone is asleep
+    if (0 == count || 0 == atomic_load(&p_tpool->num_threads_sleeping))
+    {
+        return;
+    }
+    pthread_mutex_lock(&p_tpool->mutex_task_queue);
+    for (worker_index = 0; 0 < count && worker_index < p_tpool->num_threads;
+         worker_index++)
+    {
+        p_worker = &p_tpool->p_workers[worker_index];
+        if (atomic_exchange(&p_worker->b_sleeping, false))
+        {
+            pthread_cond_signal(&p_worker->cond_worker);
+            count--;
+        }
+    }
+    pthread_mutex_unlock(&p_tpool->mutex_task_queue);
+}
+
+/**
+ * Helper function to pass `rplib_tpool_thread_do` using func signature
+ * required for `pthread_create`
+ * @param p_worker Pointer to `rplib_tpool_worker_t`
+ * @return NULL, always
+ */
+static void *
+rplib_tpool_thread_start(void *p_worker)
+{
+    rplib_tpool_thread_do((rplib_tpool_worker_t *)p_worker);
+    return NULL;
+}
+
+/**
+ * Helper function to put a worker to use, creating its thread the first time
+ * and waking it from parking afterwards
+ * \nNote: Caller must hold `mutex_grow`
+ * @param p_tpool Pointer to threadpool object
+ * @param p_worker Pointer to worker to add, counted as active already
+ * @return RPLIB_SUCCESS if the worker runs; otherwise RPLIB_UNSUCCESS
+ */
+static int
+rplib_tpool_spawn(rplib_tpool_t *p_tpool, rplib_tpool_worker_t *p_worker)
+{
+    int            res = RPLIB_SUCCESS;
+    pthread_attr_t attr;
+    cpu_set_t      cpu_set; // CPU of a pinned worker
+
+    // a parked thread sees itself active again once signaled
+    if (p_worker->b_started)
+    {
+        pthread_mutex_lock(&p_tpool->mutex_task_queue);
+        pthread_cond_signal(&p_worker->cond_worker);
+        pthread_mutex_unlock(&p_tpool->mutex_task_queue);
+        goto leave;
+    }
+    if (0 != pthread_attr_init(&attr))
+    {
+        res = RPLIB_UNSUCCESS;
+        goto leave;
+    }
+    // runs on its CPU from the first instruction
+    if (0 <= p_worker->cpu)
+    {
+        CPU_ZERO(&cpu_set);
+        CPU_SET(p_worker->cpu, &cpu_set);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set), &cpu_set);
+    }
+    if (0
+        != pthread_create(&(p_tpool->p_thread_buf[p_worker->index]),
+                          &attr,
+                          rplib_tpool_thread_start,
+                          (void *)p_worker))
+    {
+        RPLIB_DEBUG_PRINTF("Error: %s\n", "TPOOL THREAD CREATE");
+        res = RPLIB_UNSUCCESS;
+    }
+    else
+    {
+        p_worker->b_started = true;
+        RPLIB_DEBUG_PRINTF("Notice: %s #%zu %s\n",
+                           "TPOOL THREAD",
+                           p_worker->index,
+                           "started.");
+    }
+    pthread_attr_destroy(&attr);
+leave:
+    return res;
+}
+
+/**
+ * Helper function to add another worker after shared tasks were queued, if
+ * none is asleep and more than RPLIB_TPOOL_GROW_DEPTH tasks per active
+ * worker wait
+ * @param p_tpool Pointer to threadpool object
+ */
+static void
+rplib_tpool_grow(rplib_tpool_t *p_tpool)
+{
+    size_t num_active = atomic_load(&p_tpool->num_threads_active);
+
+    // not started, already at most, or someone can take the tasks anyway
+    if (0 == num_active || p_tpool->num_threads == num_active
+        || 0 != atomic_load(&p_tpool->num_threads_sleeping)
+        || RPLIB_TPOOL_GROW_DEPTH * num_active
+               >= atomic_load(&p_tpool->num_tasks_pending))
+    {
+        return;
+    }
+    // whoever holds the lock is resizing already
+    if (0 != pthread_mutex_trylock(&p_tpool->mutex_grow))
+    {
+        return;
+    }
+    num_active = atomic_load(&p_tpool->num_threads_active);
+    if (p_tpool->num_threads > num_active
+        && !atomic_load(&p_tpool->b_terminate))
+    {
+        // active first, so a parked worker leaves its wait when signaled
+        atomic_store(&p_tpool->num_threads_active, num_active + 1);
+        if (RPLIB_SUCCESS
+            == rplib_tpool_spawn(p_tpool, &p_tpool->p_workers[num_active]))
+        {
+            atomic_fetch_add(&p_tpool->num_grown, 1);
+        }
+        else
+        {
+            atomic_store(&p_tpool->num_threads_active, num_active);
+        }
+    }
+    pthread_mutex_unlock(&p_tpool->mutex_grow);
+}
+
+/**
+ * Helper function for the last active worker once it idled, to decide
+ * whether it parks. It does while more than `min_threads` are active
+ * @param p_worker Pointer to worker state of calling thread
+ * @return true if the worker is to park
+ */
+static bool
+rplib_tpool_retire(rplib_tpool_worker_t *p_worker)
+{
+    rplib_tpool_t *p_tpool    = p_worker->p_tpool;
+    bool           res        = false;
+    size_t         num_active = 0;
+
+    pthread_mutex_lock(&p_tpool->mutex_grow);
+    num_active = atomic_load(&p_tpool->num_threads_active);
+    if (p_worker->index + 1 == num_active
+        && p_tpool->min_threads < num_active)
+    {
+        atomic_store(&p_tpool->num_threads_active, num_active - 1);
+        atomic_fetch_add(&p_tpool->num_shrunk, 1);
+        res = true;
+    }
+    pthread_mutex_unlock(&p_tpool->mutex_grow);
+    return res;
+}
+
+/**
+ * Helper function to wait while a worker is parked. Tasks bound to it before
+ * it was parked, or since, still run
+ * @param p_worker Pointer to worker state of calling thread
+ */
+static void
+rplib_tpool_park(rplib_tpool_worker_t *p_worker)
+{
+    rplib_tpool_t *p_tpool = p_worker->p_tpool;
+
+    // announcing before checking pairs with an affine enqueue pushing before
+    // checking for parked workers, like sleeping does
+    atomic_store(&p_worker->b_parked, true);
+    pthread_mutex_lock(&p_tpool->mutex_task_queue);
+    while (p_worker->index >= atomic_load(&p_tpool->num_threads_active)
+           && 0 == atomic_load(&p_worker->queue.num_pending)
+           && !atomic_load(&(p_tpool->b_terminate)))
+    {
+        pthread_cond_wait(&p_worker->cond_worker,
+                          &(p_tpool->mutex_task_queue));
+    }
+    atomic_store(&p_worker->b_parked, false);
+    pthread_mutex_unlock(&p_tpool->mutex_task_queue);
+}
+
 int
 rplib_tpool_enqueue_task(rplib_tpool_t *p_tpool,
                          void (*p_function)(void *p_arg),
@@ -103,145 +874,293 @@ rplib_tpool_enqueue_task(rplib_tpool_t *p_tpool,
     int                res = RPLIB_UNSUCCESS;
     rplib_tpool_task_t new_task; // new task to add to tpool
 
-    // acquire lock
-    pthread_mutex_lock(&(p_tpool->mutex_task_queue));
     // create task
     new_task.p_arg      = p_arg;
     new_task.p_function = p_function;
     // add to queue
-    res = NULL
-          != rplib_ll_queue_enqueue(
-              p_tpool->p_queue_tasks, &new_task, sizeof(rplib_tpool_task_t));
-    if (!res)
+    atomic_fetch_add(&p_tpool->num_tasks_pending, 1);
+    if (RPLIB_SUCCESS
+        != rplib_tpool_queue_push(&p_tpool->queue_shared, &new_task))
     {
+        atomic_fetch_sub(&p_tpool->num_tasks_pending, 1);
         RPLIB_DEBUG_PRINTF("Error: %s\n", "TPOOL ENQUEUE");
         goto leave;
     }
-    // signal that new job available
-    pthread_cond_signal(&(p_tpool->cond_task_queue));
-    // unlock
-    pthread_mutex_unlock(&(p_tpool->mutex_task_queue));
+    // signal that new job available, or add a worker if all are busy
+    rplib_tpool_wake(p_tpool, NULL);
+    rplib_tpool_grow(p_tpool);
     res = RPLIB_SUCCESS;
 leave:
     return res;
 }
 
+size_t
+rplib_tpool_enqueue_batch(rplib_tpool_t      *p_tpool,
+                          rplib_tpool_task_t *p_tasks,
+                          size_t              num_tasks)
+{
+    size_t num_queued = 0;
+
+    // count first, as for single tasks
+    atomic_fetch_add(&p_tpool->num_tasks_pending, num_tasks);
+    for (num_queued = 0; num_queued < num_tasks; num_queued++)
+    {
+        if (RPLIB_SUCCESS
+            != rplib_tpool_queue_push(&p_tpool->queue_shared,
+                                      &p_tasks[num_queued]))
+        {
+            RPLIB_DEBUG_PRINTF("Error: %s\n", "TPOOL ENQUEUE");
+            break;
+        }
+    }
+    atomic_fetch_sub(&p_tpool->num_tasks_pending, num_tasks - num_queued);
+    // signal that new jobs available, or add a worker if all are busy
+    rplib_tpool_wake_shared(p_tpool, num_queued);
+    rplib_tpool_grow(p_tpool);
+    return num_queued;
+}
+
 void
-rplib_tpool_thread_do(rplib_tpool_t *p_tpool)
+rplib_tpool_affinity_initialize(rplib_tpool_affinity_t *p_affinity,
+                                size_t                  key)
 {
-    void (*p_function)(void *p_arg) = NULL; // generic ptr to func to run
-    void *p_arg                     = NULL; // generic ptr to arg for func
+    atomic_init(&p_affinity->binding, 0);
+    p_affinity->key = key;
+}
 
-    // if launched, we're alive
-    pthread_mutex_lock(&p_tpool->mutex_thrd_count);
-    p_tpool->num_threads_alive++;
-    pthread_mutex_unlock(&p_tpool->mutex_thrd_count);
+/**
+ * Helper function to pick the worker an idle affinity binding is bound to
+ * @param p_tpool Pointer to threadpool object
+ * @param p_affinity Pointer to affinity object
+ * @return Index of chosen worker
+ */
+static size_t
+rplib_tpool_affinity_choose(rplib_tpool_t          *p_tpool,
+                            rplib_tpool_affinity_t *p_affinity)
+{
+    size_t num_active      = atomic_load(&p_tpool->num_threads_active);
+    size_t preferred       = 0;
+    size_t preferred_depth = 0;
+    size_t least_loaded    = 0;
+    size_t least_depth     = 0;
+    size_t worker_index    = 0;
+    size_t depth           = 0;
 
-    for (;;)
+    // bindings made before start go to the workers it starts
+    num_active   = 0 == num_active ? p_tpool->min_threads : num_active;
+    preferred    = p_affinity->key % num_active;
+    least_loaded = preferred;
+    preferred_depth
+        = atomic_load(&p_tpool->p_workers[preferred].queue.num_pending);
+    least_depth = preferred_depth;
+    // stay put unless preferred worker is noticeably backed up
+    if (RPLIB_TPOOL_REBALANCE_SLACK >= preferred_depth)
+    {
+        goto leave;
+    }
+    for (worker_index = 0; worker_index < num_active; worker_index++)
+    {
+        depth = atomic_load(
+            &p_tpool->p_workers[worker_index].queue.num_pending);
+        if (depth < least_depth)
+        {
+            least_depth  = depth;
+            least_loaded = worker_index;
+        }
+    }
+    if (least_depth + RPLIB_TPOOL_REBALANCE_SLACK >= preferred_depth)
     {
+        least_loaded = preferred;
+    }
+leave:
+    return least_loaded;
+}
 
-        // update working threadcount
-        pthread_mutex_lock(&p_tpool->mutex_thrd_count);
-        p_tpool->num_threads_busy++;
-        pthread_mutex_unlock(&p_tpool->mutex_thrd_count);
+int
+rplib_tpool_enqueue_affine(rplib_tpool_t          *p_tpool,
+                           rplib_tpool_affinity_t *p_affinity,
+                           void (*p_function)(void *p_arg),
+                           void *p_arg)
+{
+    int                   res          = RPLIB_UNSUCCESS;
+    uint_fast64_t         binding      = 0; // bound worker and outstanding
+    uint_fast64_t         new_binding  = 0; // binding including this task
+    size_t                worker_index = 0;
+    rplib_tpool_worker_t *p_worker     = NULL;
+    rplib_tpool_task_t    new_task; // new task to add to tpool
 
-        // acquire lock on queue (or attempt to lock until we can)
-        pthread_mutex_lock(&(p_tpool->mutex_task_queue));
-        // wait until signaled for new job
-        while (p_tpool->p_queue_tasks->size == 0
-               && !atomic_load(&(p_tpool->b_terminate)))
+    // join current binding, or pick a worker if nothing is outstanding.
+    // Moving only while idle keeps tasks of a binding from running at once
+    binding = atomic_load_explicit(&p_affinity->binding, memory_order_acquire);
+    do
+    {
+        if (0 == (binding & RPLIB_TPOOL_COUNT_MASK))
+        {
+            worker_index = rplib_tpool_affinity_choose(p_tpool, p_affinity);
+            new_binding
+                = ((uint_fast64_t)worker_index << RPLIB_TPOOL_INDEX_SHIFT) | 1;
+        }
+        else
+        {
+            new_binding = binding + 1;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&p_affinity->binding,
+                                                    &binding,
+                                                    new_binding,
+                                                    memory_order_acq_rel,
+                                                    memory_order_acquire));
+    p_worker = &p_tpool->p_workers[new_binding >> RPLIB_TPOOL_INDEX_SHIFT];
+
+    // create task
+    new_task.p_arg      = p_arg;
+    new_task.p_function = p_function;
+    // add to bound worker's queue
+    atomic_fetch_add(&p_tpool->num_tasks_pending, 1);
+    if (RPLIB_SUCCESS != rplib_tpool_queue_push(&p_worker->queue, &new_task))
+    {
+        atomic_fetch_sub(&p_tpool->num_tasks_pending, 1);
+        rplib_tpool_affinity_release(p_affinity);
+        RPLIB_DEBUG_PRINTF("Error: %s\n", "TPOOL ENQUEUE");
+        goto leave;
+    }
+    // signal that new job available, also to a parked worker
+    rplib_tpool_wake(p_tpool, p_worker);
+    if (atomic_load(&p_worker->b_parked))
+    {
+        pthread_mutex_lock(&p_tpool->mutex_task_queue);
+        pthread_cond_signal(&p_worker->cond_worker);
+        pthread_mutex_unlock(&p_tpool->mutex_task_queue);
+    }
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+void
+rplib_tpool_affinity_release(rplib_tpool_affinity_t *p_affinity)
+{
+    // release so whichever worker is bound next sees this task's writes
+    atomic_fetch_sub_explicit(&p_affinity->binding, 1, memory_order_release);
+}
+
+void
+rplib_tpool_thread_do(rplib_tpool_worker_t *p_worker)
+{
+    rplib_tpool_t     *p_tpool = p_worker->p_tpool;
+    bool               b_extra = p_worker->index >= p_tpool->min_threads;
+    bool               b_idled = false; // last sleep ran out without a task
+    struct timespec    deadline;        // end of an extra worker's sleep
+    rplib_tpool_task_t task;            // task taken from queue
+
+    // if launched, we're alive
+    atomic_fetch_add(&p_tpool->num_threads_alive, 1);
+
+    for (;;)
+    {
+        // busy before taking, so a task is never in flight uncounted
+        atomic_fetch_add(&p_tpool->num_threads_busy, 1);
+        // tasks bound to this worker first, then shared ones unless parked
+        if (rplib_tpool_queue_pop(&p_worker->queue, &task)
+            || (p_worker->index < atomic_load(&p_tpool->num_threads_active)
+                && rplib_tpool_queue_pop(&p_tpool->queue_shared, &task)))
         {
-            // not busy while waiting
-            pthread_mutex_lock(&p_tpool->mutex_thrd_count);
-            p_tpool->num_threads_busy--;
-            pthread_mutex_unlock(&p_tpool->mutex_thrd_count);
-
-            pthread_cond_wait(&(p_tpool->cond_task_queue),
-                              &(p_tpool->mutex_task_queue));
-
-            // busy again
-            pthread_mutex_lock(&p_tpool->mutex_thrd_count);
-            p_tpool->num_threads_busy++;
-            pthread_mutex_unlock(&p_tpool->mutex_thrd_count);
+            atomic_fetch_sub(&p_tpool->num_tasks_pending, 1);
+            // run target function
+            task.p_function(task.p_arg);
+            // update tpool metrics
+            atomic_fetch_sub(&p_tpool->num_threads_busy, 1);
+            rplib_tpool_signal_idle(p_tpool);
+            b_idled = false;
+            continue;
         }
+        // nothing to do
+        atomic_fetch_sub(&p_tpool->num_threads_busy, 1);
+        rplib_tpool_signal_idle(p_tpool);
 
         // if shutdown, get out
         if (atomic_load(&(p_tpool->b_terminate)))
         {
-            pthread_mutex_unlock(&(p_tpool->mutex_task_queue));
             break;
         }
+        // if the pool can do without this worker, park until it can't
+        if (p_worker->index >= atomic_load(&p_tpool->num_threads_active)
+            || (b_idled && rplib_tpool_retire(p_worker)))
+        {
+            rplib_tpool_park(p_worker);
+            b_idled = false;
+            continue;
+        }
+        // workers past the minimum only sleep so long at once
+        b_idled = false;
+        if (b_extra)
+        {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += RPLIB_TPOOL_IDLE_MS / 1000;
+            deadline.tv_nsec += (RPLIB_TPOOL_IDLE_MS % 1000) * 1000000L;
+            if (1000000000L <= deadline.tv_nsec)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+        }
 
-        // new job has arrived
-        p_function
-            = ((rplib_tpool_task_t *)p_tpool->p_queue_tasks->p_front->p_data)
-                  ->p_function;
-        p_arg = ((rplib_tpool_task_t *)p_tpool->p_queue_tasks->p_front->p_data)
-                    ->p_arg;
-        // update queue
-        rplib_ll_queue_dequeue(p_tpool->p_queue_tasks);
-
-        // unlock mutex
-        pthread_mutex_unlock(&p_tpool->mutex_task_queue);
-
-        // run target function
-        p_function(p_arg);
-
-        // update tpool metrics
-        pthread_mutex_lock(&p_tpool->mutex_thrd_count);
-        p_tpool->num_threads_busy--;
-        // if no threads working, trigger the idle condition for tpool_wait
-        if (!p_tpool->num_threads_busy)
+        // sleep until signaled for new job. Announcing as sleeping before
+        // checking queues pairs with enqueue pushing before checking
+        // sleepers, so a wakeup cannot be missed
+        pthread_mutex_lock(&(p_tpool->mutex_task_queue));
+        atomic_fetch_add(&p_tpool->num_threads_sleeping, 1);
+        atomic_store(&p_worker->b_sleeping, true);
+        while (0 == atomic_load(&p_worker->queue.num_pending)
+               && 0 == atomic_load(&p_tpool->queue_shared.num_pending)
+               && !atomic_load(&(p_tpool->b_terminate)) && !b_idled)
         {
-            pthread_cond_signal(&p_tpool->cond_threads_idle);
+            if (!b_extra)
+            {
+                pthread_cond_wait(&p_worker->cond_worker,
+                                  &(p_tpool->mutex_task_queue));
+            }
+            else if (ETIMEDOUT
+                     == pthread_cond_timedwait(&p_worker->cond_worker,
+                                               &(p_tpool->mutex_task_queue),
+                                               &deadline))
+            {
+                b_idled = true;
+            }
+            // waker claimed us, go back to being wakeable
+            atomic_store(&p_worker->b_sleeping, true);
         }
-        pthread_mutex_unlock(&p_tpool->mutex_thrd_count);
+        atomic_store(&p_worker->b_sleeping, false);
+        atomic_fetch_sub(&p_tpool->num_threads_sleeping, 1);
+        pthread_mutex_unlock(&p_tpool->mutex_task_queue);
     }
 
     // where were you when thread was kill
-    pthread_mutex_lock(&p_tpool->mutex_thrd_count);
-    p_tpool->num_threads_busy--;
-    p_tpool->num_threads_alive--;
-    pthread_mutex_unlock(&p_tpool->mutex_thrd_count);
+    atomic_fetch_sub(&p_tpool->num_threads_alive, 1);
 
     pthread_exit(NULL);
 }
 
-/**
- * Helper function to pass `rplib_tpool_thread_do` using func signature
- * required for `pthread_create`
- * @param p_tpool Pointer to `rplib_tpool_t`
- * @return NULL, always
- */
-static void *
-rplib_tpool_thread_start(void *p_tpool)
-{
-    rplib_tpool_thread_do((rplib_tpool_t *)p_tpool);
-    return NULL;
-}
-
 int
 rplib_tpool_start(rplib_tpool_t *p_tpool)
 {
-    int    res        = RPLIB_UNSUCCESS;
+    int    res        = RPLIB_SUCCESS;
     size_t loop_index = 0;
-    for (loop_index = 0; loop_index < p_tpool->num_threads; loop_index++)
+
+    // active before any thread looks, or it parks right away
+    pthread_mutex_lock(&p_tpool->mutex_grow);
+    atomic_store(&p_tpool->num_threads_active, p_tpool->min_threads);
+    for (loop_index = 0;
+         RPLIB_SUCCESS == res && loop_index < p_tpool->min_threads;
+         loop_index++)
     {
-        res = pthread_create(&(p_tpool->p_thread_buf[loop_index]),
-                             NULL,
-                             rplib_tpool_thread_start,
-                             (void *)p_tpool);
-        if (0 != res)
-        {
-            RPLIB_DEBUG_PRINTF("Error: %s\n", "TPOOL THREAD CREATE");
-            res = RPLIB_UNSUCCESS;
-            goto leave;
-        }
-        RPLIB_DEBUG_PRINTF(
-            "Notice: %s #%zu %s\n", "TPOOL THREAD", loop_index, "started.");
+        res = rplib_tpool_spawn(p_tpool, &p_tpool->p_workers[loop_index]);
     }
-    res = RPLIB_SUCCESS;
-leave:
+    // whatever started takes tasks
+    if (RPLIB_SUCCESS != res)
+    {
+        atomic_store(&p_tpool->num_threads_active, loop_index - 1);
+    }
+    pthread_mutex_unlock(&p_tpool->mutex_grow);
     return res;
 }
 
@@ -253,7 +1172,8 @@ rplib_tpool_wait(rplib_tpool_t *p_tpool)
     // b) there are threads working (non-zero)
     pthread_mutex_lock(&p_tpool->mutex_thrd_count);
 
-    while (p_tpool->num_threads_busy || p_tpool->p_queue_tasks->size)
+    while (atomic_load(&p_tpool->num_threads_busy)
+           || atomic_load(&p_tpool->num_tasks_pending))
     {
         // await all threads idle condition
         pthread_cond_wait(&p_tpool->cond_threads_idle,
@@ -264,3 +1184,15 @@ rplib_tpool_wait(rplib_tpool_t *p_tpool)
     // if we make it this far all threads are idle and there are no pending jobs
     return RPLIB_SUCCESS;
 }
+
+size_t
+rplib_tpool_get_queue_depth(rplib_tpool_t *p_tpool)
+{
+    return atomic_load(&p_tpool->num_tasks_pending);
+}
+
+size_t
+rplib_tpool_get_num_threads(rplib_tpool_t *p_tpool)
+{
+    return atomic_load(&p_tpool->num_threads_active);
+}
@@ -4,6 +4,7 @@ import os
 import socket
 import struct
 import re
+import select
 import threading
 from enum import Enum
 
@@ -14,6 +15,7 @@ BCP_MAX_MSG_SIZE = 8195
 BCP_MAX_STR_LEN = 4095
 
 BCP_DEFAULT_TIMEOUT = 6000
+BCP_MAX_WINDOW = 255  # largest window a REGWIN can ask for
 
 
 class BCPClient:
@@ -26,6 +28,8 @@ class BCPClient:
         SEND = 2
         DELVR = 3
         STAT = 4
+        REGWIN = 9
+        ACK = 10
 
     class BCP_CONN_STATUS(Enum):
         SETUP = 0
@@ -33,7 +37,7 @@ class BCPClient:
         PENDING_STATUS = 2
         SHUTDOWN = 3
 
-    def __init__(self, remote_port, remote_ip, username):
+    def __init__(self, remote_port, remote_ip, username, window=1):
         # set fields
         self.inbound_thread = None  # holds thread for incoming operations
         self.outbound_thread = None  # holds thread for outgoing operations
@@ -50,6 +54,8 @@ class BCPClient:
         self.timeout = BCP_DEFAULT_TIMEOUT  # how long to wait before operation failure
         self.screen = ""
         self.prompt = ""
+        self.window = window  # DELIVERs the server may send before an ack
+        self.unacked = 0  # DELIVERs received but not yet acknowledged
         # set remaining fields
 
         # create locks
@@ -243,7 +249,12 @@ class BCPClient:
         '''
         ret_stat = None
         fmt = f"!Bh{len(self.username)}s"
-        msg = struct.pack(fmt, BCPClient.BCP_OPCODE.REGISTER.value, len(self.username), self.username.encode('utf-8'))
+        # ask for windowed delivery only if wanted, legacy servers reject it
+        if self.window > 1:
+            msg = struct.pack(fmt + "B", BCPClient.BCP_OPCODE.REGWIN.value, len(self.username),
+                              self.username.encode('utf-8'), self.window)
+        else:
+            msg = struct.pack(fmt, BCPClient.BCP_OPCODE.REGISTER.value, len(self.username), self.username.encode('utf-8'))
         # send
         self.sock.sendall(msg)
         # await response
@@ -275,6 +286,32 @@ class BCPClient:
         msg = struct.pack(fmt, BCPClient.BCP_OPCODE.STAT.value, stat_code)
         return None is self.sock.sendall(msg)
 
+    def send_ack(self, count):
+        '''
+        Send an ACK msg to the server, acknowledging several DELIVERs at once
+        :param count: Number of DELIVERs acknowledged
+        :return: True if send operation successful; False if not
+        '''
+        fmt = f"!BB"
+        msg = struct.pack(fmt, BCPClient.BCP_OPCODE.ACK.value, count)
+        return None is self.sock.sendall(msg)
+
+    def ack_deliver(self, delivered):
+        '''
+        Acknowledge a DELIVER. Windowed clients hold acks until the window is
+        full or nothing else is waiting on the socket, then ack all at once
+        :param delivered: True if the DELIVER was handled successfully
+        :return: None
+        '''
+        # NOTE: assumes status 0 is good and status 1 is error
+        if self.window <= 1 or not delivered:
+            self.send_stat(int(delivered == False))
+            return
+        self.unacked += 1
+        if self.unacked >= self.window or not select.select([self.sock], [], [], 0)[0]:
+            self.send_ack(self.unacked)
+            self.unacked = 0
+
     def setup_socket(self):
         '''
         Initializes a TCP socket for program and connect to server
@@ -297,8 +334,7 @@ class BCPClient:
             updated_msg = self.handle_stat()
         elif opc is self.BCP_OPCODE.DELVR.value:
             updated_msg = self.handle_deliver()
-            # NOTE: assumes status 0 is good and status 1 is error
-            self.send_stat(int(updated_msg == False))
+            self.ack_deliver(updated_msg)
         return updated_msg
 
 
@@ -316,6 +352,9 @@ def invalid_args(args):
     if args.p >= PORT_MAX:
         print("Invalid Port")
         error = True
+    if not 1 <= args.w <= BCP_MAX_WINDOW:
+        print("Invalid Window")
+        error = True
     return error
 
 
@@ -327,6 +366,8 @@ def main():
     parser.add_argument("-s", metavar="ip", default="127.0.0.1", help="Server IPv4 Address")
     parser.add_argument("-p", metavar="port", default="9001", help="Server Port", type=int)
     parser.add_argument("-u", metavar="username", help="Username", required=True)
+    parser.add_argument("-w", metavar="window", default=1, type=int,
+                        help="Messages the server may deliver before an acknowledgement (1 = stop-and-wait)")
 
     args = parser.parse_args()
 
@@ -338,7 +379,7 @@ def main():
     server_port = args.p
     username = args.u
 
-    client = BCPClient(server_port, server_ip, username)
+    client = BCPClient(server_port, server_ip, username, args.w)
 
 
 if __name__ == "__main__":
@@ -12,7 +12,10 @@
 #include "rpchat_process_event.h"
 
 int
-rpchat_conn_info_initialize(rpchat_conn_info_t *p_new_conn_info, int h_new_fd)
+rpchat_conn_info_initialize(rpchat_conn_info_t *p_new_conn_info,
+                            int                 h_new_fd,
+                            rplib_pool_t       *p_pool,
+                            bool                b_affinity)
 {
     int res = RPLIB_UNSUCCESS;
 
@@ -20,16 +23,397 @@ rpchat_conn_info_initialize(rpchat_conn_info_t *p_new_conn_info, int h_new_fd)
     p_new_conn_info->h_fd        = h_new_fd;
     p_new_conn_info->conn_status = RPCHAT_CONN_PRE_REGISTER;
     pthread_mutex_init(&p_new_conn_info->mutex_conn, NULL);
-    p_new_conn_info->username.len = 0;
-    p_new_conn_info->stat_msg.len = 0;
+    p_new_conn_info->stat_msg_id = RPCHAT_STAT_MSG_NONE;
+    // stop-and-wait unless the client registers with REGWIN
+    p_new_conn_info->window    = 1;
+    p_new_conn_info->in_flight = 0;
+    // no username until registered
+    p_new_conn_info->username.p_contents = p_new_conn_info->username.inline_buf;
+    rpchat_conn_info_clear_username(p_new_conn_info);
     atomic_store(&p_new_conn_info->pending_jobs, 0);
-    p_new_conn_info->last_active=time(0);
+    atomic_store(&p_new_conn_info->last_active, time(0));
+    rplib_timer_node_initialize(&p_new_conn_info->idle_timer);
+    p_new_conn_info->p_xfer = NULL;
+    // nothing queued for client yet
+    atomic_init(&p_new_conn_info->backlog_frames, 0);
+    atomic_init(&p_new_conn_info->sz_backlog, 0);
+    atomic_init(&p_new_conn_info->b_overrun, false);
+    // not polled until registered
+    atomic_init(&p_new_conn_info->b_poll_pending, false);
+    // listed by the queue until closed
+    p_new_conn_info->b_unlinked  = false;
+    p_new_conn_info->retired_gen = 0;
+    atomic_init(&p_new_conn_info->b_reclaimable, false);
+    // in no room, posted nothing and timing nothing until first used
+    atomic_init(&p_new_conn_info->p_extra, NULL);
+    p_new_conn_info->p_pool = p_pool;
+    p_new_conn_info->b_affinity = b_affinity;
+    rplib_tpool_affinity_initialize(&p_new_conn_info->affinity, h_new_fd);
+    rpchat_frame_parser_reset(&p_new_conn_info->inbound_parser);
+    // buffer for data received from client, storage attached on first read
+    rplib_ring_buf_detach(&p_new_conn_info->inbound_buf);
+    // events waiting on a state change, lists created when first parked
+    p_new_conn_info->p_parked_in  = NULL;
+    p_new_conn_info->p_parked_out = NULL;
+    // messages waiting to be written to client
+    p_new_conn_info->p_outbound_queue = rplib_ll_queue_create();
+    if (NULL == p_new_conn_info->p_outbound_queue)
+    {
+        goto no_outbound;
+    }
+
+    res = RPLIB_SUCCESS;
+    goto leave;
+
+    // undo setup in reverse order
+no_outbound:
+    pthread_mutex_destroy(&p_new_conn_info->mutex_conn);
+leave:
+    return res;
+}
+
+rpchat_conn_extra_t *
+rpchat_conn_info_get_extra(rpchat_conn_info_t *p_conn_info)
+{
+    rpchat_conn_extra_t *p_extra    = atomic_load(&p_conn_info->p_extra);
+    rpchat_conn_extra_t *p_expected = NULL; // none published yet
+
+    if (NULL != p_extra)
+    {
+        goto leave;
+    }
+    p_extra = rplib_pool_alloc(p_conn_info->p_pool, sizeof(*p_extra));
+    if (NULL == p_extra)
+    {
+        goto leave;
+    }
+    memset(p_extra, 0, sizeof(*p_extra));
+    // deliveries are posted by other threads, taken by flush tasks
+    pthread_mutex_init(&p_extra->mutex_outbox, NULL);
+    p_extra->flush_state = RPCHAT_FLUSH_IDLE;
+    // another thread got there first, use its copy
+    if (!atomic_compare_exchange_strong(
+            &p_conn_info->p_extra, &p_expected, p_extra))
+    {
+        pthread_mutex_destroy(&p_extra->mutex_outbox);
+        rplib_pool_free(p_conn_info->p_pool, p_extra);
+        p_extra = p_expected;
+    }
+leave:
+    return p_extra;
+}
+
+/**
+ * Helper function to drop the frame at the front of a connection's outbound
+ * queue, releasing its message
+ * @param p_conn_info Pointer to connection info object
+ */
+static void
+rpchat_conn_info_pop_outbound(rpchat_conn_info_t *p_conn_info)
+{
+    rpchat_outbound_frame_t *p_frame
+        = (rpchat_outbound_frame_t *)p_conn_info->p_outbound_queue->p_front
+              ->p_data;
+
+    rpchat_shared_msg_release(p_frame->p_shared_msg);
+    p_frame->p_shared_msg = NULL;
+    rplib_ll_queue_dequeue(p_conn_info->p_outbound_queue);
+}
+
+int
+rpchat_conn_info_destroy(rpchat_conn_info_t *p_conn_info)
+{
+    rpchat_conn_extra_t *p_extra = NULL;
+
+    rpchat_conn_info_clear_username(p_conn_info);
+    // removes part file of an unfinished upload
+    rpchat_file_xfer_destroy(p_conn_info->p_xfer);
+    p_conn_info->p_xfer = NULL;
+    rplib_pool_free(p_conn_info->p_pool,
+                    rplib_ring_buf_detach(&p_conn_info->inbound_buf));
+    if (NULL != p_conn_info->p_outbound_queue)
+    {
+        // drop anything never written
+        while (0 < p_conn_info->p_outbound_queue->size)
+        {
+            rpchat_conn_info_pop_outbound(p_conn_info);
+        }
+        rplib_ll_queue_destroy(p_conn_info->p_outbound_queue);
+        p_conn_info->p_outbound_queue = NULL;
+    }
+    // events still parked are owned by the caller, only drop the lists
+    if (NULL != p_conn_info->p_parked_in)
+    {
+        rplib_ll_queue_destroy(p_conn_info->p_parked_in);
+        p_conn_info->p_parked_in = NULL;
+    }
+    if (NULL != p_conn_info->p_parked_out)
+    {
+        rplib_ll_queue_destroy(p_conn_info->p_parked_out);
+        p_conn_info->p_parked_out = NULL;
+    }
+    p_extra = atomic_load(&p_conn_info->p_extra);
+    if (NULL != p_extra)
+    {
+        if (NULL != p_extra->p_outbox)
+        {
+            rplib_ll_queue_destroy(p_extra->p_outbox);
+        }
+        pthread_mutex_destroy(&p_extra->mutex_outbox);
+        rplib_pool_free(p_conn_info->p_pool, p_extra);
+        atomic_store(&p_conn_info->p_extra, NULL);
+    }
+    // callers holding the lock release it first
+    pthread_mutex_destroy(&p_conn_info->mutex_conn);
+    return RPLIB_SUCCESS;
+}
 
-    res=RPLIB_SUCCESS;
+int
+rpchat_conn_info_set_username(rpchat_conn_info_t *p_conn_info,
+                              rpchat_string_t    *p_username)
+{
+    int   res        = RPLIB_ERROR;
+    char *p_contents = p_conn_info->username.inline_buf;
 
+    // long names spill into a block sized to fit
+    if (RPCHAT_CONN_NAME_INLINE_SZ <= p_username->len)
+    {
+        p_contents = rplib_pool_alloc(p_conn_info->p_pool, p_username->len + 1);
+        if (NULL == p_contents)
+        {
+            goto leave;
+        }
+    }
+    rpchat_conn_info_clear_username(p_conn_info);
+    // terminate first, the inline name stays a valid string throughout
+    p_contents[p_username->len] = '\0';
+    memcpy(p_contents, p_username->contents, p_username->len);
+    p_conn_info->username.p_contents = p_contents;
+    p_conn_info->username.len        = p_username->len;
+    res                              = RPLIB_SUCCESS;
+leave:
     return res;
 }
 
+void
+rpchat_conn_info_clear_username(rpchat_conn_info_t *p_conn_info)
+{
+    if (p_conn_info->username.inline_buf != p_conn_info->username.p_contents)
+    {
+        rplib_pool_free(p_conn_info->p_pool, p_conn_info->username.p_contents);
+    }
+    p_conn_info->username.len           = 0;
+    p_conn_info->username.p_contents    = p_conn_info->username.inline_buf;
+    p_conn_info->username.inline_buf[0] = '\0';
+}
+
+int
+rpchat_conn_info_fill_inbound(rpchat_conn_info_t *p_conn_info)
+{
+    int          res       = RPLIB_ERROR;
+    int          iov_count = 0;    // regions available in ring buffer
+    size_t       requested = 0;    // bytes requested from socket
+    char        *p_storage = NULL; // backing storage of idle ring buffer
+    struct iovec free_iov[2];      // writable regions of ring buffer
+
+    // idle connections hold no storage, attach some before reading
+    if (NULL == p_conn_info->inbound_buf.p_buf)
+    {
+        p_storage
+            = rplib_pool_alloc(p_conn_info->p_pool, RPCHAT_CONN_INBOUND_BUF_SZ);
+        if (NULL == p_storage)
+        {
+            goto leave;
+        }
+        rplib_ring_buf_attach(
+            &p_conn_info->inbound_buf, p_storage, RPCHAT_CONN_INBOUND_BUF_SZ);
+    }
+
+    for (;;)
+    {
+        iov_count = rplib_ring_buf_get_free_iov(&p_conn_info->inbound_buf,
+                                                free_iov);
+        // full, remaining bytes are read once buffered frames are consumed
+        if (0 == iov_count)
+        {
+            break;
+        }
+        requested = free_iov[0].iov_len;
+        if (2 == iov_count)
+        {
+            requested += free_iov[1].iov_len;
+        }
+        // single syscall for everything that fits
+        res = rpchat_recvv(p_conn_info->h_fd, free_iov, iov_count);
+        if (0 > res)
+        {
+            goto leave;
+        }
+        rplib_ring_buf_commit(&p_conn_info->inbound_buf, res);
+        // short read means socket has been drained
+        if ((size_t)res < requested)
+        {
+            break;
+        }
+    }
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+void
+rpchat_conn_info_release_inbound(rpchat_conn_info_t *p_conn_info)
+{
+    if (NULL != p_conn_info->inbound_buf.p_buf
+        && 0 == rplib_ring_buf_size(&p_conn_info->inbound_buf))
+    {
+        rplib_pool_free(p_conn_info->p_pool,
+                        rplib_ring_buf_detach(&p_conn_info->inbound_buf));
+    }
+}
+
+int
+rpchat_conn_info_queue_outbound(rpchat_conn_info_t *p_conn_info,
+                                char               *p_msg_buf,
+                                size_t              sz_msg_buf)
+{
+    int                  res          = RPLIB_ERROR;
+    rpchat_shared_msg_t *p_shared_msg = NULL;
+
+    // copy message, caller keeps original
+    p_shared_msg = rpchat_shared_msg_create(p_conn_info->p_pool, sz_msg_buf);
+    if (NULL == p_shared_msg)
+    {
+        goto leave;
+    }
+    memcpy(p_shared_msg->contents, p_msg_buf, sz_msg_buf);
+
+    res = rpchat_conn_info_queue_shared(p_conn_info, p_shared_msg);
+    // queue holds its own reference
+    rpchat_shared_msg_release(p_shared_msg);
+    p_shared_msg = NULL;
+leave:
+    return res;
+}
+
+int
+rpchat_conn_info_queue_shared(rpchat_conn_info_t  *p_conn_info,
+                              rpchat_shared_msg_t *p_shared_msg)
+{
+    int                     res = RPLIB_ERROR;
+    rpchat_outbound_frame_t new_frame;
+
+    new_frame.p_shared_msg = rpchat_shared_msg_retain(p_shared_msg);
+    new_frame.sz_sent      = 0;
+
+    if (NULL
+        == rplib_ll_queue_enqueue(p_conn_info->p_outbound_queue,
+                                  &new_frame,
+                                  sizeof(rpchat_outbound_frame_t)))
+    {
+        rpchat_shared_msg_release(new_frame.p_shared_msg);
+        new_frame.p_shared_msg = NULL;
+        goto leave;
+    }
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+int
+rpchat_conn_info_flush_outbound(rpchat_conn_info_t *p_conn_info)
+{
+    int                      res          = RPLIB_SUCCESS;
+    int                      iov_count    = 0; // frames gathered per send
+    int                      sent_bytes   = 0; // bytes accepted by socket
+    size_t                   sz_requested = 0; // bytes offered to socket
+    size_t                   sz_remaining = 0; // sent bytes left to retire
+    size_t                   sz_unsent    = 0; // unsent bytes of front frame
+    rplib_ll_queue_node_t   *p_curr_node  = NULL;
+    rpchat_outbound_frame_t *p_curr_frame = NULL;
+    struct iovec             out_iov[RPCHAT_CONN_MAX_IOV];
+
+    while (0 < p_conn_info->p_outbound_queue->size)
+    {
+        // gather unsent portion of queued frames
+        iov_count    = 0;
+        sz_requested = 0;
+        p_curr_node  = p_conn_info->p_outbound_queue->p_front;
+        while (NULL != p_curr_node && RPCHAT_CONN_MAX_IOV > iov_count)
+        {
+            p_curr_frame = (rpchat_outbound_frame_t *)p_curr_node->p_data;
+            out_iov[iov_count].iov_base
+                = p_curr_frame->p_shared_msg->contents + p_curr_frame->sz_sent;
+            out_iov[iov_count].iov_len
+                = p_curr_frame->p_shared_msg->sz_msg - p_curr_frame->sz_sent;
+            sz_requested += out_iov[iov_count].iov_len;
+            iov_count++;
+            p_curr_node = p_curr_node->p_next_node;
+        }
+
+        sent_bytes = rpchat_sendmsgv(p_conn_info->h_fd, out_iov, iov_count);
+        if (0 > sent_bytes)
+        {
+            res = RPLIB_ERROR;
+            goto leave;
+        }
+
+        // retire fully written frames, remember progress on a partial one
+        sz_remaining = (size_t)sent_bytes;
+        while (0 < sz_remaining)
+        {
+            p_curr_frame = (rpchat_outbound_frame_t *)
+                               p_conn_info->p_outbound_queue->p_front->p_data;
+            sz_unsent
+                = p_curr_frame->p_shared_msg->sz_msg - p_curr_frame->sz_sent;
+            if (sz_remaining < sz_unsent)
+            {
+                p_curr_frame->sz_sent += sz_remaining;
+                break;
+            }
+            sz_remaining -= sz_unsent;
+            rpchat_conn_info_pop_outbound(p_conn_info);
+        }
+
+        // short write means socket buffer is full, wait for EPOLLOUT
+        if ((size_t)sent_bytes < sz_requested)
+        {
+            break;
+        }
+    }
+leave:
+    return res;
+}
+
+bool
+rpchat_conn_info_has_outbound(rpchat_conn_info_t *p_conn_info)
+{
+    return 0 < p_conn_info->p_outbound_queue->size;
+}
+
+int
+rpchat_conn_info_arm(rpchat_conn_info_t *p_conn_info, int h_fd_epoll)
+{
+    uint32_t events = RPCHAT_CONN_EPOLL_EVENTS;
+
+    // only ask about writability while there is something to write
+    if (rpchat_conn_info_has_outbound(p_conn_info))
+    {
+        events |= EPOLLOUT;
+    }
+    // unread requests would report readable again at once
+    if (NULL != p_conn_info->p_xfer
+        && RPCHAT_FILE_XFER_DOWNLOAD == p_conn_info->p_xfer->direction)
+    {
+        events = (events & ~EPOLLIN) | EPOLLOUT;
+    }
+    return rpchat_arm_descriptor(h_fd_epoll,
+                                 p_conn_info->h_fd,
+                                 p_conn_info,
+                                 events,
+                                 &p_conn_info->b_poll_pending);
+}
+
 int
 rpchat_conn_info_enqueue_task(rpchat_conn_info_t *p_conn_info,
                               rplib_tpool_t      *p_tpool,
@@ -37,12 +421,33 @@ rpchat_conn_info_enqueue_task(rpchat_conn_info_t *p_conn_info,
                               void *p_arg)
 {
     int res = RPLIB_UNSUCCESS;
-    res     = rplib_tpool_enqueue_task(p_tpool, p_function, p_arg);
-    // update counter
-    if (RPLIB_SUCCESS == res)
+    // update counter first, task may run before enqueue returns
+    atomic_fetch_add(&p_conn_info->pending_jobs, 1);
+    if (p_conn_info->b_affinity)
     {
-        atomic_fetch_add(&p_conn_info->pending_jobs, 1);
+        res = rplib_tpool_enqueue_affine(
+            p_tpool, &p_conn_info->affinity, p_function, p_arg);
+    }
+    else
+    {
+        res = rplib_tpool_enqueue_task(p_tpool, p_function, p_arg);
+    }
+    if (RPLIB_SUCCESS != res)
+    {
+        atomic_fetch_sub(&p_conn_info->pending_jobs, 1);
     }
 
     return res;
 }
+
+void
+rpchat_conn_info_batch_task(rpchat_conn_info_t *p_conn_info,
+                            rplib_tpool_task_t *p_task,
+                            void (*p_function)(void *p_arg),
+                            void *p_arg)
+{
+    // counted before the batch is enqueued, as for single tasks
+    atomic_fetch_add(&p_conn_info->pending_jobs, 1);
+    p_task->p_function = p_function;
+    p_task->p_arg      = p_arg;
+}
@@ -8,8 +8,72 @@
 
 #include "components/rpchat_conn_queue.h"
 
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rpchat_process_event.h"
+
+#define RPCHAT_POOL_SHORT_MSG \
+    (sizeof(rpchat_shared_msg_t) + 256) // typical chat line or status
+#define RPCHAT_POOL_LARGE_MSG \
+    (sizeof(rpchat_shared_msg_t) + sizeof(rpchat_pkt_deliver_t)) // any DELIVER
+
+/**
+ * Block sizes used by the session allocator, smallest first
+ */
+static const size_t rpchat_pool_class_sizes[] = {
+    sizeof(rpchat_args_proc_event_t), // task args
+    RPCHAT_POOL_SHORT_MSG,            // short shared messages
+    sizeof(rpchat_pkt_status_t),      // status buffers
+    RPCHAT_POOL_LARGE_MSG,            // long shared messages
+    RPCHAT_CONN_INBOUND_BUF_SZ,       // inbound buffers of busy connections
+};
+
+/**
+ * Helper function to list a queue's connections in a new snapshot, one
+ * generation past the current
+ * \nNote: Caller holds the queue's list lock, or is its only user
+ * @param p_conn_queue Pointer to connection queue
+ * @return Pointer to snapshot holding the queue's reference; NULL on
+ * allocation failure
+ */
+static rpchat_conn_snapshot_t *
+rpchat_conn_queue_build_snapshot(rpchat_conn_queue_t *p_conn_queue)
+{
+    rpchat_conn_snapshot_t *p_snapshot  = NULL;
+    rpchat_conn_info_t     *p_curr_info = NULL;
+    size_t                  conn_index  = 0;
+
+    p_snapshot = malloc(sizeof(rpchat_conn_snapshot_t)
+                        + (p_conn_queue->num_conns
+                           * sizeof(rpchat_conn_info_t *)));
+    if (NULL == p_snapshot)
+    {
+        goto leave;
+    }
+    atomic_init(&p_snapshot->refcount, 1);
+    p_snapshot->generation = p_conn_queue->generation + 1;
+    p_snapshot->p_older    = NULL;
+    p_snapshot->p_newer    = NULL;
+    for (p_curr_info = p_conn_queue->p_conn_front; NULL != p_curr_info;
+         p_curr_info = p_curr_info->queue_link.p_next)
+    {
+        p_snapshot->p_conns[conn_index++] = p_curr_info;
+    }
+    p_snapshot->num_conns = conn_index;
+leave:
+    return p_snapshot;
+}
+
 rpchat_conn_queue_t *
-rpchat_conn_queue_create(int h_fd_epoll)
+rpchat_conn_queue_create(int           h_fd_epoll,
+                         bool          b_affinity,
+                         rplib_pool_t *p_shared_pool)
 {
     rpchat_conn_queue_t *p_conn_queue = NULL;
 
@@ -21,20 +85,113 @@ rpchat_conn_queue_create(int h_fd_epoll)
     }
 
     // store a "server" identifier for use on server messages
-    p_conn_queue->server_str.len = snprintf(p_conn_queue->server_str.contents,
-                                            RPCHAT_MAX_STR_LENGTH,
-                                            "%s",
-                                            RPCHAT_SERVER_IDENTIFIER);
+    p_conn_queue->server_name.p_contents = p_conn_queue->server_name.inline_buf;
+    p_conn_queue->server_name.len
+        = snprintf(p_conn_queue->server_name.inline_buf,
+                   RPCHAT_CONN_NAME_INLINE_SZ,
+                   "%s",
+                   RPCHAT_SERVER_IDENTIFIER);
 
     // initialize children
-    p_conn_queue->p_conn_ll = rplib_ll_queue_create();
-    if (!p_conn_queue->p_conn_ll)
+    p_conn_queue->p_conn_front = NULL;
+    p_conn_queue->p_conn_rear  = NULL;
+    p_conn_queue->num_conns    = 0;
+    if (RPLIB_SUCCESS
+        != rpchat_name_index_initialize(&p_conn_queue->name_index))
     {
         goto cleanup;
     }
+    if (RPLIB_SUCCESS
+        != rpchat_room_index_initialize(&p_conn_queue->room_index))
+    {
+        goto cleanup_name_index;
+    }
+    p_conn_queue->p_mailbox = rplib_ll_queue_create();
+    if (!p_conn_queue->p_mailbox)
+    {
+        goto cleanup_room_index;
+    }
+    // readable whenever mail is waiting, watched by the owning reactor
+    p_conn_queue->h_fd_mailbox = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (0 > p_conn_queue->h_fd_mailbox)
+    {
+        perror("eventfd");
+        goto cleanup_mailbox;
+    }
+    p_conn_queue->b_owns_pool = (NULL == p_shared_pool);
+    p_conn_queue->p_pool      = p_shared_pool;
+    if (p_conn_queue->b_owns_pool)
+    {
+        p_conn_queue->p_pool = rplib_pool_create(
+            rpchat_pool_class_sizes,
+            sizeof(rpchat_pool_class_sizes)
+                / sizeof(rpchat_pool_class_sizes[0]));
+    }
+    if (!p_conn_queue->p_pool)
+    {
+        close(p_conn_queue->h_fd_mailbox);
+        goto cleanup_mailbox;
+    }
+    // nothing listed yet, nor waiting on a reader
+    p_conn_queue->generation = 0;
+    p_conn_queue->p_retired  = NULL;
+    p_conn_queue->p_snapshot = rpchat_conn_queue_build_snapshot(p_conn_queue);
+    if (!p_conn_queue->p_snapshot)
+    {
+        goto cleanup_pool;
+    }
+    p_conn_queue->p_oldest   = p_conn_queue->p_snapshot;
+    p_conn_queue->generation = p_conn_queue->p_snapshot->generation;
+    // readable once lingering batches are due, watched by the owning reactor
+    p_conn_queue->h_fd_flush
+        = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (0 > p_conn_queue->h_fd_flush)
+    {
+        perror("timerfd");
+        goto cleanup_snapshot;
+    }
+    p_conn_queue->p_lingering = NULL;
     p_conn_queue->h_fd_epoll = h_fd_epoll;
+    p_conn_queue->b_affinity = b_affinity;
+    // alone until told about other reactors
+    p_conn_queue->pp_peers  = NULL;
+    p_conn_queue->num_peers = 1;
+    atomic_init(&p_conn_queue->b_terminate, false);
+    rplib_timer_wheel_initialize(&p_conn_queue->idle_timers, time(0));
+    p_conn_queue->conn_timeout = 0;
+    p_conn_queue->idle_recheck = 0;
+    // no file exchange unless the creator provides a directory
+    p_conn_queue->h_fd_file_dir = RPLIB_ERROR;
+    p_conn_queue->p_file_cache  = NULL;
+    // outbound queues are unbounded unless the creator sets budgets
+    p_conn_queue->p_backlog = NULL;
+    // standalone unless the creator joins a cluster
+    p_conn_queue->p_cluster = NULL;
+    p_conn_queue->p_tpool   = NULL;
+    // batches only hold what was posted before they were taken
+    p_conn_queue->flush_bytes = SIZE_MAX;
+    p_conn_queue->flush_us    = 0;
     pthread_mutex_init(&(p_conn_queue->mutex_conn_ll), NULL);
+    pthread_mutex_init(&(p_conn_queue->mutex_snap), NULL);
+    pthread_mutex_init(&(p_conn_queue->mutex_names), NULL);
+    pthread_mutex_init(&(p_conn_queue->mutex_rooms), NULL);
+    pthread_mutex_init(&(p_conn_queue->mutex_mailbox), NULL);
+    pthread_mutex_init(&(p_conn_queue->mutex_linger), NULL);
     goto leave;
+cleanup_snapshot:
+    free(p_conn_queue->p_snapshot);
+cleanup_pool:
+    if (p_conn_queue->b_owns_pool)
+    {
+        rplib_pool_destroy(p_conn_queue->p_pool);
+    }
+    close(p_conn_queue->h_fd_mailbox);
+cleanup_mailbox:
+    rplib_ll_queue_destroy(p_conn_queue->p_mailbox);
+cleanup_room_index:
+    rpchat_room_index_destroy(&p_conn_queue->room_index);
+cleanup_name_index:
+    rpchat_name_index_destroy(&p_conn_queue->name_index);
 cleanup:
     free(p_conn_queue);
     p_conn_queue = NULL;
@@ -44,108 +201,622 @@ leave:
 int
 rpchat_conn_queue_destroy(rpchat_conn_queue_t *p_conn_queue)
 {
+    rpchat_conn_info_t     *p_curr_info  = p_conn_queue->p_conn_front;
+    rpchat_conn_info_t     *p_next_info  = NULL;
+    rpchat_shared_msg_t    *p_shared_msg = NULL;
+    rpchat_conn_snapshot_t *p_snapshot   = p_conn_queue->p_oldest;
+    rpchat_conn_snapshot_t *p_newer      = NULL;
+
+    // drop mail never delivered
+    while (NULL != (p_shared_msg = rpchat_conn_queue_take_mail(p_conn_queue)))
+    {
+        rpchat_shared_msg_release(p_shared_msg);
+    }
+
+    // release resources held by remaining connections
+    while (NULL != p_curr_info)
+    {
+        p_next_info = p_curr_info->queue_link.p_next;
+        rpchat_conn_info_destroy(p_curr_info);
+        free(p_curr_info);
+        p_curr_info = p_next_info;
+    }
+    // and by those unlinked but never woken to be destroyed
+    for (p_curr_info = p_conn_queue->p_retired; NULL != p_curr_info;
+         p_curr_info = p_next_info)
+    {
+        p_next_info = p_curr_info->queue_link.p_next;
+        rpchat_conn_info_destroy(p_curr_info);
+        free(p_curr_info);
+    }
+    // no reader is left to release snapshots
+    for (; NULL != p_snapshot; p_snapshot = p_newer)
+    {
+        p_newer = p_snapshot->p_newer;
+        free(p_snapshot);
+    }
     pthread_mutex_destroy(&p_conn_queue->mutex_conn_ll);
-    rplib_ll_queue_destroy(p_conn_queue->p_conn_ll);
+    pthread_mutex_destroy(&p_conn_queue->mutex_snap);
+    pthread_mutex_destroy(&p_conn_queue->mutex_names);
+    pthread_mutex_destroy(&p_conn_queue->mutex_rooms);
+    pthread_mutex_destroy(&p_conn_queue->mutex_mailbox);
+    pthread_mutex_destroy(&p_conn_queue->mutex_linger);
+    close(p_conn_queue->h_fd_mailbox);
+    close(p_conn_queue->h_fd_flush);
+    rplib_ll_queue_destroy(p_conn_queue->p_mailbox);
+    rpchat_name_index_destroy(&p_conn_queue->name_index);
+    rpchat_room_index_destroy(&p_conn_queue->room_index);
+    if (p_conn_queue->b_owns_pool)
+    {
+        rplib_pool_destroy(p_conn_queue->p_pool);
+    }
     free(p_conn_queue);
     p_conn_queue = NULL;
 
     return RPLIB_SUCCESS;
 }
-int
-rpchat_conn_queue_destroy_conn_info(rpchat_conn_queue_t *p_conn_queue,
-                                    rpchat_conn_info_t  *p_conn_info)
+
+/**
+ * Get the queue holding the username index shared by every reactor
+ * @param p_conn_queue Pointer to connection queue
+ * @return Pointer to queue of first reactor
+ */
+static rpchat_conn_queue_t *
+rpchat_conn_queue_get_registry(rpchat_conn_queue_t *p_conn_queue)
 {
-    int                         res        = RPLIB_UNSUCCESS;
-    struct rplib_ll_queue_node *p_tgt_node = p_conn_queue->p_conn_ll->p_front;
+    return rpchat_conn_queue_get_peer(p_conn_queue, 0);
+}
 
-    // destroy mutex
-    pthread_mutex_unlock(&p_conn_info->mutex_conn);
-    pthread_mutex_destroy(&p_conn_info->mutex_conn);
+/**
+ * Helper function to wake connections retired before every live snapshot,
+ * none of which can be reached by a reader anymore. Each is handed a
+ * HEARTBEAT before it is marked reclaimable, so its closing task, seeing the
+ * mark, also sees the task pending and leaves destroying it to the HEARTBEAT.
+ * One that cannot be woken stays retired, to be tried again
+ * \nNote: Caller holds the queue's list lock
+ * @param p_conn_queue Pointer to connection queue
+ */
+static void
+rpchat_conn_queue_reap(rpchat_conn_queue_t *p_conn_queue)
+{
+    rpchat_conn_info_t **pp_link     = &p_conn_queue->p_retired;
+    rpchat_conn_info_t  *p_conn_info = NULL;
 
-    // delete object
-    pthread_mutex_lock(&p_conn_queue->mutex_conn_ll);
-    while (NULL != p_tgt_node)
+    while (NULL != (p_conn_info = *pp_link))
     {
-        // if match with address, remove
-        if (p_tgt_node->p_data == p_conn_info)
+        if (p_conn_queue->p_oldest->generation < p_conn_info->retired_gen
+            || RPLIB_SUCCESS
+                   != rpchat_wake_connection(
+                       p_conn_queue, p_conn_info, p_conn_queue->p_tpool))
         {
-            // remove
-            rplib_ll_remove_node(p_conn_queue->p_conn_ll, p_tgt_node);
-            res = RPLIB_SUCCESS;
-            goto leave;
+            pp_link = &p_conn_info->queue_link.p_next;
+            continue;
         }
-        p_tgt_node = p_tgt_node->p_next_node;
+        *pp_link = p_conn_info->queue_link.p_next;
+        atomic_store(&p_conn_info->b_reclaimable, true);
     }
+}
 
-leave:
+/**
+ * Helper function to free a snapshot no reader holds anymore, then wake
+ * connections only it could still reach
+ * \nNote: Caller holds the queue's list lock
+ * @param p_conn_queue Pointer to connection queue
+ * @param p_snapshot Pointer to snapshot, not the current one
+ */
+static void
+rpchat_conn_queue_free_snapshot(rpchat_conn_queue_t    *p_conn_queue,
+                                rpchat_conn_snapshot_t *p_snapshot)
+{
+    if (NULL == p_snapshot->p_older)
+    {
+        p_conn_queue->p_oldest = p_snapshot->p_newer;
+    }
+    else
+    {
+        p_snapshot->p_older->p_newer = p_snapshot->p_newer;
+    }
+    p_snapshot->p_newer->p_older = p_snapshot->p_older;
+    free(p_snapshot);
+    rpchat_conn_queue_reap(p_conn_queue);
+}
+
+/**
+ * Helper function to replace the current snapshot with one of the list as it
+ * is now. On allocation failure readers keep the previous one, and retired
+ * connections wait for a later publish
+ * \nNote: Caller holds the queue's list lock
+ * @param p_conn_queue Pointer to connection queue
+ */
+static void
+rpchat_conn_queue_publish(rpchat_conn_queue_t *p_conn_queue)
+{
+    rpchat_conn_snapshot_t *p_snapshot = NULL;
+    rpchat_conn_snapshot_t *p_replaced = p_conn_queue->p_snapshot;
+
+    p_snapshot = rpchat_conn_queue_build_snapshot(p_conn_queue);
+    if (NULL == p_snapshot)
+    {
+        return;
+    }
+    p_snapshot->p_older      = p_replaced;
+    p_replaced->p_newer      = p_snapshot;
+    p_conn_queue->generation = p_snapshot->generation;
+    pthread_mutex_lock(&p_conn_queue->mutex_snap);
+    p_conn_queue->p_snapshot = p_snapshot;
+    pthread_mutex_unlock(&p_conn_queue->mutex_snap);
+    // drop the queue's reference, the last reader may be gone already
+    if (1 == atomic_fetch_sub(&p_replaced->refcount, 1))
+    {
+        rpchat_conn_queue_free_snapshot(p_conn_queue, p_replaced);
+    }
+}
+
+rpchat_conn_snapshot_t *
+rpchat_conn_queue_acquire_snapshot(rpchat_conn_queue_t *p_conn_queue)
+{
+    rpchat_conn_snapshot_t *p_snapshot = NULL;
+
+    pthread_mutex_lock(&p_conn_queue->mutex_snap);
+    p_snapshot = p_conn_queue->p_snapshot;
+    atomic_fetch_add(&p_snapshot->refcount, 1);
+    pthread_mutex_unlock(&p_conn_queue->mutex_snap);
+    return p_snapshot;
+}
+
+void
+rpchat_conn_queue_release_snapshot(rpchat_conn_queue_t    *p_conn_queue,
+                                   rpchat_conn_snapshot_t *p_snapshot)
+{
+    // the queue holds a reference to the current one, only old ones get here
+    if (1 != atomic_fetch_sub(&p_snapshot->refcount, 1))
+    {
+        return;
+    }
+    pthread_mutex_lock(&p_conn_queue->mutex_conn_ll);
+    rpchat_conn_queue_free_snapshot(p_conn_queue, p_snapshot);
     pthread_mutex_unlock(&p_conn_queue->mutex_conn_ll);
-    return res;
 }
 
-rpchat_conn_info_t *
-rpchat_conn_queue_find_by_username(rpchat_conn_queue_t *p_conn_queue,
-                                   rpchat_string_t     *p_tgt_username)
+void
+rpchat_conn_queue_add_conn_info(rpchat_conn_queue_t *p_conn_queue,
+                                rpchat_conn_info_t  *p_conn_info)
+{
+    rpchat_conn_queue_add_conn_batch(p_conn_queue, &p_conn_info, 1);
+}
+
+void
+rpchat_conn_queue_add_conn_batch(rpchat_conn_queue_t *p_conn_queue,
+                                 rpchat_conn_info_t **pp_conn_infos,
+                                 size_t               num_conns)
 {
-    rpchat_conn_info_t    *p_found_info = NULL; // result
-    size_t                 conn_index   = 0;    // index for conn loop
-    size_t                 cmp_size     = 0;    // strncmp size per iteration
-    rplib_ll_queue_node_t *p_tgt_node   = NULL; // current node for conn loop
-    rpchat_conn_info_t    *p_tgt_info   = NULL; // current info for conn loop
+    size_t              conn_index  = 0;
+    rpchat_conn_info_t *p_conn_info = NULL;
 
     pthread_mutex_lock(&p_conn_queue->mutex_conn_ll);
-    p_tgt_node = p_conn_queue->p_conn_ll->p_front;
-    for (conn_index = 0; conn_index < p_conn_queue->p_conn_ll->size;
-         conn_index++)
+    for (conn_index = 0; conn_index < num_conns; conn_index++)
     {
-        p_tgt_info = ((rpchat_conn_info_t *)p_tgt_node->p_data);
-        // if lengths are not the same, cannot be same username
-        if (p_tgt_info->username.len != p_tgt_username->len)
+        p_conn_info                    = pp_conn_infos[conn_index];
+        p_conn_info->queue_link.p_prev = p_conn_queue->p_conn_rear;
+        p_conn_info->queue_link.p_next = NULL;
+        if (NULL == p_conn_queue->p_conn_rear)
         {
-            continue;
+            p_conn_queue->p_conn_front = p_conn_info;
         }
-        // compare
-        if (0
-            == strncmp(p_tgt_info->username.contents,
-                       p_tgt_username->contents,
-                       cmp_size))
+        else
         {
-            // on success, this is it
-            p_found_info = p_tgt_info;
-            goto leave;
+            p_conn_queue->p_conn_rear->queue_link.p_next = p_conn_info;
         }
+        p_conn_queue->p_conn_rear = p_conn_info;
+        p_conn_queue->num_conns++;
+        // first check once the connection could have timed out
+        rplib_timer_wheel_schedule(&p_conn_queue->idle_timers,
+                                   &p_conn_info->idle_timer,
+                                   atomic_load(&p_conn_info->last_active)
+                                       + p_conn_queue->conn_timeout + 1);
     }
+    rpchat_conn_queue_publish(p_conn_queue);
+    pthread_mutex_unlock(&p_conn_queue->mutex_conn_ll);
+}
 
+int
+rpchat_conn_queue_remove_conn_info(rpchat_conn_queue_t *p_conn_queue,
+                                   rpchat_conn_info_t  *p_conn_info)
+{
+    int                  res        = RPLIB_UNSUCCESS;
+    rpchat_conn_queue_t *p_registry = NULL;  // owner of username index
+    bool                 b_unlinked = false; // unlinked by this call
+    rpchat_conn_extra_t *p_extra    = atomic_load(&p_conn_info->p_extra);
+
+    // room broadcasts copy members under the room lock, holding snapshots
+    // that keep only linked connections alive, so leave before unlinking;
+    // the connection is closing, a retry finds it in no room
+    p_registry = rpchat_conn_queue_get_registry(p_conn_queue);
+    if (NULL != p_extra && 0 < p_extra->num_rooms)
+    {
+        pthread_mutex_lock(&p_registry->mutex_rooms);
+        rpchat_room_index_leave_all(&p_registry->room_index, p_conn_info);
+        pthread_mutex_unlock(&p_registry->mutex_rooms);
+    }
+    // audits enqueue while holding the list lock, broadcasts while holding a
+    // snapshot; once unlinked no new audit can reach the connection
+    pthread_mutex_lock(&p_conn_queue->mutex_conn_ll);
+    if (p_conn_info->b_unlinked)
+    {
+        goto leave;
+    }
+    // unlink from neighbours
+    if (NULL == p_conn_info->queue_link.p_prev)
+    {
+        p_conn_queue->p_conn_front = p_conn_info->queue_link.p_next;
+    }
+    else
+    {
+        p_conn_info->queue_link.p_prev->queue_link.p_next
+            = p_conn_info->queue_link.p_next;
+    }
+    if (NULL == p_conn_info->queue_link.p_next)
+    {
+        p_conn_queue->p_conn_rear = p_conn_info->queue_link.p_prev;
+    }
+    else
+    {
+        p_conn_info->queue_link.p_next->queue_link.p_prev
+            = p_conn_info->queue_link.p_prev;
+    }
+    p_conn_queue->num_conns--;
+    rplib_timer_wheel_cancel(&p_conn_queue->idle_timers,
+                             &p_conn_info->idle_timer);
+    p_conn_info->b_unlinked  = true;
+    b_unlinked               = true;
+    p_conn_info->retired_gen = p_conn_queue->generation + 1;
+    rpchat_conn_queue_publish(p_conn_queue);
+    // readers of older snapshots may still look at the connection
+    if (p_conn_queue->p_oldest->generation < p_conn_info->retired_gen)
+    {
+        p_conn_info->queue_link.p_next = p_conn_queue->p_retired;
+        p_conn_queue->p_retired        = p_conn_info;
+    }
+    else
+    {
+        atomic_store(&p_conn_info->b_reclaimable, true);
+    }
 leave:
     pthread_mutex_unlock(&p_conn_queue->mutex_conn_ll);
+
+    // release username, if registered
+    if (b_unlinked && 0 < p_conn_info->username.len)
+    {
+        pthread_mutex_lock(&p_registry->mutex_names);
+        rpchat_name_index_remove(&p_registry->name_index, p_conn_info);
+        pthread_mutex_unlock(&p_registry->mutex_names);
+    }
+    // mark first: a HEARTBEAT handed over by the reaper is counted by then
+    if (atomic_load(&p_conn_info->b_reclaimable)
+        && 0 == atomic_load(&p_conn_info->pending_jobs))
+    {
+        res = RPLIB_SUCCESS;
+    }
+    return res;
+}
+
+int
+rpchat_conn_queue_destroy_conn_info(rpchat_conn_info_t *p_conn_info)
+{
+    // release mutex (pinned connections never take it)
+    if (!p_conn_info->b_affinity)
+    {
+        pthread_mutex_unlock(&p_conn_info->mutex_conn);
+    }
+    rpchat_conn_info_destroy(p_conn_info);
+
+    // delete object
+    free(p_conn_info);
+    p_conn_info = NULL;
+    return RPLIB_SUCCESS;
+}
+
+rpchat_conn_info_t *
+rpchat_conn_queue_find_by_username(rpchat_conn_queue_t *p_conn_queue,
+                                   rpchat_string_t     *p_tgt_username)
+{
+    rpchat_conn_info_t  *p_found_info = NULL; // result
+    rpchat_conn_queue_t *p_registry   = NULL; // owner of username index
+
+    p_registry = rpchat_conn_queue_get_registry(p_conn_queue);
+    pthread_mutex_lock(&p_registry->mutex_names);
+    p_found_info
+        = rpchat_name_index_find(&p_registry->name_index, p_tgt_username);
+    pthread_mutex_unlock(&p_registry->mutex_names);
     return p_found_info;
 }
 
+int
+rpchat_conn_queue_claim_username(rpchat_conn_queue_t *p_conn_queue,
+                                 rpchat_conn_info_t  *p_conn_info,
+                                 rpchat_string_t     *p_username)
+{
+    int                  res        = RPLIB_UNSUCCESS;
+    rpchat_conn_queue_t *p_registry = NULL; // owner of username index
+
+    p_registry = rpchat_conn_queue_get_registry(p_conn_queue);
+    pthread_mutex_lock(&p_registry->mutex_names);
+    if (NULL != rpchat_name_index_find(&p_registry->name_index, p_username))
+    {
+        goto leave;
+    }
+    // index keys on the connection's own copy
+    res = rpchat_conn_info_set_username(p_conn_info, p_username);
+    if (RPLIB_SUCCESS != res)
+    {
+        goto leave;
+    }
+    res = rpchat_name_index_insert(&p_registry->name_index, p_conn_info);
+    if (RPLIB_SUCCESS != res)
+    {
+        rpchat_conn_info_clear_username(p_conn_info);
+    }
+leave:
+    pthread_mutex_unlock(&p_registry->mutex_names);
+    return res;
+}
+
+void
+rpchat_conn_queue_release_username(rpchat_conn_queue_t *p_conn_queue,
+                                   rpchat_conn_info_t  *p_conn_info)
+{
+    rpchat_conn_queue_t *p_registry = NULL; // owner of username index
+
+    p_registry = rpchat_conn_queue_get_registry(p_conn_queue);
+    // listings read names of connections they do not own under this lock
+    pthread_mutex_lock(&p_registry->mutex_names);
+    rpchat_name_index_remove(&p_registry->name_index, p_conn_info);
+    rpchat_conn_info_clear_username(p_conn_info);
+    pthread_mutex_unlock(&p_registry->mutex_names);
+}
+
+int
+rpchat_conn_queue_join_room(rpchat_conn_queue_t *p_conn_queue,
+                            rpchat_conn_info_t  *p_conn_info,
+                            const char          *p_name,
+                            size_t               len)
+{
+    int                  res        = RPLIB_UNSUCCESS;
+    rpchat_conn_queue_t *p_registry = NULL; // owner of room index
+
+    p_registry = rpchat_conn_queue_get_registry(p_conn_queue);
+    pthread_mutex_lock(&p_registry->mutex_rooms);
+    res = rpchat_room_index_join(
+        &p_registry->room_index, p_conn_info, p_conn_queue, p_name, len);
+    pthread_mutex_unlock(&p_registry->mutex_rooms);
+    return res;
+}
+
+int
+rpchat_conn_queue_leave_room(rpchat_conn_queue_t *p_conn_queue,
+                             rpchat_conn_info_t  *p_conn_info,
+                             const char          *p_name,
+                             size_t               len)
+{
+    int                  res        = RPLIB_UNSUCCESS;
+    rpchat_conn_queue_t *p_registry = NULL; // owner of room index
+
+    p_registry = rpchat_conn_queue_get_registry(p_conn_queue);
+    pthread_mutex_lock(&p_registry->mutex_rooms);
+    res = rpchat_room_index_leave(
+        &p_registry->room_index, p_conn_info, p_name, len);
+    pthread_mutex_unlock(&p_registry->mutex_rooms);
+    return res;
+}
+
+void
+rpchat_conn_queue_lock_rooms(rpchat_conn_queue_t *p_conn_queue)
+{
+    pthread_mutex_lock(
+        &rpchat_conn_queue_get_registry(p_conn_queue)->mutex_rooms);
+}
+
+void
+rpchat_conn_queue_unlock_rooms(rpchat_conn_queue_t *p_conn_queue)
+{
+    pthread_mutex_unlock(
+        &rpchat_conn_queue_get_registry(p_conn_queue)->mutex_rooms);
+}
+
 int
 rpchat_conn_queue_list_users(rpchat_conn_queue_t *p_conn_queue,
                              rpchat_string_t     *p_output_buf)
 {
-    int                    res         = RPLIB_UNSUCCESS;
-    rplib_ll_queue_node_t *p_curr_node = NULL;
-    rpchat_conn_info_t    *p_curr_info = NULL;
-    int                    buf_index   = p_output_buf->len - 1;
-    const char            *fmt;
+    int                     res         = RPLIB_UNSUCCESS;
+    rpchat_conn_info_t     *p_curr_info = NULL;
+    rpchat_conn_queue_t    *p_peer      = NULL; // queue currently listed
+    rpchat_conn_snapshot_t *p_snapshot  = NULL; // its connections
+    rpchat_conn_queue_t    *p_registry  = NULL; // owner of username index
+    size_t                  peer_index  = 0;    // index for peer loop
+    size_t                  conn_index  = 0;    // index for snapshot loop
+    bool                    b_first     = true; // no name written yet
+    int                     buf_index   = p_output_buf->len - 1;
 
-    pthread_mutex_lock(&p_conn_queue->mutex_conn_ll);
-    p_curr_node = p_conn_queue->p_conn_ll->p_front;
-    while (p_curr_node != NULL)
-    {
-        p_curr_info = (rpchat_conn_info_t *)p_curr_node->p_data;
-        // if not front, append comma
-        fmt = p_conn_queue->p_conn_ll->p_front == p_curr_node ? "%s" : ", %s";
-        buf_index += snprintf((char *)p_output_buf->contents + buf_index,
-                              RPCHAT_MAX_STR_LENGTH - buf_index,
-                              fmt,
-                              p_curr_info->username.contents);
-        p_curr_node = p_curr_node->p_next_node;
-    }
-    // update length
+    p_registry = rpchat_conn_queue_get_registry(p_conn_queue);
+    for (peer_index = 0; peer_index < p_conn_queue->num_peers; peer_index++)
+    {
+        p_peer     = rpchat_conn_queue_get_peer(p_conn_queue, peer_index);
+        p_snapshot = rpchat_conn_queue_acquire_snapshot(p_peer);
+        // a name released meanwhile (a claim denied by another node) is
+        // freed under the names lock, so it is held while names are copied
+        pthread_mutex_lock(&p_registry->mutex_names);
+        // stop once buffer is full
+        for (conn_index = 0; conn_index < p_snapshot->num_conns
+                             && RPCHAT_MAX_STR_LENGTH > buf_index;
+             conn_index++)
+        {
+            p_curr_info = p_snapshot->p_conns[conn_index];
+            // if not first, append comma
+            buf_index += snprintf((char *)p_output_buf->contents + buf_index,
+                                  RPCHAT_MAX_STR_LENGTH - buf_index,
+                                  b_first ? "%s" : ", %s",
+                                  p_curr_info->username.p_contents);
+            b_first = false;
+        }
+        pthread_mutex_unlock(&p_registry->mutex_names);
+        rpchat_conn_queue_release_snapshot(p_peer, p_snapshot);
+    }
+    // update length (truncated names stop at end of buffer)
+    if (RPCHAT_MAX_STR_LENGTH <= buf_index)
+    {
+        buf_index = RPCHAT_MAX_STR_LENGTH - 1;
+    }
     p_output_buf->len = buf_index;
-    pthread_mutex_unlock(&p_conn_queue->mutex_conn_ll);
-    res = RPLIB_SUCCESS;
+    res               = RPLIB_SUCCESS;
     return res;
 }
+
+size_t
+rpchat_conn_queue_count_users(rpchat_conn_queue_t *p_conn_queue)
+{
+    rpchat_conn_queue_t *p_peer     = NULL;
+    size_t               peer_index = 0;
+    size_t               num_users  = 0;
+
+    for (peer_index = 0; peer_index < p_conn_queue->num_peers; peer_index++)
+    {
+        p_peer = rpchat_conn_queue_get_peer(p_conn_queue, peer_index);
+        pthread_mutex_lock(&p_peer->mutex_conn_ll);
+        num_users += p_peer->num_conns;
+        pthread_mutex_unlock(&p_peer->mutex_conn_ll);
+    }
+    return num_users;
+}
+
+rpchat_conn_queue_t *
+rpchat_conn_queue_get_peer(rpchat_conn_queue_t *p_conn_queue,
+                           size_t               peer_index)
+{
+    assert(peer_index < p_conn_queue->num_peers);
+    return NULL == p_conn_queue->pp_peers ? p_conn_queue
+                                          : p_conn_queue->pp_peers[peer_index];
+}
+
+int
+rpchat_conn_queue_post_mail(rpchat_conn_queue_t *p_conn_queue,
+                            rpchat_shared_msg_t *p_shared_msg)
+{
+    return 1 == rpchat_conn_queue_post_mail_batch(
+               p_conn_queue, &p_shared_msg, 1)
+               ? RPLIB_SUCCESS
+               : RPLIB_UNSUCCESS;
+}
+
+size_t
+rpchat_conn_queue_post_mail_batch(rpchat_conn_queue_t  *p_conn_queue,
+                                  rpchat_shared_msg_t **pp_shared_msgs,
+                                  size_t                num_msgs)
+{
+    size_t               msg_index = 0;    // index for message loop
+    uint64_t             increment = 1;    // eventfd counter increment
+    rpchat_shared_msg_t *p_mail    = NULL; // reference held by mailbox
+
+    pthread_mutex_lock(&p_conn_queue->mutex_mailbox);
+    for (msg_index = 0; msg_index < num_msgs; msg_index++)
+    {
+        p_mail = rpchat_shared_msg_retain(pp_shared_msgs[msg_index]);
+        if (NULL
+            == rplib_ll_queue_enqueue(p_conn_queue->p_mailbox,
+                                      &p_mail,
+                                      sizeof(rpchat_shared_msg_t *)))
+        {
+            rpchat_shared_msg_release(p_mail);
+            break;
+        }
+    }
+    // wake owning reactor; counter only saturates if it stops reading
+    if (0 < msg_index
+        && 0 > write(p_conn_queue->h_fd_mailbox, &increment, sizeof(increment))
+        && EAGAIN != errno)
+    {
+        perror("eventfd");
+    }
+    pthread_mutex_unlock(&p_conn_queue->mutex_mailbox);
+    return msg_index;
+}
+
+rpchat_shared_msg_t *
+rpchat_conn_queue_take_mail(rpchat_conn_queue_t *p_conn_queue)
+{
+    rpchat_shared_msg_t   *p_shared_msg = NULL;
+    rplib_ll_queue_node_t *p_mail_node  = NULL;
+    uint64_t               counter      = 0; // drained eventfd counter
+
+    pthread_mutex_lock(&p_conn_queue->mutex_mailbox);
+    // nothing left, stop eventfd reporting readable
+    if (0 == p_conn_queue->p_mailbox->size)
+    {
+        if (0 > read(p_conn_queue->h_fd_mailbox, &counter, sizeof(counter))
+            && EAGAIN != errno)
+        {
+            perror("eventfd");
+        }
+        goto leave;
+    }
+    p_mail_node  = rplib_ll_queue_peek(p_conn_queue->p_mailbox);
+    p_shared_msg = *(rpchat_shared_msg_t **)p_mail_node->p_data;
+    rplib_ll_queue_dequeue(p_conn_queue->p_mailbox);
+leave:
+    pthread_mutex_unlock(&p_conn_queue->mutex_mailbox);
+    return p_shared_msg;
+}
+
+void
+rpchat_conn_queue_linger(rpchat_conn_queue_t *p_conn_queue,
+                         rpchat_conn_info_t  *p_conn_info)
+{
+    struct itimerspec due; // once, flush_us from now
+
+    pthread_mutex_lock(&p_conn_queue->mutex_linger);
+    // the first batch to wait sets the timer, later ones go along with it
+    if (NULL == p_conn_queue->p_lingering)
+    {
+        memset(&due, 0, sizeof(due));
+        due.it_value.tv_sec  = p_conn_queue->flush_us / 1000000;
+        due.it_value.tv_nsec = (p_conn_queue->flush_us % 1000000) * 1000;
+        if (0 > timerfd_settime(p_conn_queue->h_fd_flush, 0, &due, NULL))
+        {
+            perror("timerfd");
+        }
+    }
+    atomic_load(&p_conn_info->p_extra)->p_next_linger
+        = p_conn_queue->p_lingering;
+    p_conn_queue->p_lingering = p_conn_info;
+    pthread_mutex_unlock(&p_conn_queue->mutex_linger);
+}
+
+rpchat_conn_info_t *
+rpchat_conn_queue_take_lingering(rpchat_conn_queue_t *p_conn_queue)
+{
+    rpchat_conn_info_t *p_lingering = NULL;
+    uint64_t            expirations = 0; // drained timerfd counter
+
+    pthread_mutex_lock(&p_conn_queue->mutex_linger);
+    if (0 > read(p_conn_queue->h_fd_flush, &expirations, sizeof(expirations))
+        && EAGAIN != errno)
+    {
+        perror("timerfd");
+    }
+    p_lingering               = p_conn_queue->p_lingering;
+    p_conn_queue->p_lingering = NULL;
+    pthread_mutex_unlock(&p_conn_queue->mutex_linger);
+    return p_lingering;
+}
+
+void
+rpchat_conn_queue_stop(rpchat_conn_queue_t *p_conn_queue)
+{
+    uint64_t increment = 1;
+
+    atomic_store(&p_conn_queue->b_terminate, true);
+    if (0 > write(p_conn_queue->h_fd_mailbox, &increment, sizeof(increment))
+        && EAGAIN != errno)
+    {
+        perror("eventfd");
+    }
+}
@@ -0,0 +1,339 @@
+/** @file rpchat_file_cache.c
+ *
+ * @brief Implements the mmap-backed file cache declared in
+ * `rpchat_file_cache.h`. Entries are chained by FNV-1a hash of their name
+ * and kept on one LRU list; both are guarded by the cache mutex, while entry
+ * lifetimes are reference counted so downloads never hold the lock
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#include "components/rpchat_file_cache.h"
+
+#include <endian.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define RPCHAT_FILE_CACHE_HASH_BASIS 2166136261u // FNV-1a offset basis
+#define RPCHAT_FILE_CACHE_HASH_PRIME 16777619u   // FNV-1a prime
+
+/**
+ * Hash a filename
+ * @param p_name Pointer to null-terminated filename
+ * @return 32-bit FNV-1a hash of filename
+ */
+static uint32_t
+rpchat_file_cache_hash(const char *p_name)
+{
+    uint32_t hash = RPCHAT_FILE_CACHE_HASH_BASIS;
+
+    for (; '\0' != *p_name; p_name++)
+    {
+        hash ^= (uint8_t)*p_name;
+        hash *= RPCHAT_FILE_CACHE_HASH_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * Find the link pointing at a listed entry, or at the end of its chain.
+ * \nNote: Caller holds the cache mutex
+ * @param p_cache Pointer to cache
+ * @param p_name Pointer to null-terminated filename
+ * @param hash Hash of filename
+ * @return Pointer to link; *link is NULL if the file is not listed
+ */
+static rpchat_file_entry_t **
+rpchat_file_cache_locate(rpchat_file_cache_t *p_cache,
+                         const char          *p_name,
+                         uint32_t             hash)
+{
+    rpchat_file_entry_t **pp_link = NULL;
+
+    pp_link = &p_cache->p_buckets[hash & (RPCHAT_FILE_CACHE_BUCKETS - 1)];
+    for (; NULL != *pp_link; pp_link = &(*pp_link)->p_next_hash)
+    {
+        if (hash == (*pp_link)->hash
+            && 0 == strcmp((*pp_link)->file_name, p_name))
+        {
+            break;
+        }
+    }
+    return pp_link;
+}
+
+/**
+ * Take an entry off the LRU list.
+ * \nNote: Caller holds the cache mutex
+ * @param p_cache Pointer to cache
+ * @param p_entry Pointer to listed entry
+ */
+static void
+rpchat_file_cache_lru_unlink(rpchat_file_cache_t *p_cache,
+                             rpchat_file_entry_t *p_entry)
+{
+    if (NULL != p_entry->p_prev_lru)
+    {
+        p_entry->p_prev_lru->p_next_lru = p_entry->p_next_lru;
+    }
+    else
+    {
+        p_cache->p_lru_front = p_entry->p_next_lru;
+    }
+    if (NULL != p_entry->p_next_lru)
+    {
+        p_entry->p_next_lru->p_prev_lru = p_entry->p_prev_lru;
+    }
+    else
+    {
+        p_cache->p_lru_back = p_entry->p_prev_lru;
+    }
+    p_entry->p_prev_lru = NULL;
+    p_entry->p_next_lru = NULL;
+}
+
+/**
+ * Put an entry at the front of the LRU list.
+ * \nNote: Caller holds the cache mutex
+ * @param p_cache Pointer to cache
+ * @param p_entry Pointer to entry not on the list
+ */
+static void
+rpchat_file_cache_lru_push(rpchat_file_cache_t *p_cache,
+                           rpchat_file_entry_t *p_entry)
+{
+    p_entry->p_prev_lru = NULL;
+    p_entry->p_next_lru = p_cache->p_lru_front;
+    if (NULL != p_cache->p_lru_front)
+    {
+        p_cache->p_lru_front->p_prev_lru = p_entry;
+    }
+    else
+    {
+        p_cache->p_lru_back = p_entry;
+    }
+    p_cache->p_lru_front = p_entry;
+}
+
+/**
+ * Unlist an entry, dropping the reference the cache held.
+ * \nNote: Caller holds the cache mutex
+ * @param p_cache Pointer to cache
+ * @param pp_link Pointer to link pointing at entry in its hash chain
+ */
+static void
+rpchat_file_cache_unlist(rpchat_file_cache_t  *p_cache,
+                         rpchat_file_entry_t **pp_link)
+{
+    rpchat_file_entry_t *p_entry = *pp_link;
+
+    *pp_link = p_entry->p_next_hash;
+    rpchat_file_cache_lru_unlink(p_cache, p_entry);
+    p_cache->sz_mapped -= p_entry->file_len;
+    p_cache->num_entries--;
+    rpchat_file_entry_release(p_entry);
+}
+
+rpchat_file_cache_t *
+rpchat_file_cache_create(size_t budget)
+{
+    rpchat_file_cache_t *p_cache = NULL;
+
+    p_cache = calloc(1, sizeof(rpchat_file_cache_t));
+    if (NULL == p_cache)
+    {
+        perror("calloc");
+        goto leave;
+    }
+    if (0 != pthread_mutex_init(&p_cache->mutex_cache, NULL))
+    {
+        free(p_cache);
+        p_cache = NULL;
+        goto leave;
+    }
+    p_cache->budget = budget;
+    atomic_init(&p_cache->hits, 0);
+    atomic_init(&p_cache->misses, 0);
+leave:
+    return p_cache;
+}
+
+void
+rpchat_file_cache_destroy(rpchat_file_cache_t *p_cache)
+{
+    size_t bucket_index = 0;
+
+    if (NULL == p_cache)
+    {
+        return;
+    }
+    for (bucket_index = 0; bucket_index < RPCHAT_FILE_CACHE_BUCKETS;
+         bucket_index++)
+    {
+        while (NULL != p_cache->p_buckets[bucket_index])
+        {
+            rpchat_file_cache_unlist(p_cache,
+                                     &p_cache->p_buckets[bucket_index]);
+        }
+    }
+    pthread_mutex_destroy(&p_cache->mutex_cache);
+    free(p_cache);
+}
+
+rpchat_file_entry_t *
+rpchat_file_cache_find(rpchat_file_cache_t *p_cache,
+                       const char          *p_name,
+                       uint64_t            *p_generation)
+{
+    rpchat_file_entry_t *p_entry = NULL;
+    uint32_t             hash    = rpchat_file_cache_hash(p_name);
+
+    pthread_mutex_lock(&p_cache->mutex_cache);
+    p_entry = *rpchat_file_cache_locate(p_cache, p_name, hash);
+    if (NULL != p_entry)
+    {
+        atomic_fetch_add_explicit(&p_entry->refcount, 1, memory_order_relaxed);
+        rpchat_file_cache_lru_unlink(p_cache, p_entry);
+        rpchat_file_cache_lru_push(p_cache, p_entry);
+    }
+    *p_generation = p_cache->generation;
+    pthread_mutex_unlock(&p_cache->mutex_cache);
+
+    atomic_fetch_add_explicit(NULL != p_entry ? &p_cache->hits
+                                              : &p_cache->misses,
+                              1,
+                              memory_order_relaxed);
+    return p_entry;
+}
+
+rpchat_file_entry_t *
+rpchat_file_cache_insert(rpchat_file_cache_t *p_cache,
+                         const char          *p_name,
+                         int                  h_fd_file,
+                         uint32_t             file_len,
+                         uint64_t             generation)
+{
+    rpchat_file_entry_t  *p_entry = NULL;
+    rpchat_file_entry_t **pp_link = NULL;
+    void                 *p_map   = NULL;
+
+    if (RPCHAT_FILE_CACHE_MAX_FILE < file_len || p_cache->budget < file_len
+        || RPCHAT_FILE_CACHE_NAME_MAX < strlen(p_name))
+    {
+        goto leave;
+    }
+    // mapping happens outside the lock, it may have to fault in metadata
+    if (0 < file_len)
+    {
+        p_map = mmap(NULL, file_len, PROT_READ, MAP_SHARED, h_fd_file, 0);
+        if (MAP_FAILED == p_map)
+        {
+            p_map = NULL;
+            goto leave;
+        }
+    }
+    p_entry = malloc(sizeof(rpchat_file_entry_t));
+    if (NULL == p_entry)
+    {
+        if (NULL != p_map)
+        {
+            munmap(p_map, file_len);
+        }
+        goto leave;
+    }
+    atomic_init(&p_entry->refcount, 1); // the caller's
+    p_entry->p_next_hash     = NULL;
+    p_entry->p_prev_lru      = NULL;
+    p_entry->p_next_lru      = NULL;
+    p_entry->hash            = rpchat_file_cache_hash(p_name);
+    p_entry->file_len        = file_len;
+    p_entry->p_contents      = p_map;
+    p_entry->header.opcode   = RPCHAT_BCP_RECVFILE;
+    p_entry->header.file_len = htobe32(file_len);
+    strcpy(p_entry->file_name, p_name);
+
+    pthread_mutex_lock(&p_cache->mutex_cache);
+    pp_link = rpchat_file_cache_locate(p_cache, p_name, p_entry->hash);
+    // replaced since the lookup, or another download listed it first: serve
+    // this mapping once and leave the table alone
+    if (generation != p_cache->generation || NULL != *pp_link)
+    {
+        goto unlock;
+    }
+    // make room, least recently used first
+    while (NULL != p_cache->p_lru_back
+           && p_cache->budget - p_cache->sz_mapped < file_len)
+    {
+        rpchat_file_cache_unlist(
+            p_cache,
+            rpchat_file_cache_locate(p_cache,
+                                     p_cache->p_lru_back->file_name,
+                                     p_cache->p_lru_back->hash));
+    }
+    // evictions may have emptied the chain, find its end again
+    pp_link  = rpchat_file_cache_locate(p_cache, p_name, p_entry->hash);
+    *pp_link = p_entry;
+    atomic_fetch_add_explicit(&p_entry->refcount, 1, memory_order_relaxed);
+    rpchat_file_cache_lru_push(p_cache, p_entry);
+    p_cache->sz_mapped += file_len;
+    p_cache->num_entries++;
+unlock:
+    pthread_mutex_unlock(&p_cache->mutex_cache);
+leave:
+    return p_entry;
+}
+
+void
+rpchat_file_cache_invalidate(rpchat_file_cache_t *p_cache, const char *p_name)
+{
+    rpchat_file_entry_t **pp_link = NULL;
+
+    if (NULL == p_cache)
+    {
+        return;
+    }
+    pthread_mutex_lock(&p_cache->mutex_cache);
+    // lookups that missed before this cannot list what they mapped
+    p_cache->generation++;
+    pp_link = rpchat_file_cache_locate(
+        p_cache, p_name, rpchat_file_cache_hash(p_name));
+    if (NULL != *pp_link)
+    {
+        rpchat_file_cache_unlist(p_cache, pp_link);
+    }
+    pthread_mutex_unlock(&p_cache->mutex_cache);
+}
+
+void
+rpchat_file_entry_release(rpchat_file_entry_t *p_entry)
+{
+    // last holder unmaps
+    if (1
+        == atomic_fetch_sub_explicit(
+            &p_entry->refcount, 1, memory_order_acq_rel))
+    {
+        if (NULL != p_entry->p_contents)
+        {
+            munmap((void *)p_entry->p_contents, p_entry->file_len);
+        }
+        free(p_entry);
+    }
+}
+
+void
+rpchat_file_cache_get_stats(rpchat_file_cache_t       *p_cache,
+                            rpchat_file_cache_stats_t *p_stats)
+{
+    p_stats->hits = atomic_load_explicit(&p_cache->hits, memory_order_relaxed);
+    p_stats->misses
+        = atomic_load_explicit(&p_cache->misses, memory_order_relaxed);
+    pthread_mutex_lock(&p_cache->mutex_cache);
+    p_stats->num_entries = p_cache->num_entries;
+    p_stats->sz_mapped   = p_cache->sz_mapped;
+    pthread_mutex_unlock(&p_cache->mutex_cache);
+}
+
+/*** end of file ***/
@@ -0,0 +1,508 @@
+/** @file rpchat_file_xfer.c
+ *
+ * @brief Implements resumable zero-copy file transfers declared in
+ * `rpchat_file_xfer.h`
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#define _GNU_SOURCE // splice, F_SETPIPE_SZ
+
+#include "components/rpchat_file_xfer.h"
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/**
+ * Allocate a transfer with no descriptors open
+ * @param p_pool Allocator to take transfer from
+ * @param p_cache Cache of file directory, may be NULL
+ * @param h_fd_dir File directory descriptor
+ * @param direction Which way bytes move
+ * @param p_name Pointer to checked filename; NULL for none
+ * @return Pointer to transfer; NULL on allocation failure
+ */
+static rpchat_file_xfer_t *
+rpchat_file_xfer_create(rplib_pool_t          *p_pool,
+                        rpchat_file_cache_t   *p_cache,
+                        int                    h_fd_dir,
+                        rpchat_file_xfer_dir_t direction,
+                        const rpchat_string_t *p_name)
+{
+    rpchat_file_xfer_t *p_xfer = NULL;
+
+    p_xfer = rplib_pool_alloc(p_pool, sizeof(rpchat_file_xfer_t));
+    if (NULL == p_xfer)
+    {
+        goto leave;
+    }
+    p_xfer->direction    = direction;
+    p_xfer->h_fd_dir     = h_fd_dir;
+    p_xfer->p_cache      = p_cache;
+    p_xfer->p_entry      = NULL;
+    p_xfer->h_fd_file    = RPLIB_ERROR;
+    p_xfer->h_fd_pipe[0] = RPLIB_ERROR;
+    p_xfer->h_fd_pipe[1] = RPLIB_ERROR;
+    p_xfer->sz_in_pipe   = 0;
+    p_xfer->offset       = 0;
+    p_xfer->file_len     = 0;
+    p_xfer->remaining    = 0;
+    p_xfer->b_failed     = false;
+    p_xfer->b_committed  = false;
+    p_xfer->p_pool       = p_pool;
+    p_xfer->part_name[0] = '\0';
+    p_xfer->file_name[0] = '\0';
+    if (NULL != p_name)
+    {
+        // checked name fits, a terminator sent along is dropped here
+        snprintf(p_xfer->file_name,
+                 sizeof(p_xfer->file_name),
+                 "%.*s",
+                 (int)p_name->len,
+                 p_name->contents);
+    }
+leave:
+    return p_xfer;
+}
+
+/**
+ * Close a descriptor of a transfer, if open
+ * @param p_h_fd Pointer to descriptor; set to RPLIB_ERROR
+ */
+static void
+rpchat_file_xfer_close(int *p_h_fd)
+{
+    if (0 <= *p_h_fd)
+    {
+        close(*p_h_fd);
+    }
+    *p_h_fd = RPLIB_ERROR;
+}
+
+/**
+ * Give up on storing an upload. Its part file is removed and whatever is in
+ * the pipe is dropped; remaining contents are discarded as they arrive
+ * @param p_xfer Pointer to upload
+ */
+static void
+rpchat_file_xfer_fail(rpchat_file_xfer_t *p_xfer)
+{
+    p_xfer->b_failed = true;
+    rpchat_file_xfer_close(&p_xfer->h_fd_file);
+    rpchat_file_xfer_close(&p_xfer->h_fd_pipe[0]);
+    rpchat_file_xfer_close(&p_xfer->h_fd_pipe[1]);
+    p_xfer->sz_in_pipe = 0;
+    unlinkat(p_xfer->h_fd_dir, p_xfer->part_name, 0);
+}
+
+/**
+ * Write contents that were buffered along with the SENDFILE header
+ * @param p_xfer Pointer to upload
+ * @param p_iov Pointer to regions of inbound buffer
+ * @param iov_count Number of regions
+ * @return RPLIB_SUCCESS if all written, RPLIB_ERROR otherwise
+ */
+static int
+rpchat_file_xfer_write_iov(rpchat_file_xfer_t *p_xfer,
+                           struct iovec       *p_iov,
+                           int                 iov_count)
+{
+    ssize_t written = 0;
+
+    while (0 < iov_count)
+    {
+        written = writev(p_xfer->h_fd_file, p_iov, iov_count);
+        if (0 > written && EINTR == errno)
+        {
+            continue;
+        }
+        if (0 >= written)
+        {
+            return RPLIB_ERROR;
+        }
+        while (0 < iov_count && (size_t)written >= p_iov->iov_len)
+        {
+            written -= (ssize_t)p_iov->iov_len;
+            p_iov++;
+            iov_count--;
+        }
+        if (0 < iov_count)
+        {
+            p_iov->iov_base = (char *)p_iov->iov_base + written;
+            p_iov->iov_len -= (size_t)written;
+        }
+    }
+    return RPLIB_SUCCESS;
+}
+
+/**
+ * Map a failed socket call to how a transfer step ends
+ * @return RPCHAT_FILE_XFER_BLOCKED if the socket would block, otherwise
+ * RPCHAT_FILE_XFER_FAILED
+ */
+static rpchat_file_xfer_res_t
+rpchat_file_xfer_sock_error(void)
+{
+    return (EAGAIN == errno || EWOULDBLOCK == errno) ? RPCHAT_FILE_XFER_BLOCKED
+                                                     : RPCHAT_FILE_XFER_FAILED;
+}
+
+bool
+rpchat_file_xfer_check_name(const rpchat_string_t *p_name)
+{
+    size_t char_index = 0;
+    char   curr_char  = 0;
+    size_t name_len   = p_name->len;
+
+    // clients may or may not null-terminate
+    if (0 < name_len && '\0' == p_name->contents[name_len - 1])
+    {
+        name_len--;
+    }
+    if (0 == name_len || RPCHAT_FILE_NAME_MAX < name_len
+        || '.' == p_name->contents[0])
+    {
+        return false;
+    }
+    for (char_index = 0; char_index < name_len; char_index++)
+    {
+        curr_char = p_name->contents[char_index];
+        if (RPCHAT_FILTER_ASCII_START > curr_char
+            || RPCHAT_FILTER_ASCII_END < curr_char || '/' == curr_char)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+rpchat_file_xfer_t *
+rpchat_file_xfer_begin_upload(rplib_pool_t          *p_pool,
+                              rpchat_file_cache_t   *p_cache,
+                              int                    h_fd_dir,
+                              int                    h_fd_sock,
+                              const rpchat_string_t *p_name,
+                              uint32_t               file_len)
+{
+    rpchat_file_xfer_t *p_xfer = NULL;
+
+    // rejected names still need their contents taken off the socket
+    p_xfer = rpchat_file_xfer_create(p_pool,
+                                     p_cache,
+                                     h_fd_dir,
+                                     RPCHAT_FILE_XFER_UPLOAD,
+                                     rpchat_file_xfer_check_name(p_name)
+                                         ? p_name
+                                         : NULL);
+    if (NULL == p_xfer)
+    {
+        goto leave;
+    }
+    p_xfer->file_len  = file_len;
+    p_xfer->remaining = file_len;
+    if ('\0' == p_xfer->file_name[0] || 0 > h_fd_dir)
+    {
+        p_xfer->b_failed = true;
+        goto leave;
+    }
+
+    // write under a name clients cannot ask for, publish once complete
+    snprintf(p_xfer->part_name,
+             sizeof(p_xfer->part_name),
+             RPCHAT_FILE_PART_FMT,
+             h_fd_sock,
+             p_xfer->file_name);
+    p_xfer->h_fd_file
+        = openat(h_fd_dir,
+                 p_xfer->part_name,
+                 O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC,
+                 RPCHAT_FILE_MODE);
+    if (0 > p_xfer->h_fd_file
+        || 0 > pipe2(p_xfer->h_fd_pipe, O_NONBLOCK | O_CLOEXEC))
+    {
+        rpchat_file_xfer_fail(p_xfer);
+        goto leave;
+    }
+    // larger pipe, fewer splices per upload; the default size works too
+    fcntl(p_xfer->h_fd_pipe[1], F_SETPIPE_SZ, RPCHAT_FILE_PIPE_SZ);
+leave:
+    return p_xfer;
+}
+
+rpchat_file_xfer_t *
+rpchat_file_xfer_begin_download(rplib_pool_t          *p_pool,
+                                rpchat_file_cache_t   *p_cache,
+                                int                    h_fd_dir,
+                                const rpchat_string_t *p_name)
+{
+    rpchat_file_xfer_t *p_xfer     = NULL;
+    uint64_t            generation = 0; // cache generation at lookup
+    struct stat         file_stat;
+
+    if (0 > h_fd_dir || !rpchat_file_xfer_check_name(p_name))
+    {
+        goto leave;
+    }
+    p_xfer = rpchat_file_xfer_create(
+        p_pool, p_cache, h_fd_dir, RPCHAT_FILE_XFER_DOWNLOAD, p_name);
+    if (NULL == p_xfer)
+    {
+        goto leave;
+    }
+    // repeat downloads skip the directory entirely
+    if (NULL != p_cache)
+    {
+        p_xfer->p_entry
+            = rpchat_file_cache_find(p_cache, p_xfer->file_name, &generation);
+    }
+    if (NULL != p_xfer->p_entry)
+    {
+        p_xfer->file_len  = p_xfer->p_entry->file_len;
+        p_xfer->remaining = p_xfer->file_len;
+        p_xfer->header    = p_xfer->p_entry->header;
+        goto leave;
+    }
+    p_xfer->h_fd_file = openat(
+        h_fd_dir, p_xfer->file_name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    // only regular files whose length fits the flen field
+    if (0 > p_xfer->h_fd_file || 0 > fstat(p_xfer->h_fd_file, &file_stat)
+        || !S_ISREG(file_stat.st_mode) || UINT32_MAX < file_stat.st_size)
+    {
+        rpchat_file_xfer_destroy(p_xfer);
+        p_xfer = NULL;
+        goto leave;
+    }
+    p_xfer->file_len        = (uint32_t)file_stat.st_size;
+    p_xfer->remaining       = p_xfer->file_len;
+    p_xfer->header.opcode   = RPCHAT_BCP_RECVFILE;
+    p_xfer->header.file_len = htobe32(p_xfer->file_len);
+    // keep it for the downloads to come; files too large still use sendfile
+    if (NULL != p_cache)
+    {
+        p_xfer->p_entry = rpchat_file_cache_insert(p_cache,
+                                                   p_xfer->file_name,
+                                                   p_xfer->h_fd_file,
+                                                   p_xfer->file_len,
+                                                   generation);
+    }
+    if (NULL != p_xfer->p_entry)
+    {
+        rpchat_file_xfer_close(&p_xfer->h_fd_file);
+    }
+leave:
+    return p_xfer;
+}
+
+rpchat_file_xfer_res_t
+rpchat_file_xfer_recv(rpchat_file_xfer_t *p_xfer,
+                      int                 h_fd_sock,
+                      rplib_ring_buf_t   *p_inbound)
+{
+    rpchat_file_xfer_res_t res       = RPCHAT_FILE_XFER_DONE;
+    struct iovec           data_iov[2]; // contents buffered with header
+    int                    iov_count = 0;
+    size_t                 sz_data   = 0;
+    size_t                 budget    = RPCHAT_FILE_XFER_SLICE;
+    size_t                 sz_chunk  = 0;
+    ssize_t                moved     = 0;
+
+    // whatever arrived along with the header goes first
+    iov_count = rplib_ring_buf_get_data_iov(
+        p_inbound, data_iov, p_xfer->remaining);
+    if (0 < iov_count)
+    {
+        sz_data = data_iov[0].iov_len + (2 == iov_count ? data_iov[1].iov_len
+                                                        : 0);
+        if (!p_xfer->b_failed
+            && RPLIB_SUCCESS
+                   != rpchat_file_xfer_write_iov(p_xfer, data_iov, iov_count))
+        {
+            rpchat_file_xfer_fail(p_xfer);
+        }
+        rplib_ring_buf_consume(p_inbound, sz_data);
+        p_xfer->remaining -= sz_data;
+    }
+
+    while (0 < p_xfer->remaining || 0 < p_xfer->sz_in_pipe)
+    {
+        // pull the next part off the socket into the pipe, or drop it
+        if (0 == p_xfer->sz_in_pipe)
+        {
+            if (0 == budget)
+            {
+                res = RPCHAT_FILE_XFER_YIELD;
+                break;
+            }
+            sz_chunk = p_xfer->remaining < budget ? p_xfer->remaining : budget;
+            if (p_xfer->b_failed)
+            {
+                moved = recv(
+                    h_fd_sock, NULL, sz_chunk, MSG_TRUNC | MSG_DONTWAIT);
+            }
+            else
+            {
+                moved = splice(h_fd_sock,
+                               NULL,
+                               p_xfer->h_fd_pipe[1],
+                               NULL,
+                               sz_chunk < RPCHAT_FILE_PIPE_SZ
+                                   ? sz_chunk
+                                   : RPCHAT_FILE_PIPE_SZ,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            }
+            if (0 > moved && EINTR == errno)
+            {
+                continue;
+            }
+            if (0 > moved)
+            {
+                res = rpchat_file_xfer_sock_error();
+                break;
+            }
+            // peer closed mid-upload
+            if (0 == moved)
+            {
+                res = RPCHAT_FILE_XFER_FAILED;
+                break;
+            }
+            p_xfer->remaining -= (uint32_t)moved;
+            budget -= (size_t)moved;
+            p_xfer->sz_in_pipe = p_xfer->b_failed ? 0 : (size_t)moved;
+        }
+        // then from the pipe into the file
+        if (0 < p_xfer->sz_in_pipe)
+        {
+            moved = splice(p_xfer->h_fd_pipe[0],
+                           NULL,
+                           p_xfer->h_fd_file,
+                           NULL,
+                           p_xfer->sz_in_pipe,
+                           SPLICE_F_MOVE);
+            if (0 > moved && EINTR == errno)
+            {
+                continue;
+            }
+            if (0 >= moved)
+            {
+                rpchat_file_xfer_fail(p_xfer);
+                continue;
+            }
+            p_xfer->sz_in_pipe -= (size_t)moved;
+        }
+    }
+    return res;
+}
+
+rpchat_file_xfer_res_t
+rpchat_file_xfer_send(rpchat_file_xfer_t *p_xfer, int h_fd_sock)
+{
+    rpchat_file_xfer_res_t res      = RPCHAT_FILE_XFER_DONE;
+    size_t                 budget   = RPCHAT_FILE_XFER_SLICE;
+    size_t                 sz_chunk = 0;
+    ssize_t                moved    = 0;
+
+    while (0 < p_xfer->remaining)
+    {
+        if (0 == budget)
+        {
+            res = RPCHAT_FILE_XFER_YIELD;
+            break;
+        }
+        sz_chunk = p_xfer->remaining < budget ? p_xfer->remaining : budget;
+        // MSG_NOSIGNAL: a client that went away is an error, not a SIGPIPE
+        if (NULL != p_xfer->p_entry)
+        {
+            moved = send(h_fd_sock,
+                         p_xfer->p_entry->p_contents + p_xfer->offset,
+                         sz_chunk,
+                         MSG_NOSIGNAL);
+            p_xfer->offset += (0 < moved) ? moved : 0;
+        }
+        else
+        {
+            moved = sendfile(
+                h_fd_sock, p_xfer->h_fd_file, &p_xfer->offset, sz_chunk);
+        }
+        if (0 > moved && EINTR == errno)
+        {
+            continue;
+        }
+        if (0 > moved)
+        {
+            res = rpchat_file_xfer_sock_error();
+            break;
+        }
+        // file shrank since flen was sent, the stream cannot be completed
+        if (0 == moved)
+        {
+            res = RPCHAT_FILE_XFER_FAILED;
+            break;
+        }
+        p_xfer->remaining -= (uint32_t)moved;
+        budget -= (size_t)moved;
+    }
+    return res;
+}
+
+int
+rpchat_file_xfer_commit(rpchat_file_xfer_t *p_xfer)
+{
+    int res = RPLIB_UNSUCCESS;
+
+    if (RPCHAT_FILE_XFER_UPLOAD != p_xfer->direction || p_xfer->b_failed)
+    {
+        goto leave;
+    }
+    rpchat_file_xfer_close(&p_xfer->h_fd_file);
+    // replaces any earlier upload of the same name in one step
+    if (0
+        > renameat(p_xfer->h_fd_dir,
+                   p_xfer->part_name,
+                   p_xfer->h_fd_dir,
+                   p_xfer->file_name))
+    {
+        rpchat_file_xfer_fail(p_xfer);
+        goto leave;
+    }
+    p_xfer->b_committed = true;
+    // later downloads must not get the contents this replaced
+    rpchat_file_cache_invalidate(p_xfer->p_cache, p_xfer->file_name);
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+void
+rpchat_file_xfer_destroy(rpchat_file_xfer_t *p_xfer)
+{
+    if (NULL == p_xfer)
+    {
+        return;
+    }
+    rpchat_file_xfer_close(&p_xfer->h_fd_file);
+    rpchat_file_xfer_close(&p_xfer->h_fd_pipe[0]);
+    rpchat_file_xfer_close(&p_xfer->h_fd_pipe[1]);
+    if (NULL != p_xfer->p_entry)
+    {
+        rpchat_file_entry_release(p_xfer->p_entry);
+        p_xfer->p_entry = NULL;
+    }
+    // unfinished uploads leave nothing behind
+    if (RPCHAT_FILE_XFER_UPLOAD == p_xfer->direction && !p_xfer->b_committed
+        && !p_xfer->b_failed)
+    {
+        unlinkat(p_xfer->h_fd_dir, p_xfer->part_name, 0);
+    }
+    rplib_pool_free(p_xfer->p_pool, p_xfer);
+}
+
+/*** end of file ***/
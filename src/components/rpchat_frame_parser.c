@@ -0,0 +1,230 @@
+/** @file rpchat_frame_parser.c
+ *
+ * @brief Implements incremental parser for inbound BCP frames
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#include "components/rpchat_frame_parser.h"
+
+#include <endian.h>
+
+void
+rpchat_frame_parser_reset(rpchat_frame_parser_t *p_parser)
+{
+    p_parser->sz_frame = 0;
+}
+
+int
+rpchat_frame_parser_check(rpchat_frame_parser_t *p_parser,
+                          rplib_ring_buf_t      *p_ring)
+{
+    int      res      = RPLIB_UNSUCCESS;
+    char     opcode   = 0; // opcode of front frame
+    uint16_t str_len  = 0; // string length field of front frame
+    uint16_t room_len = 0; // room length field of front room frame
+
+    // header already decoded on a previous pass, just need the body
+    if (0 < p_parser->sz_frame)
+    {
+        goto check_size;
+    }
+    // need at least an opcode to do anything
+    if (RPLIB_SUCCESS
+        != rplib_ring_buf_peek(p_ring, 0, &opcode, RPCHAT_FRAME_OPCODE_SZ))
+    {
+        goto leave;
+    }
+    // server only accepts REGISTER, SEND, STATUS, SENDFILE, GETFILE, REGWIN,
+    // ACK, JOIN, LEAVE and ROOMSEND
+    switch (rpchat_get_msg_type(&opcode))
+    {
+        case RPCHAT_BCP_REGISTER:
+            // drop down, same layout
+        case RPCHAT_BCP_REGWIN:
+            // drop down, window follows for REGWIN
+        case RPCHAT_BCP_SEND:
+            // drop down, same layout
+        case RPCHAT_BCP_GETFILE:
+            // drop down, flen follows for SENDFILE
+        case RPCHAT_BCP_SENDFILE:
+            // opcode | len | contents
+            if (RPLIB_SUCCESS
+                != rplib_ring_buf_peek(p_ring,
+                                       RPCHAT_FRAME_OPCODE_SZ,
+                                       &str_len,
+                                       RPCHAT_FRAME_STRLEN_SZ))
+            {
+                goto leave;
+            }
+            str_len = be16toh(str_len);
+            // if larger than authorized, kill
+            if (RPCHAT_MAX_STR_LENGTH < str_len)
+            {
+                res = RPLIB_ERROR;
+                goto leave;
+            }
+            p_parser->sz_frame
+                = RPCHAT_FRAME_OPCODE_SZ + RPCHAT_FRAME_STRLEN_SZ + str_len;
+            if (RPCHAT_BCP_SENDFILE == rpchat_get_msg_type(&opcode))
+            {
+                p_parser->sz_frame += RPCHAT_FRAME_FLEN_SZ;
+            }
+            if (RPCHAT_BCP_REGWIN == rpchat_get_msg_type(&opcode))
+            {
+                p_parser->sz_frame += RPCHAT_FRAME_CODE_SZ;
+            }
+            break;
+        case RPCHAT_BCP_STATUS:
+            // drop down, same layout
+        case RPCHAT_BCP_ACK:
+            // opcode | code
+            p_parser->sz_frame = RPCHAT_FRAME_OPCODE_SZ + RPCHAT_FRAME_CODE_SZ;
+            break;
+        case RPCHAT_BCP_JOIN:
+            // drop down, same layout
+        case RPCHAT_BCP_LEAVE:
+            // drop down, message follows for ROOMSEND
+        case RPCHAT_BCP_ROOMSEND:
+            // opcode | len | room [| len | contents]
+            if (RPLIB_SUCCESS
+                != rplib_ring_buf_peek(p_ring,
+                                       RPCHAT_FRAME_OPCODE_SZ,
+                                       &room_len,
+                                       RPCHAT_FRAME_STRLEN_SZ))
+            {
+                goto leave;
+            }
+            room_len = be16toh(room_len);
+            if (RPCHAT_BCP_MAX_ROOM_LENGTH < room_len)
+            {
+                res = RPLIB_ERROR;
+                goto leave;
+            }
+            p_parser->sz_frame
+                = RPCHAT_FRAME_OPCODE_SZ + RPCHAT_FRAME_STRLEN_SZ + room_len;
+            if (RPCHAT_BCP_ROOMSEND != rpchat_get_msg_type(&opcode))
+            {
+                break;
+            }
+            // header ends with the message length, decoded from scratch
+            // until it arrives
+            if (RPLIB_SUCCESS
+                != rplib_ring_buf_peek(p_ring,
+                                       p_parser->sz_frame,
+                                       &str_len,
+                                       RPCHAT_FRAME_STRLEN_SZ))
+            {
+                p_parser->sz_frame = 0;
+                goto leave;
+            }
+            str_len = be16toh(str_len);
+            if (RPCHAT_MAX_STR_LENGTH < str_len)
+            {
+                res = RPLIB_ERROR;
+                goto leave;
+            }
+            p_parser->sz_frame += RPCHAT_FRAME_STRLEN_SZ + str_len;
+            break;
+        default:
+            res = RPLIB_ERROR;
+            goto leave;
+    }
+check_size:
+    res = p_parser->sz_frame <= rplib_ring_buf_size(p_ring) ? RPLIB_SUCCESS
+                                                            : RPLIB_UNSUCCESS;
+leave:
+    return res;
+}
+
+int
+rpchat_frame_parser_next(rpchat_frame_parser_t *p_parser,
+                         rplib_ring_buf_t      *p_ring,
+                         rpchat_frame_t        *p_frame)
+{
+    int      res     = RPLIB_UNSUCCESS;
+    char     opcode  = 0;
+    uint16_t str_len = 0; // room length field of room frames
+
+    // make sure entire frame is present
+    res = rpchat_frame_parser_check(p_parser, p_ring);
+    if (RPLIB_SUCCESS != res)
+    {
+        goto leave;
+    }
+
+    // decode fields
+    rplib_ring_buf_peek(p_ring, 0, &opcode, RPCHAT_FRAME_OPCODE_SZ);
+    p_frame->msg_type     = rpchat_get_msg_type(&opcode);
+    p_frame->code         = 0;
+    p_frame->file_len     = 0;
+    p_frame->room_len     = 0;
+    p_frame->contents.len         = 0;
+    p_frame->contents.b_sanitized = false;
+    if (RPCHAT_BCP_STATUS == p_frame->msg_type
+        || RPCHAT_BCP_ACK == p_frame->msg_type)
+    {
+        rplib_ring_buf_peek(
+            p_ring, RPCHAT_FRAME_OPCODE_SZ, &p_frame->code, sizeof(uint8_t));
+    }
+    else if (RPCHAT_BCP_JOIN == p_frame->msg_type
+             || RPCHAT_BCP_LEAVE == p_frame->msg_type
+             || RPCHAT_BCP_ROOMSEND == p_frame->msg_type)
+    {
+        rplib_ring_buf_peek(p_ring,
+                            RPCHAT_FRAME_OPCODE_SZ,
+                            &str_len,
+                            RPCHAT_FRAME_STRLEN_SZ);
+        p_frame->room_len = be16toh(str_len);
+        rplib_ring_buf_peek(p_ring,
+                            RPCHAT_FRAME_OPCODE_SZ + RPCHAT_FRAME_STRLEN_SZ,
+                            p_frame->room,
+                            p_frame->room_len);
+        // rest of a ROOMSEND is the message
+        p_frame->contents.len = p_parser->sz_frame - RPCHAT_FRAME_OPCODE_SZ
+                                - RPCHAT_FRAME_STRLEN_SZ - p_frame->room_len;
+        if (RPCHAT_BCP_ROOMSEND == p_frame->msg_type)
+        {
+            p_frame->contents.len -= RPCHAT_FRAME_STRLEN_SZ;
+            rplib_ring_buf_peek(p_ring,
+                                RPCHAT_FRAME_OPCODE_SZ
+                                    + 2 * RPCHAT_FRAME_STRLEN_SZ
+                                    + p_frame->room_len,
+                                p_frame->contents.contents,
+                                p_frame->contents.len);
+        }
+    }
+    else
+    {
+        p_frame->contents.len = p_parser->sz_frame - RPCHAT_FRAME_OPCODE_SZ
+                                - RPCHAT_FRAME_STRLEN_SZ;
+        if (RPCHAT_BCP_SENDFILE == p_frame->msg_type)
+        {
+            p_frame->contents.len -= RPCHAT_FRAME_FLEN_SZ;
+            rplib_ring_buf_peek(p_ring,
+                                p_parser->sz_frame - RPCHAT_FRAME_FLEN_SZ,
+                                &p_frame->file_len,
+                                RPCHAT_FRAME_FLEN_SZ);
+            p_frame->file_len = be32toh(p_frame->file_len);
+        }
+        if (RPCHAT_BCP_REGWIN == p_frame->msg_type)
+        {
+            p_frame->contents.len -= RPCHAT_FRAME_CODE_SZ;
+            rplib_ring_buf_peek(p_ring,
+                                p_parser->sz_frame - RPCHAT_FRAME_CODE_SZ,
+                                &p_frame->code,
+                                RPCHAT_FRAME_CODE_SZ);
+        }
+        rplib_ring_buf_peek(p_ring,
+                            RPCHAT_FRAME_OPCODE_SZ + RPCHAT_FRAME_STRLEN_SZ,
+                            p_frame->contents.contents,
+                            p_frame->contents.len);
+    }
+
+    // frame handled, move on to the next
+    rplib_ring_buf_consume(p_ring, p_parser->sz_frame);
+    rpchat_frame_parser_reset(p_parser);
+leave:
+    return res;
+}
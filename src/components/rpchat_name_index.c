@@ -0,0 +1,224 @@
+/** @file rpchat_name_index.c
+ *
+ * @brief Implements linearly probed username index with backward-shift
+ * deletion, so lookups never wade through tombstones
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#include "components/rpchat_name_index.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "components/rpchat_conn_info.h"
+
+#define RPCHAT_NAME_HASH_BASIS 2166136261u // FNV-1a offset basis
+#define RPCHAT_NAME_HASH_PRIME 16777619u   // FNV-1a prime
+
+uint32_t
+rpchat_name_index_hash(const char *p_name, size_t len)
+{
+    uint32_t hash       = RPCHAT_NAME_HASH_BASIS;
+    size_t   char_index = 0;
+
+    for (char_index = 0; char_index < len; char_index++)
+    {
+        hash ^= (uint8_t)p_name[char_index];
+        hash *= RPCHAT_NAME_HASH_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * Find the slot holding a username, or the empty slot ending its probe
+ * @param p_index Pointer to index
+ * @param p_name Pointer to username contents
+ * @param len Length of username
+ * @param hash Hash of username
+ * @return Index of slot
+ */
+static size_t
+rpchat_name_index_probe(rpchat_name_index_t *p_index,
+                        const char          *p_name,
+                        size_t               len,
+                        uint32_t             hash)
+{
+    size_t              mask       = p_index->capacity - 1;
+    size_t              slot_index = hash & mask;
+    rpchat_name_slot_t *p_slot     = NULL;
+
+    // load factor stays at or below half, so an empty slot always ends this
+    for (;; slot_index = (slot_index + 1) & mask)
+    {
+        p_slot = &p_index->p_slots[slot_index];
+        if (NULL == p_slot->p_conn_info)
+        {
+            break;
+        }
+        if (hash == p_slot->hash && len == p_slot->p_conn_info->username.len
+            && 0
+                   == memcmp(
+                       p_name, p_slot->p_conn_info->username.p_contents, len))
+        {
+            break;
+        }
+    }
+    return slot_index;
+}
+
+/**
+ * Double the number of slots, rehashing every entry
+ * @param p_index Pointer to index
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on allocation failure
+ */
+static int
+rpchat_name_index_grow(rpchat_name_index_t *p_index)
+{
+    int                 res          = RPLIB_ERROR;
+    rpchat_name_slot_t *p_old_slots  = p_index->p_slots;
+    size_t              old_capacity = p_index->capacity;
+    size_t              old_index    = 0;
+    size_t              slot_index   = 0;
+    size_t              mask         = 0;
+
+    p_index->p_slots = calloc(old_capacity * 2, sizeof(rpchat_name_slot_t));
+    if (NULL == p_index->p_slots)
+    {
+        p_index->p_slots = p_old_slots;
+        goto leave;
+    }
+    p_index->capacity = old_capacity * 2;
+    mask              = p_index->capacity - 1;
+    // names are unique, so each only needs the first empty slot
+    for (old_index = 0; old_index < old_capacity; old_index++)
+    {
+        if (NULL == p_old_slots[old_index].p_conn_info)
+        {
+            continue;
+        }
+        slot_index = p_old_slots[old_index].hash & mask;
+        while (NULL != p_index->p_slots[slot_index].p_conn_info)
+        {
+            slot_index = (slot_index + 1) & mask;
+        }
+        p_index->p_slots[slot_index] = p_old_slots[old_index];
+    }
+    free(p_old_slots);
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+int
+rpchat_name_index_initialize(rpchat_name_index_t *p_index)
+{
+    int res = RPLIB_ERROR;
+
+    p_index->num_names = 0;
+    p_index->capacity  = RPCHAT_NAME_INDEX_MIN_CAPACITY;
+    p_index->p_slots
+        = calloc(RPCHAT_NAME_INDEX_MIN_CAPACITY, sizeof(rpchat_name_slot_t));
+    if (NULL != p_index->p_slots)
+    {
+        res = RPLIB_SUCCESS;
+    }
+    return res;
+}
+
+void
+rpchat_name_index_destroy(rpchat_name_index_t *p_index)
+{
+    free(p_index->p_slots);
+    p_index->p_slots   = NULL;
+    p_index->capacity  = 0;
+    p_index->num_names = 0;
+}
+
+struct rpchat_connection_info *
+rpchat_name_index_find(rpchat_name_index_t *p_index,
+                       rpchat_string_t     *p_username)
+{
+    size_t slot_index = rpchat_name_index_probe(
+        p_index,
+        p_username->contents,
+        p_username->len,
+        rpchat_name_index_hash(p_username->contents, p_username->len));
+
+    return p_index->p_slots[slot_index].p_conn_info;
+}
+
+int
+rpchat_name_index_insert(rpchat_name_index_t           *p_index,
+                         struct rpchat_connection_info *p_conn_info)
+{
+    int                 res        = RPLIB_UNSUCCESS;
+    rpchat_conn_name_t *p_username = &p_conn_info->username;
+    uint32_t            hash       = 0;
+    size_t              slot_index = 0;
+
+    hash = rpchat_name_index_hash(p_username->p_contents, p_username->len);
+
+    // keep load factor at or below half
+    if (p_index->capacity < (p_index->num_names + 1) * 2
+        && RPLIB_SUCCESS != rpchat_name_index_grow(p_index))
+    {
+        res = RPLIB_ERROR;
+        goto leave;
+    }
+    slot_index = rpchat_name_index_probe(
+        p_index, p_username->p_contents, p_username->len, hash);
+    // taken
+    if (NULL != p_index->p_slots[slot_index].p_conn_info)
+    {
+        goto leave;
+    }
+    p_index->p_slots[slot_index].hash        = hash;
+    p_index->p_slots[slot_index].p_conn_info = p_conn_info;
+    p_index->num_names++;
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+int
+rpchat_name_index_remove(rpchat_name_index_t           *p_index,
+                         struct rpchat_connection_info *p_conn_info)
+{
+    int                 res        = RPLIB_UNSUCCESS;
+    rpchat_conn_name_t *p_username = &p_conn_info->username;
+    size_t              mask       = p_index->capacity - 1;
+    size_t              hole_index = 0; // slot being vacated
+    size_t              next_index = 0; // slot examined for shifting back
+    size_t              home_index = 0; // preferred slot of entry at next_index
+
+    hole_index = rpchat_name_index_probe(
+        p_index,
+        p_username->p_contents,
+        p_username->len,
+        rpchat_name_index_hash(p_username->p_contents, p_username->len));
+    // username may belong to another connection, only remove our own
+    if (p_conn_info != p_index->p_slots[hole_index].p_conn_info)
+    {
+        goto leave;
+    }
+    // pull back entries whose probe passes through the hole
+    for (next_index = (hole_index + 1) & mask;
+         NULL != p_index->p_slots[next_index].p_conn_info;
+         next_index = (next_index + 1) & mask)
+    {
+        home_index = p_index->p_slots[next_index].hash & mask;
+        if (((next_index - home_index) & mask)
+            >= ((next_index - hole_index) & mask))
+        {
+            p_index->p_slots[hole_index] = p_index->p_slots[next_index];
+            hole_index                   = next_index;
+        }
+    }
+    p_index->p_slots[hole_index].p_conn_info = NULL;
+    p_index->num_names--;
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
@@ -0,0 +1,408 @@
+/** @file rpchat_room_index.c
+ *
+ * @brief Implements room index: linearly probed room slots with
+ * backward-shift deletion, and member arrays kept compact by moving the last
+ * member into the place of one that leaves
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#include "components/rpchat_room_index.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "components/rpchat_conn_info.h"
+#include "components/rpchat_name_index.h"
+
+int
+rpchat_room_index_check_name(const char *p_name, size_t len)
+{
+    int    res        = RPLIB_UNSUCCESS;
+    size_t char_index = 0;
+
+    if (0 == len || RPCHAT_BCP_MAX_ROOM_LENGTH < len)
+    {
+        goto leave;
+    }
+    for (char_index = 0; char_index < len; char_index++)
+    {
+        if (!isgraph((unsigned char)p_name[char_index]))
+        {
+            goto leave;
+        }
+    }
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+/**
+ * Find the slot holding a room, or the empty slot ending its probe
+ * @param p_index Pointer to index
+ * @param p_name Pointer to room name contents
+ * @param len Length of room name
+ * @param hash Hash of room name
+ * @return Index of slot
+ */
+static size_t
+rpchat_room_index_probe(rpchat_room_index_t *p_index,
+                        const char          *p_name,
+                        size_t               len,
+                        uint32_t             hash)
+{
+    size_t         mask       = p_index->capacity - 1;
+    size_t         slot_index = hash & mask;
+    rpchat_room_t *p_room     = NULL;
+
+    // load factor stays at or below half, so an empty slot always ends this
+    for (;; slot_index = (slot_index + 1) & mask)
+    {
+        p_room = p_index->pp_slots[slot_index];
+        if (NULL == p_room)
+        {
+            break;
+        }
+        if (hash == p_room->hash && len == p_room->name_len
+            && 0 == memcmp(p_name, p_room->name, len))
+        {
+            break;
+        }
+    }
+    return slot_index;
+}
+
+/**
+ * Double the number of slots, rehashing every room
+ * @param p_index Pointer to index
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on allocation failure
+ */
+static int
+rpchat_room_index_grow(rpchat_room_index_t *p_index)
+{
+    int             res          = RPLIB_ERROR;
+    rpchat_room_t **pp_old_slots = p_index->pp_slots;
+    size_t          old_capacity = p_index->capacity;
+    size_t          old_index    = 0;
+    size_t          slot_index   = 0;
+    size_t          mask         = 0;
+
+    p_index->pp_slots = calloc(old_capacity * 2, sizeof(rpchat_room_t *));
+    if (NULL == p_index->pp_slots)
+    {
+        p_index->pp_slots = pp_old_slots;
+        goto leave;
+    }
+    p_index->capacity = old_capacity * 2;
+    mask              = p_index->capacity - 1;
+    // names are unique, so each only needs the first empty slot
+    for (old_index = 0; old_index < old_capacity; old_index++)
+    {
+        if (NULL == pp_old_slots[old_index])
+        {
+            continue;
+        }
+        slot_index = pp_old_slots[old_index]->hash & mask;
+        while (NULL != p_index->pp_slots[slot_index])
+        {
+            slot_index = (slot_index + 1) & mask;
+        }
+        p_index->pp_slots[slot_index] = pp_old_slots[old_index];
+    }
+    free(pp_old_slots);
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+/**
+ * Take an empty room out of the index and free it
+ * @param p_index Pointer to index
+ * @param p_room Pointer to indexed room without members
+ */
+static void
+rpchat_room_index_remove(rpchat_room_index_t *p_index, rpchat_room_t *p_room)
+{
+    size_t mask       = p_index->capacity - 1;
+    size_t hole_index = 0; // slot being vacated
+    size_t next_index = 0; // slot examined for shifting back
+    size_t home_index = 0; // preferred slot of room at next_index
+
+    hole_index = rpchat_room_index_probe(
+        p_index, p_room->name, p_room->name_len, p_room->hash);
+    // pull back rooms whose probe passes through the hole
+    for (next_index = (hole_index + 1) & mask;
+         NULL != p_index->pp_slots[next_index];
+         next_index = (next_index + 1) & mask)
+    {
+        home_index = p_index->pp_slots[next_index]->hash & mask;
+        if (((next_index - home_index) & mask)
+            >= ((next_index - hole_index) & mask))
+        {
+            p_index->pp_slots[hole_index] = p_index->pp_slots[next_index];
+            hole_index                    = next_index;
+        }
+    }
+    p_index->pp_slots[hole_index] = NULL;
+    p_index->num_rooms--;
+    free(p_room->p_members);
+    free(p_room);
+}
+
+/**
+ * Find a room by name, creating it if it does not exist yet
+ * @param p_index Pointer to index
+ * @param p_name Pointer to valid room name contents
+ * @param len Length of room name
+ * @return Pointer to room; NULL on allocation failure
+ */
+static rpchat_room_t *
+rpchat_room_index_get(rpchat_room_index_t *p_index,
+                      const char          *p_name,
+                      size_t               len)
+{
+    rpchat_room_t *p_room     = NULL;
+    uint32_t       hash       = rpchat_name_index_hash(p_name, len);
+    size_t         slot_index = 0;
+
+    slot_index = rpchat_room_index_probe(p_index, p_name, len, hash);
+    if (NULL != p_index->pp_slots[slot_index])
+    {
+        p_room = p_index->pp_slots[slot_index];
+        goto leave;
+    }
+    // keep load factor at or below half
+    if (p_index->capacity < (p_index->num_rooms + 1) * 2)
+    {
+        if (RPLIB_SUCCESS != rpchat_room_index_grow(p_index))
+        {
+            goto leave;
+        }
+        slot_index = rpchat_room_index_probe(p_index, p_name, len, hash);
+    }
+    p_room = calloc(1, sizeof(rpchat_room_t));
+    if (NULL == p_room)
+    {
+        goto leave;
+    }
+    p_room->p_members
+        = malloc(RPCHAT_ROOM_MIN_MEMBERS * sizeof(rpchat_room_member_t));
+    if (NULL == p_room->p_members)
+    {
+        free(p_room);
+        p_room = NULL;
+        goto leave;
+    }
+    p_room->capacity = RPCHAT_ROOM_MIN_MEMBERS;
+    p_room->hash     = hash;
+    p_room->name_len = len;
+    memcpy(p_room->name, p_name, len);
+    p_room->name[len]             = '\0';
+    p_index->pp_slots[slot_index] = p_room;
+    p_index->num_rooms++;
+leave:
+    return p_room;
+}
+
+/**
+ * Remove a connection from one of its rooms. The last member moves into its
+ * place, and an emptied room is freed
+ * @param p_index Pointer to index
+ * @param p_conn_info Pointer to connection
+ * @param sub_index Index of the room in the connection's joined rooms
+ */
+static void
+rpchat_room_index_detach(rpchat_room_index_t *p_index,
+                         rpchat_conn_info_t  *p_conn_info,
+                         size_t               sub_index)
+{
+    rpchat_conn_extra_t *p_extra      = atomic_load(&p_conn_info->p_extra);
+    rpchat_room_sub_t   *p_sub        = &p_extra->rooms[sub_index];
+    rpchat_room_t       *p_room       = p_sub->p_room;
+    size_t               member_index = p_sub->member_index;
+    rpchat_conn_extra_t *p_moved      = NULL; // member taking the vacated slot
+    size_t               moved_sub    = 0;    // index for moved member's rooms
+
+    p_room->num_members--;
+    if (member_index != p_room->num_members)
+    {
+        p_room->p_members[member_index]
+            = p_room->p_members[p_room->num_members];
+        p_moved = atomic_load(
+            &p_room->p_members[member_index].p_conn_info->p_extra);
+        for (moved_sub = 0; moved_sub < p_moved->num_rooms; moved_sub++)
+        {
+            if (p_room == p_moved->rooms[moved_sub].p_room)
+            {
+                p_moved->rooms[moved_sub].member_index = member_index;
+                break;
+            }
+        }
+    }
+    if (0 == p_room->num_members)
+    {
+        rpchat_room_index_remove(p_index, p_room);
+    }
+    // joined rooms stay compact too, order does not matter
+    p_extra->num_rooms--;
+    p_extra->rooms[sub_index] = p_extra->rooms[p_extra->num_rooms];
+}
+
+int
+rpchat_room_index_initialize(rpchat_room_index_t *p_index)
+{
+    int res = RPLIB_ERROR;
+
+    p_index->num_rooms = 0;
+    p_index->capacity  = RPCHAT_ROOM_INDEX_MIN_CAPACITY;
+    p_index->pp_slots
+        = calloc(RPCHAT_ROOM_INDEX_MIN_CAPACITY, sizeof(rpchat_room_t *));
+    if (NULL != p_index->pp_slots)
+    {
+        res = RPLIB_SUCCESS;
+    }
+    return res;
+}
+
+void
+rpchat_room_index_destroy(rpchat_room_index_t *p_index)
+{
+    size_t slot_index = 0;
+
+    for (slot_index = 0; slot_index < p_index->capacity; slot_index++)
+    {
+        if (NULL != p_index->pp_slots[slot_index])
+        {
+            free(p_index->pp_slots[slot_index]->p_members);
+            free(p_index->pp_slots[slot_index]);
+        }
+    }
+    free(p_index->pp_slots);
+    p_index->pp_slots  = NULL;
+    p_index->capacity  = 0;
+    p_index->num_rooms = 0;
+}
+
+rpchat_room_t *
+rpchat_room_index_joined(struct rpchat_connection_info *p_conn_info,
+                         const char                    *p_name,
+                         size_t                         len)
+{
+    rpchat_conn_extra_t *p_extra   = atomic_load(&p_conn_info->p_extra);
+    rpchat_room_t       *p_room    = NULL;
+    size_t               sub_index = 0;
+
+    // never joined a room yet
+    if (NULL == p_extra)
+    {
+        goto leave;
+    }
+    for (sub_index = 0; sub_index < p_extra->num_rooms; sub_index++)
+    {
+        p_room = p_extra->rooms[sub_index].p_room;
+        if (len == p_room->name_len && 0 == memcmp(p_name, p_room->name, len))
+        {
+            goto leave;
+        }
+    }
+    p_room = NULL;
+leave:
+    return p_room;
+}
+
+int
+rpchat_room_index_join(rpchat_room_index_t           *p_index,
+                       struct rpchat_connection_info *p_conn_info,
+                       struct rpchat_conn_queue      *p_conn_queue,
+                       const char                    *p_name,
+                       size_t                         len)
+{
+    int                   res         = RPLIB_SUCCESS;
+    rpchat_conn_extra_t  *p_extra     = NULL;
+    rpchat_room_t        *p_room      = NULL;
+    rpchat_room_member_t *p_members   = NULL; // grown member array
+    size_t                new_members = 0;    // # entries of grown array
+
+    if (NULL != rpchat_room_index_joined(p_conn_info, p_name, len))
+    {
+        goto leave;
+    }
+    p_extra = rpchat_conn_info_get_extra(p_conn_info);
+    if (NULL == p_extra)
+    {
+        res = RPLIB_ERROR;
+        goto leave;
+    }
+    if (RPCHAT_ROOM_MAX_JOINED <= p_extra->num_rooms)
+    {
+        res = RPLIB_UNSUCCESS;
+        goto leave;
+    }
+    p_room = rpchat_room_index_get(p_index, p_name, len);
+    if (NULL == p_room)
+    {
+        res = RPLIB_ERROR;
+        goto leave;
+    }
+    // a room just created always has space
+    if (p_room->capacity == p_room->num_members)
+    {
+        new_members = p_room->capacity * 2;
+        p_members   = realloc(p_room->p_members,
+                            new_members * sizeof(rpchat_room_member_t));
+        if (NULL == p_members)
+        {
+            res = RPLIB_ERROR;
+            goto leave;
+        }
+        p_room->p_members = p_members;
+        p_room->capacity  = new_members;
+    }
+    p_room->p_members[p_room->num_members].p_conn_info  = p_conn_info;
+    p_room->p_members[p_room->num_members].p_conn_queue = p_conn_queue;
+    p_extra->rooms[p_extra->num_rooms].p_room       = p_room;
+    p_extra->rooms[p_extra->num_rooms].member_index = p_room->num_members;
+    p_extra->num_rooms++;
+    p_room->num_members++;
+leave:
+    return res;
+}
+
+int
+rpchat_room_index_leave(rpchat_room_index_t           *p_index,
+                        struct rpchat_connection_info *p_conn_info,
+                        const char                    *p_name,
+                        size_t                         len)
+{
+    int                  res       = RPLIB_UNSUCCESS;
+    rpchat_conn_extra_t *p_extra   = atomic_load(&p_conn_info->p_extra);
+    rpchat_room_t       *p_room    = NULL;
+    size_t               sub_index = 0;
+
+    for (sub_index = 0; NULL != p_extra && sub_index < p_extra->num_rooms;
+         sub_index++)
+    {
+        p_room = p_extra->rooms[sub_index].p_room;
+        if (len == p_room->name_len && 0 == memcmp(p_name, p_room->name, len))
+        {
+            rpchat_room_index_detach(p_index, p_conn_info, sub_index);
+            res = RPLIB_SUCCESS;
+            break;
+        }
+    }
+    return res;
+}
+
+void
+rpchat_room_index_leave_all(rpchat_room_index_t           *p_index,
+                            struct rpchat_connection_info *p_conn_info)
+{
+    rpchat_conn_extra_t *p_extra = atomic_load(&p_conn_info->p_extra);
+
+    while (NULL != p_extra && 0 < p_extra->num_rooms)
+    {
+        rpchat_room_index_detach(p_index, p_conn_info, p_extra->num_rooms - 1);
+    }
+}
@@ -0,0 +1,60 @@
+/** @file rpchat_shared_msg.c
+ *
+ * @brief Implements reference-counted encoded BCP messages
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#include "components/rpchat_shared_msg.h"
+
+#include <assert.h>
+
+rpchat_shared_msg_t *
+rpchat_shared_msg_create(rplib_pool_t *p_pool, size_t sz_msg)
+{
+    rpchat_shared_msg_t *p_shared_msg = NULL;
+    size_t               sz_alloc     = sizeof(rpchat_shared_msg_t) + sz_msg;
+
+    // header and contents in one allocation
+    p_shared_msg = NULL != p_pool ? rplib_pool_alloc(p_pool, sz_alloc)
+                                  : malloc(sz_alloc);
+    if (NULL == p_shared_msg)
+    {
+        goto leave;
+    }
+    atomic_init(&p_shared_msg->refcount, 1);
+    p_shared_msg->p_pool = p_pool;
+    p_shared_msg->sz_msg = sz_msg;
+    // untimed unless the creator stamps it
+    p_shared_msg->origin_ns = 0;
+    atomic_init(&p_shared_msg->fan_outs_left, 0);
+leave:
+    return p_shared_msg;
+}
+
+rpchat_shared_msg_t *
+rpchat_shared_msg_retain(rpchat_shared_msg_t *p_shared_msg)
+{
+    assert(p_shared_msg);
+    atomic_fetch_add_explicit(&p_shared_msg->refcount, 1, memory_order_relaxed);
+    return p_shared_msg;
+}
+
+void
+rpchat_shared_msg_release(rpchat_shared_msg_t *p_shared_msg)
+{
+    assert(p_shared_msg);
+    // last holder frees
+    if (1
+        == atomic_fetch_sub_explicit(
+            &p_shared_msg->refcount, 1, memory_order_acq_rel))
+    {
+        if (NULL != p_shared_msg->p_pool)
+        {
+            rplib_pool_free(p_shared_msg->p_pool, p_shared_msg);
+            return;
+        }
+        free(p_shared_msg);
+    }
+}
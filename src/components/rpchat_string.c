@@ -1,6 +1,8 @@
 /** @file rpchat_string.c
  *
- * @brief Implement rpchat string
+ * @brief Implement rpchat string. Sanitizing scans for the first disallowed
+ * character with the widest vector unit available at runtime (AVX2, SSE2 or
+ * scalar), copying clean runs whole and only compacting around bad bytes
  *
  * @par
  * COPYRIGHT NOTICE: None
@@ -8,6 +10,167 @@
 
 #include "components/rpchat_string.h"
 
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RPCHAT_STRING_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * Check a single character against the filter rules
+ * @param curr_char Character to check
+ * @param b_allow_ctrl If true, also allow tab, newline and space
+ * @return true if character is kept
+ */
+static inline bool
+rpchat_string_char_ok(char curr_char, bool b_allow_ctrl)
+{
+    return (curr_char >= RPCHAT_FILTER_ASCII_START
+            && curr_char <= RPCHAT_FILTER_ASCII_END)
+           || (b_allow_ctrl
+               && (RPCHAT_FILTER_ASCII_TAB == curr_char
+                   || RPCHAT_FILTER_ASCII_NEWLINE == curr_char
+                   || RPCHAT_FILTER_ASCII_SPACE == curr_char));
+}
+
+/**
+ * Find the first character failing the filter rules, one byte at a time
+ * @param p_contents Pointer to characters to scan
+ * @param len Number of characters to scan
+ * @param b_allow_ctrl If true, also allow tab, newline and space
+ * @return Index of first disallowed character; len if there is none
+ */
+static size_t
+rpchat_string_scan_scalar(const char *p_contents, size_t len, bool b_allow_ctrl)
+{
+    size_t char_index = 0;
+
+    while (char_index < len
+           && rpchat_string_char_ok(p_contents[char_index], b_allow_ctrl))
+    {
+        char_index++;
+    }
+    return char_index;
+}
+
+#ifdef RPCHAT_STRING_X86
+/**
+ * Find the first character failing the filter rules, 16 bytes at a time.
+ * Bytes compare signed, so anything above 127 fails the range check as it
+ * does in the scalar path
+ * @param p_contents Pointer to characters to scan
+ * @param len Number of characters to scan
+ * @param b_allow_ctrl If true, also allow tab, newline and space
+ * @return Index of first disallowed character; len if there is none
+ */
+__attribute__((target("sse2"))) static size_t
+rpchat_string_scan_sse2(const char *p_contents, size_t len, bool b_allow_ctrl)
+{
+    const __m128i below = _mm_set1_epi8(RPCHAT_FILTER_ASCII_START - 1);
+    const __m128i above = _mm_set1_epi8(RPCHAT_FILTER_ASCII_END + 1);
+    const __m128i tab   = _mm_set1_epi8(RPCHAT_FILTER_ASCII_TAB);
+    const __m128i nl    = _mm_set1_epi8(RPCHAT_FILTER_ASCII_NEWLINE);
+    const __m128i space = _mm_set1_epi8(RPCHAT_FILTER_ASCII_SPACE);
+    size_t        char_index = 0;
+    __m128i       chunk;
+    __m128i       ok;
+    unsigned int  mask = 0;
+
+    for (; char_index + sizeof(__m128i) <= len; char_index += sizeof(__m128i))
+    {
+        chunk = _mm_loadu_si128((const __m128i *)(p_contents + char_index));
+        ok    = _mm_and_si128(_mm_cmpgt_epi8(chunk, below),
+                           _mm_cmplt_epi8(chunk, above));
+        if (b_allow_ctrl)
+        {
+            ok = _mm_or_si128(
+                ok,
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, space),
+                             _mm_or_si128(_mm_cmpeq_epi8(chunk, tab),
+                                          _mm_cmpeq_epi8(chunk, nl))));
+        }
+        mask = (unsigned int)_mm_movemask_epi8(ok);
+        if (0xFFFFu != mask)
+        {
+            return char_index + __builtin_ctz(~mask);
+        }
+    }
+    return char_index
+           + rpchat_string_scan_scalar(
+               p_contents + char_index, len - char_index, b_allow_ctrl);
+}
+
+/**
+ * Find the first character failing the filter rules, 32 bytes at a time
+ * @param p_contents Pointer to characters to scan
+ * @param len Number of characters to scan
+ * @param b_allow_ctrl If true, also allow tab, newline and space
+ * @return Index of first disallowed character; len if there is none
+ */
+__attribute__((target("avx2"))) static size_t
+rpchat_string_scan_avx2(const char *p_contents, size_t len, bool b_allow_ctrl)
+{
+    const __m256i below = _mm256_set1_epi8(RPCHAT_FILTER_ASCII_START - 1);
+    const __m256i above = _mm256_set1_epi8(RPCHAT_FILTER_ASCII_END + 1);
+    const __m256i tab   = _mm256_set1_epi8(RPCHAT_FILTER_ASCII_TAB);
+    const __m256i nl    = _mm256_set1_epi8(RPCHAT_FILTER_ASCII_NEWLINE);
+    const __m256i space = _mm256_set1_epi8(RPCHAT_FILTER_ASCII_SPACE);
+    size_t        char_index = 0;
+    __m256i       chunk;
+    __m256i       ok;
+    uint32_t      mask = 0;
+
+    for (; char_index + sizeof(__m256i) <= len; char_index += sizeof(__m256i))
+    {
+        chunk = _mm256_loadu_si256((const __m256i *)(p_contents + char_index));
+        ok    = _mm256_and_si256(_mm256_cmpgt_epi8(chunk, below),
+                              _mm256_cmpgt_epi8(above, chunk));
+        if (b_allow_ctrl)
+        {
+            ok = _mm256_or_si256(
+                ok,
+                _mm256_or_si256(
+                    _mm256_cmpeq_epi8(chunk, space),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(chunk, tab),
+                                    _mm256_cmpeq_epi8(chunk, nl))));
+        }
+        mask = (uint32_t)_mm256_movemask_epi8(ok);
+        if (UINT32_MAX != mask)
+        {
+            return char_index + __builtin_ctz(~mask);
+        }
+    }
+    // finish the tail 16 bytes at a time
+    return char_index
+           + rpchat_string_scan_sse2(
+               p_contents + char_index, len - char_index, b_allow_ctrl);
+}
+#endif
+
+/**
+ * Find the first character failing the filter rules with the widest vector
+ * unit this CPU supports
+ * @param p_contents Pointer to characters to scan
+ * @param len Number of characters to scan
+ * @param b_allow_ctrl If true, also allow tab, newline and space
+ * @return Index of first disallowed character; len if there is none
+ */
+static size_t
+rpchat_string_scan(const char *p_contents, size_t len, bool b_allow_ctrl)
+{
+#ifdef RPCHAT_STRING_X86
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return rpchat_string_scan_avx2(p_contents, len, b_allow_ctrl);
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return rpchat_string_scan_sse2(p_contents, len, b_allow_ctrl);
+    }
+#endif
+    return rpchat_string_scan_scalar(p_contents, len, b_allow_ctrl);
+}
 
 int
 rpchat_string_sanitize(rpchat_string_t *p_input_string,
@@ -17,28 +180,23 @@ rpchat_string_sanitize(rpchat_string_t *p_input_string,
     int    res               = RPLIB_UNSUCCESS;
     size_t curr_output_index = 0;
     size_t loop_index        = 0;
-    char   curr_char         = 0;
-    // double check lengths compliant
+    size_t run_len           = 0; // allowed characters starting at loop_index
+    // double check lengths compliant, leaving room for the terminator
     p_input_string->len  = p_input_string->len < RPCHAT_MAX_STR_LENGTH
                                ? p_input_string->len
-                               : RPCHAT_MAX_STR_LENGTH;
+                               : RPCHAT_MAX_STR_LENGTH - 1;
     p_output_string->len = 0;
-    // ensure output clean
-    memset(p_output_string, 0, p_output_string->len);
-    for (loop_index = 0; loop_index < p_input_string->len; loop_index++)
+    // copy runs of allowed characters whole, skipping each disallowed one
+    while (loop_index < p_input_string->len)
     {
-        curr_char = p_input_string->contents[loop_index];
-        // if character meets filter rules, append to output
-        if ((curr_char >= RPCHAT_FILTER_ASCII_START
-             && curr_char <= RPCHAT_FILTER_ASCII_END)
-            || (b_allow_ctrl
-                && (RPCHAT_FILTER_ASCII_TAB == curr_char
-                    || RPCHAT_FILTER_ASCII_NEWLINE == curr_char
-                    || RPCHAT_FILTER_ASCII_SPACE == curr_char)))
-        {
-            p_output_string->contents[curr_output_index] = curr_char;
-            curr_output_index++;
-        }
+        run_len = rpchat_string_scan(p_input_string->contents + loop_index,
+                                     p_input_string->len - loop_index,
+                                     b_allow_ctrl);
+        memcpy(p_output_string->contents + curr_output_index,
+               p_input_string->contents + loop_index,
+               run_len);
+        curr_output_index += run_len;
+        loop_index += run_len + 1;
     }
     // null-terminate if not already
     if (curr_output_index > 0
@@ -48,7 +206,8 @@ rpchat_string_sanitize(rpchat_string_t *p_input_string,
         curr_output_index += 1;
     }
     // set length
-    p_output_string->len = curr_output_index;
+    p_output_string->len         = curr_output_index;
+    p_output_string->b_sanitized = true;
     // return unsuccess if string of length 1 (just terminator)
     res = p_output_string->len > 0 ? RPLIB_SUCCESS : RPLIB_UNSUCCESS;
 
@@ -15,34 +15,101 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/resource.h>
+#include <unistd.h>
 
 #include "rpchat_basic_chat.h"
 #include "rpchat_file_io.h"
+#include "rpchat_log.h"
+#include "rpchat_metrics.h"
 #include "rpchat_networking.h"
 
 /**
  * Parse command-line arguments
  * @param argc Arg count passed to program
  * @param pp_argv Arguments array
- * @param p_timeout Pointer to timeout variable in caller
- * @param p_target_directory Pointer to target directory variable in caller
+ * @param p_port_num Pointer to port number variable in caller
+ * @param p_log_location Pointer to log location buffer in caller
+ * @param p_sz_log_location Pointer to log location size in caller
+ * @param p_b_affinity Pointer to connection affinity flag in caller
+ * @param p_num_reactors Pointer to reactor count in caller
+ * @param p_conn_timeout Pointer to inactivity timeout variable in caller
+ * @param p_audit_interval Pointer to inactivity check interval in caller
+ * @param p_event_batch Pointer to events-per-wait variable in caller
+ * @param p_log_level Pointer to log level variable in caller
+ * @param pp_file_dir Pointer to file directory argument in caller, left NULL
+ * when file exchange is disabled
+ * @param p_backlog_frames Pointer to per-client message budget in caller
+ * @param p_backlog_kib Pointer to per-client byte budget (KiB) in caller
+ * @param p_watermark_mib Pointer to server-wide watermark (MiB) in caller
+ * @param p_b_drop_oldest Pointer to over-budget policy flag in caller
+ * @param p_flush_kib Pointer to per-write delivery budget (KiB) in caller
+ * @param p_flush_us Pointer to delivery flush deadline (us) in caller
+ * @param p_min_workers Pointer to idle worker count in caller
+ * @param p_max_workers Pointer to most workers in caller
+ * @param p_b_pin_workers Pointer to worker pinning flag in caller
+ * @param p_io_backend Pointer to requested I/O backend in caller
+ * @param p_metrics_port Pointer to admin port in caller, left 0 when metrics
+ * are disabled
+ * @param p_cluster_config Pointer to federation options in caller, port left
+ * 0 when standalone
+ * @param pp_handoff_path Pointer to handoff path argument in caller, left NULL
+ * when restarts drop clients
  * @return 0 on success, 1 on problems
  */
 static int
-rpchat_get_arguments(int     argc,
-                     char  **pp_argv,
-                     int    *p_port_num,
-                     char   *p_log_location,
-                     size_t *p_sz_log_location)
+rpchat_get_arguments(int                      argc,
+                     char                   **pp_argv,
+                     int                     *p_port_num,
+                     char                    *p_log_location,
+                     size_t                  *p_sz_log_location,
+                     bool                    *p_b_affinity,
+                     unsigned int            *p_num_reactors,
+                     unsigned int            *p_conn_timeout,
+                     unsigned int            *p_audit_interval,
+                     unsigned int            *p_event_batch,
+                     unsigned int            *p_log_level,
+                     char                   **pp_file_dir,
+                     unsigned int            *p_backlog_frames,
+                     unsigned int            *p_backlog_kib,
+                     unsigned int            *p_watermark_mib,
+                     bool                    *p_b_drop_oldest,
+                     unsigned int            *p_flush_kib,
+                     unsigned int            *p_flush_us,
+                     unsigned int            *p_min_workers,
+                     unsigned int            *p_max_workers,
+                     bool                    *p_b_pin_workers,
+                     rpchat_io_backend_t     *p_io_backend,
+                     unsigned int            *p_metrics_port,
+                     rpchat_cluster_config_t *p_cluster_config,
+                     char                   **pp_handoff_path)
 {
     int   opt = 0;
     char *next_char; // used for strtol
     int   port_num            = 0;
+    long  num_reactors        = 1; // single event loop unless asked
+    long  conn_timeout        = RPCHAT_CONNECTION_TIMEOUT;
+    long  audit_interval      = RPCHAT_CLIENT_AUDIT_INTERVAL;
+    long  event_batch         = RPCHAT_DEFAULT_EVENT_BATCH;
+    long  log_level           = RPCHAT_LOG_DEFAULT_LEVEL;
+    long  backlog_frames      = RPCHAT_DEFAULT_BACKLOG_FRAMES;
+    long  backlog_kib         = RPCHAT_DEFAULT_BACKLOG_KIB;
+    long  watermark_mib       = RPCHAT_DEFAULT_WATERMARK_MIB;
+    long  flush_kib           = RPCHAT_DEFAULT_FLUSH_KIB;
+    long  flush_us            = 0; // deliveries written at once unless asked
+    long  min_workers         = RPCHAT_NUM_THREADS;
+    long  max_workers         = 0;  // one per online CPU unless asked
+    long  metrics_port        = 0;  // metrics disabled unless asked
+    long  node_id             = -1; // -n argument, -1 if not given
+    long  cluster_port        = 0;  // federation disabled unless asked
     char *p_temp_log_location = NULL;
+    int   backend             = RPCHAT_IO_EPOLL; // for matching -u names
 
     // attempt to get arguments
     opterr = 0;
-    while (-1 != (opt = getopt(argc, pp_argv, "t:l:h")))
+    while (-1
+           != (opt = getopt(argc,
+                            pp_argv,
+                            "p:t:i:l:r:b:v:f:q:k:m:w:e:g:x:u:s:n:c:j:y:doah")))
     {
         // port number
         if ('p' == opt)
@@ -64,16 +131,285 @@ rpchat_get_arguments(int     argc,
             }
             p_temp_log_location = optarg;
         }
+        // directory files are exchanged in
+        if ('f' == opt)
+        {
+            if (!optarg)
+            {
+                printf("Invalid Argument for -f\n");
+                goto print_usage;
+            }
+            *pp_file_dir = optarg;
+        }
+        // number of reactors
+        if ('r' == opt)
+        {
+            num_reactors = strtol(optarg, &next_char, 10);
+            if ('\0' != *next_char || 1 > num_reactors
+                || RPCHAT_MAX_REACTORS < num_reactors)
+            {
+                printf("Invalid Argument for -r\n");
+                goto print_usage;
+            }
+        }
+        // seconds idle before disconnect
+        if ('t' == opt)
+        {
+            conn_timeout = strtol(optarg, &next_char, 10);
+            if ('\0' != *next_char || 1 > conn_timeout
+                || RPCHAT_MAX_TIMEOUT < conn_timeout)
+            {
+                printf("Invalid Argument for -t\n");
+                goto print_usage;
+            }
+        }
+        // seconds between inactivity checks
+        if ('i' == opt)
+        {
+            audit_interval = strtol(optarg, &next_char, 10);
+            if ('\0' != *next_char || 1 > audit_interval
+                || RPCHAT_MAX_TIMEOUT < audit_interval)
+            {
+                printf("Invalid Argument for -i\n");
+                goto print_usage;
+            }
+        }
+        // events taken from epoll per wait
+        if ('b' == opt)
+        {
+            event_batch = strtol(optarg, &next_char, 10);
+            if ('\0' != *next_char || 1 > event_batch
+                || RPCHAT_MAX_EVENT_BATCH < event_batch)
+            {
+                printf("Invalid Argument for -b\n");
+                goto print_usage;
+            }
+        }
+        // most verbose log records kept
+        if ('v' == opt)
+        {
+            log_level = strtol(optarg, &next_char, 10);
+            if ('\0' != *next_char || RPCHAT_LOG_ERROR > log_level
+                || RPCHAT_LOG_DEBUG < log_level)
+            {
+                printf("Invalid Argument for -v\n");
+                goto print_usage;
+            }
+        }
+        // messages queued per client
+        if ('q' == opt)
+        {
+            backlog_frames = strtol(optarg, &next_char, 10);
+            if ('\0' != *next_char || 1 > backlog_frames
+                || RPCHAT_MAX_BACKLOG < backlog_frames)
+            {
+                printf("Invalid Argument for -q\n");
+                goto print_usage;
+            }
+        }
+        // KiB queued per client
+        if ('k' == opt)
+        {
+            backlog_kib = strtol(optarg, &next_char, 10);
+            if ('\0' != *next_char || 1 > backlog_kib
+                || RPCHAT_MAX_BACKLOG < backlog_kib)
+            {
+                printf("Invalid Argument for -k\n");
+                goto print_usage;
+            }
+        }
+        // MiB queued across clients before SENDs are refused
+        if ('m' == opt)
+        {
+            watermark_mib = strtol(optarg, &next_char, 10);
+            if ('\0' != *next_char || 1 > watermark_mib
+                || RPCHAT_MAX_BACKLOG < watermark_mib)
+            {
+                printf("Invalid Argument for -m\n");
+                goto print_usage;
+            }
+        }
+        // KiB of deliveries written to a client at once
+        if ('w' == opt)
+        {
+            flush_kib = strtol(optarg, &next_char, 10);
+            if ('\0' != *next_char || 1 > flush_kib
+                || RPCHAT_MAX_FLUSH_KIB < flush_kib)
+            {
+                printf("Invalid Argument for -w\n");
+                goto print_usage;
+            }
+        }
+        // us deliveries may wait for others to be written along
+        if ('e' == opt)
+        {
+            flush_us = strtol(optarg, &next_char, 10);
+            if ('\0' != *next_char || 0 > flush_us
+                || RPCHAT_MAX_FLUSH_US < flush_us)
+            {
+                printf("Invalid Argument for -e\n");
+                goto print_usage;
+            }
+        }
+        // workers kept while idle
+        if ('g' == opt)
+        {
+            min_workers = strtol(optarg, &next_char, 10);
+            if ('\0' != *next_char || 1 > min_workers
+                || RPCHAT_MAX_WORKERS < min_workers)
+            {
+                printf("Invalid Argument for -g\n");
+                goto print_usage;
+            }
+        }
+        // most workers run as tasks back up
+        if ('x' == opt)
+        {
+            max_workers = strtol(optarg, &next_char, 10);
+            if ('\0' != *next_char || 1 > max_workers
+                || RPCHAT_MAX_WORKERS < max_workers)
+            {
+                printf("Invalid Argument for -x\n");
+                goto print_usage;
+            }
+        }
+        // how reactors wait for readiness
+        if ('u' == opt)
+        {
+            for (backend = RPCHAT_IO_EPOLL; backend <= RPCHAT_IO_URING_SQPOLL;
+                 backend++)
+            {
+                if (0 == strcmp(optarg, rpchat_io_backend_name(backend)))
+                {
+                    break;
+                }
+            }
+            if (RPCHAT_IO_URING_SQPOLL < backend)
+            {
+                printf("Invalid Argument for -u\n");
+                goto print_usage;
+            }
+            *p_io_backend = (rpchat_io_backend_t)backend;
+        }
+        // port metrics are served on
+        if ('s' == opt)
+        {
+            metrics_port = strtol(optarg, &next_char, 10);
+            if ('\0' != *next_char || 1 > metrics_port
+                || RPCHAT_MAX_PORT_NUM < metrics_port)
+            {
+                printf("Invalid Argument for -s\n");
+                goto print_usage;
+            }
+        }
+        // id of this node in a cluster
+        if ('n' == opt)
+        {
+            node_id = strtol(optarg, &next_char, 10);
+            if ('\0' != *next_char || 0 > node_id
+                || RPCHAT_CLUSTER_MAX_NODES <= node_id)
+            {
+                printf("Invalid Argument for -n\n");
+                goto print_usage;
+            }
+        }
+        // port other nodes link to
+        if ('c' == opt)
+        {
+            cluster_port = strtol(optarg, &next_char, 10);
+            if ('\0' != *next_char || 1 > cluster_port
+                || RPCHAT_MAX_PORT_NUM < cluster_port)
+            {
+                printf("Invalid Argument for -c\n");
+                goto print_usage;
+            }
+        }
+        // another node, once per node
+        if ('j' == opt)
+        {
+            if (RPCHAT_CLUSTER_MAX_NODES <= p_cluster_config->num_peers
+                || RPLIB_SUCCESS
+                       != rpchat_cluster_parse_peer(
+                           optarg,
+                           &p_cluster_config
+                                ->peers[p_cluster_config->num_peers]))
+            {
+                printf("Invalid Argument for -j\n");
+                goto print_usage;
+            }
+            p_cluster_config->num_peers++;
+        }
+        // socket successors take over clients through
+        if ('y' == opt)
+        {
+            if (!optarg || '\0' == *optarg)
+            {
+                printf("Invalid Argument for -y\n");
+                goto print_usage;
+            }
+            *pp_handoff_path = optarg;
+        }
+        // drop oldest messages of clients over budget instead of
+        // disconnecting them
+        if ('d' == opt)
+        {
+            *p_b_drop_oldest = true;
+        }
+        // pin workers to CPUs
+        if ('o' == opt)
+        {
+            *p_b_pin_workers = true;
+        }
+        // pin connections to workers
+        if ('a' == opt)
+        {
+            *p_b_affinity = true;
+        }
         // help message
         if ('h' == opt)
         {
             goto print_usage;
         }
     }
+    // nodes and peers mean nothing without a port to link on
+    if (0 == cluster_port && (0 <= node_id || 0 < p_cluster_config->num_peers))
+    {
+        printf("-n and -j require -c\n");
+        goto print_usage;
+    }
+    // pool may grow to one worker per CPU, but never below its minimum
+    if (0 == max_workers)
+    {
+        max_workers = sysconf(_SC_NPROCESSORS_ONLN);
+        max_workers = min_workers > max_workers ? min_workers : max_workers;
+        max_workers = RPCHAT_MAX_WORKERS < max_workers ? RPCHAT_MAX_WORKERS
+                                                       : max_workers;
+    }
+    if (min_workers > max_workers)
+    {
+        printf("-g may not exceed -x\n");
+        goto print_usage;
+    }
     // if args not passed, set to default
     port_num = (0 == port_num) ? RPCHAT_DEFAULT_PORT : port_num;
     // commit all params to caller
-    *p_port_num = port_num;
+    *p_port_num       = port_num;
+    *p_num_reactors   = (unsigned int)num_reactors;
+    *p_conn_timeout   = (unsigned int)conn_timeout;
+    *p_audit_interval = (unsigned int)audit_interval;
+    *p_event_batch    = (unsigned int)event_batch;
+    *p_log_level      = (unsigned int)log_level;
+    *p_backlog_frames = (unsigned int)backlog_frames;
+    *p_backlog_kib    = (unsigned int)backlog_kib;
+    *p_watermark_mib  = (unsigned int)watermark_mib;
+    *p_flush_kib      = (unsigned int)flush_kib;
+    *p_flush_us       = (unsigned int)flush_us;
+    *p_min_workers    = (unsigned int)min_workers;
+    *p_max_workers    = (unsigned int)max_workers;
+    *p_metrics_port   = (unsigned int)metrics_port;
+    // federation options, port left 0 when standalone
+    p_cluster_config->port_num = (unsigned int)cluster_port;
+    p_cluster_config->node_id  = 0 > node_id ? 0 : (unsigned int)node_id;
     if (NULL != p_temp_log_location)
     {
         *p_sz_log_location
@@ -84,8 +420,59 @@ print_usage:
     fprintf(stdout,
             "Usage: \n rpchat -l[log location (defaults to stdout)] "
             "-p[host port number  "
-            "(default %d)]\n",
-            RPCHAT_DEFAULT_PORT);
+            "(default %d)] -a[pin each connection to one worker thread] "
+            "-r[number of reactor threads, 1-%d (default 1)] "
+            "-t[seconds idle before disconnect (default %d)] "
+            "-i[seconds between inactivity checks (default %d)] "
+            "-b[events handled per wait, 1-%d (default %d)] "
+            "-v[log level, %d=errors to %d=debug (default %d)] "
+            "-f[directory for file exchange (default disabled)] "
+            "-q[messages queued per client, 1-%d (default %d)] "
+            "-k[KiB queued per client, 1-%d (default %d)] "
+            "-m[MiB queued in total before sends are refused, 1-%d "
+            "(default %d)] "
+            "-w[KiB of deliveries written to a client at once, 1-%d "
+            "(default %d)] "
+            "-e[microseconds deliveries may wait to be written together, "
+            "0-%d (default 0)] "
+            "-g[worker threads kept while idle, 1-%d (default %d)] "
+            "-x[worker threads run at most as tasks back up, 1-%d "
+            "(default one per CPU)] "
+            "-o[pin each worker thread to one CPU, filling NUMA nodes in "
+            "turn] "
+            "-d[drop oldest messages of clients over budget instead of "
+            "disconnecting them] "
+            "-u[I/O backend: epoll, uring or sqpoll (default uring, falls "
+            "back to epoll where unsupported)] "
+            "-s[port to serve metrics on, 127.0.0.1 only (default "
+            "disabled)] "
+            "-c[port other nodes of a cluster link to (default disabled)] "
+            "-n[id of this node, 0-%d, unique in the cluster (default 0)] "
+            "-j[another node as id@host:port, once per node] "
+            "-y[socket path a restarted server takes clients over through "
+            "(default disabled)]\n",
+            RPCHAT_DEFAULT_PORT,
+            RPCHAT_MAX_REACTORS,
+            RPCHAT_CONNECTION_TIMEOUT,
+            RPCHAT_CLIENT_AUDIT_INTERVAL,
+            RPCHAT_MAX_EVENT_BATCH,
+            RPCHAT_DEFAULT_EVENT_BATCH,
+            RPCHAT_LOG_ERROR,
+            RPCHAT_LOG_DEBUG,
+            RPCHAT_LOG_DEFAULT_LEVEL,
+            RPCHAT_MAX_BACKLOG,
+            RPCHAT_DEFAULT_BACKLOG_FRAMES,
+            RPCHAT_MAX_BACKLOG,
+            RPCHAT_DEFAULT_BACKLOG_KIB,
+            RPCHAT_MAX_BACKLOG,
+            RPCHAT_DEFAULT_WATERMARK_MIB,
+            RPCHAT_MAX_FLUSH_KIB,
+            RPCHAT_DEFAULT_FLUSH_KIB,
+            RPCHAT_MAX_FLUSH_US,
+            RPCHAT_MAX_WORKERS,
+            RPCHAT_NUM_THREADS,
+            RPCHAT_MAX_WORKERS,
+            RPCHAT_CLUSTER_MAX_NODES - 1);
     return RPLIB_UNSUCCESS;
 leave:
     return RPLIB_SUCCESS;
@@ -110,8 +497,35 @@ main(int argc, char **argv)
     char          log_location[PATH_MAX]; // log location buffer
     size_t        sz_log_loc = 0;         // size of log location
 
+    rpchat_server_config_t  config;                       // server options
+    rpchat_cluster_config_t cluster_config;               // federation options
+    rpchat_io_backend_t     io_backend = RPCHAT_IO_URING; // backend asked for
+    rpchat_handoff_t       *p_handoff  = NULL;            // predecessor clients
+
+    bool         b_affinity      = false;       // pin connections to workers
+    unsigned int num_reactors    = 1;           // event loops to run
+    unsigned int conn_timeout    = 0;           // seconds idle until disconnect
+    unsigned int audit_interval  = 0;           // seconds between idle checks
+    unsigned int event_batch     = 0;           // events handled per wait
+    unsigned int log_level       = 0;           // most verbose records kept
+    size_t       num_log_dropped = 0;           // records logger could not keep
+    char        *p_file_dir      = NULL;        // -f argument, NULL if none
+    int          h_fd_file_dir   = RPLIB_ERROR; // file exchange directory
+    unsigned int backlog_frames  = 0;           // messages queued per client
+    unsigned int backlog_kib     = 0;           // KiB queued per client
+    unsigned int watermark_mib   = 0;           // MiB queued before refusing
+    bool         b_drop_oldest   = false;       // drop instead of disconnecting
+    unsigned int flush_kib       = 0;           // KiB of deliveries per write
+    unsigned int flush_us        = 0;           // us deliveries may wait
+    unsigned int min_workers     = 0;           // workers kept while idle
+    unsigned int max_workers     = 0;           // workers run at most
+    bool         b_pin_workers   = false;       // pin workers to CPUs
+    unsigned int metrics_port    = 0;           // admin port, 0 if disabled
+    char        *p_handoff_path  = NULL;        // -y argument, NULL if none
+
     // log_location default 0
     memset(log_location, 0, PATH_MAX);
+    memset(&cluster_config, 0, sizeof(cluster_config));
 
     // get max descriptors using rlimit
     // On error, -1 is returned, and errno is set appropriately.
@@ -126,8 +540,31 @@ main(int argc, char **argv)
 
     // parse command-line arguments
     if (RPLIB_SUCCESS
-        != rpchat_get_arguments(
-            argc, argv, &port_num, log_location, &sz_log_loc))
+        != rpchat_get_arguments(argc,
+                                argv,
+                                &port_num,
+                                log_location,
+                                &sz_log_loc,
+                                &b_affinity,
+                                &num_reactors,
+                                &conn_timeout,
+                                &audit_interval,
+                                &event_batch,
+                                &log_level,
+                                &p_file_dir,
+                                &backlog_frames,
+                                &backlog_kib,
+                                &watermark_mib,
+                                &b_drop_oldest,
+                                &flush_kib,
+                                &flush_us,
+                                &min_workers,
+                                &max_workers,
+                                &b_pin_workers,
+                                &io_backend,
+                                &metrics_port,
+                                &cluster_config,
+                                &p_handoff_path))
     {
         goto leave;
     }
@@ -138,14 +575,126 @@ main(int argc, char **argv)
         h_fd_log_loc = rpchat_open_log_location(log_location);
     }
 
+    // files are only exchanged if asked for, and the directory opens
+    if (NULL != p_file_dir)
+    {
+        h_fd_file_dir = rpchat_open_file_dir(p_file_dir);
+        if (0 > h_fd_file_dir)
+        {
+            rpchat_close_log_location(h_fd_log_loc);
+            goto leave;
+        }
+    }
+
+    // settle on a backend before anything is watched
+    io_backend = rpchat_select_io_backend(io_backend);
+
     // print args (for situational awareness)
     printf("Port: %d\n", port_num);
     // if log location not provided or invalid, use stdout exclusively
     printf("Log Location: %s\n", 0 < h_fd_log_loc ? log_location : "stdout");
+    printf("Connection Affinity: %s\n", b_affinity ? "on" : "off");
+    printf("Reactors: %u\n", num_reactors);
+    printf("Inactivity Timeout: %us (checked every %us)\n",
+           conn_timeout,
+           audit_interval);
+    printf("Event Batch: %u\n", event_batch);
+    printf("I/O Backend: %s\n", rpchat_io_backend_name(io_backend));
+    printf("Log Level: %s\n", rpchat_log_level_name(log_level));
+    printf("File Directory: %s\n", p_file_dir ? p_file_dir : "none");
+    printf("Outbound Budget: %u messages, %u KiB per client (%s when over), "
+           "sends refused past %u MiB\n",
+           backlog_frames,
+           backlog_kib,
+           b_drop_oldest ? "drop oldest" : "disconnect",
+           watermark_mib);
+    printf("Delivery Coalescing: up to %u KiB per write, waiting %uus\n",
+           flush_kib,
+           flush_us);
+    printf("Workers: %u to %u%s\n",
+           min_workers,
+           max_workers,
+           b_pin_workers ? ", pinned" : "");
+    if (0 < metrics_port)
+    {
+        printf("Metrics: 127.0.0.1:%u\n", metrics_port);
+    }
+    else
+    {
+        printf("Metrics: off\n");
+    }
+    if (0 < cluster_config.port_num)
+    {
+        printf("Cluster: node %u, links on port %u, %zu other nodes\n",
+               cluster_config.node_id,
+               cluster_config.port_num,
+               cluster_config.num_peers);
+    }
+    else
+    {
+        printf("Cluster: off\n");
+    }
+    printf("Handoff: %s\n", p_handoff_path ? p_handoff_path : "off");
+    // anything printed so far lands before the first record
+    fflush(stdout);
+    if (RPLIB_SUCCESS
+        != rpchat_log_start(0 < h_fd_log_loc ? h_fd_log_loc : STDOUT_FILENO,
+                            log_level))
+    {
+        rpchat_close_file_dir(h_fd_file_dir);
+        rpchat_close_log_location(h_fd_log_loc);
+        goto leave;
+    }
+    // a predecessor holds every port until it handed its clients over
+    if (NULL != p_handoff_path
+        && RPLIB_SUCCESS != rpchat_handoff_receive(p_handoff_path, &p_handoff))
+    {
+        printf("Notice: %s\n", "Handoff failed, starting without clients");
+    }
+    // recording starts with the admin socket, before any worker exists
+    if (0 < metrics_port && RPLIB_SUCCESS != rpchat_metrics_start(metrics_port))
+    {
+        rpchat_handoff_destroy(p_handoff);
+        rpchat_log_stop();
+        rpchat_close_file_dir(h_fd_file_dir);
+        rpchat_close_log_location(h_fd_log_loc);
+        goto leave;
+    }
 
     // begin
-    res = rpchat_begin_chat_server(port_num, max_descriptors);
+    config.port_num        = port_num;
+    config.max_connections = max_descriptors;
+    config.b_affinity      = b_affinity;
+    config.num_reactors    = num_reactors;
+    config.conn_timeout    = conn_timeout;
+    config.audit_interval  = audit_interval;
+    config.event_batch     = event_batch;
+    config.h_fd_file_dir   = h_fd_file_dir;
+    config.backlog_frames  = backlog_frames;
+    config.backlog_kib     = backlog_kib;
+    config.watermark_mib   = watermark_mib;
+    config.b_drop_oldest   = b_drop_oldest;
+    config.flush_kib       = flush_kib;
+    config.flush_us        = flush_us;
+    config.min_workers     = min_workers;
+    config.max_workers     = max_workers;
+    config.b_pin_workers   = b_pin_workers;
+    config.p_handoff_path  = p_handoff_path;
+    config.p_handoff       = p_handoff;
+    // standalone servers run without federation options
+    config.p_cluster_config
+        = 0 < cluster_config.port_num ? &cluster_config : NULL;
+    res = rpchat_begin_chat_server(&config);
+    // anything neither taken nor resumed is closed
+    rpchat_handoff_destroy(p_handoff);
 
+    rpchat_metrics_stop();
+    num_log_dropped = rpchat_log_stop();
+    if (0 < num_log_dropped)
+    {
+        printf("Notice: logger dropped %zu records\n", num_log_dropped);
+    }
+    rpchat_close_file_dir(h_fd_file_dir);
     rpchat_close_log_location(h_fd_log_loc);
 leave:
     return res;
@@ -8,124 +8,421 @@
 
 #include "rpchat_basic_chat.h"
 
+/**
+ * Thread entry for every reactor but the first
+ * @param p_arg Pointer to `rpchat_reactor_t`
+ * @return NULL
+ */
+static void *
+rpchat_reactor_thread(void *p_arg)
+{
+    rpchat_reactor_t *p_reactor = (rpchat_reactor_t *)p_arg;
+
+    p_reactor->res = rpchat_run_reactor(p_reactor);
+    return NULL;
+}
+
 int
-rpchat_begin_chat_server(unsigned int port_num, unsigned int max_connections)
+rpchat_begin_chat_server(rpchat_server_config_t *p_config)
 {
-    int                  res             = RPLIB_UNSUCCESS; // assume failure
-    int                  h_fd_server     = RPLIB_ERROR;     // server socket fd
-    int                  h_fd_epoll      = RPLIB_ERROR;     // epoll instance fd
-    int                  h_fd_signal     = RPLIB_ERROR;
-    int                  loop_res        = RPLIB_SUCCESS;   // default success
-    rplib_tpool_t       *p_tpool         = NULL;            // threadpool
-    rpchat_conn_queue_t *p_conn_queue    = NULL; // queue for connections
-    struct epoll_event  *p_ret_event_buf = NULL; // buffer for events
-
-    // create tcp server socket and epoll instance
+    int                       res          = RPLIB_UNSUCCESS; // failure
+    rplib_tpool_t            *p_tpool      = NULL;            // threadpool
+    rpchat_reactor_t         *p_reactors   = NULL;            // event loops
+    rpchat_conn_queue_t     **pp_queues    = NULL; // queue of every reactor
+    unsigned int              num_reactors = p_config->num_reactors;
+    unsigned int              num_started  = 1; // reactors running
+    unsigned int              index        = 0; // index for reactor loops
+    rpchat_file_cache_t      *p_file_cache = NULL; // shared by reactors
+    rplib_pool_stats_t        pool_stats;          // allocator counters
+    rpchat_file_cache_stats_t cache_stats;         // file cache counters
+    rpchat_backlog_policy_t   backlog;             // outbound budgets
+    rpchat_cluster_t         *p_cluster    = NULL; // federation, if any
+    int                       listeners[RPCHAT_MAX_REACTORS]; // successor's
+    int                       num_handed   = 0; // clients passed to successor
+
+    assert(0 < num_reactors);
+    p_reactors = calloc(num_reactors, sizeof(rpchat_reactor_t));
+    pp_queues  = calloc(num_reactors, sizeof(rpchat_conn_queue_t *));
+    if (NULL == p_reactors || NULL == pp_queues)
+    {
+        perror("calloc");
+        goto cleanup;
+    }
+    for (index = 0; index < num_reactors; index++)
+    {
+        p_reactors[index].h_fd_server    = RPLIB_ERROR;
+        p_reactors[index].h_fd_epoll     = RPLIB_ERROR;
+        p_reactors[index].h_fd_signal    = RPLIB_ERROR;
+        p_reactors[index].h_fd_timer     = RPLIB_ERROR;
+        p_reactors[index].h_fd_handoff   = RPLIB_ERROR;
+        p_reactors[index].h_fd_successor = RPLIB_ERROR;
+        // no point asking for more events than descriptors
+        p_reactors[index].event_batch
+            = (p_config->event_batch < p_config->max_connections)
+                  ? p_config->event_batch
+                  : p_config->max_connections;
+    }
+
+    // create tcp server socket and epoll instance; first reactor also takes
+    // signals (blocked before any other thread starts, so all inherit mask);
+    // listeners a predecessor passed over are used before binding new ones
     res = rpchat_begin_networking(
-        port_num, &h_fd_server, &h_fd_epoll, &h_fd_signal);
-    if (0 > h_fd_epoll)
+        p_config->port_num,
+        rpchat_handoff_take_listener(p_config->p_handoff, p_config->port_num),
+        &p_reactors[0].h_fd_server,
+        &p_reactors[0].h_fd_epoll,
+        &p_reactors[0].h_fd_signal);
+    if (0 > p_reactors[0].h_fd_epoll)
     {
-        goto leave;
+        goto cleanup;
+    }
+    // every other reactor binds its own listener to the same port
+    for (index = 1; index < num_reactors; index++)
+    {
+        res = rpchat_begin_listener(
+            p_config->port_num,
+            rpchat_handoff_take_listener(p_config->p_handoff,
+                                         p_config->port_num),
+            &p_reactors[index].h_fd_server,
+            &p_reactors[index].h_fd_epoll);
+        if (RPLIB_SUCCESS != res)
+        {
+            goto cleanup;
+        }
+    }
+    res = RPLIB_UNSUCCESS;
+
+    // successors connect to the first reactor, which owns stopping
+    if (NULL != p_config->p_handoff_path)
+    {
+        p_reactors[0].h_fd_handoff
+            = rpchat_handoff_listen(p_config->p_handoff_path);
+        if (0 > p_reactors[0].h_fd_handoff
+            || RPLIB_SUCCESS
+                   != rpchat_watch_descriptor(p_reactors[0].h_fd_epoll,
+                                              p_reactors[0].h_fd_handoff))
+        {
+            goto cleanup;
+        }
     }
 
     // create threadpool
-    p_tpool = rplib_tpool_create(RPCHAT_NUM_THREADS);
+    p_tpool = rplib_tpool_create_adaptive(
+        p_config->min_workers, p_config->max_workers, p_config->b_pin_workers);
     if (!p_tpool)
     {
         goto cleanup;
     }
 
-    // create queue for connections
-    p_conn_queue = rpchat_conn_queue_create(h_fd_epoll);
-    if (!p_conn_queue)
+    // one cache for the directory, whichever reactor a download lands on
+    if (0 <= p_config->h_fd_file_dir)
     {
-        goto cleanup;
+        p_file_cache = rpchat_file_cache_create(RPCHAT_FILE_CACHE_BUDGET);
+        if (NULL == p_file_cache)
+        {
+            goto cleanup;
+        }
     }
 
-    // start threadpool
-    rplib_tpool_start(p_tpool);
+    // budgets hold for every client, whichever reactor it landed on
+    backlog.max_frames    = p_config->backlog_frames;
+    backlog.max_bytes     = (size_t)p_config->backlog_kib * 1024;
+    backlog.b_drop_oldest = p_config->b_drop_oldest;
+    backlog.watermark     = (size_t)p_config->watermark_mib * 1024 * 1024;
+    atomic_init(&backlog.sz_queued, 0);
 
-    // begin awaiting events
-    for (;;)
+    // create queue for connections of each reactor, sharing one allocator
+    for (index = 0; index < num_reactors; index++)
     {
-        // allocate returned events buffer
-        p_ret_event_buf = calloc(max_connections, sizeof(struct epoll_event));
-        if (NULL == p_ret_event_buf)
+        pp_queues[index] = rpchat_conn_queue_create(
+            p_reactors[index].h_fd_epoll,
+            p_config->b_affinity,
+            0 == index ? NULL : pp_queues[0]->p_pool);
+        if (!pp_queues[index])
         {
-            perror("calloc");
-            res = RPLIB_ERROR;
             goto cleanup;
         }
+        p_reactors[index].p_conn_queue  = pp_queues[index];
+        p_reactors[index].p_tpool       = p_tpool;
+        pp_queues[index]->conn_timeout  = p_config->conn_timeout;
+        pp_queues[index]->idle_recheck  = p_config->audit_interval;
+        pp_queues[index]->h_fd_file_dir = p_config->h_fd_file_dir;
+        pp_queues[index]->p_file_cache  = p_file_cache;
+        pp_queues[index]->p_backlog     = &backlog;
+        pp_queues[index]->p_tpool       = p_tpool;
+        pp_queues[index]->flush_bytes   = (size_t)p_config->flush_kib * 1024;
+        pp_queues[index]->flush_us      = p_config->flush_us;
+        if (RPLIB_SUCCESS
+            != rpchat_watch_descriptor(p_reactors[index].h_fd_epoll,
+                                       pp_queues[index]->h_fd_mailbox))
+        {
+            perror("mailbox");
+            goto cleanup;
+        }
+        if (RPLIB_SUCCESS
+            != rpchat_watch_descriptor(p_reactors[index].h_fd_epoll,
+                                       pp_queues[index]->h_fd_flush))
+        {
+            perror("flush timer");
+            goto cleanup;
+        }
+        // each reactor checks its own connections for inactivity
+        p_reactors[index].h_fd_timer = rpchat_begin_timer(
+            p_reactors[index].h_fd_epoll, p_config->audit_interval);
+        if (0 > p_reactors[index].h_fd_timer)
+        {
+            goto cleanup;
+        }
+    }
+    // let every queue reach the others
+    for (index = 0; 1 < num_reactors && index < num_reactors; index++)
+    {
+        pp_queues[index]->pp_peers  = pp_queues;
+        pp_queues[index]->num_peers = num_reactors;
+    }
 
-        // wait for activity reported by epoll
-        loop_res = rpchat_monitor_connections(
-            h_fd_epoll, p_ret_event_buf, max_connections);
-
-        if (RPLIB_ERROR == loop_res)
+    // link up with other nodes, every queue forwarding its broadcasts
+    if (NULL != p_config->p_cluster_config)
+    {
+        p_cluster = rpchat_cluster_create(
+            p_config->p_cluster_config, pp_queues, num_reactors, p_tpool);
+        if (NULL == p_cluster)
         {
-            RPLIB_DEBUG_PRINTF("Error: %s \n", "Monitor Connections error");
-            res = RPLIB_UNSUCCESS;
-            break;
+            goto cleanup;
         }
-        // handle incoming connections
-        loop_res = rpchat_handle_events(p_ret_event_buf,
-                                        h_fd_server,
-                                        h_fd_epoll,
-                                        h_fd_signal,
-                                        p_tpool,
-                                        loop_res,
-                                        p_conn_queue);
-        // if handle_events returns 1, planned exit
-        if (RPLIB_UNSUCCESS == loop_res)
+        for (index = 0; index < num_reactors; index++)
         {
-            res = RPLIB_SUCCESS;
-            break;
+            pp_queues[index]->p_cluster = p_cluster;
         }
+    }
+
+    // scrapes can read the pool, queues and caches from here on
+    rpchat_metrics_attach(p_tpool,
+                          pp_queues,
+                          num_reactors,
+                          p_file_cache,
+                          pp_queues[0]->p_pool);
 
-        // cleanup per loop
-        free(p_ret_event_buf);
-        p_ret_event_buf = NULL;
+    // start threadpool
+    rplib_tpool_start(p_tpool);
+    // clients of the predecessor resume before other nodes link, so their
+    // names are claimed without waiting on anyone
+    if (NULL != p_config->p_handoff)
+    {
+        printf("Notice: resumed %zu clients\n",
+               rpchat_handoff_adopt(p_config->p_handoff,
+                                    pp_queues,
+                                    num_reactors,
+                                    p_cluster,
+                                    p_tpool));
     }
+    if (NULL != p_cluster && RPLIB_SUCCESS != rpchat_cluster_start(p_cluster))
+    {
+        goto cleanup;
+    }
+
+    // start other reactors, first runs on this thread
+    for (; num_started < num_reactors; num_started++)
+    {
+        if (0
+            != pthread_create(&p_reactors[num_started].thread,
+                              NULL,
+                              rpchat_reactor_thread,
+                              &p_reactors[num_started]))
+        {
+            perror("pthread_create");
+            goto cleanup;
+        }
+    }
+
+    // begin awaiting events
+    res = rpchat_run_reactor(&p_reactors[0]);
     // notify
     printf("\nNotice: %s\n", "Shutting down..");
 cleanup:
+    // nothing arrives from other nodes, nor is resolved, from here on
+    rpchat_cluster_stop(p_cluster);
+    // stop other reactors before their queues go away
+    for (index = 1; index < num_started; index++)
+    {
+        rpchat_conn_queue_stop(pp_queues[index]);
+        pthread_join(p_reactors[index].thread, NULL);
+    }
+    // scrapes stop reading the pool, queues and caches before they go away
+    rpchat_metrics_detach();
+    // a successor takes clients once nothing is left running for them
+    if (NULL != p_reactors && 0 <= p_reactors[0].h_fd_successor)
+    {
+        rpchat_handoff_quiesce(pp_queues, num_reactors, p_tpool);
+    }
     // clean tpool, allow jobs to finish
     if (NULL != p_tpool)
     {
         rplib_tpool_destroy(p_tpool, false);
     }
-    // clean up conn_queue
-    if (NULL != p_conn_queue)
+    if (NULL != p_reactors && 0 <= p_reactors[0].h_fd_successor)
+    {
+        for (index = 0; index < num_reactors; index++)
+        {
+            listeners[index] = p_reactors[index].h_fd_server;
+        }
+        num_handed = rpchat_handoff_send(p_reactors[0].h_fd_successor,
+                                         listeners,
+                                         num_reactors,
+                                         pp_queues,
+                                         num_reactors);
+        if (0 <= num_handed)
+        {
+            printf("Notice: handed %d clients to successor\n", num_handed);
+        }
+    }
+    // names and links go before the allocator mail was taken from
+    rpchat_cluster_destroy(p_cluster);
+    // clean up conn_queues, owner of the shared allocator last
+    if (NULL != pp_queues && NULL != pp_queues[0])
+    {
+        // report how often the allocator had to go to the heap
+        rplib_pool_get_stats(pp_queues[0]->p_pool, &pool_stats);
+        printf("Notice: allocator %lu cache hits, %lu pool hits, %lu misses\n",
+               pool_stats.cache_hits,
+               pool_stats.pool_hits,
+               pool_stats.misses);
+    }
+    for (index = num_reactors; NULL != pp_queues && 0 < index; index--)
+    {
+        if (NULL != pp_queues[index - 1])
+        {
+            rpchat_conn_queue_destroy(pp_queues[index - 1]);
+        }
+    }
+    // downloads were ended with their connections
+    if (NULL != p_file_cache)
+    {
+        rpchat_file_cache_get_stats(p_file_cache, &cache_stats);
+        printf("Notice: file cache %lu hits, %lu misses, %lu files kept\n",
+               cache_stats.hits,
+               cache_stats.misses,
+               cache_stats.num_entries);
+        rpchat_file_cache_destroy(p_file_cache);
+        p_file_cache = NULL;
+    }
+    // the next server may listen at the path once this one is gone
+    if (NULL != p_reactors && 0 <= p_reactors[0].h_fd_handoff)
     {
-        rpchat_conn_queue_destroy(p_conn_queue);
+        rpchat_handoff_close(p_reactors[0].h_fd_handoff,
+                             p_config->p_handoff_path);
     }
     // clean up epoll (and watched fds)
-    if (0 < h_fd_epoll)
+    for (index = 0; NULL != p_reactors && index < num_reactors; index++)
     {
-        rpchat_stop_networking(h_fd_epoll, h_fd_server, h_fd_signal);
+        if (0 < p_reactors[index].h_fd_epoll)
+        {
+            rpchat_stop_networking(p_reactors[index].h_fd_epoll,
+                                   p_reactors[index].h_fd_server,
+                                   p_reactors[index].h_fd_signal,
+                                   p_reactors[index].h_fd_timer);
+        }
+    }
+    free(pp_queues);
+    pp_queues = NULL;
+    free(p_reactors);
+    p_reactors = NULL;
+    return res;
+}
+
+int
+rpchat_run_reactor(rpchat_reactor_t *p_reactor)
+{
+    int res      = RPLIB_UNSUCCESS; // assume failure
+    int loop_res = RPLIB_SUCCESS;   // default success
+
+    // buffers live as long as the loop, sized for one batch
+    p_reactor->p_event_buf
+        = calloc(p_reactor->event_batch, sizeof(struct epoll_event));
+    p_reactor->p_task_buf
+        = calloc(p_reactor->event_batch, sizeof(rplib_tpool_task_t));
+    if (NULL == p_reactor->p_event_buf || NULL == p_reactor->p_task_buf)
+    {
+        perror("calloc");
+        res = RPLIB_ERROR;
+        goto leave;
+    }
+    for (;;)
+    {
+        // wait for activity reported by epoll
+        loop_res = rpchat_monitor_connections(p_reactor->h_fd_epoll,
+                                              p_reactor->p_event_buf,
+                                              p_reactor->event_batch);
+
+        if (RPLIB_ERROR == loop_res)
+        {
+            RPLIB_DEBUG_PRINTF("Error: %s \n", "Monitor Connections error");
+            res = RPLIB_UNSUCCESS;
+            break;
+        }
+        // handle incoming connections
+        loop_res = rpchat_handle_events(p_reactor, loop_res);
+        // if handle_events returns 1, planned exit
+        if (RPLIB_UNSUCCESS == loop_res)
+        {
+            res = RPLIB_SUCCESS;
+            break;
+        }
     }
-    free(p_ret_event_buf);
-    p_ret_event_buf = NULL;
 leave:
+    free(p_reactor->p_event_buf);
+    p_reactor->p_event_buf = NULL;
+    free(p_reactor->p_task_buf);
+    p_reactor->p_task_buf = NULL;
     return res;
 }
 
+/**
+ * Helper function to hand the tasks batched by `rpchat_handle_events` to the
+ * threadpool. Tasks the threadpool could not take are dropped; their
+ * connections stay disarmed until the inactivity timer reaps them
+ * @param p_reactor Pointer to reactor
+ * @param num_tasks Number of tasks in `p_task_buf`
+ */
+static void
+rpchat_flush_task_batch(rpchat_reactor_t *p_reactor, size_t num_tasks)
+{
+    size_t                    task_index  = 0;
+    rpchat_args_proc_event_t *p_proc_args = NULL;
+
+    task_index = rplib_tpool_enqueue_batch(
+        p_reactor->p_tpool, p_reactor->p_task_buf, num_tasks);
+    for (; task_index < num_tasks; task_index++)
+    {
+        p_proc_args = p_reactor->p_task_buf[task_index].p_arg;
+        // the poll that reported the event is over either way
+        atomic_store(&p_proc_args->p_conn_info->b_poll_pending, false);
+        atomic_fetch_sub(&p_proc_args->p_conn_info->pending_jobs, 1);
+        rplib_pool_free(p_reactor->p_conn_queue->p_pool, p_proc_args);
+    }
+}
+
 int
-rpchat_handle_events(struct epoll_event  *p_ret_event_buf,
-                     int                  h_fd_server,
-                     int                  h_fd_epoll,
-                     int                  h_fd_signal,
-                     rplib_tpool_t       *p_tpool,
-                     size_t               sz_ret_event_buf,
-                     rpchat_conn_queue_t *p_conn_queue)
+rpchat_handle_events(rpchat_reactor_t *p_reactor, size_t num_events)
 {
     int                       res             = RPLIB_UNSUCCESS;
-    unsigned int              event_index     = 0;    // index for event loop
+    size_t                    event_index     = 0;     // index for event loop
+    size_t                    num_batched     = 0;     // tasks in p_task_buf
     rpchat_conn_info_t       *p_conn_info     = NULL;
-    rpchat_args_proc_event_t *p_new_proc_args = NULL; // args for each event
+    rpchat_args_proc_event_t *p_new_proc_args = NULL;  // args for each event
+    bool                      b_dropped       = false; // an event not queued
+    struct epoll_event       *p_ret_event_buf = p_reactor->p_event_buf;
+    int                       h_fd_server     = p_reactor->h_fd_server;
+    int                       h_fd_epoll      = p_reactor->h_fd_epoll;
+    int                       h_fd_signal     = p_reactor->h_fd_signal;
+    int                       h_fd_timer      = p_reactor->h_fd_timer;
+    int                       h_fd_handoff    = p_reactor->h_fd_handoff;
+    rplib_tpool_t            *p_tpool         = p_reactor->p_tpool;
+    rpchat_conn_queue_t      *p_conn_queue    = p_reactor->p_conn_queue;
+    uint64_t                  enqueued_ns     = rpchat_metrics_now();
 
     // iterate over returned events
-    for (event_index = 0; event_index < sz_ret_event_buf; event_index++)
+    for (event_index = 0; event_index < num_events; event_index++)
     {
         // process signal
         if (h_fd_signal == p_ret_event_buf[event_index].data.fd)
@@ -139,24 +436,63 @@ rpchat_handle_events(struct epoll_event  *p_ret_event_buf,
             }
             goto leave;
         }
-        // process new connection
-        if (h_fd_server == p_ret_event_buf[event_index].data.fd)
+        // a successor takes over; stop as on SIGINT, then pass clients
+        if (0 <= h_fd_handoff
+            && h_fd_handoff == p_ret_event_buf[event_index].data.fd)
         {
-            res = rpchat_handle_new_connection(
-                h_fd_server, h_fd_epoll, p_conn_queue);
+            p_reactor->h_fd_successor = rpchat_handoff_accept(h_fd_handoff);
+            if (0 > p_reactor->h_fd_successor)
+            {
+                res = RPLIB_SUCCESS;
+                continue;
+            }
+            printf("\nNotice: %s\n", "Successor connected");
+            res = RPLIB_UNSUCCESS;
+            goto leave;
+        }
+        // time to check for inactive connections
+        if (h_fd_timer == p_ret_event_buf[event_index].data.fd)
+        {
+            res = rpchat_handle_timer(h_fd_timer, p_tpool, p_conn_queue);
             if (RPLIB_SUCCESS != res)
             {
                 goto leave;
             }
-            else
+            continue;
+        }
+        // broadcasts from other reactors, or a request to stop
+        if (p_conn_queue->h_fd_mailbox == p_ret_event_buf[event_index].data.fd)
+        {
+            rpchat_deliver_mail(p_conn_queue, p_tpool);
+            if (atomic_load(&p_conn_queue->b_terminate))
             {
-                continue;
+                res = RPLIB_UNSUCCESS;
+                goto leave;
             }
+            res = RPLIB_SUCCESS;
+            continue;
+        }
+        // deliveries waited long enough to be written along with others
+        if (p_conn_queue->h_fd_flush == p_ret_event_buf[event_index].data.fd)
+        {
+            rpchat_flush_lingering(p_conn_queue, p_tpool);
+            res = RPLIB_SUCCESS;
+            continue;
+        }
+        // process new connection
+        if (h_fd_server == p_ret_event_buf[event_index].data.fd)
+        {
+            // failures only cost the connections being accepted; events
+            // after this one were already taken from epoll and must run
+            rpchat_handle_new_connection(h_fd_server, h_fd_epoll, p_conn_queue);
+            res = RPLIB_SUCCESS;
+            continue;
         }
         // handle new event on existing connection
         // allocate (task args will be freed by callee)
         p_new_proc_args = NULL;
-        p_new_proc_args = malloc(sizeof(rpchat_args_proc_event_t));
+        p_new_proc_args = rplib_pool_alloc(p_conn_queue->p_pool,
+                                           sizeof(rpchat_args_proc_event_t));
         if (!p_new_proc_args)
         {
             goto cleanup;
@@ -166,6 +502,9 @@ rpchat_handle_events(struct epoll_event  *p_ret_event_buf,
         // set fields for arg object
         p_new_proc_args->p_msg_buf    = NULL;
         p_new_proc_args->sz_msg_buf   = 0;
+        p_new_proc_args->p_shared_msg = NULL;
+        p_new_proc_args->b_charged    = false;
+        p_new_proc_args->enqueued_ns  = enqueued_ns;
         p_new_proc_args->p_tpool      = p_tpool;
         p_new_proc_args->p_conn_queue = p_conn_queue;
         p_new_proc_args->p_conn_info  = p_conn_info;
@@ -175,22 +514,47 @@ rpchat_handle_events(struct epoll_event  *p_ret_event_buf,
                &p_ret_event_buf[event_index],
                sizeof(struct epoll_event));
 
-        // stop listening for incoming
-        rpchat_toggle_descriptor(
-            h_fd_epoll, p_conn_info->h_fd, p_conn_info, false);
-
-        // send to threadpool
-        res = rpchat_conn_info_enqueue_task(
-            (rpchat_conn_info_t *)p_ret_event_buf[event_index].data.ptr,
-            p_tpool,
-            rpchat_task_conn_proc_event,
-            p_new_proc_args);
+        // pinned connections keep their own worker queue; the rest go to
+        // the threadpool together once every event has been looked at
+        if (p_conn_info->b_affinity)
+        {
+            // dropped as in `rpchat_flush_task_batch`; later events still run
+            if (RPLIB_SUCCESS
+                != rpchat_conn_info_enqueue_task(p_conn_info,
+                                                 p_tpool,
+                                                 rpchat_task_conn_proc_event,
+                                                 p_new_proc_args))
+            {
+                atomic_store(&p_conn_info->b_poll_pending, false);
+                rplib_pool_free(p_conn_queue->p_pool, p_new_proc_args);
+                p_new_proc_args = NULL;
+                b_dropped       = true;
+            }
+            res = RPLIB_SUCCESS;
+            continue;
+        }
+        rpchat_conn_info_batch_task(p_conn_info,
+                                    &p_reactor->p_task_buf[num_batched],
+                                    rpchat_task_conn_proc_event,
+                                    p_new_proc_args);
+        num_batched++;
+        res = RPLIB_SUCCESS;
     }
     goto leave;
 cleanup:
-    free(p_new_proc_args);
+    rplib_pool_free(p_conn_queue->p_pool, p_new_proc_args);
     p_new_proc_args = NULL;
 leave:
+    // events batched before an early leave are still owed to the threadpool
+    if (0 < num_batched)
+    {
+        rpchat_flush_task_batch(p_reactor, num_batched);
+    }
+    // a lost event is an error, never mistaken for a planned exit
+    if (b_dropped && RPLIB_SUCCESS == res)
+    {
+        res = RPLIB_ERROR;
+    }
     return res;
 }
 
@@ -199,45 +563,162 @@ rpchat_handle_new_connection(unsigned int         h_fd_server,
                              unsigned int         h_fd_epoll,
                              rpchat_conn_queue_t *p_conn_queue)
 {
-    int                    h_new_fd = RPLIB_ERROR;
-    int                    res      = RPLIB_ERROR;
-    rplib_ll_queue_node_t *p_new_node;
-    rpchat_conn_info_t     new_conn_info;
-    struct epoll_event     new_event;
+    int                 h_new_fd  = RPLIB_ERROR;
+    int                 res       = RPLIB_SUCCESS;
+    size_t              num_new   = 0; // connections accepted this call
+    size_t              new_index = 0; // index for registering loop
+    rpchat_conn_info_t *p_new_infos[RPCHAT_ACCEPT_BATCH]; // accepted batch
 
-    // accept connection
-    h_new_fd = rpchat_accept_new_connection(h_fd_server);
-    if (0 > h_new_fd)
+    // drain pending connections, capped so one storm cannot starve the
+    // clients already connected; the listener is level triggered, so
+    // anything left over is reported again on the next wait
+    while (RPCHAT_ACCEPT_BATCH > num_new)
     {
-        goto leave;
+        h_new_fd = rpchat_accept_new_connection(h_fd_server);
+        if (0 > h_new_fd)
+        {
+            // anything but running dry is a problem
+            if (EAGAIN != errno && EWOULDBLOCK != errno)
+            {
+                res = RPLIB_ERROR;
+            }
+            break;
+        }
+        // allocate (aligned so hot fields share a cache line) and set fields
+        p_new_infos[num_new] = aligned_alloc(RPCHAT_CONN_CACHE_LINE,
+                                             sizeof(rpchat_conn_info_t));
+        if (NULL == p_new_infos[num_new])
+        {
+            close(h_new_fd);
+            res = RPLIB_ERROR;
+            break;
+        }
+        if (RPLIB_SUCCESS
+            != rpchat_conn_info_initialize(p_new_infos[num_new],
+                                           h_new_fd,
+                                           p_conn_queue->p_pool,
+                                           p_conn_queue->b_affinity))
+        {
+            free(p_new_infos[num_new]);
+            close(h_new_fd);
+            res = RPLIB_ERROR;
+            break;
+        }
+        num_new++;
     }
 
-    // set fields
-    rpchat_conn_info_initialize(&new_conn_info, h_new_fd);
+    // enqueue new conn infos in one go (before epoll can report them)
+    rpchat_conn_queue_add_conn_batch(p_conn_queue, p_new_infos, num_new);
 
-    // enqueue new conn info
-    pthread_mutex_lock(&p_conn_queue->mutex_conn_ll);
-    p_new_node = rplib_ll_queue_enqueue(
-        p_conn_queue->p_conn_ll, &new_conn_info, sizeof(rpchat_conn_info_t));
-    if (!p_new_node)
+    for (new_index = 0; new_index < num_new; new_index++)
     {
-        goto leave;
+        h_new_fd = p_new_infos[new_index]->h_fd;
+        if (RPLIB_SUCCESS
+            != rpchat_register_descriptor(
+                h_fd_epoll,
+                h_new_fd,
+                p_new_infos[new_index],
+                RPCHAT_CONN_EPOLL_EVENTS,
+                &p_new_infos[new_index]->b_poll_pending))
+        {
+            // destroy expects the connection lock held
+            if (!p_new_infos[new_index]->b_affinity)
+            {
+                pthread_mutex_lock(&p_new_infos[new_index]->mutex_conn);
+            }
+            close(h_new_fd);
+            p_new_infos[new_index]->h_fd        = RPLIB_ERROR;
+            p_new_infos[new_index]->conn_status = RPCHAT_CONN_CLOSING;
+            if (RPLIB_SUCCESS
+                == rpchat_conn_queue_remove_conn_info(p_conn_queue,
+                                                      p_new_infos[new_index]))
+            {
+                rpchat_conn_queue_destroy_conn_info(p_new_infos[new_index]);
+            }
+            // a broadcast may be reading a snapshot listing it; once done,
+            // the connection is woken and closes like any other
+            else if (!p_new_infos[new_index]->b_affinity)
+            {
+                pthread_mutex_unlock(&p_new_infos[new_index]->mutex_conn);
+            }
+        }
     }
+    return res;
+}
 
-    // assign
-    new_event.events   = (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLET);
-    new_event.data.ptr = p_new_node->p_data;
-    res = epoll_ctl(h_fd_epoll, EPOLL_CTL_ADD, h_new_fd, &new_event);
+/**
+ * Context passed to `rpchat_audit_expired` while advancing a queue's timers
+ */
+typedef struct
+{
+    rpchat_conn_queue_t *p_conn_queue; // queue being audited
+    rplib_tpool_t       *p_tpool;      // threadpool to queue HEARTBEATs on
+    time_t               now;          // time of audit
+} rpchat_audit_t;
 
-leave:
-    pthread_mutex_unlock(&p_conn_queue->mutex_conn_ll);
-    return res;
+/**
+ * Helper function called for each connection whose inactivity check came due.
+ * Activity since the check was scheduled only moves it to the new deadline;
+ * otherwise a HEARTBEAT tells the connection to gracefully d/c, and another
+ * check follows in case it is still around by then.
+ * \nNote: Caller holds the queue's list lock
+ * @param p_timer Pointer to `idle_timer` of connection
+ * @param p_arg Pointer to `rpchat_audit_t`
+ */
+static void
+rpchat_audit_expired(rplib_timer_node_t *p_timer, void *p_arg)
+{
+    rpchat_audit_t           *p_audit      = (rpchat_audit_t *)p_arg;
+    rpchat_conn_queue_t      *p_conn_queue = p_audit->p_conn_queue;
+    rpchat_conn_info_t       *p_conn_info  = NULL;
+    rpchat_args_proc_event_t *p_exit_args  = NULL; // arguments to close a conn
+    time_t                    deadline     = 0;    // first second timed out
+
+    p_conn_info = RPLIB_CONTAINER_OF(p_timer, rpchat_conn_info_t, idle_timer);
+    deadline    = atomic_load(&p_conn_info->last_active)
+               + p_conn_queue->conn_timeout + 1;
+    // active since scheduled, check again at the new deadline
+    if (p_audit->now < deadline)
+    {
+        rplib_timer_wheel_schedule(
+            &p_conn_queue->idle_timers, p_timer, deadline);
+        return;
+    }
+    rplib_timer_wheel_schedule(&p_conn_queue->idle_timers,
+                               p_timer,
+                               p_audit->now + p_conn_queue->idle_recheck);
+
+    // allocate
+    p_exit_args = rplib_pool_alloc(p_conn_queue->p_pool,
+                                   sizeof(rpchat_args_proc_event_t));
+    if (NULL == p_exit_args)
+    {
+        return;
+    }
+    // set up args
+    p_exit_args->p_conn_queue = p_conn_queue;
+    p_exit_args->sz_msg_buf   = 0;
+    p_exit_args->args_type    = RPCHAT_PROC_EVENT_HEARTBEAT;
+    p_exit_args->p_tpool      = p_audit->p_tpool;
+    p_exit_args->p_msg_buf    = NULL;
+    p_exit_args->p_shared_msg = NULL;
+    p_exit_args->b_charged    = false;
+    p_exit_args->enqueued_ns  = rpchat_metrics_now();
+    p_exit_args->p_conn_info  = p_conn_info;
+
+    if (RPLIB_SUCCESS
+        != rpchat_conn_info_enqueue_task(p_conn_info,
+                                         p_audit->p_tpool,
+                                         rpchat_task_conn_proc_event,
+                                         p_exit_args))
+    {
+        rplib_pool_free(p_conn_queue->p_pool, p_exit_args);
+    }
 }
 
 /**
- * Helper function to check connections for timeout.
- * If a connection has timed out, tell main event loop to gracefully d/c and
- * destroy it.
+ * Helper function to check connections for timeout. Only connections whose
+ * inactivity check came due are looked at.
  * @param p_conn_queue Pointer to connection queue
  * @param p_tpool Pointer to threadpool
  * @return RPLIB_SUCCESS on no issues, otherwise RPLIB_UNSUCCESS
@@ -246,53 +727,35 @@ static int
 rpchat_audit_connections(rpchat_conn_queue_t *p_conn_queue,
                          rplib_tpool_t       *p_tpool)
 {
-    rplib_ll_queue_node_t    *p_current_node;
-    rpchat_conn_info_t       *p_current_info;
-    rpchat_args_proc_event_t *p_exit_args; // arguments to close a conn
-    int                       res = RPLIB_UNSUCCESS;
+    rpchat_audit_t audit; // context for expired checks
 
-    // acquire lock on connection queue for safety
+    audit.p_conn_queue = p_conn_queue;
+    audit.p_tpool      = p_tpool;
+    audit.now          = time(0);
+    // acquire lock on connection queue, timers share it with the list
     pthread_mutex_lock(&p_conn_queue->mutex_conn_ll);
-    // if queue empty, wave off
-    if (1 > p_conn_queue->p_conn_ll->size)
-    {
-        res = RPLIB_SUCCESS;
-        goto leave;
-    }
-    p_current_node = p_conn_queue->p_conn_ll->p_front;
-    // for every node, eqneuue heartbeat task
-    while (NULL != p_current_node)
-    {
-        p_current_info = (rpchat_conn_info_t *)p_current_node->p_data;
-
-        // allocate
-        p_exit_args = malloc(sizeof(rpchat_args_proc_event_t));
-
-        if (NULL == p_exit_args)
-        {
-            goto leave;
-        }
+    rplib_timer_wheel_advance(&p_conn_queue->idle_timers,
+                              (uint64_t)audit.now,
+                              rpchat_audit_expired,
+                              &audit);
+    pthread_mutex_unlock(&p_conn_queue->mutex_conn_ll);
+    return RPLIB_SUCCESS;
+}
 
-        // set up args
-        p_exit_args->p_conn_queue = p_conn_queue;
-        p_exit_args->sz_msg_buf   = 0;
-        p_exit_args->args_type    = RPCHAT_PROC_EVENT_HEARTBEAT;
-        p_exit_args->p_tpool      = p_tpool;
-        p_exit_args->p_msg_buf    = NULL;
-        p_exit_args->p_conn_info  = p_current_info;
+int
+rpchat_handle_timer(int                  h_fd_timer,
+                    rplib_tpool_t       *p_tpool,
+                    rpchat_conn_queue_t *p_conn_queue)
+{
+    uint64_t expirations = 0; // periods passed since last read
 
-        res = rpchat_conn_info_enqueue_task(
-            p_current_info, p_tpool, rpchat_task_conn_proc_event, p_exit_args);
-        if (RPLIB_SUCCESS != res)
-        {
-            goto leave;
-        }
-        p_current_node = p_current_node->p_next_node;
+    // clear readiness, nothing to do if another read already did
+    if (sizeof(expirations)
+        != read(h_fd_timer, &expirations, sizeof(expirations)))
+    {
+        return (EAGAIN == errno) ? RPLIB_SUCCESS : RPLIB_ERROR;
     }
-    res = RPLIB_SUCCESS;
-leave:
-    pthread_mutex_unlock(&p_conn_queue->mutex_conn_ll);
-    return res;
+    return rpchat_audit_connections(p_conn_queue, p_tpool);
 }
 
 int
@@ -304,17 +767,17 @@ rpchat_handle_signal(int                  h_fd_epoll,
     int res    = RPLIB_ERROR;
     int signum = rpchat_get_signal(h_fd_signal);
 
+    (void)p_tpool;
+    (void)p_conn_queue;
     // get signumber
     // on SIGINT, stop listening and tell caller to close
     switch (signum)
     {
         case SIGINT:
             // stop listening
-            epoll_ctl(h_fd_epoll, EPOLL_CTL_DEL, h_fd_signal, NULL);
+            rpchat_unwatch_descriptor(h_fd_epoll, h_fd_signal);
             res = RPLIB_UNSUCCESS;
             goto leave;
-        case SIGALRM:
-            res = rpchat_audit_connections(p_conn_queue, p_tpool);
         default:
             goto leave;
     }
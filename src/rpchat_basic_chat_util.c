@@ -9,27 +9,36 @@
 
 #include "rpchat_basic_chat_util.h"
 
+#include <errno.h>
+
 #include "components/rpchat_conn_info.h"
+#include "rpchat_io_uring.h"
+#include "rpchat_networking.h"
 
 int
-rpchat_toggle_descriptor(int   h_fd_epoll,
-                         int   h_toggle_fd,
-                         void *p_data_ptr,
-                         bool  enabled)
+rpchat_arm_descriptor(int          h_fd_epoll,
+                      int          h_arm_fd,
+                      void        *p_data_ptr,
+                      uint32_t     events,
+                      atomic_bool *p_b_pending)
 {
     int                res = RPLIB_UNSUCCESS;
     struct epoll_event delta_event; // contains new defs
-    // set defs
-    if (!enabled)
+
+    if (RPCHAT_IO_EPOLL != rpchat_get_io_backend())
     {
-        res = epoll_ctl(h_fd_epoll, EPOLL_CTL_DEL, h_toggle_fd, NULL);
-        goto leave;
+        return rpchat_uring_arm(
+            h_fd_epoll, h_arm_fd, p_data_ptr, events, p_b_pending);
     }
-    delta_event.events   = (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLET);
+    delta_event.events   = events;
     delta_event.data.ptr = p_data_ptr;
-    // mod descriptor
-    epoll_ctl(h_fd_epoll, EPOLL_CTL_ADD, h_toggle_fd, &delta_event);
-leave:
+    // update existing registration, otherwise add a new one
+    res = epoll_ctl(h_fd_epoll, EPOLL_CTL_MOD, h_arm_fd, &delta_event);
+    if (0 > res && ENOENT == errno)
+    {
+        res = epoll_ctl(h_fd_epoll, EPOLL_CTL_ADD, h_arm_fd, &delta_event);
+    }
+    res = 0 > res ? RPLIB_UNSUCCESS : RPLIB_SUCCESS;
     return res;
 }
 
@@ -52,6 +61,36 @@ rpchat_get_msg_type(char *p_msg_buf)
         case 4:
             res = RPCHAT_BCP_STATUS;
             break;
+        case 5:
+            res = RPCHAT_BCP_SENDFILE;
+            break;
+        case 6:
+            res = RPCHAT_BCP_FNOTIFY;
+            break;
+        case 7:
+            res = RPCHAT_BCP_GETFILE;
+            break;
+        case 8:
+            res = RPCHAT_BCP_RECVFILE;
+            break;
+        case 9:
+            res = RPCHAT_BCP_REGWIN;
+            break;
+        case 10:
+            res = RPCHAT_BCP_ACK;
+            break;
+        case 11:
+            res = RPCHAT_BCP_JOIN;
+            break;
+        case 12:
+            res = RPCHAT_BCP_LEAVE;
+            break;
+        case 13:
+            res = RPCHAT_BCP_ROOMSEND;
+            break;
+        case 14:
+            res = RPCHAT_BCP_ROOMDELIVER;
+            break;
         default:
             res = RPLIB_UNSUCCESS;
             break;
@@ -0,0 +1,1743 @@
+/** @file rpchat_cluster.c
+ *
+ * @brief Implements the federation declared in `rpchat_cluster.h`. A single
+ * cluster thread owns every link: it accepts and dials them, reads and
+ * handles their frames, and writes what workers queued for them. Workers only
+ * append to a link's pending buffer and wake the thread.
+ *
+ * Locks are taken in one order: registry, then the usernames of the queues,
+ * then links, then mailboxes and the threadpool. Nothing waits on a lock
+ * earlier in that order while holding a later one
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#define _GNU_SOURCE // accept4
+
+#include "rpchat_cluster.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "components/rpchat_name_index.h"
+#include "rpchat_basic_chat_util.h"
+#include "rpchat_log.h"
+#include "rpchat_networking.h"
+#include "rpchat_process_event.h"
+
+#define RPCHAT_CLUSTER_NO_NODE (-1) // link has not introduced itself yet
+#define RPCHAT_CLUSTER_HELLO_SZ 2   // version, then node id
+#define RPCHAT_CLUSTER_BIT(node_id) (UINT64_C(1) << (node_id))
+
+/**
+ * Bytes waiting to be written to a link
+ */
+typedef struct
+{
+    char  *p_data;   // contents, NULL until first frame
+    size_t len;      // bytes in use
+    size_t capacity; // bytes allocated
+} rpchat_cluster_buf_t;
+
+/**
+ * A TCP link to another node
+ */
+typedef struct rpchat_cluster_link
+{
+    int                  h_fd;         // socket
+    int                  node_id;      // id from HELLO, or NO_NODE
+    int                  peer_index;   // entry of config dialed, -1 if accepted
+    bool                 b_connecting; // dial not yet completed
+    bool                 b_want_out;   // EPOLLOUT watched
+    bool                 b_dead;       // closed, freed after event batch
+    bool                 b_overrun;    // under mutex_links, too much pending
+    time_t               last_rx;      // bytes last received
+    rpchat_cluster_buf_t pending;      // under mutex_links, queued by anyone
+    rpchat_cluster_buf_t sending;      // being written, cluster thread only
+    size_t               sz_sent;      // bytes of sending already written
+    size_t               in_len;       // bytes in in_buf
+    struct rpchat_cluster_link *p_next; // next link of node
+    char in_buf[RPCHAT_CLUSTER_IN_BUF_SZ]; // received, not yet handled
+} rpchat_cluster_link_t;
+
+/**
+ * A username held, or claimed, somewhere in the cluster
+ */
+typedef struct rpchat_cluster_name
+{
+    struct rpchat_cluster_name *p_next;       // next of bucket
+    uint32_t                    hash;         // hash of contents
+    unsigned int                node_id;      // node holding the name
+    uint64_t                    awaiting;     // nodes yet to grant, own claims
+    rpchat_conn_info_t         *p_conn_info;  // holder, own names only
+    rpchat_conn_queue_t        *p_conn_queue; // queue of holder
+    uint16_t                    len;          // length of contents
+    char                        contents[];   // NUL terminated
+} rpchat_cluster_name_t;
+
+struct rpchat_cluster
+{
+    rpchat_cluster_config_t config;      // options of node
+    rpchat_conn_queue_t   **pp_queues;   // queues of node, one per reactor
+    size_t                  num_queues;  // # entries in pp_queues
+    rplib_tpool_t          *p_tpool;     // runs connection tasks
+    int                     h_fd_listen; // accepts links
+    int                     h_fd_epoll;  // waited on by cluster thread
+    int                     h_fd_wake;   // eventfd, frames queued
+    int                     h_fd_timer;  // timerfd, pings and dials
+    pthread_t               thread;      // cluster thread
+    bool                    b_started;   // thread running
+    atomic_bool             b_terminate; // thread to stop
+
+    pthread_mutex_t         mutex_registry; // guards the fields below
+    rpchat_cluster_name_t **pp_buckets;     // chained by hash
+    size_t                  num_buckets;    // power of two
+    size_t                  num_names;      // names in buckets
+    size_t                  num_remote;     // names held by other nodes
+
+    pthread_mutex_t        mutex_links; // guards p_nodes, pending buffers
+    rpchat_cluster_link_t *p_nodes[RPCHAT_CLUSTER_MAX_NODES]; // live links
+    atomic_uint_fast64_t   live_mask;   // bit per node in p_nodes
+
+    rpchat_cluster_link_t *p_links; // every link, cluster thread only
+    rpchat_cluster_link_t *p_dialed[RPCHAT_CLUSTER_MAX_NODES]; // per peer
+    rpchat_shared_msg_t   *p_mail[RPCHAT_CLUSTER_MAIL_BATCH];  // received
+    size_t                 num_mail; // # entries in p_mail
+};
+
+static void rpchat_cluster_drop_link(rpchat_cluster_t      *p_cluster,
+                                     rpchat_cluster_link_t *p_link);
+
+/**
+ * Read a big-endian 16-bit value
+ * @param p_bytes Pointer to bytes
+ * @return Value
+ */
+static uint16_t
+rpchat_cluster_get_u16(const char *p_bytes)
+{
+    return (uint16_t)(((uint8_t)p_bytes[0] << 8) | (uint8_t)p_bytes[1]);
+}
+
+/**
+ * Read a big-endian 32-bit value
+ * @param p_bytes Pointer to bytes
+ * @return Value
+ */
+static uint32_t
+rpchat_cluster_get_u32(const char *p_bytes)
+{
+    return ((uint32_t)(uint8_t)p_bytes[0] << 24)
+           | ((uint32_t)(uint8_t)p_bytes[1] << 16)
+           | ((uint32_t)(uint8_t)p_bytes[2] << 8)
+           | (uint32_t)(uint8_t)p_bytes[3];
+}
+
+/**
+ * Find a name in the registry
+ * \nNote: Caller must hold mutex_registry
+ * @param p_cluster Pointer to node
+ * @param p_name Pointer to name contents
+ * @param len Length of name
+ * @param hash Hash of name
+ * @return Pointer to the link pointing at the entry (the entry is NULL if
+ * not found), for removal in place
+ */
+static rpchat_cluster_name_t **
+rpchat_cluster_find(rpchat_cluster_t *p_cluster,
+                    const char       *p_name,
+                    size_t            len,
+                    uint32_t          hash)
+{
+    rpchat_cluster_name_t **pp_entry = NULL;
+
+    pp_entry = &p_cluster->pp_buckets[hash & (p_cluster->num_buckets - 1)];
+    while (NULL != *pp_entry
+           && (hash != (*pp_entry)->hash || len != (*pp_entry)->len
+               || 0 != memcmp((*pp_entry)->contents, p_name, len)))
+    {
+        pp_entry = &(*pp_entry)->p_next;
+    }
+    return pp_entry;
+}
+
+/**
+ * Double the buckets of the registry, rehashing every entry
+ * \nNote: Caller must hold mutex_registry
+ * @param p_cluster Pointer to node
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on allocation failure
+ */
+static int
+rpchat_cluster_grow(rpchat_cluster_t *p_cluster)
+{
+    rpchat_cluster_name_t **pp_buckets  = NULL;
+    rpchat_cluster_name_t  *p_entry     = NULL;
+    size_t                  num_buckets = p_cluster->num_buckets * 2;
+    size_t                  index       = 0;
+
+    pp_buckets = calloc(num_buckets, sizeof(*pp_buckets));
+    if (NULL == pp_buckets)
+    {
+        return RPLIB_ERROR;
+    }
+    for (index = 0; index < p_cluster->num_buckets; index++)
+    {
+        while (NULL != (p_entry = p_cluster->pp_buckets[index]))
+        {
+            p_cluster->pp_buckets[index] = p_entry->p_next;
+            p_entry->p_next = pp_buckets[p_entry->hash & (num_buckets - 1)];
+            pp_buckets[p_entry->hash & (num_buckets - 1)] = p_entry;
+        }
+    }
+    free(p_cluster->pp_buckets);
+    p_cluster->pp_buckets  = pp_buckets;
+    p_cluster->num_buckets = num_buckets;
+    return RPLIB_SUCCESS;
+}
+
+/**
+ * Add a name to the registry, held by a node
+ * \nNote: Caller must hold mutex_registry, and know the name is absent
+ * @param p_cluster Pointer to node
+ * @param p_name Pointer to name contents
+ * @param len Length of name
+ * @param hash Hash of name
+ * @param node_id Node holding the name
+ * @return Pointer to entry, NULL on allocation failure
+ */
+static rpchat_cluster_name_t *
+rpchat_cluster_add(rpchat_cluster_t *p_cluster,
+                   const char       *p_name,
+                   size_t            len,
+                   uint32_t          hash,
+                   unsigned int      node_id)
+{
+    rpchat_cluster_name_t  *p_entry  = NULL;
+    rpchat_cluster_name_t **pp_entry = NULL;
+
+    // a failed grow only lengthens chains
+    if (p_cluster->num_names >= p_cluster->num_buckets)
+    {
+        rpchat_cluster_grow(p_cluster);
+    }
+    p_entry = malloc(sizeof(*p_entry) + len + 1);
+    if (NULL == p_entry)
+    {
+        goto leave;
+    }
+    p_entry->hash         = hash;
+    p_entry->node_id      = node_id;
+    p_entry->awaiting     = 0;
+    p_entry->p_conn_info  = NULL;
+    p_entry->p_conn_queue = NULL;
+    p_entry->len          = (uint16_t)len;
+    memcpy(p_entry->contents, p_name, len);
+    p_entry->contents[len] = '\0';
+
+    pp_entry = &p_cluster->pp_buckets[hash & (p_cluster->num_buckets - 1)];
+    p_entry->p_next = *pp_entry;
+    *pp_entry       = p_entry;
+    p_cluster->num_names++;
+    if (node_id != p_cluster->config.node_id)
+    {
+        p_cluster->num_remote++;
+    }
+leave:
+    return p_entry;
+}
+
+/**
+ * Remove a name from the registry and free it
+ * \nNote: Caller must hold mutex_registry
+ * @param p_cluster Pointer to node
+ * @param pp_entry Pointer to the link pointing at the entry
+ */
+static void
+rpchat_cluster_drop(rpchat_cluster_t       *p_cluster,
+                    rpchat_cluster_name_t **pp_entry)
+{
+    rpchat_cluster_name_t *p_entry = *pp_entry;
+
+    *pp_entry = p_entry->p_next;
+    p_cluster->num_names--;
+    if (p_entry->node_id != p_cluster->config.node_id)
+    {
+        p_cluster->num_remote--;
+    }
+    free(p_entry);
+}
+
+/**
+ * Hand a name another node holds to it, counting it as remote
+ * \nNote: Caller must hold mutex_registry
+ * @param p_cluster Pointer to node
+ * @param p_entry Pointer to entry
+ * @param node_id Node now holding the name
+ */
+static void
+rpchat_cluster_set_owner(rpchat_cluster_t      *p_cluster,
+                         rpchat_cluster_name_t *p_entry,
+                         unsigned int           node_id)
+{
+    if (p_entry->node_id == p_cluster->config.node_id)
+    {
+        p_cluster->num_remote++;
+    }
+    p_entry->node_id      = node_id;
+    p_entry->awaiting     = 0;
+    p_entry->p_conn_info  = NULL;
+    p_entry->p_conn_queue = NULL;
+}
+
+/**
+ * Wake the cluster thread to write what was queued
+ * @param p_cluster Pointer to node
+ */
+static void
+rpchat_cluster_wake(rpchat_cluster_t *p_cluster)
+{
+    uint64_t increment = 1;
+
+    // counter only saturates once the thread stopped reading, nothing lost
+    if (0 > write(p_cluster->h_fd_wake, &increment, sizeof(increment))
+        && EAGAIN != errno)
+    {
+        perror("cluster wake");
+    }
+}
+
+/**
+ * Append a frame to the pending buffer of a link. A link falling too far
+ * behind is marked and dropped by the cluster thread
+ * \nNote: Caller must hold mutex_links
+ * @param p_cluster Pointer to node
+ * @param p_link Pointer to link
+ * @param type Type of frame
+ * @param p_payload Pointer to payload, may be NULL if len is 0
+ * @param len Length of payload
+ */
+static void
+rpchat_cluster_append(rpchat_cluster_t           *p_cluster,
+                      rpchat_cluster_link_t      *p_link,
+                      rpchat_cluster_frame_type_t type,
+                      const void                 *p_payload,
+                      size_t                      len)
+{
+    rpchat_cluster_buf_t *p_buf    = &p_link->pending;
+    size_t                sz_frame = RPCHAT_CLUSTER_HEADER_SZ + len;
+    size_t                capacity = 0;
+    char                 *p_data   = NULL;
+    bool                  b_empty  = 0 == p_buf->len;
+
+    if (p_link->b_overrun)
+    {
+        return;
+    }
+    if (RPCHAT_CLUSTER_MAX_QUEUED < p_buf->len + sz_frame)
+    {
+        p_link->b_overrun = true;
+        rpchat_cluster_wake(p_cluster);
+        return;
+    }
+    if (p_buf->capacity < p_buf->len + sz_frame)
+    {
+        capacity = 0 == p_buf->capacity ? 4096 : p_buf->capacity;
+        while (capacity < p_buf->len + sz_frame)
+        {
+            capacity *= 2;
+        }
+        p_data = realloc(p_buf->p_data, capacity);
+        if (NULL == p_data)
+        {
+            // the peer misses the frame, so it cannot be trusted anymore
+            p_link->b_overrun = true;
+            rpchat_cluster_wake(p_cluster);
+            return;
+        }
+        p_buf->p_data   = p_data;
+        p_buf->capacity = capacity;
+    }
+    p_data    = p_buf->p_data + p_buf->len;
+    p_data[0] = (char)type;
+    p_data[1] = (char)(len >> 24);
+    p_data[2] = (char)(len >> 16);
+    p_data[3] = (char)(len >> 8);
+    p_data[4] = (char)len;
+    if (0 < len)
+    {
+        memcpy(p_data + RPCHAT_CLUSTER_HEADER_SZ, p_payload, len);
+    }
+    p_buf->len += sz_frame;
+    // a buffer already holding frames already woke the thread
+    if (b_empty)
+    {
+        rpchat_cluster_wake(p_cluster);
+    }
+}
+
+/**
+ * Queue a frame to a single node, if linked
+ * @param p_cluster Pointer to node
+ * @param node_id Node to queue to
+ * @param type Type of frame
+ * @param p_payload Pointer to payload
+ * @param len Length of payload
+ */
+static void
+rpchat_cluster_send_to(rpchat_cluster_t           *p_cluster,
+                       unsigned int                node_id,
+                       rpchat_cluster_frame_type_t type,
+                       const void                 *p_payload,
+                       size_t                      len)
+{
+    pthread_mutex_lock(&p_cluster->mutex_links);
+    if (NULL != p_cluster->p_nodes[node_id])
+    {
+        rpchat_cluster_append(
+            p_cluster, p_cluster->p_nodes[node_id], type, p_payload, len);
+    }
+    pthread_mutex_unlock(&p_cluster->mutex_links);
+}
+
+/**
+ * Queue a frame to every linked node
+ * @param p_cluster Pointer to node
+ * @param type Type of frame
+ * @param p_payload Pointer to payload
+ * @param len Length of payload
+ * @return Mask of the nodes the frame was queued to
+ */
+static uint64_t
+rpchat_cluster_send_all(rpchat_cluster_t           *p_cluster,
+                        rpchat_cluster_frame_type_t type,
+                        const void                 *p_payload,
+                        size_t                      len)
+{
+    uint64_t     mask    = 0;
+    unsigned int node_id = 0;
+
+    pthread_mutex_lock(&p_cluster->mutex_links);
+    mask = atomic_load(&p_cluster->live_mask);
+    for (node_id = 0; node_id < RPCHAT_CLUSTER_MAX_NODES; node_id++)
+    {
+        if (mask & RPCHAT_CLUSTER_BIT(node_id))
+        {
+            rpchat_cluster_append(
+                p_cluster, p_cluster->p_nodes[node_id], type, p_payload, len);
+        }
+    }
+    pthread_mutex_unlock(&p_cluster->mutex_links);
+    return mask;
+}
+
+/**
+ * Tell a local client whether it keeps its claimed name. A name given up is
+ * announced to every linked node
+ * \nNote: Caller must hold mutex_registry
+ * @param p_cluster Pointer to node
+ * @param p_entry Pointer to entry, held by this node
+ * @param b_granted Whether the client keeps the name
+ */
+static void
+rpchat_cluster_resolve(rpchat_cluster_t      *p_cluster,
+                       rpchat_cluster_name_t *p_entry,
+                       bool                   b_granted)
+{
+    p_entry->awaiting = 0;
+    if (RPLIB_SUCCESS
+        != rpchat_resolve_claim(p_entry->p_conn_queue,
+                                p_entry->p_conn_info,
+                                p_cluster->p_tpool,
+                                b_granted))
+    {
+        rpchat_log_write(RPCHAT_LOG_ERROR,
+                         "cluster: could not resolve claim of %s",
+                         p_entry->contents);
+    }
+    if (!b_granted)
+    {
+        rpchat_cluster_send_all(
+            p_cluster, RPCHAT_CLUSTER_LEAVE, p_entry->contents, p_entry->len);
+    }
+}
+
+/**
+ * Tell every client of this node about a user of another node
+ * @param p_cluster Pointer to node
+ * @param p_event Pointer to what the user did, e.g. "has joined"
+ * @param p_entry Pointer to entry of user
+ */
+static void
+rpchat_cluster_announce(rpchat_cluster_t      *p_cluster,
+                        const char            *p_event,
+                        rpchat_cluster_name_t *p_entry)
+{
+    rpchat_string_t notice_msg;
+    int             len = 0;
+
+    len = snprintf(notice_msg.contents,
+                   RPCHAT_MAX_STR_LENGTH,
+                   "%s %s the server.",
+                   p_entry->contents,
+                   p_event);
+    if (0 > len)
+    {
+        rpchat_log_write(RPCHAT_LOG_ERROR,
+                         "%s: could not format notice",
+                         p_entry->contents);
+        return;
+    }
+    notice_msg.len = RPCHAT_MAX_STR_LENGTH <= len ? RPCHAT_MAX_STR_LENGTH - 1
+                                                  : (u_int16_t)len;
+    notice_msg.b_sanitized = false;
+    rpchat_broadcast_notice(p_cluster->pp_queues[0], &notice_msg);
+}
+
+/**
+ * Handle a registry frame from a linked node
+ * @param p_cluster Pointer to node
+ * @param node_id Node the frame came from
+ * @param type Type of frame
+ * @param p_name Pointer to username the frame carries
+ * @param len Length of username
+ */
+static void
+rpchat_cluster_handle_name(rpchat_cluster_t           *p_cluster,
+                           unsigned int                node_id,
+                           rpchat_cluster_frame_type_t type,
+                           const char                 *p_name,
+                           size_t                      len)
+{
+    rpchat_cluster_name_t **pp_entry = NULL;
+    rpchat_cluster_name_t  *p_entry  = NULL;
+    uint32_t                hash     = 0;
+    unsigned int            own_id   = p_cluster->config.node_id;
+    bool                    b_grant  = false;
+
+    hash = rpchat_name_index_hash(p_name, len);
+    pthread_mutex_lock(&p_cluster->mutex_registry);
+    pp_entry = rpchat_cluster_find(p_cluster, p_name, len, hash);
+    p_entry  = *pp_entry;
+    switch (type)
+    {
+        case RPCHAT_CLUSTER_CLAIM:
+            if (NULL == p_entry)
+            {
+                b_grant = NULL
+                          != rpchat_cluster_add(
+                              p_cluster, p_name, len, hash, node_id);
+            }
+            else if (node_id == p_entry->node_id)
+            {
+                b_grant = true;
+            }
+            // both claimed at once, the lower id keeps the name
+            else if (own_id == p_entry->node_id && 0 != p_entry->awaiting
+                     && node_id < own_id)
+            {
+                rpchat_cluster_resolve(p_cluster, p_entry, false);
+                rpchat_cluster_set_owner(p_cluster, p_entry, node_id);
+                b_grant = true;
+            }
+            rpchat_cluster_send_to(p_cluster,
+                                   node_id,
+                                   b_grant ? RPCHAT_CLUSTER_GRANT
+                                           : RPCHAT_CLUSTER_DENY,
+                                   p_name,
+                                   len);
+            break;
+        case RPCHAT_CLUSTER_GRANT:
+            if (NULL != p_entry && own_id == p_entry->node_id
+                && (p_entry->awaiting & RPCHAT_CLUSTER_BIT(node_id)))
+            {
+                p_entry->awaiting &= ~RPCHAT_CLUSTER_BIT(node_id);
+                if (0 == p_entry->awaiting)
+                {
+                    rpchat_cluster_resolve(p_cluster, p_entry, true);
+                }
+            }
+            break;
+        case RPCHAT_CLUSTER_DENY:
+            if (NULL != p_entry && own_id == p_entry->node_id
+                && 0 != p_entry->awaiting)
+            {
+                rpchat_cluster_resolve(p_cluster, p_entry, false);
+                rpchat_cluster_drop(p_cluster, pp_entry);
+            }
+            break;
+        case RPCHAT_CLUSTER_JOIN:
+            if (NULL == p_entry)
+            {
+                p_entry = rpchat_cluster_add(
+                    p_cluster, p_name, len, hash, node_id);
+                if (NULL != p_entry)
+                {
+                    rpchat_cluster_announce(p_cluster, "has joined", p_entry);
+                }
+            }
+            // held on both sides of a partition, the lower id keeps it
+            else if (node_id < p_entry->node_id)
+            {
+                if (own_id == p_entry->node_id)
+                {
+                    rpchat_cluster_resolve(p_cluster, p_entry, false);
+                }
+                rpchat_cluster_set_owner(p_cluster, p_entry, node_id);
+            }
+            break;
+        case RPCHAT_CLUSTER_LEAVE:
+            if (NULL != p_entry && node_id == p_entry->node_id)
+            {
+                rpchat_cluster_drop(p_cluster, pp_entry);
+            }
+            break;
+        default:
+            break;
+    }
+    pthread_mutex_unlock(&p_cluster->mutex_registry);
+}
+
+/**
+ * Post the DELIVERs received so far to every queue of this node
+ * @param p_cluster Pointer to node
+ */
+static void
+rpchat_cluster_post_mail(rpchat_cluster_t *p_cluster)
+{
+    size_t queue_index = 0;
+    size_t mail_index  = 0;
+
+    for (queue_index = 0; queue_index < p_cluster->num_queues; queue_index++)
+    {
+        rpchat_conn_queue_post_mail_batch(p_cluster->pp_queues[queue_index],
+                                          p_cluster->p_mail,
+                                          p_cluster->num_mail);
+    }
+    for (mail_index = 0; mail_index < p_cluster->num_mail; mail_index++)
+    {
+        rpchat_shared_msg_release(p_cluster->p_mail[mail_index]);
+        p_cluster->p_mail[mail_index] = NULL;
+    }
+    p_cluster->num_mail = 0;
+}
+
+/**
+ * Take a DELIVER broadcast on another node, for every client of this one
+ * @param p_cluster Pointer to node
+ * @param p_payload Pointer to encoded DELIVER
+ * @param len Length of payload
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS if malformed
+ */
+static int
+rpchat_cluster_handle_deliver(rpchat_cluster_t *p_cluster,
+                              const char       *p_payload,
+                              size_t            len)
+{
+    int                  res          = RPLIB_UNSUCCESS;
+    rpchat_shared_msg_t *p_shared_msg = NULL;
+    size_t               len_from     = 0;
+    size_t               len_msg      = 0;
+
+    // op | u16 length | sender | u16 length | message
+    if (5 > len || RPCHAT_BCP_DELIVER != (uint8_t)p_payload[0])
+    {
+        goto leave;
+    }
+    len_from = rpchat_cluster_get_u16(p_payload + 1);
+    if (5 + len_from > len)
+    {
+        goto leave;
+    }
+    len_msg = rpchat_cluster_get_u16(p_payload + 3 + len_from);
+    if (5 + len_from + len_msg != len)
+    {
+        goto leave;
+    }
+    res = RPLIB_SUCCESS;
+    // a broadcast lost to exhaustion does not break the link
+    p_shared_msg
+        = rpchat_shared_msg_create(p_cluster->pp_queues[0]->p_pool, len);
+    if (NULL == p_shared_msg)
+    {
+        goto leave;
+    }
+    memcpy(p_shared_msg->contents, p_payload, len);
+    p_cluster->p_mail[p_cluster->num_mail++] = p_shared_msg;
+    if (RPCHAT_CLUSTER_MAIL_BATCH == p_cluster->num_mail)
+    {
+        rpchat_cluster_post_mail(p_cluster);
+    }
+leave:
+    return res;
+}
+
+/**
+ * Record a node as linked: frames for it go to this link from now on, and it
+ * learns every name held here
+ * @param p_cluster Pointer to node
+ * @param p_link Pointer to link, introduced
+ */
+static void
+rpchat_cluster_node_up(rpchat_cluster_t      *p_cluster,
+                       rpchat_cluster_link_t *p_link)
+{
+    rpchat_cluster_name_t *p_entry = NULL;
+    size_t                 index   = 0;
+
+    pthread_mutex_lock(&p_cluster->mutex_registry);
+    pthread_mutex_lock(&p_cluster->mutex_links);
+    p_cluster->p_nodes[p_link->node_id] = p_link;
+    atomic_fetch_or(&p_cluster->live_mask, RPCHAT_CLUSTER_BIT(p_link->node_id));
+    for (index = 0; index < p_cluster->num_buckets; index++)
+    {
+        for (p_entry = p_cluster->pp_buckets[index]; NULL != p_entry;
+             p_entry = p_entry->p_next)
+        {
+            if (p_cluster->config.node_id == p_entry->node_id)
+            {
+                rpchat_cluster_append(p_cluster,
+                                      p_link,
+                                      RPCHAT_CLUSTER_JOIN,
+                                      p_entry->contents,
+                                      p_entry->len);
+            }
+        }
+    }
+    pthread_mutex_unlock(&p_cluster->mutex_links);
+    pthread_mutex_unlock(&p_cluster->mutex_registry);
+    rpchat_log_write(
+        RPCHAT_LOG_INFO, "cluster: node %d linked", p_link->node_id);
+}
+
+/**
+ * Record a node as gone: its users leave, and claims stop waiting on it
+ * @param p_cluster Pointer to node
+ * @param node_id Node no longer linked
+ */
+static void
+rpchat_cluster_node_down(rpchat_cluster_t *p_cluster, unsigned int node_id)
+{
+    rpchat_cluster_name_t **pp_entry = NULL;
+    rpchat_cluster_name_t  *p_entry  = NULL;
+    size_t                  index    = 0;
+
+    pthread_mutex_lock(&p_cluster->mutex_registry);
+    pthread_mutex_lock(&p_cluster->mutex_links);
+    p_cluster->p_nodes[node_id] = NULL;
+    atomic_fetch_and(&p_cluster->live_mask, ~RPCHAT_CLUSTER_BIT(node_id));
+    pthread_mutex_unlock(&p_cluster->mutex_links);
+    for (index = 0; index < p_cluster->num_buckets; index++)
+    {
+        pp_entry = &p_cluster->pp_buckets[index];
+        while (NULL != (p_entry = *pp_entry))
+        {
+            if (node_id == p_entry->node_id)
+            {
+                rpchat_cluster_announce(p_cluster, "has left", p_entry);
+                rpchat_cluster_drop(p_cluster, pp_entry);
+                continue;
+            }
+            if (p_entry->awaiting & RPCHAT_CLUSTER_BIT(node_id))
+            {
+                p_entry->awaiting &= ~RPCHAT_CLUSTER_BIT(node_id);
+                if (0 == p_entry->awaiting)
+                {
+                    rpchat_cluster_resolve(p_cluster, p_entry, true);
+                }
+            }
+            pp_entry = &p_entry->p_next;
+        }
+    }
+    pthread_mutex_unlock(&p_cluster->mutex_registry);
+    rpchat_log_write(RPCHAT_LOG_INFO, "cluster: node %u unlinked", node_id);
+}
+
+/**
+ * Handle the HELLO of a link, which must be the first frame it sends
+ * @param p_cluster Pointer to node
+ * @param p_link Pointer to link
+ * @param p_payload Pointer to payload
+ * @param len Length of payload
+ * @return RPLIB_SUCCESS if the link is now live, otherwise RPLIB_UNSUCCESS
+ */
+static int
+rpchat_cluster_handle_hello(rpchat_cluster_t      *p_cluster,
+                            rpchat_cluster_link_t *p_link,
+                            const char            *p_payload,
+                            size_t                 len)
+{
+    int          res     = RPLIB_UNSUCCESS;
+    unsigned int node_id = 0;
+
+    if (RPCHAT_CLUSTER_HELLO_SZ != len
+        || RPCHAT_CLUSTER_VERSION != (uint8_t)p_payload[0])
+    {
+        rpchat_log_write(RPCHAT_LOG_WARN,
+                         "cluster: link speaks another version");
+        goto leave;
+    }
+    node_id = (uint8_t)p_payload[1];
+    if (RPCHAT_CLUSTER_MAX_NODES <= node_id
+        || p_cluster->config.node_id == node_id
+        || (0 <= p_link->peer_index
+            && p_cluster->config.peers[p_link->peer_index].node_id != node_id))
+    {
+        rpchat_log_write(RPCHAT_LOG_WARN,
+                         "cluster: link introduced as unexpected node %u",
+                         node_id);
+        goto leave;
+    }
+    // both dialed each other, the link already up wins
+    if (NULL != p_cluster->p_nodes[node_id])
+    {
+        rpchat_log_write(
+            RPCHAT_LOG_DEBUG, "cluster: node %u already linked", node_id);
+        goto leave;
+    }
+    p_link->node_id = (int)node_id;
+    rpchat_cluster_node_up(p_cluster, p_link);
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+/**
+ * Handle a single frame of a link
+ * @param p_cluster Pointer to node
+ * @param p_link Pointer to link
+ * @param type Type of frame
+ * @param p_payload Pointer to payload
+ * @param len Length of payload
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS if the link has to go
+ */
+static int
+rpchat_cluster_handle_frame(rpchat_cluster_t      *p_cluster,
+                            rpchat_cluster_link_t *p_link,
+                            uint8_t                type,
+                            const char            *p_payload,
+                            size_t                 len)
+{
+    int res = RPLIB_SUCCESS;
+
+    if (RPCHAT_CLUSTER_NO_NODE == p_link->node_id)
+    {
+        return RPCHAT_CLUSTER_HELLO == type
+                   ? rpchat_cluster_handle_hello(
+                       p_cluster, p_link, p_payload, len)
+                   : RPLIB_UNSUCCESS;
+    }
+    switch (type)
+    {
+        case RPCHAT_CLUSTER_PING:
+            break;
+        case RPCHAT_CLUSTER_CLAIM:
+        case RPCHAT_CLUSTER_GRANT:
+        case RPCHAT_CLUSTER_DENY:
+        case RPCHAT_CLUSTER_JOIN:
+        case RPCHAT_CLUSTER_LEAVE:
+            if (0 == len || RPCHAT_MAX_STR_LENGTH <= len)
+            {
+                res = RPLIB_UNSUCCESS;
+                break;
+            }
+            rpchat_cluster_handle_name(p_cluster,
+                                       (unsigned int)p_link->node_id,
+                                       (rpchat_cluster_frame_type_t)type,
+                                       p_payload,
+                                       len);
+            break;
+        case RPCHAT_CLUSTER_DELIVER:
+            res = rpchat_cluster_handle_deliver(p_cluster, p_payload, len);
+            break;
+        default:
+            res = RPLIB_UNSUCCESS;
+            break;
+    }
+    if (RPLIB_SUCCESS != res)
+    {
+        rpchat_log_write(RPCHAT_LOG_WARN,
+                         "cluster: bad frame %u from node %d",
+                         type,
+                         p_link->node_id);
+    }
+    return res;
+}
+
+/**
+ * Read what a link sent, handling every complete frame
+ * @param p_cluster Pointer to node
+ * @param p_link Pointer to link
+ */
+static void
+rpchat_cluster_read(rpchat_cluster_t *p_cluster, rpchat_cluster_link_t *p_link)
+{
+    ssize_t  sz_read = 0;
+    size_t   offset  = 0;
+    uint32_t len     = 0;
+
+    sz_read = recv(p_link->h_fd,
+                   p_link->in_buf + p_link->in_len,
+                   RPCHAT_CLUSTER_IN_BUF_SZ - p_link->in_len,
+                   MSG_DONTWAIT);
+    if (0 > sz_read && (EAGAIN == errno || EINTR == errno))
+    {
+        return;
+    }
+    if (0 >= sz_read)
+    {
+        rpchat_cluster_drop_link(p_cluster, p_link);
+        return;
+    }
+    p_link->in_len += (size_t)sz_read;
+    p_link->last_rx = time(0);
+
+    while (RPCHAT_CLUSTER_HEADER_SZ <= p_link->in_len - offset)
+    {
+        len = rpchat_cluster_get_u32(p_link->in_buf + offset + 1);
+        if (RPCHAT_CLUSTER_MAX_PAYLOAD < len)
+        {
+            rpchat_log_write(RPCHAT_LOG_WARN,
+                             "cluster: oversized frame from node %d",
+                             p_link->node_id);
+            rpchat_cluster_drop_link(p_cluster, p_link);
+            return;
+        }
+        if (RPCHAT_CLUSTER_HEADER_SZ + len > p_link->in_len - offset)
+        {
+            break;
+        }
+        if (RPLIB_SUCCESS
+            != rpchat_cluster_handle_frame(
+                p_cluster,
+                p_link,
+                (uint8_t)p_link->in_buf[offset],
+                p_link->in_buf + offset + RPCHAT_CLUSTER_HEADER_SZ,
+                len))
+        {
+            rpchat_cluster_drop_link(p_cluster, p_link);
+            return;
+        }
+        offset += RPCHAT_CLUSTER_HEADER_SZ + len;
+    }
+    // keep the start of an incomplete frame
+    memmove(p_link->in_buf, p_link->in_buf + offset, p_link->in_len - offset);
+    p_link->in_len -= offset;
+}
+
+/**
+ * Watch a link for input, and for room to write while it has a backlog
+ * @param p_cluster Pointer to node
+ * @param p_link Pointer to link
+ * @param op EPOLL_CTL_ADD or EPOLL_CTL_MOD
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on failure
+ */
+static int
+rpchat_cluster_watch(rpchat_cluster_t      *p_cluster,
+                     rpchat_cluster_link_t *p_link,
+                     int                    op)
+{
+    struct epoll_event event_watch;
+
+    event_watch.events = EPOLLIN | EPOLLRDHUP;
+    if (p_link->b_want_out || p_link->b_connecting)
+    {
+        event_watch.events |= EPOLLOUT;
+    }
+    event_watch.data.ptr = p_link;
+    return 0 == epoll_ctl(p_cluster->h_fd_epoll, op, p_link->h_fd, &event_watch)
+               ? RPLIB_SUCCESS
+               : RPLIB_ERROR;
+}
+
+/**
+ * Write as much of what was queued for a link as its socket takes
+ * @param p_cluster Pointer to node
+ * @param p_link Pointer to link
+ */
+static void
+rpchat_cluster_flush(rpchat_cluster_t *p_cluster, rpchat_cluster_link_t *p_link)
+{
+    rpchat_cluster_buf_t swap_buf;
+    ssize_t              sz_written = 0;
+    bool                 b_overrun  = false;
+    bool                 b_want_out = false;
+
+    if (p_link->b_dead || p_link->b_connecting)
+    {
+        return;
+    }
+    for (;;)
+    {
+        if (p_link->sz_sent == p_link->sending.len)
+        {
+            // take everything queued since, handing back the drained buffer
+            pthread_mutex_lock(&p_cluster->mutex_links);
+            b_overrun             = p_link->b_overrun;
+            swap_buf              = p_link->pending;
+            p_link->pending       = p_link->sending;
+            p_link->pending.len   = 0;
+            p_link->sending       = swap_buf;
+            p_link->sz_sent       = 0;
+            pthread_mutex_unlock(&p_cluster->mutex_links);
+            if (b_overrun)
+            {
+                rpchat_log_write(RPCHAT_LOG_WARN,
+                                 "cluster: node %d too far behind",
+                                 p_link->node_id);
+                rpchat_cluster_drop_link(p_cluster, p_link);
+                return;
+            }
+            if (0 == p_link->sending.len)
+            {
+                break;
+            }
+        }
+        sz_written = send(p_link->h_fd,
+                          p_link->sending.p_data + p_link->sz_sent,
+                          p_link->sending.len - p_link->sz_sent,
+                          MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (0 > sz_written && EINTR == errno)
+        {
+            continue;
+        }
+        if (0 > sz_written && EAGAIN == errno)
+        {
+            b_want_out = true;
+            break;
+        }
+        if (0 > sz_written)
+        {
+            rpchat_cluster_drop_link(p_cluster, p_link);
+            return;
+        }
+        p_link->sz_sent += (size_t)sz_written;
+    }
+    if (b_want_out != p_link->b_want_out)
+    {
+        p_link->b_want_out = b_want_out;
+        rpchat_cluster_watch(p_cluster, p_link, EPOLL_CTL_MOD);
+    }
+}
+
+/**
+ * Start tracking a link, introducing this node over it
+ * @param p_cluster Pointer to node
+ * @param h_fd Socket of link, connected or connecting
+ * @param peer_index Entry of config dialed, -1 if accepted
+ * @param b_connecting Whether the dial has yet to complete
+ * @return Pointer to link on success, NULL on failure (socket closed)
+ */
+static rpchat_cluster_link_t *
+rpchat_cluster_add_link(rpchat_cluster_t *p_cluster,
+                        int               h_fd,
+                        int               peer_index,
+                        bool              b_connecting)
+{
+    rpchat_cluster_link_t *p_link = NULL;
+    uint8_t                hello[RPCHAT_CLUSTER_HELLO_SZ];
+
+    p_link = calloc(1, sizeof(*p_link));
+    if (NULL == p_link)
+    {
+        close(h_fd);
+        goto leave;
+    }
+    p_link->h_fd         = h_fd;
+    p_link->node_id      = RPCHAT_CLUSTER_NO_NODE;
+    p_link->peer_index   = peer_index;
+    p_link->b_connecting = b_connecting;
+    p_link->last_rx      = time(0);
+    if (RPLIB_SUCCESS != rpchat_cluster_watch(p_cluster, p_link, EPOLL_CTL_ADD))
+    {
+        perror("cluster link");
+        close(h_fd);
+        free(p_link);
+        p_link = NULL;
+        goto leave;
+    }
+    hello[0] = RPCHAT_CLUSTER_VERSION;
+    hello[1] = (uint8_t)p_cluster->config.node_id;
+    pthread_mutex_lock(&p_cluster->mutex_links);
+    rpchat_cluster_append(
+        p_cluster, p_link, RPCHAT_CLUSTER_HELLO, hello, sizeof(hello));
+    pthread_mutex_unlock(&p_cluster->mutex_links);
+
+    p_link->p_next     = p_cluster->p_links;
+    p_cluster->p_links = p_link;
+    if (0 <= peer_index)
+    {
+        p_cluster->p_dialed[peer_index] = p_link;
+    }
+leave:
+    return p_link;
+}
+
+/**
+ * Close a link. Its node, if it was introduced, is gone until it links again
+ * @param p_cluster Pointer to node
+ * @param p_link Pointer to link, freed once the event batch is handled
+ */
+static void
+rpchat_cluster_drop_link(rpchat_cluster_t      *p_cluster,
+                         rpchat_cluster_link_t *p_link)
+{
+    if (p_link->b_dead)
+    {
+        return;
+    }
+    p_link->b_dead = true;
+    epoll_ctl(p_cluster->h_fd_epoll, EPOLL_CTL_DEL, p_link->h_fd, NULL);
+    close(p_link->h_fd);
+    p_link->h_fd = -1;
+    if (0 <= p_link->peer_index)
+    {
+        p_cluster->p_dialed[p_link->peer_index] = NULL;
+    }
+    if (RPCHAT_CLUSTER_NO_NODE != p_link->node_id
+        && p_link == p_cluster->p_nodes[p_link->node_id])
+    {
+        rpchat_cluster_node_down(p_cluster, (unsigned int)p_link->node_id);
+    }
+}
+
+/**
+ * Free every link dropped while handling the last event batch
+ * @param p_cluster Pointer to node
+ */
+static void
+rpchat_cluster_reap(rpchat_cluster_t *p_cluster)
+{
+    rpchat_cluster_link_t **pp_link = &p_cluster->p_links;
+    rpchat_cluster_link_t  *p_link  = NULL;
+
+    while (NULL != (p_link = *pp_link))
+    {
+        if (!p_link->b_dead)
+        {
+            pp_link = &p_link->p_next;
+            continue;
+        }
+        *pp_link = p_link->p_next;
+        free(p_link->pending.p_data);
+        free(p_link->sending.p_data);
+        free(p_link);
+    }
+}
+
+/**
+ * Dial every node of a lower id that is not linked
+ * @param p_cluster Pointer to node
+ */
+static void
+rpchat_cluster_dial(rpchat_cluster_t *p_cluster)
+{
+    rpchat_cluster_peer_t *p_peer     = NULL;
+    size_t                 peer_index = 0;
+    int                    h_fd       = -1;
+
+    for (peer_index = 0; peer_index < p_cluster->config.num_peers; peer_index++)
+    {
+        p_peer = &p_cluster->config.peers[peer_index];
+        if (p_peer->node_id >= p_cluster->config.node_id
+            || NULL != p_cluster->p_dialed[peer_index]
+            || NULL != p_cluster->p_nodes[p_peer->node_id])
+        {
+            continue;
+        }
+        h_fd = socket(p_peer->addr.ss_family,
+                      SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                      0);
+        if (0 > h_fd)
+        {
+            perror("cluster socket");
+            continue;
+        }
+        if (0 > connect(h_fd, (struct sockaddr *)&p_peer->addr, p_peer->sz_addr)
+            && EINPROGRESS != errno)
+        {
+            rpchat_log_write(RPCHAT_LOG_DEBUG,
+                             "cluster: dial of node %u failed: %s",
+                             p_peer->node_id,
+                             strerror(errno));
+            close(h_fd);
+            continue;
+        }
+        rpchat_cluster_add_link(p_cluster, h_fd, (int)peer_index, true);
+    }
+}
+
+/**
+ * Once a second: ping every link, drop those gone quiet, and redial
+ * @param p_cluster Pointer to node
+ */
+static void
+rpchat_cluster_tick(rpchat_cluster_t *p_cluster)
+{
+    rpchat_cluster_link_t *p_link = NULL;
+    uint64_t               expirations;
+    time_t                 now = time(0);
+
+    if (0 > read(p_cluster->h_fd_timer, &expirations, sizeof(expirations)))
+    {
+        return;
+    }
+    for (p_link = p_cluster->p_links; NULL != p_link; p_link = p_link->p_next)
+    {
+        if (p_link->b_dead)
+        {
+            continue;
+        }
+        if (RPCHAT_CLUSTER_DEAD_SEC < now - p_link->last_rx)
+        {
+            rpchat_log_write(RPCHAT_LOG_WARN,
+                             "cluster: link to node %d timed out",
+                             p_link->node_id);
+            rpchat_cluster_drop_link(p_cluster, p_link);
+            continue;
+        }
+        if (RPCHAT_CLUSTER_NO_NODE != p_link->node_id)
+        {
+            pthread_mutex_lock(&p_cluster->mutex_links);
+            rpchat_cluster_append(
+                p_cluster, p_link, RPCHAT_CLUSTER_PING, NULL, 0);
+            pthread_mutex_unlock(&p_cluster->mutex_links);
+        }
+    }
+    rpchat_cluster_dial(p_cluster);
+}
+
+/**
+ * Accept every link waiting on the listening socket
+ * @param p_cluster Pointer to node
+ */
+static void
+rpchat_cluster_accept(rpchat_cluster_t *p_cluster)
+{
+    int h_fd = -1;
+
+    for (;;)
+    {
+        h_fd = accept4(
+            p_cluster->h_fd_listen, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (0 > h_fd)
+        {
+            if (EINTR == errno || ECONNABORTED == errno)
+            {
+                continue;
+            }
+            break;
+        }
+        rpchat_cluster_add_link(p_cluster, h_fd, -1, false);
+    }
+}
+
+/**
+ * Handle readiness of a link
+ * @param p_cluster Pointer to node
+ * @param p_link Pointer to link
+ * @param events Events reported for it
+ */
+static void
+rpchat_cluster_handle_link(rpchat_cluster_t      *p_cluster,
+                           rpchat_cluster_link_t *p_link,
+                           uint32_t               events)
+{
+    int       sock_err = 0;
+    socklen_t sz_err   = sizeof(sock_err);
+
+    if (p_link->b_dead)
+    {
+        return;
+    }
+    if (p_link->b_connecting && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+    {
+        if (0 > getsockopt(
+                p_link->h_fd, SOL_SOCKET, SO_ERROR, &sock_err, &sz_err)
+            || 0 != sock_err)
+        {
+            rpchat_log_write(
+                RPCHAT_LOG_DEBUG,
+                "cluster: dial of node %u failed: %s",
+                p_cluster->config.peers[p_link->peer_index].node_id,
+                strerror(sock_err));
+            rpchat_cluster_drop_link(p_cluster, p_link);
+            return;
+        }
+        p_link->b_connecting = false;
+        p_link->b_want_out   = true;
+    }
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+    {
+        rpchat_cluster_read(p_cluster, p_link);
+    }
+    if (events & EPOLLOUT)
+    {
+        rpchat_cluster_flush(p_cluster, p_link);
+    }
+}
+
+/**
+ * Cluster thread: handle links until told to stop
+ * @param p_arg Pointer to node
+ * @return NULL
+ */
+static void *
+rpchat_cluster_run(void *p_arg)
+{
+    rpchat_cluster_t      *p_cluster = p_arg;
+    rpchat_cluster_link_t *p_link    = NULL;
+    struct epoll_event     events[RPCHAT_CLUSTER_EVENT_BATCH];
+    int                    num_events = 0;
+    int                    index      = 0;
+    uint64_t               counter    = 0;
+
+    rpchat_cluster_dial(p_cluster);
+    while (!atomic_load(&p_cluster->b_terminate))
+    {
+        num_events = epoll_wait(
+            p_cluster->h_fd_epoll, events, RPCHAT_CLUSTER_EVENT_BATCH, -1);
+        if (0 > num_events)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            perror("cluster epoll_wait");
+            break;
+        }
+        for (index = 0; index < num_events; index++)
+        {
+            if (&p_cluster->h_fd_listen == events[index].data.ptr)
+            {
+                rpchat_cluster_accept(p_cluster);
+            }
+            else if (&p_cluster->h_fd_timer == events[index].data.ptr)
+            {
+                rpchat_cluster_tick(p_cluster);
+            }
+            else if (&p_cluster->h_fd_wake == events[index].data.ptr)
+            {
+                read(p_cluster->h_fd_wake, &counter, sizeof(counter));
+            }
+            else
+            {
+                rpchat_cluster_handle_link(
+                    p_cluster, events[index].data.ptr, events[index].events);
+            }
+        }
+        // broadcasts received over every link go out in one batch
+        if (0 < p_cluster->num_mail)
+        {
+            rpchat_cluster_post_mail(p_cluster);
+        }
+        // workers queued frames, and handling frames queues more; links
+        // with a backlog wait for room instead
+        for (p_link = p_cluster->p_links; NULL != p_link;
+             p_link = p_link->p_next)
+        {
+            if (!p_link->b_want_out)
+            {
+                rpchat_cluster_flush(p_cluster, p_link);
+            }
+        }
+        rpchat_cluster_reap(p_cluster);
+    }
+    return NULL;
+}
+
+int
+rpchat_cluster_parse_peer(const char *p_arg, rpchat_cluster_peer_t *p_peer)
+{
+    int              res      = RPLIB_UNSUCCESS;
+    char             host[NI_MAXHOST];
+    const char      *p_at     = NULL;
+    const char      *p_colon  = NULL;
+    char            *p_end    = NULL;
+    unsigned long    node_id  = 0;
+    struct addrinfo  hints;
+    struct addrinfo *p_result = NULL;
+
+    p_at    = strchr(p_arg, '@');
+    p_colon = strrchr(p_arg, ':');
+    if (NULL == p_at || NULL == p_colon || p_colon < p_at
+        || (size_t)(p_colon - p_at - 1) >= sizeof(host) || p_colon == p_at + 1)
+    {
+        goto leave;
+    }
+    errno   = 0;
+    node_id = strtoul(p_arg, &p_end, 10);
+    if (0 != errno || p_end != p_at || p_arg == p_at
+        || RPCHAT_CLUSTER_MAX_NODES <= node_id)
+    {
+        goto leave;
+    }
+    memcpy(host, p_at + 1, (size_t)(p_colon - p_at - 1));
+    host[p_colon - p_at - 1] = '\0';
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (0 != getaddrinfo(host, p_colon + 1, &hints, &p_result))
+    {
+        goto leave;
+    }
+    p_peer->node_id = (unsigned int)node_id;
+    memcpy(&p_peer->addr, p_result->ai_addr, p_result->ai_addrlen);
+    p_peer->sz_addr = p_result->ai_addrlen;
+    freeaddrinfo(p_result);
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+/**
+ * Watch a descriptor of the node itself, tagged with the address of its field
+ * @param h_fd_epoll Epoll instance
+ * @param p_h_fd Pointer to field holding descriptor
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on failure
+ */
+static int
+rpchat_cluster_watch_own(int h_fd_epoll, int *p_h_fd)
+{
+    struct epoll_event event_watch;
+
+    event_watch.events   = EPOLLIN;
+    event_watch.data.ptr = p_h_fd;
+    return 0 == epoll_ctl(h_fd_epoll, EPOLL_CTL_ADD, *p_h_fd, &event_watch)
+               ? RPLIB_SUCCESS
+               : RPLIB_ERROR;
+}
+
+rpchat_cluster_t *
+rpchat_cluster_create(const rpchat_cluster_config_t *p_config,
+                      rpchat_conn_queue_t          **pp_queues,
+                      size_t                         num_queues,
+                      rplib_tpool_t                 *p_tpool)
+{
+    rpchat_cluster_t *p_cluster = NULL;
+    struct itimerspec tick      = {
+             .it_interval = { .tv_sec = RPCHAT_CLUSTER_TICK_SEC },
+             .it_value    = { .tv_sec = RPCHAT_CLUSTER_TICK_SEC },
+    };
+
+    p_cluster = calloc(1, sizeof(*p_cluster));
+    if (NULL == p_cluster)
+    {
+        perror("cluster");
+        goto leave;
+    }
+    p_cluster->config      = *p_config;
+    p_cluster->pp_queues   = pp_queues;
+    p_cluster->num_queues  = num_queues;
+    p_cluster->p_tpool     = p_tpool;
+    p_cluster->h_fd_listen = RPLIB_ERROR;
+    p_cluster->h_fd_epoll  = RPLIB_ERROR;
+    p_cluster->h_fd_wake   = RPLIB_ERROR;
+    p_cluster->h_fd_timer  = RPLIB_ERROR;
+    atomic_init(&p_cluster->b_terminate, false);
+    atomic_init(&p_cluster->live_mask, 0);
+
+    p_cluster->num_buckets = RPCHAT_CLUSTER_MIN_BUCKETS;
+    p_cluster->pp_buckets
+        = calloc(p_cluster->num_buckets, sizeof(*p_cluster->pp_buckets));
+    if (NULL == p_cluster->pp_buckets)
+    {
+        perror("cluster registry");
+        goto cleanup;
+    }
+
+    p_cluster->h_fd_listen = rpchat_setup_server_socket(p_config->port_num);
+    if (0 > p_cluster->h_fd_listen)
+    {
+        goto cleanup;
+    }
+    p_cluster->h_fd_epoll = epoll_create1(EPOLL_CLOEXEC);
+    p_cluster->h_fd_wake  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    p_cluster->h_fd_timer
+        = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (0 > p_cluster->h_fd_epoll || 0 > p_cluster->h_fd_wake
+        || 0 > p_cluster->h_fd_timer
+        || 0 > timerfd_settime(p_cluster->h_fd_timer, 0, &tick, NULL)
+        || RPLIB_SUCCESS
+               != rpchat_cluster_watch_own(p_cluster->h_fd_epoll,
+                                           &p_cluster->h_fd_listen)
+        || RPLIB_SUCCESS
+               != rpchat_cluster_watch_own(p_cluster->h_fd_epoll,
+                                           &p_cluster->h_fd_wake)
+        || RPLIB_SUCCESS
+               != rpchat_cluster_watch_own(p_cluster->h_fd_epoll,
+                                           &p_cluster->h_fd_timer))
+    {
+        perror("cluster");
+        goto cleanup;
+    }
+    pthread_mutex_init(&p_cluster->mutex_registry, NULL);
+    pthread_mutex_init(&p_cluster->mutex_links, NULL);
+    goto leave;
+cleanup:
+    if (0 <= p_cluster->h_fd_listen)
+    {
+        close(p_cluster->h_fd_listen);
+    }
+    if (0 <= p_cluster->h_fd_epoll)
+    {
+        close(p_cluster->h_fd_epoll);
+    }
+    if (0 <= p_cluster->h_fd_wake)
+    {
+        close(p_cluster->h_fd_wake);
+    }
+    if (0 <= p_cluster->h_fd_timer)
+    {
+        close(p_cluster->h_fd_timer);
+    }
+    free(p_cluster->pp_buckets);
+    free(p_cluster);
+    p_cluster = NULL;
+leave:
+    return p_cluster;
+}
+
+int
+rpchat_cluster_start(rpchat_cluster_t *p_cluster)
+{
+    int      res = RPLIB_ERROR;
+    sigset_t sigset_all;
+    sigset_t sigset_prev;
+
+    // cluster thread never handles signals, whatever the caller blocks later
+    sigfillset(&sigset_all);
+    pthread_sigmask(SIG_SETMASK, &sigset_all, &sigset_prev);
+    if (0
+        != pthread_create(
+            &p_cluster->thread, NULL, rpchat_cluster_run, p_cluster))
+    {
+        perror("pthread_create");
+        pthread_sigmask(SIG_SETMASK, &sigset_prev, NULL);
+        goto leave;
+    }
+    pthread_sigmask(SIG_SETMASK, &sigset_prev, NULL);
+    p_cluster->b_started = true;
+    res                  = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+void
+rpchat_cluster_stop(rpchat_cluster_t *p_cluster)
+{
+    if (NULL == p_cluster || !p_cluster->b_started)
+    {
+        return;
+    }
+    atomic_store(&p_cluster->b_terminate, true);
+    rpchat_cluster_wake(p_cluster);
+    pthread_join(p_cluster->thread, NULL);
+    p_cluster->b_started = false;
+}
+
+void
+rpchat_cluster_destroy(rpchat_cluster_t *p_cluster)
+{
+    rpchat_cluster_link_t *p_link  = NULL;
+    rpchat_cluster_name_t *p_entry = NULL;
+    size_t                 index   = 0;
+
+    if (NULL == p_cluster)
+    {
+        return;
+    }
+    rpchat_cluster_stop(p_cluster);
+    while (NULL != (p_link = p_cluster->p_links))
+    {
+        p_cluster->p_links = p_link->p_next;
+        if (0 <= p_link->h_fd)
+        {
+            close(p_link->h_fd);
+        }
+        free(p_link->pending.p_data);
+        free(p_link->sending.p_data);
+        free(p_link);
+    }
+    for (index = 0; index < p_cluster->num_buckets; index++)
+    {
+        while (NULL != (p_entry = p_cluster->pp_buckets[index]))
+        {
+            p_cluster->pp_buckets[index] = p_entry->p_next;
+            free(p_entry);
+        }
+    }
+    for (index = 0; index < p_cluster->num_mail; index++)
+    {
+        rpchat_shared_msg_release(p_cluster->p_mail[index]);
+    }
+    free(p_cluster->pp_buckets);
+    close(p_cluster->h_fd_listen);
+    close(p_cluster->h_fd_epoll);
+    close(p_cluster->h_fd_wake);
+    close(p_cluster->h_fd_timer);
+    pthread_mutex_destroy(&p_cluster->mutex_registry);
+    pthread_mutex_destroy(&p_cluster->mutex_links);
+    free(p_cluster);
+}
+
+int
+rpchat_cluster_claim_username(rpchat_cluster_t    *p_cluster,
+                              rpchat_conn_queue_t *p_conn_queue,
+                              rpchat_conn_info_t  *p_conn_info,
+                              rpchat_string_t     *p_username,
+                              bool                *p_b_pending)
+{
+    int                    res     = RPLIB_UNSUCCESS;
+    rpchat_cluster_name_t *p_entry = NULL;
+    uint32_t               hash    = 0;
+
+    *p_b_pending = false;
+    hash = rpchat_name_index_hash(p_username->contents, p_username->len);
+    pthread_mutex_lock(&p_cluster->mutex_registry);
+    if (NULL
+        != *rpchat_cluster_find(
+            p_cluster, p_username->contents, p_username->len, hash))
+    {
+        goto leave;
+    }
+    res = rpchat_conn_queue_claim_username(
+        p_conn_queue, p_conn_info, p_username);
+    if (RPLIB_SUCCESS != res)
+    {
+        goto leave;
+    }
+    p_entry = rpchat_cluster_add(p_cluster,
+                                 p_username->contents,
+                                 p_username->len,
+                                 hash,
+                                 p_cluster->config.node_id);
+    if (NULL == p_entry)
+    {
+        rpchat_conn_queue_release_username(p_conn_queue, p_conn_info);
+        res = RPLIB_ERROR;
+        goto leave;
+    }
+    p_entry->p_conn_info  = p_conn_info;
+    p_entry->p_conn_queue = p_conn_queue;
+    // kept once every node it went to agreed, or left
+    p_entry->awaiting = rpchat_cluster_send_all(
+        p_cluster, RPCHAT_CLUSTER_CLAIM, p_entry->contents, p_entry->len);
+    *p_b_pending = 0 != p_entry->awaiting;
+leave:
+    pthread_mutex_unlock(&p_cluster->mutex_registry);
+    return res;
+}
+
+void
+rpchat_cluster_release_username(rpchat_cluster_t   *p_cluster,
+                                rpchat_conn_info_t *p_conn_info)
+{
+    rpchat_cluster_name_t **pp_entry = NULL;
+    uint32_t                hash     = 0;
+
+    if (0 == p_conn_info->username.len)
+    {
+        return;
+    }
+    hash = rpchat_name_index_hash(p_conn_info->username.p_contents,
+                                  p_conn_info->username.len);
+    pthread_mutex_lock(&p_cluster->mutex_registry);
+    pp_entry = rpchat_cluster_find(p_cluster,
+                                   p_conn_info->username.p_contents,
+                                   p_conn_info->username.len,
+                                   hash);
+    // the name may have been lost to another node already
+    if (NULL != *pp_entry && p_conn_info == (*pp_entry)->p_conn_info)
+    {
+        rpchat_cluster_send_all(p_cluster,
+                                RPCHAT_CLUSTER_LEAVE,
+                                (*pp_entry)->contents,
+                                (*pp_entry)->len);
+        rpchat_cluster_drop(p_cluster, pp_entry);
+    }
+    pthread_mutex_unlock(&p_cluster->mutex_registry);
+}
+
+void
+rpchat_cluster_forward(rpchat_cluster_t    *p_cluster,
+                       rpchat_shared_msg_t *p_shared_msg)
+{
+    if (RPCHAT_CLUSTER_MAX_PAYLOAD < p_shared_msg->sz_msg
+        || 0 == atomic_load(&p_cluster->live_mask))
+    {
+        return;
+    }
+    rpchat_cluster_send_all(p_cluster,
+                            RPCHAT_CLUSTER_DELIVER,
+                            p_shared_msg->contents,
+                            p_shared_msg->sz_msg);
+}
+
+size_t
+rpchat_cluster_count_users(rpchat_cluster_t *p_cluster)
+{
+    size_t num_remote = 0;
+
+    pthread_mutex_lock(&p_cluster->mutex_registry);
+    num_remote = p_cluster->num_remote;
+    pthread_mutex_unlock(&p_cluster->mutex_registry);
+    return num_remote;
+}
+
+void
+rpchat_cluster_list_users(rpchat_cluster_t *p_cluster,
+                          rpchat_string_t  *p_output_buf,
+                          bool              b_first)
+{
+    rpchat_cluster_name_t *p_entry   = NULL;
+    size_t                 index     = 0;
+    int                    buf_index = p_output_buf->len;
+
+    // the first name takes the place of the final newline, as locally
+    if (b_first)
+    {
+        buf_index--;
+    }
+    pthread_mutex_lock(&p_cluster->mutex_registry);
+    for (index = 0;
+         index < p_cluster->num_buckets && RPCHAT_MAX_STR_LENGTH > buf_index;
+         index++)
+    {
+        for (p_entry = p_cluster->pp_buckets[index];
+             NULL != p_entry && RPCHAT_MAX_STR_LENGTH > buf_index;
+             p_entry = p_entry->p_next)
+        {
+            if (p_cluster->config.node_id == p_entry->node_id)
+            {
+                continue;
+            }
+            buf_index += snprintf(p_output_buf->contents + buf_index,
+                                  RPCHAT_MAX_STR_LENGTH - buf_index,
+                                  b_first ? "%s" : ", %s",
+                                  p_entry->contents);
+            b_first = false;
+        }
+    }
+    pthread_mutex_unlock(&p_cluster->mutex_registry);
+    if (RPCHAT_MAX_STR_LENGTH <= buf_index)
+    {
+        buf_index = RPCHAT_MAX_STR_LENGTH - 1;
+    }
+    p_output_buf->len = buf_index;
+}
+
+/*** end of file ***/
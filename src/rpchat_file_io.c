@@ -42,3 +42,23 @@ rpchat_close_log_location(int h_fd_log_loc)
 {
     return close(h_fd_log_loc);
 }
+
+int
+rpchat_open_file_dir(char *p_file_dir)
+{
+    int h_fd_file_dir = RPLIB_ERROR;
+
+    // must already exist, and be a directory
+    h_fd_file_dir = open(p_file_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (0 > h_fd_file_dir)
+    {
+        perror("File Directory");
+    }
+    return h_fd_file_dir;
+}
+
+int
+rpchat_close_file_dir(int h_fd_file_dir)
+{
+    return 0 > h_fd_file_dir ? RPLIB_SUCCESS : close(h_fd_file_dir);
+}
@@ -0,0 +1,1256 @@
+/** @file rpchat_handoff.c
+ *
+ * @brief Implements the restart handoff declared in `rpchat_handoff.h`. Both
+ * ends run on one host from one build, so records are packed structs in host
+ * byte order; the version in HELLO catches a successor of another layout.
+ *
+ * The successor keeps every record in memory until END and the predecessor's
+ * exit, and only then touches its queues: what arrives before a failure is
+ * closed, never half adopted
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#define _GNU_SOURCE // accept4, MSG_CMSG_CLOEXEC
+
+#include "rpchat_handoff.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "components/rpchat_conn_info.h"
+#include "components/rpchat_room_index.h"
+#include "rpchat_log.h"
+#include "rpchat_process_event.h"
+
+#define RPCHAT_HANDOFF_DATA_HDR_SZ  5  // type (u8), then length (u32)
+#define RPCHAT_HANDOFF_MIN_CLIENTS  64 // client slots allocated up front
+#define RPCHAT_HANDOFF_CONN_BODY_SZ /* username, then every room joined */ \
+    (RPCHAT_MAX_STR_LENGTH                                                \
+     + RPCHAT_ROOM_MAX_JOINED * (1 + RPCHAT_BCP_MAX_ROOM_LENGTH))
+
+/**
+ * First record; the listening sockets ride along
+ */
+typedef struct __attribute__((__packed__)) rpchat_handoff_hello
+{
+    uint8_t  type;          // RPCHAT_HANDOFF_HELLO
+    uint32_t version;       // RPCHAT_HANDOFF_VERSION
+    uint32_t num_listeners; // # sockets attached
+} rpchat_handoff_hello_t;
+
+/**
+ * Head of a CONN record, followed by the username, then num_rooms times a
+ * room name length (u8) and the name; the client's socket rides along
+ */
+typedef struct __attribute__((__packed__)) rpchat_handoff_conn
+{
+    uint8_t  type;        // RPCHAT_HANDOFF_CONN
+    uint8_t  conn_status; // `rpchat_conn_stat_t`
+    uint8_t  window;      // DELIVERs allowed unacked
+    uint8_t  in_flight;   // DELIVERs sent, not yet acked
+    int64_t  last_active; // time connection last active
+    uint16_t name_len;    // length of username, 0 before REGISTER
+    uint8_t  num_rooms;   // # rooms joined
+} rpchat_handoff_conn_t;
+
+/**
+ * A client received, kept until adopted
+ */
+typedef struct rpchat_handoff_client
+{
+    int    h_fd;       // socket, -1 once adopted
+    char  *p_conn;     // CONN record as received
+    size_t sz_conn;    // size of CONN record
+    char  *p_data;     // data records, each `type (u8), length (u32), bytes`
+    size_t sz_data;    // bytes in use in p_data
+    size_t cap_data;   // bytes allocated for p_data
+    size_t sz_inbound; // unparsed bytes among the data records
+} rpchat_handoff_client_t;
+
+struct rpchat_handoff
+{
+    int    listeners[RPCHAT_HANDOFF_MAX_LISTENERS]; // -1 once taken
+    size_t num_listeners;                           // # entries in listeners
+    rpchat_handoff_client_t *p_clients;             // in the order received
+    size_t                   num_clients;           // # entries in p_clients
+    size_t                   cap_clients; // # entries allocated in p_clients
+};
+
+/**
+ * Fill the address of a handoff socket
+ * @param p_path Pointer to path of the handoff socket
+ * @param p_addr Pointer to address to fill
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR if the path is too long
+ */
+static int
+rpchat_handoff_address(const char *p_path, struct sockaddr_un *p_addr)
+{
+    memset(p_addr, 0, sizeof(*p_addr));
+    p_addr->sun_family = AF_UNIX;
+    if (sizeof(p_addr->sun_path) <= strlen(p_path))
+    {
+        errno = ENAMETOOLONG;
+        return RPLIB_ERROR;
+    }
+    strcpy(p_addr->sun_path, p_path);
+    return RPLIB_SUCCESS;
+}
+
+/**
+ * Check the process at the other end of a handoff socket runs as this one:
+ * whoever connects is handed every client
+ * @param h_fd Connected handoff socket
+ * @return true if the peer's user is this process's, false otherwise
+ */
+static bool
+rpchat_handoff_check_peer(int h_fd)
+{
+    struct ucred cred;
+    socklen_t    sz_cred = sizeof(cred);
+
+    if (0 > getsockopt(h_fd, SOL_SOCKET, SO_PEERCRED, &cred, &sz_cred))
+    {
+        perror("handoff");
+        return false;
+    }
+    if (geteuid() != cred.uid)
+    {
+        rpchat_log_write(RPCHAT_LOG_ERROR,
+                         "handoff: refused peer %ld of user %ld",
+                         (long)cred.pid,
+                         (long)cred.uid);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Send one record, with sockets attached if any
+ * @param h_fd Socket connected to successor
+ * @param p_head Pointer to first part of the record
+ * @param sz_head Size of first part
+ * @param p_body Pointer to rest of the record, or NULL
+ * @param sz_body Size of rest
+ * @param p_fds Pointer to array of sockets to pass, or NULL
+ * @param num_fds Number of entries in p_fds, up to MAX_LISTENERS
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on failure
+ */
+static int
+rpchat_handoff_send_record(int         h_fd,
+                           const void *p_head,
+                           size_t      sz_head,
+                           const void *p_body,
+                           size_t      sz_body,
+                           const int  *p_fds,
+                           size_t      num_fds)
+{
+    struct msghdr   msg;
+    struct iovec    iov[2];
+    struct cmsghdr *p_cmsg = NULL;
+    ssize_t         sz_sent = 0;
+    union
+    {
+        struct cmsghdr align; // cmsg buffers must be aligned as the header
+        char buf[CMSG_SPACE(sizeof(int) * RPCHAT_HANDOFF_MAX_LISTENERS)];
+    } control;
+
+    memset(&msg, 0, sizeof(msg));
+    iov[0].iov_base = (void *)p_head;
+    iov[0].iov_len  = sz_head;
+    iov[1].iov_base = (void *)p_body;
+    iov[1].iov_len  = sz_body;
+    msg.msg_iov     = iov;
+    msg.msg_iovlen  = 0 < sz_body ? 2 : 1;
+    if (0 < num_fds)
+    {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control    = control.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * num_fds);
+        p_cmsg             = CMSG_FIRSTHDR(&msg);
+        p_cmsg->cmsg_level = SOL_SOCKET;
+        p_cmsg->cmsg_type  = SCM_RIGHTS;
+        p_cmsg->cmsg_len   = CMSG_LEN(sizeof(int) * num_fds);
+        memcpy(CMSG_DATA(p_cmsg), p_fds, sizeof(int) * num_fds);
+    }
+    do
+    {
+        sz_sent = sendmsg(h_fd, &msg, MSG_NOSIGNAL);
+    } while (0 > sz_sent && EINTR == errno);
+    return (ssize_t)(sz_head + sz_body) == sz_sent ? RPLIB_SUCCESS
+                                                   : RPLIB_ERROR;
+}
+
+/**
+ * Send bytes of a client as records of one type, split to fit a packet
+ * @param h_fd Socket connected to successor
+ * @param type `rpchat_handoff_record_type_t` of the records
+ * @param p_bytes Pointer to bytes
+ * @param len Number of bytes
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on failure
+ */
+static int
+rpchat_handoff_send_bytes(int         h_fd,
+                          uint8_t     type,
+                          const char *p_bytes,
+                          size_t      len)
+{
+    size_t sz_chunk = 0;
+
+    while (0 < len)
+    {
+        sz_chunk = len < RPCHAT_HANDOFF_MAX_PACKET - 1
+                       ? len
+                       : RPCHAT_HANDOFF_MAX_PACKET - 1;
+        if (RPLIB_SUCCESS
+            != rpchat_handoff_send_record(
+                h_fd, &type, 1, p_bytes, sz_chunk, NULL, 0))
+        {
+            return RPLIB_ERROR;
+        }
+        p_bytes += sz_chunk;
+        len -= sz_chunk;
+    }
+    return RPLIB_SUCCESS;
+}
+
+/**
+ * Check a client can move: between messages, nothing half handled
+ * @param p_conn_info Pointer to connection
+ * @return true if it can be passed, false if it closes with this process
+ */
+static bool
+rpchat_handoff_can_pass(rpchat_conn_info_t *p_conn_info)
+{
+    switch (p_conn_info->conn_status)
+    {
+        case RPCHAT_CONN_PRE_REGISTER:
+        case RPCHAT_CONN_AVAILABLE:
+        case RPCHAT_CONN_PENDING_STATUS:
+            break;
+        default:
+            return false;
+    }
+    return 0 <= p_conn_info->h_fd && NULL == p_conn_info->p_xfer
+           && !atomic_load(&p_conn_info->b_overrun) && !p_conn_info->b_unlinked
+           && (NULL == p_conn_info->p_parked_in
+               || 0 == p_conn_info->p_parked_in->size);
+}
+
+/**
+ * Send messages waiting for a client's window, in the order they wait
+ * @param h_fd Socket connected to successor
+ * @param p_waiting Pointer to queue of `rpchat_args_proc_event_t *`; NULL if
+ * never created
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on failure
+ */
+static int
+rpchat_handoff_send_waiting(int h_fd, rplib_ll_queue_t *p_waiting)
+{
+    rplib_ll_queue_node_t    *p_node = NULL;
+    rpchat_args_proc_event_t *p_args = NULL;
+    int                       res    = RPLIB_SUCCESS;
+
+    if (NULL == p_waiting)
+    {
+        return RPLIB_SUCCESS;
+    }
+    for (p_node = p_waiting->p_front; NULL != p_node && RPLIB_SUCCESS == res;
+         p_node = p_node->p_next_node)
+    {
+        p_args = *(rpchat_args_proc_event_t **)p_node->p_data;
+        if (NULL != p_args->p_shared_msg)
+        {
+            res = rpchat_handoff_send_bytes(h_fd,
+                                            RPCHAT_HANDOFF_DELIVERY,
+                                            p_args->p_shared_msg->contents,
+                                            p_args->p_shared_msg->sz_msg);
+        }
+        else
+        {
+            res = rpchat_handoff_send_bytes(h_fd,
+                                            RPCHAT_HANDOFF_STATUS,
+                                            p_args->p_msg_buf,
+                                            p_args->sz_msg_buf);
+        }
+    }
+    return res;
+}
+
+/**
+ * Send one client: CONN with its socket, then its bytes
+ * @param h_fd Socket connected to successor
+ * @param p_conn_info Pointer to connection to pass
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on failure
+ */
+static int
+rpchat_handoff_send_conn(int h_fd, rpchat_conn_info_t *p_conn_info)
+{
+    rpchat_handoff_conn_t    head;
+    char                     body[RPCHAT_HANDOFF_CONN_BODY_SZ];
+    size_t                   sz_body   = 0;
+    size_t                   index     = 0;
+    rpchat_room_t           *p_room    = NULL;
+    struct iovec             iov[2];
+    int                      iov_count = 0;
+    rplib_ll_queue_node_t   *p_node    = NULL;
+    rpchat_outbound_frame_t *p_frame   = NULL;
+    rpchat_conn_extra_t     *p_extra   = atomic_load(&p_conn_info->p_extra);
+
+    head.type        = RPCHAT_HANDOFF_CONN;
+    head.conn_status = (uint8_t)p_conn_info->conn_status;
+    head.window      = p_conn_info->window;
+    head.in_flight   = p_conn_info->in_flight;
+    head.last_active = (int64_t)atomic_load(&p_conn_info->last_active);
+    head.name_len    = p_conn_info->username.len;
+    head.num_rooms   = NULL != p_extra ? p_extra->num_rooms : 0;
+    memcpy(body, p_conn_info->username.p_contents, head.name_len);
+    sz_body = head.name_len;
+    for (index = 0; index < head.num_rooms; index++)
+    {
+        p_room          = p_extra->rooms[index].p_room;
+        body[sz_body++] = (char)p_room->name_len;
+        memcpy(body + sz_body, p_room->name, p_room->name_len);
+        sz_body += p_room->name_len;
+    }
+    if (RPLIB_SUCCESS
+        != rpchat_handoff_send_record(h_fd,
+                                      &head,
+                                      sizeof(head),
+                                      body,
+                                      sz_body,
+                                      &p_conn_info->h_fd,
+                                      1))
+    {
+        return RPLIB_ERROR;
+    }
+
+    iov_count = rplib_ring_buf_get_data_iov(
+        &p_conn_info->inbound_buf, iov, RPCHAT_CONN_INBOUND_BUF_SZ);
+    for (index = 0; index < (size_t)iov_count; index++)
+    {
+        if (RPLIB_SUCCESS
+            != rpchat_handoff_send_bytes(
+                h_fd, RPCHAT_HANDOFF_INBOUND, iov[index].iov_base,
+                iov[index].iov_len))
+        {
+            return RPLIB_ERROR;
+        }
+    }
+    // the unwritten rest of each frame; the client saw the part before it
+    for (p_node = p_conn_info->p_outbound_queue->p_front; NULL != p_node;
+         p_node = p_node->p_next_node)
+    {
+        p_frame = (rpchat_outbound_frame_t *)p_node->p_data;
+        if (RPLIB_SUCCESS
+            != rpchat_handoff_send_bytes(
+                h_fd,
+                RPCHAT_HANDOFF_OUTBOUND,
+                p_frame->p_shared_msg->contents + p_frame->sz_sent,
+                p_frame->p_shared_msg->sz_msg - p_frame->sz_sent))
+        {
+            return RPLIB_ERROR;
+        }
+    }
+    // parked waited longer than what was posted after
+    if (RPLIB_SUCCESS
+            != rpchat_handoff_send_waiting(h_fd, p_conn_info->p_parked_out)
+        || RPLIB_SUCCESS
+               != rpchat_handoff_send_waiting(
+                   h_fd, NULL != p_extra ? p_extra->p_outbox : NULL))
+    {
+        return RPLIB_ERROR;
+    }
+    return RPLIB_SUCCESS;
+}
+
+/**
+ * Receive one record, with the sockets attached to it
+ * @param h_fd Socket connected to predecessor
+ * @param p_packet Pointer to buffer of RPCHAT_HANDOFF_MAX_PACKET bytes
+ * @param p_fds Pointer to array of MAX_LISTENERS entries to store sockets in
+ * @param p_num_fds Pointer to store number of sockets received in
+ * @return Size of record, 0 if the predecessor closed, RPLIB_ERROR on failure
+ */
+static ssize_t
+rpchat_handoff_recv_record(int     h_fd,
+                           char   *p_packet,
+                           int    *p_fds,
+                           size_t *p_num_fds)
+{
+    struct msghdr   msg;
+    struct iovec    iov;
+    struct cmsghdr *p_cmsg     = NULL;
+    ssize_t         sz_recv    = 0;
+    size_t          num_new    = 0;
+    size_t          num_all    = 0;     // sockets in the control message
+    size_t          index      = 0;
+    int             h_fd_extra = -1;    // socket beyond what p_fds holds
+    bool            b_overflow = false; // more sockets than p_fds holds
+    union
+    {
+        struct cmsghdr align; // cmsg buffers must be aligned as the header
+        char buf[CMSG_SPACE(sizeof(int) * RPCHAT_HANDOFF_MAX_LISTENERS)];
+    } control;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base       = p_packet;
+    iov.iov_len        = RPCHAT_HANDOFF_MAX_PACKET;
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    *p_num_fds         = 0;
+    do
+    {
+        sz_recv = recvmsg(h_fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (0 > sz_recv && EINTR == errno);
+    if (0 > sz_recv)
+    {
+        return RPLIB_ERROR;
+    }
+    for (p_cmsg = CMSG_FIRSTHDR(&msg); NULL != p_cmsg;
+         p_cmsg = CMSG_NXTHDR(&msg, p_cmsg))
+    {
+        if (SOL_SOCKET != p_cmsg->cmsg_level
+            || SCM_RIGHTS != p_cmsg->cmsg_type)
+        {
+            continue;
+        }
+        num_all = (p_cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        num_new = num_all;
+        if (RPCHAT_HANDOFF_MAX_LISTENERS - *p_num_fds < num_new)
+        {
+            num_new    = RPCHAT_HANDOFF_MAX_LISTENERS - *p_num_fds;
+            b_overflow = true;
+        }
+        memcpy(p_fds + *p_num_fds, CMSG_DATA(p_cmsg), sizeof(int) * num_new);
+        *p_num_fds += num_new;
+        // the kernel installed every socket sent, not only those kept
+        for (index = num_new; index < num_all; index++)
+        {
+            memcpy(&h_fd_extra,
+                   CMSG_DATA(p_cmsg) + sizeof(int) * index,
+                   sizeof(int));
+            close(h_fd_extra);
+        }
+    }
+    if (b_overflow)
+    {
+        for (index = 0; index < *p_num_fds; index++)
+        {
+            close(p_fds[index]);
+        }
+        *p_num_fds = 0;
+        errno      = EPROTO;
+        return RPLIB_ERROR;
+    }
+    if (0 != (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)))
+    {
+        for (index = 0; index < *p_num_fds; index++)
+        {
+            close(p_fds[index]);
+        }
+        *p_num_fds = 0;
+        errno      = EMSGSIZE;
+        return RPLIB_ERROR;
+    }
+    return sz_recv;
+}
+
+/**
+ * Check a CONN record describes a client this build can resume
+ * @param p_record Pointer to record
+ * @param sz_record Size of record
+ * @return true if valid, false otherwise
+ */
+static bool
+rpchat_handoff_check_conn(const char *p_record, size_t sz_record)
+{
+    rpchat_handoff_conn_t head;
+    size_t                offset = sizeof(head);
+    size_t                index  = 0;
+    size_t                len    = 0;
+
+    if (sizeof(head) > sz_record)
+    {
+        return false;
+    }
+    memcpy(&head, p_record, sizeof(head));
+    switch (head.conn_status)
+    {
+        case RPCHAT_CONN_PRE_REGISTER:
+        case RPCHAT_CONN_AVAILABLE:
+        case RPCHAT_CONN_PENDING_STATUS:
+            break;
+        default:
+            return false;
+    }
+    // registered clients have names, others cannot be in rooms
+    if ((RPCHAT_CONN_PRE_REGISTER == head.conn_status) != (0 == head.name_len)
+        || (0 == head.name_len && 0 < head.num_rooms)
+        || RPCHAT_MAX_STR_LENGTH < head.name_len
+        || RPCHAT_ROOM_MAX_JOINED < head.num_rooms || 0 == head.window
+        || RPCHAT_CONN_MAX_WINDOW < head.window
+        || head.window < head.in_flight)
+    {
+        return false;
+    }
+    offset += head.name_len;
+    for (index = 0; index < head.num_rooms && offset < sz_record; index++)
+    {
+        len = (uint8_t)p_record[offset];
+        offset += 1 + len;
+        if (sz_record < offset
+            || RPLIB_SUCCESS
+                   != rpchat_room_index_check_name(p_record + offset - len,
+                                                   len))
+        {
+            return false;
+        }
+    }
+    return head.num_rooms == index && sz_record == offset;
+}
+
+/**
+ * Add a client from a CONN record
+ * @param p_handoff Pointer to what was received
+ * @param h_fd Socket of client
+ * @param p_record Pointer to checked CONN record
+ * @param sz_record Size of record
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on allocation failure
+ */
+static int
+rpchat_handoff_add_client(rpchat_handoff_t *p_handoff,
+                          int               h_fd,
+                          const char       *p_record,
+                          size_t            sz_record)
+{
+    rpchat_handoff_client_t *p_grown  = NULL;
+    rpchat_handoff_client_t *p_client = NULL;
+    size_t                   capacity = 0;
+
+    if (p_handoff->num_clients == p_handoff->cap_clients)
+    {
+        capacity = 0 == p_handoff->cap_clients ? RPCHAT_HANDOFF_MIN_CLIENTS
+                                               : p_handoff->cap_clients * 2;
+        p_grown  = realloc(p_handoff->p_clients, capacity * sizeof(*p_grown));
+        if (NULL == p_grown)
+        {
+            return RPLIB_ERROR;
+        }
+        p_handoff->p_clients   = p_grown;
+        p_handoff->cap_clients = capacity;
+    }
+    p_client = &p_handoff->p_clients[p_handoff->num_clients];
+    memset(p_client, 0, sizeof(*p_client));
+    p_client->p_conn = malloc(sz_record);
+    if (NULL == p_client->p_conn)
+    {
+        return RPLIB_ERROR;
+    }
+    memcpy(p_client->p_conn, p_record, sz_record);
+    p_client->sz_conn = sz_record;
+    p_client->h_fd    = h_fd;
+    p_handoff->num_clients++;
+    return RPLIB_SUCCESS;
+}
+
+/**
+ * Append a data record to the latest client
+ * @param p_client Pointer to client
+ * @param p_record Pointer to record, type first
+ * @param sz_record Size of record
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS if the client could not
+ * hold its bytes, RPLIB_ERROR on allocation failure
+ */
+static int
+rpchat_handoff_add_data(rpchat_handoff_client_t *p_client,
+                        const char              *p_record,
+                        size_t                   sz_record)
+{
+    uint32_t len      = (uint32_t)(sz_record - 1);
+    size_t   needed   = p_client->sz_data + RPCHAT_HANDOFF_DATA_HDR_SZ + len;
+    size_t   capacity = 0;
+    char    *p_grown  = NULL;
+
+    if (RPCHAT_HANDOFF_INBOUND == (uint8_t)p_record[0])
+    {
+        if (RPCHAT_CONN_INBOUND_BUF_SZ - p_client->sz_inbound < len)
+        {
+            return RPLIB_UNSUCCESS;
+        }
+        p_client->sz_inbound += len;
+    }
+    // statuses are parked in a buffer of one status packet
+    if (RPCHAT_HANDOFF_STATUS == (uint8_t)p_record[0]
+        && sizeof(rpchat_pkt_status_t) < len)
+    {
+        return RPLIB_UNSUCCESS;
+    }
+    if (p_client->cap_data < needed)
+    {
+        capacity = 0 == p_client->cap_data ? 512 : p_client->cap_data;
+        while (capacity < needed)
+        {
+            capacity *= 2;
+        }
+        p_grown = realloc(p_client->p_data, capacity);
+        if (NULL == p_grown)
+        {
+            return RPLIB_ERROR;
+        }
+        p_client->p_data   = p_grown;
+        p_client->cap_data = capacity;
+    }
+    p_client->p_data[p_client->sz_data] = p_record[0];
+    memcpy(p_client->p_data + p_client->sz_data + 1, &len, sizeof(len));
+    memcpy(p_client->p_data + p_client->sz_data + RPCHAT_HANDOFF_DATA_HDR_SZ,
+           p_record + 1,
+           len);
+    p_client->sz_data = needed;
+    return RPLIB_SUCCESS;
+}
+
+/**
+ * Receive records up to END
+ * @param h_fd Socket connected to predecessor
+ * @param p_handoff Pointer to store what is received in
+ * @param p_packet Pointer to buffer of RPCHAT_HANDOFF_MAX_PACKET bytes
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS if the predecessor closed
+ * before HELLO, RPLIB_ERROR on failure
+ */
+static int
+rpchat_handoff_recv_all(int h_fd, rpchat_handoff_t *p_handoff, char *p_packet)
+{
+    int                    res     = RPLIB_ERROR;
+    ssize_t                sz_recv = 0;
+    int                    fds[RPCHAT_HANDOFF_MAX_LISTENERS];
+    size_t                 num_fds = 0;
+    size_t                 index   = 0;
+    bool                   b_hello = false;
+    bool                   b_skip  = false; // data of a dropped client
+    rpchat_handoff_hello_t hello;
+
+    for (;;)
+    {
+        sz_recv = rpchat_handoff_recv_record(h_fd, p_packet, fds, &num_fds);
+        if (0 >= sz_recv)
+        {
+            // a server stopping anyway may close without a word
+            return 0 == sz_recv && !b_hello ? RPLIB_UNSUCCESS : RPLIB_ERROR;
+        }
+        res = RPLIB_ERROR;
+        switch ((uint8_t)p_packet[0])
+        {
+            case RPCHAT_HANDOFF_HELLO:
+                if (b_hello || sizeof(hello) != (size_t)sz_recv)
+                {
+                    break;
+                }
+                memcpy(&hello, p_packet, sizeof(hello));
+                if (RPCHAT_HANDOFF_VERSION != hello.version
+                    || num_fds != hello.num_listeners)
+                {
+                    rpchat_log_write(RPCHAT_LOG_ERROR,
+                                     "handoff: predecessor speaks version %u",
+                                     (unsigned int)hello.version);
+                    break;
+                }
+                memcpy(p_handoff->listeners, fds, sizeof(int) * num_fds);
+                p_handoff->num_listeners = num_fds;
+                num_fds                  = 0;
+                b_hello                  = true;
+                res                      = RPLIB_SUCCESS;
+                break;
+            case RPCHAT_HANDOFF_CONN:
+                if (!b_hello || 1 != num_fds)
+                {
+                    break;
+                }
+                num_fds = 0;
+                if (!rpchat_handoff_check_conn(p_packet, (size_t)sz_recv))
+                {
+                    rpchat_log_write(RPCHAT_LOG_WARN,
+                                     "handoff: dropped client in bad record");
+                    close(fds[0]);
+                    b_skip = true;
+                    res    = RPLIB_SUCCESS;
+                    break;
+                }
+                b_skip = false;
+                res    = rpchat_handoff_add_client(
+                    p_handoff, fds[0], p_packet, (size_t)sz_recv);
+                if (RPLIB_SUCCESS != res)
+                {
+                    close(fds[0]);
+                }
+                break;
+            case RPCHAT_HANDOFF_INBOUND:
+            case RPCHAT_HANDOFF_OUTBOUND:
+            case RPCHAT_HANDOFF_DELIVERY:
+            case RPCHAT_HANDOFF_STATUS:
+                if (!b_hello || 0 != num_fds)
+                {
+                    break;
+                }
+                // bytes of a client dropped above, never of the one before
+                if (b_skip || 0 == p_handoff->num_clients)
+                {
+                    res = RPLIB_SUCCESS;
+                    break;
+                }
+                res = rpchat_handoff_add_data(
+                    &p_handoff->p_clients[p_handoff->num_clients - 1],
+                    p_packet,
+                    (size_t)sz_recv);
+                break;
+            case RPCHAT_HANDOFF_END:
+                return b_hello && 0 == num_fds ? RPLIB_SUCCESS : RPLIB_ERROR;
+            default:
+                break;
+        }
+        for (index = 0; index < num_fds; index++)
+        {
+            close(fds[index]);
+        }
+        if (RPLIB_SUCCESS != res)
+        {
+            return RPLIB_ERROR;
+        }
+    }
+}
+
+int
+rpchat_handoff_receive(const char *p_path, rpchat_handoff_t **pp_handoff)
+{
+    int                res       = RPLIB_ERROR;
+    int                h_fd      = -1;
+    struct sockaddr_un addr;
+    struct timeval     timeout;
+    rpchat_handoff_t  *p_handoff = NULL;
+    char              *p_packet  = NULL;
+    size_t             index     = 0;
+
+    *pp_handoff = NULL;
+    if (RPLIB_SUCCESS != rpchat_handoff_address(p_path, &addr))
+    {
+        perror("handoff");
+        goto cleanup;
+    }
+    h_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (0 > h_fd)
+    {
+        perror("handoff");
+        goto cleanup;
+    }
+    // nobody to take over from
+    if (0 > connect(h_fd, (struct sockaddr *)&addr, sizeof(addr)))
+    {
+        res = ENOENT == errno || ECONNREFUSED == errno ? RPLIB_SUCCESS
+                                                       : RPLIB_ERROR;
+        if (RPLIB_SUCCESS != res)
+        {
+            perror("handoff");
+        }
+        goto cleanup;
+    }
+    // a socket at the path is not proof it belongs to this server
+    if (!rpchat_handoff_check_peer(h_fd))
+    {
+        goto cleanup;
+    }
+    timeout.tv_sec  = RPCHAT_HANDOFF_TIMEOUT_SEC;
+    timeout.tv_usec = 0;
+    p_handoff       = calloc(1, sizeof(rpchat_handoff_t));
+    p_packet        = malloc(RPCHAT_HANDOFF_MAX_PACKET);
+    if (NULL == p_handoff || NULL == p_packet
+        || 0
+               > setsockopt(h_fd,
+                            SOL_SOCKET,
+                            SO_RCVTIMEO,
+                            &timeout,
+                            sizeof(timeout)))
+    {
+        perror("handoff");
+        goto cleanup;
+    }
+    for (index = 0; index < RPCHAT_HANDOFF_MAX_LISTENERS; index++)
+    {
+        p_handoff->listeners[index] = -1;
+    }
+    rpchat_log_write(RPCHAT_LOG_INFO, "handoff: taking over at %s", p_path);
+    res = rpchat_handoff_recv_all(h_fd, p_handoff, p_packet);
+    if (RPLIB_UNSUCCESS == res)
+    {
+        res = RPLIB_SUCCESS;
+        goto cleanup;
+    }
+    if (RPLIB_SUCCESS != res)
+    {
+        rpchat_log_write(RPCHAT_LOG_ERROR,
+                         "handoff: predecessor failed: %s",
+                         strerror(errno));
+        goto cleanup;
+    }
+    // the predecessor exits once everything is sent, freeing its ports
+    while (0 < recv(h_fd, p_packet, RPCHAT_HANDOFF_MAX_PACKET, 0))
+    {
+    }
+    rpchat_log_write(RPCHAT_LOG_INFO,
+                     "handoff: received %zu clients, %zu listeners",
+                     p_handoff->num_clients,
+                     p_handoff->num_listeners);
+    *pp_handoff = p_handoff;
+    p_handoff   = NULL;
+cleanup:
+    rpchat_handoff_destroy(p_handoff);
+    free(p_packet);
+    if (0 <= h_fd)
+    {
+        close(h_fd);
+    }
+    return res;
+}
+
+int
+rpchat_handoff_take_listener(rpchat_handoff_t *p_handoff,
+                             unsigned int      port_num)
+{
+    struct sockaddr_in addr;
+    socklen_t          sz_addr = 0;
+    size_t             index   = 0;
+    int                h_fd    = -1;
+
+    if (NULL == p_handoff)
+    {
+        return -1;
+    }
+    for (index = 0; index < p_handoff->num_listeners; index++)
+    {
+        h_fd    = p_handoff->listeners[index];
+        sz_addr = sizeof(addr);
+        if (0 <= h_fd
+            && 0 == getsockname(h_fd, (struct sockaddr *)&addr, &sz_addr)
+            && AF_INET == addr.sin_family && port_num == ntohs(addr.sin_port))
+        {
+            p_handoff->listeners[index] = -1;
+            return h_fd;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Copy unparsed bytes into a connection's inbound buffer
+ * @param p_conn_info Pointer to connection
+ * @param p_bytes Pointer to bytes
+ * @param len Number of bytes
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR on failure
+ */
+static int
+rpchat_handoff_fill_inbound(rpchat_conn_info_t *p_conn_info,
+                            const char         *p_bytes,
+                            size_t              len)
+{
+    char        *p_storage = NULL;
+    struct iovec iov[2];
+    int          iov_count = 0;
+    int          index     = 0;
+    size_t       sz_copied = 0;
+    size_t       sz_chunk  = 0;
+
+    if (NULL == p_conn_info->inbound_buf.p_buf)
+    {
+        p_storage
+            = rplib_pool_alloc(p_conn_info->p_pool, RPCHAT_CONN_INBOUND_BUF_SZ);
+        if (NULL == p_storage)
+        {
+            return RPLIB_ERROR;
+        }
+        rplib_ring_buf_attach(
+            &p_conn_info->inbound_buf, p_storage, RPCHAT_CONN_INBOUND_BUF_SZ);
+    }
+    iov_count = rplib_ring_buf_get_free_iov(&p_conn_info->inbound_buf, iov);
+    for (index = 0; index < iov_count && sz_copied < len; index++)
+    {
+        sz_chunk = len - sz_copied < iov[index].iov_len ? len - sz_copied
+                                                        : iov[index].iov_len;
+        memcpy(iov[index].iov_base, p_bytes + sz_copied, sz_chunk);
+        sz_copied += sz_chunk;
+    }
+    if (sz_copied < len)
+    {
+        return RPLIB_ERROR;
+    }
+    rplib_ring_buf_commit(&p_conn_info->inbound_buf, sz_copied);
+    return RPLIB_SUCCESS;
+}
+
+/**
+ * Restore a client into a connection already in its queue
+ * @param p_client Pointer to client received
+ * @param p_conn_info Pointer to connection holding its socket
+ * @param p_conn_queue Pointer to queue of the connection
+ * @param p_cluster Pointer to node, NULL if standalone
+ * @param p_tpool Pointer to threadpool running connection tasks
+ * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS if its username is
+ * taken, RPLIB_ERROR on failure
+ */
+static int
+rpchat_handoff_restore(rpchat_handoff_client_t *p_client,
+                       rpchat_conn_info_t      *p_conn_info,
+                       rpchat_conn_queue_t     *p_conn_queue,
+                       rpchat_cluster_t        *p_cluster,
+                       rplib_tpool_t           *p_tpool)
+{
+    int                   res       = RPLIB_SUCCESS;
+    rpchat_handoff_conn_t head;
+    const char           *p_cursor  = p_client->p_conn + sizeof(head);
+    rpchat_string_t       username;
+    bool                  b_pending = false;
+    size_t                index     = 0;
+    size_t                offset    = 0;
+    uint8_t               type      = 0;
+    uint32_t              len       = 0;
+    const char           *p_bytes   = NULL;
+
+    memcpy(&head, p_client->p_conn, sizeof(head));
+    p_conn_info->conn_status = (rpchat_conn_stat_t)head.conn_status;
+    p_conn_info->window      = head.window;
+    p_conn_info->in_flight   = head.in_flight;
+    atomic_store(&p_conn_info->last_active, (time_t)head.last_active);
+    if (0 < head.name_len)
+    {
+        username.len         = head.name_len;
+        username.b_sanitized = true;
+        memcpy(username.contents, p_cursor, head.name_len);
+        p_cursor += head.name_len;
+        // no link is up yet, so nodes have nothing to agree to
+        res = NULL != p_cluster
+                  ? rpchat_cluster_claim_username(p_cluster,
+                                                  p_conn_queue,
+                                                  p_conn_info,
+                                                  &username,
+                                                  &b_pending)
+                  : rpchat_conn_queue_claim_username(
+                      p_conn_queue, p_conn_info, &username);
+        if (RPLIB_SUCCESS != res)
+        {
+            return res;
+        }
+    }
+    for (index = 0; index < head.num_rooms; index++)
+    {
+        len = (uint8_t)p_cursor[0];
+        res = rpchat_conn_queue_join_room(
+            p_conn_queue, p_conn_info, p_cursor + 1, len);
+        if (RPLIB_SUCCESS != res)
+        {
+            return RPLIB_ERROR;
+        }
+        p_cursor += 1 + len;
+    }
+    for (offset = 0; offset < p_client->sz_data && RPLIB_SUCCESS == res;
+         offset += RPCHAT_HANDOFF_DATA_HDR_SZ + len)
+    {
+        type = (uint8_t)p_client->p_data[offset];
+        memcpy(&len, p_client->p_data + offset + 1, sizeof(len));
+        p_bytes = p_client->p_data + offset + RPCHAT_HANDOFF_DATA_HDR_SZ;
+        switch (type)
+        {
+            case RPCHAT_HANDOFF_INBOUND:
+                res = rpchat_handoff_fill_inbound(p_conn_info, p_bytes, len);
+                break;
+            case RPCHAT_HANDOFF_OUTBOUND:
+                res = rpchat_conn_info_queue_outbound(
+                    p_conn_info, (char *)p_bytes, len);
+                break;
+            default:
+                res = rpchat_park_outbound(p_conn_queue,
+                                           p_conn_info,
+                                           p_tpool,
+                                           p_bytes,
+                                           len,
+                                           RPCHAT_HANDOFF_DELIVERY == type);
+                break;
+        }
+    }
+    return RPLIB_SUCCESS == res ? RPLIB_SUCCESS : RPLIB_ERROR;
+}
+
+size_t
+rpchat_handoff_adopt(rpchat_handoff_t     *p_handoff,
+                     rpchat_conn_queue_t **pp_queues,
+                     size_t                num_queues,
+                     rpchat_cluster_t     *p_cluster,
+                     rplib_tpool_t        *p_tpool)
+{
+    rpchat_conn_info_t     **pp_adopted   = NULL;
+    size_t                   num_adopted  = 0;
+    size_t                   index        = 0;
+    rpchat_handoff_client_t *p_client     = NULL;
+    rpchat_conn_queue_t     *p_conn_queue = NULL;
+    rpchat_conn_info_t      *p_conn_info  = NULL;
+
+    // a listener kept open would queue clients nobody accepts
+    for (index = 0; index < p_handoff->num_listeners; index++)
+    {
+        if (0 <= p_handoff->listeners[index])
+        {
+            close(p_handoff->listeners[index]);
+            p_handoff->listeners[index] = -1;
+        }
+    }
+    if (0 == p_handoff->num_clients)
+    {
+        return 0;
+    }
+    pp_adopted = calloc(p_handoff->num_clients, sizeof(*pp_adopted));
+    if (NULL == pp_adopted)
+    {
+        perror("handoff");
+        return 0;
+    }
+    for (index = 0; index < p_handoff->num_clients; index++)
+    {
+        p_client     = &p_handoff->p_clients[index];
+        p_conn_queue = pp_queues[num_adopted % num_queues];
+        p_conn_info  = aligned_alloc(RPCHAT_CONN_CACHE_LINE,
+                                    sizeof(rpchat_conn_info_t));
+        if (NULL == p_conn_info
+            || RPLIB_SUCCESS
+                   != rpchat_conn_info_initialize(p_conn_info,
+                                                  p_client->h_fd,
+                                                  p_conn_queue->p_pool,
+                                                  p_conn_queue->b_affinity))
+        {
+            perror("handoff");
+            free(p_conn_info);
+            continue;
+        }
+        p_client->h_fd = -1;
+        rpchat_conn_queue_add_conn_batch(p_conn_queue, &p_conn_info, 1);
+        // disconnected like any client that failed, once resumed
+        if (RPLIB_SUCCESS
+            != rpchat_handoff_restore(
+                p_client, p_conn_info, p_conn_queue, p_cluster, p_tpool))
+        {
+            rpchat_log_write(RPCHAT_LOG_WARN,
+                             "handoff: could not restore client %zu",
+                             index);
+            p_conn_info->conn_status = RPCHAT_CONN_ERR;
+        }
+        pp_adopted[num_adopted++] = p_conn_info;
+    }
+    // every client is in place before any task may broadcast to them
+    for (index = 0; index < num_adopted; index++)
+    {
+        rpchat_resume_connection(
+            pp_queues[index % num_queues], pp_adopted[index], p_tpool);
+    }
+    free(pp_adopted);
+    return num_adopted;
+}
+
+void
+rpchat_handoff_destroy(rpchat_handoff_t *p_handoff)
+{
+    size_t index = 0;
+
+    if (NULL == p_handoff)
+    {
+        return;
+    }
+    for (index = 0; index < p_handoff->num_listeners; index++)
+    {
+        if (0 <= p_handoff->listeners[index])
+        {
+            close(p_handoff->listeners[index]);
+        }
+    }
+    for (index = 0; index < p_handoff->num_clients; index++)
+    {
+        if (0 <= p_handoff->p_clients[index].h_fd)
+        {
+            close(p_handoff->p_clients[index].h_fd);
+        }
+        free(p_handoff->p_clients[index].p_conn);
+        free(p_handoff->p_clients[index].p_data);
+    }
+    free(p_handoff->p_clients);
+    free(p_handoff);
+}
+
+int
+rpchat_handoff_listen(const char *p_path)
+{
+    int                h_fd     = -1;
+    int                res      = 0;
+    mode_t             old_mask = 0;
+    struct sockaddr_un addr;
+    struct stat        path_stat;
+
+    if (RPLIB_SUCCESS != rpchat_handoff_address(p_path, &addr))
+    {
+        perror("handoff");
+        return RPLIB_ERROR;
+    }
+    // left behind by a server that did not stop cleanly; other files stay
+    if (0 == lstat(p_path, &path_stat) && S_ISSOCK(path_stat.st_mode))
+    {
+        unlink(p_path);
+    }
+    h_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (0 > h_fd)
+    {
+        perror("handoff");
+        return RPLIB_ERROR;
+    }
+    // only this user may connect; the socket exists with that mode at once
+    old_mask = umask(S_IRWXG | S_IRWXO);
+    res      = bind(h_fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (0 > res || 0 > chmod(p_path, S_IRUSR | S_IWUSR) || 0 > listen(h_fd, 1))
+    {
+        perror("handoff");
+        close(h_fd);
+        return RPLIB_ERROR;
+    }
+    return h_fd;
+}
+
+int
+rpchat_handoff_accept(int h_fd_listen)
+{
+    int h_fd = -1;
+
+    // blocking: nothing else runs while records go out
+    h_fd = accept4(h_fd_listen, NULL, NULL, SOCK_CLOEXEC);
+    if (0 > h_fd)
+    {
+        if (EAGAIN != errno && EWOULDBLOCK != errno)
+        {
+            perror("handoff");
+        }
+        return RPLIB_ERROR;
+    }
+    if (!rpchat_handoff_check_peer(h_fd))
+    {
+        close(h_fd);
+        return RPLIB_ERROR;
+    }
+    return h_fd;
+}
+
+void
+rpchat_handoff_close(int h_fd_listen, const char *p_path)
+{
+    close(h_fd_listen);
+    unlink(p_path);
+}
+
+void
+rpchat_handoff_quiesce(rpchat_conn_queue_t **pp_queues,
+                       size_t                num_queues,
+                       rplib_tpool_t        *p_tpool)
+{
+    bool                 b_busy       = true;
+    bool                 b_mail       = false;
+    bool                 b_linger     = false;
+    size_t               index        = 0;
+    rpchat_conn_queue_t *p_conn_queue = NULL;
+
+    while (b_busy)
+    {
+        rplib_tpool_wait(p_tpool);
+        b_busy = false;
+        for (index = 0; index < num_queues; index++)
+        {
+            p_conn_queue = pp_queues[index];
+            // the reactors that would take these are gone
+            pthread_mutex_lock(&p_conn_queue->mutex_mailbox);
+            b_mail = 0 < p_conn_queue->p_mailbox->size;
+            pthread_mutex_unlock(&p_conn_queue->mutex_mailbox);
+            pthread_mutex_lock(&p_conn_queue->mutex_linger);
+            b_linger = NULL != p_conn_queue->p_lingering;
+            pthread_mutex_unlock(&p_conn_queue->mutex_linger);
+            if (b_mail || b_linger)
+            {
+                b_busy = true;
+                rpchat_deliver_mail(p_conn_queue, p_tpool);
+                rpchat_flush_lingering(p_conn_queue, p_tpool);
+            }
+        }
+    }
+}
+
+int
+rpchat_handoff_send(int                   h_fd_successor,
+                    const int            *p_listeners,
+                    size_t                num_listeners,
+                    rpchat_conn_queue_t **pp_queues,
+                    size_t                num_queues)
+{
+    rpchat_handoff_hello_t hello;
+    uint8_t                end         = RPCHAT_HANDOFF_END;
+    int                    num_passed  = 0;
+    size_t                 index       = 0;
+    rpchat_conn_info_t    *p_conn_info = NULL;
+
+    hello.type          = RPCHAT_HANDOFF_HELLO;
+    hello.version       = RPCHAT_HANDOFF_VERSION;
+    hello.num_listeners = (uint32_t)num_listeners;
+    if (RPCHAT_HANDOFF_MAX_LISTENERS < num_listeners
+        || RPLIB_SUCCESS
+               != rpchat_handoff_send_record(h_fd_successor,
+                                             &hello,
+                                             sizeof(hello),
+                                             NULL,
+                                             0,
+                                             p_listeners,
+                                             num_listeners))
+    {
+        goto fail;
+    }
+    for (index = 0; index < num_queues; index++)
+    {
+        for (p_conn_info = pp_queues[index]->p_conn_front; NULL != p_conn_info;
+             p_conn_info = p_conn_info->queue_link.p_next)
+        {
+            if (!rpchat_handoff_can_pass(p_conn_info))
+            {
+                continue;
+            }
+            if (RPLIB_SUCCESS
+                != rpchat_handoff_send_conn(h_fd_successor, p_conn_info))
+            {
+                goto fail;
+            }
+            num_passed++;
+        }
+    }
+    if (RPLIB_SUCCESS
+        != rpchat_handoff_send_record(
+            h_fd_successor, &end, sizeof(end), NULL, 0, NULL, 0))
+    {
+        goto fail;
+    }
+    return num_passed;
+fail:
+    perror("handoff");
+    return RPLIB_ERROR;
+}
+
+/*** end of file ***/
@@ -0,0 +1,808 @@
+/** @file rpchat_io_uring.c
+ *
+ * @brief Implements the io_uring readiness backend declared in
+ * `rpchat_io_uring.h` directly on the system calls and the shared rings.
+ * Submitters fill the submission queue under its mutex; only the reactor
+ * reads the completion queue, so that side needs no lock. Without submission
+ * polling, entries published by other threads wait for the reactor's next
+ * wait, which submits everything published in the same system call it
+ * sleeps in
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#include "rpchat_io_uring.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define RPCHAT_URING_TAG_MASK     3 // low bits of user_data hold the tag
+#define RPCHAT_URING_TAG_WATCHED  1 // watched descriptor, number above tag
+#define RPCHAT_URING_TAG_INTERNAL 2 // update or removal, result unused
+#define RPCHAT_URING_PROBE_SIZE   8 // entries of rings made only to probe
+#define RPCHAT_URING_WATCH_EVENTS (EPOLLIN) // reported for watched fds
+#define RPCHAT_URING_ONE_SHOT_BITS (EPOLLET | EPOLLONESHOT) // not poll bits
+#define RPCHAT_URING_WATCH_DATA(h_fd) \
+    (((uint64_t)(h_fd) << 2) | RPCHAT_URING_TAG_WATCHED) // user_data of watch
+
+typedef struct rpchat_uring
+{
+    int                  h_fd_ring;   // io_uring instance
+    bool                 b_sqpoll;    // kernel thread takes submissions
+    atomic_bool          b_sleeping;  // reactor asleep, others submit
+    uint8_t              skip_flags;  // IOSQE_CQE_SKIP_SUCCESS if supported
+    pthread_mutex_t      mutex_sq;    // guards submission queue tail
+    _Atomic unsigned    *p_sq_head;   // entries taken, advanced by kernel
+    _Atomic unsigned    *p_sq_tail;   // entries published by submitters
+    _Atomic unsigned    *p_sq_flags;  // IORING_SQ_* set by kernel
+    unsigned            *p_sq_array;  // index of entry in each slot
+    unsigned             sq_mask;     // sq_entries - 1
+    unsigned             sq_entries;  // size of submission queue
+    struct io_uring_sqe *p_sqes;      // submission entries
+    _Atomic unsigned    *p_cq_head;   // completions read by reactor
+    _Atomic unsigned    *p_cq_tail;   // completions posted by kernel
+    unsigned             cq_mask;     // size of completion queue - 1
+    struct io_uring_cqe *p_cqes;      // completion entries
+    void                *p_ring_map;  // both rings (IORING_FEAT_SINGLE_MMAP)
+    size_t               sz_ring_map; // bytes of p_ring_map
+    size_t               sz_sqes;     // bytes of p_sqes
+    int  watched[RPCHAT_URING_MAX_WATCHED]; // watched fds, -1 if slot free
+    bool b_fired[RPCHAT_URING_MAX_WATCHED]; // reported, poll to resubmit
+} rpchat_uring_t;
+
+// rings by descriptor; only changed while reactors are not running
+static rpchat_uring_t *rpchat_uring_rings[RPCHAT_URING_MAX_RINGS];
+
+/**
+ * Find the ring behind a descriptor
+ * @param h_fd_ring Ring file descriptor
+ * @return Pointer to ring, NULL if the descriptor is not a ring
+ */
+static rpchat_uring_t *
+rpchat_uring_find(int h_fd_ring)
+{
+    size_t ring_index = 0;
+
+    for (; ring_index < RPCHAT_URING_MAX_RINGS; ring_index++)
+    {
+        if (NULL != rpchat_uring_rings[ring_index]
+            && h_fd_ring == rpchat_uring_rings[ring_index]->h_fd_ring)
+        {
+            return rpchat_uring_rings[ring_index];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Wrapper for the io_uring_setup system call
+ * @param entries Submission queue entries asked for
+ * @param p_params Pointer to setup parameters, filled in by the kernel
+ * @return Ring file descriptor, negative with errno set on failure
+ */
+static int
+rpchat_uring_setup(unsigned int entries, struct io_uring_params *p_params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p_params);
+}
+
+/**
+ * Wrapper for the io_uring_enter system call
+ * @param h_fd_ring Ring file descriptor
+ * @param to_submit Published entries to submit
+ * @param min_complete Completions to wait for, with IORING_ENTER_GETEVENTS
+ * @param flags IORING_ENTER_* flags
+ * @return Entries submitted, negative with errno set on failure
+ */
+static int
+rpchat_uring_enter(int          h_fd_ring,
+                   unsigned int to_submit,
+                   unsigned int min_complete,
+                   unsigned int flags)
+{
+    return (int)syscall(__NR_io_uring_enter,
+                        h_fd_ring,
+                        to_submit,
+                        min_complete,
+                        flags,
+                        NULL,
+                        0);
+}
+
+/**
+ * Set up a ring with the parameters this backend uses
+ * @param entries Submission queue entries
+ * @param b_sqpoll Whether the kernel should poll the submission queue
+ * @param h_fd_attach Ring whose submission thread to share, or -1
+ * @param p_params Pointer to parameters to fill in
+ * @return Ring file descriptor, negative on failure
+ */
+static int
+rpchat_uring_setup_ring(unsigned int            entries,
+                        bool                    b_sqpoll,
+                        int                     h_fd_attach,
+                        struct io_uring_params *p_params)
+{
+    memset(p_params, 0, sizeof(struct io_uring_params));
+    // completions outnumber submissions: every connection may have a poll
+    // outstanding while entries are only held until the kernel takes them
+    p_params->flags      = IORING_SETUP_CQSIZE;
+    p_params->cq_entries = 4 * entries;
+    if (b_sqpoll)
+    {
+        p_params->flags |= IORING_SETUP_SQPOLL;
+        p_params->sq_thread_idle = RPCHAT_URING_SQ_IDLE_MS;
+        if (0 <= h_fd_attach)
+        {
+            p_params->flags |= IORING_SETUP_ATTACH_WQ;
+            p_params->wq_fd = h_fd_attach;
+        }
+    }
+    return rpchat_uring_setup(entries, p_params);
+}
+
+/**
+ * Check that a ring supports everything this backend relies on
+ * @param p_params Pointer to parameters returned by setup
+ * @return true if supported
+ */
+static bool
+rpchat_uring_supported(const struct io_uring_params *p_params)
+{
+    // resource tags came with poll updates in 5.13
+    const uint32_t needed
+        = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_RSRC_TAGS;
+
+    return needed == (p_params->features & needed);
+}
+
+bool
+rpchat_uring_probe(bool b_sqpoll)
+{
+    struct io_uring_params params;
+    int                    h_fd_ring = -1;
+    bool                   b_usable  = false;
+
+    h_fd_ring = rpchat_uring_setup_ring(
+        RPCHAT_URING_PROBE_SIZE, b_sqpoll, -1, &params);
+    if (0 > h_fd_ring)
+    {
+        goto leave;
+    }
+    b_usable = rpchat_uring_supported(&params);
+    close(h_fd_ring);
+leave:
+    return b_usable;
+}
+
+int
+rpchat_uring_create(bool b_sqpoll)
+{
+    int                    res         = RPLIB_ERROR;
+    rpchat_uring_t        *p_ring      = NULL;
+    size_t                 ring_index  = 0;
+    size_t                 free_index  = RPCHAT_URING_MAX_RINGS;
+    int                    h_fd_attach = -1; // ring to share thread with
+    char                  *p_map       = NULL;
+    struct io_uring_params params;
+
+    for (ring_index = 0; ring_index < RPCHAT_URING_MAX_RINGS; ring_index++)
+    {
+        if (NULL == rpchat_uring_rings[ring_index])
+        {
+            free_index = RPCHAT_URING_MAX_RINGS == free_index ? ring_index
+                                                              : free_index;
+        }
+        else if (rpchat_uring_rings[ring_index]->b_sqpoll)
+        {
+            h_fd_attach = rpchat_uring_rings[ring_index]->h_fd_ring;
+        }
+    }
+    if (RPCHAT_URING_MAX_RINGS == free_index)
+    {
+        fprintf(stderr, "io_uring: too many rings\n");
+        goto leave;
+    }
+    p_ring = calloc(1, sizeof(rpchat_uring_t));
+    if (NULL == p_ring)
+    {
+        perror("calloc");
+        goto leave;
+    }
+    p_ring->h_fd_ring = rpchat_uring_setup_ring(
+        RPCHAT_URING_ENTRIES, b_sqpoll, h_fd_attach, &params);
+    // one submission thread per ring is still correct, only busier
+    if (0 > p_ring->h_fd_ring && 0 <= h_fd_attach)
+    {
+        p_ring->h_fd_ring = rpchat_uring_setup_ring(
+            RPCHAT_URING_ENTRIES, b_sqpoll, -1, &params);
+    }
+    if (0 > p_ring->h_fd_ring)
+    {
+        perror("io_uring_setup");
+        goto cleanup;
+    }
+    if (!rpchat_uring_supported(&params))
+    {
+        fprintf(stderr, "io_uring: kernel lacks poll updates\n");
+        goto cleanup;
+    }
+    p_ring->b_sqpoll   = b_sqpoll;
+    p_ring->skip_flags = (params.features & IORING_FEAT_CQE_SKIP)
+                             ? IOSQE_CQE_SKIP_SUCCESS
+                             : 0;
+
+    // both rings share one mapping
+    p_ring->sz_ring_map
+        = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    if (p_ring->sz_ring_map
+        < params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe))
+    {
+        p_ring->sz_ring_map = params.cq_off.cqes
+                              + params.cq_entries * sizeof(struct io_uring_cqe);
+    }
+    p_ring->p_ring_map = mmap(NULL,
+                              p_ring->sz_ring_map,
+                              PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE,
+                              p_ring->h_fd_ring,
+                              IORING_OFF_SQ_RING);
+    if (MAP_FAILED == p_ring->p_ring_map)
+    {
+        perror("mmap");
+        p_ring->p_ring_map = NULL;
+        goto cleanup;
+    }
+    p_ring->sz_sqes = params.sq_entries * sizeof(struct io_uring_sqe);
+    p_ring->p_sqes  = mmap(NULL,
+                          p_ring->sz_sqes,
+                          PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE,
+                          p_ring->h_fd_ring,
+                          IORING_OFF_SQES);
+    if (MAP_FAILED == p_ring->p_sqes)
+    {
+        perror("mmap");
+        p_ring->p_sqes = NULL;
+        goto cleanup;
+    }
+    p_map              = p_ring->p_ring_map;
+    p_ring->p_sq_head  = (_Atomic unsigned *)(p_map + params.sq_off.head);
+    p_ring->p_sq_tail  = (_Atomic unsigned *)(p_map + params.sq_off.tail);
+    p_ring->p_sq_flags = (_Atomic unsigned *)(p_map + params.sq_off.flags);
+    p_ring->p_sq_array = (unsigned *)(p_map + params.sq_off.array);
+    p_ring->sq_mask    = *(unsigned *)(p_map + params.sq_off.ring_mask);
+    p_ring->sq_entries = params.sq_entries;
+    p_ring->p_cq_head  = (_Atomic unsigned *)(p_map + params.cq_off.head);
+    p_ring->p_cq_tail  = (_Atomic unsigned *)(p_map + params.cq_off.tail);
+    p_ring->cq_mask    = *(unsigned *)(p_map + params.cq_off.ring_mask);
+    p_ring->p_cqes     = (struct io_uring_cqe *)(p_map + params.cq_off.cqes);
+    for (ring_index = 0; ring_index < RPCHAT_URING_MAX_WATCHED; ring_index++)
+    {
+        p_ring->watched[ring_index] = -1;
+    }
+    if (0 != pthread_mutex_init(&p_ring->mutex_sq, NULL))
+    {
+        goto cleanup;
+    }
+    rpchat_uring_rings[free_index] = p_ring;
+    res                            = p_ring->h_fd_ring;
+    goto leave;
+cleanup:
+    if (NULL != p_ring->p_sqes)
+    {
+        munmap(p_ring->p_sqes, p_ring->sz_sqes);
+    }
+    if (NULL != p_ring->p_ring_map)
+    {
+        munmap(p_ring->p_ring_map, p_ring->sz_ring_map);
+    }
+    if (0 <= p_ring->h_fd_ring)
+    {
+        close(p_ring->h_fd_ring);
+    }
+    free(p_ring);
+leave:
+    return res;
+}
+
+void
+rpchat_uring_destroy(int h_fd_ring)
+{
+    size_t          ring_index = 0;
+    rpchat_uring_t *p_ring     = NULL;
+
+    for (; ring_index < RPCHAT_URING_MAX_RINGS; ring_index++)
+    {
+        p_ring = rpchat_uring_rings[ring_index];
+        if (NULL != p_ring && h_fd_ring == p_ring->h_fd_ring)
+        {
+            rpchat_uring_rings[ring_index] = NULL;
+            munmap(p_ring->p_sqes, p_ring->sz_sqes);
+            munmap(p_ring->p_ring_map, p_ring->sz_ring_map);
+            close(p_ring->h_fd_ring);
+            pthread_mutex_destroy(&p_ring->mutex_sq);
+            free(p_ring);
+            return;
+        }
+    }
+}
+
+/**
+ * Take the next free submission entry, cleared. If the queue is full, wait
+ * for the kernel to take entries first.
+ * \nNote: Caller holds the submission mutex
+ * @param p_ring Pointer to ring
+ * @return Pointer to entry, NULL if the kernel could not take entries
+ */
+static struct io_uring_sqe *
+rpchat_uring_get_sqe(rpchat_uring_t *p_ring)
+{
+    unsigned             tail    = 0;
+    unsigned             slot    = 0;
+    unsigned             flags   = 0;
+    struct io_uring_sqe *p_entry = NULL;
+
+    tail = atomic_load_explicit(p_ring->p_sq_tail, memory_order_relaxed);
+    while (p_ring->sq_entries
+           <= tail
+                  - atomic_load_explicit(p_ring->p_sq_head,
+                                         memory_order_acquire))
+    {
+        // every published entry is complete, whoever meant to submit it
+        flags = p_ring->b_sqpoll
+                    ? IORING_ENTER_SQ_WAIT | IORING_ENTER_SQ_WAKEUP
+                    : 0;
+        if (0 > rpchat_uring_enter(p_ring->h_fd_ring,
+                                   p_ring->b_sqpoll ? 0 : p_ring->sq_entries,
+                                   0,
+                                   flags)
+            && EINTR != errno)
+        {
+            perror("io_uring_enter");
+            return NULL;
+        }
+    }
+    slot                     = tail & p_ring->sq_mask;
+    p_entry                  = &p_ring->p_sqes[slot];
+    p_ring->p_sq_array[slot] = slot;
+    memset(p_entry, 0, sizeof(struct io_uring_sqe));
+    return p_entry;
+}
+
+/**
+ * Publish the entry taken by the last `rpchat_uring_get_sqe`.
+ * \nNote: Caller holds the submission mutex
+ * @param p_ring Pointer to ring
+ */
+static void
+rpchat_uring_publish(rpchat_uring_t *p_ring)
+{
+    atomic_fetch_add_explicit(p_ring->p_sq_tail, 1, memory_order_release);
+}
+
+/**
+ * Count entries published but not yet taken by the kernel
+ * @param p_ring Pointer to ring
+ * @return # entries
+ */
+static unsigned int
+rpchat_uring_unsubmitted(rpchat_uring_t *p_ring)
+{
+    return atomic_load(p_ring->p_sq_tail)
+           - atomic_load_explicit(p_ring->p_sq_head, memory_order_acquire);
+}
+
+/**
+ * Have the kernel take published entries. With submission polling the
+ * thread only needs waking if it went to sleep. Otherwise a reactor still
+ * handling events submits them with its next wait, so they are only
+ * submitted here, or by whichever submitter gets to the kernel first, while
+ * it sleeps
+ * \nNote: Called without the submission mutex
+ * @param p_ring Pointer to ring
+ * @param num_entries Entries this caller published
+ */
+static void
+rpchat_uring_submit(rpchat_uring_t *p_ring, unsigned int num_entries)
+{
+    int num_taken = 0;
+
+    // tail store must be visible before the sleep flag is read
+    atomic_thread_fence(memory_order_seq_cst);
+    if (p_ring->b_sqpoll)
+    {
+        if (atomic_load_explicit(p_ring->p_sq_flags, memory_order_relaxed)
+            & IORING_SQ_NEED_WAKEUP)
+        {
+            rpchat_uring_enter(
+                p_ring->h_fd_ring, 0, 0, IORING_ENTER_SQ_WAKEUP);
+        }
+        return;
+    }
+    if (!atomic_load(&p_ring->b_sleeping))
+    {
+        return;
+    }
+    while (0 < num_entries)
+    {
+        num_taken = rpchat_uring_enter(p_ring->h_fd_ring, num_entries, 0, 0);
+        if (0 > num_taken && EINTR == errno)
+        {
+            continue;
+        }
+        // none left means another submitter took them
+        if (0 >= num_taken)
+        {
+            break;
+        }
+        num_entries -= (unsigned int)num_taken;
+    }
+}
+
+/**
+ * Fill an entry polling a descriptor once
+ * @param p_entry Pointer to cleared entry
+ * @param h_fd File descriptor to poll
+ * @param events Epoll events to wait for
+ * @param user_data Value reported with the completion
+ */
+static void
+rpchat_uring_prep_poll(struct io_uring_sqe *p_entry,
+                       int                  h_fd,
+                       uint32_t             events,
+                       uint64_t             user_data)
+{
+    p_entry->opcode        = IORING_OP_POLL_ADD;
+    p_entry->fd            = h_fd;
+    p_entry->poll32_events = events & ~RPCHAT_URING_ONE_SHOT_BITS;
+    p_entry->user_data     = user_data;
+}
+
+/**
+ * Fill an entry updating the events of, or removing, an outstanding poll
+ * @param p_ring Pointer to ring
+ * @param p_entry Pointer to cleared entry
+ * @param target user_data of poll to change
+ * @param events Epoll events to wait for instead; 0 removes the poll
+ */
+static void
+rpchat_uring_prep_change(rpchat_uring_t      *p_ring,
+                         struct io_uring_sqe *p_entry,
+                         uint64_t             target,
+                         uint32_t             events)
+{
+    p_entry->opcode    = IORING_OP_POLL_REMOVE;
+    p_entry->fd        = -1;
+    p_entry->addr      = target;
+    p_entry->flags     = p_ring->skip_flags;
+    p_entry->user_data = RPCHAT_URING_TAG_INTERNAL;
+    if (0 != events)
+    {
+        p_entry->len           = IORING_POLL_UPDATE_EVENTS;
+        p_entry->poll32_events = events & ~RPCHAT_URING_ONE_SHOT_BITS;
+    }
+}
+
+int
+rpchat_uring_watch(int h_fd_ring, int h_fd)
+{
+    int                  res         = RPLIB_ERROR;
+    rpchat_uring_t      *p_ring      = rpchat_uring_find(h_fd_ring);
+    struct io_uring_sqe *p_entry     = NULL;
+    size_t               watch_index = 0;
+
+    if (NULL == p_ring)
+    {
+        goto leave;
+    }
+    for (; watch_index < RPCHAT_URING_MAX_WATCHED; watch_index++)
+    {
+        if (0 > p_ring->watched[watch_index])
+        {
+            break;
+        }
+    }
+    if (RPCHAT_URING_MAX_WATCHED == watch_index)
+    {
+        goto leave;
+    }
+    pthread_mutex_lock(&p_ring->mutex_sq);
+    p_entry = rpchat_uring_get_sqe(p_ring);
+    if (NULL != p_entry)
+    {
+        rpchat_uring_prep_poll(p_entry,
+                               h_fd,
+                               RPCHAT_URING_WATCH_EVENTS,
+                               RPCHAT_URING_WATCH_DATA(h_fd));
+        rpchat_uring_publish(p_ring);
+        p_ring->watched[watch_index] = h_fd;
+        p_ring->b_fired[watch_index] = false;
+        res                          = RPLIB_SUCCESS;
+    }
+    pthread_mutex_unlock(&p_ring->mutex_sq);
+    if (RPLIB_SUCCESS == res)
+    {
+        rpchat_uring_submit(p_ring, 1);
+    }
+leave:
+    return res;
+}
+
+void
+rpchat_uring_unwatch(int h_fd_ring, int h_fd)
+{
+    rpchat_uring_t *p_ring      = rpchat_uring_find(h_fd_ring);
+    size_t          watch_index = 0;
+
+    // an outstanding poll completes unclaimed and is skipped
+    for (; NULL != p_ring && watch_index < RPCHAT_URING_MAX_WATCHED;
+         watch_index++)
+    {
+        if (h_fd == p_ring->watched[watch_index])
+        {
+            p_ring->watched[watch_index] = -1;
+        }
+    }
+}
+
+int
+rpchat_uring_arm(int          h_fd_ring,
+                 int          h_fd,
+                 void        *p_data_ptr,
+                 uint32_t     events,
+                 atomic_bool *p_b_pending)
+{
+    int                  res     = RPLIB_UNSUCCESS;
+    rpchat_uring_t      *p_ring  = rpchat_uring_find(h_fd_ring);
+    struct io_uring_sqe *p_entry = NULL;
+
+    if (NULL == p_ring || 0 > h_fd)
+    {
+        goto leave;
+    }
+    pthread_mutex_lock(&p_ring->mutex_sq);
+    p_entry = rpchat_uring_get_sqe(p_ring);
+    if (NULL != p_entry)
+    {
+        // an update that races the poll completing fails harmlessly; the
+        // completion's task arms again
+        if (atomic_exchange(p_b_pending, true))
+        {
+            rpchat_uring_prep_change(
+                p_ring, p_entry, (uintptr_t)p_data_ptr, events);
+        }
+        else
+        {
+            rpchat_uring_prep_poll(
+                p_entry, h_fd, events, (uintptr_t)p_data_ptr);
+        }
+        rpchat_uring_publish(p_ring);
+        res = RPLIB_SUCCESS;
+    }
+    pthread_mutex_unlock(&p_ring->mutex_sq);
+    if (RPLIB_SUCCESS == res)
+    {
+        rpchat_uring_submit(p_ring, 1);
+    }
+leave:
+    return res;
+}
+
+void
+rpchat_uring_disarm(int          h_fd_ring,
+                    void        *p_data_ptr,
+                    atomic_bool *p_b_pending)
+{
+    rpchat_uring_t      *p_ring  = rpchat_uring_find(h_fd_ring);
+    struct io_uring_sqe *p_entry = NULL;
+
+    if (NULL == p_ring || !atomic_load(p_b_pending))
+    {
+        return;
+    }
+    pthread_mutex_lock(&p_ring->mutex_sq);
+    p_entry = rpchat_uring_get_sqe(p_ring);
+    if (NULL != p_entry)
+    {
+        rpchat_uring_prep_change(p_ring, p_entry, (uintptr_t)p_data_ptr, 0);
+        rpchat_uring_publish(p_ring);
+    }
+    pthread_mutex_unlock(&p_ring->mutex_sq);
+    if (NULL != p_entry)
+    {
+        rpchat_uring_submit(p_ring, 1);
+    }
+}
+
+/**
+ * Publish again the polls of watched descriptors reported by the last wait;
+ * whatever is still readable completes again at once, like level-triggered
+ * epoll. Only a submission thread is told of them; otherwise the wait
+ * submits them along with everything else published
+ * @param p_ring Pointer to ring
+ */
+static void
+rpchat_uring_rewatch(rpchat_uring_t *p_ring)
+{
+    size_t               watch_index = 0;
+    unsigned int         num_entries = 0;
+    struct io_uring_sqe *p_entry     = NULL;
+    int                  h_fd        = -1;
+
+    pthread_mutex_lock(&p_ring->mutex_sq);
+    for (; watch_index < RPCHAT_URING_MAX_WATCHED; watch_index++)
+    {
+        h_fd = p_ring->watched[watch_index];
+        if (0 > h_fd || !p_ring->b_fired[watch_index])
+        {
+            continue;
+        }
+        p_entry = rpchat_uring_get_sqe(p_ring);
+        if (NULL == p_entry)
+        {
+            break;
+        }
+        rpchat_uring_prep_poll(p_entry,
+                               h_fd,
+                               RPCHAT_URING_WATCH_EVENTS,
+                               RPCHAT_URING_WATCH_DATA(h_fd));
+        rpchat_uring_publish(p_ring);
+        p_ring->b_fired[watch_index] = false;
+        num_entries++;
+    }
+    pthread_mutex_unlock(&p_ring->mutex_sq);
+    if (p_ring->b_sqpoll && 0 < num_entries)
+    {
+        rpchat_uring_submit(p_ring, num_entries);
+    }
+}
+
+/**
+ * Translate the completion of a watched descriptor's poll
+ * @param p_ring Pointer to ring
+ * @param p_completion Pointer to completion
+ * @param p_event Pointer to event to fill in
+ * @return true if an event was filled in, false if the descriptor is no
+ * longer watched or its poll failed (which ends the watch)
+ */
+static bool
+rpchat_uring_watched_event(rpchat_uring_t            *p_ring,
+                           const struct io_uring_cqe *p_completion,
+                           struct epoll_event        *p_event)
+{
+    int    h_fd        = (int)(p_completion->user_data >> 2);
+    size_t watch_index = 0;
+
+    for (; watch_index < RPCHAT_URING_MAX_WATCHED; watch_index++)
+    {
+        if (h_fd != p_ring->watched[watch_index])
+        {
+            continue;
+        }
+        if (0 > p_completion->res)
+        {
+            p_ring->watched[watch_index] = -1;
+            return false;
+        }
+        p_ring->b_fired[watch_index] = true;
+        p_event->events              = (uint32_t)p_completion->res;
+        p_event->data.u64            = 0;
+        p_event->data.fd             = h_fd;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Take waiting completions off the queue, translating them into events
+ * @param p_ring Pointer to ring
+ * @param p_ret_event_buf Pointer to buffer to receive events
+ * @param max_events Most events to return; completions past those stay
+ * queued for the next call
+ * @return # events
+ */
+static unsigned int
+rpchat_uring_reap(rpchat_uring_t     *p_ring,
+                  struct epoll_event *p_ret_event_buf,
+                  unsigned int        max_events)
+{
+    unsigned                   head         = 0;
+    unsigned                   tail         = 0;
+    unsigned int               num_ready    = 0;
+    const struct io_uring_cqe *p_completion = NULL;
+    struct epoll_event        *p_event      = NULL;
+
+    head = atomic_load_explicit(p_ring->p_cq_head, memory_order_relaxed);
+    tail = atomic_load_explicit(p_ring->p_cq_tail, memory_order_acquire);
+    for (; head != tail && num_ready < max_events; head++)
+    {
+        p_completion = &p_ring->p_cqes[head & p_ring->cq_mask];
+        p_event      = &p_ret_event_buf[num_ready];
+        switch (p_completion->user_data & RPCHAT_URING_TAG_MASK)
+        {
+            case RPCHAT_URING_TAG_WATCHED:
+                if (rpchat_uring_watched_event(p_ring, p_completion, p_event))
+                {
+                    num_ready++;
+                }
+                break;
+            case 0:
+                // connection; a failed or withdrawn poll reads as a hang up
+                p_event->events = 0 < p_completion->res
+                                      ? (uint32_t)p_completion->res
+                                      : EPOLLERR | EPOLLHUP;
+                p_event->data.ptr
+                    = (void *)(uintptr_t)p_completion->user_data;
+                num_ready++;
+                break;
+            default:
+                break;
+        }
+    }
+    atomic_store_explicit(p_ring->p_cq_head, head, memory_order_release);
+    return num_ready;
+}
+
+int
+rpchat_uring_wait(int                 h_fd_ring,
+                  struct epoll_event *p_ret_event_buf,
+                  unsigned int        max_events)
+{
+    int             res       = RPLIB_ERROR;
+    rpchat_uring_t *p_ring    = rpchat_uring_find(h_fd_ring);
+    unsigned int    num_ready = 0;
+    unsigned int    to_submit = 0; // published entries the kernel lacks
+    int             num_taken = 0;
+
+    if (NULL == p_ring)
+    {
+        goto leave;
+    }
+    rpchat_uring_rewatch(p_ring);
+
+    // failed updates and removals are no events, like epoll_wait keep
+    // waiting until there is one
+    for (;;)
+    {
+        num_ready = rpchat_uring_reap(p_ring, p_ret_event_buf, max_events);
+        if (0 < num_ready)
+        {
+            break;
+        }
+        // submitters publishing from here on submit their own entries
+        atomic_store(&p_ring->b_sleeping, true);
+        to_submit = p_ring->b_sqpoll ? 0 : rpchat_uring_unsubmitted(p_ring);
+        // only sleep when nothing is waiting (this also flushes overflow)
+        num_taken = rpchat_uring_enter(
+            p_ring->h_fd_ring, to_submit, 1, IORING_ENTER_GETEVENTS);
+        atomic_store(&p_ring->b_sleeping, false);
+        if (0 > num_taken && EINTR != errno)
+        {
+            perror("io_uring_enter");
+            goto leave;
+        }
+    }
+    // entries published meanwhile go in with the events already there
+    to_submit = p_ring->b_sqpoll ? 0 : rpchat_uring_unsubmitted(p_ring);
+    if (0 < to_submit
+        && 0 > rpchat_uring_enter(p_ring->h_fd_ring, to_submit, 0, 0)
+        && EINTR != errno)
+    {
+        perror("io_uring_enter");
+        goto leave;
+    }
+    res = (int)num_ready;
+leave:
+    return res;
+}
+
+/*** end of file ***/
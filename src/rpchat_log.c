@@ -0,0 +1,411 @@
+/** @file rpchat_log.c
+ *
+ * @brief Implements the asynchronous logger declared in `rpchat_log.h`. Every
+ * thread owns a single-producer ring the writer thread is the only consumer
+ * of; rings live until the logger stops, so threads come and go freely
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#include "rpchat_log.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RPCHAT_LOG_RING_MASK  (RPCHAT_LOG_RING_SIZE - 1)
+#define RPCHAT_LOG_CACHE_LINE 64
+#define RPCHAT_LOG_NOTICE_MAX 64 // drop notice written by the writer itself
+
+/**
+ * Records of a single thread, written by that thread, read by the writer
+ */
+typedef struct rpchat_log_ring
+{
+    _Alignas(RPCHAT_LOG_CACHE_LINE) atomic_size_t head; // running read offset
+    _Alignas(RPCHAT_LOG_CACHE_LINE) atomic_size_t tail; // running write offset
+    struct rpchat_log_ring *p_next;                  // next registered ring
+    char                    buf[RPCHAT_LOG_RING_SIZE]; // record bytes
+} rpchat_log_ring_t;
+
+typedef struct
+{
+    atomic_int                  level;        // most verbose kept, -1 stopped
+    atomic_bool                 b_terminate;  // writer asked to stop
+    atomic_size_t               num_dropped;  // records that did not fit
+    size_t                      num_reported; // drops already noted in log
+    int                         h_fd_log;     // descriptor records go to
+    _Atomic(rpchat_log_ring_t *) p_rings;     // every registered ring
+    pthread_mutex_t             mutex;        // ring registration, wakeups
+    pthread_cond_t              cond_writer;  // writer waits for work here
+    pthread_t                   thread;       // writer thread
+} rpchat_log_t;
+
+/**
+ * Batch of ring regions handed to one `writev`, with the ring offsets to
+ * release once written
+ */
+typedef struct
+{
+    struct iovec       iov[RPCHAT_LOG_MAX_IOV];
+    size_t             num_iov;
+    rpchat_log_ring_t *p_rings[RPCHAT_LOG_MAX_IOV];
+    size_t             tails[RPCHAT_LOG_MAX_IOV];
+    size_t             num_rings;
+} rpchat_log_batch_t;
+
+static rpchat_log_t rpchat_logger = {
+    .level       = -1,
+    .mutex       = PTHREAD_MUTEX_INITIALIZER,
+    .cond_writer = PTHREAD_COND_INITIALIZER,
+};
+
+static _Thread_local rpchat_log_ring_t *p_rpchat_log_ring = NULL;
+
+static const char *const rpchat_log_level_table[] = {
+    "ERROR", // RPCHAT_LOG_ERROR
+    "WARN",  // RPCHAT_LOG_WARN
+    "INFO",  // RPCHAT_LOG_INFO
+    "DEBUG", // RPCHAT_LOG_DEBUG
+};
+
+/**
+ * Get the ring of the calling thread, registering one on first use
+ * @param p_log Pointer to logger
+ * @return Pointer to ring; NULL if it could not be allocated
+ */
+static rpchat_log_ring_t *
+rpchat_log_get_ring(rpchat_log_t *p_log)
+{
+    rpchat_log_ring_t *p_ring = p_rpchat_log_ring;
+
+    if (NULL != p_ring)
+    {
+        return p_ring;
+    }
+    p_ring = calloc(1, sizeof(rpchat_log_ring_t));
+    if (NULL == p_ring)
+    {
+        return NULL;
+    }
+    // push front; writer walks the list without the lock
+    pthread_mutex_lock(&p_log->mutex);
+    p_ring->p_next = atomic_load_explicit(&p_log->p_rings,
+                                          memory_order_relaxed);
+    atomic_store_explicit(&p_log->p_rings, p_ring, memory_order_release);
+    pthread_mutex_unlock(&p_log->mutex);
+    p_rpchat_log_ring = p_ring;
+    return p_ring;
+}
+
+/**
+ * Write a batch out in full and release the ring regions it covered. On a
+ * failed write the records are lost rather than retried, so a bad log
+ * descriptor cannot stall the rings
+ * @param p_log Pointer to logger
+ * @param p_batch Pointer to batch; emptied on return
+ */
+static void
+rpchat_log_flush(rpchat_log_t *p_log, rpchat_log_batch_t *p_batch)
+{
+    struct iovec *p_iov      = p_batch->iov;
+    size_t        num_iov    = p_batch->num_iov;
+    ssize_t       written    = 0;
+    size_t        ring_index = 0;
+
+    while (0 < num_iov)
+    {
+        written = writev(p_log->h_fd_log, p_iov, (int)num_iov);
+        if (0 > written)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            break;
+        }
+        // skip what went out, resume mid-region on a short write
+        while (0 < num_iov && (size_t)written >= p_iov->iov_len)
+        {
+            written -= (ssize_t)p_iov->iov_len;
+            p_iov++;
+            num_iov--;
+        }
+        if (0 < num_iov)
+        {
+            p_iov->iov_base = (char *)p_iov->iov_base + written;
+            p_iov->iov_len -= (size_t)written;
+        }
+    }
+    for (ring_index = 0; ring_index < p_batch->num_rings; ring_index++)
+    {
+        atomic_store_explicit(&p_batch->p_rings[ring_index]->head,
+                              p_batch->tails[ring_index],
+                              memory_order_release);
+    }
+    p_batch->num_iov   = 0;
+    p_batch->num_rings = 0;
+}
+
+/**
+ * Write out everything buffered in every ring, noting any new drops first
+ * @param p_log Pointer to logger
+ */
+static void
+rpchat_log_drain(rpchat_log_t *p_log)
+{
+    rpchat_log_batch_t batch;
+    rpchat_log_ring_t *p_ring      = NULL;
+    char               notice[RPCHAT_LOG_NOTICE_MAX];
+    size_t             num_dropped = 0;
+    size_t             head        = 0;
+    size_t             tail        = 0;
+    size_t             offset      = 0;
+    size_t             len         = 0;
+    int                notice_len  = 0;
+
+    batch.num_iov   = 0;
+    batch.num_rings = 0;
+    num_dropped
+        = atomic_load_explicit(&p_log->num_dropped, memory_order_relaxed);
+    if (num_dropped != p_log->num_reported)
+    {
+        notice_len = snprintf(notice,
+                              sizeof(notice),
+                              "log: dropped %zu records\n",
+                              num_dropped - p_log->num_reported);
+        p_log->num_reported                = num_dropped;
+        batch.iov[batch.num_iov].iov_base  = notice;
+        batch.iov[batch.num_iov++].iov_len = (size_t)notice_len;
+    }
+    for (p_ring = atomic_load_explicit(&p_log->p_rings, memory_order_acquire);
+         NULL != p_ring;
+         p_ring = p_ring->p_next)
+    {
+        head = atomic_load_explicit(&p_ring->head, memory_order_relaxed);
+        tail = atomic_load_explicit(&p_ring->tail, memory_order_acquire);
+        if (head == tail)
+        {
+            continue;
+        }
+        // room for two regions of this ring
+        if (RPCHAT_LOG_MAX_IOV - 2 < batch.num_iov)
+        {
+            rpchat_log_flush(p_log, &batch);
+        }
+        offset = head & RPCHAT_LOG_RING_MASK;
+        len    = tail - head;
+        // region up to the end of storage, then the wrapped remainder
+        batch.iov[batch.num_iov].iov_base = p_ring->buf + offset;
+        batch.iov[batch.num_iov].iov_len
+            = len < RPCHAT_LOG_RING_SIZE - offset
+                  ? len
+                  : RPCHAT_LOG_RING_SIZE - offset;
+        len -= batch.iov[batch.num_iov++].iov_len;
+        if (0 < len)
+        {
+            batch.iov[batch.num_iov].iov_base  = p_ring->buf;
+            batch.iov[batch.num_iov++].iov_len = len;
+        }
+        batch.p_rings[batch.num_rings] = p_ring;
+        batch.tails[batch.num_rings++] = tail;
+    }
+    rpchat_log_flush(p_log, &batch);
+}
+
+/**
+ * Writer thread: drain all rings every flush interval, or sooner when a ring
+ * fills past half, until told to stop
+ * @param p_arg Pointer to logger
+ * @return NULL
+ */
+static void *
+rpchat_log_run(void *p_arg)
+{
+    rpchat_log_t   *p_log       = p_arg;
+    struct timespec deadline;
+    bool            b_terminate = false;
+
+    while (!b_terminate)
+    {
+        pthread_mutex_lock(&p_log->mutex);
+        if (!atomic_load(&p_log->b_terminate))
+        {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += RPCHAT_LOG_FLUSH_MS * 1000000L;
+            if (1000000000L <= deadline.tv_nsec)
+            {
+                deadline.tv_sec += 1;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(
+                &p_log->cond_writer, &p_log->mutex, &deadline);
+        }
+        b_terminate = atomic_load(&p_log->b_terminate);
+        pthread_mutex_unlock(&p_log->mutex);
+        // after the stop request, this pass is the final one
+        rpchat_log_drain(p_log);
+    }
+    return NULL;
+}
+
+int
+rpchat_log_start(int h_fd_log, rpchat_log_level_t level)
+{
+    int           res   = RPLIB_ERROR;
+    rpchat_log_t *p_log = &rpchat_logger;
+    sigset_t      sigset_all;
+    sigset_t      sigset_prev;
+
+    if (0 <= atomic_load(&p_log->level))
+    {
+        goto leave;
+    }
+    p_log->h_fd_log     = h_fd_log;
+    p_log->num_reported = 0;
+    atomic_store(&p_log->num_dropped, 0);
+    atomic_store(&p_log->b_terminate, false);
+
+    // writer never handles signals, whatever the caller blocks later
+    sigfillset(&sigset_all);
+    pthread_sigmask(SIG_SETMASK, &sigset_all, &sigset_prev);
+    if (0 != pthread_create(&p_log->thread, NULL, rpchat_log_run, p_log))
+    {
+        perror("pthread_create");
+        pthread_sigmask(SIG_SETMASK, &sigset_prev, NULL);
+        goto leave;
+    }
+    pthread_sigmask(SIG_SETMASK, &sigset_prev, NULL);
+
+    atomic_store(&p_log->level, (int)level);
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+size_t
+rpchat_log_stop(void)
+{
+    rpchat_log_t      *p_log  = &rpchat_logger;
+    rpchat_log_ring_t *p_ring = NULL;
+
+    if (0 > atomic_load(&p_log->level))
+    {
+        return 0;
+    }
+    atomic_store(&p_log->level, -1);
+    pthread_mutex_lock(&p_log->mutex);
+    atomic_store(&p_log->b_terminate, true);
+    pthread_cond_signal(&p_log->cond_writer);
+    pthread_mutex_unlock(&p_log->mutex);
+    pthread_join(p_log->thread, NULL);
+
+    while (NULL != (p_ring = atomic_load(&p_log->p_rings)))
+    {
+        atomic_store(&p_log->p_rings, p_ring->p_next);
+        free(p_ring);
+    }
+    p_rpchat_log_ring = NULL;
+    return atomic_load(&p_log->num_dropped);
+}
+
+bool
+rpchat_log_enabled(rpchat_log_level_t level)
+{
+    return (int)level
+           <= atomic_load_explicit(&rpchat_logger.level, memory_order_relaxed);
+}
+
+int
+rpchat_log_write(rpchat_log_level_t level, const char *p_format, ...)
+{
+    int                res    = RPLIB_UNSUCCESS;
+    rpchat_log_t      *p_log  = &rpchat_logger;
+    rpchat_log_ring_t *p_ring = NULL;
+    char               record[RPCHAT_LOG_RECORD_MAX];
+    struct timespec    now;
+    va_list            args;
+    int                prefix_len = 0;
+    int                body_len   = 0;
+    size_t             len        = 0;
+    size_t             head       = 0;
+    size_t             tail       = 0;
+    size_t             offset     = 0;
+    size_t             first_len  = 0; // bytes before storage wraps
+
+    if (!rpchat_log_enabled(level))
+    {
+        goto leave;
+    }
+    p_ring = rpchat_log_get_ring(p_log);
+    if (NULL == p_ring)
+    {
+        atomic_fetch_add_explicit(&p_log->num_dropped, 1, memory_order_relaxed);
+        goto leave;
+    }
+
+    // timestamp and level, then the caller's text
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    prefix_len = snprintf(record,
+                          sizeof(record),
+                          "%lld.%03ld %s ",
+                          (long long)now.tv_sec,
+                          now.tv_nsec / 1000000L,
+                          rpchat_log_level_name(level));
+    va_start(args, p_format);
+    body_len = vsnprintf(record + prefix_len,
+                         sizeof(record) - (size_t)prefix_len,
+                         p_format,
+                         args);
+    va_end(args);
+    if (0 > body_len)
+    {
+        goto leave;
+    }
+    // truncated records keep their newline
+    len = (size_t)prefix_len + (size_t)body_len;
+    len = len < sizeof(record) - 1 ? len : sizeof(record) - 1;
+    record[len++] = '\n';
+
+    // only this thread moves tail; writer only moves head forward
+    tail = atomic_load_explicit(&p_ring->tail, memory_order_relaxed);
+    head = atomic_load_explicit(&p_ring->head, memory_order_acquire);
+    if (RPCHAT_LOG_RING_SIZE - (tail - head) < len)
+    {
+        atomic_fetch_add_explicit(&p_log->num_dropped, 1, memory_order_relaxed);
+        goto leave;
+    }
+    offset    = tail & RPCHAT_LOG_RING_MASK;
+    first_len = len < RPCHAT_LOG_RING_SIZE - offset
+                    ? len
+                    : RPCHAT_LOG_RING_SIZE - offset;
+    memcpy(p_ring->buf + offset, record, first_len);
+    memcpy(p_ring->buf, record + first_len, len - first_len);
+    atomic_store_explicit(&p_ring->tail, tail + len, memory_order_release);
+
+    // filling up faster than the interval drains, wake the writer now
+    if (RPCHAT_LOG_RING_SIZE / 2 < tail + len - head)
+    {
+        pthread_cond_signal(&p_log->cond_writer);
+    }
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+const char *
+rpchat_log_level_name(rpchat_log_level_t level)
+{
+    return RPCHAT_LOG_NUM_LEVELS > level ? rpchat_log_level_table[level] : "";
+}
+
+/*** end of file ***/
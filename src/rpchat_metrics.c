@@ -0,0 +1,780 @@
+/** @file rpchat_metrics.c
+ *
+ * @brief Implements the metrics declared in `rpchat_metrics.h`. Every thread
+ * owns a shard only it writes, with plain loads and stores; the admin thread
+ * reads shards while they change, so a scrape may see a sample in a bucket
+ * before its sum. A thread's shard is allocated on its first record and
+ * pushed onto a list the admin thread sums on each connection to the
+ * loopback-only admin port; shards are freed only when metrics stop
+ *
+ * @par
+ * COPYRIGHT NOTICE: None
+ */
+
+#define _GNU_SOURCE // accept4
+
+#include "rpchat_metrics.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rpchat_log.h"
+
+#define RPCHAT_METRICS_SUB_MASK ((1U << RPCHAT_METRICS_SUB_SHIFT) - 1)
+
+/**
+ * Latencies of one histogram, counted per bucket
+ */
+typedef struct
+{
+    atomic_uint_fast64_t buckets[RPCHAT_METRICS_NUM_BUCKETS]; // # per bucket
+    atomic_uint_fast64_t sum_ns; // total of every latency recorded
+} rpchat_metrics_hist_t;
+
+/**
+ * Counters and histograms of a single thread, written by that thread, read
+ * by the admin thread
+ */
+typedef struct rpchat_metrics_shard
+{
+    atomic_uint_fast64_t  counters[RPCHAT_METRIC_NUM_COUNTERS];
+    rpchat_metrics_hist_t hists[RPCHAT_METRIC_NUM_HISTOGRAMS];
+    struct rpchat_metrics_shard *p_next; // next registered shard
+} rpchat_metrics_shard_t;
+
+typedef struct
+{
+    atomic_bool                      b_enabled;     // recording samples
+    atomic_bool                      b_terminate;   // admin thread to stop
+    int                              h_fd_listen;   // admin socket
+    _Atomic(rpchat_metrics_shard_t *) p_shards;     // every registered shard
+    pthread_mutex_t                  mutex;         // shard registration
+    pthread_mutex_t                  mutex_sources; // gauge sources below
+    rplib_tpool_t                   *p_tpool;       // threadpool, or NULL
+    rpchat_conn_queue_t            **pp_queues;     // queue of every reactor
+    size_t                           num_queues;    // # entries in pp_queues
+    rpchat_file_cache_t             *p_file_cache;  // file cache, or NULL
+    rplib_pool_t                    *p_pool;        // allocator, or NULL
+    pthread_t                        thread;        // admin thread
+} rpchat_metrics_t;
+
+/**
+ * How a metric is exported
+ */
+typedef struct
+{
+    const char *p_name; // metric name, without suffixes
+    const char *p_help; // HELP text
+} rpchat_metrics_desc_t;
+
+static rpchat_metrics_t rpchat_metrics = {
+    .h_fd_listen   = RPLIB_ERROR,
+    .mutex         = PTHREAD_MUTEX_INITIALIZER,
+    .mutex_sources = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static _Thread_local rpchat_metrics_shard_t *p_rpchat_metrics_shard = NULL;
+
+static const rpchat_metrics_desc_t rpchat_metrics_counter_table[] = {
+    // RPCHAT_METRIC_TASKS
+    { "rpchat_tasks_total", "Connection tasks run." },
+    // RPCHAT_METRIC_REQUEUES
+    { "rpchat_task_requeues_total",
+      "Tasks that waited for another task holding their connection." },
+    // RPCHAT_METRIC_PARKED
+    { "rpchat_events_parked_total",
+      "Events parked until their connection changed state." },
+    // RPCHAT_METRIC_FRAMES
+    { "rpchat_frames_parsed_total", "Complete frames parsed from clients." },
+    // RPCHAT_METRIC_BROADCASTS
+    { "rpchat_broadcasts_total", "Messages fanned out to every client." },
+    // RPCHAT_METRIC_DELIVERIES
+    { "rpchat_deliveries_enqueued_total",
+      "Deliveries enqueued with recipients." },
+    // RPCHAT_METRIC_COALESCED
+    { "rpchat_deliveries_coalesced_total",
+      "Deliveries written together with an earlier one." },
+};
+
+static const rpchat_metrics_desc_t rpchat_metrics_hist_table[] = {
+    // RPCHAT_METRIC_RECV_PARSE
+    { "rpchat_recv_parse_seconds",
+      "Time from bytes being buffered to their frame being parsed." },
+    // RPCHAT_METRIC_SEND_FAN_OUT
+    { "rpchat_send_fan_out_seconds",
+      "Time from a SEND (or server notice) being broadcast to its last "
+      "DELIVER being enqueued, on whichever reactor finished last." },
+    // RPCHAT_METRIC_DELIVER_ACK
+    { "rpchat_deliver_ack_seconds",
+      "Time from a DELIVER being written to its STATUS or ACK, sampled one "
+      "DELIVER per connection at a time." },
+    // RPCHAT_METRIC_TASK_WAIT
+    { "rpchat_task_wait_seconds",
+      "Time from a task being enqueued to it starting on a worker." },
+};
+
+/**
+ * Get the shard of the calling thread, registering one on first use
+ * @param p_metrics Pointer to metrics
+ * @return Pointer to shard; NULL if it could not be allocated
+ */
+static rpchat_metrics_shard_t *
+rpchat_metrics_get_shard(rpchat_metrics_t *p_metrics)
+{
+    rpchat_metrics_shard_t *p_shard = p_rpchat_metrics_shard;
+
+    if (NULL != p_shard)
+    {
+        return p_shard;
+    }
+    p_shard = calloc(1, sizeof(rpchat_metrics_shard_t));
+    if (NULL == p_shard)
+    {
+        return NULL;
+    }
+    // push front; admin thread walks the list without the lock
+    pthread_mutex_lock(&p_metrics->mutex);
+    p_shard->p_next = atomic_load_explicit(&p_metrics->p_shards,
+                                           memory_order_relaxed);
+    atomic_store_explicit(&p_metrics->p_shards, p_shard, memory_order_release);
+    pthread_mutex_unlock(&p_metrics->mutex);
+    p_rpchat_metrics_shard = p_shard;
+    return p_shard;
+}
+
+/**
+ * Add to a value of the calling thread's shard. Only the owner writes, so no
+ * read-modify-write instruction is needed
+ * @param p_value Pointer to value
+ * @param amount Amount to add
+ */
+static inline void
+rpchat_metrics_add(atomic_uint_fast64_t *p_value, uint64_t amount)
+{
+    atomic_store_explicit(
+        p_value,
+        atomic_load_explicit(p_value, memory_order_relaxed) + amount,
+        memory_order_relaxed);
+}
+
+/**
+ * Find the bucket a latency falls in: one below 2^MIN_SHIFT ns, then
+ * 2^SUB_SHIFT linear steps within each power of two, then one for the rest
+ * @param latency_ns Latency in nanoseconds
+ * @return Bucket index
+ */
+static size_t
+rpchat_metrics_bucket(uint64_t latency_ns)
+{
+    unsigned int shift = 0; // position of highest bit set
+
+    if ((UINT64_C(1) << RPCHAT_METRICS_MIN_SHIFT) > latency_ns)
+    {
+        return 0;
+    }
+    if ((UINT64_C(1) << RPCHAT_METRICS_MAX_SHIFT) <= latency_ns)
+    {
+        return RPCHAT_METRICS_NUM_BUCKETS - 1;
+    }
+    shift = 63 - (unsigned int)__builtin_clzll(latency_ns);
+    return 1
+           + ((size_t)(shift - RPCHAT_METRICS_MIN_SHIFT)
+              << RPCHAT_METRICS_SUB_SHIFT)
+           + ((latency_ns >> (shift - RPCHAT_METRICS_SUB_SHIFT))
+              & RPCHAT_METRICS_SUB_MASK);
+}
+
+/**
+ * Get the upper bound of a bucket, exclusive
+ * @param bucket Bucket index, below RPCHAT_METRICS_NUM_BUCKETS - 1
+ * @return Bound in nanoseconds
+ */
+static uint64_t
+rpchat_metrics_bucket_bound(size_t bucket)
+{
+    unsigned int shift = 0; // power of two the bucket lies in
+
+    if (0 == bucket)
+    {
+        return UINT64_C(1) << RPCHAT_METRICS_MIN_SHIFT;
+    }
+    shift = RPCHAT_METRICS_MIN_SHIFT
+            + (unsigned int)((bucket - 1) >> RPCHAT_METRICS_SUB_SHIFT);
+    return (UINT64_C(1) << shift)
+           + ((((bucket - 1) & RPCHAT_METRICS_SUB_MASK) + 1)
+              << (shift - RPCHAT_METRICS_SUB_SHIFT));
+}
+
+/**
+ * Write the hit and miss counters of the attached file cache and allocator
+ * \nNote: Caller holds mutex_sources
+ * @param p_metrics Pointer to metrics
+ * @param p_out Stream to write to
+ */
+static void
+rpchat_metrics_write_caches(rpchat_metrics_t *p_metrics, FILE *p_out)
+{
+    rpchat_file_cache_stats_t cache_stats;
+    rplib_pool_stats_t        pool_stats;
+
+    if (NULL != p_metrics->p_file_cache)
+    {
+        rpchat_file_cache_get_stats(p_metrics->p_file_cache, &cache_stats);
+        fprintf(p_out,
+                "# HELP rpchat_file_cache_hits_total Downloads served from a "
+                "mapping.\n"
+                "# TYPE rpchat_file_cache_hits_total counter\n"
+                "rpchat_file_cache_hits_total %zu\n"
+                "# HELP rpchat_file_cache_misses_total Downloads that had to "
+                "open the file.\n"
+                "# TYPE rpchat_file_cache_misses_total counter\n"
+                "rpchat_file_cache_misses_total %zu\n"
+                "# HELP rpchat_file_cache_files Files currently mapped.\n"
+                "# TYPE rpchat_file_cache_files gauge\n"
+                "rpchat_file_cache_files %zu\n"
+                "# HELP rpchat_file_cache_mapped_bytes Bytes of mapped "
+                "files.\n"
+                "# TYPE rpchat_file_cache_mapped_bytes gauge\n"
+                "rpchat_file_cache_mapped_bytes %zu\n",
+                cache_stats.hits,
+                cache_stats.misses,
+                cache_stats.num_entries,
+                cache_stats.sz_mapped);
+    }
+    if (NULL != p_metrics->p_pool)
+    {
+        rplib_pool_get_stats(p_metrics->p_pool, &pool_stats);
+        fprintf(p_out,
+                "# HELP rpchat_pool_cache_hits_total Allocations served from "
+                "the calling thread's cache.\n"
+                "# TYPE rpchat_pool_cache_hits_total counter\n"
+                "rpchat_pool_cache_hits_total %lu\n"
+                "# HELP rpchat_pool_hits_total Allocations served by "
+                "refilling from the shared lists.\n"
+                "# TYPE rpchat_pool_hits_total counter\n"
+                "rpchat_pool_hits_total %lu\n"
+                "# HELP rpchat_pool_misses_total Allocations that fell "
+                "through to malloc.\n"
+                "# TYPE rpchat_pool_misses_total counter\n"
+                "rpchat_pool_misses_total %lu\n",
+                pool_stats.cache_hits,
+                pool_stats.pool_hits,
+                pool_stats.misses);
+    }
+}
+
+/**
+ * Write the gauges of the attached threadpool and connection queues
+ * \nNote: Caller holds mutex_sources
+ * @param p_metrics Pointer to metrics
+ * @param p_out Stream to write to
+ */
+static void
+rpchat_metrics_write_gauges(rpchat_metrics_t *p_metrics, FILE *p_out)
+{
+    rpchat_conn_queue_t    *p_conn_queue = NULL;
+    rpchat_conn_snapshot_t *p_snapshot   = NULL; // connections of a queue
+    size_t                  index        = 0;
+    size_t                  conn_index   = 0;
+    size_t                  num_conns    = 0;
+    int                     pending      = 0;
+    long                    pending_sum  = 0;
+    int                     pending_max  = 0;
+
+    if (NULL != p_metrics->p_tpool)
+    {
+        fprintf(p_out,
+                "# HELP rpchat_tpool_threads Worker threads in the pool.\n"
+                "# TYPE rpchat_tpool_threads gauge\n"
+                "rpchat_tpool_threads %zu\n"
+                "# HELP rpchat_tpool_threads_min Workers kept while idle.\n"
+                "# TYPE rpchat_tpool_threads_min gauge\n"
+                "rpchat_tpool_threads_min %zu\n"
+                "# HELP rpchat_tpool_threads_max Most workers the pool may "
+                "run.\n"
+                "# TYPE rpchat_tpool_threads_max gauge\n"
+                "rpchat_tpool_threads_max %zu\n"
+                "# HELP rpchat_tpool_grown_total Workers added as tasks "
+                "backed up.\n"
+                "# TYPE rpchat_tpool_grown_total counter\n"
+                "rpchat_tpool_grown_total %zu\n"
+                "# HELP rpchat_tpool_shrunk_total Workers parked after "
+                "idling.\n"
+                "# TYPE rpchat_tpool_shrunk_total counter\n"
+                "rpchat_tpool_shrunk_total %zu\n"
+                "# HELP rpchat_tpool_threads_busy Workers running a task.\n"
+                "# TYPE rpchat_tpool_threads_busy gauge\n"
+                "rpchat_tpool_threads_busy %zu\n"
+                "# HELP rpchat_tpool_tasks_pending Tasks queued, not yet "
+                "started.\n"
+                "# TYPE rpchat_tpool_tasks_pending gauge\n"
+                "rpchat_tpool_tasks_pending %zu\n",
+                rplib_tpool_get_num_threads(p_metrics->p_tpool),
+                p_metrics->p_tpool->min_threads,
+                p_metrics->p_tpool->num_threads,
+                atomic_load(&p_metrics->p_tpool->num_grown),
+                atomic_load(&p_metrics->p_tpool->num_shrunk),
+                atomic_load(&p_metrics->p_tpool->num_threads_busy),
+                atomic_load(&p_metrics->p_tpool->num_tasks_pending));
+    }
+    if (0 == p_metrics->num_queues)
+    {
+        return;
+    }
+    // budgets are shared by every queue
+    if (NULL != p_metrics->pp_queues[0]->p_backlog)
+    {
+        fprintf(p_out,
+                "# HELP rpchat_outbound_queued_bytes Bytes of deliveries "
+                "queued, not yet written.\n"
+                "# TYPE rpchat_outbound_queued_bytes gauge\n"
+                "rpchat_outbound_queued_bytes %zu\n",
+                atomic_load(&p_metrics->pp_queues[0]->p_backlog->sz_queued));
+    }
+    fprintf(p_out,
+            "# HELP rpchat_connections Connections of each reactor.\n"
+            "# TYPE rpchat_connections gauge\n"
+            "# HELP rpchat_pending_jobs Tasks queued for the connections of "
+            "each reactor.\n"
+            "# TYPE rpchat_pending_jobs gauge\n"
+            "# HELP rpchat_pending_jobs_max Most tasks queued for a single "
+            "connection of each reactor.\n"
+            "# TYPE rpchat_pending_jobs_max gauge\n");
+    for (index = 0; index < p_metrics->num_queues; index++)
+    {
+        p_conn_queue = p_metrics->pp_queues[index];
+        pending_sum  = 0;
+        pending_max  = 0;
+        // a scrape never holds up the reactor's accepts and closes
+        p_snapshot   = rpchat_conn_queue_acquire_snapshot(p_conn_queue);
+        num_conns    = p_snapshot->num_conns;
+        for (conn_index = 0; conn_index < p_snapshot->num_conns; conn_index++)
+        {
+            pending = atomic_load_explicit(
+                &p_snapshot->p_conns[conn_index]->pending_jobs,
+                memory_order_relaxed);
+            pending_sum += pending;
+            pending_max = pending > pending_max ? pending : pending_max;
+        }
+        rpchat_conn_queue_release_snapshot(p_conn_queue, p_snapshot);
+        fprintf(p_out,
+                "rpchat_connections{reactor=\"%zu\"} %zu\n"
+                "rpchat_pending_jobs{reactor=\"%zu\"} %ld\n"
+                "rpchat_pending_jobs_max{reactor=\"%zu\"} %d\n",
+                index,
+                num_conns,
+                index,
+                pending_sum,
+                index,
+                pending_max);
+    }
+}
+
+/**
+ * Write every metric, summed over all shards
+ * @param p_metrics Pointer to metrics
+ * @param p_out Stream to write to
+ */
+static void
+rpchat_metrics_write_all(rpchat_metrics_t *p_metrics, FILE *p_out)
+{
+    rpchat_metrics_shard_t *p_first = NULL;
+    rpchat_metrics_shard_t *p_shard = NULL;
+    uint64_t                total   = 0;
+    uint64_t                sum_ns  = 0;
+    size_t                  index   = 0;
+    size_t                  bucket  = 0;
+
+    p_first = atomic_load_explicit(&p_metrics->p_shards, memory_order_acquire);
+    for (index = 0; index < RPCHAT_METRIC_NUM_COUNTERS; index++)
+    {
+        total = 0;
+        for (p_shard = p_first; NULL != p_shard; p_shard = p_shard->p_next)
+        {
+            total += atomic_load_explicit(&p_shard->counters[index],
+                                          memory_order_relaxed);
+        }
+        fprintf(p_out,
+                "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+                rpchat_metrics_counter_table[index].p_name,
+                rpchat_metrics_counter_table[index].p_help,
+                rpchat_metrics_counter_table[index].p_name,
+                rpchat_metrics_counter_table[index].p_name,
+                (unsigned long long)total);
+    }
+    for (index = 0; index < RPCHAT_METRIC_NUM_HISTOGRAMS; index++)
+    {
+        fprintf(p_out,
+                "# HELP %s %s\n# TYPE %s histogram\n",
+                rpchat_metrics_hist_table[index].p_name,
+                rpchat_metrics_hist_table[index].p_help,
+                rpchat_metrics_hist_table[index].p_name);
+        // buckets are cumulative; the count is the last of them, so a scrape
+        // always agrees with itself
+        total  = 0;
+        sum_ns = 0;
+        for (bucket = 0; bucket < RPCHAT_METRICS_NUM_BUCKETS; bucket++)
+        {
+            for (p_shard = p_first; NULL != p_shard; p_shard = p_shard->p_next)
+            {
+                total += atomic_load_explicit(
+                    &p_shard->hists[index].buckets[bucket],
+                    memory_order_relaxed);
+            }
+            if (RPCHAT_METRICS_NUM_BUCKETS - 1 == bucket)
+            {
+                fprintf(p_out,
+                        "%s_bucket{le=\"+Inf\"} %llu\n",
+                        rpchat_metrics_hist_table[index].p_name,
+                        (unsigned long long)total);
+                break;
+            }
+            fprintf(p_out,
+                    "%s_bucket{le=\"%.9g\"} %llu\n",
+                    rpchat_metrics_hist_table[index].p_name,
+                    (double)rpchat_metrics_bucket_bound(bucket) / 1e9,
+                    (unsigned long long)total);
+        }
+        for (p_shard = p_first; NULL != p_shard; p_shard = p_shard->p_next)
+        {
+            sum_ns += atomic_load_explicit(&p_shard->hists[index].sum_ns,
+                                           memory_order_relaxed);
+        }
+        fprintf(p_out,
+                "%s_sum %.9f\n%s_count %llu\n",
+                rpchat_metrics_hist_table[index].p_name,
+                (double)sum_ns / 1e9,
+                rpchat_metrics_hist_table[index].p_name,
+                (unsigned long long)total);
+    }
+    pthread_mutex_lock(&p_metrics->mutex_sources);
+    rpchat_metrics_write_gauges(p_metrics, p_out);
+    rpchat_metrics_write_caches(p_metrics, p_out);
+    pthread_mutex_unlock(&p_metrics->mutex_sources);
+}
+
+/**
+ * Write a buffer to a socket in full
+ * @param h_fd_client Socket to write to
+ * @param p_buf Pointer to bytes to write
+ * @param sz_buf Number of bytes to write
+ * @return RPLIB_SUCCESS if all written, RPLIB_ERROR otherwise
+ */
+static int
+rpchat_metrics_send_all(int h_fd_client, const char *p_buf, size_t sz_buf)
+{
+    ssize_t sent = 0;
+
+    while (0 < sz_buf)
+    {
+        sent = send(h_fd_client, p_buf, sz_buf, MSG_NOSIGNAL);
+        if (0 > sent)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            return RPLIB_ERROR;
+        }
+        p_buf += sent;
+        sz_buf -= (size_t)sent;
+    }
+    return RPLIB_SUCCESS;
+}
+
+/**
+ * Answer one scrape. Whatever was asked for, the reply is every metric, so
+ * any HTTP client (or plain `nc`) can read them
+ * @param p_metrics Pointer to metrics
+ * @param h_fd_client Accepted admin connection
+ */
+static void
+rpchat_metrics_serve(rpchat_metrics_t *p_metrics, int h_fd_client)
+{
+    char           request[RPCHAT_METRICS_REQUEST_MAX];
+    char           header[128];
+    struct timeval timeout    = { .tv_sec = RPCHAT_METRICS_IO_TIMEOUT };
+    FILE          *p_out      = NULL;
+    char          *p_body     = NULL;
+    size_t         sz_body    = 0;
+    int            header_len = 0;
+
+    // a stalled scraper cannot hold up the admin thread for long
+    setsockopt(h_fd_client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(h_fd_client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (0 > recv(h_fd_client, request, sizeof(request), 0))
+    {
+        goto leave;
+    }
+
+    p_out = open_memstream(&p_body, &sz_body);
+    if (NULL == p_out)
+    {
+        goto leave;
+    }
+    rpchat_metrics_write_all(p_metrics, p_out);
+    if (0 != fclose(p_out))
+    {
+        goto leave;
+    }
+    header_len = snprintf(header,
+                          sizeof(header),
+                          "HTTP/1.0 200 OK\r\n"
+                          "Content-Type: text/plain; version=0.0.4\r\n"
+                          "Content-Length: %zu\r\n\r\n",
+                          sz_body);
+    if (RPLIB_SUCCESS
+        == rpchat_metrics_send_all(h_fd_client, header, (size_t)header_len))
+    {
+        rpchat_metrics_send_all(h_fd_client, p_body, sz_body);
+    }
+leave:
+    free(p_body);
+    close(h_fd_client);
+}
+
+/**
+ * Admin thread: answer scrapes one at a time until told to stop
+ * @param p_arg Pointer to metrics
+ * @return NULL
+ */
+static void *
+rpchat_metrics_run(void *p_arg)
+{
+    rpchat_metrics_t *p_metrics   = p_arg;
+    int               h_fd_client = RPLIB_ERROR;
+
+    while (!atomic_load(&p_metrics->b_terminate))
+    {
+        h_fd_client = accept4(p_metrics->h_fd_listen, NULL, NULL, SOCK_CLOEXEC);
+        if (0 > h_fd_client)
+        {
+            if (EINTR == errno || ECONNABORTED == errno)
+            {
+                continue;
+            }
+            // stopping shuts the socket down, anything else is a failure
+            if (!atomic_load(&p_metrics->b_terminate))
+            {
+                rpchat_log_write(RPCHAT_LOG_ERROR,
+                                 "metrics: accept failed: %s",
+                                 strerror(errno));
+            }
+            break;
+        }
+        rpchat_metrics_serve(p_metrics, h_fd_client);
+    }
+    return NULL;
+}
+
+/**
+ * Open the admin socket, reachable from this host only
+ * @param port_num Port to listen on
+ * @return Listening socket on success, RPLIB_ERROR on failure
+ */
+static int
+rpchat_metrics_listen(unsigned int port_num)
+{
+    int                res         = RPLIB_ERROR;
+    int                h_fd_listen = RPLIB_ERROR;
+    struct sockaddr_in addr;
+    int                reuse = 1;
+
+    h_fd_listen = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (0 > h_fd_listen)
+    {
+        perror("metrics socket");
+        goto leave;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = htons(port_num);
+    if (0 > setsockopt(
+            h_fd_listen, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)))
+    {
+        perror("setsockopt");
+        goto leave;
+    }
+    if (0 > bind(h_fd_listen, (struct sockaddr *)&addr, sizeof(addr))
+        || 0 > listen(h_fd_listen, SOMAXCONN))
+    {
+        perror("metrics socket");
+        goto leave;
+    }
+    res         = h_fd_listen;
+    h_fd_listen = RPLIB_ERROR;
+leave:
+    if (0 <= h_fd_listen)
+    {
+        close(h_fd_listen);
+    }
+    return res;
+}
+
+int
+rpchat_metrics_start(unsigned int port_num)
+{
+    int               res       = RPLIB_ERROR;
+    rpchat_metrics_t *p_metrics = &rpchat_metrics;
+    sigset_t          sigset_all;
+    sigset_t          sigset_prev;
+
+    if (0 <= p_metrics->h_fd_listen)
+    {
+        goto leave;
+    }
+    p_metrics->h_fd_listen = rpchat_metrics_listen(port_num);
+    if (0 > p_metrics->h_fd_listen)
+    {
+        goto leave;
+    }
+    atomic_store(&p_metrics->b_terminate, false);
+
+    // admin thread never handles signals, whatever the caller blocks later
+    sigfillset(&sigset_all);
+    pthread_sigmask(SIG_SETMASK, &sigset_all, &sigset_prev);
+    if (0
+        != pthread_create(
+            &p_metrics->thread, NULL, rpchat_metrics_run, p_metrics))
+    {
+        perror("pthread_create");
+        pthread_sigmask(SIG_SETMASK, &sigset_prev, NULL);
+        close(p_metrics->h_fd_listen);
+        p_metrics->h_fd_listen = RPLIB_ERROR;
+        goto leave;
+    }
+    pthread_sigmask(SIG_SETMASK, &sigset_prev, NULL);
+
+    atomic_store(&p_metrics->b_enabled, true);
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+void
+rpchat_metrics_stop(void)
+{
+    rpchat_metrics_t       *p_metrics = &rpchat_metrics;
+    rpchat_metrics_shard_t *p_shard   = NULL;
+
+    if (0 > p_metrics->h_fd_listen)
+    {
+        return;
+    }
+    atomic_store(&p_metrics->b_enabled, false);
+    // wakes the admin thread out of accept
+    atomic_store(&p_metrics->b_terminate, true);
+    shutdown(p_metrics->h_fd_listen, SHUT_RDWR);
+    pthread_join(p_metrics->thread, NULL);
+    close(p_metrics->h_fd_listen);
+    p_metrics->h_fd_listen = RPLIB_ERROR;
+
+    while (NULL != (p_shard = atomic_load(&p_metrics->p_shards)))
+    {
+        atomic_store(&p_metrics->p_shards, p_shard->p_next);
+        free(p_shard);
+    }
+    p_rpchat_metrics_shard = NULL;
+}
+
+void
+rpchat_metrics_attach(rplib_tpool_t        *p_tpool,
+                      rpchat_conn_queue_t **pp_queues,
+                      size_t                num_queues,
+                      rpchat_file_cache_t  *p_file_cache,
+                      rplib_pool_t         *p_pool)
+{
+    rpchat_metrics_t *p_metrics = &rpchat_metrics;
+
+    pthread_mutex_lock(&p_metrics->mutex_sources);
+    p_metrics->p_tpool      = p_tpool;
+    p_metrics->pp_queues    = pp_queues;
+    p_metrics->num_queues   = num_queues;
+    p_metrics->p_file_cache = p_file_cache;
+    p_metrics->p_pool       = p_pool;
+    pthread_mutex_unlock(&p_metrics->mutex_sources);
+}
+
+void
+rpchat_metrics_detach(void)
+{
+    rpchat_metrics_attach(NULL, NULL, 0, NULL, NULL);
+}
+
+bool
+rpchat_metrics_enabled(void)
+{
+    return atomic_load_explicit(&rpchat_metrics.b_enabled,
+                                memory_order_relaxed);
+}
+
+uint64_t
+rpchat_metrics_now(void)
+{
+    struct timespec now;
+
+    if (!rpchat_metrics_enabled())
+    {
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * UINT64_C(1000000000)
+           + (uint64_t)now.tv_nsec;
+}
+
+void
+rpchat_metrics_count(rpchat_metric_counter_t counter, uint64_t amount)
+{
+    rpchat_metrics_shard_t *p_shard = NULL;
+
+    if (!rpchat_metrics_enabled())
+    {
+        return;
+    }
+    p_shard = rpchat_metrics_get_shard(&rpchat_metrics);
+    if (NULL != p_shard)
+    {
+        rpchat_metrics_add(&p_shard->counters[counter], amount);
+    }
+}
+
+void
+rpchat_metrics_record(rpchat_metric_hist_t hist, uint64_t start_ns)
+{
+    rpchat_metrics_shard_t *p_shard    = NULL;
+    uint64_t                now_ns     = 0;
+    uint64_t                latency_ns = 0;
+
+    // stamps taken while disabled are 0
+    if (0 == start_ns)
+    {
+        return;
+    }
+    now_ns = rpchat_metrics_now();
+    if (0 == now_ns)
+    {
+        return;
+    }
+    p_shard = rpchat_metrics_get_shard(&rpchat_metrics);
+    if (NULL == p_shard)
+    {
+        return;
+    }
+    latency_ns = now_ns > start_ns ? now_ns - start_ns : 0;
+    rpchat_metrics_add(
+        &p_shard->hists[hist].buckets[rpchat_metrics_bucket(latency_ns)], 1);
+    rpchat_metrics_add(&p_shard->hists[hist].sum_ns, latency_ns);
+}
+
+/*** end of file ***/
@@ -6,93 +6,284 @@
  * COPYRIGHT NOTICE: None
  */
 
+#define _GNU_SOURCE // accept4
+
 #include "rpchat_networking.h"
 
+#include "rpchat_io_uring.h"
+
+// picked once at startup, before any reactor exists
+static rpchat_io_backend_t rpchat_io_backend = RPCHAT_IO_EPOLL;
+
+rpchat_io_backend_t
+rpchat_select_io_backend(rpchat_io_backend_t requested)
+{
+    // submission polling may be refused where plain rings still work
+    if (RPCHAT_IO_URING_SQPOLL == requested && !rpchat_uring_probe(true))
+    {
+        requested = RPCHAT_IO_URING;
+    }
+    if (RPCHAT_IO_URING == requested && !rpchat_uring_probe(false))
+    {
+        requested = RPCHAT_IO_EPOLL;
+    }
+    rpchat_io_backend = requested;
+    return rpchat_io_backend;
+}
+
+rpchat_io_backend_t
+rpchat_get_io_backend(void)
+{
+    return rpchat_io_backend;
+}
+
+const char *
+rpchat_io_backend_name(rpchat_io_backend_t backend)
+{
+    switch (backend)
+    {
+        case RPCHAT_IO_URING:
+            return "uring";
+        case RPCHAT_IO_URING_SQPOLL:
+            return "sqpoll";
+        default:
+            return "epoll";
+    }
+}
+
+/**
+ * Helper function to create the epoll instance or io_uring ring a reactor
+ * waits on
+ * @return File descriptor on success, RPLIB_ERROR on failure
+ */
+static int
+rpchat_create_poller(void)
+{
+    int h_fd_poller = RPLIB_ERROR;
+
+    if (RPCHAT_IO_EPOLL != rpchat_io_backend)
+    {
+        return rpchat_uring_create(RPCHAT_IO_URING_SQPOLL == rpchat_io_backend);
+    }
+    // create epoll fd (create1 automatically resizes..)
+    h_fd_poller = epoll_create1(0);
+    if (0 > h_fd_poller)
+    {
+        // failure
+        perror("epoll");
+    }
+    return h_fd_poller;
+}
+
+/**
+ * Helper function to close what `rpchat_create_poller` created
+ * @param h_fd_epoll Epoll instance or ring file descriptor
+ */
+static void
+rpchat_close_poller(int h_fd_epoll)
+{
+    if (RPCHAT_IO_EPOLL != rpchat_io_backend)
+    {
+        rpchat_uring_destroy(h_fd_epoll);
+        return;
+    }
+    close(h_fd_epoll);
+}
+
 int
 rpchat_begin_networking(unsigned int port_num,
+                        int          h_fd_inherited,
                         int         *p_h_fd_server,
                         int         *p_h_fd_epoll,
                         int         *p_h_fd_signal)
 {
-    int res           = RPLIB_ERROR;  // default failure in case of early term
-    int h_fd_epoll    = -1;           // fd that describes epoll
-    int h_sock_server = -1;           // fd for server socket
-    struct epoll_event event_server;  // event used for server socket
-    struct itimerval   timeout_timer; // timer used for connection timeout
-    sigset_t           sigset;        // sigset to listen for on fd_signal
+    int      res = RPLIB_ERROR; // default failure in case early term
+    sigset_t sigset;            // sigset to listen for on fd_signal
 
     // create sigset to assign to sigmask
     res = sigemptyset(&sigset);
     assert(res == 0);
     res = sigaddset(&sigset, SIGINT);
     assert(res == 0);
-    res = sigaddset(&sigset, SIGALRM);
-    assert(res == 0);
 
     // set sigmask to receive desired signals
     res = sigprocmask(SIG_BLOCK, &sigset, NULL);
     assert(res == 0);
+    // sendfile has no MSG_NOSIGNAL; a client gone mid-download is an error
+    signal(SIGPIPE, SIG_IGN);
 
     // create signalfd with given sigmask
     *p_h_fd_signal = signalfd(-1, &sigset, 0);
     assert(*p_h_fd_signal != -1);
 
-    // create epoll fd (create1 automatically resizes..)
-    h_fd_epoll = epoll_create1(0);
-    if (0 > h_fd_epoll)
+    // create server socket and epoll instance
+    res = rpchat_begin_listener(
+        port_num, h_fd_inherited, p_h_fd_server, p_h_fd_epoll);
+    if (RPLIB_SUCCESS != res)
     {
-        // failure
-        perror("epoll");
         goto leave;
     }
 
-    // create server socket
-    h_sock_server = rpchat_setup_server_socket(port_num);
-    if (0 > h_sock_server)
+    // tell epoll to watch signal socket
+    res = rpchat_watch_descriptor(*p_h_fd_epoll, *p_h_fd_signal);
+    if (RPLIB_SUCCESS != res)
     {
-        // failure
+        perror("signal socket");
         goto leave;
     }
 
-    // tell epoll to watch server socket
-    event_server.events  = EPOLLIN;
-    event_server.data.fd = h_sock_server; // fd stands in place of pointer here
-    if (0 > epoll_ctl(h_fd_epoll, EPOLL_CTL_ADD, h_sock_server, &event_server))
+leave:
+    return res;
+}
+
+int
+rpchat_begin_listener(unsigned int port_num,
+                      int          h_fd_inherited,
+                      int         *p_h_fd_server,
+                      int         *p_h_fd_epoll)
+{
+    int res           = RPLIB_ERROR; // default failure in case of early term
+    int h_fd_epoll    = -1;          // fd that describes epoll
+    int h_sock_server = -1;          // fd for server socket
+
+    h_fd_epoll = rpchat_create_poller();
+    if (0 > h_fd_epoll)
     {
-        perror("server socket");
+        if (0 <= h_fd_inherited)
+        {
+            close(h_fd_inherited);
+        }
         goto leave;
     }
 
-    // tell epoll to watch signal socket
-    event_server.events  = EPOLLIN;
-    event_server.data.fd = *p_h_fd_signal; // fd stands in place of pointer here
-    if (0 > epoll_ctl(h_fd_epoll, EPOLL_CTL_ADD, *p_h_fd_signal, &event_server))
+    // create server socket (SO_REUSEPORT lets every reactor bind the port);
+    // one inherited keeps the clients its backlog already holds
+    h_sock_server = 0 <= h_fd_inherited ? h_fd_inherited
+                                        : rpchat_setup_server_socket(port_num);
+    if (0 > h_sock_server)
+    {
+        // failure
+        goto cleanup;
+    }
+
+    // tell epoll to watch server socket
+    if (RPLIB_SUCCESS != rpchat_watch_descriptor(h_fd_epoll, h_sock_server))
     {
         perror("server socket");
-        goto leave;
+        close(h_sock_server);
+        goto cleanup;
     }
 
     // set server and epoll FDs
     *p_h_fd_server = h_sock_server;
     *p_h_fd_epoll  = h_fd_epoll;
+    res            = RPLIB_SUCCESS;
+    goto leave;
+cleanup:
+    rpchat_close_poller(h_fd_epoll);
+leave:
+    return res;
+}
 
-    // start timer
-    timeout_timer.it_interval.tv_sec  = RPCHAT_CLIENT_AUDIT_INTERVAL;
-    timeout_timer.it_interval.tv_usec = 0;
-    timeout_timer.it_value            = timeout_timer.it_interval;
-    // raises SIGALRM every RPCHAT_CLIENT_AUDIT_INTERVAL seconds
-    res = setitimer(ITIMER_REAL, &timeout_timer, NULL);
+int
+rpchat_watch_descriptor(int h_fd_epoll, int h_fd)
+{
+    int                res = RPLIB_ERROR;
+    struct epoll_event event_watch; // level triggered, read only
 
-leave:
+    if (RPCHAT_IO_EPOLL != rpchat_io_backend)
+    {
+        return rpchat_uring_watch(h_fd_epoll, h_fd);
+    }
+    event_watch.events  = EPOLLIN;
+    event_watch.data.fd = h_fd; // fd stands in place of pointer here
+    if (0 == epoll_ctl(h_fd_epoll, EPOLL_CTL_ADD, h_fd, &event_watch))
+    {
+        res = RPLIB_SUCCESS;
+    }
     return res;
 }
 
 void
-rpchat_stop_networking(int h_fd_epoll, int h_fd_server, int h_fd_signal)
+rpchat_unwatch_descriptor(int h_fd_epoll, int h_fd)
+{
+    if (RPCHAT_IO_EPOLL != rpchat_io_backend)
+    {
+        rpchat_uring_unwatch(h_fd_epoll, h_fd);
+        return;
+    }
+    epoll_ctl(h_fd_epoll, EPOLL_CTL_DEL, h_fd, NULL);
+}
+
+int
+rpchat_register_descriptor(int          h_fd_epoll,
+                           int          h_fd,
+                           void        *p_data_ptr,
+                           uint32_t     events,
+                           atomic_bool *p_b_pending)
+{
+    struct epoll_event new_event;
+
+    if (RPCHAT_IO_EPOLL != rpchat_io_backend)
+    {
+        return rpchat_uring_arm(
+            h_fd_epoll, h_fd, p_data_ptr, events, p_b_pending);
+    }
+    new_event.events   = events;
+    new_event.data.ptr = p_data_ptr;
+    return 0 > epoll_ctl(h_fd_epoll, EPOLL_CTL_ADD, h_fd, &new_event)
+               ? RPLIB_UNSUCCESS
+               : RPLIB_SUCCESS;
+}
+
+void
+rpchat_disarm_descriptor(int          h_fd_epoll,
+                         void        *p_data_ptr,
+                         atomic_bool *p_b_pending)
+{
+    if (RPCHAT_IO_EPOLL != rpchat_io_backend)
+    {
+        rpchat_uring_disarm(h_fd_epoll, p_data_ptr, p_b_pending);
+    }
+}
+
+int
+rpchat_begin_timer(int h_fd_epoll, unsigned int interval_sec)
+{
+    int               h_fd_timer = -1; // fd that describes timer
+    struct itimerspec period;          // fires every interval_sec
+
+    // monotonic, so clock changes don't bunch up or stall checks
+    h_fd_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (0 > h_fd_timer)
+    {
+        perror("timerfd");
+        goto leave;
+    }
+    period.it_interval.tv_sec  = interval_sec;
+    period.it_interval.tv_nsec = 0;
+    period.it_value            = period.it_interval;
+    if (0 > timerfd_settime(h_fd_timer, 0, &period, NULL)
+        || RPLIB_SUCCESS != rpchat_watch_descriptor(h_fd_epoll, h_fd_timer))
+    {
+        perror("timer");
+        close(h_fd_timer);
+        h_fd_timer = RPLIB_ERROR;
+    }
+leave:
+    return h_fd_timer;
+}
+
+void
+rpchat_stop_networking(int h_fd_epoll,
+                       int h_fd_server,
+                       int h_fd_signal,
+                       int h_fd_timer)
 {
     close(h_fd_server);
     close(h_fd_signal);
-    close(h_fd_epoll);
+    close(h_fd_timer);
+    rpchat_close_poller(h_fd_epoll);
 }
 
 int
@@ -102,9 +293,11 @@ rpchat_setup_server_socket(unsigned int port_num)
     int                h_sock_server = -1; // server fd
     struct sockaddr_in addr;               // server address
     int                reuse = 1; // required to have in stack frame to ref
+    int                defer = RPCHAT_DEFER_ACCEPT_SEC; // idle connect wait
 
-    // open TCP socket
-    h_sock_server = socket(AF_INET, SOCK_STREAM, 0);
+    // open TCP socket (non-blocking, so accepting can drain until empty)
+    h_sock_server
+        = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (0 > h_sock_server)
     {
         perror("sock");
@@ -138,6 +331,17 @@ rpchat_setup_server_socket(unsigned int port_num)
         goto leave;
     }
 
+    // only wake for clients once they have sent something (REGISTER)
+    if (0 > setsockopt(h_sock_server,
+                       IPPROTO_TCP,
+                       TCP_DEFER_ACCEPT,
+                       (const char *)&defer,
+                       sizeof(defer)))
+    {
+        perror("setsockopt");
+        goto leave;
+    }
+
     // attempt to bind to built address
     if (0 > bind(h_sock_server, (struct sockaddr *)&addr, sizeof(addr)))
     {
@@ -167,6 +371,11 @@ rpchat_monitor_connections(int                 h_fd_epoll,
     int res   = RPLIB_UNSUCCESS; // default failure in case early term
     int ready = 0;               // num of events ready
 
+    if (RPCHAT_IO_EPOLL != rpchat_io_backend)
+    {
+        return rpchat_uring_wait(
+            h_fd_epoll, p_ret_event_buf, max_connections);
+    }
     // block until events on watched fds
     // on event - 3 possibilities: error, new client, existing client
     ready = epoll_wait(h_fd_epoll, p_ret_event_buf, max_connections, -1);
@@ -198,22 +407,22 @@ rpchat_accept_new_connection(unsigned int h_fd_server)
     int                h_new_fd        = RPLIB_ERROR;
     int                res             = RPLIB_ERROR;
 
-    // accept new connection
-    h_new_fd = accept(
-        h_fd_server, (struct sockaddr *)&client_addr, &client_addr_len);
+    // accept new connection, flags set in the same call
+    h_new_fd = accept4(h_fd_server,
+                       (struct sockaddr *)&client_addr,
+                       &client_addr_len,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC);
 
     if (0 > h_new_fd)
     {
-        perror("New connection");
+        // drained, not a problem
+        if (EAGAIN != errno && EWOULDBLOCK != errno)
+        {
+            perror("New connection");
+        }
         res = RPLIB_ERROR;
         goto leave;
     }
-    // set nonblocking
-    res = fcntl(h_new_fd, F_SETFL, fcntl(h_new_fd, F_GETFL, 0) | O_NONBLOCK);
-    if (0 > res)
-    {
-        perror("fcntl");
-    }
     res = h_new_fd;
 
 leave:
@@ -224,19 +433,15 @@ int
 rpchat_close_connection(int h_fd_epoll, int h_fd)
 {
     int res = RPLIB_UNSUCCESS;
-    // close connection
-    res = close(h_fd);
-    if (RPLIB_SUCCESS != res)
+    // remove from epoll consideration while the number is still ours; once
+    // closed it may already name a newly accepted connection. A ring's poll
+    // holds the file itself, so the number is free to reuse at once
+    if (RPCHAT_IO_EPOLL == rpchat_io_backend)
     {
-        goto leave;
+        epoll_ctl(h_fd_epoll, EPOLL_CTL_DEL, h_fd, NULL);
     }
-    // remove from epoll consideration
-    res = epoll_ctl(h_fd_epoll, EPOLL_CTL_DEL, h_fd, NULL);
-    if (RPLIB_SUCCESS != res)
-    {
-        goto leave;
-    }
-leave:
+    // close connection
+    res = close(h_fd);
     return res;
 }
 
@@ -266,6 +471,27 @@ rpchat_recv(int h_fd_client, char *p_buf, size_t len)
     return 0 < read_bytes ? read_bytes : RPLIB_ERROR;
 }
 
+int
+rpchat_recvv(int h_fd_client, struct iovec *p_iov, int iov_count)
+{
+    ssize_t       read_bytes = 0;
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = p_iov;
+    msg.msg_iovlen = iov_count;
+
+    read_bytes = recvmsg(h_fd_client, &msg, 0);
+    // nothing pending on a non-blocking socket is not an error
+    if (0 > read_bytes
+        && (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno))
+    {
+        return 0;
+    }
+
+    return 0 < read_bytes ? read_bytes : RPLIB_ERROR;
+}
+
 int
 rpchat_sendmsg(int h_fd_client, char *p_buf, size_t len)
 {
@@ -275,3 +501,25 @@ rpchat_sendmsg(int h_fd_client, char *p_buf, size_t len)
 
     return sent_bytes;
 }
+
+int
+rpchat_sendmsgv(int h_fd_client, struct iovec *p_iov, int iov_count)
+{
+    ssize_t       sent_bytes = 0;
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = p_iov;
+    msg.msg_iovlen = iov_count;
+
+    // MSG_NOSIGNAL: a client that went away is an error, not a SIGPIPE
+    sent_bytes = sendmsg(h_fd_client, &msg, MSG_NOSIGNAL);
+    // full socket buffer on a non-blocking socket is not an error
+    if (0 > sent_bytes
+        && (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno))
+    {
+        return 0;
+    }
+
+    return 0 <= sent_bytes ? sent_bytes : RPLIB_ERROR;
+}
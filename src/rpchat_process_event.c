@@ -10,58 +10,250 @@
 #include "rpchat_process_event.h"
 
 #include "components/rpchat_conn_info.h"
+#include "rpchat_cluster.h"
 
+/**
+ * Status message text, indexed by `rpchat_stat_msg_id_t`
+ */
+static const char *const rpchat_stat_msg_table[] = {
+    "",                                  // RPCHAT_STAT_MSG_NONE
+    "Disconnected for inactivity.",      // RPCHAT_STAT_MSG_INACTIVE
+    "File could not be stored.",         // RPCHAT_STAT_MSG_NO_STORE
+    "File not found.",                   // RPCHAT_STAT_MSG_NO_FILE
+    "Disconnected, too far behind.",     // RPCHAT_STAT_MSG_BACKLOG
+    "Server busy, try again later.",     // RPCHAT_STAT_MSG_BUSY
+    "Username taken on another server.", // RPCHAT_STAT_MSG_TAKEN
+    "Invalid room name.",                // RPCHAT_STAT_MSG_BAD_ROOM
+    "Not in that room.",                 // RPCHAT_STAT_MSG_NO_ROOM
+    "Too many rooms joined.",            // RPCHAT_STAT_MSG_ROOMS
+};
+
+/**
+ * Helper function for `rpchat_task_conn_proc_event`, when the event is
+ * inbound, pull any pending bytes off the socket and extract the next complete
+ * message from the connection's inbound buffer
+ * @param p_task_args Pointer to parent `rpchat_args_proc_event_t` object
+ * @param p_frame Pointer to frame object to store message in
+ * @return RPLIB_SUCCESS if a message is ready, RPLIB_UNSUCCESS if more data is
+ * needed, RPLIB_ERROR if the client disconnected or sent invalid data
+ */
 static int
-rpchat_conn_proc_handle_inbound_msg(rpchat_args_proc_event_t *p_task_args)
-{
-    int                 res = RPLIB_UNSUCCESS;
-    rpchat_conn_info_t *p_conn_info
-        = (rpchat_conn_info_t *)p_task_args->epoll_event.data.ptr;
-    rplib_tpool_t *p_tpool = p_task_args->p_tpool;
-
-    // if there is no passed message, attempt to receive a message
-    if (0 == p_task_args->sz_msg_buf)
-    {
-        // POLLIN = pending data on conn, attempt to process
-        // POLLERR = has problem
-        // POLLHUP = they gone
-        if (p_task_args->epoll_event.events & EPOLLIN)
-        {
-            // receive message from client
-            res = rpchat_recv(
-                p_conn_info->h_fd, p_task_args->p_msg_buf, sizeof(uint8_t));
-            // if no bytes read, leave
-            if (0 >= res)
+rpchat_conn_proc_next_frame(rpchat_args_proc_event_t *p_task_args,
+                            rpchat_frame_t           *p_frame)
+{
+    int                  res         = RPLIB_SUCCESS;
+    rpchat_conn_info_t  *p_conn_info = p_task_args->p_conn_info;
+    bool                 b_was_empty = false; // nothing buffered before read
+    uint64_t             recv_ns     = 0;     // time those bytes landed
+    rpchat_conn_extra_t *p_extra     = NULL;  // holds the clock, if timed
+
+    // POLLIN = pending data on conn, attempt to process
+    // POLLERR = has problem
+    // POLLHUP = they gone
+    // (no flags = requeued to process data already buffered)
+    if (p_task_args->epoll_event.events & EPOLLIN)
+    {
+        // drain socket into inbound buffer; bytes landing in an empty buffer
+        // start the clock of the frame they begin
+        b_was_empty = 0 == rplib_ring_buf_size(&p_conn_info->inbound_buf);
+        res         = rpchat_conn_info_fill_inbound(p_conn_info);
+        if (b_was_empty
+            && 0 < rplib_ring_buf_size(&p_conn_info->inbound_buf))
+        {
+            // only a clock that runs needs somewhere to be kept
+            recv_ns = rpchat_metrics_now();
+            p_extra = 0 != recv_ns ? rpchat_conn_info_get_extra(p_conn_info)
+                                   : atomic_load(&p_conn_info->p_extra);
+            if (NULL != p_extra)
             {
-                // TODO: error
-                res = RPLIB_ERROR;
-                goto cleanup;
+                p_extra->recv_ns = recv_ns;
             }
-            // otherwise, update size
-            p_task_args->sz_msg_buf = res;
         }
-        else if (p_task_args->epoll_event.events & (EPOLLERR | EPOLLHUP))
+    }
+    else if (p_task_args->epoll_event.events & (EPOLLERR | EPOLLHUP))
+    {
+        res = RPLIB_ERROR;
+    }
+    if (RPLIB_SUCCESS != res)
+    {
+        goto leave;
+    }
+
+    // pull out next complete message, if there is one
+    res = rpchat_frame_parser_next(
+        &p_conn_info->inbound_parser, &p_conn_info->inbound_buf, p_frame);
+    if (RPLIB_SUCCESS == res)
+    {
+        rpchat_metrics_count(RPCHAT_METRIC_FRAMES, 1);
+        // bytes left behind keep the clock running, so frames queued behind
+        // others count the wait
+        p_extra = atomic_load(&p_conn_info->p_extra);
+        if (NULL != p_extra)
         {
-            // TODO: error behavior
-            res = RPLIB_ERROR;
-            goto leave;
+            rpchat_metrics_record(RPCHAT_METRIC_RECV_PARSE, p_extra->recv_ns);
         }
     }
+leave:
+    return res;
+}
 
+/**
+ * Helper function for `rpchat_task_conn_proc_event`, handle a complete message
+ * received from the current connection
+ * @param p_task_args Pointer to parent `rpchat_args_proc_event_t` object
+ * @param p_frame Pointer to frame containing message
+ * @return RPLIB_SUCCESS if message was expected and handled, RPLIB_UNSUCCESS
+ * if unexpected, RPLIB_ERROR if invalid
+ */
+static int
+rpchat_conn_proc_handle_inbound_msg(rpchat_args_proc_event_t *p_task_args,
+                                    rpchat_frame_t           *p_frame)
+{
     // handle message appropriately. If message is expected (e.g. conn state
     // PENDING_STATUS and msg is STATUS, otherwise if conn state AVAILABLE)
     // then returns RPLIB_SUCCESS
-    res = rpchat_handle_msg(p_task_args->p_conn_queue,
-                            p_conn_info,
-                            p_tpool,
-                            p_task_args->p_msg_buf);
-    goto leave;
+    return rpchat_handle_msg(p_task_args->p_conn_queue,
+                             p_task_args->p_conn_info,
+                             p_task_args->p_tpool,
+                             p_frame);
+}
 
-cleanup:
-    free(p_task_args->p_msg_buf);
-    p_task_args->p_msg_buf = NULL;
+/**
+ * Helper function to enqueue processing of data already sitting in a
+ * connection's inbound buffer, without waiting on a new epoll event
+ * @param p_conn_info Pointer to connection `rpchat_conn_info_t`
+ * @param p_conn_queue Pointer to connection Queue
+ * @param p_tpool Pointer to threadpool object
+ * @return RPLIB_SUCCESS on no issues, otherwise RPLIB_UNSUCCESS
+ */
+static int
+rpchat_conn_proc_enqueue_inbound(rpchat_conn_info_t  *p_conn_info,
+                                 rpchat_conn_queue_t *p_conn_queue,
+                                 rplib_tpool_t       *p_tpool)
+{
+    int                       res               = RPLIB_UNSUCCESS;
+    rpchat_args_proc_event_t *p_proc_event_args = NULL;
+
+    // allocate
+    p_proc_event_args = rplib_pool_alloc(p_conn_queue->p_pool,
+                                         sizeof(rpchat_args_proc_event_t));
+    if (NULL == p_proc_event_args)
+    {
+        res = RPLIB_ERROR;
+        goto leave;
+    }
+
+    // set fields
+    p_proc_event_args->args_type    = RPCHAT_PROC_EVENT_INBOUND;
+    p_proc_event_args->p_conn_queue = p_conn_queue;
+    p_proc_event_args->p_conn_info  = p_conn_info;
+    p_proc_event_args->p_tpool      = p_tpool;
+    p_proc_event_args->p_msg_buf    = NULL;
+    p_proc_event_args->sz_msg_buf   = 0;
+    p_proc_event_args->p_shared_msg = NULL;
+    p_proc_event_args->b_charged    = false;
+    p_proc_event_args->enqueued_ns  = rpchat_metrics_now();
+    // no epoll flags, data is already buffered
+    p_proc_event_args->epoll_event.events   = 0;
+    p_proc_event_args->epoll_event.data.ptr = p_conn_info;
+    // enqueue
+    res = rpchat_conn_info_enqueue_task(
+        p_conn_info, p_tpool, rpchat_task_conn_proc_event, p_proc_event_args);
+    if (RPLIB_SUCCESS != res)
+    {
+        rplib_pool_free(p_conn_queue->p_pool, p_proc_event_args);
+        p_proc_event_args = NULL;
+    }
+leave:
+    return res;
+}
+
+/**
+ * Helper function for `rpchat_task_conn_proc_event`, once a connection is
+ * ready to accept its next inbound message. If one is already buffered it is
+ * queued for processing immediately; otherwise listening on the socket resumes
+ * @param p_task_args Pointer to parent `rpchat_args_proc_event_t` object
+ * @return RPLIB_SUCCESS on no issues, otherwise RPLIB_UNSUCCESS
+ */
+static int
+rpchat_conn_proc_resume_inbound(rpchat_args_proc_event_t *p_task_args)
+{
+    int                 res         = RPLIB_UNSUCCESS;
+    rpchat_conn_info_t *p_conn_info = p_task_args->p_conn_info;
+
+    // complete (or invalid) message waiting, no need to involve epoll
+    if (RPLIB_UNSUCCESS
+        != rpchat_frame_parser_check(&p_conn_info->inbound_parser,
+                                     &p_conn_info->inbound_buf))
+    {
+        res = rpchat_conn_proc_enqueue_inbound(
+            p_conn_info, p_task_args->p_conn_queue, p_task_args->p_tpool);
+        if (RPLIB_SUCCESS == res)
+        {
+            goto leave;
+        }
+    }
+    // hand back buffer storage while waiting, if nothing is left in it
+    rpchat_conn_info_release_inbound(p_conn_info);
+    // start listening (and wait for writability if output is backed up)
+    res = rpchat_conn_info_arm(p_conn_info,
+                               p_task_args->p_conn_queue->h_fd_epoll);
+leave:
+    return res;
+}
+
+/**
+ * Helper function for `rpchat_task_conn_proc_event`, when the socket reported
+ * it is writable, continue writing the connection's outbound queue
+ * @param p_task_args Pointer to parent `rpchat_args_proc_event_t` object
+ * @return RPLIB_SUCCESS if the event still has inbound work, RPLIB_UNSUCCESS if
+ * writability was the only thing reported, RPLIB_ERROR if the socket errored
+ */
+static int
+rpchat_conn_proc_writable(rpchat_args_proc_event_t *p_task_args)
+{
+    int                 res         = RPLIB_SUCCESS;
+    rpchat_conn_info_t *p_conn_info = p_task_args->p_conn_info;
+
+    if (RPLIB_SUCCESS != rpchat_conn_info_flush_outbound(p_conn_info))
+    {
+        res = RPLIB_ERROR;
+        goto leave;
+    }
+    // handled, leave remaining flags for the state machine
+    p_task_args->epoll_event.events &= ~EPOLLOUT;
+    if (0
+        == (p_task_args->epoll_event.events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+    {
+        // nothing else to do, keep listening
+        rpchat_conn_info_arm(p_conn_info,
+                             p_task_args->p_conn_queue->h_fd_epoll);
+        res = RPLIB_UNSUCCESS;
+    }
 leave:
     return res;
+}
+
+/**
+ * Helper function to get the type of message an outbound event carries,
+ * whether it is a shared message or held in the event's own buffer
+ * @param p_task_args Pointer to parent `rpchat_args_proc_event_t` object
+ * @return Appropriate message type, or RPLIB_UNSUCCESS if no message
+ */
+static rpchat_msg_type_t
+rpchat_conn_proc_outbound_type(rpchat_args_proc_event_t *p_task_args)
+{
+    int res = RPLIB_UNSUCCESS;
+
+    if (NULL != p_task_args->p_shared_msg)
+    {
+        res = rpchat_get_msg_type(p_task_args->p_shared_msg->contents);
+    }
+    else if (NULL != p_task_args->p_msg_buf)
+    {
+        res = rpchat_get_msg_type(p_task_args->p_msg_buf);
+    }
+    return res;
 } /**
    * Helper function for `rpchat_task_conn_proc_event`, when the event is
    * outbound, send the corresponding message to the current connection
@@ -75,15 +267,19 @@ rpchat_conn_proc_handle_outbound_msg(rpchat_args_proc_event_t *p_task_args)
     rpchat_msg_type_t   new_msg_type = -1;
     rpchat_conn_info_t *p_conn_info  = p_task_args->p_conn_info;
 
-    // get message type based on the message stored in buffer
-    new_msg_type = rpchat_get_msg_type(p_task_args->p_msg_buf);
+    // get message type based on the message carried by the event
+    new_msg_type = rpchat_conn_proc_outbound_type(p_task_args);
 
     // send appropriate message out
     switch (new_msg_type)
     {
         case RPCHAT_BCP_DELIVER:
-            res = rpchat_conn_info_submit_msg(
-                p_conn_info, p_task_args->p_msg_buf, p_task_args->sz_msg_buf);
+            // drop down, all are shared and acknowledged
+        case RPCHAT_BCP_FNOTIFY:
+            // drop down
+        case RPCHAT_BCP_ROOMDELIVER:
+            res = rpchat_conn_info_submit_shared(p_conn_info,
+                                                 p_task_args->p_shared_msg);
             break;
         case RPCHAT_BCP_STATUS:
             res = rpchat_conn_info_submit_msg(
@@ -95,8 +291,8 @@ rpchat_conn_proc_handle_outbound_msg(rpchat_args_proc_event_t *p_task_args)
     return res;
 } /**
    * Constructs a status message to p_msg buffer in
-   * `rpchat_args_proc_event_t` object using passed status code and stat_msg in
-   * connection object
+   * `rpchat_args_proc_event_t` object using passed status code and the status
+   * message selected by stat_msg_id in connection object
    * @param p_task_args Pointer to parent `rpchat_args_proc_event_t` object
    * @return RPLIB_SUCCESS on successful send, RPLIB_ERROR if cannot be sent
    */
@@ -105,9 +301,14 @@ rpchat_conn_proc_set_status(rpchat_conn_info_t       *p_recipient_info,
                             rpchat_args_proc_event_t *p_task_args,
                             rpchat_stat_code_t        status_code)
 {
-    int res = RPLIB_UNSUCCESS;
+    int         res        = RPLIB_UNSUCCESS;
+    int         buf_index  = 0; // to track memcpy
+    const char *p_stat_msg = NULL;
+    uint16_t    stat_len   = 0;
 
-    int buf_index = 0; // to track memcpy
+    // canned message, shared by every connection
+    p_stat_msg = rpchat_stat_msg_table[p_recipient_info->stat_msg_id];
+    stat_len   = strlen(p_stat_msg);
 
     // asserts
     assert(NULL != p_task_args->p_msg_buf);
@@ -119,24 +320,17 @@ rpchat_conn_proc_set_status(rpchat_conn_info_t       *p_recipient_info,
     // status
     *(uint8_t *)(p_task_args->p_msg_buf + buf_index) = status_code;
     buf_index += sizeof(uint8_t);
-    // status msg (len)
-    memcpy(p_task_args->p_msg_buf + buf_index,
-           &p_recipient_info->stat_msg.len,
-           sizeof(p_recipient_info->stat_msg.len));
-    // big endian
-    *(uint16_t *)(p_task_args->p_msg_buf + buf_index)
-        = htobe16(p_recipient_info->stat_msg.len);
-    buf_index += sizeof(p_recipient_info->stat_msg.len);
+    // status msg (len, big endian)
+    *(uint16_t *)(p_task_args->p_msg_buf + buf_index) = htobe16(stat_len);
+    buf_index += sizeof(stat_len);
     // status msg (contents)
-    memcpy(p_task_args->p_msg_buf + buf_index,
-           &p_recipient_info->stat_msg.contents,
-           p_recipient_info->stat_msg.len);
-    buf_index += p_recipient_info->stat_msg.len;
+    memcpy(p_task_args->p_msg_buf + buf_index, p_stat_msg, stat_len);
+    buf_index += stat_len;
     p_task_args->sz_msg_buf = buf_index;
 
     // clear message
-    p_recipient_info->stat_msg.len = 0;
-    res                            = RPLIB_SUCCESS;
+    p_recipient_info->stat_msg_id = RPCHAT_STAT_MSG_NONE;
+    res                           = RPLIB_SUCCESS;
 
     return res;
 }
@@ -161,13 +355,15 @@ rpchat_conn_proc_enqueue_status(rpchat_conn_info_t  *p_recipient_info,
     rpchat_args_proc_event_t *p_proc_event_args = NULL;
 
     // allocate
-    p_proc_event_args = malloc(sizeof(rpchat_args_proc_event_t));
+    p_proc_event_args = rplib_pool_alloc(p_conn_queue->p_pool,
+                                         sizeof(rpchat_args_proc_event_t));
     if (NULL == p_proc_event_args)
     {
         res = RPLIB_ERROR;
         goto cleanup;
     }
-    p_proc_event_args->p_msg_buf = malloc(sizeof(rpchat_pkt_status_t));
+    p_proc_event_args->p_msg_buf
+        = rplib_pool_alloc(p_conn_queue->p_pool, sizeof(rpchat_pkt_status_t));
     if (NULL == p_proc_event_args->p_msg_buf)
     {
         res = RPLIB_ERROR;
@@ -179,6 +375,9 @@ rpchat_conn_proc_enqueue_status(rpchat_conn_info_t  *p_recipient_info,
     p_proc_event_args->p_conn_queue = p_conn_queue;
     p_proc_event_args->p_conn_info  = p_recipient_info;
     p_proc_event_args->p_tpool      = p_tpool;
+    p_proc_event_args->p_shared_msg = NULL;
+    p_proc_event_args->b_charged    = false;
+    p_proc_event_args->enqueued_ns  = rpchat_metrics_now();
     // create status msg in new proc_events
     res = rpchat_conn_proc_set_status(
         p_recipient_info, p_proc_event_args, status_code);
@@ -200,230 +399,1250 @@ rpchat_conn_proc_enqueue_status(rpchat_conn_info_t  *p_recipient_info,
 cleanup:
     if (NULL != p_proc_event_args)
     {
-        free(p_proc_event_args->p_msg_buf);
+        rplib_pool_free(p_conn_queue->p_pool, p_proc_event_args->p_msg_buf);
         p_proc_event_args->p_msg_buf = NULL;
     }
-    free(p_proc_event_args);
+    rplib_pool_free(p_conn_queue->p_pool, p_proc_event_args);
     p_proc_event_args = NULL;
 leave:
     return res;
 }
 /**
- * Construct a deliver message in the p_msg buffer
- * within passed `rpchat_args_proc_event_t` object
- * @param p_task_args Pointer to parent `rpchat_args_proc_event_t` object
- * @param p_sender Pointer to `rpchat_string_t` containing sender
- * @param p_msg Pointer to `rpchat_string_t` containing message
- * @return RPLIB_SUCCESS on success, RPLIB_UNSUCCESS on failure
+ * Encode a message made of an opcode and two strings (DELIVER, FNOTIFY) once
+ * into a shared message that can be queued to any number of recipients
+ * @param p_pool Pointer to pool to allocate message from
+ * @param opcode BCP message type
+ * @param p_sender Pointer to `rpchat_conn_name_t` containing sender
+ * @param p_msg Pointer to `rpchat_string_t` containing sanitized message
+ * @return Pointer to shared message holding one reference; NULL on failure
  */
-static int
-rpchat_conn_proc_set_deliver(rpchat_args_proc_event_t *p_task_args,
-                             rpchat_string_t          *p_sender,
-                             rpchat_string_t          *p_msg)
+static rpchat_shared_msg_t *
+rpchat_conn_proc_create_pair(rplib_pool_t       *p_pool,
+                             rpchat_msg_type_t   opcode,
+                             rpchat_conn_name_t *p_sender,
+                             rpchat_string_t    *p_msg)
 {
-    int             res       = RPLIB_UNSUCCESS;
-    int             buf_index = 0;
-    rpchat_string_t sanitized_msg;
+    rpchat_shared_msg_t *p_shared_msg = NULL;
+    int                  buf_index    = 0;
 
     assert(p_sender);
     assert(p_msg);
 
-    rpchat_string_sanitize(p_msg, &sanitized_msg, true);
+    // opcode | from (len, contents) | msg (len, contents)
+    p_shared_msg = rpchat_shared_msg_create(
+        p_pool,
+        sizeof(uint8_t) + sizeof(p_sender->len) + p_sender->len
+        + sizeof(p_msg->len) + p_msg->len);
+    if (NULL == p_shared_msg)
+    {
+        goto leave;
+    }
 
     buf_index = 0;
     // opcode field
-    *p_task_args->p_msg_buf = RPCHAT_BCP_DELIVER;
+    p_shared_msg->contents[buf_index] = opcode;
     buf_index += sizeof(uint8_t);
-    // from field (len)
-    memcpy(p_task_args->p_msg_buf + buf_index,
-           &p_sender->len,
-           sizeof(p_sender->len));
-    // big endian
-    *(uint16_t *)(p_task_args->p_msg_buf + buf_index) = htobe16(p_sender->len);
+    // from field (len, big endian)
+    *(uint16_t *)(p_shared_msg->contents + buf_index) = htobe16(p_sender->len);
     buf_index += sizeof(p_sender->len);
     // from field (contents)
-    memcpy(
-        p_task_args->p_msg_buf + buf_index, &p_sender->contents, p_sender->len);
+    memcpy(p_shared_msg->contents + buf_index,
+           p_sender->p_contents,
+           p_sender->len);
     buf_index += p_sender->len;
-    // msg field (len)
-    memcpy(p_task_args->p_msg_buf + buf_index,
-           &sanitized_msg.len,
-           sizeof(sanitized_msg.len));
-    // big endian
-    *(uint16_t *)(p_task_args->p_msg_buf + buf_index)
-        = htobe16(sanitized_msg.len);
-    buf_index += sizeof(sanitized_msg.len);
+    // msg field (len, big endian)
+    *(uint16_t *)(p_shared_msg->contents + buf_index) = htobe16(p_msg->len);
+    buf_index += sizeof(p_msg->len);
     // msg field (contents)
-    memcpy(p_task_args->p_msg_buf + buf_index,
-           &sanitized_msg.contents,
-           sanitized_msg.len);
-    buf_index += sanitized_msg.len;
-    // update size
-    p_task_args->sz_msg_buf = buf_index;
-    res                     = RPLIB_SUCCESS;
+    memcpy(p_shared_msg->contents + buf_index, &p_msg->contents, p_msg->len);
+leave:
+    return p_shared_msg;
+}
 
-    return res;
+/**
+ * Encode a deliver message once into a shared message that can be queued to
+ * any number of recipients
+ * @param p_pool Pointer to pool to allocate message from
+ * @param p_sender Pointer to `rpchat_conn_name_t` containing sender
+ * @param p_msg Pointer to `rpchat_string_t` containing sanitized message
+ * @return Pointer to shared message holding one reference; NULL on failure
+ */
+static rpchat_shared_msg_t *
+rpchat_conn_proc_create_deliver(rplib_pool_t       *p_pool,
+                                rpchat_conn_name_t *p_sender,
+                                rpchat_string_t    *p_msg)
+{
+    return rpchat_conn_proc_create_pair(
+        p_pool, RPCHAT_BCP_DELIVER, p_sender, p_msg);
 }
+
 /**
- * Helper function to enqueue a Deliver message for a given recipient
- * `rpchat_conn_info_t` object to be processed later
- * @param p_recipient_info  Pointer to recipient connection
- * `rpchat_conn_info_t`
+ * Encode a room deliver message once into a shared message that can be queued
+ * to every member of the room
+ * @param p_pool Pointer to pool to allocate message from
+ * @param p_room_name Pointer to room name contents
+ * @param room_len Length of room name
+ * @param p_sender Pointer to `rpchat_conn_name_t` containing sender
+ * @param p_msg Pointer to `rpchat_string_t` containing sanitized message
+ * @return Pointer to shared message holding one reference; NULL on failure
+ */
+static rpchat_shared_msg_t *
+rpchat_conn_proc_create_room_deliver(rplib_pool_t       *p_pool,
+                                     const char         *p_room_name,
+                                     uint16_t            room_len,
+                                     rpchat_conn_name_t *p_sender,
+                                     rpchat_string_t    *p_msg)
+{
+    rpchat_shared_msg_t *p_shared_msg = NULL;
+    int                  buf_index    = 0;
+
+    // opcode | room (len, contents) | from (len, contents) | msg (len,
+    // contents)
+    p_shared_msg = rpchat_shared_msg_create(
+        p_pool,
+        sizeof(uint8_t) + sizeof(room_len) + room_len + sizeof(p_sender->len)
+            + p_sender->len + sizeof(p_msg->len) + p_msg->len);
+    if (NULL == p_shared_msg)
+    {
+        goto leave;
+    }
+
+    // opcode field
+    p_shared_msg->contents[buf_index] = RPCHAT_BCP_ROOMDELIVER;
+    buf_index += sizeof(uint8_t);
+    // room field
+    *(uint16_t *)(p_shared_msg->contents + buf_index) = htobe16(room_len);
+    buf_index += sizeof(room_len);
+    memcpy(p_shared_msg->contents + buf_index, p_room_name, room_len);
+    buf_index += room_len;
+    // from field
+    *(uint16_t *)(p_shared_msg->contents + buf_index) = htobe16(p_sender->len);
+    buf_index += sizeof(p_sender->len);
+    memcpy(p_shared_msg->contents + buf_index,
+           p_sender->p_contents,
+           p_sender->len);
+    buf_index += p_sender->len;
+    // msg field
+    *(uint16_t *)(p_shared_msg->contents + buf_index) = htobe16(p_msg->len);
+    buf_index += sizeof(p_msg->len);
+    memcpy(p_shared_msg->contents + buf_index, &p_msg->contents, p_msg->len);
+leave:
+    return p_shared_msg;
+}
+/**
+ * Helper function to check a connection's backlog against its budget
+ * @param p_backlog Pointer to outbound budgets
+ * @param p_conn_info Pointer to connection `rpchat_conn_info_t`
+ * @param num_frames Messages about to be added to the backlog
+ * @param sz_msg Bytes about to be added to the backlog
+ * @return true if the backlog holds (or would hold) more than allowed
+ */
+static bool
+rpchat_conn_proc_over_budget(rpchat_backlog_policy_t *p_backlog,
+                             rpchat_conn_info_t      *p_conn_info,
+                             size_t                   num_frames,
+                             size_t                   sz_msg)
+{
+    return p_backlog->max_frames
+               < atomic_load_explicit(&p_conn_info->backlog_frames,
+                                      memory_order_relaxed)
+                     + num_frames
+           || p_backlog->max_bytes
+                  < atomic_load_explicit(&p_conn_info->sz_backlog,
+                                         memory_order_relaxed)
+                        + sz_msg;
+}
+
+/**
+ * Helper function to count an outbound event's message against its
+ * recipient's backlog, and the server's
+ * @param p_task_args Pointer to `rpchat_args_proc_event_t` carrying a shared
+ * message
+ */
+static void
+rpchat_conn_proc_charge(rpchat_args_proc_event_t *p_task_args)
+{
+    rpchat_conn_info_t      *p_conn_info = p_task_args->p_conn_info;
+    rpchat_backlog_policy_t *p_backlog   = p_task_args->p_conn_queue->p_backlog;
+    size_t                   sz_msg      = p_task_args->p_shared_msg->sz_msg;
+
+    atomic_fetch_add_explicit(
+        &p_conn_info->backlog_frames, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(
+        &p_conn_info->sz_backlog, sz_msg, memory_order_relaxed);
+    if (NULL != p_backlog)
+    {
+        atomic_fetch_add_explicit(
+            &p_backlog->sz_queued, sz_msg, memory_order_relaxed);
+    }
+    p_task_args->b_charged = true;
+}
+
+/**
+ * Helper function to take an outbound event's message off the backlogs it was
+ * counted in, once it was written or dropped. Sending the drop notice lets
+ * further drops start a new one
+ * \nNote: Caller must hold the connection (lock or affinity)
+ * @param p_task_args Pointer to `rpchat_args_proc_event_t` object
+ */
+static void
+rpchat_conn_proc_settle(rpchat_args_proc_event_t *p_task_args)
+{
+    rpchat_conn_info_t      *p_conn_info = p_task_args->p_conn_info;
+    rpchat_backlog_policy_t *p_backlog   = p_task_args->p_conn_queue->p_backlog;
+    size_t                   sz_msg      = 0;
+    rpchat_conn_extra_t     *p_extra     = NULL;
+
+    if (!p_task_args->b_charged)
+    {
+        return;
+    }
+    sz_msg = p_task_args->p_shared_msg->sz_msg;
+    atomic_fetch_sub_explicit(
+        &p_conn_info->backlog_frames, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(
+        &p_conn_info->sz_backlog, sz_msg, memory_order_relaxed);
+    if (NULL != p_backlog)
+    {
+        atomic_fetch_sub_explicit(
+            &p_backlog->sz_queued, sz_msg, memory_order_relaxed);
+    }
+    // no notice without the extra fields
+    p_extra = atomic_load(&p_conn_info->p_extra);
+    if (NULL != p_extra && p_task_args->p_shared_msg == p_extra->p_drop_notice)
+    {
+        p_extra->p_drop_notice = NULL;
+        p_extra->num_dropped   = 0;
+    }
+    p_task_args->b_charged = false;
+}
+
+/**
+ * Helper function to hand a connection an event carrying no message
+ * @param p_recipient_info Pointer to recipient connection `rpchat_conn_info_t`
  * @param p_conn_queue Pointer to Connection Queue
  * @param p_tpool Pointer to threadpool object
- * @param p_sender_str Pointer to string of "sender"
- * @param p_msg Pointer to string of message to send
+ * @param args_type Kind of event, HEARTBEAT or FLUSH
  * @return RPLIB_SUCCESS on no issues, otherwise RPLIB_UNSUCCESS
  */
 static int
-rpchat_conn_proc_enqueue_deliver(rpchat_conn_info_t  *p_recipient_info,
-                                 rpchat_conn_queue_t *p_conn_queue,
-                                 rplib_tpool_t       *p_tpool,
-                                 rpchat_string_t     *p_sender_str,
-                                 rpchat_string_t     *p_msg)
+rpchat_conn_proc_enqueue_signal(rpchat_conn_info_t          *p_recipient_info,
+                                rpchat_conn_queue_t         *p_conn_queue,
+                                rplib_tpool_t               *p_tpool,
+                                rpchat_args_proc_event_src_t args_type)
 {
     int                       res               = RPLIB_UNSUCCESS;
     rpchat_args_proc_event_t *p_proc_event_args = NULL;
 
-    // allocate
-    p_proc_event_args = malloc(sizeof(rpchat_args_proc_event_t));
+    p_proc_event_args = rplib_pool_alloc(p_conn_queue->p_pool,
+                                         sizeof(rpchat_args_proc_event_t));
     if (NULL == p_proc_event_args)
     {
         res = RPLIB_ERROR;
-        goto cleanup;
-    }
-    p_proc_event_args->p_msg_buf = malloc(sizeof(rpchat_pkt_deliver_t));
-    if (NULL == p_proc_event_args->p_msg_buf)
-    {
-        res = RPLIB_ERROR;
-        goto cleanup;
+        goto leave;
     }
-
-    // set fields
-    p_proc_event_args->args_type    = RPCHAT_PROC_EVENT_OUTBOUND;
+    p_proc_event_args->args_type    = args_type;
     p_proc_event_args->p_conn_queue = p_conn_queue;
     p_proc_event_args->p_conn_info  = p_recipient_info;
     p_proc_event_args->p_tpool      = p_tpool;
-    // create deliver msg in new proc_events
-    res = rpchat_conn_proc_set_deliver(p_proc_event_args, p_sender_str, p_msg);
-    if (RPLIB_SUCCESS != res)
-    {
-        goto cleanup;
-    }
-    // enqueue
+    p_proc_event_args->p_msg_buf    = NULL;
+    p_proc_event_args->sz_msg_buf   = 0;
+    p_proc_event_args->p_shared_msg = NULL;
+    p_proc_event_args->b_charged    = false;
+    p_proc_event_args->enqueued_ns  = rpchat_metrics_now();
     res = rpchat_conn_info_enqueue_task(p_recipient_info,
                                         p_tpool,
                                         rpchat_task_conn_proc_event,
                                         p_proc_event_args);
     if (RPLIB_SUCCESS != res)
     {
-        goto cleanup;
-    }
-    res = RPLIB_SUCCESS;
-    goto leave;
-cleanup:
-    if (NULL != p_proc_event_args)
-    {
-        free(p_proc_event_args->p_msg_buf);
-        p_proc_event_args->p_msg_buf = NULL;
+        rplib_pool_free(p_conn_queue->p_pool, p_proc_event_args);
+        p_proc_event_args = NULL;
     }
-    free(p_proc_event_args);
-    p_proc_event_args = NULL;
 leave:
     return res;
 }
+
 /**
- * Helper function for `rpchat_task_conn_proc_event`, when the connection is
- * in an error state. An error status is sent to sender and the connection
- * is closed.
- * @param p_task_args Pointer to parent `rpchat_args_proc_event_t` object
- * @return RPLIB_SUCCESS on no issues; otherwise, RPLIB_UNSUCCESS
+ * Helper function to wake a connection that went over its budget, so it
+ * disconnects even while it has nothing else to process
+ * @param p_recipient_info Pointer to recipient connection `rpchat_conn_info_t`
+ * @param p_conn_queue Pointer to Connection Queue
+ * @param p_tpool Pointer to threadpool object
+ * @return RPLIB_SUCCESS on no issues, otherwise RPLIB_UNSUCCESS
  */
 static int
-rpchat_conn_proc_error(rpchat_args_proc_event_t *p_task_args)
+rpchat_conn_proc_enqueue_heartbeat(rpchat_conn_info_t  *p_recipient_info,
+                                   rpchat_conn_queue_t *p_conn_queue,
+                                   rplib_tpool_t       *p_tpool)
 {
-    int                 res         = RPLIB_UNSUCCESS;
-    rpchat_conn_info_t *p_conn_info = NULL;
-
-    p_conn_info = (rpchat_conn_info_t *)p_task_args->p_conn_info;
-
-    // set message
-    rpchat_conn_proc_set_status(
-        p_conn_info, p_task_args, RPCHAT_BCP_STATUS_ERROR);
-
-    // attempt to send status
-    rpchat_conn_info_submit_msg(
-        p_conn_info, p_task_args->p_msg_buf, p_task_args->sz_msg_buf);
-
-    // stop listening and close socket(s)
-    res = rpchat_close_connection(p_task_args->p_conn_queue->h_fd_epoll,
-                                  p_conn_info->h_fd);
-
-    // get out
-    return res;
+    return rpchat_conn_proc_enqueue_signal(
+        p_recipient_info, p_conn_queue, p_tpool, RPCHAT_PROC_EVENT_HEARTBEAT);
 }
 
-void
-rpchat_task_conn_proc_event(void *p_args)
+/**
+ * Helper function to post a charged delivery to its recipient's outbox. The
+ * first one posted since the last flush asks for the next: at once, or once
+ * the queue's flush timer fires when a flush deadline is set. Reaching
+ * `flush_bytes` asks for it at once either way
+ * @param p_task_args Pointer to `rpchat_args_proc_event_t` carrying a
+ * delivery
+ * @return RPLIB_SUCCESS on success, RPLIB_ERROR if it could not be posted
+ */
+static int
+rpchat_conn_proc_post_outbox(rpchat_args_proc_event_t *p_task_args)
 {
-    rpchat_args_proc_event_t *p_task_args = NULL;
-    rpchat_conn_info_t       *p_conn_info = NULL;
-    rplib_tpool_t            *p_tpool     = NULL;
-    int                       res         = RPLIB_SUCCESS;
-    rpchat_string_t           dc_msg;
-    // cast args to access fields
-    p_task_args = (rpchat_args_proc_event_t *)p_args;
-    p_conn_info = (rpchat_conn_info_t *)p_task_args->p_conn_info;
-    p_tpool     = p_task_args->p_tpool;
-
-    // update queue on conn info
-    atomic_fetch_sub(&p_conn_info->pending_jobs, 1);
+    rpchat_conn_info_t  *p_conn_info  = p_task_args->p_conn_info;
+    rpchat_conn_queue_t *p_conn_queue = p_task_args->p_conn_queue;
+    int                  res          = RPLIB_SUCCESS;
+    rpchat_conn_extra_t *p_extra      = NULL;
 
-    // attempt lock, otherwise requeue
-    if (RPLIB_SUCCESS != pthread_mutex_trylock(&p_conn_info->mutex_conn))
+    p_extra = rpchat_conn_info_get_extra(p_conn_info);
+    if (NULL == p_extra)
     {
-        goto requeue_no_unlock;
+        return RPLIB_ERROR;
     }
-
-    // update last activity if not a HEARTBEAT event
-    if (RPCHAT_PROC_EVENT_HEARTBEAT != p_task_args->args_type)
+    pthread_mutex_lock(&p_extra->mutex_outbox);
+    // taken whole by the last flush, or never posted to
+    if (NULL == p_extra->p_outbox)
     {
-        p_conn_info->last_active = time(0);
+        p_extra->p_outbox = rplib_ll_queue_create();
     }
-
-    // if buffer is not allocated, allocate
-    if (NULL == p_task_args->p_msg_buf)
+    if (NULL == p_extra->p_outbox
+        || NULL
+               == rplib_ll_queue_enqueue(
+                   p_extra->p_outbox, &p_task_args, sizeof(p_task_args)))
     {
-        // freed when args object is freed completion of task (on n
-        // iteration)
-        p_task_args->p_msg_buf = malloc(RPCHAT_MAX_INCOMING_MSG);
-        if (NULL == p_task_args->p_msg_buf)
-        {
-            // TODO: set error
-            perror("malloc");
-            goto cleanup;
-        }
+        res = RPLIB_ERROR;
+        goto leave;
     }
-
-    // event is HEARTBEAT, check how long inactive for
-    // if not already CONN_CLOSING or CONN_ERR
-    if (RPCHAT_PROC_EVENT_HEARTBEAT == p_task_args->args_type
-        && (RPCHAT_CONN_CLOSING != p_conn_info->conn_status
-            && RPCHAT_CONN_ERR != p_conn_info->conn_status))
+    p_extra->sz_outbox += p_task_args->p_shared_msg->sz_msg;
+    // a flush already asked for takes this one along
+    if (RPCHAT_FLUSH_QUEUED == p_extra->flush_state)
     {
-        if (RPCHAT_CONNECTION_TIMEOUT < (time(0) - p_conn_info->last_active))
-        {
-            p_conn_info->stat_msg.len
-                = snprintf(p_conn_info->stat_msg.contents,
-                           RPCHAT_MAX_STR_LENGTH,
-                           "Disconnected for inactivity.");
-            p_conn_info->conn_status = RPCHAT_CONN_ERR;
-        }
-        else
+        goto leave;
+    }
+    // clients acknowledging every DELIVER get nothing from waiting
+    if (0 == p_conn_queue->flush_us || 1 >= p_conn_info->window
+        || p_conn_queue->flush_bytes <= p_extra->sz_outbox)
+    {
+        p_extra->flush_state = RPCHAT_FLUSH_QUEUED;
+        // left for the next post to ask again
+        if (RPLIB_SUCCESS
+            != rpchat_conn_proc_enqueue_signal(p_conn_info,
+                                               p_conn_queue,
+                                               p_task_args->p_tpool,
+                                               RPCHAT_PROC_EVENT_FLUSH))
         {
-            goto cleanup;
+            p_extra->flush_state = RPCHAT_FLUSH_IDLE;
         }
     }
+    else if (!p_extra->b_lingering)
+    {
+        // counted as pending, the connection stays until the timer fired
+        p_extra->b_lingering = true;
+        atomic_fetch_add(&p_conn_info->pending_jobs, 1);
+        rpchat_conn_queue_linger(p_conn_queue, p_conn_info);
+    }
+leave:
+    pthread_mutex_unlock(&p_extra->mutex_outbox);
+    return res;
+}
+
+/**
+ * Helper function to enqueue a Deliver message for a given recipient
+ * `rpchat_conn_info_t` object to be processed later
+ * @param p_recipient_info  Pointer to recipient connection
+ * `rpchat_conn_info_t`
+ * @param p_conn_queue Pointer to Connection Queue
+ * @param p_tpool Pointer to threadpool object
+ * \nNote: Under the disconnect policy, a recipient whose budget the message
+ * would exceed is not given it, and is told to disconnect instead
+ * @param p_shared_msg Pointer to encoded deliver message; the event takes its
+ * own reference
+ * @return RPLIB_SUCCESS on no issues, otherwise RPLIB_UNSUCCESS
+ */
+static int
+rpchat_conn_proc_enqueue_deliver(rpchat_conn_info_t  *p_recipient_info,
+                                 rpchat_conn_queue_t *p_conn_queue,
+                                 rplib_tpool_t       *p_tpool,
+                                 rpchat_shared_msg_t *p_shared_msg)
+{
+    int                       res               = RPLIB_UNSUCCESS;
+    rpchat_args_proc_event_t *p_proc_event_args = NULL;
+    rpchat_backlog_policy_t  *p_backlog         = p_conn_queue->p_backlog;
+
+    // recipient is not keeping up; wake it once so it disconnects
+    if (NULL != p_backlog && !p_backlog->b_drop_oldest
+        && rpchat_conn_proc_over_budget(
+            p_backlog, p_recipient_info, 1, p_shared_msg->sz_msg))
+    {
+        if (!atomic_exchange(&p_recipient_info->b_overrun, true))
+        {
+            rpchat_conn_proc_enqueue_heartbeat(
+                p_recipient_info, p_conn_queue, p_tpool);
+        }
+        goto leave;
+    }
+
+    // allocate
+    p_proc_event_args = rplib_pool_alloc(p_conn_queue->p_pool,
+                                         sizeof(rpchat_args_proc_event_t));
+    if (NULL == p_proc_event_args)
+    {
+        res = RPLIB_ERROR;
+        goto leave;
+    }
+
+    // set fields
+    p_proc_event_args->args_type    = RPCHAT_PROC_EVENT_OUTBOUND;
+    p_proc_event_args->p_conn_queue = p_conn_queue;
+    p_proc_event_args->p_conn_info  = p_recipient_info;
+    p_proc_event_args->p_tpool      = p_tpool;
+    p_proc_event_args->p_msg_buf    = NULL;
+    p_proc_event_args->sz_msg_buf   = 0;
+    p_proc_event_args->p_shared_msg = rpchat_shared_msg_retain(p_shared_msg);
+    p_proc_event_args->enqueued_ns  = rpchat_metrics_now();
+    // counted before a flush can take it and settle it
+    rpchat_conn_proc_charge(p_proc_event_args);
+    // written along with whatever else is posted until the flush
+    res = rpchat_conn_proc_post_outbox(p_proc_event_args);
+    if (RPLIB_SUCCESS != res)
+    {
+        rpchat_conn_proc_settle(p_proc_event_args);
+        rpchat_shared_msg_release(p_proc_event_args->p_shared_msg);
+        rplib_pool_free(p_conn_queue->p_pool, p_proc_event_args);
+        p_proc_event_args = NULL;
+        goto leave;
+    }
+    rpchat_metrics_count(RPCHAT_METRIC_DELIVERIES, 1);
+leave:
+    return res;
+}
+/**
+ * Helper function for `rpchat_task_conn_proc_event`, when the connection is
+ * in an error state. An error status is sent to sender and the connection
+ * is closed.
+ * @param p_task_args Pointer to parent `rpchat_args_proc_event_t` object
+ * @return RPLIB_SUCCESS on no issues; otherwise, RPLIB_UNSUCCESS
+ */
+static int
+rpchat_conn_proc_error(rpchat_args_proc_event_t *p_task_args)
+{
+    int                 res         = RPLIB_UNSUCCESS;
+    rpchat_conn_info_t *p_conn_info = NULL;
+
+    p_conn_info = (rpchat_conn_info_t *)p_task_args->p_conn_info;
+
+    // only status events carry a buffer of their own
+    if (NULL == p_task_args->p_msg_buf)
+    {
+        p_task_args->p_msg_buf = rplib_pool_alloc(
+            p_task_args->p_conn_queue->p_pool, sizeof(rpchat_pkt_status_t));
+    }
+    if (NULL != p_task_args->p_msg_buf)
+    {
+        // set message
+        rpchat_conn_proc_set_status(
+            p_conn_info, p_task_args, RPCHAT_BCP_STATUS_ERROR);
+
+        // attempt to send status
+        rpchat_conn_info_submit_msg(
+            p_conn_info, p_task_args->p_msg_buf, p_task_args->sz_msg_buf);
+    }
+
+    // stop listening and close socket(s). Tasks still outstanding must not
+    // arm, read or write the number, it may be handed to a new connection
+    rpchat_disarm_descriptor(p_task_args->p_conn_queue->h_fd_epoll,
+                             p_conn_info,
+                             &p_conn_info->b_poll_pending);
+    res = rpchat_close_connection(p_task_args->p_conn_queue->h_fd_epoll,
+                                  p_conn_info->h_fd);
+    p_conn_info->h_fd = RPLIB_ERROR;
+
+    // get out
+    return res;
+}
+
+/**
+ * Helper function for file transfers that stopped short, either waiting for
+ * the socket or giving up the worker after a slice. Either way the transfer
+ * continues from a later event
+ * @param p_task_args Pointer to parent `rpchat_args_proc_event_t` object
+ * @param xfer_res How the transfer step ended
+ */
+static void
+rpchat_conn_proc_continue_file(rpchat_args_proc_event_t *p_task_args,
+                               rpchat_file_xfer_res_t    xfer_res)
+{
+    rpchat_conn_info_t *p_conn_info = p_task_args->p_conn_info;
+
+    // other connections get the worker, carry on from a fresh task
+    if (RPCHAT_FILE_XFER_YIELD == xfer_res
+        && RPLIB_SUCCESS
+               == rpchat_conn_proc_enqueue_inbound(p_conn_info,
+                                                   p_task_args->p_conn_queue,
+                                                   p_task_args->p_tpool))
+    {
+        return;
+    }
+    rpchat_conn_info_release_inbound(p_conn_info);
+    rpchat_conn_info_arm(p_conn_info, p_task_args->p_conn_queue->h_fd_epoll);
+}
+
+/**
+ * Helper function for `rpchat_task_conn_proc_event`, while SENDFILE contents
+ * arrive. Once all have, the file is published, the sender gets its status
+ * and everyone else an FNOTIFY
+ * @param p_task_args Pointer to parent `rpchat_args_proc_event_t` object
+ * @return RPLIB_SUCCESS on no issues, RPLIB_ERROR if the socket failed
+ */
+static int
+rpchat_conn_proc_recv_file(rpchat_args_proc_event_t *p_task_args)
+{
+    int                    res         = RPLIB_SUCCESS;
+    rpchat_conn_info_t    *p_conn_info = p_task_args->p_conn_info;
+    rpchat_file_xfer_t    *p_xfer      = p_conn_info->p_xfer;
+    rpchat_file_xfer_res_t xfer_res    = RPCHAT_FILE_XFER_FAILED;
+    rpchat_string_t        file_name;  // name announced to other clients
+    bool                   b_stored    = false;
+
+    xfer_res = rpchat_file_xfer_recv(
+        p_xfer, p_conn_info->h_fd, &p_conn_info->inbound_buf);
+    if (RPCHAT_FILE_XFER_FAILED == xfer_res)
+    {
+        res = RPLIB_ERROR;
+        goto leave;
+    }
+    if (RPCHAT_FILE_XFER_DONE != xfer_res)
+    {
+        rpchat_conn_proc_continue_file(p_task_args, xfer_res);
+        goto leave;
+    }
+
+    // every byte is in, publish and answer
+    b_stored = RPLIB_SUCCESS == rpchat_file_xfer_commit(p_xfer);
+    file_name.len = snprintf(
+        file_name.contents, RPCHAT_MAX_STR_LENGTH, "%s", p_xfer->file_name);
+    file_name.b_sanitized = false;
+    rpchat_file_xfer_destroy(p_xfer);
+    p_conn_info->p_xfer = NULL;
+
+    p_conn_info->stat_msg_id
+        = b_stored ? RPCHAT_STAT_MSG_NONE : RPCHAT_STAT_MSG_NO_STORE;
+    p_conn_info->conn_status = RPCHAT_CONN_SEND_STAT;
+    rpchat_conn_proc_enqueue_status(
+        p_conn_info,
+        p_task_args->p_conn_queue,
+        p_task_args->p_tpool,
+        b_stored ? RPCHAT_BCP_STATUS_GOOD : RPCHAT_BCP_STATUS_ERROR);
+    if (b_stored)
+    {
+        rpchat_broadcast_file(p_task_args->p_conn_queue,
+                              p_conn_info,
+                              p_task_args->p_tpool,
+                              &file_name);
+    }
+leave:
+    return res;
+}
+
+/**
+ * Helper function for `rpchat_task_conn_proc_event`, while RECVFILE contents
+ * are written. The RECVFILE header, and anything queued ahead of it, is
+ * flushed first; once the file is sent the connection takes requests again
+ * @param p_task_args Pointer to parent `rpchat_args_proc_event_t` object
+ * @return RPLIB_SUCCESS on no issues, RPLIB_ERROR if the socket failed
+ */
+static int
+rpchat_conn_proc_send_file(rpchat_args_proc_event_t *p_task_args)
+{
+    int                    res         = RPLIB_SUCCESS;
+    rpchat_conn_info_t    *p_conn_info = p_task_args->p_conn_info;
+    rpchat_file_xfer_res_t xfer_res    = RPCHAT_FILE_XFER_FAILED;
+
+    if (RPLIB_SUCCESS != rpchat_conn_info_flush_outbound(p_conn_info))
+    {
+        res = RPLIB_ERROR;
+        goto leave;
+    }
+    // header still backed up, contents cannot follow yet
+    if (rpchat_conn_info_has_outbound(p_conn_info))
+    {
+        rpchat_conn_proc_continue_file(p_task_args, RPCHAT_FILE_XFER_BLOCKED);
+        goto leave;
+    }
+
+    xfer_res = rpchat_file_xfer_send(p_conn_info->p_xfer, p_conn_info->h_fd);
+    if (RPCHAT_FILE_XFER_FAILED == xfer_res)
+    {
+        res = RPLIB_ERROR;
+        goto leave;
+    }
+    if (RPCHAT_FILE_XFER_DONE != xfer_res)
+    {
+        rpchat_conn_proc_continue_file(p_task_args, xfer_res);
+        goto leave;
+    }
+
+    // the file was the answer, no ack expected
+    rpchat_file_xfer_destroy(p_conn_info->p_xfer);
+    p_conn_info->p_xfer      = NULL;
+    p_conn_info->conn_status = RPCHAT_CONN_AVAILABLE;
+    rpchat_conn_proc_resume_inbound(p_task_args);
+leave:
+    return res;
+}
+
+/**
+ * Helper function to time a DELIVER just written to its acknowledgement. One
+ * is timed per connection at a time, remembering how many older ones must be
+ * acknowledged first
+ * @param p_conn_info Pointer to recipient connection info
+ */
+static void
+rpchat_conn_proc_note_sent(rpchat_conn_info_t *p_conn_info)
+{
+    rpchat_conn_extra_t *p_extra = atomic_load(&p_conn_info->p_extra);
+    uint64_t             sent_ns = 0;
+
+    if (NULL != p_extra && 0 != p_extra->ack_sample_ns)
+    {
+        return;
+    }
+    // stamps taken while disabled are 0, nothing to keep
+    sent_ns = rpchat_metrics_now();
+    if (0 == sent_ns)
+    {
+        return;
+    }
+    p_extra = rpchat_conn_info_get_extra(p_conn_info);
+    if (NULL != p_extra)
+    {
+        p_extra->ack_sample_ns    = sent_ns;
+        p_extra->ack_sample_ahead = p_conn_info->in_flight;
+    }
+}
+
+/**
+ * Helper function to account for acknowledged DELIVERs, recording the timed
+ * one once acknowledgements reach it
+ * @param p_conn_info Pointer to recipient connection info
+ * @param num_acked Number of oldest unacknowledged DELIVERs acknowledged
+ */
+static void
+rpchat_conn_proc_note_acked(rpchat_conn_info_t *p_conn_info,
+                            uint8_t             num_acked)
+{
+    rpchat_conn_extra_t *p_extra = atomic_load(&p_conn_info->p_extra);
+
+    if (NULL == p_extra || 0 == p_extra->ack_sample_ns)
+    {
+        return;
+    }
+    if (num_acked <= p_extra->ack_sample_ahead)
+    {
+        p_extra->ack_sample_ahead -= num_acked;
+        return;
+    }
+    rpchat_metrics_record(RPCHAT_METRIC_DELIVER_ACK, p_extra->ack_sample_ns);
+    p_extra->ack_sample_ns = 0;
+}
+
+/**
+ * Helper function for `rpchat_task_conn_proc_event`, once a task is done with
+ * its connection. Unlocks it, or for pinned connections lets them move to
+ * another worker once nothing else is outstanding
+ * @param p_conn_info Pointer to connection `rpchat_conn_info_t`
+ */
+static void
+rpchat_conn_proc_release(rpchat_conn_info_t *p_conn_info)
+{
+    if (p_conn_info->b_affinity)
+    {
+        rplib_tpool_affinity_release(&p_conn_info->affinity);
+    }
+    else
+    {
+        pthread_mutex_unlock(&p_conn_info->mutex_conn);
+    }
+}
+
+/**
+ * Helper function to check whether an event can be processed in the current
+ * state of its connection
+ * @param p_task_args Pointer to `rpchat_args_proc_event_t` object
+ * @return true if event can run now, false if it has to wait for a state
+ * change
+ */
+static bool
+rpchat_conn_proc_can_run(rpchat_args_proc_event_t *p_task_args)
+{
+    bool res = true;
+
+    switch (p_task_args->p_conn_info->conn_status)
+    {
+        case RPCHAT_CONN_AVAILABLE:
+            // window full, further messages wait for acknowledgements
+            res = RPCHAT_PROC_EVENT_OUTBOUND != p_task_args->args_type
+                  || p_task_args->p_conn_info->in_flight
+                         < p_task_args->p_conn_info->window;
+            break;
+        case RPCHAT_CONN_SEND_STAT:
+            // only the status being sent
+            res = RPCHAT_PROC_EVENT_OUTBOUND == p_task_args->args_type
+                  && RPCHAT_BCP_STATUS
+                         == rpchat_conn_proc_outbound_type(p_task_args);
+            break;
+        case RPCHAT_CONN_SEND_MSG:
+            res = RPCHAT_PROC_EVENT_OUTBOUND == p_task_args->args_type;
+            break;
+        case RPCHAT_CONN_PENDING_STATUS:
+            // need a STATUS before sending anything
+            res = RPCHAT_PROC_EVENT_OUTBOUND != p_task_args->args_type;
+            break;
+        case RPCHAT_CONN_RECV_FILE:
+            // drop down, file contents hold the stream until they moved
+        case RPCHAT_CONN_SEND_FILE:
+            res = RPCHAT_PROC_EVENT_OUTBOUND != p_task_args->args_type;
+            break;
+        case RPCHAT_CONN_CLAIMING:
+            // nothing goes until the cluster decided on the username
+            res = false;
+            break;
+        default:
+            break;
+    }
+    return res;
+}
+
+/**
+ * Helper function to defer an event until its connection changes to a state
+ * that can process it
+ * @param p_task_args Pointer to `rpchat_args_proc_event_t` object
+ * @return RPLIB_SUCCESS on success; otherwise RPLIB_UNSUCCESS
+ */
+static int
+rpchat_conn_proc_park(rpchat_args_proc_event_t *p_task_args)
+{
+    rplib_ll_queue_t **pp_parked = NULL;
+
+    // inbound and outbound wait on different states, keep apart so one
+    // cannot hold up the other
+    pp_parked = RPCHAT_PROC_EVENT_OUTBOUND == p_task_args->args_type
+                    ? &p_task_args->p_conn_info->p_parked_out
+                    : &p_task_args->p_conn_info->p_parked_in;
+    // most connections never park anything
+    if (NULL == *pp_parked)
+    {
+        *pp_parked = rplib_ll_queue_create();
+    }
+    return NULL != *pp_parked
+                   && NULL
+                          != rplib_ll_queue_enqueue(
+                              *pp_parked, &p_task_args, sizeof(p_task_args))
+               ? RPLIB_SUCCESS
+               : RPLIB_UNSUCCESS;
+}
+
+/**
+ * Helper function to take the oldest deferred event that the connection's
+ * current state can process
+ * @param p_conn_info Pointer to connection `rpchat_conn_info_t`
+ * @return Pointer to event args; NULL if none can run
+ */
+static rpchat_args_proc_event_t *
+rpchat_conn_proc_unpark(rpchat_conn_info_t *p_conn_info)
+{
+    rpchat_args_proc_event_t *p_task_args = NULL;
+    rplib_ll_queue_t         *p_parked[]  = { p_conn_info->p_parked_in,
+                                              p_conn_info->p_parked_out };
+    size_t                    list_index  = 0;
+
+    for (list_index = 0; list_index < sizeof(p_parked) / sizeof(p_parked[0]);
+         list_index++)
+    {
+        if (NULL == p_parked[list_index] || 0 == p_parked[list_index]->size)
+        {
+            continue;
+        }
+        p_task_args = *(rpchat_args_proc_event_t **)p_parked[list_index]
+                           ->p_front->p_data;
+        if (rpchat_conn_proc_can_run(p_task_args))
+        {
+            rplib_ll_queue_dequeue(p_parked[list_index]);
+            return p_task_args;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Helper function to release a finished event's args and anything it holds
+ * @param p_task_args Pointer to `rpchat_args_proc_event_t` object
+ */
+static void
+rpchat_conn_proc_free_args(rpchat_args_proc_event_t *p_task_args)
+{
+    rplib_pool_t *p_pool = p_task_args->p_conn_queue->p_pool;
+
+    rpchat_conn_proc_settle(p_task_args);
+    rplib_pool_free(p_pool, p_task_args->p_msg_buf);
+    p_task_args->p_msg_buf = NULL;
+    if (NULL != p_task_args->p_shared_msg)
+    {
+        rpchat_shared_msg_release(p_task_args->p_shared_msg);
+        p_task_args->p_shared_msg = NULL;
+    }
+    rplib_pool_free(p_pool, p_task_args);
+}
+
+/**
+ * Helper function for a FLUSH event, to move every delivery posted to a
+ * connection's outbox behind its parked events, in the order posted. Later
+ * posts ask for another flush
+ * \nNote: Caller must hold the connection (lock or affinity)
+ * @param p_conn_info Pointer to connection `rpchat_conn_info_t`
+ * @return Number of deliveries moved
+ */
+static size_t
+rpchat_conn_proc_take_outbox(rpchat_conn_info_t *p_conn_info)
+{
+    size_t               num_taken = 0;
+    rpchat_conn_extra_t *p_extra   = atomic_load(&p_conn_info->p_extra);
+
+    // never posted to
+    if (NULL == p_extra)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&p_extra->mutex_outbox);
+    if (NULL != p_extra->p_outbox)
+    {
+        num_taken = p_extra->p_outbox->size;
+        // with nothing parked the outbox list itself becomes the parked list,
+        // the next post creates another
+        if (NULL == p_conn_info->p_parked_out)
+        {
+            p_conn_info->p_parked_out = p_extra->p_outbox;
+            p_extra->p_outbox         = NULL;
+        }
+        else
+        {
+            rplib_ll_queue_splice(p_conn_info->p_parked_out, p_extra->p_outbox);
+        }
+    }
+    p_extra->sz_outbox   = 0;
+    p_extra->flush_state = RPCHAT_FLUSH_IDLE;
+    pthread_mutex_unlock(&p_extra->mutex_outbox);
+    return num_taken;
+}
+
+/**
+ * Helper function for `rpchat_conn_proc_run`, when a DELIVER (or FNOTIFY) is
+ * to be sent. Deliveries parked behind it go out in the same vectored write,
+ * as many as the window leaves room for, until the batch would exceed
+ * `flush_bytes`; a windowed client acknowledges them all with one ACK
+ * @param p_task_args Pointer to parent `rpchat_args_proc_event_t` object
+ * @return RPLIB_SUCCESS on success; otherwise RPLIB_UNSUCCESS
+ */
+static int
+rpchat_conn_proc_send_batch(rpchat_args_proc_event_t *p_task_args)
+{
+    rpchat_conn_info_t       *p_conn_info = p_task_args->p_conn_info;
+    rpchat_conn_queue_t      *p_queue     = p_task_args->p_conn_queue;
+    rplib_ll_queue_t         *p_parked    = p_conn_info->p_parked_out;
+    rpchat_args_proc_event_t *p_next      = NULL; // front of parked
+    size_t                    sz_batch    = 0;    // bytes queued by this call
+    uint64_t                  num_joined  = 0;    // written along the first
+    int                       res         = RPLIB_UNSUCCESS;
+
+    // statuses carry their own buffer, nothing joins them
+    if (NULL == p_task_args->p_shared_msg)
+    {
+        res = rpchat_conn_proc_handle_outbound_msg(p_task_args);
+        if (RPLIB_SUCCESS == res)
+        {
+            rpchat_conn_proc_note_sent(p_conn_info);
+            p_conn_info->in_flight++;
+        }
+        return res;
+    }
+    res = rpchat_conn_info_queue_shared(p_conn_info, p_task_args->p_shared_msg);
+    if (RPLIB_SUCCESS != res)
+    {
+        goto leave;
+    }
+    rpchat_conn_proc_note_sent(p_conn_info);
+    p_conn_info->in_flight++;
+    sz_batch = p_task_args->p_shared_msg->sz_msg;
+    while (NULL != p_parked && 0 < p_parked->size
+           && p_conn_info->in_flight < p_conn_info->window)
+    {
+        p_next = *(rpchat_args_proc_event_t **)p_parked->p_front->p_data;
+        if (NULL == p_next->p_shared_msg
+            || p_queue->flush_bytes < sz_batch + p_next->p_shared_msg->sz_msg)
+        {
+            break;
+        }
+        if (RPLIB_SUCCESS
+            != rpchat_conn_info_queue_shared(p_conn_info, p_next->p_shared_msg))
+        {
+            break;
+        }
+        rplib_ll_queue_dequeue(p_parked);
+        p_conn_info->in_flight++;
+        sz_batch += p_next->p_shared_msg->sz_msg;
+        rpchat_conn_proc_free_args(p_next);
+        num_joined++;
+    }
+    if (0 < num_joined)
+    {
+        rpchat_metrics_count(RPCHAT_METRIC_COALESCED, num_joined);
+    }
+    res = rpchat_conn_info_flush_outbound(p_conn_info);
+leave:
+    // if queueing or sending fails, set error state
+    if (RPLIB_SUCCESS != res)
+    {
+        p_conn_info->conn_status = RPCHAT_CONN_ERR;
+        res                      = RPLIB_UNSUCCESS;
+    }
+    return res;
+}
+
+/**
+ * Helper function to throw away every deferred event of a connection that is
+ * about to be destroyed, along with every delivery posted to its outbox
+ * @param p_conn_info Pointer to connection `rpchat_conn_info_t`
+ */
+static void
+rpchat_conn_proc_drop_parked(rpchat_conn_info_t *p_conn_info)
+{
+    rpchat_args_proc_event_t *p_task_args = NULL;
+    rplib_ll_queue_t         *p_parked[]  = { p_conn_info->p_parked_in,
+                                              p_conn_info->p_parked_out };
+    size_t                    list_index  = 0;
+
+    rpchat_conn_proc_take_outbox(p_conn_info);
+    for (list_index = 0; list_index < sizeof(p_parked) / sizeof(p_parked[0]);
+         list_index++)
+    {
+        while (NULL != p_parked[list_index] && 0 < p_parked[list_index]->size)
+        {
+            p_task_args = *(rpchat_args_proc_event_t **)p_parked[list_index]
+                               ->p_front->p_data;
+            rplib_ll_queue_dequeue(p_parked[list_index]);
+            rpchat_conn_proc_free_args(p_task_args);
+        }
+    }
+}
+
+/**
+ * Helper function for `rpchat_task_conn_proc_event`, once an outbound event
+ * parked. Under the drop policy, a connection over its budget loses its oldest
+ * parked messages until it is back within it. The oldest message gives up its
+ * place to a notice counting every message dropped, so the client learns of
+ * the gap before anything newer arrives; later drops update the same notice
+ * \nNote: Caller must hold the connection (lock or affinity)
+ * @param p_task_args Pointer to `rpchat_args_proc_event_t` object that parked
+ */
+static void
+rpchat_conn_proc_trim_backlog(rpchat_args_proc_event_t *p_task_args)
+{
+    rpchat_conn_info_t       *p_conn_info  = p_task_args->p_conn_info;
+    rpchat_conn_queue_t      *p_conn_queue = p_task_args->p_conn_queue;
+    rpchat_backlog_policy_t  *p_backlog    = p_conn_queue->p_backlog;
+    rplib_ll_queue_node_t    *p_node       = NULL;
+    rplib_ll_queue_node_t    *p_next_node  = NULL;
+    rpchat_args_proc_event_t *p_parked     = NULL; // event at p_node
+    rpchat_args_proc_event_t *p_keeper     = NULL; // first parked message
+    rpchat_conn_extra_t      *p_extra      = NULL; // holds the notice
+    rpchat_shared_msg_t      *p_notice     = NULL; // replaces keeper's message
+    uint32_t                  num_dropped  = 0;    // removed by this call
+    uint32_t                  num_total    = 0;    // reported by notice
+    rpchat_string_t           notice_msg;
+    rpchat_string_t           sanitized_msg;
+
+    if (NULL == p_backlog || !p_backlog->b_drop_oldest
+        || !rpchat_conn_proc_over_budget(p_backlog, p_conn_info, 0, 0))
+    {
+        return;
+    }
+    // nowhere to keep the notice, try again on the next park
+    p_extra = rpchat_conn_info_get_extra(p_conn_info);
+    if (NULL == p_extra)
+    {
+        return;
+    }
+    for (p_node = p_conn_info->p_parked_out->p_front;
+         NULL != p_node
+         && rpchat_conn_proc_over_budget(p_backlog, p_conn_info, 0, 0);
+         p_node = p_next_node)
+    {
+        p_next_node = p_node->p_next_node;
+        p_parked    = *(rpchat_args_proc_event_t **)p_node->p_data;
+        // statuses are answers, not deliveries
+        if (!p_parked->b_charged)
+        {
+            continue;
+        }
+        if (NULL == p_keeper)
+        {
+            p_keeper = p_parked;
+            continue;
+        }
+        rplib_ll_remove_node(p_conn_info->p_parked_out, p_node);
+        rpchat_conn_proc_free_args(p_parked);
+        num_dropped++;
+    }
+    // nothing but the notice is parked, the rest has not run yet
+    if (NULL == p_keeper
+        || (0 == num_dropped
+            && p_keeper->p_shared_msg == p_extra->p_drop_notice))
+    {
+        return;
+    }
+
+    // a keeper that is not the notice yet loses its message as well
+    num_total = p_extra->num_dropped + num_dropped;
+    if (p_keeper->p_shared_msg != p_extra->p_drop_notice)
+    {
+        num_total++;
+    }
+    notice_msg.len = snprintf(notice_msg.contents,
+                              RPCHAT_MAX_STR_LENGTH,
+                              "%u messages to you were dropped, you are "
+                              "receiving too slowly.",
+                              num_total);
+    notice_msg.b_sanitized = false;
+    rpchat_string_sanitize(&notice_msg, &sanitized_msg, true);
+    p_notice = rpchat_conn_proc_create_deliver(
+        p_conn_queue->p_pool, &p_conn_queue->server_name, &sanitized_msg);
+    // keeper keeps its message, counted by the next notice
+    if (NULL == p_notice)
+    {
+        p_extra->num_dropped += num_dropped;
+        return;
+    }
+    rpchat_log_write(RPCHAT_LOG_WARN,
+                     "%s: dropped %u messages, too far behind",
+                     p_conn_info->username.p_contents,
+                     num_total);
+    rpchat_conn_proc_settle(p_keeper);
+    rpchat_shared_msg_release(p_keeper->p_shared_msg);
+    p_keeper->p_shared_msg = p_notice;
+    rpchat_conn_proc_charge(p_keeper);
+    p_extra->p_drop_notice = p_notice;
+    p_extra->num_dropped   = num_total;
+}
+
+/**
+ * Helper function to complete a registration once the username is held:
+ * greet the client with everyone already connected and tell everyone of it
+ * @param p_conn_queue Pointer to connection Queue
+ * @param p_conn_info Pointer to registering connection, username set
+ * @param p_tpool Pointer to threadpool managing tasks
+ */
+static void
+rpchat_conn_proc_welcome(rpchat_conn_queue_t           *p_conn_queue,
+                         struct rpchat_connection_info *p_conn_info,
+                         rplib_tpool_t                 *p_tpool)
+{
+    rpchat_string_t      group_reg_msg;           // for other clients
+    rpchat_string_t      client_reg_msg;          // for this client
+    rpchat_string_t      sanitized_reg_msg;       // stripped client_reg_msg
+    rpchat_shared_msg_t *p_client_deliver = NULL; // encoded client_reg_msg
+    size_t               num_local        = 0;    // clients of this node
+    size_t               num_remote       = 0;    // users of other nodes
+
+    // notify other clients of this registration
+    // create message
+    group_reg_msg.len = snprintf(group_reg_msg.contents,
+                                 RPCHAT_MAX_STR_LENGTH,
+                                 "%s has joined the server.",
+                                 p_conn_info->username.p_contents);
+    group_reg_msg.b_sanitized = false;
+
+    client_reg_msg.len = snprintf(client_reg_msg.contents,
+                                  RPCHAT_MAX_STR_LENGTH,
+                                  "Logged in as %s.\nCurrent Clients: \n",
+                                  p_conn_info->username.p_contents);
+    client_reg_msg.b_sanitized = false;
+    num_local = rpchat_conn_queue_count_users(p_conn_queue);
+    if (NULL != p_conn_queue->p_cluster)
+    {
+        num_remote = rpchat_cluster_count_users(p_conn_queue->p_cluster);
+    }
+    // anyone else online lists every local name, this client's included
+    if (1 < num_local || 0 < num_remote)
+    {
+        rpchat_conn_queue_list_users(p_conn_queue, &client_reg_msg);
+    }
+    // users of other nodes follow those of this one
+    if (0 < num_remote)
+    {
+        rpchat_cluster_list_users(
+            p_conn_queue->p_cluster, &client_reg_msg, false);
+    }
+
+    // enqueue message with registering client
+    rpchat_string_sanitize(&client_reg_msg, &sanitized_reg_msg, true);
+    p_client_deliver = rpchat_conn_proc_create_deliver(
+        p_conn_queue->p_pool, &p_conn_queue->server_name, &sanitized_reg_msg);
+    if (NULL != p_client_deliver)
+    {
+        rpchat_conn_proc_enqueue_deliver(
+            p_conn_info, p_conn_queue, p_tpool, p_client_deliver);
+        rpchat_shared_msg_release(p_client_deliver);
+        p_client_deliver = NULL;
+    }
+
+    // send to all
+    rpchat_broadcast_msg(p_conn_queue,
+                         p_conn_info,
+                         &p_conn_queue->server_name,
+                         p_tpool,
+                         &group_reg_msg);
+}
+
+/**
+ * Helper function for `rpchat_conn_proc_run`, act on the cluster's decision
+ * on the username of a connection: welcome it if granted, otherwise tell it
+ * the name is taken and disconnect it
+ * @param p_task_args Pointer to CLAIM event
+ * @return `rpchat_proc_event_res_t` telling caller what to do with the event
+ */
+static rpchat_proc_event_res_t
+rpchat_conn_proc_claimed(rpchat_args_proc_event_t *p_task_args)
+{
+    rpchat_conn_info_t *p_conn_info = p_task_args->p_conn_info;
+
+    if (!p_task_args->b_granted)
+    {
+        rpchat_log_write(RPCHAT_LOG_WARN,
+                         "%s: username held on another node",
+                         p_conn_info->username.p_contents);
+        rpchat_conn_queue_release_username(p_task_args->p_conn_queue,
+                                           p_conn_info);
+        p_conn_info->stat_msg_id = RPCHAT_STAT_MSG_TAKEN;
+        p_conn_info->conn_status = RPCHAT_CONN_ERR;
+        return RPCHAT_PROC_RES_AGAIN;
+    }
+    // a name another node gave up on after it was already kept
+    if (RPCHAT_CONN_CLAIMING != p_conn_info->conn_status)
+    {
+        return RPCHAT_PROC_RES_DONE;
+    }
+    rpchat_conn_proc_welcome(
+        p_task_args->p_conn_queue, p_conn_info, p_task_args->p_tpool);
+    p_conn_info->conn_status = RPCHAT_CONN_SEND_STAT;
+    rpchat_conn_proc_enqueue_status(p_conn_info,
+                                    p_task_args->p_conn_queue,
+                                    p_task_args->p_tpool,
+                                    RPCHAT_BCP_STATUS_GOOD);
+    return RPCHAT_PROC_RES_DONE;
+}
+
+/**
+ * Helper function for `rpchat_task_conn_proc_event`, process a single event
+ * against the state of its connection
+ * \nNote: Caller must hold the connection (lock or affinity)
+ * @param p_task_args Pointer to `rpchat_args_proc_event_t` object
+ * @return `rpchat_proc_event_res_t` telling caller what to do with the event
+ */
+static rpchat_proc_event_res_t
+rpchat_conn_proc_run(rpchat_args_proc_event_t *p_task_args)
+{
+    rpchat_conn_info_t *p_conn_info = p_task_args->p_conn_info;
+    rplib_tpool_t      *p_tpool     = p_task_args->p_tpool;
+    int                 res         = RPLIB_SUCCESS;
+    rpchat_string_t     dc_msg;
+    rpchat_frame_t      inbound_frame; // message received from client
+
+    // update last activity if not a HEARTBEAT event
+    if (RPCHAT_PROC_EVENT_HEARTBEAT != p_task_args->args_type)
+    {
+        atomic_store_explicit(
+            &p_conn_info->last_active, time(0), memory_order_relaxed);
+    }
+
+    // event is HEARTBEAT, check for an exceeded budget or how long inactive
+    // for, if not already CONN_CLOSING or CONN_ERR
+    if (RPCHAT_PROC_EVENT_HEARTBEAT == p_task_args->args_type
+        && (RPCHAT_CONN_CLOSING != p_conn_info->conn_status
+            && RPCHAT_CONN_ERR != p_conn_info->conn_status))
+    {
+        if (atomic_load(&p_conn_info->b_overrun))
+        {
+            rpchat_log_write(RPCHAT_LOG_WARN,
+                             "%s: disconnected, too far behind",
+                             p_conn_info->username.p_contents);
+            p_conn_info->stat_msg_id = RPCHAT_STAT_MSG_BACKLOG;
+            p_conn_info->conn_status = RPCHAT_CONN_ERR;
+        }
+        else if (p_task_args->p_conn_queue->conn_timeout
+            < (time(0) - atomic_load(&p_conn_info->last_active)))
+        {
+            p_conn_info->stat_msg_id = RPCHAT_STAT_MSG_INACTIVE;
+            p_conn_info->conn_status = RPCHAT_CONN_ERR;
+        }
+        else
+        {
+            return RPCHAT_PROC_RES_DONE;
+        }
+    }
+
+    // socket drained enough to continue writing queued messages
+    // (downloads flush the queue themselves, ahead of the contents)
+    if (RPCHAT_PROC_EVENT_INBOUND == p_task_args->args_type
+        && (p_task_args->epoll_event.events & EPOLLOUT)
+        && (RPCHAT_CONN_CLOSING != p_conn_info->conn_status
+            && RPCHAT_CONN_ERR != p_conn_info->conn_status
+            && RPCHAT_CONN_SEND_FILE != p_conn_info->conn_status))
+    {
+        res = rpchat_conn_proc_writable(p_task_args);
+        if (RPLIB_ERROR == res)
+        {
+            p_conn_info->conn_status = RPCHAT_CONN_ERR;
+            return RPCHAT_PROC_RES_AGAIN;
+        }
+        if (RPLIB_UNSUCCESS == res)
+        {
+            return RPCHAT_PROC_RES_DONE;
+        }
+    }
+
+    // cluster decided on the username, unless the connection is going
+    // anyway
+    if (RPCHAT_PROC_EVENT_CLAIM == p_task_args->args_type
+        && (RPCHAT_CONN_CLOSING != p_conn_info->conn_status
+            && RPCHAT_CONN_ERR != p_conn_info->conn_status))
+    {
+        return rpchat_conn_proc_claimed(p_task_args);
+    }
+
+    // deliveries posted since the last flush park behind those waiting
+    // already, and run in order once the state allows. A closing connection
+    // goes on closing
+    if (RPCHAT_PROC_EVENT_FLUSH == p_task_args->args_type)
+    {
+        if (0 < rpchat_conn_proc_take_outbox(p_conn_info))
+        {
+            rpchat_conn_proc_trim_backlog(p_task_args);
+        }
+        if (RPCHAT_CONN_CLOSING != p_conn_info->conn_status
+            && RPCHAT_CONN_ERR != p_conn_info->conn_status)
+        {
+            return RPCHAT_PROC_RES_DONE;
+        }
+    }
+
+    // wrong state for this event, wait for the state to change
+    if (!rpchat_conn_proc_can_run(p_task_args))
+    {
+        return RPCHAT_PROC_RES_PARK;
+    }
 
     switch (p_conn_info->conn_status)
     {
@@ -432,18 +1651,56 @@ rpchat_task_conn_proc_event(void *p_args)
         case RPCHAT_CONN_AVAILABLE:
             if (RPCHAT_PROC_EVENT_INBOUND == p_task_args->args_type)
             {
+                res = rpchat_conn_proc_next_frame(p_task_args, &inbound_frame);
+                // message incomplete, wait for the rest
+                if (RPLIB_UNSUCCESS == res)
+                {
+                    rpchat_conn_proc_resume_inbound(p_task_args);
+                    res = RPLIB_SUCCESS;
+                    break;
+                }
                 // handle messages inbound from client (register, status,
                 // send)
-                res = rpchat_conn_proc_handle_inbound_msg(p_task_args);
+                if (RPLIB_SUCCESS == res)
+                {
+                    res = rpchat_conn_proc_handle_inbound_msg(p_task_args,
+                                                              &inbound_frame);
+                }
 
-                // on success, requeue to send status
+                // acknowledgements of a window need no answer
+                if (RPLIB_SUCCESS == res
+                    && (RPCHAT_BCP_STATUS == inbound_frame.msg_type
+                        || RPCHAT_BCP_ACK == inbound_frame.msg_type))
+                {
+                    rpchat_conn_proc_resume_inbound(p_task_args);
+                    break;
+                }
+                // claims other nodes have to agree to are answered once
+                // they did, see `rpchat_conn_proc_claimed`
+                if (RPLIB_SUCCESS == res
+                    && RPCHAT_CONN_CLAIMING == p_conn_info->conn_status)
+                {
+                    break;
+                }
+                // file transfers answer once their contents have moved
+                if (RPLIB_SUCCESS == res
+                    && (RPCHAT_CONN_RECV_FILE == p_conn_info->conn_status
+                        || RPCHAT_CONN_SEND_FILE == p_conn_info->conn_status))
+                {
+                    return RPCHAT_PROC_RES_AGAIN;
+                }
+                // on success, requeue to send status, negative if the
+                // request left a message explaining why
                 if (RPLIB_SUCCESS == res)
                 {
                     p_conn_info->conn_status = RPCHAT_CONN_SEND_STAT;
-                    rpchat_conn_proc_enqueue_status(p_conn_info,
-                                                    p_task_args->p_conn_queue,
-                                                    p_tpool,
-                                                    RPCHAT_BCP_STATUS_GOOD);
+                    rpchat_conn_proc_enqueue_status(
+                        p_conn_info,
+                        p_task_args->p_conn_queue,
+                        p_tpool,
+                        RPCHAT_STAT_MSG_NONE == p_conn_info->stat_msg_id
+                            ? RPCHAT_BCP_STATUS_GOOD
+                            : RPCHAT_BCP_STATUS_ERROR);
                 }
                 // on unsuccess, kill connection TODO: is this overkill?
                 else
@@ -452,397 +1709,1084 @@ rpchat_task_conn_proc_event(void *p_args)
                 }
                 break;
             }
-            // if AVAILABLE and event is OUTBOUND, state change and requeue
-            // to process on next pass
+            // if AVAILABLE and event is OUTBOUND, state change and process
+            // again in new state
             else
             {
                 p_conn_info->conn_status = RPCHAT_CONN_SEND_MSG;
-                goto requeue;
+                return RPCHAT_PROC_RES_AGAIN;
             }
         case RPCHAT_CONN_SEND_STAT:
-            // if event is not outbound and not stat, requeue
-            if (RPCHAT_PROC_EVENT_OUTBOUND != p_task_args->args_type
-                || RPCHAT_BCP_STATUS
-                       != rpchat_get_msg_type(p_task_args->p_msg_buf))
-            {
-                goto requeue;
-            }
             res = rpchat_conn_proc_handle_outbound_msg(p_task_args);
             // go back to AVAILABLE once status has been sent
             if (RPLIB_SUCCESS == res)
             {
                 p_conn_info->conn_status = RPCHAT_CONN_AVAILABLE;
-                // start listening
-                rpchat_toggle_descriptor(p_task_args->p_conn_queue->h_fd_epoll,
-                                         p_conn_info->h_fd,
-                                         p_conn_info,
-                                         true);
+                // process next message
+                rpchat_conn_proc_resume_inbound(p_task_args);
             }
             break;
         case RPCHAT_CONN_SEND_MSG:
-            // sending outbound message (deliver, status)
-            // if event is not outbound, requeue
-            if (RPCHAT_PROC_EVENT_OUTBOUND != p_task_args->args_type)
-            {
-                goto requeue;
-            }
-            // if message is outbound, send it to client
-            res = rpchat_conn_proc_handle_outbound_msg(p_task_args);
-            // wait for status if sent successfully
+            // sending outbound message (deliver, fnotify) to client
+            res = rpchat_conn_proc_send_batch(p_task_args);
+            // wait for status if sent successfully; windowed clients keep
+            // taking messages, acks arrive whenever
             if (RPLIB_SUCCESS == res)
             {
-                p_conn_info->conn_status = RPCHAT_CONN_PENDING_STATUS;
-                // start listening
-                rpchat_toggle_descriptor(p_task_args->p_conn_queue->h_fd_epoll,
-                                         p_conn_info->h_fd,
-                                         p_conn_info,
-                                         true);
+                p_conn_info->conn_status = 1 < p_conn_info->window
+                                               ? RPCHAT_CONN_AVAILABLE
+                                               : RPCHAT_CONN_PENDING_STATUS;
+                // process next message (hopefully status)
+                rpchat_conn_proc_resume_inbound(p_task_args);
             }
             break;
         case RPCHAT_CONN_PENDING_STATUS:
-            // if not inbound, requeue. Need a STATUS before sending
-            // anything.
-            if (RPCHAT_PROC_EVENT_INBOUND != p_task_args->args_type)
+            res = rpchat_conn_proc_next_frame(p_task_args, &inbound_frame);
+            // status incomplete, wait for the rest
+            if (RPLIB_UNSUCCESS == res)
+            {
+                rpchat_conn_proc_resume_inbound(p_task_args);
+                res = RPLIB_SUCCESS;
+                break;
+            }
+            // while in PENDING_STATUS state this
+            // call will return RPLIB_UNSUCCESS if msg is not STATUS
+            if (RPLIB_SUCCESS == res)
             {
-                goto requeue;
+                res = rpchat_conn_proc_handle_inbound_msg(p_task_args,
+                                                          &inbound_frame);
             }
-            // if message inbound from client, try to process message
-            else
+            // if error, set error state and process again to handle
+            if (RPLIB_ERROR == res)
             {
-                // while in PENDING_STATUS state this
-                // call will return RPLIB_UNSUCCESS if msg is not STATUS
-                res = rpchat_conn_proc_handle_inbound_msg(p_task_args);
-                // if error, set error state and requeue to handle
-                if (RPLIB_ERROR == res)
-                {
-                    p_conn_info->conn_status = RPCHAT_CONN_ERR;
-                    goto requeue;
-                }
-                // success; reset to available
-                p_conn_info->conn_status = RPCHAT_CONN_AVAILABLE;
-                // start listening
-                rpchat_toggle_descriptor(p_task_args->p_conn_queue->h_fd_epoll,
-                                         p_conn_info->h_fd,
-                                         p_conn_info,
-                                         true);
+                p_conn_info->conn_status = RPCHAT_CONN_ERR;
+                return RPCHAT_PROC_RES_AGAIN;
             }
+            // success; reset to available
+            p_conn_info->conn_status = RPCHAT_CONN_AVAILABLE;
+            p_conn_info->in_flight   = 0;
+            // process next message
+            rpchat_conn_proc_resume_inbound(p_task_args);
+            res = RPLIB_SUCCESS;
+            break;
+        case RPCHAT_CONN_RECV_FILE:
+            res = rpchat_conn_proc_recv_file(p_task_args);
+            break;
+        case RPCHAT_CONN_SEND_FILE:
+            res = rpchat_conn_proc_send_file(p_task_args);
             break;
         case RPCHAT_CONN_ERR:
             // error occurred, send message and begin closing
-            rpchat_conn_proc_error(p_args);
+            rpchat_conn_proc_error(p_task_args);
             p_conn_info->conn_status = RPCHAT_CONN_CLOSING;
-            goto requeue;
+            return RPCHAT_PROC_RES_AGAIN;
         case RPCHAT_CONN_CLOSING:
-            // connection is closing...waiting for final out
-            if (0 == atomic_load(&p_conn_info->pending_jobs))
+            // connection is closing...waiting for final out (and for a ring
+            // to report the poll withdrawn, its task retries)
+            if (0 != atomic_load(&p_conn_info->pending_jobs)
+                || atomic_load(&p_conn_info->b_poll_pending))
+            {
+                break;
+            }
+            // once the cluster forgot the name, no claim result can be
+            // queued for the connection anymore
+            if (NULL != p_task_args->p_conn_queue->p_cluster)
+            {
+                rpchat_cluster_release_username(
+                    p_task_args->p_conn_queue->p_cluster, p_conn_info);
+            }
+            // unlinked on the first try; destroyed once no reader of an
+            // older snapshot can reach it, which wakes it again
+            if (RPLIB_SUCCESS
+                == rpchat_conn_queue_remove_conn_info(
+                    p_task_args->p_conn_queue, p_conn_info))
             {
                 // notify
                 dc_msg.len = snprintf(dc_msg.contents,
                                       RPCHAT_MAX_STR_LENGTH,
                                       "%s has left the server.",
                                       (0 < p_conn_info->username.len)
-                                          ? p_conn_info->username.contents
+                                          ? p_conn_info->username.p_contents
                                           : "An unregistered user");
+                dc_msg.b_sanitized = false;
 
                 rpchat_broadcast_msg(p_task_args->p_conn_queue,
                                      p_conn_info,
-                                     &p_task_args->p_conn_queue->server_str,
+                                     &p_task_args->p_conn_queue->server_name,
                                      p_tpool,
                                      &dc_msg);
 
-                rpchat_conn_queue_destroy_conn_info(p_task_args->p_conn_queue,
-                                                    p_conn_info);
+                // nothing left will run for this connection
+                rpchat_conn_proc_settle(p_task_args);
+                rpchat_conn_proc_drop_parked(p_conn_info);
+                rpchat_conn_queue_destroy_conn_info(p_conn_info);
+
+                return RPCHAT_PROC_RES_DESTROYED;
+            }
+        default:
+            break;
+    }
+    // on error occurred during switch branching, change state
+    if (RPLIB_ERROR == res)
+    {
+        p_conn_info->conn_status = RPCHAT_CONN_ERR;
+        return RPCHAT_PROC_RES_AGAIN;
+    }
+    return RPCHAT_PROC_RES_DONE;
+}
+
+/**
+ * Helper function for the connection tasks, to process an event once its
+ * connection is held, then every parked event the new state can run
+ * @param p_task_args Pointer to `rpchat_args_proc_event_t` object
+ * @param b_contended Whether the task waited in line on the connection's
+ * affine queue, whose slot is given up before the connection is
+ */
+static void
+rpchat_conn_proc_drive(rpchat_args_proc_event_t *p_task_args, bool b_contended)
+{
+    rpchat_conn_info_t     *p_conn_info = p_task_args->p_conn_info;
+    rplib_tpool_t          *p_tpool     = p_task_args->p_tpool;
+    rpchat_proc_event_res_t res         = RPCHAT_PROC_RES_DONE;
+
+    // update queue on conn info
+    atomic_fetch_sub(&p_conn_info->pending_jobs, 1);
+    // readiness reported by the reactor ends the io_uring poll it came from
+    if (RPCHAT_PROC_EVENT_INBOUND == p_task_args->args_type
+        && 0 != p_task_args->epoll_event.events)
+    {
+        atomic_store(&p_conn_info->b_poll_pending, false);
+    }
+    // waiting includes any wait for the lock; events unparked later are not
+    // timed
+    rpchat_metrics_count(RPCHAT_METRIC_TASKS, 1);
+    rpchat_metrics_record(RPCHAT_METRIC_TASK_WAIT, p_task_args->enqueued_ns);
+    p_task_args->enqueued_ns = 0;
+
+    while (NULL != p_task_args)
+    {
+        res = rpchat_conn_proc_run(p_task_args);
+        switch (res)
+        {
+            case RPCHAT_PROC_RES_AGAIN:
+                // state changed, process same event in new state
+                continue;
+            case RPCHAT_PROC_RES_DESTROYED:
+                // connection is gone, nothing more to release
+                rpchat_conn_proc_free_args(p_task_args);
+                return;
+            case RPCHAT_PROC_RES_PARK:
+                // could not defer, fall back to trying again later
+                if (RPLIB_SUCCESS != rpchat_conn_proc_park(p_task_args))
+                {
+                    if (!atomic_load(&p_tpool->b_terminate))
+                    {
+                        rpchat_conn_info_enqueue_task(
+                            p_conn_info,
+                            p_tpool,
+                            rpchat_task_conn_proc_event,
+                            p_task_args);
+                    }
+                }
+                else
+                {
+                    rpchat_metrics_count(RPCHAT_METRIC_PARKED, 1);
+                    // messages pile up while parked, keep them within budget
+                    if (RPCHAT_PROC_EVENT_OUTBOUND == p_task_args->args_type)
+                    {
+                        rpchat_conn_proc_trim_backlog(p_task_args);
+                    }
+                }
+                break;
+            default:
+                rpchat_conn_proc_free_args(p_task_args);
+                break;
+        }
+        // state may have changed, run deferred events that can now go, in
+        // the order they arrived
+        p_task_args = rpchat_conn_proc_unpark(p_conn_info);
+    }
+    // the connection may be destroyed as soon as it is unlocked
+    if (b_contended)
+    {
+        rplib_tpool_affinity_release(&p_conn_info->affinity);
+    }
+    rpchat_conn_proc_release(p_conn_info);
+}
+
+/**
+ * Task for an event whose connection was held when it first ran. These wait
+ * in line on the connection's affine queue, so at most one worker per
+ * connection blocks on its lock and none spins through the shared queue
+ * @param p_args Pointer to event args
+ */
+static void
+rpchat_task_conn_proc_contended(void *p_args)
+{
+    rpchat_args_proc_event_t *p_task_args = p_args;
+
+    pthread_mutex_lock(&p_task_args->p_conn_info->mutex_conn);
+    rpchat_conn_proc_drive(p_task_args, true);
+}
+
+void
+rpchat_task_conn_proc_event(void *p_args)
+{
+    rpchat_args_proc_event_t *p_task_args = NULL;
+    rpchat_conn_info_t       *p_conn_info = NULL;
+    rplib_tpool_t            *p_tpool     = NULL;
+    // cast args to access fields
+    p_task_args = (rpchat_args_proc_event_t *)p_args;
+    p_conn_info = (rpchat_conn_info_t *)p_task_args->p_conn_info;
+    p_tpool     = p_task_args->p_tpool;
+
+    // pinned connections only ever run one task at a time, no lock needed.
+    // Otherwise attempt lock, and wait in line behind the holder if another
+    // task has it. The task stays counted in pending_jobs meanwhile, so a
+    // closing task holding the lock cannot destroy the connection under it
+    if (!p_conn_info->b_affinity
+        && RPLIB_SUCCESS != pthread_mutex_trylock(&p_conn_info->mutex_conn))
+    {
+        rpchat_metrics_count(RPCHAT_METRIC_REQUEUES, 1);
+        if (!atomic_load(&p_tpool->b_terminate)
+            && RPLIB_SUCCESS
+                   == rplib_tpool_enqueue_affine(
+                       p_tpool,
+                       &p_conn_info->affinity,
+                       rpchat_task_conn_proc_contended,
+                       p_args))
+        {
+            return;
+        }
+        // no line to wait in, wait here
+        pthread_mutex_lock(&p_conn_info->mutex_conn);
+    }
+    rpchat_conn_proc_drive(p_task_args, false);
+}
+
+int
+rpchat_handle_msg(rpchat_conn_queue_t           *p_conn_queue,
+                  struct rpchat_connection_info *p_conn_info,
+                  rplib_tpool_t                 *p_tpool,
+                  rpchat_frame_t                *p_frame)
+{
+    int res = RPLIB_ERROR;
+
+    // get type
+    // server will only receive RPCHAT_BCP_REGISTER, RPCHAT_BCP_REGWIN,
+    // RPCHAT_BCP_STATUS, RPCHAT_BCP_ACK, RPCHAT_BCP_SEND, RPCHAT_BCP_SENDFILE,
+    // RPCHAT_BCP_GETFILE, RPCHAT_BCP_JOIN, RPCHAT_BCP_LEAVE and
+    // RPCHAT_BCP_ROOMSEND messages
+    switch (p_frame->msg_type)
+    {
+        case RPCHAT_BCP_REGISTER:
+            // drop down, REGWIN only adds the window
+        case RPCHAT_BCP_REGWIN:
+            // if registration fails, return ERROR to close connection
+            res = RPLIB_SUCCESS
+                          == rpchat_handle_register(
+                              p_conn_queue, p_conn_info, p_tpool, p_frame)
+                      ? RPLIB_SUCCESS
+                      : RPLIB_ERROR;
+            break;
+        case RPCHAT_BCP_SEND:
+            res = rpchat_handle_send(
+                p_conn_queue, p_conn_info, p_tpool, p_frame);
+            break;
+        case RPCHAT_BCP_STATUS:
+            // returns unsuccess if not looking for status
+            res = rpchat_conn_info_handle_status(p_conn_info, p_frame);
+            break;
+        case RPCHAT_BCP_ACK:
+            res = rpchat_conn_info_handle_ack(p_conn_info, p_frame);
+            break;
+        case RPCHAT_BCP_SENDFILE:
+            res = rpchat_handle_sendfile(p_conn_queue, p_conn_info, p_frame);
+            break;
+        case RPCHAT_BCP_GETFILE:
+            res = rpchat_handle_getfile(p_conn_queue, p_conn_info, p_frame);
+            break;
+        case RPCHAT_BCP_JOIN:
+            res = rpchat_handle_join(p_conn_queue, p_conn_info, p_frame);
+            break;
+        case RPCHAT_BCP_LEAVE:
+            res = rpchat_handle_leave(p_conn_queue, p_conn_info, p_frame);
+            break;
+        case RPCHAT_BCP_ROOMSEND:
+            res = rpchat_handle_roomsend(
+                p_conn_queue, p_conn_info, p_tpool, p_frame);
+            break;
+        default:
+            res = RPLIB_ERROR;
+            break;
+    }
+    // TODO: set neg status on failure to handle
+    return res;
+}
+
+int
+rpchat_handle_register(rpchat_conn_queue_t           *p_conn_queue,
+                       struct rpchat_connection_info *p_conn_info,
+                       rplib_tpool_t                 *p_tpool,
+                       rpchat_frame_t                *p_frame)
+{
+    int             res       = RPLIB_UNSUCCESS;
+    bool            b_pending = false; // other nodes have to agree first
+    rpchat_string_t sanitized_username; // stripped username
+
+    // check if connection eligible for registration
+    if (RPCHAT_CONN_PRE_REGISTER != p_conn_info->conn_status)
+    {
+        goto leave;
+    }
+
+    // username (length already validated by parser)
+    res = rpchat_string_sanitize(
+        &p_frame->contents, &sanitized_username, false);
+    // on sanitization failure, exit
+    if (RPLIB_SUCCESS != res)
+    {
+        goto leave;
+    }
+    // claim username, fails if any client already holds it (on any node,
+    // when federated)
+    if (NULL != p_conn_queue->p_cluster)
+    {
+        res = rpchat_cluster_claim_username(p_conn_queue->p_cluster,
+                                            p_conn_queue,
+                                            p_conn_info,
+                                            &sanitized_username,
+                                            &b_pending);
+    }
+    else
+    {
+        res = rpchat_conn_queue_claim_username(
+            p_conn_queue, p_conn_info, &sanitized_username);
+    }
+    if (RPLIB_SUCCESS != res)
+    {
+        res = RPLIB_UNSUCCESS;
+        goto leave;
+    }
+    // windowed delivery, capped; applies from the login DELIVER on
+    if (RPCHAT_BCP_REGWIN == p_frame->msg_type && 1 < p_frame->code)
+    {
+        p_conn_info->window = RPCHAT_CONN_MAX_WINDOW < p_frame->code
+                                  ? RPCHAT_CONN_MAX_WINDOW
+                                  : p_frame->code;
+    }
+    // welcomed once every other node agreed
+    if (b_pending)
+    {
+        p_conn_info->conn_status = RPCHAT_CONN_CLAIMING;
+        goto leave;
+    }
+    rpchat_conn_proc_welcome(p_conn_queue, p_conn_info, p_tpool);
+leave:
+    return res;
+}
+
+int
+rpchat_handle_send(rpchat_conn_queue_t           *p_conn_queue,
+                   struct rpchat_connection_info *p_sender_info,
+                   rplib_tpool_t                 *p_tpool,
+                   rpchat_frame_t                *p_frame)
+{
+    int                      res       = RPLIB_UNSUCCESS;
+    rpchat_backlog_policy_t *p_backlog = p_conn_queue->p_backlog;
+    rpchat_string_t          sanitized_msg;
+
+    // slow readers hold too much already, refuse until they catch up
+    if (NULL != p_backlog
+        && p_backlog->watermark
+               <= atomic_load_explicit(&p_backlog->sz_queued,
+                                       memory_order_relaxed))
+    {
+        p_sender_info->stat_msg_id = RPCHAT_STAT_MSG_BUSY;
+        res                        = RPLIB_SUCCESS;
+        goto leave;
+    }
+    // message (length already validated by parser)
+    rpchat_string_sanitize(&p_frame->contents, &sanitized_msg, true);
+    if (1 > sanitized_msg.len)
+    {
+        goto leave;
+    }
+    // send to all
+    res = rpchat_broadcast_msg(p_conn_queue,
+                               p_sender_info,
+                               &p_sender_info->username,
+                               p_tpool,
+                               &sanitized_msg);
+leave:
+    return res;
+}
+
+int
+rpchat_handle_join(rpchat_conn_queue_t           *p_conn_queue,
+                   struct rpchat_connection_info *p_conn_info,
+                   rpchat_frame_t                *p_frame)
+{
+    int res = RPLIB_UNSUCCESS;
+
+    // rooms are for registered clients only
+    if (0 == p_conn_info->username.len)
+    {
+        goto leave;
+    }
+    // refusals are answered with a negative STATUS, the client stays
+    res = RPLIB_SUCCESS;
+    if (RPLIB_SUCCESS
+        != rpchat_room_index_check_name(p_frame->room, p_frame->room_len))
+    {
+        p_conn_info->stat_msg_id = RPCHAT_STAT_MSG_BAD_ROOM;
+        goto leave;
+    }
+    res = rpchat_conn_queue_join_room(
+        p_conn_queue, p_conn_info, p_frame->room, p_frame->room_len);
+    if (RPLIB_UNSUCCESS == res)
+    {
+        p_conn_info->stat_msg_id = RPCHAT_STAT_MSG_ROOMS;
+        res                      = RPLIB_SUCCESS;
+    }
+leave:
+    return res;
+}
+
+int
+rpchat_handle_leave(rpchat_conn_queue_t           *p_conn_queue,
+                    struct rpchat_connection_info *p_conn_info,
+                    rpchat_frame_t                *p_frame)
+{
+    int res = RPLIB_UNSUCCESS;
+
+    if (0 == p_conn_info->username.len)
+    {
+        goto leave;
+    }
+    // rooms not joined are answered with a negative STATUS
+    res = RPLIB_SUCCESS;
+    if (RPLIB_SUCCESS
+        != rpchat_conn_queue_leave_room(
+            p_conn_queue, p_conn_info, p_frame->room, p_frame->room_len))
+    {
+        p_conn_info->stat_msg_id = RPCHAT_STAT_MSG_NO_ROOM;
+    }
+leave:
+    return res;
+}
+
+int
+rpchat_handle_roomsend(rpchat_conn_queue_t           *p_conn_queue,
+                       struct rpchat_connection_info *p_sender_info,
+                       rplib_tpool_t                 *p_tpool,
+                       rpchat_frame_t                *p_frame)
+{
+    int                      res       = RPLIB_UNSUCCESS;
+    rpchat_backlog_policy_t *p_backlog = p_conn_queue->p_backlog;
+    rpchat_string_t          sanitized_msg;
+
+    if (0 == p_sender_info->username.len)
+    {
+        goto leave;
+    }
+    // refusals are answered with a negative STATUS, the client stays
+    res = RPLIB_SUCCESS;
+    if (NULL != p_backlog
+        && p_backlog->watermark
+               <= atomic_load_explicit(&p_backlog->sz_queued,
+                                       memory_order_relaxed))
+    {
+        p_sender_info->stat_msg_id = RPCHAT_STAT_MSG_BUSY;
+        goto leave;
+    }
+    // only members speak in a room; rooms of a connection only change in its
+    // own tasks, so this holds until the broadcast
+    if (NULL
+        == rpchat_room_index_joined(
+            p_sender_info, p_frame->room, p_frame->room_len))
+    {
+        p_sender_info->stat_msg_id = RPCHAT_STAT_MSG_NO_ROOM;
+        goto leave;
+    }
+    // message (length already validated by parser)
+    rpchat_string_sanitize(&p_frame->contents, &sanitized_msg, true);
+    if (1 > sanitized_msg.len)
+    {
+        res = RPLIB_UNSUCCESS;
+        goto leave;
+    }
+    res = rpchat_broadcast_room(p_conn_queue,
+                                p_sender_info,
+                                p_tpool,
+                                p_frame->room,
+                                p_frame->room_len,
+                                &sanitized_msg);
+leave:
+    return res;
+}
+
+int
+rpchat_handle_sendfile(rpchat_conn_queue_t           *p_conn_queue,
+                       struct rpchat_connection_info *p_sender_info,
+                       rpchat_frame_t                *p_frame)
+{
+    int                 res    = RPLIB_ERROR;
+    rpchat_file_xfer_t *p_xfer = NULL;
+
+    // only one request at a time
+    if (RPCHAT_CONN_AVAILABLE != p_sender_info->conn_status)
+    {
+        goto leave;
+    }
+    // contents are taken even if they will not be stored, the stream has to
+    // get past them
+    p_xfer = rpchat_file_xfer_begin_upload(p_conn_queue->p_pool,
+                                           p_conn_queue->p_file_cache,
+                                           p_conn_queue->h_fd_file_dir,
+                                           p_sender_info->h_fd,
+                                           &p_frame->contents,
+                                           p_frame->file_len);
+    if (NULL == p_xfer)
+    {
+        goto leave;
+    }
+    p_sender_info->p_xfer      = p_xfer;
+    p_sender_info->conn_status = RPCHAT_CONN_RECV_FILE;
+    res                        = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+int
+rpchat_handle_getfile(rpchat_conn_queue_t           *p_conn_queue,
+                      struct rpchat_connection_info *p_sender_info,
+                      rpchat_frame_t                *p_frame)
+{
+    int                 res    = RPLIB_ERROR;
+    rpchat_file_xfer_t *p_xfer = NULL;
+
+    if (RPCHAT_CONN_AVAILABLE != p_sender_info->conn_status)
+    {
+        goto leave;
+    }
+    p_xfer = rpchat_file_xfer_begin_download(p_conn_queue->p_pool,
+                                             p_conn_queue->p_file_cache,
+                                             p_conn_queue->h_fd_file_dir,
+                                             &p_frame->contents);
+    // nothing to serve, tell the client with a status instead
+    if (NULL == p_xfer)
+    {
+        p_sender_info->stat_msg_id = RPCHAT_STAT_MSG_NO_FILE;
+        res                        = RPLIB_SUCCESS;
+        goto leave;
+    }
+    // header goes out through the queue, contents follow it straight from
+    // the file (or its cached mapping)
+    if (RPLIB_SUCCESS
+        != rpchat_conn_info_queue_outbound(p_sender_info,
+                                           (char *)&p_xfer->header,
+                                           sizeof(p_xfer->header)))
+    {
+        rpchat_file_xfer_destroy(p_xfer);
+        goto leave;
+    }
+    p_sender_info->p_xfer      = p_xfer;
+    p_sender_info->conn_status = RPCHAT_CONN_SEND_FILE;
+    res                        = RPLIB_SUCCESS;
+leave:
+    return res;
+}
+
+/**
+ * Helper function to note a queue has enqueued a timed message with all of
+ * its clients; the last queue to do so records how long it took
+ * @param p_shared_msg Pointer to encoded message
+ */
+static void
+rpchat_conn_proc_fanned_out(rpchat_shared_msg_t *p_shared_msg)
+{
+    if (0 != p_shared_msg->origin_ns
+        && 1 == atomic_fetch_sub(&p_shared_msg->fan_outs_left, 1))
+    {
+        rpchat_metrics_record(RPCHAT_METRIC_SEND_FAN_OUT,
+                              p_shared_msg->origin_ns);
+    }
+}
+
+/**
+ * Helper function to enqueue an encoded message with every client of
+ * a single connection queue (except sender)
+ * @param p_conn_queue Pointer to connection Queue
+ * @param p_sender_info Pointer to sender connection info; NULL if sender is
+ * not connected to this queue
+ * @param p_tpool Pointer to threadpool managing tasks
+ * @param p_shared_msg Pointer to encoded message; recipients take their own
+ * references
+ */
+static void
+rpchat_conn_proc_fan_out(rpchat_conn_queue_t           *p_conn_queue,
+                         struct rpchat_connection_info *p_sender_info,
+                         rplib_tpool_t                 *p_tpool,
+                         rpchat_shared_msg_t           *p_shared_msg)
+{
+    struct rpchat_connection_info *p_current_info = NULL;
+    rpchat_conn_snapshot_t        *p_snapshot     = NULL; // clients listed
+    size_t                         conn_index     = 0;
 
-                goto cleanup_no_unlock;
-            }
-        default:
-            break;
+    // walked without the list lock, accepts and closes carry on meanwhile
+    p_snapshot = rpchat_conn_queue_acquire_snapshot(p_conn_queue);
+    for (conn_index = 0; conn_index < p_snapshot->num_conns; conn_index++)
+    {
+        p_current_info = p_snapshot->p_conns[conn_index];
+        // skip sender, anyone not yet registered (a DELIVER would leave them
+        // awaiting a status and reject their REGISTER), and anyone closing or
+        // in error state
+        if (p_sender_info == p_current_info
+            || 0 == p_current_info->username.len
+            || RPCHAT_CONN_CLAIMING == p_current_info->conn_status
+            || RPCHAT_CONN_CLOSING == p_current_info->conn_status
+            || RPCHAT_CONN_ERR == p_current_info->conn_status)
+        {
+            continue;
+        }
+        rpchat_conn_proc_enqueue_deliver(
+            p_current_info, p_conn_queue, p_tpool, p_shared_msg);
     }
-    // on error occurred during switch branching, change state
-    if (RPLIB_ERROR == res)
+    rpchat_conn_queue_release_snapshot(p_conn_queue, p_snapshot);
+    rpchat_conn_proc_fanned_out(p_shared_msg);
+}
+
+/**
+ * Helper function to hand an encoded message to every client of this queue
+ * (except sender) and to the mailbox of every other reactor
+ * @param p_conn_queue Pointer to queue containing conn info objects
+ * @param p_sender_info Pointer to sender connection info
+ * @param p_tpool Pointer to threadpool managing tasks
+ * @param p_shared_msg Pointer to encoded message; recipients take their own
+ * references
+ */
+static void
+rpchat_conn_proc_share(rpchat_conn_queue_t           *p_conn_queue,
+                       struct rpchat_connection_info *p_sender_info,
+                       rplib_tpool_t                 *p_tpool,
+                       rpchat_shared_msg_t           *p_shared_msg)
+{
+    rpchat_conn_queue_t *p_peer     = NULL; // queue of another reactor
+    size_t               peer_index = 0;    // index for peer loop
+
+    rpchat_metrics_count(RPCHAT_METRIC_BROADCASTS, 1);
+    // this queue and every peer fan out once; peers only know of queues
+    // when there are several
+    atomic_store(&p_shared_msg->fan_outs_left,
+                 1 < p_conn_queue->num_peers ? (int)p_conn_queue->num_peers
+                                             : 1);
+    rpchat_conn_proc_fan_out(
+        p_conn_queue, p_sender_info, p_tpool, p_shared_msg);
+    // other reactors fan out to their own connections
+    for (peer_index = 0; peer_index < p_conn_queue->num_peers; peer_index++)
     {
-        p_conn_info->conn_status = RPCHAT_CONN_ERR;
-        goto requeue;
+        p_peer = rpchat_conn_queue_get_peer(p_conn_queue, peer_index);
+        if (p_conn_queue != p_peer
+            && RPLIB_SUCCESS
+                   != rpchat_conn_queue_post_mail(p_peer, p_shared_msg))
+        {
+            rpchat_conn_proc_fanned_out(p_shared_msg);
+        }
     }
-cleanup:
-    pthread_mutex_unlock(&p_conn_info->mutex_conn);
-cleanup_no_unlock:
-    free(p_task_args->p_msg_buf);
-    p_task_args->p_msg_buf = NULL;
-    free(p_args);
-    goto leave;
-requeue:
-    pthread_mutex_unlock(&p_conn_info->mutex_conn);
-requeue_no_unlock:
-    // only requeue if not closing
-    if (!atomic_load(&p_tpool->b_terminate))
+    // other nodes get it once each and fan it out themselves; files stay on
+    // the node they were uploaded to, so their notices do too
+    if (NULL != p_conn_queue->p_cluster
+        && RPCHAT_BCP_DELIVER == p_shared_msg->contents[0])
     {
-        rpchat_conn_info_enqueue_task(
-            p_conn_info, p_tpool, rpchat_task_conn_proc_event, p_args);
+        rpchat_cluster_forward(p_conn_queue->p_cluster, p_shared_msg);
     }
-leave:
-    return;
 }
 
 int
-rpchat_handle_msg(rpchat_conn_queue_t           *p_conn_queue,
-                  struct rpchat_connection_info *p_conn_info,
-                  rplib_tpool_t                 *p_tpool,
-                  char                          *p_msg_buf)
+rpchat_broadcast_msg(rpchat_conn_queue_t           *p_conn_queue,
+                     struct rpchat_connection_info *p_sender_info,
+                     rpchat_conn_name_t            *p_sender_name,
+                     rplib_tpool_t                 *p_tpool,
+                     rpchat_string_t               *p_msg)
 {
-    int res = RPLIB_ERROR;
+    int                  res = RPLIB_UNSUCCESS;
+    rpchat_string_t      sanitized_msg;
+    rpchat_shared_msg_t *p_shared_msg = NULL; // encoded once
+    uint64_t             origin_ns    = rpchat_metrics_now(); // fan-out start
 
-    enum rpchat_message_type msg_type = rpchat_get_msg_type(p_msg_buf);
-    // get type
-    // server will only receive RPCHAT_BCP_REGISTER, RPCHAT_BCP_STATUS, and
-    // RPCHAT_BCP_SEND messages
-    switch (msg_type)
+    // sanitize, unless the caller already did
+    if (!p_msg->b_sanitized)
     {
-        case RPCHAT_BCP_REGISTER:
-            // if registration fails, return ERROR to close connection
-            res = RPLIB_SUCCESS
-                          == rpchat_handle_register(
-                              p_conn_queue, p_conn_info, p_tpool)
-                      ? RPLIB_SUCCESS
-                      : RPLIB_ERROR;
-            break;
-        case RPCHAT_BCP_SEND:
-            res = rpchat_handle_send(p_conn_queue, p_conn_info, p_tpool);
-            break;
-        case RPCHAT_BCP_STATUS:
-            // returns unsuccess if not looking for status
-            res = rpchat_conn_info_handle_status(p_conn_info);
-            break;
-        default:
-            res = RPLIB_ERROR;
-            break;
+        rpchat_string_sanitize(p_msg, &sanitized_msg, true);
+        p_msg = &sanitized_msg;
     }
-    // TODO: set neg status on failure to handle
+
+    // if no passed username, use the calling conn_info username
+    if (!p_sender_name)
+    {
+        p_sender_name = &p_sender_info->username;
+    }
+
+    // logging, handed off to the writer thread
+    rpchat_log_write(
+        RPCHAT_LOG_INFO, "%s: %s", p_sender_name->p_contents, p_msg->contents);
+
+    // encode DELIVER once, every recipient references the same bytes
+    p_shared_msg = rpchat_conn_proc_create_deliver(
+        p_conn_queue->p_pool, p_sender_name, p_msg);
+    if (NULL == p_shared_msg)
+    {
+        goto leave;
+    }
+    p_shared_msg->origin_ns = origin_ns;
+
+    // create broadcasts
+    rpchat_conn_proc_share(p_conn_queue, p_sender_info, p_tpool, p_shared_msg);
+    res = RPLIB_SUCCESS;
+
+    // recipients hold their own references
+    rpchat_shared_msg_release(p_shared_msg);
+    p_shared_msg = NULL;
+leave:
     return res;
 }
 
 int
-rpchat_handle_register(rpchat_conn_queue_t           *p_conn_queue,
-                       struct rpchat_connection_info *p_conn_info,
-                       rplib_tpool_t                 *p_tpool)
+rpchat_broadcast_room(rpchat_conn_queue_t           *p_conn_queue,
+                      struct rpchat_connection_info *p_sender_info,
+                      rplib_tpool_t                 *p_tpool,
+                      const char                    *p_room_name,
+                      uint16_t                       room_len,
+                      rpchat_string_t               *p_msg)
 {
-    int                   res = RPLIB_UNSUCCESS;
-    rpchat_pkt_register_t reg_info;           // msg storage
-    rpchat_string_t       new_username;       // original username
-    rpchat_string_t       sanitized_username; // stripped username
-    rpchat_string_t       group_reg_msg;      // for other clients
-    rpchat_string_t       client_reg_msg;     // for this client
+    int                   res          = RPLIB_UNSUCCESS;
+    rpchat_shared_msg_t  *p_shared_msg = NULL; // encoded once
+    rpchat_room_t        *p_room       = NULL; // room of sender, locked
+    rpchat_room_member_t *p_member     = NULL; // recipient
+    size_t                member_index = 0;    // index for member loop
+    uint64_t              origin_ns    = rpchat_metrics_now(); // fan-out start
+    rpchat_room_member_t  stack_members[RPCHAT_ROOM_STACK_MEMBERS];
+    rpchat_room_member_t *p_members    = stack_members; // copied under lock
+    rpchat_room_member_t *p_grown      = NULL;
+    size_t                capacity     = RPCHAT_ROOM_STACK_MEMBERS;
+    size_t                num_members  = 0; // # entries copied to p_members
+    rpchat_conn_snapshot_t *pinned[RPCHAT_CONN_QUEUE_MAX_PEERS]; // per peer
+    size_t                  peer_index = 0; // index for peer loops
 
-    // check if connection eligible for registration
-    if (RPCHAT_CONN_PRE_REGISTER != p_conn_info->conn_status)
+    rpchat_log_write(RPCHAT_LOG_INFO,
+                     "%s@%.*s: %s",
+                     p_sender_info->username.p_contents,
+                     (int)room_len,
+                     p_room_name,
+                     p_msg->contents);
+
+    p_shared_msg
+        = rpchat_conn_proc_create_room_deliver(p_conn_queue->p_pool,
+                                               p_room_name,
+                                               room_len,
+                                               &p_sender_info->username,
+                                               p_msg);
+    if (NULL == p_shared_msg)
     {
         goto leave;
     }
+    p_shared_msg->origin_ns = origin_ns;
+    atomic_store(&p_shared_msg->fan_outs_left, 1);
+    rpchat_metrics_count(RPCHAT_METRIC_BROADCASTS, 1);
 
-    // get fields
-    // username length
-    if (sizeof(reg_info.username.len)
-        != rpchat_recv(p_conn_info->h_fd,
-                       (char *)&reg_info.username.len,
-                       sizeof(reg_info.username.len)))
+    // members leave their rooms before they are unlinked, so a snapshot of
+    // every queue taken first keeps each member copied below alive until
+    // released; the room lock is only held for the copy
+    for (peer_index = 0; peer_index < p_conn_queue->num_peers; peer_index++)
     {
-        goto leave;
+        pinned[peer_index] = rpchat_conn_queue_acquire_snapshot(
+            rpchat_conn_queue_get_peer(p_conn_queue, peer_index));
     }
-    reg_info.username.len = be16toh(reg_info.username.len);
-    // if larger than authorized, kill
-    if (RPCHAT_MAX_STR_LENGTH < reg_info.username.len)
+    for (;;)
     {
-        goto leave;
+        rpchat_conn_queue_lock_rooms(p_conn_queue);
+        p_room
+            = rpchat_room_index_joined(p_sender_info, p_room_name, room_len);
+        num_members = NULL == p_room ? 0 : p_room->num_members;
+        if (num_members <= capacity)
+        {
+            if (0 < num_members)
+            {
+                memcpy(p_members,
+                       p_room->p_members,
+                       num_members * sizeof(rpchat_room_member_t));
+            }
+            rpchat_conn_queue_unlock_rooms(p_conn_queue);
+            break;
+        }
+        rpchat_conn_queue_unlock_rooms(p_conn_queue);
+        // grown outside the lock, then copied again; it may have changed
+        p_grown = realloc(stack_members == p_members ? NULL : p_members,
+                          num_members * sizeof(rpchat_room_member_t));
+        if (NULL == p_grown)
+        {
+            num_members = 0;
+            goto cleanup;
+        }
+        p_members = p_grown;
+        capacity  = num_members;
     }
-    // username
-    if (reg_info.username.len
-        != rpchat_recv(p_conn_info->h_fd,
-                       (char *)&reg_info.username.contents,
-                       reg_info.username.len))
+    // each member is enqueued with the queue of its own reactor
+    for (member_index = 0; member_index < num_members; member_index++)
     {
-        goto leave;
+        p_member = &p_members[member_index];
+        if (p_sender_info == p_member->p_conn_info
+            || RPCHAT_CONN_CLOSING == p_member->p_conn_info->conn_status
+            || RPCHAT_CONN_ERR == p_member->p_conn_info->conn_status)
+        {
+            continue;
+        }
+        rpchat_conn_proc_enqueue_deliver(p_member->p_conn_info,
+                                         p_member->p_conn_queue,
+                                         p_tpool,
+                                         p_shared_msg);
     }
-    new_username = reg_info.username;
-    res = rpchat_string_sanitize(&new_username, &sanitized_username, false);
-    // on sanitization failure, exit
-    if (RPLIB_SUCCESS != res)
+    res = RPLIB_SUCCESS;
+cleanup:
+    for (peer_index = 0; peer_index < p_conn_queue->num_peers; peer_index++)
     {
-        goto leave;
+        rpchat_conn_queue_release_snapshot(
+            rpchat_conn_queue_get_peer(p_conn_queue, peer_index),
+            pinned[peer_index]);
     }
-    // check for existing username. Want NULL
-    if (NULL
-        != rpchat_conn_queue_find_by_username(p_conn_queue,
-                                              &sanitized_username))
+    if (stack_members != p_members)
     {
-        res = RPLIB_UNSUCCESS;
-        goto leave;
+        free(p_members);
     }
-    // update connection object
-    memcpy(
-        &p_conn_info->username, &sanitized_username, sizeof(rpchat_string_t));
+    rpchat_conn_proc_fanned_out(p_shared_msg);
+    rpchat_shared_msg_release(p_shared_msg);
+    p_shared_msg = NULL;
+leave:
+    return res;
+}
 
-    // notify other clients of this registration
-    // create message
-    group_reg_msg.len = snprintf(group_reg_msg.contents,
-                                 RPCHAT_MAX_STR_LENGTH,
-                                 "%s has joined the server.",
-                                 sanitized_username.contents);
+int
+rpchat_broadcast_file(rpchat_conn_queue_t           *p_conn_queue,
+                      struct rpchat_connection_info *p_sender_info,
+                      rplib_tpool_t                 *p_tpool,
+                      rpchat_string_t               *p_file_name)
+{
+    int                  res = RPLIB_UNSUCCESS;
+    rpchat_string_t      sanitized_name;
+    rpchat_shared_msg_t *p_shared_msg = NULL; // encoded once
 
-    client_reg_msg.len = snprintf(client_reg_msg.contents,
-                                  RPCHAT_MAX_STR_LENGTH,
-                                  "Logged in as %s.\nCurrent Clients: \n",
-                                  p_conn_info->username.contents);
-    if (1 < p_conn_queue->p_conn_ll->size)
+    if (!p_file_name->b_sanitized)
     {
-        rpchat_conn_queue_list_users(p_conn_queue, &client_reg_msg);
+        rpchat_string_sanitize(p_file_name, &sanitized_name, false);
+        p_file_name = &sanitized_name;
     }
 
-    // enqueue message with registering client
-    rpchat_conn_proc_enqueue_deliver(p_conn_info,
-                                     p_conn_queue,
-                                     p_tpool,
-                                     &p_conn_queue->server_str,
-                                     &client_reg_msg);
+    rpchat_log_write(RPCHAT_LOG_INFO,
+                     "%s uploaded %s",
+                     p_sender_info->username.p_contents,
+                     p_file_name->contents);
 
-    // send to all
-    rpchat_broadcast_msg(p_conn_queue,
-                         p_conn_info,
-                         &p_conn_queue->server_str,
-                         p_tpool,
-                         &group_reg_msg);
-    // success
+    p_shared_msg = rpchat_conn_proc_create_pair(p_conn_queue->p_pool,
+                                                RPCHAT_BCP_FNOTIFY,
+                                                &p_sender_info->username,
+                                                p_file_name);
+    if (NULL == p_shared_msg)
+    {
+        goto leave;
+    }
+    rpchat_conn_proc_share(p_conn_queue, p_sender_info, p_tpool, p_shared_msg);
     res = RPLIB_SUCCESS;
+
+    rpchat_shared_msg_release(p_shared_msg);
+    p_shared_msg = NULL;
 leave:
     return res;
 }
 
 int
-rpchat_handle_send(rpchat_conn_queue_t           *p_conn_queue,
-                   struct rpchat_connection_info *p_sender_info,
-                   rplib_tpool_t                 *p_tpool)
+rpchat_broadcast_notice(rpchat_conn_queue_t *p_conn_queue,
+                        rpchat_string_t     *p_msg)
 {
-    int             res = RPLIB_UNSUCCESS;
-    rpchat_string_t curr_msg;
-    rpchat_string_t sanitized_msg;
+    int                  res = RPLIB_UNSUCCESS;
+    rpchat_string_t      sanitized_msg;
+    rpchat_shared_msg_t *p_shared_msg = NULL; // encoded once
+    size_t               num_queues   = 0;    // reactors of this node
+    size_t               queue_index  = 0;    // index for queue loop
 
-    // get rest of message
-    // message length
-    if (sizeof(curr_msg.len)
-        != rpchat_recv(
-            p_sender_info->h_fd, (char *)&curr_msg.len, sizeof(curr_msg.len)))
+    if (!p_msg->b_sanitized)
     {
-        goto leave;
+        rpchat_string_sanitize(p_msg, &sanitized_msg, true);
+        p_msg = &sanitized_msg;
     }
-    curr_msg.len = be16toh(curr_msg.len);
-    // if larger than authorized, kill
-    if (RPCHAT_MAX_STR_LENGTH < curr_msg.len)
+    rpchat_log_write(RPCHAT_LOG_INFO,
+                     "%s: %s",
+                     p_conn_queue->server_name.p_contents,
+                     p_msg->contents);
+
+    p_shared_msg = rpchat_conn_proc_create_deliver(
+        p_conn_queue->p_pool, &p_conn_queue->server_name, p_msg);
+    if (NULL == p_shared_msg)
     {
         goto leave;
     }
-    // message
-    if (curr_msg.len
-        != rpchat_recv(
-            p_sender_info->h_fd, (char *)&curr_msg.contents, curr_msg.len))
+    // no sender, so every reactor fans out from its mailbox, this one too
+    num_queues = 0 < p_conn_queue->num_peers ? p_conn_queue->num_peers : 1;
+    for (queue_index = 0; queue_index < num_queues; queue_index++)
     {
-        goto leave;
+        rpchat_conn_queue_post_mail(
+            rpchat_conn_queue_get_peer(p_conn_queue, queue_index),
+            p_shared_msg);
     }
-    rpchat_string_sanitize(&curr_msg, &sanitized_msg, true);
-    if (1 > sanitized_msg.len)
+    res = RPLIB_SUCCESS;
+
+    rpchat_shared_msg_release(p_shared_msg);
+    p_shared_msg = NULL;
+leave:
+    return res;
+}
+
+int
+rpchat_resolve_claim(rpchat_conn_queue_t *p_conn_queue,
+                     rpchat_conn_info_t  *p_conn_info,
+                     rplib_tpool_t       *p_tpool,
+                     bool                 b_granted)
+{
+    int                       res               = RPLIB_UNSUCCESS;
+    rpchat_args_proc_event_t *p_proc_event_args = NULL;
+
+    p_proc_event_args = rplib_pool_alloc(p_conn_queue->p_pool,
+                                         sizeof(rpchat_args_proc_event_t));
+    if (NULL == p_proc_event_args)
     {
+        res = RPLIB_ERROR;
         goto leave;
     }
-    // send to all
-    res = rpchat_broadcast_msg(p_conn_queue,
-                               p_sender_info,
-                               &p_sender_info->username,
-                               p_tpool,
-                               &sanitized_msg);
+    p_proc_event_args->args_type    = RPCHAT_PROC_EVENT_CLAIM;
+    p_proc_event_args->p_conn_queue = p_conn_queue;
+    p_proc_event_args->p_conn_info  = p_conn_info;
+    p_proc_event_args->p_tpool      = p_tpool;
+    p_proc_event_args->p_msg_buf    = NULL;
+    p_proc_event_args->sz_msg_buf   = 0;
+    p_proc_event_args->p_shared_msg = NULL;
+    p_proc_event_args->b_charged    = false;
+    p_proc_event_args->b_granted    = b_granted;
+    p_proc_event_args->enqueued_ns  = rpchat_metrics_now();
+    res = rpchat_conn_info_enqueue_task(p_conn_info,
+                                        p_tpool,
+                                        rpchat_task_conn_proc_event,
+                                        p_proc_event_args);
+    if (RPLIB_SUCCESS != res)
+    {
+        rplib_pool_free(p_conn_queue->p_pool, p_proc_event_args);
+        p_proc_event_args = NULL;
+    }
 leave:
     return res;
 }
 
 int
-rpchat_broadcast_msg(rpchat_conn_queue_t           *p_conn_queue,
-                     struct rpchat_connection_info *p_sender_info,
-                     rpchat_string_t               *p_sender_str,
-                     rplib_tpool_t                 *p_tpool,
-                     rpchat_string_t               *p_msg)
+rpchat_wake_connection(rpchat_conn_queue_t *p_conn_queue,
+                       rpchat_conn_info_t  *p_conn_info,
+                       rplib_tpool_t       *p_tpool)
 {
-    int                            res = RPLIB_UNSUCCESS;
-    rpchat_string_t                sanitized_msg;
-    struct rplib_ll_queue_node    *p_current_node = NULL;
-    struct rpchat_connection_info *p_current_info = NULL;
-    int                            index          = 0;
+    return rpchat_conn_proc_enqueue_heartbeat(
+        p_conn_info, p_conn_queue, p_tpool);
+}
 
-    // sanitize
-    rpchat_string_sanitize(p_msg, &sanitized_msg, true);
+int
+rpchat_resume_connection(rpchat_conn_queue_t *p_conn_queue,
+                         rpchat_conn_info_t  *p_conn_info,
+                         rplib_tpool_t       *p_tpool)
+{
+    return rpchat_conn_proc_enqueue_inbound(p_conn_info, p_conn_queue, p_tpool);
+}
 
-    // if no passed username, use the calling conn_info username
-    if (!p_sender_str)
+int
+rpchat_park_outbound(rpchat_conn_queue_t *p_conn_queue,
+                     rpchat_conn_info_t  *p_conn_info,
+                     rplib_tpool_t       *p_tpool,
+                     const char          *p_msg,
+                     size_t               sz_msg,
+                     bool                 b_delivery)
+{
+    int                       res               = RPLIB_ERROR;
+    rpchat_args_proc_event_t *p_proc_event_args = NULL;
+
+    // statuses live in buffers of one size
+    if (!b_delivery && sizeof(rpchat_pkt_status_t) < sz_msg)
     {
-        p_sender_str = &p_sender_info->username;
+        goto leave;
     }
-
-    // logging
-    printf("%s: %s\n", p_sender_str->contents, sanitized_msg.contents);
-
-    // create broadcasts
-    assert(NULL != &p_conn_queue->mutex_conn_ll);
-    pthread_mutex_lock(&p_conn_queue->mutex_conn_ll);
-    p_current_node = p_conn_queue->p_conn_ll->p_front;
-    while (NULL != p_current_node)
-    {
-        if (p_sender_info != p_current_node->p_data)
-        {
-            p_current_info
-                = (struct rpchat_connection_info *)p_current_node->p_data;
-            // if closing or in error state, skip
-            if (RPCHAT_CONN_CLOSING == p_current_info->conn_status
-                || RPCHAT_CONN_ERR == p_current_info->conn_status)
-            {
-                continue;
-            }
-            rpchat_conn_proc_enqueue_deliver(p_current_info,
-                                             p_conn_queue,
-                                             p_tpool,
-                                             p_sender_str,
-                                             &sanitized_msg);
+    p_proc_event_args = rplib_pool_alloc(p_conn_queue->p_pool,
+                                         sizeof(rpchat_args_proc_event_t));
+    if (NULL == p_proc_event_args)
+    {
+        goto leave;
+    }
+    p_proc_event_args->args_type    = RPCHAT_PROC_EVENT_OUTBOUND;
+    p_proc_event_args->p_conn_queue = p_conn_queue;
+    p_proc_event_args->p_conn_info  = p_conn_info;
+    p_proc_event_args->p_tpool      = p_tpool;
+    p_proc_event_args->p_msg_buf    = NULL;
+    p_proc_event_args->sz_msg_buf   = 0;
+    p_proc_event_args->p_shared_msg = NULL;
+    p_proc_event_args->b_charged    = false;
+    p_proc_event_args->enqueued_ns  = 0;
+    if (b_delivery)
+    {
+        p_proc_event_args->p_shared_msg
+            = rpchat_shared_msg_create(p_conn_queue->p_pool, sz_msg);
+        if (NULL == p_proc_event_args->p_shared_msg)
+        {
+            goto cleanup;
+        }
+        memcpy(p_proc_event_args->p_shared_msg->contents, p_msg, sz_msg);
+        rpchat_conn_proc_charge(p_proc_event_args);
+    }
+    else
+    {
+        p_proc_event_args->p_msg_buf = rplib_pool_alloc(
+            p_conn_queue->p_pool, sizeof(rpchat_pkt_status_t));
+        if (NULL == p_proc_event_args->p_msg_buf)
+        {
+            goto cleanup;
         }
-        index++;
-        p_current_node = p_current_node->p_next_node;
+        memcpy(p_proc_event_args->p_msg_buf, p_msg, sz_msg);
+        p_proc_event_args->sz_msg_buf = sz_msg;
+    }
+    if (RPLIB_SUCCESS != rpchat_conn_proc_park(p_proc_event_args))
+    {
+        goto cleanup;
     }
     res = RPLIB_SUCCESS;
-
-    pthread_mutex_unlock(&p_conn_queue->mutex_conn_ll);
+    goto leave;
+cleanup:
+    rpchat_conn_proc_free_args(p_proc_event_args);
+    p_proc_event_args = NULL;
+leave:
     return res;
 }
+
 int
-rpchat_conn_info_handle_status(rpchat_conn_info_t *p_conn_info)
+rpchat_conn_info_handle_status(rpchat_conn_info_t *p_conn_info,
+                               rpchat_frame_t     *p_frame)
 {
-    int                 res = RPLIB_UNSUCCESS;
-    rpchat_pkt_status_t status_msg;
+    int res = RPLIB_UNSUCCESS;
     // asserts
     assert(p_conn_info);
 
-    // if status is not pending, exit
-    if (RPCHAT_CONN_PENDING_STATUS != p_conn_info->conn_status)
-    {
-        goto leave;
-    }
-
-    // get rest of message
-    // status code
-    if (sizeof(status_msg.code)
-        != rpchat_recv(p_conn_info->h_fd,
-                       (char *)&status_msg.code,
-                       sizeof(status_msg.code)))
+    // if nothing awaits a status, exit
+    if (0 == p_conn_info->in_flight)
     {
         goto leave;
     }
 
-    // handle status
-    if (RPCHAT_BCP_STATUS_GOOD == status_msg.code)
+    // handle status, acknowledging the oldest message sent
+    if (RPCHAT_BCP_STATUS_GOOD == p_frame->code)
     {
+        rpchat_conn_proc_note_acked(p_conn_info, 1);
+        p_conn_info->in_flight--;
         res = RPLIB_SUCCESS;
     }
     else
@@ -853,6 +2797,32 @@ rpchat_conn_info_handle_status(rpchat_conn_info_t *p_conn_info)
 leave:
     return res;
 }
+
+int
+rpchat_conn_info_handle_ack(rpchat_conn_info_t *p_conn_info,
+                            rpchat_frame_t     *p_frame)
+{
+    int res = RPLIB_UNSUCCESS;
+
+    assert(p_conn_info);
+
+    // only clients that registered with a window acknowledge in bulk
+    if (1 >= p_conn_info->window)
+    {
+        goto leave;
+    }
+    // acknowledging nothing, or more than was sent, is noncompliant
+    if (0 == p_frame->code || p_conn_info->in_flight < p_frame->code)
+    {
+        res = RPLIB_ERROR;
+        goto leave;
+    }
+    rpchat_conn_proc_note_acked(p_conn_info, p_frame->code);
+    p_conn_info->in_flight -= p_frame->code;
+    res = RPLIB_SUCCESS;
+leave:
+    return res;
+}
 int
 rpchat_conn_info_submit_msg(rpchat_conn_info_t *p_sender_info,
                             char               *p_msg_buf,
@@ -860,15 +2830,92 @@ rpchat_conn_info_submit_msg(rpchat_conn_info_t *p_sender_info,
 {
     int res = RPLIB_UNSUCCESS;
 
-    // send message
-    res = 0 > rpchat_sendmsg(p_sender_info->h_fd, p_msg_buf, sz_msg_buf)
-              ? RPLIB_UNSUCCESS
-              : RPLIB_SUCCESS;
-    // if sendmsg fails, set error state
-    if (RPLIB_UNSUCCESS == res)
+    // queue behind anything not yet written, then write what the socket takes.
+    // Remainder is flushed once EPOLLOUT fires
+    res = rpchat_conn_info_queue_outbound(p_sender_info, p_msg_buf, sz_msg_buf);
+    if (RPLIB_SUCCESS == res)
+    {
+        res = rpchat_conn_info_flush_outbound(p_sender_info);
+    }
+    // if queueing or sending fails, set error state
+    if (RPLIB_SUCCESS != res)
+    {
+        p_sender_info->conn_status = RPCHAT_CONN_ERR;
+        res                        = RPLIB_UNSUCCESS;
+    }
+
+    return res;
+}
+
+int
+rpchat_conn_info_submit_shared(rpchat_conn_info_t  *p_sender_info,
+                               rpchat_shared_msg_t *p_shared_msg)
+{
+    int res = RPLIB_UNSUCCESS;
+
+    // queue by reference, then write what the socket takes
+    res = rpchat_conn_info_queue_shared(p_sender_info, p_shared_msg);
+    if (RPLIB_SUCCESS == res)
+    {
+        res = rpchat_conn_info_flush_outbound(p_sender_info);
+    }
+    // if queueing or sending fails, set error state
+    if (RPLIB_SUCCESS != res)
     {
         p_sender_info->conn_status = RPCHAT_CONN_ERR;
+        res                        = RPLIB_UNSUCCESS;
     }
 
     return res;
 }
+
+void
+rpchat_flush_lingering(rpchat_conn_queue_t *p_conn_queue,
+                       rplib_tpool_t       *p_tpool)
+{
+    rpchat_conn_info_t  *p_conn_info = NULL;
+    rpchat_conn_info_t  *p_next_info = NULL;
+    rpchat_conn_extra_t *p_extra     = NULL; // posted to, so never NULL
+    int                  res         = RPLIB_SUCCESS;
+
+    for (p_conn_info = rpchat_conn_queue_take_lingering(p_conn_queue);
+         NULL != p_conn_info;
+         p_conn_info = p_next_info)
+    {
+        p_extra     = atomic_load(&p_conn_info->p_extra);
+        p_next_info = p_extra->p_next_linger;
+        pthread_mutex_lock(&p_extra->mutex_outbox);
+        res = RPLIB_SUCCESS;
+        if (RPCHAT_FLUSH_QUEUED != p_extra->flush_state)
+        {
+            p_extra->flush_state = RPCHAT_FLUSH_QUEUED;
+            res                  = rpchat_conn_proc_enqueue_signal(
+                p_conn_info, p_conn_queue, p_tpool, RPCHAT_PROC_EVENT_FLUSH);
+        }
+        // keeps waiting, still counted as pending, until a flush is queued
+        if (RPLIB_SUCCESS != res)
+        {
+            p_extra->flush_state = RPCHAT_FLUSH_IDLE;
+            rpchat_conn_queue_linger(p_conn_queue, p_conn_info);
+            pthread_mutex_unlock(&p_extra->mutex_outbox);
+            continue;
+        }
+        p_extra->b_lingering = false;
+        pthread_mutex_unlock(&p_extra->mutex_outbox);
+        // the queued flush holds the connection now
+        atomic_fetch_sub(&p_conn_info->pending_jobs, 1);
+    }
+}
+
+void
+rpchat_deliver_mail(rpchat_conn_queue_t *p_conn_queue, rplib_tpool_t *p_tpool)
+{
+    rpchat_shared_msg_t *p_shared_msg = NULL;
+
+    // sender lives on another reactor, so every local client receives it
+    while (NULL != (p_shared_msg = rpchat_conn_queue_take_mail(p_conn_queue)))
+    {
+        rpchat_conn_proc_fan_out(p_conn_queue, NULL, p_tpool, p_shared_msg);
+        rpchat_shared_msg_release(p_shared_msg);
+    }
+}